@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cachedsourcebench"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "include/NuCachedSource2.h"
+#include "include/SharedPageCache.h"
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-s <stream size KB>] [-p <preview size KB>]"
+                    " [-l <latency ms>] [-b <bandwidth KB/s>] [-r <read size>]\n", me);
+    fprintf(stderr, "       -s size of the stream, default 8192\n");
+    fprintf(stderr, "       -p amount read by the preview player, default 2048\n");
+    fprintf(stderr, "       -l round trip time per request, default 20\n");
+    fprintf(stderr, "       -b bandwidth of the fake server, default 4096\n");
+    fprintf(stderr, "       -r size of each read, default 16384\n");
+
+    exit(1);
+}
+
+using namespace android;
+
+// Stands in for an HTTP source: every request costs a round trip plus
+// transfer time, and the bytes served are counted.
+struct FakeHTTPSource : public DataSource {
+    FakeHTTPSource(off64_t size, int64_t latencyUs, size_t bytesPerSec)
+        : mSize(size),
+          mLatencyUs(latencyUs),
+          mBytesPerSec(bytesPerSec),
+          mNumRequests(0),
+          mNumBytesServed(0) {
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset >= mSize) {
+            return 0;
+        }
+        if (offset + (off64_t)size > mSize) {
+            size = mSize - offset;
+        }
+
+        usleep(mLatencyUs + size * 1000000ll / mBytesPerSec);
+
+        uint8_t *out = (uint8_t *)data;
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = ExpectedByte(offset + i);
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        ++mNumRequests;
+        mNumBytesServed += size;
+
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mSize;
+        return OK;
+    }
+
+    virtual String8 getUri() {
+        return String8("http://127.0.0.1/cachedsourcebench.mp4");
+    }
+
+    void getStats(size_t *requests, size_t *bytes) const {
+        Mutex::Autolock autoLock(mLock);
+        *requests = mNumRequests;
+        *bytes = mNumBytesServed;
+    }
+
+    static uint8_t ExpectedByte(off64_t offset) {
+        return (offset * 31 + (offset >> 12)) & 0xff;
+    }
+
+private:
+    off64_t mSize;
+    int64_t mLatencyUs;
+    size_t mBytesPerSec;
+
+    mutable Mutex mLock;
+    size_t mNumRequests;
+    size_t mNumBytesServed;
+};
+
+static int compareInt64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// Reads the first |length| bytes of |source| sequentially, like an
+// extractor would, and reports the read latency.
+static void play(
+        const char *name, const sp<FakeHTTPSource> &server,
+        off64_t length, size_t readSize) {
+    sp<NuCachedSource2> source = NuCachedSource2::Create(server);
+    source->enableSharing(String8("cachedsourcebench"), NULL);
+
+    Vector<int64_t> latencies;
+    uint8_t *buffer = new uint8_t[readSize];
+    size_t numNoCopy = 0;
+    bool corrupt = false;
+
+    int64_t startUs = ALooper::GetNowUs();
+    for (off64_t offset = 0; offset < length; offset += readSize) {
+        int64_t readStartUs = ALooper::GetNowUs();
+
+        sp<ABuffer> page;
+        const uint8_t *data;
+        ssize_t n;
+        if (source->readAtNoCopy(offset, readSize, &page, &data) == OK) {
+            n = readSize;
+            ++numNoCopy;
+        } else {
+            n = source->readAt(offset, buffer, readSize);
+            data = buffer;
+        }
+
+        latencies.push(ALooper::GetNowUs() - readStartUs);
+
+        if (n <= 0) {
+            break;
+        }
+
+        for (ssize_t i = 0; i < n; ++i) {
+            if (data[i] != FakeHTTPSource::ExpectedByte(offset + i)) {
+                corrupt = true;
+                break;
+            }
+        }
+    }
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    delete[] buffer;
+
+    size_t fetched, shared;
+    source->getStats(&fetched, &shared);
+    source.clear();
+
+    qsort(latencies.editArray(), latencies.size(), sizeof(int64_t), compareInt64);
+
+    printf("  %-8s %6.2f secs, %zu reads (%zu zero-copy), latency p50 %.2f ms"
+           " p99 %.2f ms max %.2f ms%s\n",
+           name, elapsedUs / 1E6, latencies.size(), numNoCopy,
+           latencies[latencies.size() / 2] / 1E3,
+           latencies[latencies.size() * 99 / 100] / 1E3,
+           latencies[latencies.size() - 1] / 1E3,
+           corrupt ? ", DATA MISMATCH" : "");
+    printf("           fetched %zu bytes, %zu bytes from the shared cache\n",
+           fetched, shared);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    off64_t streamSize = 8192 * 1024ll;
+    off64_t previewSize = 2048 * 1024ll;
+    int64_t latencyUs = 20000ll;
+    size_t bytesPerSec = 4096 * 1024;
+    size_t readSize = 16384;
+
+    int res;
+    while ((res = getopt(argc, argv, "?s:p:l:b:r:")) >= 0) {
+        switch (res) {
+            case 's':
+            {
+                streamSize = atoll(optarg) * 1024;
+                break;
+            }
+
+            case 'p':
+            {
+                previewSize = atoll(optarg) * 1024;
+                break;
+            }
+
+            case 'l':
+            {
+                latencyUs = atoll(optarg) * 1000;
+                break;
+            }
+
+            case 'b':
+            {
+                bytesPerSec = atoi(optarg) * 1024;
+                break;
+            }
+
+            case 'r':
+            {
+                readSize = atoi(optarg);
+                break;
+            }
+
+            case '?':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    if (streamSize <= 0 || previewSize <= 0 || latencyUs < 0
+            || bytesPerSec == 0 || readSize == 0) {
+        usage(me);
+    }
+
+    SharedPageCache *cache = SharedPageCache::getInstance();
+    size_t budget = cache->maxBytes();
+
+    for (int shared = 0; shared <= 1; ++shared) {
+        cache->setMaxBytes(shared ? budget : 0);
+
+        printf("%s shared cache (budget %zu KB):\n",
+               shared ? "with" : "without", shared ? budget / 1024 : 0);
+
+        sp<FakeHTTPSource> server =
+            new FakeHTTPSource(streamSize, latencyUs, bytesPerSec);
+
+        // A preview player reads the start of the stream, then the stream
+        // is opened again for playback.
+        play("preview", server, previewSize, readSize);
+        play("playback", server, streamSize, readSize);
+
+        size_t requests, bytes;
+        server->getStats(&requests, &bytes);
+
+        SharedPageCache::Stats stats;
+        cache->getStats(&stats);
+
+        printf("  server: %zu requests, %zu bytes\n", requests, bytes);
+        printf("  cache: %zu/%zu hits, %zu insertions, %zu evictions, %zu pages\n",
+               stats.mHits, stats.mLookups, stats.mInsertions, stats.mEvictions,
+               stats.mPages);
+
+        cache->trim(SharedPageCache::TRIM_COMPLETE);
+    }
+
+    return 0;
+}
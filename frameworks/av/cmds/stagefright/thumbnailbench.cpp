@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "thumbnailbench"
+#include <inttypes.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utils/Log.h>
+
+#include <binder/ProcessState.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AString.h>
+#include <media/stagefright/MediaSource.h>
+#include <private/media/VideoFrame.h>
+#include <utils/Vector.h>
+
+#include "include/StagefrightMetadataRetriever.h"
+#include "include/ThumbnailCache.h"
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-f] [-w <width>] [-h <height>] [-n <passes>]"
+                    " <directory>\n", me);
+    fprintf(stderr, "       -f use getFrameAtTime() at full resolution\n");
+    fprintf(stderr, "       -w maximum thumbnail width, default 512\n");
+    fprintf(stderr, "       -h maximum thumbnail height, default 384\n");
+    fprintf(stderr, "       -n number of passes over the directory, default 2;"
+                    " passes after the first are served from the cache\n");
+
+    exit(1);
+}
+
+using namespace android;
+
+static void collectFiles(const char *dir, Vector<AString> *files) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "unable to open %s\n", dir);
+        return;
+    }
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        AString path = dir;
+        path.append("/");
+        path.append(de->d_name);
+
+        struct stat sb;
+        if (stat(path.c_str(), &sb) != 0) {
+            continue;
+        }
+
+        if (S_ISDIR(sb.st_mode)) {
+            collectFiles(path.c_str(), files);
+        } else if (S_ISREG(sb.st_mode)) {
+            files->push(path);
+        }
+    }
+
+    closedir(d);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    bool fullFrame = false;
+    int32_t maxWidth = 512;
+    int32_t maxHeight = 384;
+    int passes = 2;
+
+    int res;
+    while ((res = getopt(argc, argv, "?fw:h:n:")) >= 0) {
+        switch (res) {
+            case 'f':
+            {
+                fullFrame = true;
+                break;
+            }
+
+            case 'w':
+            {
+                maxWidth = atoi(optarg);
+                break;
+            }
+
+            case 'h':
+            {
+                maxHeight = atoi(optarg);
+                break;
+            }
+
+            case 'n':
+            {
+                passes = atoi(optarg);
+                break;
+            }
+
+            case '?':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc != 1 || passes < 1 || maxWidth <= 0 || maxHeight <= 0) {
+        usage(me);
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    Vector<AString> files;
+    collectFiles(argv[0], &files);
+
+    for (int pass = 0; pass < passes; ++pass) {
+        size_t numFrames = 0;
+        int64_t startUs = ALooper::GetNowUs();
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            int fd = open(files[i].c_str(), O_RDONLY | O_LARGEFILE);
+            if (fd < 0) {
+                continue;
+            }
+
+            struct stat sb;
+            fstat(fd, &sb);
+
+            sp<StagefrightMetadataRetriever> retriever = new StagefrightMetadataRetriever;
+            if (retriever->setDataSource(fd, 0, sb.st_size) == OK) {
+                VideoFrame *frame = fullFrame
+                    ? retriever->getFrameAtTime(
+                            -1, MediaSource::ReadOptions::SEEK_CLOSEST_SYNC)
+                    : retriever->getThumbnailAtTime(
+                            -1, MediaSource::ReadOptions::SEEK_CLOSEST_SYNC,
+                            maxWidth, maxHeight);
+
+                if (frame != NULL) {
+                    ALOGV("%s: %ux%u", files[i].c_str(), frame->mWidth, frame->mHeight);
+                    ++numFrames;
+                    delete frame;
+                }
+            }
+            retriever.clear();
+
+            close(fd);
+        }
+
+        int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+        printf("pass %d: %zu/%zu thumbnails in %.2f secs, %.2f thumbnails/sec\n",
+               pass, numFrames, files.size(), elapsedUs / 1E6,
+               elapsedUs > 0 ? numFrames * 1E6 / elapsedUs : 0.0);
+    }
+
+    size_t hits, misses, bytes;
+    ThumbnailCache::getInstance()->getStats(&hits, &misses, &bytes);
+
+    size_t reused, created;
+    ThumbnailDecoderPool::getInstance()->getStats(&reused, &created);
+
+    printf("cache: %zu hits, %zu misses, %zu bytes; decoders: %zu reused, %zu created\n",
+           hits, misses, bytes, reused, created);
+
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "webmbench"
+#include <inttypes.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Log.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/MediaBufferGroup.h>
+#include <media/stagefright/MediaDefs.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MediaSource.h>
+#include <media/stagefright/MetaData.h>
+
+#include "webm/WebmWriter.h"
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d <duration s>] [-f <fps>] [-b <video bitrate kbps>]"
+                    " [-a] [-o <output file>]\n", me);
+    fprintf(stderr, "       -d duration of the stream, default 3600\n");
+    fprintf(stderr, "       -f video frame rate, default 30\n");
+    fprintf(stderr, "       -b video bit rate, default 1000\n");
+    fprintf(stderr, "       -a also write an audio track\n");
+    fprintf(stderr, "       -o output file, default /data/local/tmp/webmbench.webm\n");
+
+    exit(1);
+}
+
+using namespace android;
+
+// Produces frames as fast as the writer takes them, with timestamps of a
+// real-time stream. Only the sizes matter to the writer, the payload is
+// not valid VP8 or Vorbis.
+struct SyntheticSource : public MediaSource {
+    SyntheticSource(bool audio, int64_t durationUs, int32_t frameRate, size_t frameSize)
+        : mAudio(audio),
+          mDurationUs(durationUs),
+          mFrameRate(frameRate),
+          mFrameSize(frameSize),
+          mNumFramesOutput(0) {
+        // room for key frames, which are several times the average size
+        for (int i = 0; i < 4; ++i) {
+            mGroup.add_buffer(new MediaBuffer(mFrameSize * 8));
+        }
+    }
+
+    virtual sp<MetaData> getFormat() {
+        sp<MetaData> meta = new MetaData;
+        if (mAudio) {
+            static const uint8_t kInfo[] = { 1, 'v', 'o', 'r', 'b', 'i', 's' };
+            static const uint8_t kBooks[] = { 5, 'v', 'o', 'r', 'b', 'i', 's' };
+            meta->setCString(kKeyMIMEType, MEDIA_MIMETYPE_AUDIO_VORBIS);
+            meta->setInt32(kKeyChannelCount, 2);
+            meta->setInt32(kKeySampleRate, 48000);
+            meta->setData(kKeyVorbisInfo, 0, kInfo, sizeof(kInfo));
+            meta->setData(kKeyVorbisBooks, 0, kBooks, sizeof(kBooks));
+        } else {
+            meta->setCString(kKeyMIMEType, MEDIA_MIMETYPE_VIDEO_VP8);
+            meta->setInt32(kKeyWidth, 1280);
+            meta->setInt32(kKeyHeight, 720);
+        }
+        return meta;
+    }
+
+    virtual status_t start(MetaData *params __unused) {
+        mNumFramesOutput = 0;
+        return OK;
+    }
+
+    virtual status_t stop() {
+        return OK;
+    }
+
+    virtual status_t read(
+            MediaBuffer **buffer, const MediaSource::ReadOptions *options __unused) {
+        int64_t timeUs = mNumFramesOutput * 1000000ll / mFrameRate;
+        if (timeUs >= mDurationUs) {
+            return ERROR_END_OF_STREAM;
+        }
+
+        status_t err = mGroup.acquire_buffer(buffer);
+        if (err != OK) {
+            return err;
+        }
+
+        bool isSync = mAudio || (mNumFramesOutput % mFrameRate) == 0;
+        // vary the sizes so that frame buffers are not all alike
+        size_t size = mFrameSize / 2 + (mNumFramesOutput * 7919) % mFrameSize;
+        if (isSync && !mAudio) {
+            size *= 4;
+        }
+        memset((*buffer)->data(), mNumFramesOutput & 0xff, size);
+
+        (*buffer)->set_range(0, size);
+        (*buffer)->meta_data()->clear();
+        (*buffer)->meta_data()->setInt64(kKeyTime, timeUs);
+        (*buffer)->meta_data()->setInt32(kKeyIsSyncFrame, isSync);
+        ++mNumFramesOutput;
+
+        return OK;
+    }
+
+    int64_t numFramesOutput() const {
+        return mNumFramesOutput;
+    }
+
+protected:
+    virtual ~SyntheticSource() {}
+
+private:
+    bool mAudio;
+    int64_t mDurationUs;
+    int32_t mFrameRate;
+    size_t mFrameSize;
+    MediaBufferGroup mGroup;
+    int64_t mNumFramesOutput;
+
+    SyntheticSource(const SyntheticSource &);
+    SyntheticSource &operator=(const SyntheticSource &);
+};
+
+// Prints the current and peak resident set size.
+static void printMemory(const char *when) {
+    FILE *f = fopen("/proc/self/status", "r");
+    if (f == NULL) {
+        return;
+    }
+
+    long rssKB = -1, hwmKB = -1;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (!strncmp(line, "VmRSS:", 6)) {
+            rssKB = atol(line + 6);
+        } else if (!strncmp(line, "VmHWM:", 6)) {
+            hwmKB = atol(line + 6);
+        }
+    }
+    fclose(f);
+
+    printf("  %-8s RSS %ld KB, peak RSS %ld KB\n", when, rssKB, hwmKB);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    int64_t durationUs = 3600 * 1000000ll;
+    int32_t frameRate = 30;
+    int32_t bitRateKbps = 1000;
+    bool withAudio = false;
+    const char *outPath = "/data/local/tmp/webmbench.webm";
+
+    int res;
+    while ((res = getopt(argc, argv, "?d:f:b:ao:")) >= 0) {
+        switch (res) {
+            case 'd':
+            {
+                durationUs = atoll(optarg) * 1000000ll;
+                break;
+            }
+
+            case 'f':
+            {
+                frameRate = atoi(optarg);
+                break;
+            }
+
+            case 'b':
+            {
+                bitRateKbps = atoi(optarg);
+                break;
+            }
+
+            case 'a':
+            {
+                withAudio = true;
+                break;
+            }
+
+            case 'o':
+            {
+                outPath = optarg;
+                break;
+            }
+
+            case '?':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    if (durationUs <= 0 || frameRate <= 0 || bitRateKbps <= 0) {
+        usage(me);
+    }
+
+    int fd = open(outPath, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "unable to create %s\n", outPath);
+        return 1;
+    }
+
+    printMemory("before");
+
+    sp<SyntheticSource> video = new SyntheticSource(
+            false, durationUs, frameRate, bitRateKbps * 1000 / 8 / frameRate);
+    // 20ms Vorbis packets at 128kbps
+    sp<SyntheticSource> audio = withAudio
+            ? new SyntheticSource(true, durationUs, 50, 128000 / 8 / 50) : NULL;
+
+    sp<WebmWriter> writer = new WebmWriter(fd);
+    CHECK_EQ(writer->addSource(video), (status_t)OK);
+    if (audio != NULL) {
+        CHECK_EQ(writer->addSource(audio), (status_t)OK);
+    }
+
+    sp<MetaData> params = new MetaData;
+    params->setInt32(kKeyBitRate, bitRateKbps * 1000);
+    params->setInt32(kKeyRealTimeRecording, false);
+
+    int64_t startUs = ALooper::GetNowUs();
+    CHECK_EQ(writer->start(params.get()), (status_t)OK);
+    while (!writer->reachedEOS()) {
+        usleep(100000);
+    }
+    CHECK_EQ(writer->stop(), (status_t)OK);
+    int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+    int64_t numFrames = video->numFramesOutput();
+    if (audio != NULL) {
+        numFrames += audio->numFramesOutput();
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+
+    printf("%.0f secs of stream, %" PRId64 " frames in %.2f secs, %.1f frames/sec\n",
+           durationUs / 1E6, numFrames, elapsedUs / 1E6, numFrames * 1E6 / elapsedUs);
+    printf("  %s, %lld bytes\n", outPath, (long long)st.st_size);
+    printMemory("after");
+
+    writer.clear();
+    close(fd);
+    unlink(outPath);
+
+    return 0;
+}
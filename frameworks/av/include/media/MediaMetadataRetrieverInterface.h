@@ -43,6 +43,8 @@ public:
     virtual status_t    setDataSource(int fd, int64_t offset, int64_t length) = 0;
     virtual status_t setDataSource(const sp<DataSource>& source) = 0;
     virtual VideoFrame* getFrameAtTime(int64_t timeUs, int option) = 0;
+    virtual VideoFrame* getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight) = 0;
     virtual MediaAlbumArt* extractAlbumArt() = 0;
     virtual const char* extractMetadata(int keyCode) = 0;
 };
@@ -55,6 +57,8 @@ public:
 
     virtual             ~MediaMetadataRetrieverInterface() {}
     virtual VideoFrame* getFrameAtTime(int64_t timeUs, int option) { return NULL; }
+    virtual VideoFrame* getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight) { return NULL; }
     virtual MediaAlbumArt* extractAlbumArt() { return NULL; }
     virtual const char* extractMetadata(int keyCode) { return NULL; }
 };
@@ -52,7 +52,8 @@ public:
             const KeyedVector<String8, String8> *headers = NULL,
             String8 *contentType = NULL,
             HTTPBase *httpSource = NULL,
-            bool useExtendedCache = false);
+            bool useExtendedCache = false,
+            const String8 &sharingClient = String8());
 
     static sp<DataSource> CreateMediaHTTP(const sp<IMediaHTTPService> &httpService);
     static sp<DataSource> CreateFromIDataSource(const sp<IDataSource> &source);
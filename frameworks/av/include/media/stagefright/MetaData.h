@@ -94,6 +94,8 @@ enum {
     kKeyYear              = 'year',  // cstring
     kKeyAlbumArt          = 'albA',  // compressed image data
     kKeyAlbumArtMIME      = 'alAM',  // cstring
+    kKeyAlbumArtOffset    = 'albO',  // int64_t, location of album art in the source
+    kKeyAlbumArtSize      = 'albS',  // int32_t, if not copied to kKeyAlbumArt
     kKeyAuthor            = 'auth',  // cstring
     kKeyCDTrackNumber     = 'cdtr',  // cstring
     kKeyDiscNumber        = 'dnum',  // cstring
@@ -208,6 +208,31 @@ sp<IMemory> MetadataRetrieverClient::getFrameAtTime(int64_t timeUs, int option)
         ALOGE("failed to capture a video frame");
         return NULL;
     }
+    return storeFrame_l(frame);
+}
+
+sp<IMemory> MetadataRetrieverClient::getThumbnailAtTime(int64_t timeUs, int option,
+        int32_t maxWidth, int32_t maxHeight)
+{
+    ALOGV("getThumbnailAtTime: time(%" PRId64 " us) option(%d) max(%dx%d)",
+            timeUs, option, maxWidth, maxHeight);
+    Mutex::Autolock lock(mLock);
+    Mutex::Autolock glock(sLock);
+    mThumbnail.clear();
+    if (mRetriever == NULL) {
+        ALOGE("retriever is not initialized");
+        return NULL;
+    }
+    VideoFrame *frame = mRetriever->getThumbnailAtTime(timeUs, option, maxWidth, maxHeight);
+    if (frame == NULL) {
+        ALOGE("failed to capture a thumbnail");
+        return NULL;
+    }
+    return storeFrame_l(frame);
+}
+
+sp<IMemory> MetadataRetrieverClient::storeFrame_l(VideoFrame *frame)
+{
     size_t size = sizeof(VideoFrame) + frame->mSize;
     sp<MemoryHeapBase> heap = new MemoryHeapBase(size, 0, "MetadataRetrieverClient");
     if (heap == NULL) {
@@ -380,10 +380,12 @@ void NuPlayer::GenericSource::onPrepareAsync() {
                 }
             }
 
+            // Only pages fetched for the same app are shared.
             mDataSource = DataSource::CreateFromURI(
                    mHTTPService, uri, &mUriHeaders, &contentType,
                    static_cast<HTTPBase *>(mHttpSource.get()),
-                   true /*use extended cache*/);
+                   true /*use extended cache*/,
+                   mUIDValid ? String8::format("uid:%d", mUID) : String8());
         } else {
             mIsWidevine = false;
 
@@ -1829,6 +1829,13 @@ void NuPlayer::getStats(Vector<sp<AMessage> > *mTrackStats) {
     }
 }
 
+void NuPlayer::dumpRendererStats(AString *out) {
+    sp<Renderer> renderer = mRenderer;
+    if (renderer != NULL) {
+        renderer->dumpVideoRenderTiming(out);
+    }
+}
+
 sp<MetaData> NuPlayer::getFileMeta() {
     return mSource->getFileFormatMeta();
 }
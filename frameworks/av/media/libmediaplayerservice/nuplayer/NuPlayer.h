@@ -97,6 +97,7 @@ struct NuPlayer : public AHandler {
     status_t selectTrack(size_t trackIndex, bool select, int64_t timeUs);
     status_t getCurrentPosition(int64_t *mediaUs);
     void getStats(Vector<sp<AMessage> > *mTrackStats);
+    void dumpRendererStats(AString *out);
 
     sp<MetaData> getFileMeta();
     float getFrameRate();
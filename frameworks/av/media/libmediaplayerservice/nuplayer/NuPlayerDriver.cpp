@@ -711,6 +711,8 @@ status_t NuPlayerDriver::dump(
         }
     }
 
+    mPlayer->dumpRendererStats(&logString);
+
     ALOGI("%s", logString.c_str());
 
     if (fd >= 0) {
@@ -358,6 +358,10 @@ int64_t NuPlayer::Renderer::getVideoLateByUs() {
     return mVideoLateByUs;
 }
 
+void NuPlayer::Renderer::dumpVideoRenderTiming(AString *out) const {
+    mVideoRenderTiming.dump(out);
+}
+
 status_t NuPlayer::Renderer::openAudioSink(
         const sp<AMessage> &format,
         bool offloadOnly,
@@ -1096,11 +1100,15 @@ void NuPlayer::Renderer::postDrainVideoQueue() {
     ALOGW_IF(delayUs > 500000, "unusually high delayUs: %" PRId64, delayUs);
     // post 2 display refreshes before rendering is due
     // FIXME currently this increases power consumption, so unless frame-accurate
-    // AV sync is requested, post closer to required render time (at 0.63 vsyncs)
+    // AV sync is requested, post as close to the required render time as the
+    // recently observed wakeup jitter allows (at least 0.63 vsyncs ahead)
+    int64_t leadUs = twoVsyncsUs;
     if (!sFrameAccurateAVsync) {
-        twoVsyncsUs >>= 4;
+        leadUs = mVideoRenderTiming.getLeadTimeUs(twoVsyncsUs >> 4, twoVsyncsUs);
     }
-    msg->post(delayUs > twoVsyncsUs ? delayUs - twoVsyncsUs : 0);
+    int64_t postDelayUs = delayUs > leadUs ? delayUs - leadUs : 0;
+    entry.mDrainWakeupUs = nowUs + postDelayUs;
+    msg->post(postDelayUs);
 
     mDrainVideoQueuePending = true;
 }
@@ -1145,6 +1153,9 @@ void NuPlayer::Renderer::onDrainVideoQueue() {
         setVideoLateByUs(nowUs - realTimeUs);
         tooLate = (mVideoLateByUs > 40000);
 
+        mVideoRenderTiming.onFrameDrained(
+                entry->mQueuedTimeUs, entry->mDrainWakeupUs, realTimeUs, nowUs, tooLate);
+
         if (tooLate) {
             ALOGV("video late by %lld us (%.2f secs)",
                  (long long)mVideoLateByUs, mVideoLateByUs / 1E6);
@@ -1237,6 +1248,8 @@ void NuPlayer::Renderer::onQueueBuffer(const sp<AMessage> &msg) {
     entry.mOffset = 0;
     entry.mFinalResult = OK;
     entry.mBufferOrdinal = ++mTotalBuffersQueued;
+    entry.mQueuedTimeUs = ALooper::GetNowUs();
+    entry.mDrainWakeupUs = -1;
 
     if (audio) {
         Mutex::Autolock autoLock(mLock);
@@ -1316,6 +1329,8 @@ void NuPlayer::Renderer::onQueueEOS(const sp<AMessage> &msg) {
     QueueEntry entry;
     entry.mOffset = 0;
     entry.mFinalResult = finalResult;
+    entry.mQueuedTimeUs = -1;
+    entry.mDrainWakeupUs = -1;
 
     if (audio) {
         Mutex::Autolock autoLock(mLock);
@@ -1408,6 +1423,7 @@ void NuPlayer::Renderer::onFlush(const sp<AMessage> &msg) {
         if (mVideoScheduler != NULL) {
             mVideoScheduler->restart();
         }
+        mVideoRenderTiming.restart();
 
         Mutex::Autolock autoLock(mLock);
         ++mVideoDrainGeneration;
@@ -22,6 +22,7 @@
 #include <media/AVSyncSettings.h>
 
 #include "NuPlayer.h"
+#include "VideoRenderTiming.h"
 
 namespace android {
 
@@ -73,6 +74,9 @@ struct NuPlayer::Renderer : public AHandler {
     status_t getCurrentPosition(int64_t *mediaUs);
     int64_t getVideoLateByUs();
 
+    // Appends video render timing statistics for dumpsys.
+    void dumpVideoRenderTiming(AString *out) const;
+
     virtual audio_stream_type_t getAudioStreamType(){return AUDIO_STREAM_DEFAULT;}
 
     status_t openAudioSink(
@@ -131,6 +135,11 @@ protected:
         size_t mOffset;
         status_t mFinalResult;
         int32_t mBufferOrdinal;
+
+        // video only: when the buffer was queued to the renderer and when
+        // its drain message is due, for VideoRenderTiming.
+        int64_t mQueuedTimeUs;
+        int64_t mDrainWakeupUs;
     };
 
     static const int64_t kMinPositionUpdateDelayUs;
@@ -143,6 +152,7 @@ protected:
     List<QueueEntry> mVideoQueue;
     uint32_t mNumFramesWritten;
     sp<VideoFrameScheduler> mVideoScheduler;
+    VideoRenderTiming mVideoRenderTiming;
 
     bool mDrainAudioQueuePending;
     bool mDrainVideoQueuePending;
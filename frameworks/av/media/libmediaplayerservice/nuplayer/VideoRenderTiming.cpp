@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "VideoRenderTiming"
+#include <utils/Log.h>
+
+#include <inttypes.h>
+
+#include "VideoRenderTiming.h"
+
+namespace android {
+
+// added on top of the observed wakeup jitter when computing the lead time
+const int64_t VideoRenderTiming::kLeadMarginUs = 1000ll;
+
+VideoRenderTiming::Histogram::Histogram(int64_t minUs, int64_t bucketUs)
+    : mMinUs(minUs),
+      mBucketUs(bucketUs) {
+    clear();
+}
+
+void VideoRenderTiming::Histogram::add(int64_t valueUs) {
+    int64_t index = (valueUs - mMinUs) / mBucketUs;
+    if (valueUs < mMinUs || index < 0) {
+        index = 0;
+    } else if (index >= kNumBuckets) {
+        index = kNumBuckets - 1;
+    }
+    ++mBuckets[index];
+    ++mCount;
+}
+
+void VideoRenderTiming::Histogram::clear() {
+    mCount = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+int64_t VideoRenderTiming::Histogram::percentile(float pct) const {
+    if (mCount == 0) {
+        return 0;
+    }
+
+    size_t target = (size_t)(mCount * pct / 100.f + 0.5f);
+    if (target == 0) {
+        target = 1;
+    }
+
+    size_t sum = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        sum += mBuckets[i];
+        if (sum >= target) {
+            return mMinUs + (int64_t)(i + 1) * mBucketUs;
+        }
+    }
+    return mMinUs + kNumBuckets * mBucketUs;
+}
+
+void VideoRenderTiming::Histogram::dump(const char *name, AString *out) const {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+            "    %s: n=%zu p50=%.1fms p90=%.1fms p95=%.1fms p99=%.1fms\n",
+            name, mCount,
+            percentile(50) / 1E3, percentile(90) / 1E3,
+            percentile(95) / 1E3, percentile(99) / 1E3);
+    out->append(buf);
+
+    if (mCount == 0) {
+        return;
+    }
+
+    // only print the populated range of buckets
+    size_t first = 0;
+    while (mBuckets[first] == 0) {
+        ++first;
+    }
+    size_t last = kNumBuckets - 1;
+    while (mBuckets[last] == 0) {
+        --last;
+    }
+
+    out->append("     ");
+    for (size_t i = first; i <= last; ++i) {
+        snprintf(buf, sizeof(buf), " [%" PRId64 "ms]%zu",
+                (mMinUs + (int64_t)i * mBucketUs) / 1000, mBuckets[i]);
+        out->append(buf);
+    }
+    out->append("\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VideoRenderTiming::VideoRenderTiming()
+    : mNumJitterSamples(0),
+      mJitterIndex(0),
+      mNumFrames(0),
+      mNumDropped(0),
+      mNumLate(0),
+      mWakeupJitter(0ll /* minUs */, 500ll /* bucketUs */),
+      mLateness(-32000ll /* minUs */, 1000ll /* bucketUs */),
+      mQueueLatency(0ll /* minUs */, 5000ll /* bucketUs */) {
+}
+
+void VideoRenderTiming::restart() {
+    Mutex::Autolock autoLock(mLock);
+    mNumJitterSamples = 0;
+    mJitterIndex = 0;
+}
+
+int64_t VideoRenderTiming::getLeadTimeUs(int64_t minLeadUs, int64_t maxLeadUs) const {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mNumJitterSamples == 0) {
+        return minLeadUs;
+    }
+
+    // 95th percentile of the recent wakeup jitter; the window is small
+    // enough that a partial selection sort is cheap.
+    int64_t sorted[kJitterWindow];
+    memcpy(sorted, mJitterUs, mNumJitterSamples * sizeof(int64_t));
+
+    size_t rank = (mNumJitterSamples * 95) / 100;
+    for (size_t i = 0; i <= rank; ++i) {
+        size_t minIndex = i;
+        for (size_t j = i + 1; j < mNumJitterSamples; ++j) {
+            if (sorted[j] < sorted[minIndex]) {
+                minIndex = j;
+            }
+        }
+        int64_t tmp = sorted[i];
+        sorted[i] = sorted[minIndex];
+        sorted[minIndex] = tmp;
+    }
+
+    int64_t leadUs = sorted[rank] + kLeadMarginUs;
+    if (leadUs < minLeadUs) {
+        leadUs = minLeadUs;
+    } else if (leadUs > maxLeadUs) {
+        leadUs = maxLeadUs;
+    }
+    return leadUs;
+}
+
+void VideoRenderTiming::onFrameDrained(
+        int64_t queuedUs, int64_t wakeupUs, int64_t renderUs,
+        int64_t drainedUs, bool dropped) {
+    Mutex::Autolock autoLock(mLock);
+
+    ++mNumFrames;
+    if (dropped) {
+        ++mNumDropped;
+    } else if (drainedUs > renderUs) {
+        ++mNumLate;
+    }
+
+    if (wakeupUs >= 0) {
+        int64_t jitterUs = drainedUs - wakeupUs;
+        if (jitterUs < 0) {
+            jitterUs = 0;
+        }
+        mJitterUs[mJitterIndex] = jitterUs;
+        mJitterIndex = (mJitterIndex + 1) % kJitterWindow;
+        if (mNumJitterSamples < kJitterWindow) {
+            ++mNumJitterSamples;
+        }
+        mWakeupJitter.add(jitterUs);
+    }
+
+    mLateness.add(drainedUs - renderUs);
+    if (queuedUs >= 0) {
+        mQueueLatency.add(drainedUs - queuedUs);
+    }
+
+    ALOGV("frame drained: queue %" PRId64 "us, jitter %" PRId64 "us, late %" PRId64 "us%s",
+            queuedUs >= 0 ? drainedUs - queuedUs : -1,
+            wakeupUs >= 0 ? drainedUs - wakeupUs : -1,
+            drainedUs - renderUs, dropped ? " (dropped)" : "");
+}
+
+void VideoRenderTiming::dump(AString *out) const {
+    Mutex::Autolock autoLock(mLock);
+
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+            "  video render timing: frames(%zu) dropped(%zu) late(%zu)\n",
+            mNumFrames, mNumDropped, mNumLate);
+    out->append(buf);
+
+    mWakeupJitter.dump("wakeup jitter", out);
+    mLateness.dump("render lateness", out);
+    mQueueLatency.dump("queue-to-render", out);
+}
+
+}  // namespace android
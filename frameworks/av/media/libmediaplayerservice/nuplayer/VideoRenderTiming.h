@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VIDEO_RENDER_TIMING_H_
+
+#define VIDEO_RENDER_TIMING_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// Collects per-frame timing of the video render path in NuPlayer::Renderer
+// and derives from it how far ahead of a frame's render time the drain
+// message needs to be posted. All times are passed in by the caller, so the
+// class can be driven by a simulated clock.
+//
+// For every frame three points in time are known:
+//   queued    - the decoder handed the frame to the renderer
+//   wakeup    - the time the drain message was scheduled to be handled
+//   render    - the vsync-aligned time the frame is meant to be displayed
+// and compared against the time the drain message was actually handled.
+struct VideoRenderTiming {
+    VideoRenderTiming();
+
+    // Forget the jitter history, e.g. after a flush or seek. Histograms are
+    // kept for the lifetime of the renderer.
+    void restart();
+
+    // Returns how long before |renderTimeUs| the drain message should fire.
+    // Tracks the observed looper wakeup jitter, bounded by [minLeadUs,
+    // maxLeadUs].
+    int64_t getLeadTimeUs(int64_t minLeadUs, int64_t maxLeadUs) const;
+
+    void onFrameDrained(
+            int64_t queuedUs, int64_t wakeupUs, int64_t renderUs,
+            int64_t drainedUs, bool dropped);
+
+    void dump(AString *out) const;
+
+    // Fixed-width bucket histogram of microsecond values, values outside
+    // the range are accounted to the first/last bucket.
+    struct Histogram {
+        Histogram(int64_t minUs, int64_t bucketUs);
+
+        void add(int64_t valueUs);
+        void clear();
+
+        size_t count() const { return mCount; }
+
+        // Upper bound of the bucket containing the |pct|-th percentile.
+        int64_t percentile(float pct) const;
+
+        void dump(const char *name, AString *out) const;
+
+        enum {
+            kNumBuckets = 64,
+        };
+
+    private:
+        int64_t mMinUs;
+        int64_t mBucketUs;
+        size_t mCount;
+        size_t mBuckets[kNumBuckets];
+    };
+
+    enum {
+        // Number of most recent wakeup jitter samples the lead time is
+        // derived from.
+        kJitterWindow = 64,
+    };
+
+    static const int64_t kLeadMarginUs;
+
+private:
+    mutable Mutex mLock;
+
+    int64_t mJitterUs[kJitterWindow];
+    size_t mNumJitterSamples;
+    size_t mJitterIndex;
+
+    size_t mNumFrames;
+    size_t mNumDropped;
+    size_t mNumLate;   // rendered after their render time
+
+    Histogram mWakeupJitter;
+    Histogram mLateness;
+    Histogram mQueueLatency;
+
+    DISALLOW_EVIL_CONSTRUCTORS(VideoRenderTiming);
+};
+
+}  // namespace android
+
+#endif  // VIDEO_RENDER_TIMING_H_
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "VideoRenderTiming_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include "VideoRenderTiming.h"
+
+namespace android {
+
+static const int64_t kVsyncPeriodUs = 16667;
+static const int64_t kTwoVsyncsUs = 2 * kVsyncPeriodUs;
+
+// Simulated display: vsyncs at a fixed period starting at time 0.
+struct FakeVsync {
+    FakeVsync(int64_t periodUs) : mPeriodUs(periodUs) {}
+
+    // first vsync at or after |timeUs|
+    int64_t next(int64_t timeUs) const {
+        return ((timeUs + mPeriodUs - 1) / mPeriodUs) * mPeriodUs;
+    }
+
+private:
+    int64_t mPeriodUs;
+};
+
+// Deterministic looper wakeup delay: uniform in [0, maxUs), with a spike
+// of |spikeUs| every |spikeEvery| frames.
+struct FakeJitter {
+    FakeJitter(int64_t maxUs, int64_t spikeUs = 0, size_t spikeEvery = 0)
+        : mMaxUs(maxUs), mSpikeUs(spikeUs), mSpikeEvery(spikeEvery),
+          mState(1), mCount(0) {}
+
+    int64_t next() {
+        ++mCount;
+        if (mSpikeEvery > 0 && mCount % mSpikeEvery == 0) {
+            return mSpikeUs;
+        }
+        if (mMaxUs == 0) {
+            return 0;
+        }
+        mState = mState * 1103515245u + 12345u;
+        return (mState >> 8) % mMaxUs;
+    }
+
+private:
+    int64_t mMaxUs;
+    int64_t mSpikeUs;
+    size_t mSpikeEvery;
+    uint32_t mState;
+    size_t mCount;
+};
+
+class VideoRenderTimingTest : public ::testing::Test {
+protected:
+    VideoRenderTimingTest() : mVsync(kVsyncPeriodUs), mNowUs(0), mNumLate(0) {}
+
+    // Plays |numFrames| of 60fps video through the same scheduling steps as
+    // NuPlayer::Renderer::postDrainVideoQueue()/onDrainVideoQueue().
+    void play(size_t numFrames, FakeJitter *jitter, size_t skipFrames = 0) {
+        mNumLate = 0;
+        for (size_t i = 0; i < numFrames; ++i) {
+            int64_t mediaTimeUs = mNowUs + kVsyncPeriodUs * 3;
+            int64_t renderUs = mVsync.next(mediaTimeUs);
+            int64_t queuedUs = mNowUs;
+
+            int64_t leadUs = mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs);
+            int64_t wakeupUs = renderUs - leadUs;
+            int64_t drainedUs = wakeupUs + jitter->next();
+
+            bool tooLate = drainedUs - renderUs > 40000;
+            mTiming.onFrameDrained(queuedUs, wakeupUs, renderUs, drainedUs, tooLate);
+
+            if (i >= skipFrames && drainedUs > renderUs) {
+                ++mNumLate;
+            }
+            mNowUs = drainedUs;
+        }
+    }
+
+    VideoRenderTiming mTiming;
+    FakeVsync mVsync;
+    int64_t mNowUs;
+    size_t mNumLate;
+};
+
+TEST_F(VideoRenderTimingTest, NoJitterKeepsMinimumLead) {
+    FakeJitter jitter(0);
+    play(300, &jitter);
+
+    EXPECT_EQ(kTwoVsyncsUs >> 4,
+            mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs));
+    EXPECT_EQ(0u, mNumLate);
+}
+
+TEST_F(VideoRenderTimingTest, LeadAdaptsToJitter) {
+    // wakeups up to 6ms late would miss most vsyncs with the default lead
+    FakeJitter jitter(6000);
+    play(600, &jitter, VideoRenderTiming::kJitterWindow);
+
+    int64_t leadUs = mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs);
+    EXPECT_GT(leadUs, 5000);
+    EXPECT_LE(leadUs, 6000 + VideoRenderTiming::kLeadMarginUs);
+
+    // the lead covers the 95th percentile, so only a small fraction is late
+    EXPECT_LT(mNumLate, 600u / 10);
+}
+
+TEST_F(VideoRenderTimingTest, LeadIsBounded) {
+    FakeJitter jitter(0, 100000 /* spikeUs */, 1 /* spikeEvery */);
+    play(100, &jitter);
+
+    EXPECT_EQ(kTwoVsyncsUs, mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs));
+}
+
+TEST_F(VideoRenderTimingTest, RestartForgetsJitter) {
+    FakeJitter jitter(6000);
+    play(200, &jitter);
+    EXPECT_GT(mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs), kTwoVsyncsUs >> 4);
+
+    mTiming.restart();
+    EXPECT_EQ(kTwoVsyncsUs >> 4, mTiming.getLeadTimeUs(kTwoVsyncsUs >> 4, kTwoVsyncsUs));
+}
+
+TEST_F(VideoRenderTimingTest, Dump) {
+    FakeJitter jitter(1000, 60000 /* spikeUs */, 50 /* spikeEvery */);
+    play(100, &jitter);
+
+    AString out;
+    mTiming.dump(&out);
+    ALOGV("%s", out.c_str());
+
+    EXPECT_GE(out.find("frames(100)"), 0);
+    EXPECT_GE(out.find("render lateness"), 0);
+}
+
+TEST(VideoRenderTimingHistogramTest, Percentiles) {
+    VideoRenderTiming::Histogram histogram(0 /* minUs */, 1000 /* bucketUs */);
+    EXPECT_EQ(0, histogram.percentile(50));
+
+    for (int64_t i = 0; i < 100; ++i) {
+        histogram.add(i * 100);   // 0 .. 9.9ms
+    }
+    EXPECT_EQ(100u, histogram.count());
+    EXPECT_EQ(5000, histogram.percentile(50));
+    EXPECT_EQ(10000, histogram.percentile(99));
+
+    // out of range values are clamped to the edge buckets
+    histogram.add(-5000);
+    histogram.add(1000000);
+    EXPECT_EQ(1000, histogram.percentile(0));
+    EXPECT_EQ(VideoRenderTiming::Histogram::kNumBuckets * 1000ll, histogram.percentile(100));
+}
+
+} // namespace android
@@ -2300,6 +2300,12 @@ status_t AwesomePlayer::finishSetDataSource_l() {
                     disconnectAtHighwatermark);
 #endif
 
+            // Only pages fetched for the same app are shared.
+            if (mUIDValid) {
+                mCachedSource->enableSharing(
+                        String8::format("uid:%d", mUID), &mUriHeaders);
+            }
+
             dataSource = mCachedSource;
         } else {
             dataSource = mConnectingDataSource;
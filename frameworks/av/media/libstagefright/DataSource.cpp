@@ -194,7 +194,8 @@ sp<DataSource> DataSource::CreateFromURI(
         const KeyedVector<String8, String8> *headers,
         String8 *contentType,
         HTTPBase *httpSource,
-        bool useExtendedCache) {
+        bool useExtendedCache,
+        const String8 &sharingClient) {
     if (contentType != NULL) {
         *contentType = "";
     }
@@ -250,17 +251,22 @@ sp<DataSource> DataSource::CreateFromURI(
                 *contentType = httpSource->getMIMEType();
             }
 
+            sp<NuCachedSource2> cachedSource;
             if (useExtendedCache) {
-                source = AVFactory::get()->createCachedSource(
+                cachedSource = AVFactory::get()->createCachedSource(
                         httpSource,
                         cacheConfig.isEmpty() ? NULL : cacheConfig.string(),
                         disconnectAtHighwatermark);
             } else {
-                source = NuCachedSource2::Create(
+                cachedSource = NuCachedSource2::Create(
                         httpSource,
                         cacheConfig.isEmpty() ? NULL : cacheConfig.string(),
                         disconnectAtHighwatermark);
             }
+            if (!sharingClient.isEmpty()) {
+                cachedSource->enableSharing(sharingClient, &nonCacheSpecificHeaders);
+            }
+            source = cachedSource;
         } else {
             // We do not want that prefetching, caching, datasource wrapper
             // in the widevine:// case.
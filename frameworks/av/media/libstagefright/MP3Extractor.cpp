@@ -22,9 +22,11 @@
 
 #include "include/avc_utils.h"
 #include "include/ID3.h"
+#include "include/ID3Index.h"
 #include "include/VBRISeeker.h"
 #include "include/XINGSeeker.h"
 
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/DataSource.h>
@@ -602,12 +604,6 @@ sp<MetaData> MP3Extractor::getMetaData() {
 
     meta->setCString(kKeyMIMEType, "audio/mpeg");
 
-    ID3 id3(mDataSource);
-
-    if (!id3.isValid()) {
-        return meta;
-    }
-
     struct Map {
         int key;
         const char *tag1;
@@ -628,6 +624,42 @@ sp<MetaData> MP3Extractor::getMetaData() {
     };
     static const size_t kNumMapEntries = sizeof(kMap) / sizeof(kMap[0]);
 
+    // The index only reads the frames asked for and leaves the album art in
+    // the source, use it for ID3v2 tags and fall back to ID3 for ID3v1.
+    ID3Index index(mDataSource);
+    if (index.isValid()) {
+        for (size_t i = 0; i < kNumMapEntries; ++i) {
+            String8 s;
+            if (index.getString(kMap[i].tag1, &s)
+                    || index.getString(kMap[i].tag2, &s)) {
+                meta->setCString(kMap[i].key, s);
+            }
+        }
+
+        off64_t artOffset;
+        size_t artSize;
+        String8 mime;
+        if (index.getAlbumArtLocation(&artOffset, &artSize, &mime)) {
+            meta->setInt64(kKeyAlbumArtOffset, artOffset);
+            meta->setInt32(kKeyAlbumArtSize, artSize);
+            meta->setCString(kKeyAlbumArtMIME, mime.string());
+        } else {
+            sp<ABuffer> art = index.readAlbumArt(&mime);
+            if (art != NULL) {
+                meta->setData(kKeyAlbumArt, MetaData::TYPE_NONE, art->data(), art->size());
+                meta->setCString(kKeyAlbumArtMIME, mime.string());
+            }
+        }
+
+        return meta;
+    }
+
+    ID3 id3(mDataSource);
+
+    if (!id3.isValid()) {
+        return meta;
+    }
+
     for (size_t i = 0; i < kNumMapEntries; ++i) {
         ID3::Iterator *it = new ID3::Iterator(id3, kMap[i].tag1);
         if (it->done()) {
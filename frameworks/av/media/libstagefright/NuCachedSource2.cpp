@@ -22,8 +22,10 @@
 
 #include "include/NuCachedSource2.h"
 #include "include/HTTPBase.h"
+#include "include/SharedPageCache.h"
 
 #include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaErrors.h>
@@ -35,7 +37,7 @@ struct PageCache {
     ~PageCache();
 
     struct Page {
-        void *mData;
+        sp<ABuffer> mBuffer;
         size_t mSize;
     };
 
@@ -43,6 +45,10 @@ struct PageCache {
     void releasePage(Page *page);
 
     void appendPage(Page *page);
+
+    // Appends a complete page taken from SharedPageCache.
+    void appendSharedPage(const sp<ABuffer> &buffer);
+
     size_t releaseFromStart(size_t maxBytes);
 
     size_t totalSize() const {
@@ -51,6 +57,10 @@ struct PageCache {
 
     void copy(size_t from, void *data, size_t size);
 
+    // Returns the page holding |from| and sets |*delta| to the position of
+    // |from| in it and |*avail| to the number of bytes from there.
+    sp<ABuffer> getPage(size_t from, size_t *delta, size_t *avail);
+
 private:
     size_t mPageSize;
     size_t mTotalSize;
@@ -78,7 +88,6 @@ void PageCache::freePages(List<Page *> *list) {
     while (it != list->end()) {
         Page *page = *it;
 
-        free(page->mData);
         delete page;
         page = NULL;
 
@@ -96,13 +105,20 @@ PageCache::Page *PageCache::acquirePage() {
     }
 
     Page *page = new Page;
-    page->mData = malloc(mPageSize);
+    page->mBuffer = new ABuffer(mPageSize);
     page->mSize = 0;
 
     return page;
 }
 
 void PageCache::releasePage(Page *page) {
+    if (page->mBuffer->getStrongCount() > 1) {
+        // Still referenced by SharedPageCache or another source, so it
+        // cannot be reused for new data.
+        delete page;
+        return;
+    }
+
     page->mSize = 0;
     mFreePages.push_back(page);
 }
@@ -112,6 +128,16 @@ void PageCache::appendPage(Page *page) {
     mActivePages.push_back(page);
 }
 
+void PageCache::appendSharedPage(const sp<ABuffer> &buffer) {
+    CHECK_EQ(buffer->capacity(), mPageSize);
+
+    Page *page = new Page;
+    page->mBuffer = buffer;
+    page->mSize = mPageSize;
+
+    appendPage(page);
+}
+
 size_t PageCache::releaseFromStart(size_t maxBytes) {
     size_t bytesReleased = 0;
 
@@ -156,11 +182,11 @@ void PageCache::copy(size_t from, void *data, size_t size) {
     size_t avail = (*it)->mSize - delta;
 
     if (avail >= size) {
-        memcpy(data, (const uint8_t *)(*it)->mData + delta, size);
+        memcpy(data, (*it)->mBuffer->base() + delta, size);
         return;
     }
 
-    memcpy(data, (const uint8_t *)(*it)->mData + delta, avail);
+    memcpy(data, (*it)->mBuffer->base() + delta, avail);
     ++it;
     data = (uint8_t *)data + avail;
     size -= avail;
@@ -170,13 +196,29 @@ void PageCache::copy(size_t from, void *data, size_t size) {
         if (copy > size) {
             copy = size;
         }
-        memcpy(data, (*it)->mData, copy);
+        memcpy(data, (*it)->mBuffer->base(), copy);
         data = (uint8_t *)data + copy;
         size -= copy;
         ++it;
     }
 }
 
+sp<ABuffer> PageCache::getPage(size_t from, size_t *delta, size_t *avail) {
+    CHECK_LT(from, mTotalSize);
+
+    size_t offset = 0;
+    List<Page *>::iterator it = mActivePages.begin();
+    while (from >= offset + (*it)->mSize) {
+        offset += (*it)->mSize;
+        ++it;
+    }
+
+    *delta = from - offset;
+    *avail = (*it)->mSize - *delta;
+
+    return (*it)->mBuffer;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 NuCachedSource2::NuCachedSource2(
@@ -193,6 +235,8 @@ NuCachedSource2::NuCachedSource2(
       mFetching(true),
       mDisconnecting(false),
       mLastFetchTimeUs(-1),
+      mNumBytesFetched(0),
+      mNumBytesShared(0),
       mNumRetriesLeft(kMaxNumRetries),
       mHighwaterThresholdBytes(kDefaultHighWaterThreshold),
       mLowwaterThresholdBytes(kDefaultLowWaterThreshold),
@@ -320,11 +364,14 @@ void NuCachedSource2::fetchInternal() {
     ALOGV("fetchInternal");
 
     bool reconnect = false;
+    String8 streamKey;
 
     {
         Mutex::Autolock autoLock(mLock);
         CHECK(mFinalStatus == OK || mNumRetriesLeft > 0);
 
+        streamKey = mStreamKey;
+
         if (mFinalStatus != OK) {
             --mNumRetriesLeft;
 
@@ -355,10 +402,29 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
+    // Pages are fetched at page-aligned offsets (a read after a seek or a
+    // short read only fills up to the next page boundary), so that
+    // complete pages can be shared with other sources of the same stream.
+    off64_t offset = mCacheOffset + mCache->totalSize();
+    size_t size = kPageSize - offset % kPageSize;
+
+    if (size == kPageSize) {
+        sp<ABuffer> shared = SharedPageCache::getInstance()->lookup(streamKey, offset);
+        if (shared != NULL) {
+            Mutex::Autolock autoLock(mLock);
+
+            mNumRetriesLeft = kMaxNumRetries;
+            mFinalStatus = OK;
+
+            mCache->appendSharedPage(shared);
+            mNumBytesShared += kPageSize;
+            return;
+        }
+    }
+
     PageCache::Page *page = mCache->acquirePage();
 
-    ssize_t n = mSource->readAt(
-            mCacheOffset + mCache->totalSize(), page->mData, kPageSize);
+    ssize_t n = mSource->readAt(offset, page->mBuffer->base(), size);
 
     Mutex::Autolock autoLock(mLock);
 
@@ -388,6 +454,11 @@ void NuCachedSource2::fetchInternal() {
 
         page->mSize = n;
         mCache->appendPage(page);
+        mNumBytesFetched += n;
+
+        if ((size_t)n == (size_t)kPageSize) {
+            SharedPageCache::getInstance()->insert(streamKey, offset, page->mBuffer);
+        }
     }
 }
 
@@ -560,6 +631,51 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
     return (ssize_t)result;
 }
 
+status_t NuCachedSource2::readAtNoCopy(
+        off64_t offset, size_t size, sp<ABuffer> *page, const uint8_t **data) {
+    Mutex::Autolock autoLock(mLock);
+    if (mDisconnecting) {
+        return ERROR_END_OF_STREAM;
+    }
+
+    if (size == 0 || offset < mCacheOffset
+            || offset + size > mCacheOffset + mCache->totalSize()) {
+        return -EAGAIN;
+    }
+
+    size_t delta, avail;
+    sp<ABuffer> buffer = mCache->getPage(offset - mCacheOffset, &delta, &avail);
+    if (avail < size) {
+        return -EAGAIN;
+    }
+
+    mLastAccessPos = offset + size;
+    restartPrefetcherIfNecessary_l();
+
+    *page = buffer;
+    *data = buffer->base() + delta;
+    return OK;
+}
+
+void NuCachedSource2::enableSharing(
+        const String8 &client, const KeyedVector<String8, String8> *headers) {
+    off64_t size;
+    if (mSource->getSize(&size) != OK) {
+        return;
+    }
+    String8 streamKey = SharedPageCache::MakeStreamKey(client, mSource->getUri(), headers, size);
+
+    Mutex::Autolock autoLock(mLock);
+    mStreamKey = streamKey;
+}
+
+void NuCachedSource2::getStats(size_t *bytesFetched, size_t *bytesShared) const {
+    Mutex::Autolock autoLock(mLock);
+
+    *bytesFetched = mNumBytesFetched;
+    *bytesShared = mNumBytesShared;
+}
+
 size_t NuCachedSource2::cachedSize() {
     Mutex::Autolock autoLock(mLock);
     return mCacheOffset + mCache->totalSize();
@@ -658,7 +774,7 @@ status_t NuCachedSource2::seekInternal_l(off64_t offset) {
 
     ALOGI("new range: offset= %lld", (long long)offset);
 
-    mCacheOffset = offset;
+    mCacheOffset = offset - offset % kPageSize;
 
     size_t totalSize = mCache->totalSize();
     CHECK_EQ(mCache->releaseFromStart(totalSize), totalSize);
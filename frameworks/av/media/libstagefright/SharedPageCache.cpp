@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SharedPageCache"
+#include <utils/Log.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "include/SharedPageCache.h"
+
+#include <cutils/properties.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+
+namespace android {
+
+const size_t SharedPageCache::kDefaultMaxBytes = 16 * 1024 * 1024;
+const int64_t SharedPageCache::kMemoryCheckIntervalUs = 1000000ll;
+
+static Mutex sInitMutex;
+
+// static
+SharedPageCache *SharedPageCache::getInstance() {
+    static SharedPageCache *sCache = NULL;
+
+    Mutex::Autolock autoLock(sInitMutex);
+    if (sCache == NULL) {
+        sCache = new SharedPageCache;
+    }
+    return sCache;
+}
+
+// Reads the available memory as a percentage of the total from
+// /proc/meminfo, or returns -1. Kernels without MemAvailable get an
+// estimate from MemFree and Cached.
+static int availableMemoryPercent() {
+    int fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    char buffer[1024];
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1;
+    }
+    buffer[n] = '\0';
+
+    long long total = -1, available = -1, free = 0, cached = 0;
+    for (char *line = buffer; line != NULL && *line != '\0';) {
+        long long *value = NULL;
+        if (!strncmp(line, "MemTotal:", 9)) {
+            value = &total;
+        } else if (!strncmp(line, "MemAvailable:", 13)) {
+            value = &available;
+        } else if (!strncmp(line, "MemFree:", 8)) {
+            value = &free;
+        } else if (!strncmp(line, "Cached:", 7)) {
+            value = &cached;
+        }
+        if (value != NULL) {
+            *value = strtoll(strchr(line, ':') + 1, NULL, 10);
+        }
+        line = strchr(line, '\n');
+        if (line != NULL) {
+            ++line;
+        }
+    }
+
+    if (total <= 0) {
+        return -1;
+    }
+    if (available < 0) {
+        available = free + cached;
+    }
+    return (int)(available * 100 / total);
+}
+
+// static
+String8 SharedPageCache::MakeStreamKey(
+        const String8 &client, const String8 &uri,
+        const KeyedVector<String8, String8> *headers, off64_t size) {
+    if (client.isEmpty() || uri.isEmpty() || size <= 0) {
+        // Without a length the stream may well be live, and the same URI
+        // would not return the same data twice.
+        return String8();
+    }
+
+    String8 key = String8::format(
+            "%s|%s#%lld", client.string(), uri.string(), (long long)size);
+
+    // KeyedVector keeps the headers sorted, so equal sets give equal keys.
+    if (headers != NULL) {
+        for (size_t i = 0; i < headers->size(); ++i) {
+            key.appendFormat("\n%s: %s",
+                    headers->keyAt(i).string(), headers->valueAt(i).string());
+        }
+    }
+    return key;
+}
+
+SharedPageCache::SharedPageCache()
+    : mMaxBytes(kDefaultMaxBytes),
+      mTotalBytes(0),
+      mNumLookups(0),
+      mNumHits(0),
+      mNumInsertions(0),
+      mNumEvictions(0),
+      mLastMemoryCheckUs(0) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.shared-cache-kb", value, NULL)) {
+        char *end;
+        long kb = strtol(value, &end, 10);
+        if (end != value && *end == '\0' && kb >= 0) {
+            mMaxBytes = (size_t)kb * 1024;
+        } else {
+            ALOGE("Failed to parse shared cache size from '%s'.", value);
+        }
+    }
+
+    ALOGV("budget %zu bytes", mMaxBytes);
+}
+
+sp<ABuffer> SharedPageCache::lookup(const String8 &streamKey, off64_t offset) {
+    CHECK_EQ(offset % kPageSize, 0);
+
+    Mutex::Autolock autoLock(mLock);
+
+    if (mMaxBytes == 0 || streamKey.isEmpty()) {
+        return NULL;
+    }
+
+    ++mNumLookups;
+    checkMemory_l();
+
+    String8 key = String8::format("%s@%lld", streamKey.string(), (long long)offset);
+    ssize_t index = mPages.indexOfKey(key);
+    if (index < 0) {
+        return NULL;
+    }
+
+    ++mNumHits;
+    touch_l(key);
+
+    return mPages.valueAt(index);
+}
+
+void SharedPageCache::insert(
+        const String8 &streamKey, off64_t offset, const sp<ABuffer> &page) {
+    CHECK_EQ(offset % kPageSize, 0);
+    CHECK_EQ(page->capacity(), (size_t)kPageSize);
+
+    Mutex::Autolock autoLock(mLock);
+
+    if (mMaxBytes < (size_t)kPageSize || streamKey.isEmpty()) {
+        return;
+    }
+
+    String8 key = String8::format("%s@%lld", streamKey.string(), (long long)offset);
+    if (mPages.indexOfKey(key) >= 0) {
+        // Another source fetched the same page in the meantime.
+        touch_l(key);
+        return;
+    }
+
+    checkMemory_l();
+    evict_l(mMaxBytes - kPageSize);
+
+    mPages.add(key, page);
+    mLRU.push_back(key);
+    mTotalBytes += kPageSize;
+    ++mNumInsertions;
+}
+
+void SharedPageCache::setMaxBytes(size_t maxBytes) {
+    Mutex::Autolock autoLock(mLock);
+
+    mMaxBytes = maxBytes;
+    evict_l(mMaxBytes);
+}
+
+size_t SharedPageCache::maxBytes() const {
+    Mutex::Autolock autoLock(mLock);
+
+    return mMaxBytes;
+}
+
+void SharedPageCache::trim(TrimLevel level) {
+    Mutex::Autolock autoLock(mLock);
+
+    trim_l(level);
+}
+
+void SharedPageCache::trim_l(TrimLevel level) {
+    size_t before = mTotalBytes;
+    evict_l(level == TRIM_MODERATE ? mMaxBytes / 2 : 0);
+
+    ALOGI("trimmed from %zu to %zu bytes", before, mTotalBytes);
+}
+
+void SharedPageCache::checkMemory_l() {
+    // Below these, lowmemorykiller starts on cached and then on perceptible
+    // apps; the cache gives way before that.
+    static const int kModeratePercent = 10;
+    static const int kCompletePercent = 5;
+
+    int64_t nowUs = ALooper::GetNowUs();
+    if (mTotalBytes == 0 || nowUs - mLastMemoryCheckUs < kMemoryCheckIntervalUs) {
+        return;
+    }
+    mLastMemoryCheckUs = nowUs;
+
+    int percent = availableMemoryPercent();
+    if (percent < 0) {
+        return;
+    }
+    if (percent < kCompletePercent) {
+        trim_l(TRIM_COMPLETE);
+    } else if (percent < kModeratePercent && mTotalBytes > mMaxBytes / 2) {
+        trim_l(TRIM_MODERATE);
+    }
+}
+
+void SharedPageCache::getStats(Stats *stats) const {
+    Mutex::Autolock autoLock(mLock);
+
+    stats->mLookups = mNumLookups;
+    stats->mHits = mNumHits;
+    stats->mInsertions = mNumInsertions;
+    stats->mEvictions = mNumEvictions;
+    stats->mBytes = mTotalBytes;
+    stats->mPages = mPages.size();
+
+    stats->mPagesInUse = 0;
+    for (size_t i = 0; i < mPages.size(); ++i) {
+        if (mPages.valueAt(i)->getStrongCount() > 1) {
+            ++stats->mPagesInUse;
+        }
+    }
+}
+
+void SharedPageCache::touch_l(const String8 &key) {
+    for (List<String8>::iterator it = mLRU.begin(); it != mLRU.end(); ++it) {
+        if (*it == key) {
+            mLRU.erase(it);
+            break;
+        }
+    }
+    mLRU.push_back(key);
+}
+
+void SharedPageCache::evict_l(size_t maxBytes) {
+    while (!mLRU.empty() && mTotalBytes > maxBytes) {
+        String8 key = *mLRU.begin();
+        mLRU.erase(mLRU.begin());
+
+        ssize_t index = mPages.indexOfKey(key);
+        CHECK_GE(index, 0);
+
+        mPages.removeItemsAt(index);
+        mTotalBytes -= kPageSize;
+        ++mNumEvictions;
+    }
+}
+
+}  // namespace android
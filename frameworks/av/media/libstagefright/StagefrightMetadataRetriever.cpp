@@ -18,12 +18,14 @@
 #define LOG_TAG "StagefrightMetadataRetriever"
 
 #include <inttypes.h>
+#include <sys/stat.h>
 
 #include <utils/Log.h>
 #include <gui/Surface.h>
 
 #include "include/StagefrightMetadataRetriever.h"
 #include "include/HTTPBase.h"
+#include "include/ThumbnailCache.h"
 
 #include <media/ICrypto.h>
 #include <media/IMediaHTTPService.h>
@@ -51,10 +53,23 @@ namespace android {
 
 static const int64_t kBufferTimeOutUs = 30000ll; // 30 msec
 static const size_t kRetryCount = 20; // must be >0
+static const size_t kMaxAlbumArtSize = 3 * 1024 * 1024; // as ID3 limits whole tags
+
+// Builds a ThumbnailCache identity for a local file from its inode and
+// modification time, so that edited or replaced files are not served stale.
+static String8 makeFileKey(const struct stat &sb, int64_t offset, int64_t length) {
+    return String8::format(
+            "%llu:%llu:%lld:%lld.%09ld:%" PRId64 ":%" PRId64,
+            (unsigned long long)sb.st_dev, (unsigned long long)sb.st_ino,
+            (long long)sb.st_size, (long long)sb.st_mtim.tv_sec,
+            (long)sb.st_mtim.tv_nsec, offset, length);
+}
 
 StagefrightMetadataRetriever::StagefrightMetadataRetriever()
     : mParsedMetaData(false),
-      mAlbumArt(NULL) {
+      mAlbumArt(NULL),
+      mAlbumArtOffset(0),
+      mAlbumArtSize(0) {
     ALOGV("StagefrightMetadataRetriever()");
 
     DataSource::RegisterDefaultSniffers();
@@ -80,6 +95,7 @@ status_t StagefrightMetadataRetriever::setDataSource(
     ALOGV("setDataSource(%s)", uri);
 
     clearMetadata();
+    mSourceKey.clear();
     mSource = DataSource::CreateFromURI(httpService, uri, headers);
 
     if (mSource == NULL) {
@@ -97,6 +113,16 @@ status_t StagefrightMetadataRetriever::setDataSource(
         return UNKNOWN_ERROR;
     }
 
+    const char *path = uri;
+    if (!strncasecmp("file://", path, 7)) {
+        path += 7;
+    }
+
+    struct stat sb;
+    if (strstr(path, "://") == NULL && stat(path, &sb) == 0) {
+        mSourceKey = makeFileKey(sb, 0, sb.st_size);
+    }
+
     return OK;
 }
 
@@ -109,6 +135,7 @@ status_t StagefrightMetadataRetriever::setDataSource(
     AVUtils::get()->printFileName(fd);
 
     clearMetadata();
+    mSourceKey.clear();
     mSource = new FileSource(fd, offset, length);
 
     status_t err;
@@ -126,6 +153,11 @@ status_t StagefrightMetadataRetriever::setDataSource(
         return UNKNOWN_ERROR;
     }
 
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode)) {
+        mSourceKey = makeFileKey(sb, offset, length);
+    }
+
     return OK;
 }
 
@@ -134,6 +166,7 @@ status_t StagefrightMetadataRetriever::setDataSource(
     ALOGV("setDataSource(DataSource)");
 
     clearMetadata();
+    mSourceKey.clear();
     mSource = source;
     mExtractor = MediaExtractor::Create(mSource);
 
@@ -146,12 +179,35 @@ status_t StagefrightMetadataRetriever::setDataSource(
     return OK;
 }
 
+// Point-samples a full resolution RGB565 frame down to |dst|, used when the
+// decoder's output format has no fused scaling conversion.
+static void scaleRGB565(
+        const uint16_t *src, size_t srcWidth, size_t srcHeight,
+        uint16_t *dst, size_t dstWidth, size_t dstHeight) {
+    const uint32_t stepX = (srcWidth << 16) / dstWidth;
+    const uint32_t stepY = (srcHeight << 16) / dstHeight;
+
+    uint32_t fy = stepY / 2;
+    for (size_t y = 0; y < dstHeight; ++y, fy += stepY) {
+        const uint16_t *srcRow = src + (fy >> 16) * srcWidth;
+        uint32_t fx = stepX / 2;
+        for (size_t x = 0; x < dstWidth; ++x, fx += stepX) {
+            dst[x] = srcRow[fx >> 16];
+        }
+        dst += dstWidth;
+    }
+}
+
 static VideoFrame *extractVideoFrame(
         const char *componentName,
         const sp<MetaData> &trackMeta,
         const sp<MediaSource> &source,
         int64_t frameTimeUs,
-        int seekMode) {
+        int seekMode,
+        int32_t maxWidth,
+        int32_t maxHeight) {
+    // In thumbnail mode only the sync sample the source seeks to is decoded.
+    const bool syncFrameOnly = maxWidth > 0 && maxHeight > 0;
 
     sp<MetaData> format = source->getFormat();
 
@@ -166,11 +222,10 @@ static VideoFrame *extractVideoFrame(
 
     videoFormat->setInt32("thumbnail-mode", 1);
 
+    ThumbnailDecoderPool *pool = ThumbnailDecoderPool::getInstance();
+
     status_t err;
-    sp<ALooper> looper = new ALooper;
-    looper->start();
-    sp<MediaCodec> decoder = MediaCodec::CreateByComponentName(
-            looper, componentName, &err);
+    sp<MediaCodec> decoder = pool->acquire(componentName, &err);
 
     if (decoder.get() == NULL || err != OK) {
         ALOGW("Failed to instantiate decoder [%s]", componentName);
@@ -178,6 +233,18 @@ static VideoFrame *extractVideoFrame(
     }
 
     err = decoder->configure(videoFormat, NULL /* surface */, NULL /* crypto */, 0 /* flags */);
+    if (err != OK) {
+        // A pooled decoder may have been reclaimed while idle, retry once.
+        ALOGV("configure returned error %d (%s), retrying", err, asString(err));
+        decoder->release();
+        decoder = pool->acquire(componentName, &err);
+        if (decoder.get() == NULL || err != OK) {
+            ALOGW("Failed to instantiate decoder [%s]", componentName);
+            return NULL;
+        }
+        err = decoder->configure(
+                videoFormat, NULL /* surface */, NULL /* crypto */, 0 /* flags */);
+    }
     if (err != OK) {
         ALOGW("configure returned error %d (%s)", err, asString(err));
         decoder->release();
@@ -202,6 +269,9 @@ static VideoFrame *extractVideoFrame(
 
     MediaSource::ReadOptions::SeekMode mode =
             static_cast<MediaSource::ReadOptions::SeekMode>(seekMode);
+    if (syncFrameOnly && mode == MediaSource::ReadOptions::SEEK_CLOSEST) {
+        mode = MediaSource::ReadOptions::SEEK_CLOSEST_SYNC;
+    }
 
     int64_t thumbNailTime;
     if (frameTimeUs < 0) {
@@ -245,6 +315,7 @@ static VideoFrame *extractVideoFrame(
     size_t index, offset, size;
     int64_t timeUs;
     size_t retriesLeft = kRetryCount;
+    size_t numInputsQueued = 0;
     bool done = false;
 
     do {
@@ -264,6 +335,15 @@ static VideoFrame *extractVideoFrame(
             }
             codecBuffer = inputBuffers[inputIndex];
 
+            if (syncFrameOnly && numInputsQueued > 0) {
+                // The sync sample is all we need, signal EOS so that the
+                // decoder flushes it out instead of waiting for more input.
+                codecBuffer->setRange(0, 0);
+                flags = MediaCodec::BUFFER_FLAG_EOS;
+                haveMoreInputs = false;
+                break;
+            }
+
             MediaBuffer *mediaBuffer = NULL;
 
             err = source->read(&mediaBuffer, &options);
@@ -300,6 +380,7 @@ static VideoFrame *extractVideoFrame(
                     codecBuffer->size(),
                     ptsUs,
                     flags);
+            ++numInputsQueued;
 
             // we don't expect an output from codec config buffer
             if (flags & MediaCodec::BUFFER_FLAG_CODECCONFIG) {
@@ -378,9 +459,28 @@ static VideoFrame *extractVideoFrame(
         rotationAngle = 0;  // By default, no rotation
     }
 
+    const int32_t cropWidth = crop_right - crop_left + 1;
+    const int32_t cropHeight = crop_bottom - crop_top + 1;
+
     VideoFrame *frame = new VideoFrame;
-    frame->mWidth = crop_right - crop_left + 1;
-    frame->mHeight = crop_bottom - crop_top + 1;
+    frame->mWidth = cropWidth;
+    frame->mHeight = cropHeight;
+    if (syncFrameOnly && (cropWidth > maxWidth || cropHeight > maxHeight)) {
+        // Fit within the requested bounds, preserving the aspect ratio.
+        if ((int64_t)cropWidth * maxHeight > (int64_t)cropHeight * maxWidth) {
+            frame->mWidth = maxWidth;
+            frame->mHeight = (int64_t)cropHeight * maxWidth / cropWidth;
+        } else {
+            frame->mHeight = maxHeight;
+            frame->mWidth = (int64_t)cropWidth * maxHeight / cropHeight;
+        }
+        if (frame->mWidth == 0) {
+            frame->mWidth = 1;
+        }
+        if (frame->mHeight == 0) {
+            frame->mHeight = 1;
+        }
+    }
     frame->mDisplayWidth = frame->mWidth;
     frame->mDisplayHeight = frame->mHeight;
     frame->mSize = frame->mWidth * frame->mHeight * 2;
@@ -399,7 +499,38 @@ static VideoFrame *extractVideoFrame(
 
     ColorConverter converter((OMX_COLOR_FORMATTYPE)srcFormat, OMX_COLOR_Format16bitRGB565);
 
-    if (converter.isValid()) {
+    const bool scaled =
+            (int32_t)frame->mWidth != cropWidth || (int32_t)frame->mHeight != cropHeight;
+
+    if (converter.isValid() && scaled) {
+        // Convert and scale in one pass where the converter supports it,
+        // otherwise go through a full resolution intermediate.
+        err = converter.convertScaled(
+                (const uint8_t *)videoFrameBuffer->data(),
+                stride, slice_height,
+                crop_left, crop_top, crop_right, crop_bottom,
+                frame->mData,
+                frame->mWidth,
+                frame->mHeight,
+                0, 0, frame->mWidth - 1, frame->mHeight - 1);
+
+        if (err == ERROR_UNSUPPORTED) {
+            uint16_t *full = new uint16_t[cropWidth * cropHeight];
+            err = converter.convert(
+                    (const uint8_t *)videoFrameBuffer->data(),
+                    stride, slice_height,
+                    crop_left, crop_top, crop_right, crop_bottom,
+                    full,
+                    cropWidth,
+                    cropHeight,
+                    0, 0, cropWidth - 1, cropHeight - 1);
+            if (err == OK) {
+                scaleRGB565(full, cropWidth, cropHeight,
+                        (uint16_t *)frame->mData, frame->mWidth, frame->mHeight);
+            }
+            delete[] full;
+        }
+    } else if (converter.isValid()) {
         err = converter.convert(
                 (const uint8_t *)videoFrameBuffer->data(),
                 stride, slice_height,
@@ -417,8 +548,11 @@ static VideoFrame *extractVideoFrame(
     videoFrameBuffer.clear();
     source->stop();
     decoder->releaseOutputBuffer(index);
-    decoder->stop();
-    decoder->release();
+    if (decoder->stop() == OK) {
+        pool->recycle(componentName, decoder);
+    } else {
+        decoder->release();
+    }
 
     if (err != OK) {
         ALOGE("Colorconverter failed to convert frame.");
@@ -435,6 +569,24 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
 
     ALOGV("getFrameAtTime: %" PRId64 " us option: %d", timeUs, option);
 
+    return getFrameInternal(timeUs, option, 0 /* maxWidth */, 0 /* maxHeight */);
+}
+
+VideoFrame *StagefrightMetadataRetriever::getThumbnailAtTime(
+        int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight) {
+
+    ALOGV("getThumbnailAtTime: %" PRId64 " us option: %d max %dx%d",
+            timeUs, option, maxWidth, maxHeight);
+
+    if (maxWidth <= 0 || maxHeight <= 0) {
+        return NULL;
+    }
+
+    return getFrameInternal(timeUs, option, maxWidth, maxHeight);
+}
+
+VideoFrame *StagefrightMetadataRetriever::getFrameInternal(
+        int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight) {
     if (mExtractor.get() == NULL) {
         ALOGV("no extractor.");
         return NULL;
@@ -453,6 +605,17 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
         return NULL;
     }
 
+    String8 cacheKey;
+    if (!mSourceKey.isEmpty()) {
+        cacheKey = ThumbnailCache::MakeKey(mSourceKey, timeUs, option, maxWidth, maxHeight);
+
+        VideoFrame *frame = ThumbnailCache::getInstance()->lookup(cacheKey);
+        if (frame != NULL) {
+            ALOGV("thumbnail cache hit for %s", cacheKey.string());
+            return frame;
+        }
+    }
+
     size_t n = mExtractor->countTracks();
     size_t i;
     for (i = 0; i < n; ++i) {
@@ -481,13 +644,7 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
         return NULL;
     }
 
-    const void *data;
-    uint32_t type;
-    size_t dataSize;
-    if (fileMeta->findData(kKeyAlbumArt, &type, &data, &dataSize)
-            && mAlbumArt == NULL) {
-        mAlbumArt = MediaAlbumArt::fromData(dataSize, data);
-    }
+    parseAlbumArt(fileMeta);
 
     const char *mime;
     CHECK(trackMeta->findCString(kKeyMIMEType, &mime));
@@ -502,10 +659,13 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
 
     for (size_t i = 0; i < matchingCodecs.size(); ++i) {
         const char *componentName = matchingCodecs[i].mName.string();
-        VideoFrame *frame =
-            extractVideoFrame(componentName, trackMeta, source, timeUs, option);
+        VideoFrame *frame = extractVideoFrame(
+                componentName, trackMeta, source, timeUs, option, maxWidth, maxHeight);
 
         if (frame != NULL) {
+            if (!cacheKey.isEmpty()) {
+                ThumbnailCache::getInstance()->insert(cacheKey, *frame);
+            }
             return frame;
         }
         ALOGV("%s failed to extract thumbnail, trying next decoder.", componentName);
@@ -527,6 +687,11 @@ MediaAlbumArt *StagefrightMetadataRetriever::extractAlbumArt() {
         mParsedMetaData = true;
     }
 
+    if (mAlbumArt == NULL && mAlbumArtSize > 0) {
+        mAlbumArt = readAlbumArt();
+        mAlbumArtSize = 0;
+    }
+
     if (mAlbumArt) {
         return mAlbumArt->clone();
     }
@@ -534,6 +699,46 @@ MediaAlbumArt *StagefrightMetadataRetriever::extractAlbumArt() {
     return NULL;
 }
 
+void StagefrightMetadataRetriever::parseAlbumArt(const sp<MetaData> &meta) {
+    if (mAlbumArt != NULL || mAlbumArtSize > 0) {
+        return;
+    }
+
+    const void *data;
+    uint32_t type;
+    size_t dataSize;
+    int64_t offset;
+    int32_t size;
+    if (meta->findData(kKeyAlbumArt, &type, &data, &dataSize)) {
+        mAlbumArt = MediaAlbumArt::fromData(dataSize, data);
+    } else if (meta->findInt64(kKeyAlbumArtOffset, &offset)
+            && meta->findInt32(kKeyAlbumArtSize, &size)
+            && offset >= 0 && size > 0) {
+        mAlbumArtOffset = offset;
+        mAlbumArtSize = size;
+    }
+}
+
+MediaAlbumArt *StagefrightMetadataRetriever::readAlbumArt() {
+    ALOGV("reading %zu bytes of album art at offset %lld",
+            mAlbumArtSize, (long long)mAlbumArtOffset);
+
+    // The size comes from the file, don't trust it further than ID3 ever did.
+    if (mAlbumArtSize > kMaxAlbumArtSize) {
+        ALOGW("album art too large (%zu bytes)", mAlbumArtSize);
+        return NULL;
+    }
+
+    sp<ABuffer> buffer = new ABuffer(mAlbumArtSize);
+    ssize_t n = mSource->readAt(mAlbumArtOffset, buffer->data(), buffer->size());
+    if (n != (ssize_t)buffer->size()) {
+        ALOGW("failed to read album art (%zd)", n);
+        return NULL;
+    }
+
+    return MediaAlbumArt::fromData(buffer->size(), buffer->data());
+}
+
 const char *StagefrightMetadataRetriever::extractMetadata(int keyCode) {
     if (mExtractor == NULL) {
         return NULL;
@@ -618,13 +823,7 @@ void StagefrightMetadataRetriever::parseMetaData() {
     }
     delete detector;
 
-    const void *data;
-    uint32_t type;
-    size_t dataSize;
-    if (meta->findData(kKeyAlbumArt, &type, &data, &dataSize)
-            && mAlbumArt == NULL) {
-        mAlbumArt = MediaAlbumArt::fromData(dataSize, data);
-    }
+    parseAlbumArt(meta);
 
     size_t numTracks = mExtractor->countTracks();
 
@@ -757,6 +956,7 @@ void StagefrightMetadataRetriever::clearMetadata() {
     mMetaData.clear();
     delete mAlbumArt;
     mAlbumArt = NULL;
+    mAlbumArtSize = 0;
 }
 
 }  // namespace android
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ThumbnailCache"
+#include <utils/Log.h>
+
+#include <inttypes.h>
+
+#include "include/ThumbnailCache.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AHandler.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaCodec.h>
+#include <private/media/VideoFrame.h>
+
+namespace android {
+
+static Mutex sInitMutex;
+
+// static
+ThumbnailCache *ThumbnailCache::getInstance() {
+    static ThumbnailCache *sCache = NULL;
+
+    Mutex::Autolock autoLock(sInitMutex);
+    if (sCache == NULL) {
+        sCache = new ThumbnailCache;
+    }
+    return sCache;
+}
+
+// static
+String8 ThumbnailCache::MakeKey(
+        const String8 &sourceKey, int64_t timeUs, int option,
+        int32_t maxWidth, int32_t maxHeight) {
+    return String8::format(
+            "%s@%" PRId64 ":%d:%dx%d",
+            sourceKey.string(), timeUs, option, maxWidth, maxHeight);
+}
+
+ThumbnailCache::ThumbnailCache()
+    : mTotalBytes(0),
+      mNumHits(0),
+      mNumMisses(0) {
+}
+
+ThumbnailCache::~ThumbnailCache() {
+    clear();
+}
+
+VideoFrame *ThumbnailCache::lookup(const String8 &key) {
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mFrames.indexOfKey(key);
+    if (index < 0) {
+        ++mNumMisses;
+        return NULL;
+    }
+
+    ++mNumHits;
+    touch_l(key);
+
+    return new VideoFrame(*mFrames.valueAt(index));
+}
+
+void ThumbnailCache::insert(const String8 &key, const VideoFrame &frame) {
+    if (frame.mSize == 0 || frame.mSize > kMaxBytes / 4) {
+        // Not worth displacing everything else for a single huge frame.
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mFrames.indexOfKey(key);
+    if (index >= 0) {
+        touch_l(key);
+        return;
+    }
+
+    evict_l(frame.mSize);
+
+    mFrames.add(key, new VideoFrame(frame));
+    mLRU.push_back(key);
+    mTotalBytes += frame.mSize;
+
+    ALOGV("cached %s (%u bytes, total %zu)", key.string(), frame.mSize, mTotalBytes);
+}
+
+void ThumbnailCache::clear() {
+    Mutex::Autolock autoLock(mLock);
+
+    for (size_t i = 0; i < mFrames.size(); ++i) {
+        delete mFrames.valueAt(i);
+    }
+    mFrames.clear();
+    mLRU.clear();
+    mTotalBytes = 0;
+}
+
+void ThumbnailCache::getStats(size_t *hits, size_t *misses, size_t *bytes) const {
+    Mutex::Autolock autoLock(mLock);
+
+    *hits = mNumHits;
+    *misses = mNumMisses;
+    *bytes = mTotalBytes;
+}
+
+void ThumbnailCache::touch_l(const String8 &key) {
+    for (List<String8>::iterator it = mLRU.begin(); it != mLRU.end(); ++it) {
+        if (*it == key) {
+            mLRU.erase(it);
+            break;
+        }
+    }
+    mLRU.push_back(key);
+}
+
+void ThumbnailCache::evict_l(size_t bytesNeeded) {
+    while (!mLRU.empty() && mTotalBytes + bytesNeeded > kMaxBytes) {
+        String8 key = *mLRU.begin();
+        mLRU.erase(mLRU.begin());
+
+        ssize_t index = mFrames.indexOfKey(key);
+        CHECK_GE(index, 0);
+
+        VideoFrame *frame = mFrames.valueAt(index);
+        mTotalBytes -= frame->mSize;
+        delete frame;
+        mFrames.removeItemsAt(index);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const int64_t ThumbnailDecoderPool::kIdleTimeoutUs = 5000000ll;
+
+struct ThumbnailDecoderPool::PurgeHandler : public AHandler {
+    enum {
+        kWhatPurge = 'prge',
+    };
+
+    PurgeHandler(ThumbnailDecoderPool *pool)
+        : mPool(pool) {
+    }
+
+protected:
+    virtual void onMessageReceived(const sp<AMessage> &msg) {
+        CHECK_EQ(msg->what(), (uint32_t)kWhatPurge);
+        mPool->onPurge();
+    }
+
+private:
+    ThumbnailDecoderPool *mPool;
+
+    DISALLOW_EVIL_CONSTRUCTORS(PurgeHandler);
+};
+
+// static
+ThumbnailDecoderPool *ThumbnailDecoderPool::getInstance() {
+    static ThumbnailDecoderPool *sPool = NULL;
+
+    Mutex::Autolock autoLock(sInitMutex);
+    if (sPool == NULL) {
+        sPool = new ThumbnailDecoderPool;
+    }
+    return sPool;
+}
+
+ThumbnailDecoderPool::ThumbnailDecoderPool()
+    : mNumReused(0),
+      mNumCreated(0),
+      mPurgeScheduled(false) {
+}
+
+sp<MediaCodec> ThumbnailDecoderPool::acquire(
+        const char *componentName, status_t *err) {
+    List<sp<MediaCodec> > expired;
+    sp<MediaCodec> codec;
+
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        purgeExpired_l(ALooper::GetNowUs(), &expired);
+
+        for (List<IdleCodec>::iterator it = mIdle.begin(); it != mIdle.end(); ++it) {
+            if (it->mComponentName == componentName) {
+                codec = it->mCodec;
+                mIdle.erase(it);
+                ++mNumReused;
+                break;
+            }
+        }
+    }
+
+    // Release outside the lock, this round-trips to the component.
+    for (List<sp<MediaCodec> >::iterator it = expired.begin(); it != expired.end(); ++it) {
+        (*it)->release();
+    }
+
+    if (codec != NULL) {
+        ALOGV("reusing pooled decoder [%s]", componentName);
+        *err = OK;
+        return codec;
+    }
+
+    sp<ALooper> looper = new ALooper;
+    looper->setName("thumbnail");
+    looper->start();
+
+    codec = MediaCodec::CreateByComponentName(looper, componentName, err);
+    if (codec != NULL && *err == OK) {
+        Mutex::Autolock autoLock(mLock);
+        ++mNumCreated;
+    }
+
+    return codec;
+}
+
+void ThumbnailDecoderPool::recycle(
+        const char *componentName, const sp<MediaCodec> &codec) {
+    if (strncmp(componentName, "OMX.google.", 11)) {
+        codec->release();
+        return;
+    }
+
+    List<sp<MediaCodec> > expired;
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        purgeExpired_l(ALooper::GetNowUs(), &expired);
+
+        size_t count = 0;
+        List<IdleCodec>::iterator oldest = mIdle.end();
+        for (List<IdleCodec>::iterator it = mIdle.begin(); it != mIdle.end(); ++it) {
+            if (it->mComponentName == componentName) {
+                if (count++ == 0) {
+                    oldest = it;
+                }
+            }
+        }
+
+        if (count >= kMaxIdlePerComponent) {
+            expired.push_back(oldest->mCodec);
+            mIdle.erase(oldest);
+        }
+
+        IdleCodec idle;
+        idle.mComponentName = componentName;
+        idle.mCodec = codec;
+        idle.mIdleSinceUs = ALooper::GetNowUs();
+        mIdle.push_back(idle);
+
+        schedulePurge_l();
+    }
+
+    for (List<sp<MediaCodec> >::iterator it = expired.begin(); it != expired.end(); ++it) {
+        (*it)->release();
+    }
+}
+
+void ThumbnailDecoderPool::getStats(size_t *reused, size_t *created) const {
+    Mutex::Autolock autoLock(mLock);
+
+    *reused = mNumReused;
+    *created = mNumCreated;
+}
+
+void ThumbnailDecoderPool::purgeExpired_l(
+        int64_t nowUs, List<sp<MediaCodec> > *expired) {
+    List<IdleCodec>::iterator it = mIdle.begin();
+    while (it != mIdle.end()) {
+        if (nowUs - it->mIdleSinceUs >= kIdleTimeoutUs) {
+            expired->push_back(it->mCodec);
+            it = mIdle.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ThumbnailDecoderPool::schedulePurge_l() {
+    if (mPurgeScheduled) {
+        return;
+    }
+
+    if (mPurgeLooper == NULL) {
+        mPurgeLooper = new ALooper;
+        mPurgeLooper->setName("thumbnail_purge");
+        mPurgeLooper->start();
+
+        mPurgeHandler = new PurgeHandler(this);
+        mPurgeLooper->registerHandler(mPurgeHandler);
+    }
+
+    (new AMessage(PurgeHandler::kWhatPurge, mPurgeHandler))->post(kIdleTimeoutUs);
+    mPurgeScheduled = true;
+}
+
+void ThumbnailDecoderPool::onPurge() {
+    List<sp<MediaCodec> > expired;
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        mPurgeScheduled = false;
+        purgeExpired_l(ALooper::GetNowUs(), &expired);
+
+        // Decoders recycled since the timer was set expire later.
+        if (!mIdle.empty()) {
+            schedulePurge_l();
+        }
+    }
+
+    for (List<sp<MediaCodec> >::iterator it = expired.begin(); it != expired.end(); ++it) {
+        (*it)->release();
+    }
+}
+
+}  // namespace android
@@ -132,6 +132,38 @@ status_t ColorConverter::convert(
     return err;
 }
 
+status_t ColorConverter::convertScaled(
+        const void *srcBits,
+        size_t srcWidth, size_t srcHeight,
+        size_t srcCropLeft, size_t srcCropTop,
+        size_t srcCropRight, size_t srcCropBottom,
+        void *dstBits,
+        size_t dstWidth, size_t dstHeight,
+        size_t dstCropLeft, size_t dstCropTop,
+        size_t dstCropRight, size_t dstCropBottom) {
+    if (mDstFormat != OMX_COLOR_Format16bitRGB565
+            || mSrcFormat != OMX_COLOR_FormatYUV420Planar) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    BitmapParams src(
+            const_cast<void *>(srcBits),
+            srcWidth, srcHeight,
+            srcCropLeft, srcCropTop, srcCropRight, srcCropBottom);
+
+    BitmapParams dst(
+            dstBits,
+            dstWidth, dstHeight,
+            dstCropLeft, dstCropTop, dstCropRight, dstCropBottom);
+
+    if (src.cropWidth() == dst.cropWidth()
+            && src.cropHeight() == dst.cropHeight()) {
+        return convertYUV420Planar(src, dst);
+    }
+
+    return convertYUV420PlanarScaled(src, dst);
+}
+
 status_t ColorConverter::convertCbYCrY(
         const BitmapParams &src, const BitmapParams &dst) {
     // XXX Untested
@@ -290,6 +322,63 @@ status_t ColorConverter::convertYUV420Planar(
     return OK;
 }
 
+status_t ColorConverter::convertYUV420PlanarScaled(
+        const BitmapParams &src, const BitmapParams &dst) {
+    if (dst.cropWidth() == 0 || dst.cropHeight() == 0
+            || dst.cropWidth() > src.cropWidth()
+            || dst.cropHeight() > src.cropHeight()) {
+        return ERROR_UNSUPPORTED;
+    }
+
+    uint8_t *kAdjustedClip = initClip();
+
+    // 16.16 fixed point source step per destination pixel; samples are
+    // taken at the center of each destination pixel's footprint.
+    const uint32_t stepX = (src.cropWidth() << 16) / dst.cropWidth();
+    const uint32_t stepY = (src.cropHeight() << 16) / dst.cropHeight();
+
+    const uint8_t *src_y_base = (const uint8_t *)src.mBits;
+    const uint8_t *src_u_base = src_y_base + src.mWidth * src.mHeight;
+    const uint8_t *src_v_base =
+        src_u_base + (src.mWidth / 2) * (src.mHeight / 2);
+
+    uint16_t *dst_ptr = (uint16_t *)dst.mBits
+        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+
+    uint32_t fy = stepY / 2;
+    for (size_t y = 0; y < dst.cropHeight(); ++y, fy += stepY) {
+        size_t sy = src.mCropTop + (fy >> 16);
+
+        const uint8_t *src_y = src_y_base + sy * src.mWidth;
+        const uint8_t *src_u = src_u_base + (sy / 2) * (src.mWidth / 2);
+        const uint8_t *src_v = src_v_base + (sy / 2) * (src.mWidth / 2);
+
+        uint32_t fx = stepX / 2;
+        for (size_t x = 0; x < dst.cropWidth(); ++x, fx += stepX) {
+            size_t sx = src.mCropLeft + (fx >> 16);
+
+            // Same fixed point coefficients as convertYUV420Planar().
+            signed y1 = (signed)src_y[sx] - 16;
+            signed u = (signed)src_u[sx / 2] - 128;
+            signed v = (signed)src_v[sx / 2] - 128;
+
+            signed tmp1 = y1 * 298;
+            signed b1 = (tmp1 + u * 517) / 256;
+            signed g1 = (tmp1 - v * 208 - u * 100) / 256;
+            signed r1 = (tmp1 + v * 409) / 256;
+
+            dst_ptr[x] =
+                ((kAdjustedClip[r1] >> 3) << 11)
+                | ((kAdjustedClip[g1] >> 2) << 5)
+                | (kAdjustedClip[b1] >> 3);
+        }
+
+        dst_ptr += dst.mWidth;
+    }
+
+    return OK;
+}
+
 status_t ColorConverter::convertQCOMYUV420SemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
     uint8_t *kAdjustedClip = initClip();
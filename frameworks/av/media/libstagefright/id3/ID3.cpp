@@ -115,50 +115,42 @@ bool ID3::ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x) {
     return true;
 }
 
-bool ID3::parseV2(const sp<DataSource> &source, off64_t offset) {
-struct id3_header {
-    char id[3];
-    uint8_t version_major;
-    uint8_t version_minor;
-    uint8_t flags;
-    uint8_t enc_size[4];
-    };
-
-    id3_header header;
-    if (source->readAt(
-                offset, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+// static
+bool ID3::ParseV2Header(
+        const uint8_t header[10], uint8_t *majorVersion, uint8_t *flags,
+        size_t *size) {
+    if (memcmp(header, "ID3", 3)) {
         return false;
     }
 
-    if (memcmp(header.id, "ID3", 3)) {
-        return false;
-    }
+    *majorVersion = header[3];
+    *flags = header[5];
 
-    if (header.version_major == 0xff || header.version_minor == 0xff) {
+    if (header[3] == 0xff || header[4] == 0xff) {
         return false;
     }
 
-    if (header.version_major == 2) {
-        if (header.flags & 0x3f) {
+    if (*majorVersion == 2) {
+        if (*flags & 0x3f) {
             // We only support the 2 high bits, if any of the lower bits are
             // set, we cannot guarantee to understand the tag format.
             return false;
         }
 
-        if (header.flags & 0x40) {
+        if (*flags & 0x40) {
             // No compression scheme has been decided yet, ignore the
             // tag if compression is indicated.
 
             return false;
         }
-    } else if (header.version_major == 3) {
-        if (header.flags & 0x1f) {
+    } else if (*majorVersion == 3) {
+        if (*flags & 0x1f) {
             // We only support the 3 high bits, if any of the lower bits are
             // set, we cannot guarantee to understand the tag format.
             return false;
         }
-    } else if (header.version_major == 4) {
-        if (header.flags & 0x0f) {
+    } else if (*majorVersion == 4) {
+        if (*flags & 0x0f) {
             // The lower 4 bits are undefined in this spec.
             return false;
         }
@@ -166,8 +158,27 @@ struct id3_header {
         return false;
     }
 
+    return ParseSyncsafeInteger(&header[6], size);
+}
+
+bool ID3::parseV2(const sp<DataSource> &source, off64_t offset) {
+struct id3_header {
+    char id[3];
+    uint8_t version_major;
+    uint8_t version_minor;
+    uint8_t flags;
+    uint8_t enc_size[4];
+    };
+
+    id3_header header;
+    if (source->readAt(
+                offset, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        return false;
+    }
+
+    uint8_t majorVersion, flags;
     size_t size;
-    if (!ParseSyncsafeInteger(header.enc_size, &size)) {
+    if (!ParseV2Header((const uint8_t *)&header, &majorVersion, &flags, &size)) {
         return false;
     }
 
@@ -509,8 +520,6 @@ void ID3::Iterator::getstring(String8 *id, bool otherdata) const {
         return;
     }
 
-    uint8_t encoding = *frameData;
-
     if (mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1) {
         if (mOffset == 126 || mOffset == 127) {
             // Special treatment for the track number and genre.
@@ -530,13 +539,29 @@ void ID3::Iterator::getstring(String8 *id, bool otherdata) const {
     if (mFrameSize < getHeaderLength() + 1) {
         return;
     }
-    size_t n = mFrameSize - getHeaderLength() - 1;
+
+    ParseV2String(frameData, mFrameSize - getHeaderLength(), otherdata, id);
+}
+
+// static
+void ID3::ParseV2String(
+        const uint8_t *frameData, size_t size, bool otherdata, String8 *id) {
+    id->setTo("");
+
+    if (size < 1) {
+        return;
+    }
+
+    const uint8_t *start = frameData;
+    uint8_t encoding = *frameData;
+
+    size_t n = size - 1;
     if (otherdata) {
         // skip past the encoding, language, and the 0 separator
         frameData += 4;
         int32_t i = n - 4;
         while(--i >= 0 && *++frameData != 0) ;
-        int skipped = (frameData - mFrameData);
+        int skipped = (frameData - start);
         if (skipped >= (int)n) {
             return;
         }
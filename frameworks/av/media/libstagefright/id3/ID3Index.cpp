@@ -0,0 +1,494 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ID3Index"
+#include <utils/Log.h>
+
+#include "../include/ID3Index.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/Utils.h>
+#include <utils/String8.h>
+
+namespace android {
+
+// Same limit ID3 applies, for tags that have to be decoded as a whole.
+static const size_t kMaxDecodedSize = 3 * 1024 * 1024;
+
+// Limit for reading a single frame payload.
+static const size_t kMaxFrameSize = 32 * 1024 * 1024;
+
+// Album art was always read as part of a tag limited to kMaxDecodedSize.
+static const size_t kMaxAlbumArtSize = 3 * 1024 * 1024;
+
+// Initial amount of an attached picture frame read to locate the picture
+// data, grown up to kMaxPictureHeaderSize for long descriptions.
+static const size_t kPictureHeaderSize = 512;
+static const size_t kMaxPictureHeaderSize = 64 * 1024;
+
+// Like StringSize() in ID3.cpp, but fails instead of reading past |size|.
+static bool BoundedStringSize(
+        const uint8_t *start, size_t size, uint8_t encoding, size_t *length) {
+    if (encoding == 0x00 || encoding == 0x03) {
+        // ISO 8859-1 or UTF-8
+        const uint8_t *end = (const uint8_t *)memchr(start, 0, size);
+        if (end == NULL) {
+            return false;
+        }
+        *length = end - start + 1;
+        return true;
+    }
+
+    // UCS-2
+    for (size_t n = 0; n + 1 < size; n += 2) {
+        if (start[n] == '\0' && start[n + 1] == '\0') {
+            *length = n + 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Replaces occurrences of 0xff 0x00 with just 0xff, returns the new size.
+static size_t RemoveUnsynchronization(uint8_t *data, size_t size) {
+    size_t writeOffset = 0;
+    for (size_t readOffset = 0; readOffset < size; ++readOffset) {
+        data[writeOffset++] = data[readOffset];
+        if (data[readOffset] == 0xff
+                && readOffset + 1 < size && data[readOffset + 1] == 0x00) {
+            ++readOffset;
+        }
+    }
+    return writeOffset;
+}
+
+ID3Index::ID3Index(const sp<DataSource> &source, off64_t offset)
+    : mSource(source),
+      mIsValid(false),
+      mVersion(ID3::ID3_UNKNOWN),
+      mRawSize(0) {
+    mIsValid = parse(offset);
+    if (!mIsValid) {
+        mFrames.clear();
+        mDecoded.clear();
+    }
+}
+
+ID3Index::~ID3Index() {
+}
+
+bool ID3Index::isValid() const {
+    return mIsValid;
+}
+
+ID3::Version ID3Index::version() const {
+    return mVersion;
+}
+
+size_t ID3Index::countFrames() const {
+    return mFrames.size();
+}
+
+bool ID3Index::parse(off64_t offset) {
+    uint8_t header[10];
+    if (mSource->readAt(offset, header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        return false;
+    }
+
+    uint8_t majorVersion, flags;
+    size_t size;
+    if (!ID3::ParseV2Header(header, &majorVersion, &flags, &size)) {
+        return false;
+    }
+
+    mRawSize = size + sizeof(header);
+
+    off64_t dataOffset = offset + sizeof(header);
+    if (majorVersion < 4 && (flags & 0x80)) {
+        // Frame headers are unsynchronized as well, there is no way to
+        // find the frames without decoding everything.
+        if (size > kMaxDecodedSize) {
+            ALOGE("skipping huge unsynchronized ID3 tag of size %zu", size);
+            return false;
+        }
+
+        mDecoded = new ABuffer(size);
+        if (mSource->readAt(dataOffset, mDecoded->data(), size) != (ssize_t)size) {
+            return false;
+        }
+        mDecoded->setRange(0, RemoveUnsynchronization(mDecoded->data(), size));
+
+        dataOffset = 0;
+        size = mDecoded->size();
+    }
+
+    size_t firstFrameOffset = 0;
+    if (majorVersion == 3 && (flags & 0x40)) {
+        // Version 2.3 has an optional extended header.
+        uint8_t ext[10];
+        if (size < 4 || readAt(dataOffset, ext, 4) != 4) {
+            return false;
+        }
+
+        size_t extendedHeaderSize = U32_AT(ext);
+        if (extendedHeaderSize > size - 4) {
+            return false;
+        }
+        extendedHeaderSize += 4;
+        firstFrameOffset = extendedHeaderSize;
+
+        if (extendedHeaderSize >= 10) {
+            if (readAt(dataOffset, ext, 10) != 10) {
+                return false;
+            }
+
+            size_t paddingSize = U32_AT(&ext[6]);
+            if (paddingSize > size - firstFrameOffset) {
+                return false;
+            }
+            size -= paddingSize;
+        }
+    } else if (majorVersion == 4 && (flags & 0x40)) {
+        // Version 2.4 has an optional extended header, that's different
+        // from Version 2.3's...
+        uint8_t ext[4];
+        if (size < 4 || readAt(dataOffset, ext, 4) != 4) {
+            return false;
+        }
+
+        size_t extendedHeaderSize;
+        if (!ID3::ParseSyncsafeInteger(ext, &extendedHeaderSize)
+                || extendedHeaderSize < 6 || extendedHeaderSize > size) {
+            return false;
+        }
+        firstFrameOffset = extendedHeaderSize;
+    }
+
+    if (majorVersion == 2) {
+        mVersion = ID3::ID3_V2_2;
+    } else if (majorVersion == 3) {
+        mVersion = ID3::ID3_V2_3;
+    } else {
+        CHECK_EQ(majorVersion, 4);
+        mVersion = ID3::ID3_V2_4;
+    }
+
+    if (indexFrames(dataOffset, size, firstFrameOffset, false /* iTunesHack */)) {
+        return true;
+    }
+
+    if (mVersion == ID3::ID3_V2_4
+            && indexFrames(dataOffset, size, firstFrameOffset, true /* iTunesHack */)) {
+        ALOGV("Had to apply the iTunes hack to parse this ID3 tag");
+        return true;
+    }
+
+    return false;
+}
+
+bool ID3Index::indexFrames(
+        off64_t dataOffset, size_t dataSize, size_t firstFrameOffset,
+        bool iTunesHack) {
+    mFrames.clear();
+
+    const size_t headerSize = (mVersion == ID3::ID3_V2_2) ? 6 : 10;
+
+    size_t offset = firstFrameOffset;
+    while (dataSize >= headerSize && offset <= dataSize - headerSize) {
+        uint8_t header[10];
+        if (readAt(dataOffset + offset, header, headerSize) != (ssize_t)headerSize) {
+            return false;
+        }
+
+        Frame frame;
+        memset(frame.mID, 0, sizeof(frame.mID));
+        frame.mFlags = 0;
+
+        if (mVersion == ID3::ID3_V2_2) {
+            if (!memcmp(header, "\0\0\0", 3)) {
+                break;
+            }
+
+            memcpy(frame.mID, header, 3);
+            frame.mSize = (header[3] << 16) | (header[4] << 8) | header[5];
+        } else {
+            if (!memcmp(header, "\0\0\0\0", 4)) {
+                break;
+            }
+
+            memcpy(frame.mID, header, 4);
+            if (mVersion == ID3::ID3_V2_4 && !iTunesHack) {
+                if (!ID3::ParseSyncsafeInteger(&header[4], &frame.mSize)) {
+                    return false;
+                }
+            } else {
+                frame.mSize = U32_AT(&header[4]);
+            }
+            frame.mFlags = U16_AT(&header[8]);
+        }
+
+        if (frame.mSize == 0) {
+            break;
+        }
+
+        if (frame.mSize > dataSize - headerSize - offset) {
+            ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
+                    offset, frame.mSize, dataSize - offset - headerSize);
+            if (mVersion == ID3::ID3_V2_4) {
+                // a bogus size is what the iTunes hack is for
+                return false;
+            }
+            break;
+        }
+
+        frame.mOffset = dataOffset + offset + headerSize;
+        offset += headerSize + frame.mSize;
+
+        if ((mVersion == ID3::ID3_V2_4 && (frame.mFlags & 0x000c))
+                || (mVersion == ID3::ID3_V2_3 && (frame.mFlags & 0x00c0))) {
+            // Compression or encryption are not supported at this time.
+            ALOGV("Skipping unsupported frame %s (compression or encryption)",
+                    frame.mID);
+            continue;
+        }
+
+        if (mVersion == ID3::ID3_V2_4) {
+            frame.mFlags &= (kFlagUnsynchronized | kFlagDataLengthIndicator);
+            if ((frame.mFlags & kFlagDataLengthIndicator) && frame.mSize < 4) {
+                return false;
+            }
+        } else {
+            frame.mFlags = 0;
+        }
+
+        mFrames.push(frame);
+    }
+
+    return true;
+}
+
+ssize_t ID3Index::readAt(off64_t offset, void *data, size_t size) const {
+    if (mDecoded == NULL) {
+        return mSource->readAt(offset, data, size);
+    }
+
+    if (offset < 0 || offset >= (off64_t)mDecoded->size()) {
+        return 0;
+    }
+
+    size_t available = mDecoded->size() - offset;
+    size_t copy = (available > size) ? size : available;
+    memcpy(data, mDecoded->data() + offset, copy);
+
+    return copy;
+}
+
+ssize_t ID3Index::findFrame(const char *id, size_t start) const {
+    for (size_t i = start; i < mFrames.size(); ++i) {
+        if (!strcmp(mFrames[i].mID, id)) {
+            return i;
+        }
+    }
+    return -ENOENT;
+}
+
+void ID3Index::getFrameID(size_t index, String8 *id) const {
+    CHECK_LT(index, mFrames.size());
+    id->setTo(mFrames[index].mID);
+}
+
+status_t ID3Index::readFrame(size_t index, sp<ABuffer> *payload) const {
+    CHECK_LT(index, mFrames.size());
+    const Frame &frame = mFrames[index];
+
+    if (frame.mSize > kMaxFrameSize) {
+        ALOGE("skipping huge ID3 frame %s of size %zu", frame.mID, frame.mSize);
+        return ERROR_MALFORMED;
+    }
+
+    sp<ABuffer> buffer = new ABuffer(frame.mSize);
+    if (readAt(frame.mOffset, buffer->data(), frame.mSize) != (ssize_t)frame.mSize) {
+        return ERROR_IO;
+    }
+
+    if (frame.mFlags & kFlagDataLengthIndicator) {
+        buffer->setRange(4, buffer->size() - 4);
+    }
+
+    if (frame.mFlags & kFlagUnsynchronized) {
+        buffer->setRange(
+                buffer->offset(),
+                RemoveUnsynchronization(buffer->data(), buffer->size()));
+    }
+
+    *payload = buffer;
+    return OK;
+}
+
+bool ID3Index::getString(const char *id, String8 *s) const {
+    s->setTo("");
+
+    ssize_t index = findFrame(id);
+    if (index < 0) {
+        return false;
+    }
+
+    sp<ABuffer> payload;
+    if (readFrame(index, &payload) != OK) {
+        return false;
+    }
+
+    ID3::ParseV2String(payload->data(), payload->size(), false /* otherdata */, s);
+    return true;
+}
+
+ssize_t ID3Index::findPictureFrame() const {
+    return findFrame(mVersion == ID3::ID3_V2_2 ? "PIC" : "APIC");
+}
+
+ssize_t ID3Index::parsePictureHeader(
+        const uint8_t *data, size_t size, size_t payloadSize,
+        String8 *mime) const {
+    if (size < 1) {
+        return -EAGAIN;
+    }
+    uint8_t encoding = data[0];
+
+    size_t descOffset;
+    if (mVersion == ID3::ID3_V2_2) {
+        if (size < 5) {
+            return payloadSize < 5 ? ERROR_MALFORMED : -EAGAIN;
+        }
+
+        if (!memcmp(&data[1], "PNG", 3)) {
+            mime->setTo("image/png");
+        } else if (!memcmp(&data[1], "JPG", 3)) {
+            mime->setTo("image/jpeg");
+        } else if (!memcmp(&data[1], "-->", 3)) {
+            mime->setTo("text/plain");
+        } else {
+            return ERROR_MALFORMED;
+        }
+
+        descOffset = 5;
+    } else {
+        size_t mimeLen;
+        if (!BoundedStringSize(&data[1], size - 1, 0x00, &mimeLen)) {
+            return size < payloadSize ? -EAGAIN : ERROR_MALFORMED;
+        }
+        mime->setTo((const char *)&data[1]);
+
+        // skip the picture type
+        descOffset = 2 + mimeLen;
+    }
+
+    size_t descLen;
+    if (descOffset >= size
+            || !BoundedStringSize(&data[descOffset], size - descOffset, encoding, &descLen)) {
+        return size < payloadSize ? -EAGAIN : ERROR_MALFORMED;
+    }
+
+    return descOffset + descLen;
+}
+
+bool ID3Index::getAlbumArtLocation(
+        off64_t *offset, size_t *length, String8 *mime) const {
+    ssize_t index = findPictureFrame();
+    if (index < 0 || mDecoded != NULL) {
+        return false;
+    }
+
+    const Frame &frame = mFrames[index];
+    if (frame.mFlags & kFlagUnsynchronized) {
+        // stored unsynchronized, the caller needs readAlbumArt().
+        return false;
+    }
+
+    if (frame.mSize > kMaxAlbumArtSize) {
+        ALOGW("skipping huge album art of size %zu", frame.mSize);
+        return false;
+    }
+
+    off64_t payloadOffset = frame.mOffset;
+    size_t payloadSize = frame.mSize;
+    if (frame.mFlags & kFlagDataLengthIndicator) {
+        payloadOffset += 4;
+        payloadSize -= 4;
+    }
+
+    for (size_t headerSize = kPictureHeaderSize;; headerSize *= 2) {
+        if (headerSize > payloadSize) {
+            headerSize = payloadSize;
+        }
+
+        uint8_t *header = new uint8_t[headerSize];
+        ssize_t n = mSource->readAt(payloadOffset, header, headerSize);
+        ssize_t pictureOffset = (n == (ssize_t)headerSize)
+                ? parsePictureHeader(header, headerSize, payloadSize, mime)
+                : (ssize_t)ERROR_IO;
+        delete[] header;
+
+        if (pictureOffset >= 0) {
+            *offset = payloadOffset + pictureOffset;
+            *length = payloadSize - pictureOffset;
+            return true;
+        }
+
+        if (pictureOffset != -EAGAIN
+                || headerSize == payloadSize || headerSize >= kMaxPictureHeaderSize) {
+            ALOGW("bogus album art header");
+            return false;
+        }
+    }
+}
+
+sp<ABuffer> ID3Index::readAlbumArt(String8 *mime) const {
+    off64_t offset;
+    size_t length;
+    if (getAlbumArtLocation(&offset, &length, mime)) {
+        sp<ABuffer> buffer = new ABuffer(length);
+        if (mSource->readAt(offset, buffer->data(), length) != (ssize_t)length) {
+            return NULL;
+        }
+        return buffer;
+    }
+
+    ssize_t index = findPictureFrame();
+    if (index < 0 || mFrames[index].mSize > kMaxAlbumArtSize) {
+        return NULL;
+    }
+
+    sp<ABuffer> payload;
+    if (readFrame(index, &payload) != OK) {
+        return NULL;
+    }
+
+    ssize_t pictureOffset =
+        parsePictureHeader(payload->data(), payload->size(), payload->size(), mime);
+    if (pictureOffset < 0) {
+        ALOGW("bogus album art sizes");
+        return NULL;
+    }
+
+    payload->setRange(payload->offset() + pictureOffset, payload->size() - pictureOffset);
+    return payload;
+}
+
+}  // namespace android
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../include/ID3.h"
+#include "../include/ID3Index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/FileSource.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// The text frames MP3Extractor::getMetaData() looks up.
+static const char *kTextFrames[] = {
+    "TALB", "TPE1", "TPE2", "TCOM", "TCON", "TIT2", "TYER", "TEXT", "TRCK", "TPOS",
+};
+static const size_t kNumTextFrames = sizeof(kTextFrames) / sizeof(kTextFrames[0]);
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-s <art size KB>] [-n <iterations>] [-o <dir>]"
+                    " [file ...]\n", me);
+    fprintf(stderr, "       -s size of the synthesized album art, default 2048\n");
+    fprintf(stderr, "       -n iterations per file, default 50\n");
+    fprintf(stderr, "       -o directory for the synthesized files,"
+                    " default /data/local/tmp\n");
+    fprintf(stderr, "       without files, a v2.3 and a v2.4 (unsynchronized)"
+                    " tag are synthesized\n");
+
+    exit(1);
+}
+
+static void writeSyncsafe(uint8_t *out, size_t x) {
+    out[0] = (x >> 21) & 0x7f;
+    out[1] = (x >> 14) & 0x7f;
+    out[2] = (x >> 7) & 0x7f;
+    out[3] = x & 0x7f;
+}
+
+static void appendFrame(
+        Vector<uint8_t> *tag, uint8_t majorVersion, const char *id,
+        const Vector<uint8_t> &payload, uint16_t flags) {
+    uint8_t header[10];
+    memcpy(header, id, 4);
+    if (majorVersion == 4) {
+        writeSyncsafe(&header[4], payload.size());
+    } else {
+        header[4] = payload.size() >> 24;
+        header[5] = (payload.size() >> 16) & 0xff;
+        header[6] = (payload.size() >> 8) & 0xff;
+        header[7] = payload.size() & 0xff;
+    }
+    header[8] = flags >> 8;
+    header[9] = flags & 0xff;
+
+    tag->appendArray(header, sizeof(header));
+    tag->appendVector(payload);
+}
+
+// Writes an ID3v2 tag with text frames and an attached picture of
+// |artSize| bytes, followed by a few silent MPEG audio frames. For v2.4
+// the picture frame is stored unsynchronized.
+static bool synthesize(const char *path, uint8_t majorVersion, size_t artSize) {
+    Vector<uint8_t> frames;
+
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        String8 text = String8::format("%s value %zu", kTextFrames[i], i);
+        Vector<uint8_t> payload;
+        payload.push(0x00);  // ISO 8859-1
+        payload.appendArray((const uint8_t *)text.string(), text.length());
+        appendFrame(&frames, majorVersion, kTextFrames[i], payload, 0);
+    }
+
+    Vector<uint8_t> picture;
+    picture.push(0x00);
+    picture.appendArray((const uint8_t *)"image/jpeg", 11);
+    picture.push(0x03);  // front cover
+    picture.appendArray((const uint8_t *)"cover", 6);
+
+    // JPEG-ish data, rich in 0xff so unsynchronization has work to do.
+    uint32_t seed = 1;
+    for (size_t i = 0; i < artSize; ++i) {
+        seed = seed * 1103515245 + 12345;
+        uint8_t x = (i % 64 == 0) ? 0xff : (seed >> 16) & 0xff;
+        picture.push(x);
+        if (majorVersion == 4 && x == 0xff) {
+            picture.push(0x00);
+        }
+    }
+    appendFrame(&frames, majorVersion, "APIC", picture, majorVersion == 4 ? 0x0002 : 0);
+
+    uint8_t header[10] = { 'I', 'D', '3', majorVersion, 0, 0 };
+    writeSyncsafe(&header[6], frames.size());
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "unable to create %s\n", path);
+        return false;
+    }
+
+    bool success = write(fd, header, sizeof(header)) == (ssize_t)sizeof(header)
+            && write(fd, frames.array(), frames.size()) == (ssize_t)frames.size();
+
+    // MPEG-1 layer III, 128kbps, 44.1kHz
+    static const uint8_t kMpegFrameHeader[4] = { 0xff, 0xfb, 0x90, 0x00 };
+    uint8_t mpegFrame[417];
+    memset(mpegFrame, 0, sizeof(mpegFrame));
+    memcpy(mpegFrame, kMpegFrameHeader, sizeof(kMpegFrameHeader));
+    for (size_t i = 0; success && i < 16; ++i) {
+        success = write(fd, mpegFrame, sizeof(mpegFrame)) == (ssize_t)sizeof(mpegFrame);
+    }
+
+    close(fd);
+    return success;
+}
+
+// Everything MP3Extractor::getMetaData() used to do: parse the whole tag,
+// look up the text frames and copy out the album art.
+static bool parseFull(const sp<DataSource> &source, size_t *artSize) {
+    ID3 tag(source);
+    if (!tag.isValid()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        ID3::Iterator it(tag, kTextFrames[i]);
+        if (!it.done()) {
+            String8 s;
+            it.getString(&s);
+        }
+    }
+
+    String8 mime;
+    *artSize = 0;
+    const void *data = tag.getAlbumArt(artSize, &mime);
+    if (data != NULL) {
+        // as MetaData::setData() would
+        sp<ABuffer> art = new ABuffer(*artSize);
+        memcpy(art->data(), data, *artSize);
+    }
+    return true;
+}
+
+// Text frames through the index and only the location of the album art, or
+// the art itself if it is stored unsynchronized.
+static bool parseIndexed(const sp<DataSource> &source, size_t *artSize, bool *zeroCopy) {
+    ID3Index index(source);
+    if (!index.isValid()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < kNumTextFrames; ++i) {
+        String8 s;
+        index.getString(kTextFrames[i], &s);
+    }
+
+    off64_t offset;
+    String8 mime;
+    *artSize = 0;
+    *zeroCopy = index.getAlbumArtLocation(&offset, artSize, &mime);
+    if (!*zeroCopy) {
+        sp<ABuffer> art = index.readAlbumArt(&mime);
+        if (art != NULL) {
+            *artSize = art->size();
+        }
+    }
+    return true;
+}
+
+static void benchmark(const char *path, int iterations) {
+    sp<FileSource> source = new FileSource(path);
+    if (source->initCheck() != OK) {
+        fprintf(stderr, "unable to open %s\n", path);
+        return;
+    }
+
+    printf("%s\n", path);
+
+    size_t artSize = 0;
+    int64_t startUs = ALooper::GetNowUs();
+    bool valid = true;
+    for (int i = 0; valid && i < iterations; ++i) {
+        valid = parseFull(source, &artSize);
+    }
+    int64_t fullUs = ALooper::GetNowUs() - startUs;
+
+    if (valid) {
+        printf("  ID3:      %8.3f ms/file, album art %zu bytes (copied)\n",
+               fullUs / 1E3 / iterations, artSize);
+    } else {
+        printf("  ID3:      tag rejected\n");
+    }
+
+    bool zeroCopy = false;
+    startUs = ALooper::GetNowUs();
+    valid = true;
+    for (int i = 0; valid && i < iterations; ++i) {
+        valid = parseIndexed(source, &artSize, &zeroCopy);
+    }
+    int64_t indexedUs = ALooper::GetNowUs() - startUs;
+
+    if (valid) {
+        printf("  ID3Index: %8.3f ms/file, album art %zu bytes (%s)\n",
+               indexedUs / 1E3 / iterations, artSize,
+               zeroCopy ? "located" : "copied");
+    } else {
+        printf("  ID3Index: tag rejected\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+
+    size_t artSizeKB = 2048;
+    int iterations = 50;
+    const char *outDir = "/data/local/tmp";
+
+    int res;
+    while ((res = getopt(argc, argv, "s:n:o:")) >= 0) {
+        switch (res) {
+            case 's':
+            {
+                artSizeKB = atoi(optarg);
+                break;
+            }
+
+            case 'n':
+            {
+                iterations = atoi(optarg);
+                if (iterations < 1) {
+                    usage(me);
+                }
+                break;
+            }
+
+            case 'o':
+            {
+                outDir = optarg;
+                break;
+            }
+
+            case '?':
+            default:
+            {
+                usage(me);
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc > 0) {
+        for (int i = 0; i < argc; ++i) {
+            benchmark(argv[i], iterations);
+        }
+        return 0;
+    }
+
+    for (uint8_t majorVersion = 3; majorVersion <= 4; ++majorVersion) {
+        String8 path = String8::format("%s/id3bench_v2.%d.mp3", outDir, majorVersion);
+        if (!synthesize(path.string(), majorVersion, artSizeKB * 1024)) {
+            return 1;
+        }
+
+        benchmark(path.string(), iterations);
+        unlink(path.string());
+    }
+
+    return 0;
+}
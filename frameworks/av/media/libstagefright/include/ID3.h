@@ -74,6 +74,19 @@ struct ID3 {
 
     size_t rawSize() const { return mRawSize; }
 
+    // Decodes the text of an ID3v2 frame payload (starting with the text
+    // encoding byte), see Iterator::getString().
+    static void ParseV2String(
+            const uint8_t *frameData, size_t size, bool otherdata, String8 *s);
+
+    // Checks the 10 byte ID3v2 header at |header| and returns the tag's
+    // major version and the size of the tag following the header.
+    static bool ParseV2Header(
+            const uint8_t header[10], uint8_t *majorVersion, uint8_t *flags,
+            size_t *size);
+
+    static bool ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x);
+
 private:
     bool mIsValid;
     uint8_t *mData;
@@ -90,8 +103,6 @@ private:
     void removeUnsynchronization();
     bool removeUnsynchronizationV2_4(bool iTunesHack);
 
-    static bool ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x);
-
     ID3(const ID3 &);
     ID3 &operator=(const ID3 &);
 };
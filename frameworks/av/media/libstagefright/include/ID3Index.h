@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ID3_INDEX_H_
+
+#define ID3_INDEX_H_
+
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "ID3.h"
+
+namespace android {
+
+struct ABuffer;
+class DataSource;
+class String8;
+
+// Index of the frames of an ID3v2 tag, built in a single pass over the frame
+// headers. Unlike ID3, the tag is not read into memory as a whole: frame
+// payloads are read from the source (and unsynchronization undone) only
+// when asked for, and the picture data of an attached picture frame can be
+// located in the source without reading it at all.
+//
+// Tags using tag-wide unsynchronization (only allowed before v2.4) cannot be
+// walked without decoding, those are read and decoded in one go instead.
+struct ID3Index {
+    ID3Index(const sp<DataSource> &source, off64_t offset = 0);
+    ~ID3Index();
+
+    bool isValid() const;
+
+    ID3::Version version() const;
+
+    // size of the tag including its header
+    size_t rawSize() const { return mRawSize; }
+
+    size_t countFrames() const;
+
+    // Returns the index of the first frame with |id| at or after |start|,
+    // or -ENOENT.
+    ssize_t findFrame(const char *id, size_t start = 0) const;
+
+    void getFrameID(size_t index, String8 *id) const;
+
+    // Reads the payload of a frame, with the data length indicator removed
+    // and unsynchronization undone.
+    status_t readFrame(size_t index, sp<ABuffer> *payload) const;
+
+    // Decodes the text of the first frame with |id|, see ID3::Iterator.
+    bool getString(const char *id, String8 *s) const;
+
+    // If the picture data of the first attached picture frame is stored
+    // verbatim in the source, returns its absolute offset and length.
+    bool getAlbumArtLocation(off64_t *offset, size_t *length, String8 *mime) const;
+
+    // Reads the picture data of the first attached picture frame.
+    sp<ABuffer> readAlbumArt(String8 *mime) const;
+
+private:
+    enum {
+        // v2.4 per frame format flags
+        kFlagUnsynchronized      = 0x0002,
+        kFlagDataLengthIndicator = 0x0001,
+    };
+
+    struct Frame {
+        char mID[5];
+        off64_t mOffset;    // of the payload, in mSource or mDecoded
+        size_t mSize;       // of the payload as stored
+        uint16_t mFlags;    // v2.4 format flags still to be applied
+    };
+
+    sp<DataSource> mSource;
+    bool mIsValid;
+    ID3::Version mVersion;
+    size_t mRawSize;
+
+    // Set for tags with tag-wide unsynchronization, frame offsets are
+    // relative to it then.
+    sp<ABuffer> mDecoded;
+
+    Vector<Frame> mFrames;
+
+    bool parse(off64_t offset);
+    bool indexFrames(
+            off64_t dataOffset, size_t dataSize, size_t firstFrameOffset,
+            bool iTunesHack);
+
+    ssize_t readAt(off64_t offset, void *data, size_t size) const;
+
+    ssize_t findPictureFrame() const;
+
+    // Parses the header of an attached picture frame payload, returns the
+    // offset of the picture data in the payload, -EAGAIN if |data| does not
+    // hold the complete header, or ERROR_MALFORMED.
+    ssize_t parsePictureHeader(
+            const uint8_t *data, size_t size, size_t payloadSize,
+            String8 *mime) const;
+
+    ID3Index(const ID3Index &);
+    ID3Index &operator=(const ID3Index &);
+};
+
+}  // namespace android
+
+#endif  // ID3_INDEX_H_
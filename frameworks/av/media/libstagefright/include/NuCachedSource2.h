@@ -22,8 +22,11 @@
 #include <media/stagefright/foundation/AHandlerReflector.h>
 #include <media/stagefright/DataSource.h>
 
+#include "SharedPageCache.h"
+
 namespace android {
 
+struct ABuffer;
 struct ALooper;
 struct PageCache;
 
@@ -50,6 +53,22 @@ struct NuCachedSource2 : public DataSource {
 
     ////////////////////////////////////////////////////////////////////////////
 
+    // Zero-copy variant of readAt() for ranges that are cached within a
+    // single page: |*data| points to |offset| in |*page|, and stays valid
+    // for as long as |*page| is held. The data must not be modified.
+    // Returns -EAGAIN if readAt() has to be used instead.
+    status_t readAtNoCopy(
+            off64_t offset, size_t size, sp<ABuffer> *page, const uint8_t **data);
+
+    // Shares the pages of this stream through SharedPageCache with other
+    // sources that |client| opens with the same |headers|. Sources are not
+    // shared unless this is called.
+    void enableSharing(const String8 &client, const KeyedVector<String8, String8> *headers);
+
+    // Bytes read from the source, and bytes served by SharedPageCache
+    // instead, since creation.
+    void getStats(size_t *bytesFetched, size_t *bytesShared) const;
+
     size_t cachedSize();
     size_t approxDataRemaining(status_t *finalStatus) const;
 
@@ -78,7 +97,7 @@ protected:
             bool disconnectAtHighwatermark);
 
     enum {
-        kPageSize                       = 65536,
+        kPageSize                       = SharedPageCache::kPageSize,
         kDefaultHighWaterThreshold      = 20 * 1024 * 1024,
         kDefaultLowWaterThreshold       = 4 * 1024 * 1024,
 
@@ -113,6 +132,11 @@ protected:
     bool mDisconnecting;
     int64_t mLastFetchTimeUs;
 
+    // Identifies the stream in SharedPageCache, empty if not shared.
+    String8 mStreamKey;
+    size_t mNumBytesFetched;
+    size_t mNumBytesShared;
+
     int32_t mNumRetriesLeft;
 
     size_t mHighwaterThresholdBytes;
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHARED_PAGE_CACHE_H_
+
+#define SHARED_PAGE_CACHE_H_
+
+#include <sys/types.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+struct ABuffer;
+
+// Process-wide cache of pages fetched by NuCachedSource2, so that a stream
+// opened again (e.g. preview, then playback) is served from memory instead
+// of being fetched a second time.
+//
+// Pages are kPageSize bytes at page-aligned offsets of a stream and are
+// immutable once inserted. They are reference counted: evicting a page
+// only drops the cache's reference, sources still holding it keep reading
+// it. The cache is bounded by the bytes it references, in LRU order.
+struct SharedPageCache {
+    enum {
+        kPageSize = 65536,
+    };
+
+    static SharedPageCache *getInstance();
+
+    // Identifies a stream by the client reading it, its URI, the request
+    // headers and its length. The response can depend on credentials only
+    // the client has, cookies included, so streams are never shared between
+    // clients. Returns an empty key for streams that must not be shared (no
+    // client, no URI or unknown length).
+    static String8 MakeStreamKey(
+            const String8 &client, const String8 &uri,
+            const KeyedVector<String8, String8> *headers, off64_t size);
+
+    // Returns the page at page-aligned |offset| of the stream, or NULL.
+    // The page must not be modified.
+    sp<ABuffer> lookup(const String8 &streamKey, off64_t offset);
+
+    // Adds a complete page, ignored if caching is disabled.
+    void insert(const String8 &streamKey, off64_t offset, const sp<ABuffer> &page);
+
+    // Sets the budget, 0 disables the cache. Defaults to the
+    // "media.stagefright.shared-cache-kb" property.
+    void setMaxBytes(size_t maxBytes);
+    size_t maxBytes() const;
+
+    enum TrimLevel {
+        // drop down to half the budget
+        TRIM_MODERATE,
+        // drop everything
+        TRIM_COMPLETE,
+    };
+
+    // To be called under memory pressure. mediaserver isn't told about it,
+    // so lookup() and insert() also trim when the system runs low on memory.
+    void trim(TrimLevel level);
+
+    struct Stats {
+        size_t mLookups;
+        size_t mHits;
+        size_t mInsertions;
+        size_t mEvictions;
+        size_t mBytes;
+        size_t mPages;
+        size_t mPagesInUse;  // also referenced by a source
+    };
+    void getStats(Stats *stats) const;
+
+private:
+    static const size_t kDefaultMaxBytes;
+    static const int64_t kMemoryCheckIntervalUs;
+
+    mutable Mutex mLock;
+    KeyedVector<String8, sp<ABuffer> > mPages;
+    List<String8> mLRU;  // front is least recently used
+    size_t mMaxBytes;
+    size_t mTotalBytes;
+    size_t mNumLookups;
+    size_t mNumHits;
+    size_t mNumInsertions;
+    size_t mNumEvictions;
+    int64_t mLastMemoryCheckUs;
+
+    SharedPageCache();
+
+    void touch_l(const String8 &key);
+    void evict_l(size_t maxBytes);
+    void trim_l(TrimLevel level);
+
+    // Trims the cache if memory is low, looked at no more than once every
+    // kMemoryCheckIntervalUs.
+    void checkMemory_l();
+
+    SharedPageCache(const SharedPageCache &);
+    SharedPageCache &operator=(const SharedPageCache &);
+};
+
+}  // namespace android
+
+#endif  // SHARED_PAGE_CACHE_H_
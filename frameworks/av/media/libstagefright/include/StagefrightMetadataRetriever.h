@@ -41,6 +41,13 @@ struct StagefrightMetadataRetriever : public MediaMetadataRetrieverInterface {
     virtual status_t setDataSource(const sp<DataSource>& source);
 
     virtual VideoFrame *getFrameAtTime(int64_t timeUs, int option);
+
+    // Thumbnail mode: decodes only the sync sample nearest to |timeUs| and
+    // returns it scaled down to fit within maxWidth x maxHeight. Results are
+    // cached process-wide for sources with a stable identity.
+    virtual VideoFrame *getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight);
+
     virtual MediaAlbumArt *extractAlbumArt();
     virtual const char *extractMetadata(int keyCode);
 
@@ -49,11 +56,26 @@ private:
     sp<DataSource> mSource;
     sp<MediaExtractor> mExtractor;
 
+    // Identifies the content of mSource for ThumbnailCache, empty if the
+    // source has no stable identity.
+    String8 mSourceKey;
+
     bool mParsedMetaData;
     KeyedVector<int, String8> mMetaData;
     MediaAlbumArt *mAlbumArt;
 
+    // Location of album art the extractor left in mSource, it is only read
+    // when asked for.
+    off64_t mAlbumArtOffset;
+    size_t mAlbumArtSize;
+
+    VideoFrame *getFrameInternal(
+            int64_t timeUs, int option, int32_t maxWidth, int32_t maxHeight);
+
     void parseMetaData();
+    void parseAlbumArt(const sp<MetaData> &meta);
+    MediaAlbumArt *readAlbumArt();
+
     // Delete album art and clear metadata.
     void clearMetadata();
 
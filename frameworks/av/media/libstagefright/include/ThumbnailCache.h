@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THUMBNAIL_CACHE_H_
+
+#define THUMBNAIL_CACHE_H_
+
+#include <media/stagefright/foundation/AString.h>
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+struct AHandler;
+struct ALooper;
+struct MediaCodec;
+class VideoFrame;
+
+// Process-wide cache of decoded thumbnails, keyed by an identity string for
+// the source (see StagefrightMetadataRetriever) plus the requested time,
+// seek mode and target size. Bounded by total pixel memory, LRU eviction.
+struct ThumbnailCache {
+    static ThumbnailCache *getInstance();
+
+    // Returns a copy of the cached frame, or NULL on a miss.
+    VideoFrame *lookup(const String8 &key);
+
+    // Stores a copy of |frame| under |key|.
+    void insert(const String8 &key, const VideoFrame &frame);
+
+    void clear();
+
+    void getStats(size_t *hits, size_t *misses, size_t *bytes) const;
+
+    static String8 MakeKey(
+            const String8 &sourceKey, int64_t timeUs, int option,
+            int32_t maxWidth, int32_t maxHeight);
+
+private:
+    enum {
+        kMaxBytes = 8 * 1024 * 1024,
+    };
+
+    mutable Mutex mLock;
+    KeyedVector<String8, VideoFrame *> mFrames;
+    List<String8> mLRU;  // front is least recently used
+    size_t mTotalBytes;
+    size_t mNumHits;
+    size_t mNumMisses;
+
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    void touch_l(const String8 &key);
+    void evict_l(size_t bytesNeeded);
+
+    ThumbnailCache(const ThumbnailCache &);
+    ThumbnailCache &operator=(const ThumbnailCache &);
+};
+
+// Keeps recently used software video decoders allocated across thumbnail
+// requests so that consecutive getFrameAtTime() calls for the same format
+// skip component instantiation. Decoders are returned to the pool in the
+// INITIALIZED state (after stop()) and must be reconfigured by the caller.
+// Hardware decoders are never pooled since they are a shared resource.
+struct ThumbnailDecoderPool {
+    static ThumbnailDecoderPool *getInstance();
+
+    sp<MediaCodec> acquire(const char *componentName, status_t *err);
+
+    // Returns a stopped decoder to the pool, or releases it if the pool
+    // is full or |componentName| is not eligible for pooling.
+    void recycle(const char *componentName, const sp<MediaCodec> &codec);
+
+    void getStats(size_t *reused, size_t *created) const;
+
+private:
+    struct PurgeHandler;
+
+    enum {
+        kMaxIdlePerComponent = 1,
+    };
+
+    static const int64_t kIdleTimeoutUs;
+
+    struct IdleCodec {
+        AString mComponentName;
+        sp<MediaCodec> mCodec;
+        int64_t mIdleSinceUs;
+    };
+
+    mutable Mutex mLock;
+    List<IdleCodec> mIdle;
+    size_t mNumReused;
+    size_t mNumCreated;
+
+    // Wakes up while decoders are idle, so that they are released once
+    // thumbnail requests stop rather than at the next one.
+    sp<ALooper> mPurgeLooper;
+    sp<AHandler> mPurgeHandler;
+    bool mPurgeScheduled;
+
+    ThumbnailDecoderPool();
+
+    // Releases idle decoders that have not been used for kIdleTimeoutUs.
+    void purgeExpired_l(int64_t nowUs, List<sp<MediaCodec> > *expired);
+    void schedulePurge_l();
+    void onPurge();
+
+    ThumbnailDecoderPool(const ThumbnailDecoderPool &);
+    ThumbnailDecoderPool &operator=(const ThumbnailDecoderPool &);
+};
+
+}  // namespace android
+
+#endif  // THUMBNAIL_CACHE_H_
@@ -68,10 +68,28 @@ public:
         return front(true);
     }
 
+    // Moves all queued elements to the end of |out|, waiting until there is
+    // at least one. Consumers that can work on batches take one lock round
+    // trip per batch instead of one per element.
+    void drainTo(List<T>& out) {
+        Mutex::Autolock autolock(mLock);
+        while (mList.empty()) {
+            mContentAvailableCondition.wait(mLock);
+        }
+        for (typename List<T>::iterator it = mList.begin(); it != mList.end(); ++it) {
+            out.push_back(*it);
+        }
+        mList.clear();
+    }
+
     void push(T e) {
         Mutex::Autolock autolock(mLock);
+        // consumers only ever wait on an empty queue
+        bool wasEmpty = mList.empty();
         mList.push_back(e);
-        mContentAvailableCondition.signal();
+        if (wasEmpty) {
+            mContentAvailableCondition.signal();
+        }
     }
 };
 
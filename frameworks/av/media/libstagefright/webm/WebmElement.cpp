@@ -35,6 +35,10 @@ using namespace webm;
 
 namespace {
 
+// Clusters bigger than this are written through a mapping of the file rather
+// than kept in a scratch buffer.
+const uint64_t kMaxScratchSize = 4 * 1024 * 1024;
+
 int64_t voidSize(int64_t totalSize) {
     if (totalSize < 2) {
         return -1;
@@ -45,6 +49,15 @@ int64_t voidSize(int64_t totalSize) {
     return totalSize - 9;
 }
 
+uint64_t cuePointsSum(const Vector<WebmCuePoint>& cuePoints, int trackNum) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < cuePoints.size(); ++i) {
+        total += WebmElement::CuePointEntry(
+                cuePoints[i].mTime, trackNum, cuePoints[i].mClusterPosition)->totalSize();
+    }
+    return total;
+}
+
 uint64_t childrenSum(const List<sp<WebmElement> >& children) {
     uint64_t total = 0;
     for (List<sp<WebmElement> >::const_iterator it = children.begin();
@@ -130,6 +143,39 @@ int WebmElement::write(int fd, uint64_t& size) {
     }
 }
 
+int WebmElement::write(int fd, uint64_t& size, sp<ABuffer>& scratch) {
+    size = totalSize();
+    if (size > kMaxScratchSize) {
+        return write(fd, size);
+    }
+    if (scratch == NULL || scratch->capacity() < size) {
+        // grow geometrically, clusters tend to get larger as bitrates ramp up
+        uint64_t capacity = scratch == NULL ? 0 : scratch->capacity() * 2;
+        if (capacity > kMaxScratchSize) {
+            capacity = kMaxScratchSize;
+        }
+        scratch = new ABuffer(capacity > size ? capacity : size);
+    }
+
+    serializeInto(scratch->base());
+
+    const uint8_t *data = scratch->base();
+    uint64_t remaining = size;
+    while (remaining > 0) {
+        ssize_t n = ::write(fd, data, remaining);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("write failed; errno = %d", errno);
+            return errno;
+        }
+        data += n;
+        remaining -= n;
+    }
+    return 0;
+}
+
 //=================================================================================================
 
 WebmUnsigned::WebmUnsigned(uint64_t id, uint64_t value)
@@ -202,11 +248,44 @@ WebmSimpleBlock::WebmSimpleBlock(
 }
 
 void WebmSimpleBlock::serializePayload(uint8_t *buf) {
-    serializeCodedUnsigned(encodeUnsigned(mTrackNum), buf);
-    buf[1] = (mRelTimecode & 0xff00) >> 8;
-    buf[2] = mRelTimecode & 0xff;
-    buf[3] = mKey ? 0x80 : 0;
-    memcpy(buf + 4, mRef->data(), mSize - 4);
+    SerializePayload(buf, mTrackNum, mRelTimecode, mKey, mRef->data(), mSize - 4);
+}
+
+// static
+void WebmSimpleBlock::SerializePayload(
+        uint8_t *buf,
+        int trackNum,
+        int16_t timecode,
+        bool key,
+        const uint8_t *data,
+        uint64_t dataSize) {
+    serializeCodedUnsigned(encodeUnsigned(trackNum), buf);
+    buf[1] = (timecode & 0xff00) >> 8;
+    buf[2] = timecode & 0xff;
+    buf[3] = key ? 0x80 : 0;
+    memcpy(buf + 4, data, dataSize);
+}
+
+// static
+uint64_t WebmSimpleBlock::TotalSize(uint64_t dataSize) {
+    uint64_t payloadSize = dataSize + 4;
+    return sizeOf(kMkvSimpleBlock) + sizeOf(encodeUnsigned(payloadSize)) + payloadSize;
+}
+
+// static
+uint64_t WebmSimpleBlock::SerializeInto(
+        uint8_t *buf,
+        int trackNum,
+        int16_t timecode,
+        bool key,
+        const uint8_t *data,
+        uint64_t dataSize) {
+    uint8_t *cur = buf;
+    cur += serializeCodedUnsigned(kMkvSimpleBlock, cur);
+    cur += serializeCodedUnsigned(encodeUnsigned(dataSize + 4), cur);
+    SerializePayload(cur, trackNum, timecode, key, data, dataSize);
+    cur += dataSize + 4;
+    return cur - buf;
 }
 
 //=================================================================================================
@@ -228,6 +307,31 @@ void EbmlVoid::serializePayload(uint8_t *buf) {
 
 //=================================================================================================
 
+WebmCues::WebmCues(const Vector<WebmCuePoint>& cuePoints, int trackNum)
+    : WebmElement(kMkvCues, cuePointsSum(cuePoints, trackNum)),
+      mCuePoints(cuePoints),
+      mTrackNum(trackNum) {
+}
+
+int WebmCues::serializePayloadSize(uint8_t *buf) {
+    if (mSize == 0) {
+        // same as an empty WebmMaster
+        return serializeCodedUnsigned(kMkvUnknownLength, buf);
+    }
+    return WebmElement::serializePayloadSize(buf);
+}
+
+void WebmCues::serializePayload(uint8_t *buf) {
+    uint64_t off = 0;
+    for (size_t i = 0; i < mCuePoints.size(); ++i) {
+        sp<WebmElement> cuePoint = CuePointEntry(
+                mCuePoints[i].mTime, mTrackNum, mCuePoints[i].mClusterPosition);
+        off += cuePoint->serializeInto(buf + off);
+    }
+}
+
+//=================================================================================================
+
 WebmMaster::WebmMaster(uint64_t id, const List<sp<WebmElement> >& children)
     : WebmElement(id, childrenSum(children)), mChildren(children) {
 }
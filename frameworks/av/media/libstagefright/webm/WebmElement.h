@@ -21,6 +21,7 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -37,6 +38,13 @@ struct WebmElement : public LightRefBase<WebmElement> {
     uint8_t *serialize(uint64_t& size);
     int write(int fd, uint64_t& size);
 
+    // Like write(fd, size) but serializes into |scratch|, which is grown as
+    // needed up to 4 MB and kept by the caller for the next element, and
+    // appends it to the file with write(2) instead of mapping the file.
+    // Elements too big for the scratch buffer are written as write(fd, size)
+    // does.
+    int write(int fd, uint64_t& size, sp<ABuffer>& scratch);
+
     static sp<WebmElement> EbmlHeader(
             int ver = 1,
             int readVer = 1,
@@ -106,6 +114,26 @@ struct WebmSimpleBlock : public WebmElement {
 
     WebmSimpleBlock(int trackNum, int16_t timecode, bool key, const sp<ABuffer>& orig);
     void serializePayload(uint8_t *buf);
+
+    // Size and serialization of a simple block element, for writers that
+    // do not want to allocate one per frame.
+    static uint64_t TotalSize(uint64_t dataSize);
+    static uint64_t SerializeInto(
+            uint8_t *buf,
+            int trackNum,
+            int16_t timecode,
+            bool key,
+            const uint8_t *data,
+            uint64_t dataSize);
+
+private:
+    static void SerializePayload(
+            uint8_t *buf,
+            int trackNum,
+            int16_t timecode,
+            bool key,
+            const uint8_t *data,
+            uint64_t dataSize);
 };
 
 struct EbmlVoid : public WebmElement {
@@ -115,6 +143,22 @@ struct EbmlVoid : public WebmElement {
     void serializePayload(uint8_t *buf);
 };
 
+// Cue point of a cluster, 16 bytes instead of a tree of elements.
+struct WebmCuePoint {
+    uint64_t mTime;
+    uint64_t mClusterPosition;
+};
+
+// The cues element, serialized from a compact list of cue points. The
+// element tree of each cue point only exists while it is serialized.
+struct WebmCues : public WebmElement {
+    const Vector<WebmCuePoint> &mCuePoints;
+    const int mTrackNum;
+    WebmCues(const Vector<WebmCuePoint> &cuePoints, int trackNum);
+    int serializePayloadSize(uint8_t *buf);
+    void serializePayload(uint8_t *buf);
+};
+
 struct WebmMaster : public WebmElement {
     const List<sp<WebmElement> > mChildren;
     WebmMaster(uint64_t id);
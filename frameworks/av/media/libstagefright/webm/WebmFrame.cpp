@@ -27,15 +27,77 @@ using namespace android;
 using namespace webm;
 
 namespace {
-sp<ABuffer> toABuffer(MediaBuffer *mbuf) {
-    sp<ABuffer> abuf = new ABuffer(mbuf->range_length());
+
+// Pooled buffers are for frames of up to kMaxPooledBufferSize, and the pool
+// holds no more than kMaxPooledBytes in all.
+const size_t kMaxPooledBufferSize = 1024 * 1024;
+const size_t kMaxPooledBytes = 4 * 1024 * 1024;
+const size_t kPoolGranularity = 4096;
+
+sp<ABuffer> toABuffer(const sp<WebmFramePool>& pool, MediaBuffer *mbuf) {
+    sp<ABuffer> abuf = pool->obtain(mbuf->range_length());
     memcpy(abuf->data(), (uint8_t*) mbuf->data() + mbuf->range_offset(), mbuf->range_length());
     return abuf;
 }
+
+uint64_t clusterSize(uint64_t timecode, const List<const sp<WebmFrame> >& frames) {
+    sp<WebmElement> timecodeElement = new WebmUnsigned(kMkvTimecode, timecode);
+    uint64_t total = timecodeElement->totalSize();
+    for (List<const sp<WebmFrame> >::const_iterator it = frames.begin();
+            it != frames.end(); ++it) {
+        total += WebmSimpleBlock::TotalSize((*it)->mData->size());
+    }
+    return total;
+}
+
 }
 
 namespace android {
 
+WebmFramePool::WebmFramePool()
+    : mBytes(0) {
+}
+
+sp<ABuffer> WebmFramePool::obtain(size_t size) {
+    {
+        Mutex::Autolock autoLock(mLock);
+        for (List<sp<ABuffer> >::iterator it = mBuffers.begin(); it != mBuffers.end(); ++it) {
+            if ((*it)->capacity() >= size) {
+                sp<ABuffer> abuf = *it;
+                mBuffers.erase(it);
+                mBytes -= abuf->capacity();
+                abuf->setRange(0, size);
+                return abuf;
+            }
+        }
+    }
+
+    // round up so that buffers fit frames of similar sizes when recycled
+    sp<ABuffer> abuf = new ABuffer((size + kPoolGranularity - 1) & ~(kPoolGranularity - 1));
+    abuf->setRange(0, size);
+    return abuf;
+}
+
+void WebmFramePool::recycle(const sp<ABuffer>& abuf) {
+    if (abuf->capacity() == 0 || abuf->capacity() > kMaxPooledBufferSize) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    if (mBytes + abuf->capacity() <= kMaxPooledBytes) {
+        mBuffers.push_back(abuf);
+        mBytes += abuf->capacity();
+    }
+}
+
+void WebmFramePool::clear() {
+    Mutex::Autolock autoLock(mLock);
+    mBuffers.clear();
+    mBytes = 0;
+}
+
+//=================================================================================================
+
 const sp<WebmFrame> WebmFrame::EOS = new WebmFrame();
 
 WebmFrame::WebmFrame()
@@ -46,12 +108,21 @@ WebmFrame::WebmFrame()
       mEos(true) {
 }
 
-WebmFrame::WebmFrame(int type, bool key, uint64_t absTimecode, MediaBuffer *mbuf)
+WebmFrame::WebmFrame(int type, bool key, uint64_t absTimecode, MediaBuffer *mbuf,
+        const sp<WebmFramePool>& pool)
     : mType(type),
       mKey(key),
       mAbsTimecode(absTimecode),
-      mData(toABuffer(mbuf)),
-      mEos(false) {
+      mData(toABuffer(pool, mbuf)),
+      mEos(false),
+      mPool(pool) {
+}
+
+WebmFrame::~WebmFrame() {
+    // the buffer may still be referenced by a simple block element
+    if (mPool != NULL && mData->getStrongCount() == 1) {
+        mPool->recycle(mData);
+    }
 }
 
 sp<WebmElement> WebmFrame::SimpleBlock(uint64_t baseTimecode) const {
@@ -80,4 +151,28 @@ bool WebmFrame::operator<(const WebmFrame &other) const {
     }
     return this->mAbsTimecode < other.mAbsTimecode;
 }
+
+//=================================================================================================
+
+WebmCluster::WebmCluster(uint64_t timecode, const List<const sp<WebmFrame> >& frames)
+    : WebmElement(kMkvCluster, clusterSize(timecode, frames)),
+      mTimecode(timecode),
+      mFrames(frames) {
+}
+
+void WebmCluster::serializePayload(uint8_t *buf) {
+    sp<WebmElement> timecodeElement = new WebmUnsigned(kMkvTimecode, mTimecode);
+    uint8_t *cur = buf + timecodeElement->serializeInto(buf);
+    for (List<const sp<WebmFrame> >::const_iterator it = mFrames.begin();
+            it != mFrames.end(); ++it) {
+        const sp<WebmFrame> f = *it;
+        cur += WebmSimpleBlock::SerializeInto(
+                cur,
+                f->mType == kVideoType ? kVideoTrackNum : kAudioTrackNum,
+                f->mAbsTimecode - mTimecode,
+                f->mKey,
+                f->mData->data(),
+                f->mData->size());
+    }
+}
 } /* namespace android */
@@ -19,8 +19,31 @@
 
 #include "WebmElement.h"
 
+#include <utils/List.h>
+#include <utils/threads.h>
+
 namespace android {
 
+// Recycles the payload buffers of one writer's frames. Every encoded frame
+// is copied out of its MediaBuffer, and without a pool a recording allocates
+// and frees one buffer per frame for its whole duration.
+struct WebmFramePool : LightRefBase<WebmFramePool> {
+public:
+    WebmFramePool();
+
+    sp<ABuffer> obtain(size_t size);
+    void recycle(const sp<ABuffer>& abuf);
+    // Frees every pooled buffer.
+    void clear();
+
+private:
+    Mutex mLock;
+    List<sp<ABuffer> > mBuffers;
+    size_t mBytes;
+
+    DISALLOW_EVIL_CONSTRUCTORS(WebmFramePool);
+};
+
 struct WebmFrame : LightRefBase<WebmFrame> {
 public:
     const int mType;
@@ -30,8 +53,9 @@ public:
     const bool mEos;
 
     WebmFrame();
-    WebmFrame(int type, bool key, uint64_t absTimecode, MediaBuffer *buf);
-    ~WebmFrame() {}
+    WebmFrame(int type, bool key, uint64_t absTimecode, MediaBuffer *buf,
+            const sp<WebmFramePool>& pool);
+    ~WebmFrame();
 
     sp<WebmElement> SimpleBlock(uint64_t baseTimecode) const;
 
@@ -39,8 +63,24 @@ public:
 
     static const sp<WebmFrame> EOS;
 private:
+    const sp<WebmFramePool> mPool;
+
     DISALLOW_EVIL_CONSTRUCTORS(WebmFrame);
 };
 
+// A cluster serialized straight from its frames, without a simple block
+// element per frame. Equivalent to a WebmMaster holding a timecode element
+// followed by the frames' SimpleBlock()s.
+struct WebmCluster : public WebmElement {
+    WebmCluster(uint64_t timecode, const List<const sp<WebmFrame> >& frames);
+    void serializePayload(uint8_t *buf);
+
+private:
+    const uint64_t mTimecode;
+    const List<const sp<WebmFrame> > mFrames;
+
+    DISALLOW_EVIL_CONSTRUCTORS(WebmCluster);
+};
+
 } /* namespace android */
 #endif /* WEBMFRAME_H_ */
@@ -66,7 +66,7 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         sp<WebmFrameSourceThread> videoThread,
         sp<WebmFrameSourceThread> audioThread,
-        List<sp<WebmElement> >& cues)
+        Vector<WebmCuePoint>& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoThread->mSink),
@@ -80,7 +80,7 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
         LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-        List<sp<WebmElement> >& cues)
+        Vector<WebmCuePoint>& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoSource),
@@ -98,32 +98,29 @@ WebmFrameSinkThread::WebmFrameSinkThread(
 //   the starting timecode of the cluster; this is the timecode of the first
 //   frame since frames are ordered by timestamp.
 //
-// children:
-//   list to hold child elements in a webm cluster (start timecode and
-//   simple blocks).
+// clusterFrames:
+//   list to hold the frames written out as simple blocks of the cluster.
 //
 // static
 void WebmFrameSinkThread::initCluster(
     List<const sp<WebmFrame> >& frames,
     uint64_t& clusterTimecodeL,
-    List<sp<WebmElement> >& children) {
-    CHECK(!frames.empty() && children.empty());
+    List<const sp<WebmFrame> >& clusterFrames) {
+    CHECK(!frames.empty() && clusterFrames.empty());
 
     const sp<WebmFrame> f = *(frames.begin());
     clusterTimecodeL = f->mAbsTimecode;
-    WebmUnsigned *clusterTimecode = new WebmUnsigned(kMkvTimecode, clusterTimecodeL);
-    children.clear();
-    children.push_back(clusterTimecode);
 }
 
-void WebmFrameSinkThread::writeCluster(List<sp<WebmElement> >& children) {
-    // children must contain at least one simpleblock and its timecode
-    CHECK_GE(children.size(), 2);
+void WebmFrameSinkThread::writeCluster(
+        uint64_t clusterTimecodeL, List<const sp<WebmFrame> >& clusterFrames) {
+    // a cluster must contain at least one simpleblock
+    CHECK_GE(clusterFrames.size(), 1);
 
     uint64_t size;
-    sp<WebmElement> cluster = new WebmMaster(kMkvCluster, children);
-    cluster->write(mFd, size);
-    children.clear();
+    sp<WebmElement> cluster = new WebmCluster(clusterTimecodeL, clusterFrames);
+    cluster->write(mFd, size, mScratch);
+    clusterFrames.clear();
 }
 
 // Write out (possibly multiple) webm cluster(s) from frames split on video key frames.
@@ -136,8 +133,8 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
     }
 
     uint64_t clusterTimecodeL;
-    List<sp<WebmElement> > children;
-    initCluster(frames, clusterTimecodeL, children);
+    List<const sp<WebmFrame> > clusterFrames;
+    initCluster(frames, clusterTimecodeL, clusterFrames);
 
     uint64_t cueTime = clusterTimecodeL;
     off_t fpos = ::lseek(mFd, 0, SEEK_CUR);
@@ -160,12 +157,12 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         }
 
         if (f->mAbsTimecode - clusterTimecodeL > INT16_MAX) {
-            writeCluster(children);
-            initCluster(frames, clusterTimecodeL, children);
+            writeCluster(clusterTimecodeL, clusterFrames);
+            initCluster(frames, clusterTimecodeL, clusterFrames);
         }
 
         frames.erase(frames.begin());
-        children.push_back(f->SimpleBlock(clusterTimecodeL));
+        clusterFrames.push_back(f);
     }
 
     // equivalent to last==false
@@ -174,12 +171,14 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         const sp<WebmFrame> secondLastFrame = *(frames.begin());
         if (secondLastFrame->mType == kVideoType) {
             frames.erase(frames.begin());
-            children.push_back(secondLastFrame->SimpleBlock(clusterTimecodeL));
+            clusterFrames.push_back(secondLastFrame);
         }
     }
 
-    writeCluster(children);
-    sp<WebmElement> cuePoint = WebmElement::CuePointEntry(cueTime, 1, fpos - mSegmentDataStart);
+    writeCluster(clusterTimecodeL, clusterFrames);
+    WebmCuePoint cuePoint;
+    cuePoint.mTime = cueTime;
+    cuePoint.mClusterPosition = fpos - mSegmentDataStart;
     mCues.push_back(cuePoint);
 }
 
@@ -198,13 +197,24 @@ status_t WebmFrameSinkThread::stop() {
 void WebmFrameSinkThread::run() {
     int numVideoKeyFrames = 0;
     List<const sp<WebmFrame> > outstandingFrames;
+    // Frames are drained from the source queues in batches; the EOS frame
+    // of a track is never consumed, so a drained list only runs empty while
+    // its track is still producing.
+    List<const sp<WebmFrame> > videoFrames;
+    List<const sp<WebmFrame> > audioFrames;
     while (!mDone) {
-        ALOGV("wait v frame");
-        const sp<WebmFrame> videoFrame = mVideoFrames.peek();
+        if (videoFrames.empty()) {
+            ALOGV("wait v frames");
+            mVideoFrames.drainTo(videoFrames);
+        }
+        const sp<WebmFrame> videoFrame = *videoFrames.begin();
         ALOGV("v frame: %p", videoFrame.get());
 
-        ALOGV("wait a frame");
-        const sp<WebmFrame> audioFrame = mAudioFrames.peek();
+        if (audioFrames.empty()) {
+            ALOGV("wait a frames");
+            mAudioFrames.drainTo(audioFrames);
+        }
+        const sp<WebmFrame> audioFrame = *audioFrames.begin();
         ALOGV("a frame: %p", audioFrame.get());
 
         if (videoFrame->mEos && audioFrame->mEos) {
@@ -213,11 +223,11 @@ void WebmFrameSinkThread::run() {
 
         if (*audioFrame < *videoFrame) {
             ALOGV("take a frame");
-            mAudioFrames.take();
+            audioFrames.erase(audioFrames.begin());
             outstandingFrames.push_back(audioFrame);
         } else {
             ALOGV("take v frame");
-            mVideoFrames.take();
+            videoFrames.erase(videoFrames.begin());
             outstandingFrames.push_back(videoFrame);
             if (videoFrame->mKey)
                 numVideoKeyFrames++;
@@ -253,9 +263,11 @@ WebmFrameMediaSourceThread::WebmFrameMediaSourceThread(
         int64_t startTimeRealUs,
         int32_t startTimeOffsetMs,
         int numTracks,
-        bool realTimeRecording)
+        bool realTimeRecording,
+        const sp<WebmFramePool>& pool)
     : WebmFrameSourceThread(type, sink),
       mSource(source),
+      mPool(pool),
       mTimeCodeScale(timeCodeScale),
       mTrackDurationUs(0) {
     clearFlags();
@@ -373,7 +385,8 @@ void WebmFrameMediaSourceThread::run() {
             mType,
             isSync,
             timestampUs * 1000 / mTimeCodeScale,
-            buffer);
+            buffer,
+            mPool);
         mSink.push(f);
 
         ALOGV(
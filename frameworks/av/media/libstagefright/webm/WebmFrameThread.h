@@ -61,14 +61,14 @@ public:
             const uint64_t& off,
             sp<WebmFrameSourceThread> videoThread,
             sp<WebmFrameSourceThread> audioThread,
-            List<sp<WebmElement> >& cues);
+            Vector<WebmCuePoint>& cues);
 
     WebmFrameSinkThread(
             const int& fd,
             const uint64_t& off,
             LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
             LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-            List<sp<WebmElement> >& cues);
+            Vector<WebmCuePoint>& cues);
 
     void run();
     bool running() {
@@ -82,15 +82,18 @@ private:
     const uint64_t& mSegmentDataStart;
     LinkedBlockingQueue<const sp<WebmFrame> >& mVideoFrames;
     LinkedBlockingQueue<const sp<WebmFrame> >& mAudioFrames;
-    List<sp<WebmElement> >& mCues;
+    Vector<WebmCuePoint>& mCues;
+
+    // reused to serialize clusters
+    sp<ABuffer> mScratch;
 
     volatile bool mDone;
 
     static void initCluster(
             List<const sp<WebmFrame> >& frames,
             uint64_t& clusterTimecodeL,
-            List<sp<WebmElement> >& children);
-    void writeCluster(List<sp<WebmElement> >& children);
+            List<const sp<WebmFrame> >& clusterFrames);
+    void writeCluster(uint64_t clusterTimecodeL, List<const sp<WebmFrame> >& clusterFrames);
     void flushFrames(List<const sp<WebmFrame> >& frames, bool last);
 };
 
@@ -130,7 +133,8 @@ public:
             int64_t startTimeRealUs,
             int32_t startTimeOffsetMs,
             int numPeers,
-            bool realTimeRecording);
+            bool realTimeRecording,
+            const sp<WebmFramePool>& pool);
 
     void run();
     status_t start();
@@ -143,6 +147,7 @@ public:
 
 private:
     const sp<MediaSource> mSource;
+    const sp<WebmFramePool> mPool;
     const uint64_t mTimeCodeScale;
     uint64_t mStartTimeUs;
 
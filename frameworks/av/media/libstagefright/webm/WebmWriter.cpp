@@ -69,7 +69,8 @@ WebmWriter::WebmWriter(int fd)
       mIsFileSizeLimitExplicitlyRequested(false),
       mIsRealTimeRecording(false),
       mStreamableFile(true),
-      mEstimatedCuesSize(0) {
+      mEstimatedCuesSize(0),
+      mFramePool(new WebmFramePool) {
     mStreams[kAudioIndex] = WebmStream(kAudioType, "Audio", &WebmWriter::audioTrack);
     mStreams[kVideoIndex] = WebmStream(kVideoType, "Video", &WebmWriter::videoTrack);
     mSinkThread = new WebmFrameSinkThread(
@@ -218,13 +219,15 @@ void WebmWriter::initStream(size_t idx) {
                 mStartTimestampUs,
                 mStartTimeOffsetMs,
                 numTracks(),
-                mIsRealTimeRecording);
+                mIsRealTimeRecording,
+                mFramePool);
     }
 }
 
 void WebmWriter::release() {
     close(mFd);
     mFd = -1;
+    mFramePool->clear();
     mInitCheck = NO_INIT;
     mStarted = false;
 }
@@ -273,7 +276,7 @@ status_t WebmWriter::reset() {
         return err;
     }
 
-    sp<WebmElement> cues = new WebmMaster(kMkvCues, mCuePoints);
+    sp<WebmElement> cues = new WebmCues(mCuePoints, kVideoTrackNum);
     uint64_t cuesSize = cues->totalSize();
     // TRICKY Even when the cues do fit in the space we reserved, if they do not fit
     // perfectly, we still need to check if there is enough "extra space" to write an
@@ -71,8 +71,11 @@ private:
     bool mStreamableFile;
     uint64_t mEstimatedCuesSize;
 
+    // Recycles frame buffers for this writer's recordings; emptied by release().
+    sp<WebmFramePool> mFramePool;
+
     Mutex mLock;
-    List<sp<WebmElement> > mCuePoints;
+    Vector<WebmCuePoint> mCuePoints;
 
     enum {
         kAudioIndex     =  0,
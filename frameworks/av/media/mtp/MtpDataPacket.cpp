@@ -419,6 +419,14 @@ void MtpDataPacket::putString(const uint16_t* string) {
         putUInt16(0);
 }
 
+void MtpDataPacket::putData(const void* data, size_t length) {
+    allocate(mOffset + length);
+    memcpy(mBuffer + mOffset, data, length);
+    mOffset += length;
+    if (mPacketSize < mOffset)
+        mPacketSize = mOffset;
+}
+
 #ifdef MTP_DEVICE 
 int MtpDataPacket::read(int fd) {
     int ret = ::read(fd, mBuffer, MTP_BUFFER_SIZE);
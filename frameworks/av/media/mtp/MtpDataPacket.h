@@ -42,6 +42,7 @@ public:
     void                setTransactionID(MtpTransactionID id);
 
     inline const uint8_t*     getData() const { return mBuffer + MTP_CONTAINER_HEADER_SIZE; }
+    inline size_t       getDataLength() const { return mPacketSize - MTP_CONTAINER_HEADER_SIZE; }
 
     bool                getUInt8(uint8_t& value);
     inline bool         getInt8(int8_t& value) { return getUInt8((uint8_t&)value); }
@@ -92,6 +93,8 @@ public:
     void                putString(const uint16_t* string);
     inline void         putEmptyString() { putUInt8(0); }
     inline void         putEmptyArray() { putUInt32(0); }
+    // appends data already in MTP encoding
+    void                putData(const void* data, size_t length);
 
 
 #ifdef MTP_DEVICE
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MtpObjectCache"
+
+#include "MtpDebug.h"
+#include "MtpDatabase.h"
+#include "MtpDataPacket.h"
+#include "MtpObjectCache.h"
+
+namespace android {
+
+// a property list of a large library runs to megabytes
+static const size_t kMaxCacheSize = 8 * 1024 * 1024;
+static const size_t kMaxEntries = 64;
+static const nsecs_t kMaxEntryAge = seconds_to_nanoseconds(10);
+
+bool MtpObjectCache::Key::operator<(const Key& other) const {
+    if (mType != other.mType)
+        return mType < other.mType;
+    for (size_t i = 0; i < sizeof(mParams) / sizeof(mParams[0]); i++) {
+        if (mParams[i] != other.mParams[i])
+            return mParams[i] < other.mParams[i];
+    }
+    return false;
+}
+
+MtpObjectCache::MtpObjectCache(MtpDatabase* database)
+    :   mDatabase(database),
+        mSize(0),
+        mGeneration(0)
+{
+}
+
+MtpObjectCache::~MtpObjectCache() {
+    invalidate();
+}
+
+void MtpObjectCache::getObjectList(MtpStorageID storageID,
+                                    MtpObjectFormat format,
+                                    MtpObjectHandle parent,
+                                    MtpDataPacket& packet) {
+    Key key = makeKey(OBJECT_LIST, storageID, format, parent);
+    MtpResponseCode result;
+    uint32_t generation;
+    if (lookup(key, packet, &result, &generation))
+        return;
+
+    size_t offset = packet.getDataLength();
+    MtpObjectHandleList* handles = mDatabase->getObjectList(storageID, format, parent);
+    packet.putAUInt32(handles);
+    delete handles;
+    insert(key, packet, offset, MTP_RESPONSE_OK, generation);
+}
+
+int MtpObjectCache::getNumObjects(MtpStorageID storageID,
+                                    MtpObjectFormat format,
+                                    MtpObjectHandle parent) {
+    // hosts often ask for the count of the handles they just fetched
+    Key key = makeKey(OBJECT_LIST, storageID, format, parent);
+    {
+        Mutex::Autolock autoLock(mMutex);
+        ssize_t index = mEntries.indexOfKey(key);
+        if (index >= 0 && systemTime() - mEntries.valueAt(index)->mTime <= kMaxEntryAge) {
+            // the array length, in front of the handles
+            const uint8_t* data = mEntries.valueAt(index)->mData.array();
+            return (int)((uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+                    ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        }
+    }
+    return mDatabase->getNumObjects(storageID, format, parent);
+}
+
+MtpResponseCode MtpObjectCache::getObjectPropertyList(MtpObjectHandle handle,
+                                    uint32_t format, uint32_t property,
+                                    int groupCode, int depth,
+                                    MtpDataPacket& packet) {
+    Key key = makeKey(OBJECT_PROPERTY_LIST, handle, format, property, groupCode, depth);
+    MtpResponseCode result;
+    uint32_t generation;
+    if (lookup(key, packet, &result, &generation))
+        return result;
+
+    size_t offset = packet.getDataLength();
+    result = mDatabase->getObjectPropertyList(handle, format, property, groupCode, depth,
+            packet);
+    if (result == MTP_RESPONSE_OK)
+        insert(key, packet, offset, result, generation);
+    return result;
+}
+
+void MtpObjectCache::invalidate() {
+    Mutex::Autolock autoLock(mMutex);
+
+    for (size_t i = 0; i < mEntries.size(); i++)
+        delete mEntries.valueAt(i);
+    mEntries.clear();
+    mSize = 0;
+    mGeneration++;
+}
+
+MtpObjectCache::Key MtpObjectCache::makeKey(uint32_t type, uint32_t p1, uint32_t p2,
+                                    uint32_t p3, uint32_t p4, uint32_t p5) {
+    Key key;
+    key.mType = type;
+    key.mParams[0] = p1;
+    key.mParams[1] = p2;
+    key.mParams[2] = p3;
+    key.mParams[3] = p4;
+    key.mParams[4] = p5;
+    return key;
+}
+
+bool MtpObjectCache::lookup(const Key& key, MtpDataPacket& packet,
+                                    MtpResponseCode* result, uint32_t* generation) {
+    Mutex::Autolock autoLock(mMutex);
+
+    *generation = mGeneration;
+    ssize_t index = mEntries.indexOfKey(key);
+    if (index < 0)
+        return false;
+
+    const Entry* entry = mEntries.valueAt(index);
+    if (systemTime() - entry->mTime > kMaxEntryAge) {
+        removeAt(index);
+        return false;
+    }
+
+    packet.putData(entry->mData.array(), entry->mData.size());
+    *result = entry->mResult;
+    return true;
+}
+
+void MtpObjectCache::insert(const Key& key, const MtpDataPacket& packet, size_t offset,
+                                    MtpResponseCode result, uint32_t generation) {
+    size_t size = packet.getDataLength() - offset;
+    if (size < sizeof(uint32_t) || size > kMaxCacheSize)
+        return;
+
+    Mutex::Autolock autoLock(mMutex);
+
+    // objects changed while the database was queried
+    if (generation != mGeneration)
+        return;
+
+    ssize_t index = mEntries.indexOfKey(key);
+    if (index >= 0)
+        removeAt(index);
+
+    // make room by dropping the oldest entries
+    while (mEntries.size() > 0
+            && (mSize + size > kMaxCacheSize || mEntries.size() >= kMaxEntries)) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < mEntries.size(); i++) {
+            if (mEntries.valueAt(i)->mTime < mEntries.valueAt(oldest)->mTime)
+                oldest = i;
+        }
+        removeAt(oldest);
+    }
+
+    Entry* entry = new Entry;
+    entry->mData.appendArray(packet.getData() + offset, size);
+    entry->mResult = result;
+    entry->mTime = systemTime();
+    mEntries.add(key, entry);
+    mSize += size;
+    ALOGV("cached %zu bytes, %zu entries %zu bytes in all", size, mEntries.size(), mSize);
+}
+
+void MtpObjectCache::removeAt(size_t index) {
+    Entry* entry = mEntries.valueAt(index);
+    mSize -= entry->mData.size();
+    delete entry;
+    mEntries.removeItemsAt(index);
+}
+
+}  // namespace android
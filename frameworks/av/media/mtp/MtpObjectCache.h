@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MTP_OBJECT_CACHE_H
+#define _MTP_OBJECT_CACHE_H
+
+#include "MtpTypes.h"
+
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class MtpDatabase;
+class MtpDataPacket;
+
+// Keeps the results of GetObjectHandles and GetObjectPropList, which hosts
+// repeat for every folder they show, as the bytes that go in the data packet.
+// Everything is dropped by invalidate() whenever objects are added, removed
+// or changed, and entries also expire, in case an object changed without
+// the server hearing about it.
+class MtpObjectCache {
+
+private:
+    enum {
+        OBJECT_LIST,
+        OBJECT_PROPERTY_LIST,
+    };
+
+    struct Key {
+        uint32_t            mType;
+        uint32_t            mParams[5];
+
+        bool operator<(const Key& other) const;
+    };
+
+    struct Entry {
+        Vector<uint8_t>     mData;
+        MtpResponseCode     mResult;
+        nsecs_t             mTime;
+    };
+
+    MtpDatabase*            mDatabase;
+
+    Mutex                   mMutex;
+    KeyedVector<Key, Entry*> mEntries;
+    size_t                  mSize;
+    // bumped by invalidate(), so that results fetched before are not added
+    uint32_t                mGeneration;
+
+public:
+                            MtpObjectCache(MtpDatabase* database);
+    virtual                 ~MtpObjectCache();
+
+    // these add to the packet what the database would
+    void                    getObjectList(MtpStorageID storageID,
+                                    MtpObjectFormat format,
+                                    MtpObjectHandle parent,
+                                    MtpDataPacket& packet);
+
+    int                     getNumObjects(MtpStorageID storageID,
+                                    MtpObjectFormat format,
+                                    MtpObjectHandle parent);
+
+    MtpResponseCode         getObjectPropertyList(MtpObjectHandle handle,
+                                    uint32_t format, uint32_t property,
+                                    int groupCode, int depth,
+                                    MtpDataPacket& packet);
+
+    void                    invalidate();
+
+private:
+    static Key              makeKey(uint32_t type, uint32_t p1, uint32_t p2, uint32_t p3,
+                                    uint32_t p4 = 0, uint32_t p5 = 0);
+
+    // returns true and adds the cached data to the packet if the key is cached
+    bool                    lookup(const Key& key, MtpDataPacket& packet,
+                                    MtpResponseCode* result, uint32_t* generation);
+    // caches what was added to the packet from offset on
+    void                    insert(const Key& key, const MtpDataPacket& packet, size_t offset,
+                                    MtpResponseCode result, uint32_t generation);
+    void                    removeAt(size_t index);
+};
+
+}; // namespace android
+
+#endif // _MTP_OBJECT_CACHE_H
@@ -26,6 +26,9 @@
 
 #include <usbhost/usbhost.h>
 
+// buffers that grew larger than this many increments are shrunk by reset()
+#define MTP_MAX_RETAINED_INCREMENTS 16
+
 namespace android {
 
 MtpPacket::MtpPacket(int bufferSize)
@@ -47,6 +50,15 @@ MtpPacket::~MtpPacket() {
 }
 
 void MtpPacket::reset() {
+    // give back what a large transaction needed, rather than clear it every time
+    if (mBufferSize > mAllocationIncrement * MTP_MAX_RETAINED_INCREMENTS) {
+        mBuffer = (uint8_t *)realloc(mBuffer, mAllocationIncrement);
+        if (!mBuffer) {
+            ALOGE("out of memory!");
+            abort();
+        }
+        mBufferSize = mAllocationIncrement;
+    }
     allocate(MTP_CONTAINER_HEADER_SIZE);
     mPacketSize = MTP_CONTAINER_HEADER_SIZE;
     memset(mBuffer, 0, mBufferSize);
@@ -54,7 +66,10 @@ void MtpPacket::reset() {
 
 void MtpPacket::allocate(size_t length) {
     if (length > mBufferSize) {
-        int newLength = length + mAllocationIncrement;
+        // grow by at least half, so that building a large packet isn't quadratic
+        size_t newLength = length + mAllocationIncrement;
+        if (newLength < mBufferSize + mBufferSize / 2)
+            newLength = mBufferSize + mBufferSize / 2;
         mBuffer = (uint8_t *)realloc(mBuffer, newLength);
         if (!mBuffer) {
             ALOGE("out of memory!");
@@ -31,6 +31,7 @@
 
 #include "MtpDebug.h"
 #include "MtpDatabase.h"
+#include "MtpObjectCache.h"
 #include "MtpObjectInfo.h"
 #include "MtpProperty.h"
 #include "MtpServer.h"
@@ -89,6 +90,19 @@ static const MtpOperationCode kSupportedOperationCodes[] = {
     MTP_OPERATION_END_EDIT_OBJECT,
 };
 
+// operations after which cached object lists and properties may be out of date
+static const MtpOperationCode kObjectChangingOperationCodes[] = {
+    MTP_OPERATION_OPEN_SESSION,
+    MTP_OPERATION_CLOSE_SESSION,
+    MTP_OPERATION_DELETE_OBJECT,
+    MTP_OPERATION_SEND_OBJECT_INFO,
+    MTP_OPERATION_SEND_OBJECT,
+    MTP_OPERATION_SET_OBJECT_PROP_VALUE,
+    MTP_OPERATION_SEND_PARTIAL_OBJECT,
+    MTP_OPERATION_TRUNCATE_OBJECT,
+    MTP_OPERATION_END_EDIT_OBJECT,
+};
+
 static const MtpEventCode kSupportedEventCodes[] = {
     MTP_EVENT_OBJECT_ADDED,
     MTP_EVENT_OBJECT_REMOVED,
@@ -109,17 +123,20 @@ MtpServer::MtpServer(int fd, MtpDatabase* database, bool ptp,
         mSessionOpen(false),
         mSendObjectHandle(kInvalidObjectHandle),
         mSendObjectFormat(0),
-        mSendObjectFileSize(0)
+        mSendObjectFileSize(0),
+        mObjectCache(new MtpObjectCache(database))
 {
 }
 
 MtpServer::~MtpServer() {
+    delete mObjectCache;
 }
 
 void MtpServer::addStorage(MtpStorage* storage) {
     Mutex::Autolock autoLock(mMutex);
 
     mStorages.push(storage);
+    mObjectCache->invalidate();
     sendStoreAdded(storage->getStorageID());
 }
 
@@ -129,6 +146,7 @@ void MtpServer::removeStorage(MtpStorage* storage) {
     for (size_t i = 0; i < mStorages.size(); i++) {
         if (mStorages[i] == storage) {
             mStorages.removeAt(i);
+            mObjectCache->invalidate();
             sendStoreRemoved(storage->getStorageID());
             break;
         }
@@ -236,6 +254,7 @@ void MtpServer::run() {
         delete edit;
     }
     mObjectEditList.clear();
+    mObjectCache->invalidate();
 
     if (mSessionOpen)
         mDatabase->sessionEnded();
@@ -245,11 +264,13 @@ void MtpServer::run() {
 
 void MtpServer::sendObjectAdded(MtpObjectHandle handle) {
     ALOGV("sendObjectAdded %d\n", handle);
+    mObjectCache->invalidate();
     sendEvent(MTP_EVENT_OBJECT_ADDED, handle);
 }
 
 void MtpServer::sendObjectRemoved(MtpObjectHandle handle) {
     ALOGV("sendObjectRemoved %d\n", handle);
+    mObjectCache->invalidate();
     sendEvent(MTP_EVENT_OBJECT_REMOVED, handle);
 }
 
@@ -429,6 +450,13 @@ bool MtpServer::handleRequest() {
             break;
     }
 
+    for (size_t i = 0; i < sizeof(kObjectChangingOperationCodes) / sizeof(uint16_t); i++) {
+        if (operation == kObjectChangingOperationCodes[i]) {
+            mObjectCache->invalidate();
+            break;
+        }
+    }
+
     if (response == MTP_RESPONSE_TRANSACTION_CANCELLED)
         return false;
     mResponse.setResponseCode(response);
@@ -578,9 +606,7 @@ MtpResponseCode MtpServer::doGetObjectHandles() {
     if (!hasStorage(storageID))
         return MTP_RESPONSE_INVALID_STORAGE_ID;
 
-    MtpObjectHandleList* handles = mDatabase->getObjectList(storageID, format, parent);
-    mData.putAUInt32(handles);
-    delete handles;
+    mObjectCache->getObjectList(storageID, format, parent, mData);
     return MTP_RESPONSE_OK;
 }
 
@@ -596,7 +622,7 @@ MtpResponseCode MtpServer::doGetNumObjects() {
     if (!hasStorage(storageID))
         return MTP_RESPONSE_INVALID_STORAGE_ID;
 
-    int count = mDatabase->getNumObjects(storageID, format, parent);
+    int count = mObjectCache->getNumObjects(storageID, format, parent);
     if (count >= 0) {
         mResponse.setParameter(1, count);
         return MTP_RESPONSE_OK;
@@ -715,7 +741,8 @@ MtpResponseCode MtpServer::doGetObjectPropList() {
             handle, MtpDebug::getFormatCodeName(format),
             MtpDebug::getObjectPropCodeName(property), groupCode, depth);
 
-    return mDatabase->getObjectPropertyList(handle, format, property, groupCode, depth, mData);
+    return mObjectCache->getObjectPropertyList(handle, format, property, groupCode, depth,
+            mData);
 }
 
 MtpResponseCode MtpServer::doGetObjectInfo() {
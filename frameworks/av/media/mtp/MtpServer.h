@@ -29,6 +29,7 @@
 namespace android {
 
 class MtpDatabase;
+class MtpObjectCache;
 class MtpStorage;
 
 class MtpServer {
@@ -68,6 +69,9 @@ private:
 
     Mutex               mMutex;
 
+    // object lists and properties hosts fetched recently
+    MtpObjectCache*     mObjectCache;
+
     // represents an MTP object that is being edited using the android extensions
     // for direct editing (BeginEditObject, SendPartialObject, TruncateObject and EndEditObject)
     class ObjectEdit {
@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "MtpServer_test"
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MtpDatabase.h"
+#include "MtpDataPacket.h"
+#include "MtpServer.h"
+#include "MtpStorage.h"
+#include "mtp.h"
+
+// Runs MtpServer over a socketpair, with the test as the host, against a
+// database holding a large photo library.
+
+namespace android {
+
+static const MtpStorageID kStorageID = 0x00010001;
+static const int kLibrarySize = 100000;
+// what a MediaProvider query costs per object, roughly
+static const nsecs_t kQueryCostPerObject = 2000;
+
+static void spin(nsecs_t duration) {
+    nsecs_t end = systemTime() + duration;
+    while (systemTime() < end) {
+    }
+}
+
+// All objects are photos in the root of the one storage.
+struct FakeMtpDatabase : public MtpDatabase {
+    FakeMtpDatabase()
+        : mObjectCount(kLibrarySize),
+          mObjectListQueries(0),
+          mPropertyListQueries(0) {
+    }
+
+    virtual MtpObjectHandle beginSendObject(const char*, MtpObjectFormat, MtpObjectHandle,
+            MtpStorageID, uint64_t, time_t) {
+        return kInvalidObjectHandle;
+    }
+
+    virtual void endSendObject(const char*, MtpObjectHandle, MtpObjectFormat, bool) {
+    }
+
+    virtual MtpObjectHandleList* getObjectList(MtpStorageID, MtpObjectFormat,
+            MtpObjectHandle) {
+        mObjectListQueries++;
+        spin(kQueryCostPerObject * mObjectCount);
+        MtpObjectHandleList* list = new MtpObjectHandleList();
+        for (int i = 1; i <= mObjectCount; i++) {
+            list->push(i);
+        }
+        return list;
+    }
+
+    virtual int getNumObjects(MtpStorageID, MtpObjectFormat, MtpObjectHandle) {
+        return mObjectCount;
+    }
+
+    virtual MtpObjectFormatList* getSupportedPlaybackFormats() { return NULL; }
+    virtual MtpObjectFormatList* getSupportedCaptureFormats() { return NULL; }
+    virtual MtpObjectPropertyList* getSupportedObjectProperties(MtpObjectFormat) { return NULL; }
+    virtual MtpDevicePropertyList* getSupportedDeviceProperties() { return NULL; }
+
+    virtual MtpResponseCode getObjectPropertyValue(MtpObjectHandle, MtpObjectProperty,
+            MtpDataPacket&) {
+        return MTP_RESPONSE_OBJECT_PROP_NOT_SUPPORTED;
+    }
+
+    virtual MtpResponseCode setObjectPropertyValue(MtpObjectHandle, MtpObjectProperty,
+            MtpDataPacket&) {
+        return MTP_RESPONSE_OBJECT_PROP_NOT_SUPPORTED;
+    }
+
+    virtual MtpResponseCode getDevicePropertyValue(MtpDeviceProperty, MtpDataPacket&) {
+        return MTP_RESPONSE_DEVICE_PROP_NOT_SUPPORTED;
+    }
+
+    virtual MtpResponseCode setDevicePropertyValue(MtpDeviceProperty, MtpDataPacket&) {
+        return MTP_RESPONSE_DEVICE_PROP_NOT_SUPPORTED;
+    }
+
+    virtual MtpResponseCode resetDeviceProperty(MtpDeviceProperty) {
+        return MTP_RESPONSE_DEVICE_PROP_NOT_SUPPORTED;
+    }
+
+    // the file name and size of every object, whatever is asked for
+    virtual MtpResponseCode getObjectPropertyList(MtpObjectHandle, uint32_t, uint32_t, int,
+            int, MtpDataPacket& packet) {
+        mPropertyListQueries++;
+        spin(kQueryCostPerObject * mObjectCount);
+        char name[32];
+        packet.putUInt32(mObjectCount * 2);
+        for (int i = 1; i <= mObjectCount; i++) {
+            packet.putUInt32(i);
+            packet.putUInt16(MTP_PROPERTY_OBJECT_FILE_NAME);
+            packet.putUInt16(MTP_TYPE_STR);
+            snprintf(name, sizeof(name), "IMG_%08d.jpg", i);
+            packet.putString(name);
+            packet.putUInt32(i);
+            packet.putUInt16(MTP_PROPERTY_OBJECT_SIZE);
+            packet.putUInt16(MTP_TYPE_UINT64);
+            packet.putUInt64(3000000 + i);
+        }
+        return MTP_RESPONSE_OK;
+    }
+
+    virtual MtpResponseCode getObjectInfo(MtpObjectHandle, MtpObjectInfo&) {
+        return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
+    }
+
+    virtual void* getThumbnail(MtpObjectHandle, size_t& outThumbSize) {
+        outThumbSize = 0;
+        return NULL;
+    }
+
+    virtual MtpResponseCode getObjectFilePath(MtpObjectHandle, MtpString&, int64_t&,
+            MtpObjectFormat&) {
+        return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
+    }
+
+    virtual MtpResponseCode deleteFile(MtpObjectHandle) {
+        return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
+    }
+
+    virtual MtpObjectHandleList* getObjectReferences(MtpObjectHandle) { return NULL; }
+
+    virtual MtpResponseCode setObjectReferences(MtpObjectHandle, MtpObjectHandleList*) {
+        return MTP_RESPONSE_OPERATION_NOT_SUPPORTED;
+    }
+
+    virtual MtpProperty* getObjectPropertyDesc(MtpObjectProperty, MtpObjectFormat) {
+        return NULL;
+    }
+
+    virtual MtpProperty* getDevicePropertyDesc(MtpDeviceProperty) { return NULL; }
+
+    virtual void sessionStarted() {}
+    virtual void sessionEnded() {}
+
+    int mObjectCount;
+    int mObjectListQueries;
+    int mPropertyListQueries;
+};
+
+class MtpServerTest : public ::testing::Test {
+public:
+    MtpServerTest()
+        : mServer(NULL),
+          mHostFd(-1),
+          mTransactionID(0) {
+    }
+
+protected:
+    virtual void SetUp() {
+        int fds[2];
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        mHostFd = fds[0];
+        // the server closes its end when run() returns
+        mServer = new MtpServer(fds[1], &mDatabase, false, 0, 0664, 0775);
+        mStorage = new MtpStorage(kStorageID, "/data/local/tmp", "test", 0, false, 0);
+        mServer->addStorage(mStorage);
+        ASSERT_EQ(0, pthread_create(&mServerThread, NULL, runServer, mServer));
+
+        Vector<uint8_t> data;
+        ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_OPEN_SESSION, 1, &data));
+    }
+
+    virtual void TearDown() {
+        shutdown(mHostFd, SHUT_RDWR);
+        pthread_join(mServerThread, NULL);
+        close(mHostFd);
+        delete mServer;
+        delete mStorage;
+    }
+
+    static void* runServer(void* server) {
+        static_cast<MtpServer*>(server)->run();
+        return NULL;
+    }
+
+    static void putUInt32(Vector<uint8_t>* buffer, uint32_t value) {
+        buffer->push((uint8_t)value);
+        buffer->push((uint8_t)(value >> 8));
+        buffer->push((uint8_t)(value >> 16));
+        buffer->push((uint8_t)(value >> 24));
+    }
+
+    static uint32_t getUInt32(const Vector<uint8_t>& buffer, size_t offset) {
+        return (uint32_t)buffer[offset] | ((uint32_t)buffer[offset + 1] << 8) |
+                ((uint32_t)buffer[offset + 2] << 16) | ((uint32_t)buffer[offset + 3] << 24);
+    }
+
+    bool readFully(uint8_t* buffer, size_t length) {
+        while (length > 0) {
+            ssize_t ret = read(mHostFd, buffer, length);
+            if (ret <= 0)
+                return false;
+            buffer += ret;
+            length -= ret;
+        }
+        return true;
+    }
+
+    // reads a whole container, header included
+    bool readContainer(Vector<uint8_t>* container) {
+        container->clear();
+        container->insertAt((uint8_t)0, 0, MTP_CONTAINER_HEADER_SIZE);
+        if (!readFully(container->editArray(), MTP_CONTAINER_HEADER_SIZE))
+            return false;
+        uint32_t length = getUInt32(*container, MTP_CONTAINER_LENGTH_OFFSET);
+        if (length < MTP_CONTAINER_HEADER_SIZE)
+            return false;
+        container->insertAt((uint8_t)0, MTP_CONTAINER_HEADER_SIZE,
+                length - MTP_CONTAINER_HEADER_SIZE);
+        return readFully(container->editArray() + MTP_CONTAINER_HEADER_SIZE,
+                length - MTP_CONTAINER_HEADER_SIZE);
+    }
+
+    // sends a request and returns the response code, and the payload of the data phase
+    // if there is one
+    MtpResponseCode transact(MtpOperationCode code, int paramCount, Vector<uint8_t>* data,
+            uint32_t p1 = 0, uint32_t p2 = 0, uint32_t p3 = 0, uint32_t p4 = 0,
+            uint32_t p5 = 0) {
+        const uint32_t params[5] = { p1, p2, p3, p4, p5 };
+        Vector<uint8_t> request;
+        putUInt32(&request, MTP_CONTAINER_HEADER_SIZE + paramCount * sizeof(uint32_t));
+        request.push(MTP_CONTAINER_TYPE_COMMAND);
+        request.push(0);
+        request.push((uint8_t)code);
+        request.push((uint8_t)(code >> 8));
+        putUInt32(&request, ++mTransactionID);
+        for (int i = 0; i < paramCount; i++) {
+            putUInt32(&request, params[i]);
+        }
+        if (write(mHostFd, request.array(), request.size()) != (ssize_t)request.size())
+            return 0;
+
+        data->clear();
+        Vector<uint8_t> container;
+        for (;;) {
+            if (!readContainer(&container))
+                return 0;
+            uint16_t type = container[MTP_CONTAINER_TYPE_OFFSET];
+            if (type == MTP_CONTAINER_TYPE_DATA) {
+                data->appendArray(container.array() + MTP_CONTAINER_HEADER_SIZE,
+                        container.size() - MTP_CONTAINER_HEADER_SIZE);
+            } else if (type == MTP_CONTAINER_TYPE_RESPONSE) {
+                return container[MTP_CONTAINER_CODE_OFFSET] |
+                        (container[MTP_CONTAINER_CODE_OFFSET + 1] << 8);
+            }
+        }
+    }
+
+    FakeMtpDatabase mDatabase;
+    MtpServer* mServer;
+    MtpStorage* mStorage;
+    pthread_t mServerThread;
+    int mHostFd;
+    MtpTransactionID mTransactionID;
+};
+
+TEST_F(MtpServerTest, GetObjectHandles) {
+    Vector<uint8_t> data;
+    for (int i = 0; i < 3; i++) {
+        nsecs_t start = systemTime();
+        ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_GET_OBJECT_HANDLES, 3, &data,
+                kStorageID, 0, MTP_PARENT_ROOT));
+        nsecs_t latency = systemTime() - start;
+        printf("GetObjectHandles %d: %zu bytes in %.2f ms\n", i, data.size(), latency / 1E6);
+
+        ASSERT_EQ((size_t)(kLibrarySize + 1) * sizeof(uint32_t), data.size());
+        EXPECT_EQ((uint32_t)kLibrarySize, getUInt32(data, 0));
+        EXPECT_EQ(1u, getUInt32(data, 4));
+        EXPECT_EQ((uint32_t)kLibrarySize, getUInt32(data, data.size() - 4));
+    }
+    EXPECT_EQ(1, mDatabase.mObjectListQueries);
+
+    // the count comes from the handles fetched above
+    ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_GET_NUM_OBJECTS, 3, &data,
+            kStorageID, 0, MTP_PARENT_ROOT));
+    EXPECT_EQ(1, mDatabase.mObjectListQueries);
+}
+
+TEST_F(MtpServerTest, GetObjectPropList) {
+    Vector<uint8_t> data;
+    Vector<uint8_t> first;
+    for (int i = 0; i < 3; i++) {
+        nsecs_t start = systemTime();
+        ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_GET_OBJECT_PROP_LIST, 5, &data,
+                MTP_PARENT_ROOT, 0, 0xFFFFFFFF, 0, 1));
+        nsecs_t latency = systemTime() - start;
+        printf("GetObjectPropList %d: %zu bytes in %.2f ms\n", i, data.size(), latency / 1E6);
+
+        EXPECT_EQ((uint32_t)kLibrarySize * 2, getUInt32(data, 0));
+        if (i == 0) {
+            first = data;
+        } else {
+            ASSERT_EQ(first.size(), data.size());
+            EXPECT_EQ(0, memcmp(first.array(), data.array(), data.size()));
+        }
+    }
+    EXPECT_EQ(1, mDatabase.mPropertyListQueries);
+}
+
+TEST_F(MtpServerTest, ObjectAddedInvalidatesCache) {
+    Vector<uint8_t> data;
+    ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_GET_OBJECT_HANDLES, 3, &data,
+            kStorageID, 0, MTP_PARENT_ROOT));
+    EXPECT_EQ((uint32_t)kLibrarySize, getUInt32(data, 0));
+
+    mDatabase.mObjectCount++;
+    mServer->sendObjectAdded(kLibrarySize + 1);
+
+    ASSERT_EQ(MTP_RESPONSE_OK, transact(MTP_OPERATION_GET_OBJECT_HANDLES, 3, &data,
+            kStorageID, 0, MTP_PARENT_ROOT));
+    EXPECT_EQ((uint32_t)kLibrarySize + 1, getUInt32(data, 0));
+    EXPECT_EQ(2, mDatabase.mObjectListQueries);
+}
+
+}  // namespace android
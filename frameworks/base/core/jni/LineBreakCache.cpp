@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LineBreakCache"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <unicode/uchar.h>
+#include <unicode/utf16.h>
+
+#include "LineBreakCache.h"
+
+namespace android {
+
+static const size_t kMaxEntries = 16;
+static const size_t kMaxChars = 64 * 1024;
+
+// A shorter prefix isn't worth the run being split.
+static const size_t kMinPrefixLength = 64;
+
+bool LineBreakParams::operator==(const LineBreakParams& other) const {
+    return firstWidth == other.firstWidth
+            && firstWidthLineLimit == other.firstWidthLineLimit
+            && restWidth == other.restWidth
+            && tabStops == other.tabStops
+            && defaultTabStop == other.defaultTabStop
+            && strategy == other.strategy
+            && hyphenFrequency == other.hyphenFrequency
+            && indents == other.indents
+            && locale == other.locale
+            && hyphenator == other.hyphenator;
+}
+
+bool LineBreakRun::sameStyleAs(const LineBreakRun& other) const {
+    if (kind != other.kind || start != other.start || isRtl != other.isRtl) {
+        return false;
+    }
+    if (kind != STYLE) {
+        return true;
+    }
+    return font == other.font
+            && style == other.style
+            && paint.size == other.paint.size
+            && paint.scaleX == other.paint.scaleX
+            && paint.skewX == other.paint.skewX
+            && paint.letterSpacing == other.paint.letterSpacing
+            && paint.paintFlags == other.paint.paintFlags
+            && paint.hyphenEdit == other.paint.hyphenEdit
+            && paint.fontFeatureSettings == other.paint.fontFeatureSettings;
+}
+
+LineBreakEntry::~LineBreakEntry() {
+    for (size_t i = 0; i < runs.size(); i++) {
+        if (runs[i].kind == LineBreakRun::STYLE) {
+            runs[i].font->Unref();
+        }
+    }
+}
+
+LineBreakCache& LineBreakCache::getInstance() {
+    static LineBreakCache* sInstance = new LineBreakCache();
+    return *sInstance;
+}
+
+std::shared_ptr<const LineBreakEntry> LineBreakCache::find(const uint16_t* text, size_t length,
+        const LineBreakParams& params, size_t* prefixLength) {
+    Mutex::Autolock _l(mLock);
+    std::list<std::shared_ptr<const LineBreakEntry> >::iterator best = mEntries.end();
+    size_t bestLength = 0;
+    for (auto it = mEntries.begin(); it != mEntries.end(); ++it) {
+        const LineBreakEntry& entry = **it;
+        if (!(entry.params == params)) {
+            continue;
+        }
+        size_t common = std::min(length, entry.text.size());
+        size_t n = 0;
+        while (n < common && text[n] == entry.text[n]) {
+            n++;
+        }
+        if (n == length && n == entry.text.size()) {
+            best = it;
+            bestLength = n;
+            break;
+        }
+        if (n > bestLength) {
+            best = it;
+            bestLength = n;
+        }
+    }
+    if (best == mEntries.end() || bestLength < std::min(length, kMinPrefixLength)) {
+        return nullptr;
+    }
+    std::shared_ptr<const LineBreakEntry> entry = *best;
+    mEntries.splice(mEntries.begin(), mEntries, best);
+    *prefixLength = bestLength;
+    return entry;
+}
+
+void LineBreakCache::put(const std::shared_ptr<const LineBreakEntry>& entry) {
+    if (entry->text.size() > kMaxChars / 4) {
+        return;
+    }
+    Mutex::Autolock _l(mLock);
+    mEntries.push_front(entry);
+    mChars += entry->text.size();
+    while (mEntries.size() > kMaxEntries || mChars > kMaxChars) {
+        mChars -= mEntries.back()->text.size();
+        mEntries.pop_back();
+    }
+}
+
+CachingLineBreaker::CachingLineBreaker()
+    : mBreakerStarted(false),
+      mLookedUp(false),
+      mPrefixLength(0),
+      mHit(false) {
+    mParams.firstWidth = 0;
+    mParams.firstWidthLineLimit = 0;
+    mParams.restWidth = 0;
+    mParams.defaultTabStop = 0;
+    mParams.strategy = kBreakStrategy_Greedy;
+    mParams.hyphenFrequency = kHyphenationFrequency_Normal;
+    mParams.hyphenator = nullptr;
+}
+
+uint16_t* CachingLineBreaker::resize(size_t size) {
+    mText.resize(size);
+    return mText.data();
+}
+
+void CachingLineBreaker::setupParagraph(float firstWidth, int firstWidthLineLimit,
+        float restWidth, const int* tabStops, size_t nTabStops, int defaultTabStop,
+        BreakStrategy strategy, HyphenationFrequency hyphenFrequency) {
+    reset();
+    mParams.firstWidth = firstWidth;
+    mParams.firstWidthLineLimit = firstWidthLineLimit;
+    mParams.restWidth = restWidth;
+    mParams.tabStops.assign(tabStops, tabStops + nTabStops);
+    mParams.defaultTabStop = defaultTabStop;
+    mParams.strategy = strategy;
+    mParams.hyphenFrequency = hyphenFrequency;
+}
+
+// Indents and the locale are the LineBreaker's until they're set again, not the paragraph's.
+void CachingLineBreaker::setIndents(const std::vector<float>& indents) {
+    mParams.indents = indents;
+    mBreaker.setIndents(indents);
+}
+
+void CachingLineBreaker::setLocale(const icu::Locale& locale, Hyphenator* hyphenator) {
+    mParams.locale = locale.getName();
+    mParams.hyphenator = hyphenator;
+    mBreaker.setLocale(locale, hyphenator);
+}
+
+// Looks for the paragraph once its setup is complete, which is when the runs start.
+void CachingLineBreaker::lookUp() {
+    if (mLookedUp) {
+        return;
+    }
+    mLookedUp = true;
+    mPrefixLength = 0;
+    mCached = LineBreakCache::getInstance().find(mText.data(), mText.size(), mParams,
+            &mPrefixLength);
+    mHit = mCached != nullptr && mPrefixLength == mText.size() &&
+            mCached->text.size() == mText.size();
+    if (!mHit) {
+        startBreaker();
+    }
+}
+
+bool CachingLineBreaker::isHit() {
+    if (mHit && mRuns.size() != mCached->runs.size()) {
+        miss();
+    }
+    return mHit;
+}
+
+// The runs stopped matching the cached paragraph's, so the ones that did go to the breaker.
+void CachingLineBreaker::miss() {
+    mHit = false;
+    startBreaker();
+    for (size_t i = 0; i < mRuns.size(); i++) {
+        LineBreakRun& run = mRuns[i];
+        switch (run.kind) {
+            case LineBreakRun::STYLE:
+                measure(&run);
+                break;
+            case LineBreakRun::MEASURED:
+                memcpy(mBreaker.charWidths() + run.start, mCached->charWidths.data() + run.start,
+                        (run.end - run.start) * sizeof(float));
+                mBreaker.addStyleRun(nullptr, nullptr, FontStyle{}, run.start, run.end, false);
+                break;
+            case LineBreakRun::REPLACEMENT:
+                mBreaker.addReplacement(run.start, run.end, run.width);
+                break;
+        }
+    }
+}
+
+void CachingLineBreaker::startBreaker() {
+    mBreaker.resize(mText.size());
+    memcpy(mBreaker.buffer(), mText.data(), mText.size() * sizeof(uint16_t));
+    mBreaker.setText();
+    mBreaker.setLineWidths(mParams.firstWidth, mParams.firstWidthLineLimit, mParams.restWidth);
+    if (mParams.tabStops.empty()) {
+        mBreaker.setTabStops(nullptr, 0, mParams.defaultTabStop);
+    } else {
+        mBreaker.setTabStops(mParams.tabStops.data(), mParams.tabStops.size(),
+                mParams.defaultTabStop);
+    }
+    mBreaker.setStrategy(mParams.strategy);
+    mBreaker.setHyphenationFrequency(mParams.hyphenFrequency);
+    mBreakerStarted = true;
+}
+
+// Chars that measure zero wide only as part of the cluster before them, which
+// the word breaker never breaks before.
+static bool isInCluster(UChar c) {
+    if (U16_IS_TRAIL(c)) {
+        return true;
+    }
+    int8_t type = u_charType(c);
+    return type == U_NON_SPACING_MARK || type == U_ENCLOSING_MARK ||
+            type == U_COMBINING_SPACING_MARK || type == U_FORMAT_CHAR;
+}
+
+/*
+ * Where the cached widths of the run's text stop being good for it.  Layout
+ * measures a word at a time, in the context of the word alone, so the widths
+ * of the words before the last space before the edit are what they were.
+ *
+ * The text up to there is added as a measured run.  That differs from adding
+ * it with the paint in hyphenation, the line penalty, which only the optimal
+ * strategies use, and in not breaking before a char that measured zero wide,
+ * so those have to be out of it.
+ */
+size_t CachingLineBreaker::reusableEnd(const LineBreakRun& run) const {
+    if (mCached == nullptr || mPrefixLength == 0 ||
+            mParams.strategy != kBreakStrategy_Greedy ||
+            (mParams.hyphenFrequency != kHyphenationFrequency_None &&
+             mParams.hyphenator != nullptr)) {
+        return run.start;
+    }
+
+    const LineBreakRun* cachedRun = nullptr;
+    for (size_t i = 0; i < mCached->runs.size(); i++) {
+        if (mCached->runs[i].start == run.start) {
+            cachedRun = &mCached->runs[i];
+            break;
+        }
+    }
+    if (cachedRun == nullptr || !cachedRun->sameStyleAs(run)) {
+        return run.start;
+    }
+
+    size_t limit = std::min(std::min(run.end, cachedRun->end), mPrefixLength);
+    size_t end = limit;
+    while (end > run.start && mText[end - 1] != ' ') {
+        end--;
+    }
+    if (end == run.start) {
+        return run.start;
+    }
+    end--;
+
+    for (size_t i = run.start; i < end; i++) {
+        if (mCached->charWidths[i] == 0 && !isInCluster(mText[i])) {
+            return run.start;
+        }
+    }
+    return end;
+}
+
+void CachingLineBreaker::measure(LineBreakRun* run) {
+    size_t reused = reusableEnd(*run);
+    if (reused == run->start) {
+        run->width = mBreaker.addStyleRun(&run->paint, run->font, run->style, run->start,
+                run->end, run->isRtl);
+        return;
+    }
+
+    float width = 0;
+    for (size_t i = run->start; i < reused; i++) {
+        width += mCached->charWidths[i];
+    }
+    memcpy(mBreaker.charWidths() + run->start, mCached->charWidths.data() + run->start,
+            (reused - run->start) * sizeof(float));
+    mBreaker.addStyleRun(nullptr, nullptr, FontStyle{}, run->start, reused, run->isRtl);
+    if (reused < run->end) {
+        width += mBreaker.addStyleRun(&run->paint, run->font, run->style, reused, run->end,
+                run->isRtl);
+    }
+    run->width = width;
+}
+
+float CachingLineBreaker::addStyleRun(const MinikinPaint& paint, FontCollection* font,
+        FontStyle style, size_t start, size_t end, bool isRtl) {
+    lookUp();
+    LineBreakRun run;
+    run.kind = LineBreakRun::STYLE;
+    run.start = start;
+    run.end = end;
+    run.isRtl = isRtl;
+    run.paint = paint;
+    run.font = font;
+    run.style = style;
+    run.width = 0;
+
+    if (mHit) {
+        size_t i = mRuns.size();
+        if (i < mCached->runs.size() && mCached->runs[i].sameStyleAs(run) &&
+                mCached->runs[i].end == end) {
+            run.width = mCached->runs[i].width;
+            mRuns.push_back(run);
+            return run.width;
+        }
+        miss();
+    }
+    measure(&run);
+    mRuns.push_back(run);
+    return run.width;
+}
+
+void CachingLineBreaker::addMeasuredRun(size_t start, size_t end, const float* widths) {
+    lookUp();
+    LineBreakRun run;
+    run.kind = LineBreakRun::MEASURED;
+    run.start = start;
+    run.end = end;
+    run.isRtl = false;
+    run.font = nullptr;
+    run.width = 0;
+
+    if (mHit) {
+        size_t i = mRuns.size();
+        if (i < mCached->runs.size() && mCached->runs[i].sameStyleAs(run) &&
+                mCached->runs[i].end == end &&
+                !memcmp(widths, mCached->charWidths.data() + start, (end - start) * sizeof(float))) {
+            mRuns.push_back(run);
+            return;
+        }
+        miss();
+    }
+    memcpy(mBreaker.charWidths() + start, widths, (end - start) * sizeof(float));
+    mBreaker.addStyleRun(nullptr, nullptr, FontStyle{}, start, end, false);
+    mRuns.push_back(run);
+}
+
+void CachingLineBreaker::addReplacementRun(size_t start, size_t end, float width) {
+    lookUp();
+    LineBreakRun run;
+    run.kind = LineBreakRun::REPLACEMENT;
+    run.start = start;
+    run.end = end;
+    run.isRtl = false;
+    run.font = nullptr;
+    run.width = width;
+
+    if (mHit) {
+        size_t i = mRuns.size();
+        if (i < mCached->runs.size() && mCached->runs[i].sameStyleAs(run) &&
+                mCached->runs[i].end == end && mCached->runs[i].width == width) {
+            mRuns.push_back(run);
+            return;
+        }
+        miss();
+    }
+    mBreaker.addReplacement(start, end, width);
+    mRuns.push_back(run);
+}
+
+const float* CachingLineBreaker::charWidths() {
+    lookUp();
+    return isHit() ? mCached->charWidths.data() : mBreaker.charWidths();
+}
+
+size_t CachingLineBreaker::computeBreaks() {
+    lookUp();
+    if (isHit()) {
+        mResult = mCached;
+        return mResult->breaks.size();
+    }
+
+    size_t nBreaks = mBreaker.computeBreaks();
+    std::shared_ptr<LineBreakEntry> entry = std::make_shared<LineBreakEntry>();
+    entry->text = mText;
+    entry->params = mParams;
+    entry->runs = mRuns;
+    for (size_t i = 0; i < entry->runs.size(); i++) {
+        if (entry->runs[i].kind == LineBreakRun::STYLE) {
+            entry->runs[i].font->Ref();
+        }
+    }
+    entry->charWidths.assign(mBreaker.charWidths(), mBreaker.charWidths() + mText.size());
+    entry->breaks.assign(mBreaker.getBreaks(), mBreaker.getBreaks() + nBreaks);
+    entry->widths.assign(mBreaker.getWidths(), mBreaker.getWidths() + nBreaks);
+    entry->flags.assign(mBreaker.getFlags(), mBreaker.getFlags() + nBreaks);
+    LineBreakCache::getInstance().put(entry);
+    mResult = entry;
+    return nBreaks;
+}
+
+void CachingLineBreaker::finish() {
+    if (mBreakerStarted) {
+        mBreaker.finish();
+        mBreakerStarted = false;
+    }
+    reset();
+}
+
+void CachingLineBreaker::reset() {
+    mRuns.clear();
+    mLookedUp = false;
+    mCached = nullptr;
+    mPrefixLength = 0;
+    mHit = false;
+    mResult = nullptr;
+}
+
+} // namespace android
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LINE_BREAK_CACHE_H
+#define ANDROID_LINE_BREAK_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unicode/locid.h>
+#include <utils/Mutex.h>
+
+#include "minikin/FontCollection.h"
+#include "minikin/LineBreaker.h"
+
+namespace android {
+
+// What a paragraph is broken with, besides its text and runs.
+struct LineBreakParams {
+    float firstWidth;
+    int firstWidthLineLimit;
+    float restWidth;
+    std::vector<int> tabStops;
+    int defaultTabStop;
+    BreakStrategy strategy;
+    HyphenationFrequency hyphenFrequency;
+    std::vector<float> indents;
+    std::string locale;
+    Hyphenator* hyphenator;
+
+    bool operator==(const LineBreakParams& other) const;
+};
+
+// A run of a paragraph as it was given to the line breaker.
+struct LineBreakRun {
+    enum Kind {
+        STYLE,
+        MEASURED,
+        REPLACEMENT,
+    };
+
+    Kind kind;
+    size_t start;
+    size_t end;
+    bool isRtl;
+    MinikinPaint paint;     // for STYLE
+    FontCollection* font;   // for STYLE
+    FontStyle style;        // for STYLE
+    float width;            // measured for STYLE, given for REPLACEMENT
+
+    // Whether the runs would measure the same, given the same text.
+    bool sameStyleAs(const LineBreakRun& other) const;
+};
+
+// A paragraph and the line breaks found for it.
+struct LineBreakEntry {
+    std::vector<uint16_t> text;
+    LineBreakParams params;
+    std::vector<LineBreakRun> runs;
+    std::vector<float> charWidths;
+    std::vector<int> breaks;
+    std::vector<float> widths;
+    std::vector<int> flags;
+
+    LineBreakEntry() {}
+    ~LineBreakEntry();
+
+private:
+    LineBreakEntry(const LineBreakEntry&);
+    LineBreakEntry& operator=(const LineBreakEntry&);
+};
+
+/*
+ * The paragraphs most recently broken into lines, shared by every
+ * StaticLayout builder.  Layouts are rebuilt in full for small edits and
+ * over again for the same text, so most paragraphs have been seen before, or
+ * have a long way in common with one that has.
+ */
+class LineBreakCache {
+public:
+    static LineBreakCache& getInstance();
+
+    // The entry for the paragraph if there is one, otherwise the entry with
+    // the same params that has the longest prefix of text in common with it,
+    // in which case prefixLength is set to its length.
+    std::shared_ptr<const LineBreakEntry> find(const uint16_t* text, size_t length,
+            const LineBreakParams& params, size_t* prefixLength);
+
+    void put(const std::shared_ptr<const LineBreakEntry>& entry);
+
+private:
+    LineBreakCache() : mChars(0) {}
+
+    Mutex mLock;
+    std::list<std::shared_ptr<const LineBreakEntry> > mEntries;  // most recently used first
+    size_t mChars;
+};
+
+/*
+ * A LineBreaker that keeps what it finds in the LineBreakCache.  A paragraph
+ * found there whole, with the same runs, isn't measured or broken again; the
+ * builder's setup isn't even handed to the LineBreaker.  An edited paragraph
+ * is measured only from the word before the edit on, as long as the rest of
+ * the break can't depend on how the text before it was measured: that is,
+ * with the greedy strategy and no hyphenation, which is what editable text
+ * uses.
+ */
+class CachingLineBreaker {
+public:
+    CachingLineBreaker();
+
+    // The buffer the paragraph's text is to be copied into.
+    uint16_t* resize(size_t size);
+    size_t size() const { return mText.size(); }
+
+    void setupParagraph(float firstWidth, int firstWidthLineLimit, float restWidth,
+            const int* tabStops, size_t nTabStops, int defaultTabStop, BreakStrategy strategy,
+            HyphenationFrequency hyphenFrequency);
+    void setIndents(const std::vector<float>& indents);
+    void setLocale(const icu::Locale& locale, Hyphenator* hyphenator);
+
+    float addStyleRun(const MinikinPaint& paint, FontCollection* font, FontStyle style,
+            size_t start, size_t end, bool isRtl);
+    void addMeasuredRun(size_t start, size_t end, const float* widths);
+    void addReplacementRun(size_t start, size_t end, float width);
+
+    const float* charWidths();
+
+    size_t computeBreaks();
+    bool hasBreaks() const { return mResult != nullptr; }
+    size_t breakCount() const { return mResult->breaks.size(); }
+    const int* getBreaks() const { return mResult->breaks.data(); }
+    const float* getWidths() const { return mResult->widths.data(); }
+    const int* getFlags() const { return mResult->flags.data(); }
+
+    void finish();
+
+private:
+    void reset();
+    void lookUp();
+    bool isHit();
+    void miss();
+    void startBreaker();
+    void measure(LineBreakRun* run);
+    size_t reusableEnd(const LineBreakRun& run) const;
+
+    LineBreaker mBreaker;
+    bool mBreakerStarted;
+    std::vector<uint16_t> mText;
+    LineBreakParams mParams;
+    std::vector<LineBreakRun> mRuns;
+    bool mLookedUp;
+
+    // The paragraph's entry, or the nearest, and how much of its text is the same.
+    std::shared_ptr<const LineBreakEntry> mCached;
+    size_t mPrefixLength;
+    // Whether the runs so far are the cached paragraph's.
+    bool mHit;
+
+    std::shared_ptr<const LineBreakEntry> mResult;
+};
+
+} // namespace android
+
+#endif // ANDROID_LINE_BREAK_CACHE_H
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NativeLibraryHelper"
+//#define LOG_NDEBUG 0
+
+#include "NativeLibraryExtractor.h"
+
+#include <utils/Compat.h>
+#include <utils/FileCopy.h>
+#include <utils/Log.h>
+
+#include <zlib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#define TMP_FILE_PATTERN "/tmp.XXXXXX"
+
+namespace android {
+
+// Matches ZipFileRO::kCompressStored and kCompressDeflated, which this doesn't link against
+static const uint16_t kCompressStored = 0;
+static const uint16_t kCompressDeflated = 8;
+
+static const size_t kInflateInSize = 64 * 1024;
+static const size_t kInflateOutSize = 256 * 1024;
+
+static bool
+isFileDifferent(const char* filePath, uint32_t fileSize, time_t modifiedTime,
+        uint32_t zipCrc, struct stat64* st)
+{
+    if (lstat64(filePath, st) < 0) {
+        // File is not found or cannot be read.
+        ALOGV("Couldn't stat %s, copying: %s\n", filePath, strerror(errno));
+        return true;
+    }
+
+    if (!S_ISREG(st->st_mode)) {
+        return true;
+    }
+
+    if (static_cast<uint64_t>(st->st_size) != static_cast<uint64_t>(fileSize)) {
+        return true;
+    }
+
+    // For some reason, bionic doesn't define st_mtime as time_t
+    if (time_t(st->st_mtime) != modifiedTime) {
+        ALOGV("mod time doesn't match: %ld vs. %ld\n", st->st_mtime, modifiedTime);
+        return true;
+    }
+
+    // Only now that size and time match is the file read, in one go.
+    uLong crc = crc32(0L, Z_NULL, 0);
+    if (fileSize > 0) {
+        int fd = TEMP_FAILURE_RETRY(open(filePath, O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            ALOGV("Couldn't open file %s: %s", filePath, strerror(errno));
+            return true;
+        }
+        void* data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            ALOGV("Couldn't map file %s: %s", filePath, strerror(errno));
+            return true;
+        }
+        madvise(data, fileSize, MADV_SEQUENTIAL);
+        crc = crc32(crc, static_cast<const Bytef*>(data), fileSize);
+        munmap(data, fileSize);
+    }
+
+    ALOGV("%s: crc = %lx, zipCrc = %" PRIu32 "\n", filePath, crc, zipCrc);
+
+    if (crc != static_cast<uLong>(zipCrc)) {
+        return true;
+    }
+
+    return false;
+}
+
+NativeLibraryExtractor::NativeLibraryExtractor(int apkFd, const char* libPath)
+    : mApkFd(apkFd), mLibPath(libPath) {
+}
+
+bool NativeLibraryExtractor::copyStored(const native_lib_entry& entry, int fd) const
+{
+    ssize_t n = copyFileRange(mApkFd, entry.offset, fd, 0, entry.uncompressedLength);
+    if (n < 0 || static_cast<size_t>(n) != entry.uncompressedLength) {
+        ALOGI("Failed copying %s: %s\n", entry.fileName.c_str(),
+                n < 0 ? strerror(errno) : "truncated APK");
+        return false;
+    }
+    return true;
+}
+
+bool NativeLibraryExtractor::inflateDeflated(const native_lib_entry& entry, int fd,
+        std::vector<uint8_t>* buffer) const
+{
+    buffer->resize(kInflateInSize + kInflateOutSize);
+    uint8_t* in = buffer->data();
+    uint8_t* out = in + kInflateInSize;
+
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    // Zip entries are raw deflate, without the zlib header
+    if (inflateInit2(&zstream, -MAX_WBITS) != Z_OK) {
+        ALOGI("Couldn't initialize zlib for %s\n", entry.fileName.c_str());
+        return false;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    off64_t inOff = entry.offset;
+    size_t inLeft = entry.compressedLength;
+    size_t written = 0;
+    int zerr = Z_OK;
+    bool ok = true;
+    while (ok && zerr != Z_STREAM_END) {
+        if (zstream.avail_in == 0 && inLeft > 0) {
+            ssize_t n = TEMP_FAILURE_RETRY(pread64(mApkFd, in, std::min(kInflateInSize, inLeft),
+                    inOff));
+            if (n <= 0) {
+                ALOGI("Failed reading %s: %s\n", entry.fileName.c_str(),
+                        n < 0 ? strerror(errno) : "truncated APK");
+                ok = false;
+                break;
+            }
+            inOff += n;
+            inLeft -= n;
+            zstream.next_in = in;
+            zstream.avail_in = n;
+        }
+        zstream.next_out = out;
+        zstream.avail_out = kInflateOutSize;
+        zerr = inflate(&zstream, Z_NO_FLUSH);
+        if (zerr != Z_OK && zerr != Z_STREAM_END) {
+            ALOGI("Failed inflating %s: zerr=%d\n", entry.fileName.c_str(), zerr);
+            ok = false;
+            break;
+        }
+        size_t produced = kInflateOutSize - zstream.avail_out;
+        if (written + produced > entry.uncompressedLength) {
+            ALOGI("%s is longer than its entry says\n", entry.fileName.c_str());
+            ok = false;
+            break;
+        }
+        crc = crc32(crc, out, produced);
+        for (size_t done = 0; done < produced; ) {
+            ssize_t n = TEMP_FAILURE_RETRY(write(fd, out + done, produced - done));
+            if (n < 0) {
+                ALOGI("Failed writing %s: %s\n", entry.fileName.c_str(), strerror(errno));
+                ok = false;
+                break;
+            }
+            done += n;
+        }
+        written += produced;
+        if (zerr == Z_OK && produced == 0 && zstream.avail_in == 0 && inLeft == 0) {
+            ALOGI("%s ends before its deflate stream does\n", entry.fileName.c_str());
+            ok = false;
+        }
+    }
+    inflateEnd(&zstream);
+
+    if (ok && (written != entry.uncompressedLength || crc != static_cast<uLong>(entry.crc))) {
+        ALOGI("%s doesn't match its entry: %zu bytes, crc %lx\n", entry.fileName.c_str(),
+                written, crc);
+        ok = false;
+    }
+    return ok;
+}
+
+/*
+ * Copy the native library if needed.
+ *
+ * This function assumes the library and path names passed in are considered safe.
+ */
+install_status_t NativeLibraryExtractor::extract(const native_lib_entry& entry,
+        std::vector<uint8_t>* buffer) const
+{
+    const std::string localFileName(mLibPath + "/" + entry.fileName);
+
+    // Only copy out the native file if it's different.
+    struct stat64 st;
+    if (!isFileDifferent(localFileName.c_str(), entry.uncompressedLength, entry.modTime,
+            entry.crc, &st)) {
+        return INSTALL_SUCCEEDED;
+    }
+
+    std::string tmpFileName(mLibPath + TMP_FILE_PATTERN);
+    int fd = mkstemp(&tmpFileName[0]);
+    if (fd < 0) {
+        ALOGI("Couldn't open temporary file name: %s: %s\n", tmpFileName.c_str(),
+                strerror(errno));
+        return INSTALL_FAILED_CONTAINER_ERROR;
+    }
+    const char* localTmpFileName = tmpFileName.c_str();
+
+    bool ok;
+    if (entry.method == kCompressStored) {
+        ok = copyStored(entry, fd);
+    } else if (entry.method == kCompressDeflated) {
+        ok = inflateDeflated(entry, fd, buffer);
+    } else {
+        ALOGI("Unknown compression method %d for %s\n", entry.method, entry.fileName.c_str());
+        ok = false;
+    }
+    if (!ok) {
+        ALOGI("Failed uncompressing %s to %s\n", entry.fileName.c_str(), localTmpFileName);
+        close(fd);
+        unlink(localTmpFileName);
+        return INSTALL_FAILED_CONTAINER_ERROR;
+    }
+
+    // Set the mode to 755
+    static const mode_t mode = S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP |  S_IXGRP | S_IROTH | S_IXOTH;
+    if (fchmod(fd, mode) < 0) {
+        ALOGI("Couldn't change permissions on %s: %s\n", localTmpFileName, strerror(errno));
+        close(fd);
+        unlink(localTmpFileName);
+        return INSTALL_FAILED_CONTAINER_ERROR;
+    }
+
+    close(fd);
+
+    // Set the modification time for this file to the ZIP's mod time.
+    struct timeval times[2];
+    times[0].tv_sec = st.st_atime;
+    times[1].tv_sec = entry.modTime;
+    times[0].tv_usec = times[1].tv_usec = 0;
+    if (utimes(localTmpFileName, times) < 0) {
+        ALOGI("Couldn't change modification time on %s: %s\n", localTmpFileName, strerror(errno));
+        unlink(localTmpFileName);
+        return INSTALL_FAILED_CONTAINER_ERROR;
+    }
+
+    // Finally, rename it to the final name.
+    if (rename(localTmpFileName, localFileName.c_str()) < 0) {
+        ALOGI("Couldn't rename %s to %s: %s\n", localTmpFileName, localFileName.c_str(),
+                strerror(errno));
+        unlink(localTmpFileName);
+        return INSTALL_FAILED_CONTAINER_ERROR;
+    }
+
+    ALOGV("Successfully moved %s to %s\n", localTmpFileName, localFileName.c_str());
+
+    return INSTALL_SUCCEEDED;
+}
+
+install_status_t NativeLibraryExtractor::extractAll(size_t maxThreads)
+{
+    // Largest first, so that no thread is left with a big one at the end
+    std::stable_sort(mEntries.begin(), mEntries.end(),
+            [](const native_lib_entry& lhs, const native_lib_entry& rhs) {
+                return lhs.uncompressedLength > rhs.uncompressedLength;
+            });
+
+    std::atomic<size_t> next(0);
+    std::atomic<int> status(INSTALL_SUCCEEDED);
+    auto work = [this, &next, &status]() {
+        std::vector<uint8_t> buffer;
+        size_t i;
+        while (status == INSTALL_SUCCEEDED && (i = next++) < mEntries.size()) {
+            install_status_t ret = extract(mEntries[i], &buffer);
+            if (ret != INSTALL_SUCCEEDED) {
+                ALOGV("Failure for entry %s", mEntries[i].fileName.c_str());
+                int expected = INSTALL_SUCCEEDED;
+                status.compare_exchange_strong(expected, ret);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min(maxThreads, mEntries.size()); t++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    return static_cast<install_status_t>(status.load());
+}
+
+} // namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_NATIVE_LIBRARY_EXTRACTOR_H
+#define ANDROID_NATIVE_LIBRARY_EXTRACTOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+
+// These match PackageManager.java install codes
+enum install_status_t {
+    INSTALL_SUCCEEDED = 1,
+    INSTALL_FAILED_INVALID_APK = -2,
+    INSTALL_FAILED_INSUFFICIENT_STORAGE = -4,
+    INSTALL_FAILED_CONTAINER_ERROR = -18,
+    INSTALL_FAILED_INTERNAL_ERROR = -110,
+    INSTALL_FAILED_NO_MATCHING_ABIS = -113,
+    NO_NATIVE_LIBRARIES = -114
+};
+
+struct native_lib_entry {
+    std::string fileName;       // name in the library directory, already checked to be safe
+    uint16_t method;            // ZipFileRO::kCompressStored or kCompressDeflated
+    off64_t offset;             // of the entry's data in the APK
+    uint32_t compressedLength;
+    uint32_t uncompressedLength;
+    uint32_t crc;
+    time_t modTime;
+};
+
+/*
+ * Copies native libraries out of an APK into a library directory, several at a time.
+ *
+ * Entries are read from the APK's descriptor with pread() and friends only, so that they can
+ * be extracted in parallel without the ZipFileRO, whose reads depend on the file offset. Stored
+ * entries are copied by the kernel with copyFileRange(); their contents were verified with the
+ * APK's signature before anything is extracted. Deflated entries are inflated straight into
+ * the destination and their CRC checked on the way.
+ *
+ * As before, libraries that are already there with the same size, modification time and CRC
+ * are left alone, and every library is written to a temporary file and renamed into place.
+ */
+class NativeLibraryExtractor {
+public:
+    NativeLibraryExtractor(int apkFd, const char* libPath);
+
+    void add(const native_lib_entry& entry) { mEntries.push_back(entry); }
+    size_t size() const { return mEntries.size(); }
+
+    // Returns INSTALL_SUCCEEDED, or the failure of the first entry that failed, in which case
+    // the entries not yet started are not extracted.
+    install_status_t extractAll(size_t maxThreads);
+
+private:
+    install_status_t extract(const native_lib_entry& entry, std::vector<uint8_t>* buffer) const;
+    bool copyStored(const native_lib_entry& entry, int fd) const;
+    bool inflateDeflated(const native_lib_entry& entry, int fd,
+            std::vector<uint8_t>* buffer) const;
+
+    const int mApkFd;
+    const std::string mLibPath;
+    std::vector<native_lib_entry> mEntries;
+};
+
+} // namespace android
+
+#endif // ANDROID_NATIVE_LIBRARY_EXTRACTOR_H
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "NetworkStats"
+
+#include "NetworkStatsParser.h"
+#include "ProcText.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+// The file is around 200 bytes a row
+static const size_t kInitialBufferSize = 64 * 1024;
+
+// Parses the decimal number at pos, returns false if there is none.
+static inline bool nextDecimal(const char** pos, const char* end, uint64_t* value) {
+    const char* start = skipSpaces(*pos, end);
+    const char* p = parseDecimal(start, end, value);
+    if (p == start) {
+        return false;
+    }
+    *pos = p;
+    return true;
+}
+
+// Parses the hexadecimal number at pos, with or without "0x", returns false if there is none.
+static inline bool nextHex(const char** pos, const char* end, uint64_t* value) {
+    const char* start = *pos;
+    if (end - start > 2 && start[0] == '0' && (start[1] == 'x' || start[1] == 'X')) {
+        start += 2;
+    }
+    const char* p = parseHex(start, end, value);
+    if (p == start) {
+        return false;
+    }
+    *pos = p;
+    return true;
+}
+
+NetworkStatsParser::NetworkStatsParser()
+    : mLimitUid(-1), mLimitTag(-1), mDelta(false) {
+}
+
+void NetworkStatsParser::setLimits(int32_t limitUid, const Vector<String8>& limitIfaces,
+        int32_t limitTag) {
+    mLimitUid = limitUid;
+    mLimitIfaces = limitIfaces;
+    mLimitTag = limitTag;
+}
+
+void NetworkStatsParser::setDeltaMode(bool delta) {
+    mDelta = delta;
+    if (!delta) {
+        mPrevious.clear();
+    }
+}
+
+bool NetworkStatsParser::ifaceWanted(const char* iface, size_t length) const {
+    if (mLimitIfaces.size() == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < mLimitIfaces.size(); i++) {
+        const String8& limit = mLimitIfaces[i];
+        if (limit.length() == length && !memcmp(limit.string(), iface, length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool NetworkStatsParser::unchanged(size_t row, const stats_line& line) {
+    if (row >= mPrevious.size()) {
+        stats_line none;
+        none.iface[0] = 0;
+        mPrevious.resize(row + 1, none);
+    }
+    stats_line& previous = mPrevious[row];
+    bool same = previous.iface[0] != 0
+            && previous.rxBytes == line.rxBytes && previous.rxPackets == line.rxPackets
+            && previous.txBytes == line.txBytes && previous.txPackets == line.txPackets
+            && previous.uid == line.uid && previous.set == line.set && previous.tag == line.tag
+            && !strcmp(previous.iface, line.iface);
+    previous = line;
+    return same;
+}
+
+int NetworkStatsParser::parseFile(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t length = readProcFile(fd, &mBuffer, kInitialBufferSize);
+    if (length < 0) {
+        ALOGE("Failed to read netstats file: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (close(fd) != 0) {
+        ALOGE("Failed to close netstats file");
+        return -1;
+    }
+    return parse(mBuffer.data(), length);
+}
+
+int NetworkStatsParser::parse(const char* data, size_t length) {
+    const char* pos = data;
+    const char* end = data + length;
+    uint64_t lastIdx = 1;
+    size_t rows = 0;
+
+    mLines.clear();
+    while (pos < end) {
+        const char* line = pos;
+        const char* eol = (const char*) memchr(pos, '\n', end - pos);
+        if (eol == NULL) {
+            eol = end;
+        }
+        pos = eol + 1;
+
+        // First field is the index. Skip lines that don't start with an index, the
+        // initial header line in particular.
+        const char* p = line;
+        uint64_t idx;
+        if (!nextDecimal(&p, eol, &idx)) {
+            continue;
+        }
+        if (idx != lastIdx + 1) {
+            ALOGE("inconsistent idx=%d after lastIdx=%d: %.*s", (int) idx, (int) lastIdx,
+                    (int) (eol - line), line);
+            return -1;
+        }
+        lastIdx = idx;
+        size_t row = rows++;
+
+        stats_line s;
+        // Next field is iface.
+        p = skipSpaces(p, eol);
+        const char* iface = p;
+        while (p < eol && *p != ' ') {
+            p++;
+        }
+        size_t ifaceLength = p - iface;
+        if (p == eol || ifaceLength >= sizeof(s.iface)) {
+            ALOGE("bad iface: %.*s", (int) (eol - line), line);
+            return -1;
+        }
+        if (!ifaceWanted(iface, ifaceLength)) {
+            if (row < mPrevious.size()) {
+                mPrevious[row].iface[0] = 0;
+            }
+            continue;
+        }
+        memcpy(s.iface, iface, ifaceLength);
+        s.iface[ifaceLength] = 0;
+
+        // Three digit tag field is always 0x0, otherwise parse
+        p = skipSpaces(p, eol);
+        const char* tagEnd = p;
+        while (tagEnd < eol && *tagEnd != ' ') {
+            tagEnd++;
+        }
+        uint64_t rawTag = 0;
+        if (tagEnd - p != 3 && !nextHex(&p, tagEnd, &rawTag)) {
+            ALOGE("bad tag: %.*s", (int) (eol - p), p);
+            return -1;
+        }
+        s.tag = rawTag >> 32;
+        p = tagEnd;
+
+        uint64_t uid, set, rxBytes, rxPackets, txBytes, txPackets;
+        bool wanted = (mLimitTag == -1 || s.tag == mLimitTag)
+                && nextDecimal(&p, eol, &uid) && nextDecimal(&p, eol, &set)
+                && nextDecimal(&p, eol, &rxBytes) && nextDecimal(&p, eol, &rxPackets)
+                && nextDecimal(&p, eol, &txBytes) && nextDecimal(&p, eol, &txPackets);
+        if (wanted) {
+            s.uid = uid;
+            s.set = set;
+            s.rxBytes = rxBytes;
+            s.rxPackets = rxPackets;
+            s.txBytes = txBytes;
+            s.txPackets = txPackets;
+            wanted = mLimitUid == -1 || mLimitUid == s.uid;
+        }
+        if (!wanted) {
+            if (row < mPrevious.size()) {
+                mPrevious[row].iface[0] = 0;
+            }
+            continue;
+        }
+        if (mDelta && unchanged(row, s)) {
+            continue;
+        }
+        mLines.push_back(s);
+    }
+    if (mDelta) {
+        // Rows that are gone
+        if (mPrevious.size() > rows) {
+            mPrevious.resize(rows);
+        }
+    }
+    return 0;
+}
+
+} // namespace android
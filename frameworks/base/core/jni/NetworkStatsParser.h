@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_NETWORK_STATS_PARSER_H
+#define ANDROID_NETWORK_STATS_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct stats_line {
+    char iface[32];
+    int32_t uid;
+    int32_t set;
+    int32_t tag;
+    int64_t rxBytes;
+    int64_t rxPackets;
+    int64_t txBytes;
+    int64_t txPackets;
+};
+
+/*
+ * Parses /proc/net/xt_qtaguid/stats in one pass over the whole file, read into a buffer that
+ * is kept from one read to the next, as are the parsed rows, so that once both have grown to
+ * the size of the file reading it again allocates nothing.
+ *
+ * In delta mode only the rows whose counters changed since the previous parse, or that are
+ * new, are returned. Rows are matched by their index in the file, which the kernel keeps
+ * for as long as the row exists; a row found at another index is returned as changed.
+ */
+class NetworkStatsParser {
+public:
+    NetworkStatsParser();
+
+    // -1, or an empty list, for no limit.
+    void setLimits(int32_t limitUid, const Vector<String8>& limitIfaces, int32_t limitTag);
+    void setDeltaMode(bool delta);
+
+    // Returns 0, or -1 if the file can't be read or is malformed.
+    int parseFile(const char* path);
+    int parse(const char* data, size_t length);
+
+    const std::vector<stats_line>& lines() const { return mLines; }
+
+private:
+    bool ifaceWanted(const char* iface, size_t length) const;
+    bool unchanged(size_t row, const stats_line& line);
+
+    int32_t mLimitUid;
+    Vector<String8> mLimitIfaces;
+    int32_t mLimitTag;
+    bool mDelta;
+
+    std::vector<char> mBuffer;
+    std::vector<stats_line> mLines;
+    // Every row of the previous parse by index, iface empty for those filtered out.
+    std::vector<stats_line> mPrevious;
+};
+
+} // namespace android
+
+#endif // ANDROID_NETWORK_STATS_PARSER_H
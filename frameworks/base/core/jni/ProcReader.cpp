@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Process"
+
+#include "ProcReader.h"
+#include "ProcText.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <utils/Compat.h>
+
+namespace android {
+
+// Lines of cmdline past this were never looked at
+static const size_t kMaxCmdlineLength = PATH_MAX - 1;
+static const size_t kMaxStatLength = 1024;
+static const size_t kMaxStatusLength = 4096;
+
+// Room for a few hundred entries a call
+static const size_t kDentsBufferSize = 16 * 1024;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Opened on first use and never closed, as every reader of /proc shares it.
+static int procFd() {
+    static const int fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    return fd;
+}
+
+ProcReader::ProcReader() : mRootFd(procFd()), mOwnsFd(false), mLength(0) {
+}
+
+ProcReader::ProcReader(const char* root)
+    : mRootFd(open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)), mOwnsFd(true), mLength(0) {
+}
+
+ProcReader::~ProcReader() {
+    if (mOwnsFd && mRootFd >= 0) {
+        close(mRootFd);
+    }
+}
+
+int ProcReader::openProc(const char* path, int flags) {
+    int fd = procFd();
+    if (fd >= 0 && strncmp(path, "/proc", 5) == 0 && (path[5] == '/' || path[5] == '\0')) {
+        const char* relative = path + 5;
+        while (*relative == '/') {
+            relative++;
+        }
+        return openat(fd, *relative ? relative : ".", flags | O_CLOEXEC);
+    }
+    return open(path, flags | O_CLOEXEC);
+}
+
+bool ProcReader::listPids(std::vector<pid_t>* pids, const char* dir) {
+    if (mRootFd < 0) {
+        return false;
+    }
+    int fd = openat(mRootFd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool result = listPids(fd, pids);
+    close(fd);
+    return result;
+}
+
+bool ProcReader::listPids(int dirFd, std::vector<pid_t>* pids) {
+    uint64_t buffer[kDentsBufferSize / sizeof(uint64_t)];
+    pids->clear();
+    for (;;) {
+        int n = TEMP_FAILURE_RETRY(syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer)));
+        if (n < 0) {
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        const char* p = reinterpret_cast<const char*>(buffer);
+        for (int offset = 0; offset < n; ) {
+            const linux_dirent64* entry = reinterpret_cast<const linux_dirent64*>(p + offset);
+            offset += entry->d_reclen;
+            const char* name = entry->d_name;
+            pid_t pid = 0;
+            for (; *name >= '0' && *name <= '9'; name++) {
+                pid = pid * 10 + (*name - '0');
+            }
+            if (*name == '\0' && name != entry->d_name) {
+                pids->push_back(pid);
+            }
+        }
+    }
+    std::sort(pids->begin(), pids->end());
+    return true;
+}
+
+void ProcReader::read(const std::vector<pid_t>& pids, int fields,
+        std::vector<proc_info_t>* infos) {
+    infos->clear();
+    infos->reserve(pids.size());
+    for (pid_t pid : pids) {
+        proc_info_t info = proc_info_t();
+        info.pid = pid;
+        info.uid = (uid_t) -1;
+
+        char path[32];
+        if ((fields & PROC_READ_CMDLINE) != 0) {
+            snprintf(path, sizeof(path), "%d/cmdline", pid);
+            if (readFile(path, kMaxCmdlineLength)) {
+                parseCmdline(mBuffer.data(), mLength, &info);
+                info.read |= PROC_READ_CMDLINE;
+            }
+        }
+        if ((fields & PROC_READ_STAT) != 0) {
+            snprintf(path, sizeof(path), "%d/stat", pid);
+            if (readFile(path, kMaxStatLength) && parseStat(mBuffer.data(), mLength, &info)) {
+                info.read |= PROC_READ_STAT;
+            }
+        }
+        if ((fields & PROC_READ_STATUS) != 0) {
+            snprintf(path, sizeof(path), "%d/status", pid);
+            if (readFile(path, kMaxStatusLength)) {
+                parseStatus(mBuffer.data(), mLength, &info);
+                info.read |= PROC_READ_STATUS;
+            }
+        }
+        if (info.read != 0) {
+            infos->push_back(std::move(info));
+        }
+    }
+}
+
+bool ProcReader::readAll(int fields, std::vector<proc_info_t>* infos) {
+    std::vector<pid_t> pids;
+    if (!listPids(&pids)) {
+        return false;
+    }
+    read(pids, fields, infos);
+    return true;
+}
+
+void ProcReader::parseCmdline(const char* data, size_t length, proc_info_t* info) {
+    size_t i = 0;
+    while (i < length && data[i] != '\0' && data[i] != ' ') {
+        i++;
+    }
+    info->cmdline.assign(data, i);
+}
+
+bool ProcReader::parseStat(const char* data, size_t length, proc_info_t* info) {
+    // The name can have anything in it, parentheses and spaces included, so it runs from
+    // the first '(' to the last ')'.
+    const char* end = data + length;
+    const char* nameStart = static_cast<const char*>(memchr(data, '(', length));
+    const char* nameEnd = end;
+    while (nameEnd > data && nameEnd[-1] != ')') {
+        nameEnd--;
+    }
+    if (nameStart == NULL || nameEnd <= nameStart + 1) {
+        return false;
+    }
+    nameStart++;
+    nameEnd--;
+    info->name.assign(nameStart, nameEnd - nameStart);
+
+    const char* p = skipSpaces(nameEnd + 1, end);
+    if (p == end) {
+        return false;
+    }
+    info->state = *p++;
+
+    // Fields 4 on, up to rss
+    int64_t values[21];
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        p = skipSpaces(p, end);
+        if (p == end || *p == '\n') {
+            return false;
+        }
+        p = parseNumber(p, end, &values[i]);
+    }
+    info->ppid = values[0];
+    info->minFaults = values[6];
+    info->majFaults = values[8];
+    info->utime = values[10];
+    info->stime = values[11];
+    info->priority = values[14];
+    info->nice = values[15];
+    info->numThreads = values[16];
+    info->startTime = values[18];
+    info->vsize = values[19];
+    info->rss = values[20];
+    return true;
+}
+
+void ProcReader::parseStatus(const char* data, size_t length, proc_info_t* info) {
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == NULL) {
+            eol = end;
+        }
+        size_t len = eol - p;
+        int64_t value;
+        if (STARTS_WITH(p, len, "Uid:")) {
+            parseNumber(p + 4, eol, &value);
+            info->uid = value;
+        } else if (STARTS_WITH(p, len, "VmRSS:")) {
+            parseNumber(p + 6, eol, &info->vmRss);
+        } else if (STARTS_WITH(p, len, "VmSwap:")) {
+            parseNumber(p + 7, eol, &info->vmSwap);
+        }
+        p = eol + 1;
+    }
+}
+
+bool ProcReader::readFile(const char* path, size_t maxLength) {
+    int fd = openat(mRootFd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = readProcFile(fd, &mBuffer, maxLength, maxLength);
+    close(fd);
+    if (length < 0) {
+        return false;
+    }
+    mLength = length;
+    return true;
+}
+
+} // namespace android
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PROC_READER_H
+#define ANDROID_PROC_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+
+// The files of a process that ProcReader reads.
+enum {
+    PROC_READ_CMDLINE = 1 << 0,
+    PROC_READ_STAT = 1 << 1,
+    PROC_READ_STATUS = 1 << 2,
+};
+
+// What /proc/<pid> has to say about a process; only the parts read are filled in.
+struct proc_info_t {
+    pid_t pid;
+    int read;               // PROC_READ_* of the files that could be read
+
+    // cmdline: argv[0], up to the first space as getPidsForCommands() has always matched it
+    std::string cmdline;
+
+    // stat
+    std::string name;
+    char state;
+    pid_t ppid;
+    uint64_t minFaults;
+    uint64_t majFaults;
+    uint64_t utime;         // in clock ticks
+    uint64_t stime;
+    int64_t priority;
+    int64_t nice;
+    int64_t numThreads;
+    uint64_t startTime;
+    uint64_t vsize;         // in bytes
+    int64_t rss;            // in pages
+
+    // status
+    uid_t uid;
+    int64_t vmRss;          // in kB
+    int64_t vmSwap;
+};
+
+/*
+ * Reads many processes' files from /proc in one go. The directory is listed with
+ * getdents64 into a buffer of many entries at once, where readdir() gives them out one at
+ * a time, and files are opened relative to a /proc fd that is kept open, so the kernel
+ * doesn't look up /proc for every one of them. They are all read into one buffer that is
+ * kept for the next file, and parsed without sscanf().
+ *
+ * A process can go away at any point, so what couldn't be read is left out rather than
+ * treated as an error.
+ */
+class ProcReader {
+public:
+    // Reads /proc, through the fd shared by every reader.
+    ProcReader();
+    // Reads a tree laid out like /proc under root, as the benchmark does.
+    explicit ProcReader(const char* root);
+    ~ProcReader();
+
+    bool isOpen() const { return mRootFd >= 0; }
+
+    // The numeric entries of the directory, sorted. Returns false if it can't be read.
+    bool listPids(std::vector<pid_t>* pids, const char* dir = ".");
+    static bool listPids(int dirFd, std::vector<pid_t>* pids);
+
+    // Reads the fields, some PROC_READ_*, of every process listed. One none of whose files
+    // could be read has gone away, and is left out.
+    void read(const std::vector<pid_t>& pids, int fields, std::vector<proc_info_t>* infos);
+    bool readAll(int fields, std::vector<proc_info_t>* infos);
+
+    static void parseCmdline(const char* data, size_t length, proc_info_t* info);
+    static bool parseStat(const char* data, size_t length, proc_info_t* info);
+    static void parseStatus(const char* data, size_t length, proc_info_t* info);
+
+    // Opens a path under /proc relative to the shared /proc fd, and any other path as it is.
+    static int openProc(const char* path, int flags);
+
+private:
+    ProcReader(const ProcReader&);
+    ProcReader& operator=(const ProcReader&);
+
+    // Reads up to maxLength bytes of the file into mBuffer.
+    bool readFile(const char* path, size_t maxLength);
+
+    int mRootFd;
+    bool mOwnsFd;
+    std::vector<char> mBuffer;
+    size_t mLength;
+};
+
+} // namespace android
+
+#endif // ANDROID_PROC_READER_H
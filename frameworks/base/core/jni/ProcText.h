@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PROC_TEXT_H
+#define ANDROID_PROC_TEXT_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <utils/Compat.h>
+
+// Reading and scanning the text files in /proc, for the parsers that read them without stdio.
+// Scanning works on a [p, end) range and returns where it stopped; nothing is nul terminated.
+
+namespace android {
+
+static inline bool startsWith(const char* s, size_t len, const char* prefix, size_t prefixLen) {
+    return len >= prefixLen && memcmp(s, prefix, prefixLen) == 0;
+}
+
+static inline bool endsWith(const char* s, size_t len, const char* suffix, size_t suffixLen) {
+    return len > suffixLen && memcmp(s + len - suffixLen, suffix, suffixLen) == 0;
+}
+
+#define STARTS_WITH(s, len, lit) startsWith(s, len, lit, sizeof(lit) - 1)
+#define ENDS_WITH(s, len, lit) endsWith(s, len, lit, sizeof(lit) - 1)
+
+static inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+static inline const char* skipToken(const char* p, const char* end) {
+    while (p < end && *p != ' ' && *p != '\t') {
+        p++;
+    }
+    return p;
+}
+
+static inline bool isHex(char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+// Parses the hex digits at p, without "0x"; returns p if there are none.
+static inline const char* parseHex(const char* p, const char* end, uint64_t* value) {
+    uint64_t v = 0;
+    for (; p < end && isHex(*p); p++) {
+        v = (v << 4) | (*p <= '9' ? *p - '0' : (*p | 0x20) - 'a' + 10);
+    }
+    *value = v;
+    return p;
+}
+
+// Parses the decimal digits after any spaces at p; returns the end of the spaces if there are
+// no digits.
+static inline const char* parseDecimal(const char* p, const char* end, uint64_t* value) {
+    p = skipSpaces(p, end);
+    uint64_t v = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (*p - '0');
+    }
+    *value = v;
+    return p;
+}
+
+// As parseDecimal(), with a sign.
+static inline const char* parseNumber(const char* p, const char* end, int64_t* value) {
+    p = skipSpaces(p, end);
+    bool negative = p < end && *p == '-';
+    uint64_t v;
+    p = parseDecimal(negative ? p + 1 : p, end, &v);
+    *value = negative ? -static_cast<int64_t>(v) : v;
+    return p;
+}
+
+/*
+ * Reads fd to its end, or to maxLength, into the start of buffer; returns the length read, or
+ * -1 with errno set. The buffer is first made initialLength long, then doubled as it fills up,
+ * and is kept at its size for the next read.
+ */
+static inline ssize_t readProcFile(int fd, std::vector<char>* buffer, size_t initialLength,
+        size_t maxLength = SIZE_MAX) {
+    if (buffer->size() < initialLength) {
+        buffer->resize(initialLength);
+    }
+    // Sizes of proc files are not known until they are read
+    size_t length = 0;
+    while (length < maxLength) {
+        if (length == buffer->size()) {
+            buffer->resize(std::min(buffer->size() * 2, maxLength));
+        }
+        size_t room = std::min(buffer->size(), maxLength) - length;
+        ssize_t n = TEMP_FAILURE_RETRY(read(fd, buffer->data() + length, room));
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += n;
+    }
+    return length;
+}
+
+} // namespace android
+
+#endif // ANDROID_PROC_TEXT_H
@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.os.Debug"
+
+#include "SmapsParser.h"
+#include "ProcText.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <utils/Mutex.h>
+
+namespace android {
+
+// A large app's smaps runs to a few MB
+static const size_t kInitialBufferSize = 256 * 1024;
+static const size_t kMaxKeptBufferSize = 1024 * 1024;
+
+// For readMapsShared() and readPssShared(), which ActivityManager calls every few seconds
+static Mutex gParserLock;
+static SmapsParser* gParser;
+
+enum {
+    ROLLUP_UNKNOWN,
+    ROLLUP_PRESENT,
+    ROLLUP_ABSENT
+};
+static std::atomic<int> sHaveRollup(ROLLUP_UNKNOWN);
+
+static inline unsigned parseKb(const char* p, const char* end) {
+    uint64_t kb;
+    parseDecimal(p, end, &kb);
+    return kb;
+}
+
+/*
+ * "start-end perms offset major:minor inode name". Returns false if the line is not a mapping
+ * at all; sets *named to false if it starts like one but the rest doesn't follow.
+ */
+static bool parseMapping(const char* p, const char* eol, uint64_t* start, uint64_t* end,
+        const char** name, size_t* nameLen, bool* named) {
+    if (p == eol || !isHex(*p)) {
+        return false;
+    }
+    p = parseHex(p, eol, start);
+    if (p == eol || *p != '-' || p + 1 == eol || !isHex(p[1])) {
+        return false;
+    }
+    p = parseHex(p + 1, eol, end);
+
+    *named = false;
+    uint64_t ignored;
+    p = skipToken(skipSpaces(p, eol), eol);                     // perms
+    const char* field = skipSpaces(p, eol);                     // offset
+    p = parseHex(field, eol, &ignored);
+    if (p == field) return true;
+    field = skipSpaces(p, eol);                                 // major
+    p = parseHex(field, eol, &ignored);
+    if (p == field || p == eol || *p != ':') return true;
+    field = p + 1;                                              // minor
+    p = parseHex(field, eol, &ignored);
+    if (p == field) return true;
+    field = skipSpaces(p, eol);                                 // inode
+    p = field;
+    while (p < eol && *p >= '0' && *p <= '9') p++;
+    if (p == field) return true;
+
+    p = skipSpaces(p, eol);
+    *name = p;
+    *nameLen = eol - p;
+    *named = true;
+    return true;
+}
+
+static void classify(const char* name, size_t nameLen, uint64_t start, uint64_t prevEnd,
+        int prevHeap, int* whichHeap, int* subHeap, bool* is_swappable) {
+    if (STARTS_WITH(name, nameLen, "[heap]")) {
+        *whichHeap = HEAP_NATIVE;
+    } else if (STARTS_WITH(name, nameLen, "[anon:libc_malloc]")) {
+        *whichHeap = HEAP_NATIVE;
+    } else if (STARTS_WITH(name, nameLen, "[stack")) {
+        *whichHeap = HEAP_STACK;
+    } else if (ENDS_WITH(name, nameLen, ".so")) {
+        *whichHeap = HEAP_SO;
+        *is_swappable = true;
+    } else if (ENDS_WITH(name, nameLen, ".jar")) {
+        *whichHeap = HEAP_JAR;
+        *is_swappable = true;
+    } else if (ENDS_WITH(name, nameLen, ".apk")) {
+        *whichHeap = HEAP_APK;
+        *is_swappable = true;
+    } else if (ENDS_WITH(name, nameLen, ".ttf")) {
+        *whichHeap = HEAP_TTF;
+        *is_swappable = true;
+    } else if ((nameLen > 4 && memmem(name, nameLen, ".dex", 4) != NULL) ||
+               ENDS_WITH(name, nameLen, ".odex")) {
+        *whichHeap = HEAP_DEX;
+        *is_swappable = true;
+    } else if (ENDS_WITH(name, nameLen, ".oat")) {
+        *whichHeap = HEAP_OAT;
+        *is_swappable = true;
+    } else if (ENDS_WITH(name, nameLen, ".art")) {
+        *whichHeap = HEAP_ART;
+        *is_swappable = true;
+    } else if (STARTS_WITH(name, nameLen, "/dev/")) {
+        if (STARTS_WITH(name, nameLen, "/dev/kgsl-3d0")) {
+            *whichHeap = HEAP_GL_DEV;
+        } else if (STARTS_WITH(name, nameLen, "/dev/ashmem")) {
+            if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-")) {
+                *whichHeap = HEAP_DALVIK_OTHER;
+                if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-LinearAlloc")) {
+                    *subHeap = HEAP_DALVIK_LINEARALLOC;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-alloc space") ||
+                           STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-main space")) {
+                    // This is the regular Dalvik heap.
+                    *whichHeap = HEAP_DALVIK;
+                    *subHeap = HEAP_DALVIK_NORMAL;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-large object space")) {
+                    *whichHeap = HEAP_DALVIK;
+                    *subHeap = HEAP_DALVIK_LARGE;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-non moving space")) {
+                    *whichHeap = HEAP_DALVIK;
+                    *subHeap = HEAP_DALVIK_NON_MOVING;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-zygote space")) {
+                    *whichHeap = HEAP_DALVIK;
+                    *subHeap = HEAP_DALVIK_ZYGOTE;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-indirect ref")) {
+                    *subHeap = HEAP_DALVIK_INDIRECT_REFERENCE_TABLE;
+                } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/dalvik-jit-code-cache")) {
+                    *subHeap = HEAP_DALVIK_CODE_CACHE;
+                } else {
+                    *subHeap = HEAP_DALVIK_ACCOUNTING;  // Default to accounting.
+                }
+            } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/CursorWindow")) {
+                *whichHeap = HEAP_CURSOR;
+            } else if (STARTS_WITH(name, nameLen, "/dev/ashmem/libc malloc")) {
+                *whichHeap = HEAP_NATIVE;
+            } else {
+                *whichHeap = HEAP_ASHMEM;
+            }
+        } else {
+            *whichHeap = HEAP_UNKNOWN_DEV;
+        }
+    } else if (STARTS_WITH(name, nameLen, "[anon:")) {
+        *whichHeap = HEAP_UNKNOWN;
+    } else if (nameLen > 0) {
+        *whichHeap = HEAP_UNKNOWN_MAP;
+    } else if (start == prevEnd && prevHeap == HEAP_SO) {
+        // bss section of a shared library.
+        *whichHeap = HEAP_SO;
+    }
+}
+
+namespace {
+
+struct mapping_t {
+    bool skip = true;
+    int whichHeap = HEAP_UNKNOWN;
+    int subHeap = HEAP_UNKNOWN;
+    bool is_swappable = false;
+    unsigned shared_clean = 0, shared_dirty = 0;
+    unsigned private_clean = 0, private_dirty = 0;
+    unsigned swapped_out = 0;
+};
+
+}  // namespace
+
+static void addMapping(const mapping_t& m, unsigned pss, stats_t* stats) {
+    if (m.skip) {
+        return;
+    }
+    unsigned swappable_pss;
+    if (m.is_swappable && (pss > 0)) {
+        float sharing_proportion = 0.0;
+        if ((m.shared_clean > 0) || (m.shared_dirty > 0)) {
+            sharing_proportion = (pss - m.private_clean
+                    - m.private_dirty)/(m.shared_clean+m.shared_dirty);
+        }
+        swappable_pss = (sharing_proportion*m.shared_clean) + m.private_clean;
+    } else
+        swappable_pss = 0;
+
+    int whichHeap = m.whichHeap;
+    stats[whichHeap].pss += pss;
+    stats[whichHeap].swappablePss += swappable_pss;
+    stats[whichHeap].privateDirty += m.private_dirty;
+    stats[whichHeap].sharedDirty += m.shared_dirty;
+    stats[whichHeap].privateClean += m.private_clean;
+    stats[whichHeap].sharedClean += m.shared_clean;
+    stats[whichHeap].swappedOut += m.swapped_out;
+    if (whichHeap == HEAP_DALVIK || whichHeap == HEAP_DALVIK_OTHER) {
+        int subHeap = m.subHeap;
+        stats[subHeap].pss += pss;
+        stats[subHeap].swappablePss += swappable_pss;
+        stats[subHeap].privateDirty += m.private_dirty;
+        stats[subHeap].sharedDirty += m.shared_dirty;
+        stats[subHeap].privateClean += m.private_clean;
+        stats[subHeap].sharedClean += m.shared_clean;
+        stats[subHeap].swappedOut += m.swapped_out;
+    }
+}
+
+void SmapsParser::parseMaps(const char* data, size_t length, stats_t* stats) {
+    const char* pos = data;
+    const char* end = data + length;
+    mapping_t m;
+    bool first = true;
+    // As it always was, a mapping without a Pss line counts the one before's
+    unsigned pss = 0;
+    uint64_t prevEnd = 0;
+
+    while (pos < end) {
+        const char* line = pos;
+        const char* eol = (const char*) memchr(pos, '\n', end - pos);
+        if (eol == NULL) {
+            eol = end;
+        }
+        pos = eol + 1;
+
+        const char* colon;
+        switch (line[0]) {
+            case 'P':
+            case 'S':
+            case 'R':
+                // Field lines: "Name:   123 kB"
+                colon = (const char*) memchr(line, ':', eol - line);
+                if (colon == NULL) {
+                    break;
+                }
+                switch (colon - line) {
+                    case 3:
+                        if (!memcmp(line, "Pss", 3)) pss = parseKb(colon + 1, eol);
+                        continue;
+                    case 4:
+                        if (!memcmp(line, "Swap", 4)) m.swapped_out = parseKb(colon + 1, eol);
+                        continue;
+                    case 12:
+                        if (!memcmp(line, "Shared_Clean", 12)) {
+                            m.shared_clean = parseKb(colon + 1, eol);
+                        } else if (!memcmp(line, "Shared_Dirty", 12)) {
+                            m.shared_dirty = parseKb(colon + 1, eol);
+                        }
+                        continue;
+                    case 13:
+                        if (!memcmp(line, "Private_Clean", 13)) {
+                            m.private_clean = parseKb(colon + 1, eol);
+                        } else if (!memcmp(line, "Private_Dirty", 13)) {
+                            m.private_dirty = parseKb(colon + 1, eol);
+                        }
+                        continue;
+                    default:
+                        continue;
+                }
+                break;
+            default:
+                break;
+        }
+
+        uint64_t start, mappingEnd;
+        const char* name = NULL;
+        size_t nameLen = 0;
+        bool named;
+        if (!parseMapping(line, eol, &start, &mappingEnd, &name, &nameLen, &named)) {
+            if (first) {
+                // Nothing to count a field against before the first mapping
+                return;
+            }
+            continue;
+        }
+        if (!first) {
+            addMapping(m, pss, stats);
+        }
+
+        // read_mapinfo() had already read the next mapping's end when it took the previous
+        // one's, so the bss rule below only ever applied to a first mapping at 0. Kept as is,
+        // not to move memory between heaps as reported.
+        prevEnd = first ? 0 : mappingEnd;
+        int prevHeap = m.whichHeap;
+        m = mapping_t();
+        if (named) {
+            m.skip = false;
+            classify(name, nameLen, start, prevEnd, prevHeap, &m.whichHeap, &m.subHeap,
+                    &m.is_swappable);
+        }
+        first = false;
+    }
+    if (!first) {
+        addMapping(m, pss, stats);
+    }
+}
+
+void SmapsParser::parsePss(const char* data, size_t length, pss_t* pss) {
+    const char* pos = data;
+    const char* end = data + length;
+    pss->pss = 0;
+    pss->uss = 0;
+    while (pos < end) {
+        const char* line = pos;
+        const char* eol = (const char*) memchr(pos, '\n', end - pos);
+        if (eol == NULL) {
+            eol = end;
+        }
+        pos = eol + 1;
+
+        // Pss_Anon and the like in smaps_rollup are parts of Pss
+        if (line[0] != 'P' || eol - line < 4) {
+            continue;
+        }
+        if (line[3] == ':' && line[1] == 's' && line[2] == 's') {
+            pss->pss += parseKb(line + 4, eol);
+        } else if (eol - line > 14 && line[13] == ':'
+                && (!memcmp(line, "Private_Clean", 13) || !memcmp(line, "Private_Dirty", 13))) {
+            pss->uss += parseKb(line + 14, eol);
+        }
+    }
+}
+
+bool SmapsParser::readFile(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = readProcFile(fd, &mBuffer, kInitialBufferSize);
+    close(fd);
+    if (length < 0) {
+        return false;
+    }
+    mLength = length;
+    return true;
+}
+
+bool SmapsParser::readMaps(pid_t pid, stats_t* stats) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+    if (!readFile(path)) {
+        return false;
+    }
+    parseMaps(mBuffer.data(), mLength, stats);
+    return true;
+}
+
+bool SmapsParser::readPss(pid_t pid, pss_t* pss) {
+    char path[64];
+    if (sHaveRollup != ROLLUP_ABSENT) {
+        snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+        if (readFile(path)) {
+            sHaveRollup = ROLLUP_PRESENT;
+            parsePss(mBuffer.data(), mLength, pss);
+            return true;
+        }
+        if (sHaveRollup == ROLLUP_PRESENT || errno != ENOENT) {
+            return false;
+        }
+    }
+    snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+    if (!readFile(path)) {
+        return false;
+    }
+    // The process is there, but smaps_rollup isn't: the kernel doesn't have it
+    sHaveRollup = ROLLUP_ABSENT;
+    parsePss(mBuffer.data(), mLength, pss);
+    return true;
+}
+
+void SmapsParser::trimBuffer() {
+    if (mBuffer.size() > kMaxKeptBufferSize) {
+        std::vector<char>().swap(mBuffer);
+    }
+}
+
+bool SmapsParser::readMapsShared(pid_t pid, stats_t* stats) {
+    Mutex::Autolock _l(gParserLock);
+    if (gParser == NULL) {
+        gParser = new SmapsParser();
+    }
+    bool ok = gParser->readMaps(pid, stats);
+    gParser->trimBuffer();
+    return ok;
+}
+
+bool SmapsParser::readPssShared(pid_t pid, pss_t* pss) {
+    Mutex::Autolock _l(gParserLock);
+    if (gParser == NULL) {
+        gParser = new SmapsParser();
+    }
+    bool ok = gParser->readPss(pid, pss);
+    gParser->trimBuffer();
+    return ok;
+}
+
+void SmapsParser::readPss(const std::vector<pid_t>& pids, std::vector<pss_t>* pss,
+        size_t maxThreads) {
+    pss->assign(pids.size(), pss_t { -1, -1 });
+    std::atomic<size_t> next(0);
+    auto work = [&pids, pss, &next]() {
+        SmapsParser parser;
+        size_t i;
+        while ((i = next++) < pids.size()) {
+            if (!parser.readPss(pids[i], &(*pss)[i])) {
+                (*pss)[i] = pss_t { -1, -1 };
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < std::min(maxThreads, pids.size()); t++) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+} // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SMAPS_PARSER_H
+#define ANDROID_SMAPS_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace android {
+
+enum {
+    HEAP_UNKNOWN,
+    HEAP_DALVIK,
+    HEAP_NATIVE,
+
+    HEAP_DALVIK_OTHER,
+    HEAP_STACK,
+    HEAP_CURSOR,
+    HEAP_ASHMEM,
+    HEAP_GL_DEV,
+    HEAP_UNKNOWN_DEV,
+    HEAP_SO,
+    HEAP_JAR,
+    HEAP_APK,
+    HEAP_TTF,
+    HEAP_DEX,
+    HEAP_OAT,
+    HEAP_ART,
+    HEAP_UNKNOWN_MAP,
+    HEAP_GRAPHICS,
+    HEAP_GL,
+    HEAP_OTHER_MEMTRACK,
+
+    HEAP_DALVIK_NORMAL,
+    HEAP_DALVIK_LARGE,
+    HEAP_DALVIK_LINEARALLOC,
+    HEAP_DALVIK_ACCOUNTING,
+    HEAP_DALVIK_CODE_CACHE,
+    HEAP_DALVIK_ZYGOTE,
+    HEAP_DALVIK_NON_MOVING,
+    HEAP_DALVIK_INDIRECT_REFERENCE_TABLE,
+
+    _NUM_HEAP,
+    _NUM_EXCLUSIVE_HEAP = HEAP_OTHER_MEMTRACK+1,
+    _NUM_CORE_HEAP = HEAP_NATIVE+1
+};
+
+struct stats_t {
+    int pss;
+    int swappablePss;
+    int privateDirty;
+    int sharedDirty;
+    int privateClean;
+    int sharedClean;
+    int swappedOut;
+};
+
+// In kB, as smaps has them.
+struct pss_t {
+    int64_t pss;
+    int64_t uss;    // Private_Clean + Private_Dirty
+};
+
+/*
+ * Reads /proc/<pid>/smaps in one pass over the whole file, read into a buffer that is kept
+ * for the next file. Lines are told apart by their first bytes and numbers parsed by hand,
+ * where every line used to go through sscanf() until one matched.
+ *
+ * Pss and Uss alone are read from /proc/<pid>/smaps_rollup when the kernel has it, which
+ * sums the mappings up in the kernel; whether it does is found out once.
+ */
+class SmapsParser {
+public:
+    // Adds the stats of every mapping of pid to stats[_NUM_HEAP]. Returns false if its
+    // smaps can't be read.
+    bool readMaps(pid_t pid, stats_t* stats);
+    static void parseMaps(const char* data, size_t length, stats_t* stats);
+
+    // Returns false if neither file can be read.
+    bool readPss(pid_t pid, pss_t* pss);
+    static void parsePss(const char* data, size_t length, pss_t* pss);
+
+    // readMaps() and readPss() with one parser that every caller shares, behind a lock, so
+    // that its buffer is kept from one call to the next.
+    static bool readMapsShared(pid_t pid, stats_t* stats);
+    static bool readPssShared(pid_t pid, pss_t* pss);
+
+    // Reads the Pss of many processes on up to maxThreads threads. A process whose smaps
+    // can't be read gets a pss of -1.
+    static void readPss(const std::vector<pid_t>& pids, std::vector<pss_t>* pss,
+            size_t maxThreads);
+
+private:
+    bool readFile(const char* path);
+    // Frees the buffer if a large smaps grew it past what is worth keeping.
+    void trimBuffer();
+
+    std::vector<char> mBuffer;
+    size_t mLength = 0;
+};
+
+} // namespace android
+
+#endif // ANDROID_SMAPS_PARSER_H
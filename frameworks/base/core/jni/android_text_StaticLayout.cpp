@@ -26,6 +26,7 @@
 #include "JNIHelp.h"
 #include "core_jni_helpers.h"
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <list>
 #include <algorithm>
@@ -36,6 +37,7 @@
 #include "MinikinUtils.h"
 #include "Paint.h"
 #include "minikin/LineBreaker.h"
+#include "LineBreakCache.h"
 
 namespace android {
 
@@ -53,19 +55,18 @@ static JLineBreaksID gLineBreaks_fieldID;
 static void nSetupParagraph(JNIEnv* env, jclass, jlong nativePtr, jcharArray text, jint length,
         jfloat firstWidth, jint firstWidthLineLimit, jfloat restWidth,
         jintArray variableTabStops, jint defaultTabStop, jint strategy, jint hyphenFrequency) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
-    b->resize(length);
-    env->GetCharArrayRegion(text, 0, length, b->buffer());
-    b->setText();
-    b->setLineWidths(firstWidth, firstWidthLineLimit, restWidth);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
+    env->GetCharArrayRegion(text, 0, length, b->resize(length));
     if (variableTabStops == nullptr) {
-        b->setTabStops(nullptr, 0, defaultTabStop);
+        b->setupParagraph(firstWidth, firstWidthLineLimit, restWidth, nullptr, 0, defaultTabStop,
+                static_cast<BreakStrategy>(strategy),
+                static_cast<HyphenationFrequency>(hyphenFrequency));
     } else {
         ScopedIntArrayRO stops(env, variableTabStops);
-        b->setTabStops(stops.get(), stops.size(), defaultTabStop);
+        b->setupParagraph(firstWidth, firstWidthLineLimit, restWidth, stops.get(), stops.size(),
+                defaultTabStop, static_cast<BreakStrategy>(strategy),
+                static_cast<HyphenationFrequency>(hyphenFrequency));
     }
-    b->setStrategy(static_cast<BreakStrategy>(strategy));
-    b->setHyphenationFrequency(static_cast<HyphenationFrequency>(hyphenFrequency));
 }
 
 static void recycleCopy(JNIEnv* env, jobject recycle, jintArray recycleBreaks,
@@ -92,9 +93,9 @@ static jint nComputeLineBreaks(JNIEnv* env, jclass, jlong nativePtr,
                                jobject recycle, jintArray recycleBreaks,
                                jfloatArray recycleWidths, jintArray recycleFlags,
                                jint recycleLength) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
 
-    size_t nBreaks = b->computeBreaks();
+    size_t nBreaks = b->hasBreaks() ? b->breakCount() : b->computeBreaks();
 
     recycleCopy(env, recycle, recycleBreaks, recycleWidths, recycleFlags, recycleLength,
             nBreaks, b->getBreaks(), b->getWidths(), b->getFlags());
@@ -104,16 +105,41 @@ static jint nComputeLineBreaks(JNIEnv* env, jclass, jlong nativePtr,
     return static_cast<jint>(nBreaks);
 }
 
+// As nComputeLineBreaks, but into one direct buffer: the breaks, then the widths, then the
+// flags. If they don't fit, returns minus the number of breaks, and they're kept for another
+// call with a buffer that's big enough.
+static jint nComputeLineBreaksDirect(JNIEnv* env, jclass, jlong nativePtr, jobject buffer) {
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
+
+    size_t nBreaks = b->hasBreaks() ? b->breakCount() : b->computeBreaks();
+
+    uint8_t* out = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    size_t size = nBreaks * (sizeof(jint) + sizeof(jfloat) + sizeof(jint));
+    if (out == nullptr || capacity < 0 || static_cast<size_t>(capacity) < size) {
+        return -static_cast<jint>(nBreaks);
+    }
+    memcpy(out, b->getBreaks(), nBreaks * sizeof(jint));
+    out += nBreaks * sizeof(jint);
+    memcpy(out, b->getWidths(), nBreaks * sizeof(jfloat));
+    out += nBreaks * sizeof(jfloat);
+    memcpy(out, b->getFlags(), nBreaks * sizeof(jint));
+
+    b->finish();
+
+    return static_cast<jint>(nBreaks);
+}
+
 static jlong nNewBuilder(JNIEnv*, jclass) {
-    return reinterpret_cast<jlong>(new LineBreaker);
+    return reinterpret_cast<jlong>(new CachingLineBreaker);
 }
 
 static void nFreeBuilder(JNIEnv*, jclass, jlong nativePtr) {
-    delete reinterpret_cast<LineBreaker*>(nativePtr);
+    delete reinterpret_cast<CachingLineBreaker*>(nativePtr);
 }
 
 static void nFinishBuilder(JNIEnv*, jclass, jlong nativePtr) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
     b->finish();
 }
 
@@ -126,7 +152,7 @@ static jlong nLoadHyphenator(JNIEnv* env, jclass, jstring patternData) {
 static void nSetLocale(JNIEnv* env, jclass, jlong nativePtr, jstring javaLocaleName,
         jlong nativeHyphenator) {
     ScopedIcuLocale icuLocale(env, javaLocaleName);
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
     Hyphenator* hyphenator = reinterpret_cast<Hyphenator*>(nativeHyphenator);
 
     if (icuLocale.valid()) {
@@ -137,38 +163,39 @@ static void nSetLocale(JNIEnv* env, jclass, jlong nativePtr, jstring javaLocaleN
 static void nSetIndents(JNIEnv* env, jclass, jlong nativePtr, jintArray indents) {
     ScopedIntArrayRO indentArr(env, indents);
     std::vector<float> indentVec(indentArr.get(), indentArr.get() + indentArr.size());
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
     b->setIndents(indentVec);
 }
 
 // Basically similar to Paint.getTextRunAdvances but with C++ interface
 static jfloat nAddStyleRun(JNIEnv* env, jclass, jlong nativePtr,
         jlong nativePaint, jlong nativeTypeface, jint start, jint end, jboolean isRtl) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
     Paint* paint = reinterpret_cast<Paint*>(nativePaint);
     TypefaceImpl* typeface = reinterpret_cast<TypefaceImpl*>(nativeTypeface);
     FontCollection *font;
     MinikinPaint minikinPaint;
     FontStyle style = MinikinUtils::prepareMinikinPaint(&minikinPaint, &font, paint, typeface);
-    return b->addStyleRun(&minikinPaint, font, style, start, end, isRtl);
+    return b->addStyleRun(minikinPaint, font, style, start, end, isRtl);
 }
 
 // Accept width measurements for the run, passed in from Java
 static void nAddMeasuredRun(JNIEnv* env, jclass, jlong nativePtr,
         jint start, jint end, jfloatArray widths) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
-    env->GetFloatArrayRegion(widths, start, end - start, b->charWidths() + start);
-    b->addStyleRun(nullptr, nullptr, FontStyle{}, start, end, false);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
+    std::vector<float> runWidths(end - start);
+    env->GetFloatArrayRegion(widths, start, end - start, runWidths.data());
+    b->addMeasuredRun(start, end, runWidths.data());
 }
 
 static void nAddReplacementRun(JNIEnv* env, jclass, jlong nativePtr,
         jint start, jint end, jfloat width) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
-    b->addReplacement(start, end, width);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
+    b->addReplacementRun(start, end, width);
 }
 
 static void nGetWidths(JNIEnv* env, jclass, jlong nativePtr, jfloatArray widths) {
-    LineBreaker* b = reinterpret_cast<LineBreaker*>(nativePtr);
+    CachingLineBreaker* b = reinterpret_cast<CachingLineBreaker*>(nativePtr);
     env->SetFloatArrayRegion(widths, 0, b->size(), b->charWidths());
 }
 
@@ -189,6 +216,11 @@ static JNINativeMethod gMethods[] = {
         (void*) nComputeLineBreaks}
 };
 
+// Registered when StaticLayout has it, which it can use instead of nComputeLineBreaks.
+static JNINativeMethod gDirectMethods[] = {
+    {"nComputeLineBreaksDirect", "(JLjava/nio/ByteBuffer;)I", (void*) nComputeLineBreaksDirect}
+};
+
 int register_android_text_StaticLayout(JNIEnv* env)
 {
     gLineBreaks_class = MakeGlobalRefOrDie(env,
@@ -198,7 +230,14 @@ int register_android_text_StaticLayout(JNIEnv* env)
     gLineBreaks_fieldID.widths = GetFieldIDOrDie(env, gLineBreaks_class, "widths", "[F");
     gLineBreaks_fieldID.flags = GetFieldIDOrDie(env, gLineBreaks_class, "flags", "[I");
 
-    return RegisterMethodsOrDie(env, "android/text/StaticLayout", gMethods, NELEM(gMethods));
+    int result = RegisterMethodsOrDie(env, "android/text/StaticLayout", gMethods,
+            NELEM(gMethods));
+    jclass staticLayout = FindClassOrDie(env, "android/text/StaticLayout");
+    if (env->RegisterNatives(staticLayout, gDirectMethods, NELEM(gDirectMethods)) < 0) {
+        env->ExceptionClear();
+    }
+    env->DeleteLocalRef(staticLayout);
+    return result;
 }
 
 }
@@ -29,6 +29,8 @@
 #include "core_jni_helpers.h"
 
 #include "android_util_Binder.h"
+#include "ProcReader.h"
+#include "SmapsParser.h"
 #include "JNIHelp.h"
 
 #include <dirent.h>
@@ -428,12 +430,6 @@ jint android_os_Process_setGid(JNIEnv* env, jobject clazz, jint uid)
     return setgid(uid) == 0 ? 0 : errno;
 }
 
-static int pid_compare(const void* v1, const void* v2)
-{
-    //ALOGI("Compare %" PRId32 " vs %" PRId32 "\n", *((const jint*)v1), *((const jint*)v2));
-    return *((const jint*)v1) - *((const jint*)v2);
-}
-
 static jlong getFreeMemoryImpl(const char* const sums[], const size_t sumsLen[], size_t num)
 {
     int fd = open("/proc/meminfo", O_RDONLY);
@@ -549,7 +545,7 @@ void android_os_Process_readProcLines(JNIEnv* env, jobject clazz, jstring fileSt
         sizesArray[i] = 0;
     }
 
-    int fd = open(file.string(), O_RDONLY);
+    int fd = ProcReader::openProc(file.string(), O_RDONLY);
 
     if (fd >= 0) {
         const size_t BUFFER_SIZE = 2048;
@@ -621,71 +617,57 @@ jintArray android_os_Process_getPids(JNIEnv* env, jobject clazz,
         return NULL;
     }
 
-    DIR* dirp = opendir(file8);
+    int fd = ProcReader::openProc(file8, O_RDONLY | O_DIRECTORY);
 
     env->ReleaseStringUTFChars(file, file8);
 
-    if(dirp == NULL) {
+    if (fd < 0) {
+        return NULL;
+    }
+
+    std::vector<pid_t> pids;
+    bool listed = ProcReader::listPids(fd, &pids);
+    close(fd);
+    if (!listed) {
         return NULL;
     }
 
     jsize curCount = 0;
-    jint* curData = NULL;
     if (lastArray != NULL) {
         curCount = env->GetArrayLength(lastArray);
-        curData = env->GetIntArrayElements(lastArray, 0);
     }
 
-    jint curPos = 0;
-
-    struct dirent* entry;
-    while ((entry=readdir(dirp)) != NULL) {
-        const char* p = entry->d_name;
-        while (*p) {
-            if (*p < '0' || *p > '9') break;
-            p++;
+    // Grown as it always has been, so the caller sees the same sizes
+    if ((size_t) curCount < pids.size()) {
+        jsize newCount = curCount;
+        while ((size_t) newCount < pids.size()) {
+            newCount = (newCount == 0) ? 10 : (newCount*2);
         }
-        if (*p != 0) continue;
-
-        char* end;
-        int pid = strtol(entry->d_name, &end, 10);
-        //ALOGI("File %s pid=%d\n", entry->d_name, pid);
-        if (curPos >= curCount) {
-            jsize newCount = (curCount == 0) ? 10 : (curCount*2);
-            jintArray newArray = env->NewIntArray(newCount);
-            if (newArray == NULL) {
-                closedir(dirp);
-                jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-                return NULL;
-            }
-            jint* newData = env->GetIntArrayElements(newArray, 0);
-            if (curData != NULL) {
-                memcpy(newData, curData, sizeof(jint)*curCount);
-                env->ReleaseIntArrayElements(lastArray, curData, 0);
-            }
-            lastArray = newArray;
-            curCount = newCount;
-            curData = newData;
+        jintArray newArray = env->NewIntArray(newCount);
+        if (newArray == NULL) {
+            jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+            return NULL;
         }
-
-        curData[curPos] = pid;
-        curPos++;
+        lastArray = newArray;
+        curCount = newCount;
     }
 
-    closedir(dirp);
-
-    if (curData != NULL && curPos > 0) {
-        qsort(curData, curPos, sizeof(jint), pid_compare);
+    if (curCount == 0) {
+        return lastArray;
+    }
+    jint* curData = env->GetIntArrayElements(lastArray, 0);
+    if (curData == NULL) {
+        return NULL;
+    }
+    jsize curPos = 0;
+    for (pid_t pid : pids) {
+        curData[curPos++] = pid;
     }
-
     while (curPos < curCount) {
         curData[curPos] = -1;
         curPos++;
     }
-
-    if (curData != NULL) {
-        env->ReleaseIntArrayElements(lastArray, curData, 0);
-    }
+    env->ReleaseIntArrayElements(lastArray, curData, 0);
 
     return lastArray;
 }
@@ -850,7 +832,7 @@ jboolean android_os_Process_readProcFile(JNIEnv* env, jobject clazz,
         jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
         return JNI_FALSE;
     }
-    int fd = open(file8, O_RDONLY);
+    int fd = ProcReader::openProc(file8, O_RDONLY);
 
     if (fd < 0) {
         if (kDebugProc) {
@@ -920,29 +902,14 @@ static jlong android_os_Process_getElapsedCpuTime(JNIEnv* env, jobject clazz)
 
 static jlong android_os_Process_getPss(JNIEnv* env, jobject clazz, jint pid)
 {
-    char filename[64];
-
-    snprintf(filename, sizeof(filename), "/proc/%" PRId32 "/smaps", pid);
-
-    FILE * file = fopen(filename, "r");
-    if (!file) {
-        return (jlong) -1;
-    }
-
     // Tally up all of the Pss from the various maps
-    char line[256];
-    jlong pss = 0;
-    while (fgets(line, sizeof(line), file)) {
-        jlong v;
-        if (sscanf(line, "Pss: %" SCNd64 " kB", &v) == 1) {
-            pss += v;
-        }
+    pss_t pss;
+    if (!SmapsParser::readPssShared(pid, &pss)) {
+        return (jlong) -1;
     }
 
-    fclose(file);
-
     // Return the Pss value in bytes, not kilobytes
-    return pss * 1024;
+    return pss.pss * 1024;
 }
 
 jintArray android_os_Process_getPidsForCommands(JNIEnv* env, jobject clazz,
@@ -973,52 +940,23 @@ jintArray android_os_Process_getPidsForCommands(JNIEnv* env, jobject clazz,
         }
     }
 
-    Vector<jint> pids;
-
-    DIR *proc = opendir("/proc");
-    if (proc == NULL) {
+    std::vector<proc_info_t> infos;
+    ProcReader reader;
+    if (!reader.readAll(PROC_READ_CMDLINE, &infos)) {
         fprintf(stderr, "/proc: %s\n", strerror(errno));
         return NULL;
     }
 
-    struct dirent *d;
-    while ((d = readdir(proc))) {
-        int pid = atoi(d->d_name);
-        if (pid <= 0) continue;
-
-        char path[PATH_MAX];
-        char data[PATH_MAX];
-        snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-
-        int fd = open(path, O_RDONLY);
-        if (fd < 0) {
-            continue;
-        }
-        const int len = read(fd, data, sizeof(data)-1);
-        close(fd);
-
-        if (len < 0) {
-            continue;
-        }
-        data[len] = 0;
-
-        for (int i=0; i<len; i++) {
-            if (data[i] == ' ') {
-                data[i] = 0;
-                break;
-            }
-        }
-
+    Vector<jint> pids;
+    for (const proc_info_t& info : infos) {
         for (size_t i=0; i<commands.size(); i++) {
-            if (commands[i] == data) {
-                pids.add(pid);
+            if (commands[i] == info.cmdline.c_str()) {
+                pids.add(info.pid);
                 break;
             }
         }
     }
 
-    closedir(proc);
-
     jintArray pidArray = env->NewIntArray(pids.size());
     if (pidArray == NULL) {
         jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
@@ -1032,6 +970,96 @@ jintArray android_os_Process_getPidsForCommands(JNIEnv* env, jobject clazz,
     return pidArray;
 }
 
+// The longs readProcesses() gives for each process, in this order.
+enum {
+    PROC_INFO_PPID,
+    PROC_INFO_STATE,
+    PROC_INFO_MIN_FAULTS,
+    PROC_INFO_MAJ_FAULTS,
+    PROC_INFO_UTIME,
+    PROC_INFO_STIME,
+    PROC_INFO_START_TIME,
+    PROC_INFO_NUM_THREADS,
+    PROC_INFO_VSIZE,
+    PROC_INFO_RSS,
+    PROC_INFO_UID,
+    PROC_INFO_VM_RSS,
+    PROC_INFO_VM_SWAP,
+    PROC_INFO_LONGS
+};
+
+/*
+ * Reads the cmdline, stat and status, as fields asks for, of every process at once, where
+ * getPids() and a readProcFile() per process and file go through /proc a path at a time.
+ * Returns how many processes there are, or minus that if the arrays are too small for them.
+ */
+jint android_os_Process_readProcesses(JNIEnv* env, jobject clazz, jint fields,
+        jintArray outPids, jobjectArray outNames, jlongArray outLongs)
+{
+    if (outPids == NULL) {
+        jniThrowNullPointerException(env, NULL);
+        return 0;
+    }
+
+    std::vector<proc_info_t> infos;
+    ProcReader reader;
+    if (!reader.readAll(fields, &infos)) {
+        return 0;
+    }
+
+    const jsize count = infos.size();
+    if (env->GetArrayLength(outPids) < count
+            || (outNames != NULL && env->GetArrayLength(outNames) < count)
+            || (outLongs != NULL && env->GetArrayLength(outLongs) < count * PROC_INFO_LONGS)) {
+        return -count;
+    }
+
+    jint* pidsData = env->GetIntArrayElements(outPids, 0);
+    jlong* longsData = outLongs ? env->GetLongArrayElements(outLongs, 0) : NULL;
+    if (pidsData == NULL || (outLongs != NULL && longsData == NULL)) {
+        if (pidsData != NULL) {
+            env->ReleaseIntArrayElements(outPids, pidsData, 0);
+        }
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
+
+    for (jsize i=0; i<count; i++) {
+        const proc_info_t& info = infos[i];
+        pidsData[i] = info.pid;
+        if (longsData != NULL) {
+            jlong* values = longsData + i * PROC_INFO_LONGS;
+            values[PROC_INFO_PPID] = info.ppid;
+            values[PROC_INFO_STATE] = info.state;
+            values[PROC_INFO_MIN_FAULTS] = info.minFaults;
+            values[PROC_INFO_MAJ_FAULTS] = info.majFaults;
+            values[PROC_INFO_UTIME] = info.utime;
+            values[PROC_INFO_STIME] = info.stime;
+            values[PROC_INFO_START_TIME] = info.startTime;
+            values[PROC_INFO_NUM_THREADS] = info.numThreads;
+            values[PROC_INFO_VSIZE] = info.vsize;
+            values[PROC_INFO_RSS] = info.rss;
+            values[PROC_INFO_UID] = (jint) info.uid;
+            values[PROC_INFO_VM_RSS] = info.vmRss;
+            values[PROC_INFO_VM_SWAP] = info.vmSwap;
+        }
+        if (outNames != NULL) {
+            // The cmdline if it was asked for, as a process can rename itself there
+            const std::string& name = (info.read & PROC_READ_CMDLINE) != 0
+                    ? info.cmdline : info.name;
+            jstring str = env->NewStringUTF(name.c_str());
+            env->SetObjectArrayElement(outNames, i, str);
+            env->DeleteLocalRef(str);
+        }
+    }
+
+    env->ReleaseIntArrayElements(outPids, pidsData, 0);
+    if (longsData != NULL) {
+        env->ReleaseLongArrayElements(outLongs, longsData, 0);
+    }
+    return count;
+}
+
 jint android_os_Process_killProcessGroup(JNIEnv* env, jobject clazz, jint uid, jint pid)
 {
     return killProcessGroup(uid, pid, SIGKILL);
@@ -1073,7 +1101,18 @@ static const JNINativeMethod methods[] = {
     {"removeAllProcessGroups", "()V", (void*)android_os_Process_removeAllProcessGroups},
 };
 
+// Registered when Process has it, which it can use instead of getPids() and readProcFile().
+static const JNINativeMethod batchMethods[] = {
+    {"readProcesses", "(I[I[Ljava/lang/String;[J)I", (void*)android_os_Process_readProcesses},
+};
+
 int register_android_os_Process(JNIEnv* env)
 {
-    return RegisterMethodsOrDie(env, "android/os/Process", methods, NELEM(methods));
+    int result = RegisterMethodsOrDie(env, "android/os/Process", methods, NELEM(methods));
+    jclass process = FindClassOrDie(env, "android/os/Process");
+    if (env->RegisterNatives(process, batchMethods, NELEM(batchMethods)) < 0) {
+        env->ExceptionClear();
+    }
+    env->DeleteLocalRef(process);
+    return result;
 }
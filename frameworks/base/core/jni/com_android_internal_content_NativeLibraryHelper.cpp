@@ -18,6 +18,7 @@
 //#define LOG_NDEBUG 0
 
 #include "core_jni_helpers.h"
+#include "NativeLibraryExtractor.h"
 
 #include <ScopedUtfChars.h>
 #include <UniquePtr.h>
@@ -26,8 +27,6 @@
 #include <utils/Log.h>
 #include <utils/Vector.h>
 
-#include <zlib.h>
-
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,25 +51,14 @@
 #define GDBSERVER "gdbserver"
 #define GDBSERVER_LEN (sizeof(GDBSERVER) - 1)
 
-#define TMP_FILE_PATTERN "/tmp.XXXXXX"
-#define TMP_FILE_PATTERN_LEN (sizeof(TMP_FILE_PATTERN) - 1)
-
 #define LIB_UNINIT             0
 #define LIB_INITED_AND_FAIL    -1
 #define LIB_INITED_AND_SUCCESS 1
 
-namespace android {
+// Libraries extracted at once
+#define EXTRACT_THREADS 4
 
-// These match PackageManager.java install codes
-enum install_status_t {
-    INSTALL_SUCCEEDED = 1,
-    INSTALL_FAILED_INVALID_APK = -2,
-    INSTALL_FAILED_INSUFFICIENT_STORAGE = -4,
-    INSTALL_FAILED_CONTAINER_ERROR = -18,
-    INSTALL_FAILED_INTERNAL_ERROR = -110,
-    INSTALL_FAILED_NO_MATCHING_ABIS = -113,
-    NO_NATIVE_LIBRARIES = -114
-};
+namespace android {
 
 typedef install_status_t (*iterFunc)(JNIEnv*, void*, ZipFileRO*, ZipEntryRO, const char*);
 
@@ -125,55 +113,6 @@ isFilenameSafe(const char* filename)
     // Should not reach here.
 }
 
-static bool
-isFileDifferent(const char* filePath, uint32_t fileSize, time_t modifiedTime,
-        uint32_t zipCrc, struct stat64* st)
-{
-    if (lstat64(filePath, st) < 0) {
-        // File is not found or cannot be read.
-        ALOGV("Couldn't stat %s, copying: %s\n", filePath, strerror(errno));
-        return true;
-    }
-
-    if (!S_ISREG(st->st_mode)) {
-        return true;
-    }
-
-    if (static_cast<uint64_t>(st->st_size) != static_cast<uint64_t>(fileSize)) {
-        return true;
-    }
-
-    // For some reason, bionic doesn't define st_mtime as time_t
-    if (time_t(st->st_mtime) != modifiedTime) {
-        ALOGV("mod time doesn't match: %ld vs. %ld\n", st->st_mtime, modifiedTime);
-        return true;
-    }
-
-    int fd = TEMP_FAILURE_RETRY(open(filePath, O_RDONLY));
-    if (fd < 0) {
-        ALOGV("Couldn't open file %s: %s", filePath, strerror(errno));
-        return true;
-    }
-
-    // uLong comes from zlib.h. It's a bit of a wart that they're
-    // potentially using a 64-bit type for a 32-bit CRC.
-    uLong crc = crc32(0L, Z_NULL, 0);
-    unsigned char crcBuffer[16384];
-    ssize_t numBytes;
-    while ((numBytes = TEMP_FAILURE_RETRY(read(fd, crcBuffer, sizeof(crcBuffer)))) > 0) {
-        crc = crc32(crc, crcBuffer, numBytes);
-    }
-    close(fd);
-
-    ALOGV("%s: crc = %lx, zipCrc = %" PRIu32 "\n", filePath, crc, zipCrc);
-
-    if (crc != static_cast<uLong>(zipCrc)) {
-        return true;
-    }
-
-    return false;
-}
-
 static install_status_t
 sumFiles(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char*)
 {
@@ -190,28 +129,27 @@ sumFiles(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char
 }
 
 /*
- * Copy the native library if needed.
+ * Queue the native library to be copied, if it is to be extracted at all.
  *
  * This function assumes the library and path names passed in are considered safe.
  */
 static install_status_t
-copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
+addFileToExtract(JNIEnv*, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntry, const char* fileName)
 {
     void** args = reinterpret_cast<void**>(arg);
-    jstring* javaNativeLibPath = (jstring*) args[0];
+    NativeLibraryExtractor* extractor = (NativeLibraryExtractor*) args[0];
     jboolean extractNativeLibs = *(jboolean*) args[1];
     jboolean hasNativeBridge = *(jboolean*) args[2];
 
-    ScopedUtfChars nativeLibPath(env, *javaNativeLibPath);
-
     uint32_t uncompLen;
+    uint32_t compLen;
     uint32_t when;
     uint32_t crc;
 
     uint16_t method;
     off64_t offset;
 
-    if (!zipFile->getEntryInfo(zipEntry, &method, &uncompLen, NULL, &offset, &when, &crc)) {
+    if (!zipFile->getEntryInfo(zipEntry, &method, &uncompLen, &compLen, &offset, &when, &crc)) {
         ALOGD("Couldn't read zip entry info\n");
         return INSTALL_FAILED_INVALID_APK;
     }
@@ -235,89 +173,18 @@ copyFileIfChanged(JNIEnv *env, void* arg, ZipFileRO* zipFile, ZipEntryRO zipEntr
         }
     }
 
-    // Build local file path
-    const size_t fileNameLen = strlen(fileName);
-    char localFileName[nativeLibPath.size() + fileNameLen + 2];
-
-    if (strlcpy(localFileName, nativeLibPath.c_str(), sizeof(localFileName)) != nativeLibPath.size()) {
-        ALOGD("Couldn't allocate local file name for library");
-        return INSTALL_FAILED_INTERNAL_ERROR;
-    }
-
-    *(localFileName + nativeLibPath.size()) = '/';
-
-    if (strlcpy(localFileName + nativeLibPath.size() + 1, fileName, sizeof(localFileName)
-                    - nativeLibPath.size() - 1) != fileNameLen) {
-        ALOGD("Couldn't allocate local file name for library");
-        return INSTALL_FAILED_INTERNAL_ERROR;
-    }
-
-    // Only copy out the native file if it's different.
     struct tm t;
     ZipUtils::zipTimeToTimespec(when, &t);
-    const time_t modTime = mktime(&t);
-    struct stat64 st;
-    if (!isFileDifferent(localFileName, uncompLen, modTime, crc, &st)) {
-        return INSTALL_SUCCEEDED;
-    }
-
-    char localTmpFileName[nativeLibPath.size() + TMP_FILE_PATTERN_LEN + 2];
-    if (strlcpy(localTmpFileName, nativeLibPath.c_str(), sizeof(localTmpFileName))
-            != nativeLibPath.size()) {
-        ALOGD("Couldn't allocate local file name for library");
-        return INSTALL_FAILED_INTERNAL_ERROR;
-    }
-
-    *(localFileName + nativeLibPath.size()) = '/';
-
-    if (strlcpy(localTmpFileName + nativeLibPath.size(), TMP_FILE_PATTERN,
-                    TMP_FILE_PATTERN_LEN - nativeLibPath.size()) != TMP_FILE_PATTERN_LEN) {
-        ALOGI("Couldn't allocate temporary file name for library");
-        return INSTALL_FAILED_INTERNAL_ERROR;
-    }
-
-    int fd = mkstemp(localTmpFileName);
-    if (fd < 0) {
-        ALOGI("Couldn't open temporary file name: %s: %s\n", localTmpFileName, strerror(errno));
-        return INSTALL_FAILED_CONTAINER_ERROR;
-    }
-
-    if (!zipFile->uncompressEntry(zipEntry, fd)) {
-        ALOGI("Failed uncompressing %s to %s\n", fileName, localTmpFileName);
-        close(fd);
-        unlink(localTmpFileName);
-        return INSTALL_FAILED_CONTAINER_ERROR;
-    }
-
-    close(fd);
-
-    // Set the modification time for this file to the ZIP's mod time.
-    struct timeval times[2];
-    times[0].tv_sec = st.st_atime;
-    times[1].tv_sec = modTime;
-    times[0].tv_usec = times[1].tv_usec = 0;
-    if (utimes(localTmpFileName, times) < 0) {
-        ALOGI("Couldn't change modification time on %s: %s\n", localTmpFileName, strerror(errno));
-        unlink(localTmpFileName);
-        return INSTALL_FAILED_CONTAINER_ERROR;
-    }
-
-    // Set the mode to 755
-    static const mode_t mode = S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP |  S_IXGRP | S_IROTH | S_IXOTH;
-    if (chmod(localTmpFileName, mode) < 0) {
-        ALOGI("Couldn't change permissions on %s: %s\n", localTmpFileName, strerror(errno));
-        unlink(localTmpFileName);
-        return INSTALL_FAILED_CONTAINER_ERROR;
-    }
-
-    // Finally, rename it to the final name.
-    if (rename(localTmpFileName, localFileName) < 0) {
-        ALOGI("Couldn't rename %s to %s: %s\n", localTmpFileName, localFileName, strerror(errno));
-        unlink(localTmpFileName);
-        return INSTALL_FAILED_CONTAINER_ERROR;
-    }
 
-    ALOGV("Successfully moved %s to %s\n", localTmpFileName, localFileName);
+    native_lib_entry entry;
+    entry.fileName = fileName;
+    entry.method = method;
+    entry.offset = offset;
+    entry.compressedLength = compLen;
+    entry.uncompressedLength = uncompLen;
+    entry.crc = crc;
+    entry.modTime = mktime(&t);
+    extractor->add(entry);
 
     return INSTALL_SUCCEEDED;
 }
@@ -535,9 +402,27 @@ com_android_internal_content_NativeLibraryHelper_copyNativeBinaries(JNIEnv *env,
         jlong apkHandle, jstring javaNativeLibPath, jstring javaCpuAbi,
         jboolean extractNativeLibs, jboolean hasNativeBridge)
 {
-    void* args[] = { &javaNativeLibPath, &extractNativeLibs, &hasNativeBridge };
-    return (jint) iterateOverNativeFiles(env, apkHandle, javaCpuAbi,
-            copyFileIfChanged, reinterpret_cast<void*>(args));
+    ZipFileRO* zipFile = reinterpret_cast<ZipFileRO*>(apkHandle);
+    if (zipFile == NULL) {
+        return INSTALL_FAILED_INVALID_APK;
+    }
+
+    ScopedUtfChars nativeLibPath(env, javaNativeLibPath);
+    if (nativeLibPath.c_str() == NULL) {
+        return INSTALL_FAILED_INTERNAL_ERROR;
+    }
+
+    // Entries are gathered through the ZipFileRO, then extracted from its descriptor in
+    // parallel once the iteration is over.
+    NativeLibraryExtractor extractor(zipFile->getFileDescriptor(), nativeLibPath.c_str());
+    void* args[] = { &extractor, &extractNativeLibs, &hasNativeBridge };
+    install_status_t ret = iterateOverNativeFiles(env, apkHandle, javaCpuAbi,
+            addFileToExtract, reinterpret_cast<void*>(args));
+    if (ret != INSTALL_SUCCEEDED) {
+        return (jint) ret;
+    }
+
+    return (jint) extractor.extractAll(EXTRACT_THREADS);
 }
 
 static jlong
@@ -30,8 +30,11 @@
 
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/Mutex.h>
 #include <utils/Vector.h>
 
+#include "NetworkStatsParser.h"
+
 namespace android {
 
 static jclass gStringClass;
@@ -50,16 +53,9 @@ static struct {
     jfieldID operations;
 } gNetworkStatsClassInfo;
 
-struct stats_line {
-    char iface[32];
-    int32_t uid;
-    int32_t set;
-    int32_t tag;
-    int64_t rxBytes;
-    int64_t rxPackets;
-    int64_t txBytes;
-    int64_t txPackets;
-};
+// Keeps its buffers between reads, which come every few seconds
+static Mutex gParserLock;
+static NetworkStatsParser* gParser;
 
 static jobjectArray get_string_array(JNIEnv* env, jobject obj, jfieldID field, int size, bool grow)
 {
@@ -101,11 +97,6 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
         return -1;
     }
 
-    FILE *fp = fopen(path8.c_str(), "r");
-    if (fp == NULL) {
-        return -1;
-    }
-
     Vector<String8> limitIfaces;
     if (limitIfacesObj != NULL && env->GetArrayLength(limitIfacesObj) > 0) {
         int num = env->GetArrayLength(limitIfacesObj);
@@ -119,109 +110,15 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
         }
     }
 
-    Vector<stats_line> lines;
-
-    int lastIdx = 1;
-    int idx;
-    char buffer[384];
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-        stats_line s;
-        int64_t rawTag;
-        char* pos = buffer;
-        char* endPos;
-        // First field is the index.
-        idx = (int)strtol(pos, &endPos, 10);
-        //ALOGI("Index #%d: %s", idx, buffer);
-        if (pos == endPos) {
-            // Skip lines that don't start with in index.  In particular,
-            // this will skip the initial header line.
-            continue;
-        }
-        if (idx != lastIdx + 1) {
-            ALOGE("inconsistent idx=%d after lastIdx=%d: %s", idx, lastIdx, buffer);
-            fclose(fp);
-            return -1;
-        }
-        lastIdx = idx;
-        pos = endPos;
-        // Skip whitespace.
-        while (*pos == ' ') {
-            pos++;
-        }
-        // Next field is iface.
-        int ifaceIdx = 0;
-        while (*pos != ' ' && *pos != 0 && ifaceIdx < (int)(sizeof(s.iface)-1)) {
-            s.iface[ifaceIdx] = *pos;
-            ifaceIdx++;
-            pos++;
-        }
-        if (*pos != ' ') {
-            ALOGE("bad iface: %s", buffer);
-            fclose(fp);
-            return -1;
-        }
-        s.iface[ifaceIdx] = 0;
-        if (limitIfaces.size() > 0) {
-            // Is this an iface the caller is interested in?
-            int i = 0;
-            while (i < (int)limitIfaces.size()) {
-                if (limitIfaces[i] == s.iface) {
-                    break;
-                }
-                i++;
-            }
-            if (i >= (int)limitIfaces.size()) {
-                // Nothing matched; skip this line.
-                //ALOGI("skipping due to iface: %s", buffer);
-                continue;
-            }
-        }
-
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Find end of tag field
-        endPos = pos;
-        while (*endPos != ' ') endPos++;
-
-        // Three digit field is always 0x0, otherwise parse
-        if (endPos - pos == 3) {
-            rawTag = 0;
-        } else {
-            if (sscanf(pos, "%" PRIx64, &rawTag) != 1) {
-                ALOGE("bad tag: %s", pos);
-                fclose(fp);
-                return -1;
-            }
-        }
-        s.tag = rawTag >> 32;
-        if (limitTag != -1 && s.tag != limitTag) {
-            //ALOGI("skipping due to tag: %s", buffer);
-            continue;
-        }
-        pos = endPos;
-
-        // Ignore whitespace
-        while (*pos == ' ') pos++;
-
-        // Parse remaining fields.
-        if (sscanf(pos, "%u %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
-                &s.uid, &s.set, &s.rxBytes, &s.rxPackets,
-                &s.txBytes, &s.txPackets) == 6) {
-            if (limitUid != -1 && limitUid != s.uid) {
-                //ALOGI("skipping due to uid: %s", buffer);
-                continue;
-            }
-            lines.push_back(s);
-        } else {
-            //ALOGI("skipping due to bad remaining fields: %s", pos);
-        }
+    Mutex::Autolock _l(gParserLock);
+    if (gParser == NULL) {
+        gParser = new NetworkStatsParser();
     }
-
-    if (fclose(fp) != 0) {
-        ALOGE("Failed to close netstats file");
+    gParser->setLimits(limitUid, limitIfaces, limitTag);
+    if (gParser->parseFile(path8.c_str()) != 0) {
         return -1;
     }
+    const std::vector<stats_line>& lines = gParser->lines();
 
     int size = lines.size();
     bool grow = size > env->GetIntField(stats, gNetworkStatsClassInfo.capacity);
@@ -254,8 +151,12 @@ static int readNetworkStatsDetail(JNIEnv* env, jclass clazz, jobject stats,
             gNetworkStatsClassInfo.operations, size, grow));
     if (operations.get() == NULL) return -1;
 
+    // Rows of one iface come together, they can share its String
+    ScopedLocalRef<jstring> ifaceString(env, NULL);
     for (int i = 0; i < size; i++) {
-        ScopedLocalRef<jstring> ifaceString(env, env->NewStringUTF(lines[i].iface));
+        if (i == 0 || strcmp(lines[i].iface, lines[i - 1].iface)) {
+            ifaceString.reset(env->NewStringUTF(lines[i].iface));
+        }
         env->SetObjectArrayElement(iface.get(), i, ifaceString.get());
 
         uid[i] = lines[i].uid;
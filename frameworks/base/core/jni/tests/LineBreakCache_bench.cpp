@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "SkTypeface.h"
+
+#include <minikin/FontCollection.h>
+#include <minikin/FontFamily.h>
+#include <minikin/LineBreaker.h>
+
+#include "LineBreakCache.h"
+#include "MinikinSkia.h"
+
+// Lays out a long paragraph of words the way StaticLayout does for an
+// EditText being typed into: the whole paragraph over again after each edit,
+// once with a plain LineBreaker and once with a CachingLineBreaker, and checks
+// that they break it in the same places. The edits are single characters put
+// in at the end, as typing does, or anywhere in the paragraph with -r.
+//
+// Then times laying out the same paragraph again with nothing changed, as a
+// layout being rebuilt for a new width and back does.
+
+// Run it like this:
+//
+// LineBreakCache_bench -f /system/fonts/Roboto-Regular.ttf -l 4000 -i 200
+
+using namespace android;
+
+static const float kTextSize = 16.0f;
+static const float kLineWidth = 480.0f;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -f <font> [-l <length>] [-i <edits>] [-r]\n", me);
+    fprintf(stderr, "       -f font file to measure with\n");
+    fprintf(stderr, "       -l length of the paragraph in chars, default 4000\n");
+    fprintf(stderr, "       -i edits to lay out, default 200\n");
+    fprintf(stderr, "       -r make the edits at random rather than at the end\n");
+    exit(1);
+}
+
+static FontCollection* loadFont(const char* path) {
+    SkTypeface* face = SkTypeface::CreateFromFile(path);
+    if (face == NULL) {
+        return NULL;
+    }
+    FontFamily* family = new FontFamily();
+    MinikinFont* font = new MinikinFontSkia(face);
+    family->addFont(font);
+    font->Unref();
+    std::vector<FontFamily*> families;
+    families.push_back(family);
+    FontCollection* collection = new FontCollection(families);
+    family->Unref();
+    return collection;
+}
+
+static void makeText(std::vector<uint16_t>* text, size_t length) {
+    static const char* kWords[] = {
+        "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "layout",
+        "paragraph", "a", "of", "line", "breaking", "is", "measured", "again",
+    };
+    text->clear();
+    while (text->size() < length) {
+        const char* word = kWords[rand() % (sizeof(kWords) / sizeof(kWords[0]))];
+        text->insert(text->end(), word, word + strlen(word));
+        text->push_back(' ');
+    }
+    text->resize(length);
+}
+
+static void edit(std::vector<uint16_t>* text, bool random) {
+    size_t offset = random ? rand() % text->size() : text->size();
+    text->insert(text->begin() + offset, rand() % 5 == 0 ? ' ' : 'a' + rand() % 26);
+}
+
+static MinikinPaint makePaint() {
+    MinikinPaint paint;
+    paint.size = kTextSize;
+    paint.scaleX = 1.0f;
+    return paint;
+}
+
+static void breakPlain(LineBreaker* breaker, const std::vector<uint16_t>& text,
+        FontCollection* font, std::vector<int>* breaks) {
+    MinikinPaint paint = makePaint();
+    breaker->resize(text.size());
+    memcpy(breaker->buffer(), text.data(), text.size() * sizeof(uint16_t));
+    breaker->setText();
+    breaker->setLineWidths(kLineWidth, 0, kLineWidth);
+    breaker->setTabStops(NULL, 0, 20);
+    breaker->setStrategy(kBreakStrategy_Greedy);
+    breaker->setHyphenationFrequency(kHyphenationFrequency_None);
+    breaker->addStyleRun(&paint, font, FontStyle(), 0, text.size(), false);
+    size_t n = breaker->computeBreaks();
+    breaks->assign(breaker->getBreaks(), breaker->getBreaks() + n);
+    breaker->finish();
+}
+
+static void breakCached(CachingLineBreaker* breaker, const std::vector<uint16_t>& text,
+        FontCollection* font, std::vector<int>* breaks) {
+    MinikinPaint paint = makePaint();
+    memcpy(breaker->resize(text.size()), text.data(), text.size() * sizeof(uint16_t));
+    breaker->setupParagraph(kLineWidth, 0, kLineWidth, NULL, 0, 20, kBreakStrategy_Greedy,
+            kHyphenationFrequency_None);
+    breaker->addStyleRun(paint, font, FontStyle(), 0, text.size(), false);
+    size_t n = breaker->computeBreaks();
+    breaks->assign(breaker->getBreaks(), breaker->getBreaks() + n);
+    breaker->finish();
+}
+
+int main(int argc, char* argv[]) {
+    const char* me = argv[0];
+    const char* fontPath = NULL;
+    size_t length = 4000;
+    int iterations = 200;
+    bool random = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "f:l:i:r")) >= 0) {
+        switch (res) {
+            case 'f': fontPath = optarg; break;
+            case 'l': length = atoi(optarg); break;
+            case 'i': iterations = atoi(optarg); break;
+            case 'r': random = true; break;
+            default: usage(me);
+        }
+    }
+    if (fontPath == NULL || length == 0 || iterations <= 0) {
+        usage(me);
+    }
+
+    FontCollection* font = loadFont(fontPath);
+    if (font == NULL) {
+        fprintf(stderr, "couldn't load %s\n", fontPath);
+        return EXIT_FAILURE;
+    }
+
+    LineBreaker plain;
+    CachingLineBreaker cached;
+    std::vector<uint16_t> text;
+    std::vector<int> plainBreaks;
+    std::vector<int> cachedBreaks;
+    bool ok = true;
+
+    srand(1);
+    makeText(&text, length);
+    breakCached(&cached, text, font, &cachedBreaks);
+
+    int64_t plainNs = 0;
+    int64_t cachedNs = 0;
+    for (int i = 0; i < iterations; i++) {
+        edit(&text, random);
+
+        int64_t startNs = nowNs();
+        breakPlain(&plain, text, font, &plainBreaks);
+        plainNs += nowNs() - startNs;
+
+        startNs = nowNs();
+        breakCached(&cached, text, font, &cachedBreaks);
+        cachedNs += nowNs() - startNs;
+
+        if (plainBreaks != cachedBreaks) {
+            fprintf(stderr, "edit %d: %zu breaks vs %zu\n", i, plainBreaks.size(),
+                    cachedBreaks.size());
+            ok = false;
+        }
+    }
+    printf("%zu char paragraph, %d edits %s\n", text.size(), iterations,
+            random ? "at random" : "at the end");
+    printf("  edited:    LineBreaker %8.1f us, cached %8.1f us a layout\n",
+            plainNs / 1E3 / iterations, cachedNs / 1E3 / iterations);
+
+    plainNs = 0;
+    cachedNs = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t startNs = nowNs();
+        breakPlain(&plain, text, font, &plainBreaks);
+        plainNs += nowNs() - startNs;
+
+        startNs = nowNs();
+        breakCached(&cached, text, font, &cachedBreaks);
+        cachedNs += nowNs() - startNs;
+    }
+    if (plainBreaks != cachedBreaks) {
+        fprintf(stderr, "unchanged: %zu breaks vs %zu\n", plainBreaks.size(),
+                cachedBreaks.size());
+        ok = false;
+    }
+    printf("  unchanged: LineBreaker %8.1f us, cached %8.1f us a layout\n",
+            plainNs / 1E3 / iterations, cachedNs / 1E3 / iterations);
+
+    font->Unref();
+    printf("%s\n", ok ? "breaks agree" : "BREAKS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "NativeLibraryExtractor.h"
+
+// Writes a synthetic APK body with many libraries, half stored and half deflated, and extracts
+// them: one at a time through read() and write() with small buffers, as copyFileIfChanged() did
+// through the ZipFileRO, then with NativeLibraryExtractor on one thread and on several. Each is
+// then run again over what it extracted, when nothing should change. Checks the libraries
+// extracted by all of them.
+
+// Run it like this:
+//
+// NativeLibraryExtractor_bench -d /data/local/tmp/libs_bench -n 40 -s 2048
+
+using namespace android;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-n <libraries>] [-s <KB>] [-t <threads>]\n", me);
+    fprintf(stderr, "       -d directory for the APK and the libraries, created if needed\n");
+    fprintf(stderr, "       -n libraries, default 40\n");
+    fprintf(stderr, "       -s average library size in KB, default 2048\n");
+    fprintf(stderr, "       -t threads, default 4\n");
+    exit(1);
+}
+
+static void makeDir(const std::string& path) {
+    if (mkdir(path.c_str(), 0771) != 0 && errno != EEXIST) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void clearDir(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] != '.') {
+            unlink((path + "/" + de->d_name).c_str());
+        }
+    }
+    closedir(d);
+}
+
+static void writeAll(int fd, const void* data, size_t length) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (length > 0) {
+        ssize_t n = write(fd, p, length);
+        if (n <= 0) {
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        length -= n;
+    }
+}
+
+/* Something that compresses about as well as code does. */
+static std::vector<uint8_t> makeLibrary(size_t size, unsigned* seed) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (rand_r(seed) % 4 == 0) ? rand_r(seed) : data[i > 64 ? i - 64 : 0] + 1;
+    }
+    return data;
+}
+
+static std::vector<uint8_t> deflateRaw(const std::vector<uint8_t>& data) {
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(zstream));
+    deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> out(deflateBound(&zstream, data.size()));
+    zstream.next_in = const_cast<Bytef*>(data.data());
+    zstream.avail_in = data.size();
+    zstream.next_out = out.data();
+    zstream.avail_out = out.size();
+    deflate(&zstream, Z_FINISH);
+    out.resize(zstream.total_out);
+    deflateEnd(&zstream);
+    return out;
+}
+
+/* Only the entry data: the extractor is handed offsets, as the ZipFileRO would find them. */
+static std::vector<native_lib_entry> writeApk(const std::string& path, int count, size_t sizeKb) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    std::vector<native_lib_entry> entries;
+    unsigned seed = 1;
+    off64_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        size_t size = sizeKb * 1024 / 4 + rand_r(&seed) % (sizeKb * 1024 * 3 / 2 + 1);
+        std::vector<uint8_t> data = makeLibrary(size, &seed);
+        native_lib_entry entry;
+        entry.fileName = "lib" + std::to_string(i) + ".so";
+        entry.method = (i % 2 == 0) ? 0 : 8;
+        entry.uncompressedLength = size;
+        entry.crc = crc32(crc32(0L, Z_NULL, 0), data.data(), size);
+        entry.modTime = 1230768000;     // as zip times go, on a two second boundary
+        // Stored entries are page aligned, as zipalign leaves them
+        offset = (offset + 4095) & ~4095;
+        entry.offset = offset;
+        if (entry.method == 0) {
+            entry.compressedLength = size;
+            lseek64(fd, offset, SEEK_SET);
+            writeAll(fd, data.data(), size);
+        } else {
+            std::vector<uint8_t> compressed = deflateRaw(data);
+            entry.compressedLength = compressed.size();
+            lseek64(fd, offset, SEEK_SET);
+            writeAll(fd, compressed.data(), compressed.size());
+        }
+        offset += entry.compressedLength;
+        entries.push_back(entry);
+    }
+    close(fd);
+    return entries;
+}
+
+static bool sameCrc(const std::string& path, uint32_t size, uint32_t expected) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    uLong crc = crc32(0L, Z_NULL, 0);
+    uint8_t buf[16384];
+    ssize_t n;
+    uint32_t total = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        crc = crc32(crc, buf, n);
+        total += n;
+    }
+    close(fd);
+    return total == size && crc == expected;
+}
+
+/* copyFileIfChanged() as it was, with the reads ExtractEntryToFile() did. */
+static bool extractOld(int apkFd, const std::string& libPath,
+        const std::vector<native_lib_entry>& entries) {
+    for (const auto& entry : entries) {
+        std::string path = libPath + "/" + entry.fileName;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && (uint32_t) st.st_size == entry.uncompressedLength
+                && st.st_mtime == entry.modTime && sameCrc(path, entry.uncompressedLength,
+                        entry.crc)) {
+            continue;
+        }
+        std::string tmp = libPath + "/tmp.XXXXXX";
+        int fd = mkstemp(&tmp[0]);
+        if (fd < 0) {
+            return false;
+        }
+        uint8_t in[32768];
+        uint8_t out[32768];
+        off64_t off = entry.offset;
+        size_t left = entry.compressedLength;
+        lseek64(apkFd, off, SEEK_SET);
+        if (entry.method == 0) {
+            while (left > 0) {
+                ssize_t n = read(apkFd, in, std::min(sizeof(in), left));
+                if (n <= 0) {
+                    return false;
+                }
+                writeAll(fd, in, n);
+                left -= n;
+            }
+        } else {
+            z_stream zstream;
+            memset(&zstream, 0, sizeof(zstream));
+            inflateInit2(&zstream, -MAX_WBITS);
+            int zerr = Z_OK;
+            while (zerr != Z_STREAM_END) {
+                if (zstream.avail_in == 0) {
+                    ssize_t n = read(apkFd, in, std::min(sizeof(in), left));
+                    if (n <= 0) {
+                        return false;
+                    }
+                    left -= n;
+                    zstream.next_in = in;
+                    zstream.avail_in = n;
+                }
+                zstream.next_out = out;
+                zstream.avail_out = sizeof(out);
+                zerr = inflate(&zstream, Z_NO_FLUSH);
+                if (zerr != Z_OK && zerr != Z_STREAM_END) {
+                    return false;
+                }
+                writeAll(fd, out, sizeof(out) - zstream.avail_out);
+            }
+            inflateEnd(&zstream);
+        }
+        close(fd);
+        struct timeval times[2] = { { entry.modTime, 0 }, { entry.modTime, 0 } };
+        utimes(tmp.c_str(), times);
+        chmod(tmp.c_str(), 0755);
+        rename(tmp.c_str(), path.c_str());
+    }
+    return true;
+}
+
+static bool check(const char* name, const std::string& libPath,
+        const std::vector<native_lib_entry>& entries) {
+    for (const auto& entry : entries) {
+        std::string path = libPath + "/" + entry.fileName;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || st.st_mtime != entry.modTime
+                || !sameCrc(path, entry.uncompressedLength, entry.crc)) {
+            fprintf(stderr, "%s: %s was not extracted right\n", name, entry.fileName.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    std::string dir;
+    int count = 40;
+    int sizeKb = 2048;
+    int threads = 4;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:n:s:t:")) >= 0) {
+        switch (res) {
+            case 'd': dir = optarg; break;
+            case 'n': count = atoi(optarg); break;
+            case 's': sizeKb = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (dir.empty() || count < 1 || sizeKb < 1 || threads < 1) {
+        usage(me);
+    }
+
+    makeDir(dir);
+    std::string apkPath = dir + "/base.apk";
+    std::string libPath = dir + "/lib";
+    makeDir(libPath);
+    std::vector<native_lib_entry> entries = writeApk(apkPath, count, sizeKb);
+    int apkFd = open(apkPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (apkFd < 0) {
+        perror(apkPath.c_str());
+        return EXIT_FAILURE;
+    }
+    printf("extracting %d libraries of about %d KB\n", count, sizeKb);
+
+    bool ok = true;
+    for (int mode = 0; mode < 3; mode++) {
+        const char* name = (mode == 0) ? "read/write" : (mode == 1) ? "1 thread" : "threads";
+        clearDir(libPath);
+        sync();
+        double ms[2];
+        for (int pass = 0; pass < 2; pass++) {
+            int64_t startNs = nowNs();
+            bool done;
+            if (mode == 0) {
+                done = extractOld(apkFd, libPath, entries);
+            } else {
+                NativeLibraryExtractor extractor(apkFd, libPath.c_str());
+                for (const auto& entry : entries) {
+                    extractor.add(entry);
+                }
+                done = extractor.extractAll(mode == 1 ? 1 : threads) == INSTALL_SUCCEEDED;
+            }
+            ms[pass] = (nowNs() - startNs) / 1E6;
+            if (!done) {
+                fprintf(stderr, "%s: extraction failed\n", name);
+                ok = false;
+            }
+        }
+        ok = check(name, libPath, entries) && ok;
+        printf("  %-10s %8.1f ms, unchanged %8.1f ms\n", name, ms[0], ms[1]);
+    }
+    close(apkFd);
+    clearDir(libPath);
+    rmdir(libPath.c_str());
+    unlink(apkPath.c_str());
+
+    printf("%s\n", ok ? "extractions agree" : "EXTRACTIONS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "NetworkStatsParser.h"
+
+// Writes synthetic /proc/net/xt_qtaguid/stats files of 1k to 100k rows and reads them: with
+// fgets and sscanf, as readNetworkStatsDetail() used to, with NetworkStatsParser, and with
+// NetworkStatsParser in delta mode after a few rows have changed. Checks that all of them
+// agree.
+
+// Run it like this:
+//
+// NetworkStatsParser_bench -d /data/local/tmp -i 50
+
+using namespace android;
+
+static const char* kHeader = "idx iface acct_tag_hex uid_tag_int cnt_set rx_bytes rx_packets "
+        "tx_bytes tx_packets rx_tcp_bytes rx_tcp_packets rx_udp_bytes rx_udp_packets "
+        "rx_other_bytes rx_other_packets tx_tcp_bytes tx_tcp_packets tx_udp_bytes "
+        "tx_udp_packets tx_other_bytes tx_other_packets\n";
+
+struct Row {
+    std::string iface;
+    uint64_t tag;
+    uint32_t uid;
+    uint32_t set;
+    uint64_t counters[4];
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d <dir>] [-i <iterations>] [-c <percent changed>]\n", me);
+    fprintf(stderr, "       -d directory for the stats files, default /data/local/tmp\n");
+    fprintf(stderr, "       -i reads of each file, default 50\n");
+    fprintf(stderr, "       -c percent of the rows changed for delta reads, default 5\n");
+    exit(1);
+}
+
+static std::vector<Row> makeRows(size_t count) {
+    static const char* kIfaces[] = { "wlan0", "rmnet_data0", "rmnet_data1", "lo" };
+    std::vector<Row> rows;
+    unsigned seed = 1;
+    for (size_t i = 0; rows.size() < count; i++) {
+        Row row;
+        row.iface = kIfaces[(i / 64) % 4];
+        row.uid = 10000 + (i / 2) % 997;
+        row.set = i % 2;
+        row.tag = (i % 5 == 0) ? (uint64_t) (rand_r(&seed) % 0xffff) << 32 : 0;
+        for (auto& counter : row.counters) {
+            counter = rand_r(&seed) * 4096ULL;
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+static void writeStats(const std::string& path, const std::vector<Row>& rows) {
+    FILE* fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    fputs(kHeader, fp);
+    for (size_t i = 0; i < rows.size(); i++) {
+        const Row& row = rows[i];
+        fprintf(fp, "%zu %s 0x%" PRIx64 " %u %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                " 0 0 0 0 0 0 0 0 0 0 0 0\n", i + 2, row.iface.c_str(), row.tag, row.uid,
+                row.set, row.counters[0], row.counters[1], row.counters[2], row.counters[3]);
+    }
+    fclose(fp);
+}
+
+// readNetworkStatsDetail() as it was, without limits.
+static int readOld(const char* path, std::vector<stats_line>* lines) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    lines->clear();
+    int lastIdx = 1;
+    int idx;
+    char buffer[384];
+    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+        stats_line s;
+        int64_t rawTag;
+        char* pos = buffer;
+        char* endPos;
+        idx = (int)strtol(pos, &endPos, 10);
+        if (pos == endPos) {
+            continue;
+        }
+        if (idx != lastIdx + 1) {
+            fclose(fp);
+            return -1;
+        }
+        lastIdx = idx;
+        pos = endPos;
+        while (*pos == ' ') {
+            pos++;
+        }
+        int ifaceIdx = 0;
+        while (*pos != ' ' && *pos != 0 && ifaceIdx < (int)(sizeof(s.iface)-1)) {
+            s.iface[ifaceIdx] = *pos;
+            ifaceIdx++;
+            pos++;
+        }
+        if (*pos != ' ') {
+            fclose(fp);
+            return -1;
+        }
+        s.iface[ifaceIdx] = 0;
+        while (*pos == ' ') pos++;
+        endPos = pos;
+        while (*endPos != ' ') endPos++;
+        if (endPos - pos == 3) {
+            rawTag = 0;
+        } else if (sscanf(pos, "%" PRIx64, &rawTag) != 1) {
+            fclose(fp);
+            return -1;
+        }
+        s.tag = rawTag >> 32;
+        pos = endPos;
+        while (*pos == ' ') pos++;
+        if (sscanf(pos, "%u %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+                &s.uid, &s.set, &s.rxBytes, &s.rxPackets,
+                &s.txBytes, &s.txPackets) == 6) {
+            lines->push_back(s);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+static bool sameLine(const stats_line& a, const stats_line& b) {
+    return !strcmp(a.iface, b.iface) && a.uid == b.uid && a.set == b.set && a.tag == b.tag
+            && a.rxBytes == b.rxBytes && a.rxPackets == b.rxPackets
+            && a.txBytes == b.txBytes && a.txPackets == b.txPackets;
+}
+
+static bool sameLines(const std::vector<stats_line>& a, const std::vector<stats_line>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!sameLine(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bench(const std::string& dir, size_t count, int iterations, int percent) {
+    std::string path = dir + "/xt_qtaguid_stats_" + std::to_string(count);
+    std::string changedPath = path + "_changed";
+    std::vector<Row> rows = makeRows(count);
+    writeStats(path, rows);
+    size_t changes = 0;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (i % 100 < (size_t) percent) {
+            rows[i].counters[0] += 1500;
+            rows[i].counters[1]++;
+            changes++;
+        }
+    }
+    writeStats(changedPath, rows);
+
+    std::vector<stats_line> expected;
+    int64_t startNs = nowNs();
+    for (int i = 0; i < iterations; i++) {
+        if (readOld(path.c_str(), &expected) != 0) {
+            fprintf(stderr, "fgets: failed to read %s\n", path.c_str());
+            return false;
+        }
+    }
+    double oldUs = (nowNs() - startNs) / 1E3 / iterations;
+
+    NetworkStatsParser parser;
+    startNs = nowNs();
+    for (int i = 0; i < iterations; i++) {
+        if (parser.parseFile(path.c_str()) != 0) {
+            fprintf(stderr, "parser: failed to read %s\n", path.c_str());
+            return false;
+        }
+    }
+    double newUs = (nowNs() - startNs) / 1E3 / iterations;
+    bool ok = sameLines(expected, parser.lines());
+    if (!ok) {
+        fprintf(stderr, "%zu rows: parser read %zu rows, not as fgets did\n", count,
+                parser.lines().size());
+    }
+
+    // Each delta read is against the other file
+    NetworkStatsParser delta;
+    delta.setDeltaMode(true);
+    delta.parseFile(path.c_str());
+    double deltaUs = 0;
+    for (int i = 0; i < iterations; i++) {
+        const std::string& next = (i % 2 == 0) ? changedPath : path;
+        startNs = nowNs();
+        delta.parseFile(next.c_str());
+        deltaUs += (nowNs() - startNs) / 1E3;
+        if (delta.lines().size() != changes) {
+            fprintf(stderr, "%zu rows: delta read %zu rows, %zu changed\n", count,
+                    delta.lines().size(), changes);
+            ok = false;
+            break;
+        }
+    }
+    deltaUs /= iterations;
+
+    printf("%7zu rows: fgets %9.1f us, parser %9.1f us (%4.1fx), delta %9.1f us\n", count,
+            oldUs, newUs, oldUs / newUs, deltaUs);
+    unlink(path.c_str());
+    unlink(changedPath.c_str());
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    std::string dir = "/data/local/tmp";
+    int iterations = 50;
+    int percent = 5;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:i:c:")) >= 0) {
+        switch (res) {
+            case 'd': dir = optarg; break;
+            case 'i': iterations = atoi(optarg); break;
+            case 'c': percent = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (iterations < 1 || percent < 0 || percent > 100) {
+        usage(me);
+    }
+
+    bool ok = true;
+    static const size_t kCounts[] = { 1000, 10000, 100000 };
+    for (size_t count : kCounts) {
+        ok = bench(dir, count, iterations, percent) && ok;
+    }
+    printf("%s\n", ok ? "parsers agree" : "PARSERS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ProcReader.h"
+
+// Builds a tree laid out like /proc, with a cmdline, stat and status for each of -n
+// processes and a few other files beside them, unless the directory has one already.
+// Reads it the way getPids(), getPidsForCommands() and readProcFile() go through /proc,
+// with readdir() and a path put together for every file, and with ProcReader, and checks
+// that they agree. Then reads the real /proc both ways.
+
+// Run it like this:
+//
+// ProcReader_bench -d /data/local/tmp/proc -n 500 -i 20
+
+using namespace android;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-n <processes>] [-i <iterations>]\n", me);
+    fprintf(stderr, "       -d directory for the /proc-like tree, built if empty\n");
+    fprintf(stderr, "       -n processes in the tree, default 500\n");
+    fprintf(stderr, "       -i reads of the whole tree, default 20\n");
+    exit(1);
+}
+
+static bool writeFile(const std::string& path, const std::string& data) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, data.data(), data.size()) == (ssize_t) data.size();
+    close(fd);
+    return ok;
+}
+
+static bool buildTree(const std::string& dir, int processes) {
+    mkdir(dir.c_str(), 0755);
+    if (access((dir + "/1/stat").c_str(), F_OK) == 0) {
+        return true;
+    }
+    static const char* kOthers[] = { "meminfo", "stat", "uptime", "version", "vmstat" };
+    for (size_t i = 0; i < sizeof(kOthers) / sizeof(kOthers[0]); i++) {
+        if (!writeFile(dir + "/" + kOthers[i], "0\n")) {
+            return false;
+        }
+    }
+    mkdir((dir + "/self").c_str(), 0755);
+
+    srand(1);
+    for (int i = 0; i < processes; i++) {
+        int pid = i == 0 ? 1 : 100 + i * 7 + rand() % 7;
+        std::string pidDir = dir + "/" + std::to_string(pid);
+        mkdir(pidDir.c_str(), 0755);
+
+        char name[32];
+        char data[1024];
+        snprintf(name, sizeof(name), i % 3 == 0 ? "kworker/%d:1" : "com.example.app%d", i);
+        std::string cmdline;
+        if (i % 3 != 0) {
+            cmdline = name;
+            cmdline.append(1, '\0');
+            cmdline.append(i % 2 ? "--flag" : "");
+            cmdline.append(1, '\0');
+        }
+        int n = snprintf(data, sizeof(data),
+                "%d (%.15s) %c %d %d %d 0 -1 4194560 %d 0 %d 0 %d %d 0 0 %d %d %d 0 %d "
+                "%d %d 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 %d 0 0 0 0 0\n",
+                pid, name, "RSDS"[i % 4], i == 0 ? 0 : 1, pid, pid, rand() % 100000,
+                rand() % 1000, rand() % 100000, rand() % 10000, 20 - i % 40, i % 40 - 20,
+                1 + i % 60, rand() % 1000000, rand() * 4096, rand() % 50000, i % 4);
+        if (!writeFile(pidDir + "/cmdline", cmdline)
+                || !writeFile(pidDir + "/stat", std::string(data, n))) {
+            return false;
+        }
+        n = snprintf(data, sizeof(data),
+                "Name:\t%.15s\nState:\tS (sleeping)\nTgid:\t%d\nPid:\t%d\nPPid:\t1\n"
+                "TracerPid:\t0\nUid:\t%d\t%d\t%d\t%d\nGid:\t%d\t%d\t%d\t%d\n"
+                "FDSize:\t64\nVmPeak:\t 1000000 kB\nVmSize:\t  900000 kB\n"
+                "VmRSS:\t   %d kB\nVmSwap:\t    %d kB\nThreads:\t%d\n"
+                "SigQ:\t0/12345\nCpus_allowed:\tff\nvoluntary_ctxt_switches:\t%d\n",
+                name, pid, pid, 10000 + i, 10000 + i, 10000 + i, 10000 + i, 10000 + i,
+                10000 + i, 10000 + i, 10000 + i, rand() % 200000, rand() % 20000, 1 + i % 60,
+                rand());
+        if (!writeFile(pidDir + "/status", std::string(data, n))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// As the JNI calls read them: a path and an open() for each file, into a small buffer.
+static bool readFileOld(const char* path, char* buffer, size_t size, int* length) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    *length = read(fd, buffer, size - 1);
+    close(fd);
+    if (*length < 0) {
+        return false;
+    }
+    buffer[*length] = 0;
+    return true;
+}
+
+static void readOld(const char* root, std::vector<proc_info_t>* infos) {
+    infos->clear();
+    DIR* d = opendir(root);
+    if (d == NULL) {
+        return;
+    }
+    std::vector<pid_t> pids;
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const char* p = de->d_name;
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (*p == 0 && p != de->d_name) {
+            pids.push_back(atoi(de->d_name));
+        }
+    }
+    closedir(d);
+    std::sort(pids.begin(), pids.end());
+
+    for (pid_t pid : pids) {
+        proc_info_t info = proc_info_t();
+        info.pid = pid;
+        info.uid = (uid_t) -1;
+
+        char path[PATH_MAX];
+        char data[PATH_MAX];
+        int len;
+        snprintf(path, sizeof(path), "%s/%d/cmdline", root, pid);
+        if (readFileOld(path, data, sizeof(data), &len)) {
+            for (int i = 0; i < len; i++) {
+                if (data[i] == ' ') {
+                    data[i] = 0;
+                    break;
+                }
+            }
+            info.cmdline = data;
+            info.read |= PROC_READ_CMDLINE;
+        }
+
+        snprintf(path, sizeof(path), "%s/%d/stat", root, pid);
+        if (readFileOld(path, data, sizeof(data), &len)) {
+            char* open = strchr(data, '(');
+            char* close = strrchr(data, ')');
+            if (open != NULL && close != NULL && close > open) {
+                info.name.assign(open + 1, close - open - 1);
+                int ppid;
+                int64_t minFaults, majFaults, utime, stime, priority, nice, numThreads;
+                int64_t startTime, vsize, rss;
+                if (sscanf(close + 2, "%c %d %*d %*d %*d %*d %*u %" SCNd64 " %*u %" SCNd64
+                        " %*u %" SCNd64 " %" SCNd64 " %*d %*d %" SCNd64 " %" SCNd64 " %" SCNd64
+                        " %*d %" SCNd64 " %" SCNd64 " %" SCNd64, &info.state, &ppid,
+                        &minFaults, &majFaults, &utime, &stime, &priority, &nice, &numThreads,
+                        &startTime, &vsize, &rss) == 12) {
+                    info.ppid = ppid;
+                    info.minFaults = minFaults;
+                    info.majFaults = majFaults;
+                    info.utime = utime;
+                    info.stime = stime;
+                    info.priority = priority;
+                    info.nice = nice;
+                    info.numThreads = numThreads;
+                    info.startTime = startTime;
+                    info.vsize = vsize;
+                    info.rss = rss;
+                    info.read |= PROC_READ_STAT;
+                }
+            }
+        }
+
+        snprintf(path, sizeof(path), "%s/%d/status", root, pid);
+        if (readFileOld(path, data, sizeof(data), &len)) {
+            char* line = data;
+            while (line != NULL && *line) {
+                int64_t value;
+                unsigned uid;
+                if (sscanf(line, "Uid: %u", &uid) == 1) {
+                    info.uid = uid;
+                } else if (sscanf(line, "VmRSS: %" SCNd64, &value) == 1) {
+                    info.vmRss = value;
+                } else if (sscanf(line, "VmSwap: %" SCNd64, &value) == 1) {
+                    info.vmSwap = value;
+                }
+                line = strchr(line, '\n');
+                if (line != NULL) {
+                    line++;
+                }
+            }
+            info.read |= PROC_READ_STATUS;
+        }
+
+        if (info.read != 0) {
+            infos->push_back(info);
+        }
+    }
+}
+
+static bool same(const proc_info_t& a, const proc_info_t& b) {
+    return a.pid == b.pid && a.read == b.read && a.cmdline == b.cmdline && a.name == b.name
+            && a.state == b.state && a.ppid == b.ppid && a.minFaults == b.minFaults
+            && a.majFaults == b.majFaults && a.utime == b.utime && a.stime == b.stime
+            && a.priority == b.priority && a.nice == b.nice && a.numThreads == b.numThreads
+            && a.startTime == b.startTime && a.vsize == b.vsize && a.rss == b.rss
+            && a.uid == b.uid && a.vmRss == b.vmRss && a.vmSwap == b.vmSwap;
+}
+
+static const int kAllFields = PROC_READ_CMDLINE | PROC_READ_STAT | PROC_READ_STATUS;
+
+int main(int argc, char* argv[]) {
+    const char* me = argv[0];
+    const char* dir = NULL;
+    int processes = 500;
+    int iterations = 20;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:n:i:")) >= 0) {
+        switch (res) {
+            case 'd': dir = optarg; break;
+            case 'n': processes = atoi(optarg); break;
+            case 'i': iterations = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (dir == NULL || processes <= 0 || iterations <= 0) {
+        usage(me);
+    }
+    if (!buildTree(dir, processes)) {
+        fprintf(stderr, "couldn't build %s\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<proc_info_t> oldInfos;
+    std::vector<proc_info_t> newInfos;
+    ProcReader reader(dir);
+    if (!reader.isOpen()) {
+        fprintf(stderr, "couldn't open %s\n", dir);
+        return EXIT_FAILURE;
+    }
+
+    int64_t oldNs = 0;
+    int64_t newNs = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t startNs = nowNs();
+        readOld(dir, &oldInfos);
+        oldNs += nowNs() - startNs;
+
+        startNs = nowNs();
+        reader.readAll(kAllFields, &newInfos);
+        newNs += nowNs() - startNs;
+    }
+
+    bool ok = oldInfos.size() == newInfos.size();
+    if (!ok) {
+        fprintf(stderr, "%zu processes vs %zu\n", oldInfos.size(), newInfos.size());
+    }
+    for (size_t i = 0; ok && i < oldInfos.size(); i++) {
+        if (!same(oldInfos[i], newInfos[i])) {
+            fprintf(stderr, "pid %d differs\n", oldInfos[i].pid);
+            ok = false;
+        }
+    }
+    printf("%zu processes in %s\n", newInfos.size(), dir);
+    printf("  tree:  readdir+open %8.1f us, ProcReader %8.1f us a process\n",
+            oldNs / 1E3 / iterations / newInfos.size(),
+            newNs / 1E3 / iterations / newInfos.size());
+
+    ProcReader procReader;
+    oldNs = 0;
+    newNs = 0;
+    for (int i = 0; i < iterations; i++) {
+        int64_t startNs = nowNs();
+        readOld("/proc", &oldInfos);
+        oldNs += nowNs() - startNs;
+
+        startNs = nowNs();
+        procReader.readAll(kAllFields, &newInfos);
+        newNs += nowNs() - startNs;
+    }
+    if (!newInfos.empty()) {
+        printf("  /proc: readdir+open %8.1f us, ProcReader %8.1f us a process (%zu)\n",
+                oldNs / 1E3 / iterations / newInfos.size(),
+                newNs / 1E3 / iterations / newInfos.size(), newInfos.size());
+    }
+
+    printf("%s\n", ok ? "readers agree" : "READERS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "SmapsParser.h"
+
+// Reads captured smaps files, copied from /proc into a directory unless it already has some,
+// with fgets and sscanf as read_mapinfo() and Process.getPss() used to, and with SmapsParser,
+// and checks that they agree. Then reads the Pss of every process there is, one after the
+// other and in a batch over several threads.
+
+// Run it like this:
+//
+// SmapsParser_bench -d /data/local/tmp/smaps -i 20 -t 4
+
+using namespace android;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-i <iterations>] [-t <threads>]\n", me);
+    fprintf(stderr, "       -d directory of captured smaps files, filled from /proc if empty\n");
+    fprintf(stderr, "       -i reads of each file, default 20\n");
+    fprintf(stderr, "       -t threads for the batch read, default 4\n");
+    exit(1);
+}
+
+static std::vector<pid_t> listPids() {
+    std::vector<pid_t> pids;
+    DIR* d = opendir("/proc");
+    if (d == NULL) {
+        return pids;
+    }
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        pid_t pid = atoi(de->d_name);
+        if (pid > 0) {
+            pids.push_back(pid);
+        }
+    }
+    closedir(d);
+    return pids;
+}
+
+static bool readAll(const std::string& path, std::string* data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char buf[65536];
+    ssize_t n;
+    data->clear();
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        data->append(buf, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+static std::vector<std::string> captured(const std::string& dir) {
+    std::vector<std::string> files;
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        perror(dir.c_str());
+        exit(EXIT_FAILURE);
+    }
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        if (!strncmp(de->d_name, "smaps.", 6)) {
+            files.push_back(dir + "/" + de->d_name);
+        }
+    }
+    closedir(d);
+    if (!files.empty()) {
+        return files;
+    }
+    for (pid_t pid : listPids()) {
+        std::string data;
+        if (!readAll("/proc/" + std::to_string(pid) + "/smaps", &data) || data.empty()) {
+            continue;
+        }
+        std::string path = dir + "/smaps." + std::to_string(pid);
+        FILE* fp = fopen(path.c_str(), "w");
+        if (fp != NULL) {
+            fwrite(data.data(), 1, data.size(), fp);
+            fclose(fp);
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+static void readMapinfoOld(FILE *fp, stats_t* stats)
+{
+    char line[1024];
+    int len, nameLen;
+    bool skip, done = false;
+
+    unsigned pss = 0, swappable_pss = 0;
+    float sharing_proportion = 0.0;
+    unsigned shared_clean = 0, shared_dirty = 0;
+    unsigned private_clean = 0, private_dirty = 0;
+    unsigned swapped_out = 0;
+    bool is_swappable = false;
+    unsigned temp;
+
+    uint64_t start;
+    uint64_t end = 0;
+    uint64_t prevEnd = 0;
+    char* name;
+    int name_pos;
+
+    int whichHeap = HEAP_UNKNOWN;
+    int subHeap = HEAP_UNKNOWN;
+    int prevHeap = HEAP_UNKNOWN;
+
+    if(fgets(line, sizeof(line), fp) == 0) return;
+
+    while (!done) {
+        prevHeap = whichHeap;
+        prevEnd = end;
+        whichHeap = HEAP_UNKNOWN;
+        subHeap = HEAP_UNKNOWN;
+        skip = false;
+        is_swappable = false;
+
+        len = strlen(line);
+        if (len < 1) return;
+        line[--len] = 0;
+
+        if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %*s %*x %*x:%*x %*d%n", &start, &end, &name_pos) != 2) {
+            skip = true;
+        } else {
+            while (isspace(line[name_pos])) {
+                name_pos += 1;
+            }
+            name = line + name_pos;
+            nameLen = strlen(name);
+
+            if ((strstr(name, "[heap]") == name)) {
+                whichHeap = HEAP_NATIVE;
+            } else if (strncmp(name, "[anon:libc_malloc]", 18) == 0) {
+                whichHeap = HEAP_NATIVE;
+            } else if (strncmp(name, "[stack", 6) == 0) {
+                whichHeap = HEAP_STACK;
+            } else if (nameLen > 3 && strcmp(name+nameLen-3, ".so") == 0) {
+                whichHeap = HEAP_SO;
+                is_swappable = true;
+            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".jar") == 0) {
+                whichHeap = HEAP_JAR;
+                is_swappable = true;
+            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".apk") == 0) {
+                whichHeap = HEAP_APK;
+                is_swappable = true;
+            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".ttf") == 0) {
+                whichHeap = HEAP_TTF;
+                is_swappable = true;
+            } else if ((nameLen > 4 && strstr(name, ".dex") != NULL) ||
+                       (nameLen > 5 && strcmp(name+nameLen-5, ".odex") == 0)) {
+                whichHeap = HEAP_DEX;
+                is_swappable = true;
+            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".oat") == 0) {
+                whichHeap = HEAP_OAT;
+                is_swappable = true;
+            } else if (nameLen > 4 && strcmp(name+nameLen-4, ".art") == 0) {
+                whichHeap = HEAP_ART;
+                is_swappable = true;
+            } else if (strncmp(name, "/dev/", 5) == 0) {
+                if (strncmp(name, "/dev/kgsl-3d0", 13) == 0) {
+                    whichHeap = HEAP_GL_DEV;
+                } else if (strncmp(name, "/dev/ashmem", 11) == 0) {
+                    if (strncmp(name, "/dev/ashmem/dalvik-", 19) == 0) {
+                        whichHeap = HEAP_DALVIK_OTHER;
+                        if (strstr(name, "/dev/ashmem/dalvik-LinearAlloc") == name) {
+                            subHeap = HEAP_DALVIK_LINEARALLOC;
+                        } else if ((strstr(name, "/dev/ashmem/dalvik-alloc space") == name) ||
+                                   (strstr(name, "/dev/ashmem/dalvik-main space") == name)) {
+                            // This is the regular Dalvik heap.
+                            whichHeap = HEAP_DALVIK;
+                            subHeap = HEAP_DALVIK_NORMAL;
+                        } else if (strstr(name, "/dev/ashmem/dalvik-large object space") == name) {
+                            whichHeap = HEAP_DALVIK;
+                            subHeap = HEAP_DALVIK_LARGE;
+                        } else if (strstr(name, "/dev/ashmem/dalvik-non moving space") == name) {
+                            whichHeap = HEAP_DALVIK;
+                            subHeap = HEAP_DALVIK_NON_MOVING;
+                        } else if (strstr(name, "/dev/ashmem/dalvik-zygote space") == name) {
+                            whichHeap = HEAP_DALVIK;
+                            subHeap = HEAP_DALVIK_ZYGOTE;
+                        } else if (strstr(name, "/dev/ashmem/dalvik-indirect ref") == name) {
+                            subHeap = HEAP_DALVIK_INDIRECT_REFERENCE_TABLE;
+                        } else if (strstr(name, "/dev/ashmem/dalvik-jit-code-cache") == name) {
+                            subHeap = HEAP_DALVIK_CODE_CACHE;
+                        } else {
+                            subHeap = HEAP_DALVIK_ACCOUNTING;  // Default to accounting.
+                        }
+                    } else if (strncmp(name, "/dev/ashmem/CursorWindow", 24) == 0) {
+                        whichHeap = HEAP_CURSOR;
+                    } else if (strncmp(name, "/dev/ashmem/libc malloc", 23) == 0) {
+                        whichHeap = HEAP_NATIVE;
+                    } else {
+                        whichHeap = HEAP_ASHMEM;
+                    }
+                } else {
+                    whichHeap = HEAP_UNKNOWN_DEV;
+                }
+            } else if (strncmp(name, "[anon:", 6) == 0) {
+                whichHeap = HEAP_UNKNOWN;
+            } else if (nameLen > 0) {
+                whichHeap = HEAP_UNKNOWN_MAP;
+            } else if (start == prevEnd && prevHeap == HEAP_SO) {
+                // bss section of a shared library.
+                whichHeap = HEAP_SO;
+            }
+        }
+
+        //ALOGI("native=%d dalvik=%d sqlite=%d: %s\n", isNativeHeap, isDalvikHeap,
+        //    isSqliteHeap, line);
+
+        shared_clean = 0;
+        shared_dirty = 0;
+        private_clean = 0;
+        private_dirty = 0;
+        swapped_out = 0;
+
+        while (true) {
+            if (fgets(line, 1024, fp) == 0) {
+                done = true;
+                break;
+            }
+
+            if (line[0] == 'S' && sscanf(line, "Size: %d kB", &temp) == 1) {
+                /* size = temp; */
+            } else if (line[0] == 'R' && sscanf(line, "Rss: %d kB", &temp) == 1) {
+                /* resident = temp; */
+            } else if (line[0] == 'P' && sscanf(line, "Pss: %d kB", &temp) == 1) {
+                pss = temp;
+            } else if (line[0] == 'S' && sscanf(line, "Shared_Clean: %d kB", &temp) == 1) {
+                shared_clean = temp;
+            } else if (line[0] == 'S' && sscanf(line, "Shared_Dirty: %d kB", &temp) == 1) {
+                shared_dirty = temp;
+            } else if (line[0] == 'P' && sscanf(line, "Private_Clean: %d kB", &temp) == 1) {
+                private_clean = temp;
+            } else if (line[0] == 'P' && sscanf(line, "Private_Dirty: %d kB", &temp) == 1) {
+                private_dirty = temp;
+            } else if (line[0] == 'R' && sscanf(line, "Referenced: %d kB", &temp) == 1) {
+                /* referenced = temp; */
+            } else if (line[0] == 'S' && sscanf(line, "Swap: %d kB", &temp) == 1) {
+                swapped_out = temp;
+            } else if (sscanf(line, "%" SCNx64 "-%" SCNx64 " %*s %*x %*x:%*x %*d", &start, &end) == 2) {
+                // looks like a new mapping
+                // example: "10000000-10001000 ---p 10000000 00:00 0"
+                break;
+            }
+        }
+
+        if (!skip) {
+            if (is_swappable && (pss > 0)) {
+                sharing_proportion = 0.0;
+                if ((shared_clean > 0) || (shared_dirty > 0)) {
+                    sharing_proportion = (pss - private_clean
+                            - private_dirty)/(shared_clean+shared_dirty);
+                }
+                swappable_pss = (sharing_proportion*shared_clean) + private_clean;
+            } else
+                swappable_pss = 0;
+
+            stats[whichHeap].pss += pss;
+            stats[whichHeap].swappablePss += swappable_pss;
+            stats[whichHeap].privateDirty += private_dirty;
+            stats[whichHeap].sharedDirty += shared_dirty;
+            stats[whichHeap].privateClean += private_clean;
+            stats[whichHeap].sharedClean += shared_clean;
+            stats[whichHeap].swappedOut += swapped_out;
+            if (whichHeap == HEAP_DALVIK || whichHeap == HEAP_DALVIK_OTHER) {
+                stats[subHeap].pss += pss;
+                stats[subHeap].swappablePss += swappable_pss;
+                stats[subHeap].privateDirty += private_dirty;
+                stats[subHeap].sharedDirty += shared_dirty;
+                stats[subHeap].privateClean += private_clean;
+                stats[subHeap].sharedClean += shared_clean;
+                stats[subHeap].swappedOut += swapped_out;
+            }
+        }
+    }
+}
+
+// Process.getPss() and Debug.getPss() as they were.
+static void readPssOld(FILE* fp, pss_t* out) {
+    char line[1024];
+    out->pss = 0;
+    out->uss = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        int64_t v;
+        if (sscanf(line, "Pss: %" SCNd64 " kB", &v) == 1) {
+            out->pss += v;
+        } else if (strncmp(line, "Private_Clean:", 14) == 0
+                || strncmp(line, "Private_Dirty:", 14) == 0) {
+            char* c = line + 14;
+            while (*c != 0 && (*c < '0' || *c > '9')) {
+                c++;
+            }
+            out->uss += atoi(c);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    std::string dir;
+    int iterations = 20;
+    int threads = 4;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:i:t:")) >= 0) {
+        switch (res) {
+            case 'd': dir = optarg; break;
+            case 'i': iterations = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (dir.empty() || iterations < 1 || threads < 1) {
+        usage(me);
+    }
+
+    std::vector<std::string> files = captured(dir);
+    bool ok = true;
+    double oldMapsNs = 0, newMapsNs = 0, oldPssNs = 0, newPssNs = 0;
+    size_t bytes = 0;
+    for (const auto& file : files) {
+        std::string data;
+        readAll(file, &data);
+        bytes += data.size();
+
+        stats_t oldStats[_NUM_HEAP];
+        stats_t newStats[_NUM_HEAP];
+        pss_t oldPss, newPss;
+        for (int i = 0; i < iterations; i++) {
+            memset(oldStats, 0, sizeof(oldStats));
+            int64_t startNs = nowNs();
+            FILE* fp = fopen(file.c_str(), "r");
+            readMapinfoOld(fp, oldStats);
+            fclose(fp);
+            oldMapsNs += nowNs() - startNs;
+
+            startNs = nowNs();
+            fp = fopen(file.c_str(), "r");
+            readPssOld(fp, &oldPss);
+            fclose(fp);
+            oldPssNs += nowNs() - startNs;
+
+            // Read as the parser reads /proc, into its buffer
+            memset(newStats, 0, sizeof(newStats));
+            startNs = nowNs();
+            readAll(file, &data);
+            SmapsParser::parseMaps(data.data(), data.size(), newStats);
+            newMapsNs += nowNs() - startNs;
+
+            startNs = nowNs();
+            readAll(file, &data);
+            SmapsParser::parsePss(data.data(), data.size(), &newPss);
+            newPssNs += nowNs() - startNs;
+        }
+        if (memcmp(oldStats, newStats, sizeof(oldStats))) {
+            fprintf(stderr, "%s: heaps differ\n", file.c_str());
+            ok = false;
+        }
+        if (oldPss.pss != newPss.pss || oldPss.uss != newPss.uss) {
+            fprintf(stderr, "%s: pss %" PRId64 "/%" PRId64 " vs %" PRId64 "/%" PRId64 "\n",
+                    file.c_str(), oldPss.pss, oldPss.uss, newPss.pss, newPss.uss);
+            ok = false;
+        }
+    }
+    double reads = (double) iterations * files.size();
+    printf("%zu smaps files, %zu kB on average\n", files.size(),
+            files.empty() ? 0 : bytes / files.size() / 1024);
+    printf("  heaps: fgets %8.1f us, parser %8.1f us a file\n", oldMapsNs / 1E3 / reads,
+            newMapsNs / 1E3 / reads);
+    printf("  pss:   fgets %8.1f us, parser %8.1f us a file\n", oldPssNs / 1E3 / reads,
+            newPssNs / 1E3 / reads);
+
+    std::vector<pid_t> pids = listPids();
+    int64_t startNs = nowNs();
+    for (pid_t pid : pids) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+        FILE* fp = fopen(path, "r");
+        if (fp != NULL) {
+            pss_t pss;
+            readPssOld(fp, &pss);
+            fclose(fp);
+        }
+    }
+    double oldLiveMs = (nowNs() - startNs) / 1E6;
+    std::vector<pss_t> pss;
+    startNs = nowNs();
+    SmapsParser::readPss(pids, &pss, threads);
+    double batchMs = (nowNs() - startNs) / 1E6;
+    printf("  %zu live processes: fgets %8.1f ms, batch of %d threads %8.1f ms\n", pids.size(),
+            oldLiveMs, threads, batchMs);
+
+    // One process at a time, as Process.getPss() reads them: with a parser made for each,
+    // and with the shared one
+    startNs = nowNs();
+    for (pid_t pid : pids) {
+        SmapsParser parser;
+        pss_t one;
+        parser.readPss(pid, &one);
+    }
+    double freshMs = (nowNs() - startNs) / 1E6;
+    startNs = nowNs();
+    for (pid_t pid : pids) {
+        pss_t one;
+        SmapsParser::readPssShared(pid, &one);
+    }
+    double sharedMs = (nowNs() - startNs) / 1E6;
+    printf("  one at a time: new parser %8.1f ms, shared parser %8.1f ms\n", freshMs,
+            sharedMs);
+
+    printf("%s\n", ok ? "parsers agree" : "PARSERS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -136,6 +136,13 @@ public:
      */
     FileMap* createEntryFileMap(ZipEntryRO entry) const;
 
+    /*
+     * The archive's file descriptor, owned by this object. Only read it
+     * with pread() and the like, the iteration and uncompress calls above
+     * depend on its file offset.
+     */
+    int getFileDescriptor() const;
+
     /*
      * Uncompress the data into a buffer.  Depending on the compression
      * format, this is either an "inflate" operation or a memcpy.
@@ -110,16 +110,6 @@ void ClockRecoveryLoop::reset(bool position, bool frequency) {
     reset_l(position, frequency);
 }
 
-uint32_t ClockRecoveryLoop::findMinRTTNdx(DisciplineDataPoint* data,
-                                          uint32_t count) {
-    uint32_t min_rtt = 0;
-    for (uint32_t i = 1; i < count; ++i)
-        if (data[min_rtt].rtt > data[i].rtt)
-            min_rtt = i;
-
-    return min_rtt;
-}
-
 bool ClockRecoveryLoop::pushDisciplineEvent(int64_t local_time,
                                             int64_t nominal_common_time,
                                             int64_t rtt) {
@@ -140,21 +130,22 @@ bool ClockRecoveryLoop::pushDisciplineEvent(int64_t local_time,
     // from a particularly bad startup data point, we collect the first N data
     // points and choose the best of them before moving on.
     if (!common_clock_->isValid()) {
-        if (startup_filter_wr_ < kStartupFilterSize) {
-            DisciplineDataPoint& d =  startup_filter_data_[startup_filter_wr_];
+        if (!startup_filter_.full()) {
+            DisciplineDataPoint d;
             d.local_time = local_time;
+            d.observed_common_time = 0;
             d.nominal_common_time = nominal_common_time;
             d.rtt = rtt;
-            startup_filter_wr_++;
+            d.point_used = false;
+            startup_filter_.push(d);
         }
 
-        if (startup_filter_wr_ == kStartupFilterSize) {
-            uint32_t min_rtt = findMinRTTNdx(startup_filter_data_,
-                    kStartupFilterSize);
+        if (startup_filter_.full()) {
+            uint32_t min_rtt = startup_filter_.findMinRTTNdx();
 
             common_clock_->setBasis(
-                    startup_filter_data_[min_rtt].local_time,
-                    startup_filter_data_[min_rtt].nominal_common_time);
+                    startup_filter_[min_rtt].local_time,
+                    startup_filter_[min_rtt].nominal_common_time);
         }
 
         return true;
@@ -205,19 +196,14 @@ bool ClockRecoveryLoop::pushDisciplineEvent(int64_t local_time,
     //    component in the current PID controller.  Also use a much more narrow
     //    outlier-rejector filter (as described in #1) to drive a short term
     //    correction factor similar to the P component of the PID controller.
-    assert(filter_wr_ < kFilterSize);
-    filter_data_[filter_wr_].local_time           = local_time;
-    filter_data_[filter_wr_].observed_common_time = observed_common;
-    filter_data_[filter_wr_].nominal_common_time  = nominal_common_time;
-    filter_data_[filter_wr_].rtt                  = rtt;
-    filter_data_[filter_wr_].point_used           = false;
-    uint32_t current_point = filter_wr_;
-    filter_wr_ = (filter_wr_ + 1) % kFilterSize;
-    if (!filter_wr_)
-        filter_full_ = true;
-
-    uint32_t scan_end = filter_full_ ? kFilterSize : filter_wr_;
-    uint32_t min_rtt = findMinRTTNdx(filter_data_, scan_end);
+    DisciplineDataPoint point;
+    point.local_time           = local_time;
+    point.observed_common_time = observed_common;
+    point.nominal_common_time  = nominal_common_time;
+    point.rtt                  = rtt;
+    point.point_used           = false;
+    uint32_t current_point = filter_.push(point);
+    uint32_t min_rtt = filter_.findMinRTTNdx();
     // We only use packets with low RTTs for control. If the packet RTT
     // is less than the panic threshold, we can probably eat the jitter with the
     // control loop. Otherwise, take the packet only if it better than all
@@ -309,7 +295,7 @@ void ClockRecoveryLoop::reset_l(bool position, bool frequency) {
 
     if (position) {
         common_clock_->resetBasis();
-        startup_filter_wr_ = 0;
+        startup_filter_.reset();
     }
 
     if (frequency) {
@@ -322,8 +308,7 @@ void ClockRecoveryLoop::reset_l(bool position, bool frequency) {
         applySlew_l();
     }
 
-    filter_wr_   = 0;
-    filter_full_ = false;
+    filter_.reset();
 }
 
 void ClockRecoveryLoop::setTargetCorrection_l(int32_t tgt) {
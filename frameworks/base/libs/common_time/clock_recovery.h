@@ -91,7 +91,57 @@ class ClockRecoveryLoop {
         bool point_used;
     } DisciplineDataPoint;
 
-    static uint32_t findMinRTTNdx(DisciplineDataPoint* data, uint32_t count);
+    // The last N data points, the oldest overwritten first.  The RTTs are also
+    // kept in an array of their own, so the search for the best point is a
+    // loop over N int64_ts which the compiler can vectorize rather than a walk
+    // over the points themselves.
+    template <uint32_t N> class SampleRing {
+      public:
+        SampleRing() { reset(); }
+
+        void reset() {
+            wr_ = 0;
+            count_ = 0;
+        }
+
+        bool full() const { return count_ == N; }
+
+        // Returns the index the point was stored at.
+        uint32_t push(const DisciplineDataPoint& point) {
+            uint32_t ndx = wr_;
+            data_[ndx] = point;
+            rtt_[ndx] = point.rtt;
+            wr_ = (wr_ + 1) % N;
+            if (count_ < N)
+                count_++;
+            return ndx;
+        }
+
+        const DisciplineDataPoint& operator[](uint32_t ndx) const {
+            return data_[ndx];
+        }
+
+        // The index of the first stored point with the lowest RTT.
+        uint32_t findMinRTTNdx() const {
+            if (!count_)
+                return 0;
+
+            int64_t min_rtt = rtt_[0];
+            for (uint32_t i = 1; i < count_; ++i)
+                min_rtt = (rtt_[i] < min_rtt) ? rtt_[i] : min_rtt;
+
+            uint32_t ndx = 0;
+            while (rtt_[ndx] != min_rtt)
+                ++ndx;
+            return ndx;
+        }
+
+      private:
+        DisciplineDataPoint data_[N];
+        int64_t rtt_[N];
+        uint32_t wr_;
+        uint32_t count_;
+    };
 
     void reset_l(bool position, bool frequency);
     void setTargetCorrection_l(int32_t tgt);
@@ -131,13 +181,10 @@ class ClockRecoveryLoop {
 
     // State kept for filtering the discipline data.
     static const uint32_t kFilterSize = 16;
-    DisciplineDataPoint filter_data_[kFilterSize];
-    uint32_t filter_wr_;
-    bool filter_full_;
+    SampleRing<kFilterSize> filter_;
 
     static const uint32_t kStartupFilterSize = 4;
-    DisciplineDataPoint startup_filter_data_[kStartupFilterSize];
-    uint32_t startup_filter_wr_;
+    SampleRing<kStartupFilterSize> startup_filter_;
 
     // Minimum number of milliseconds over which we allow a full range change
     // (from rail to rail) of the VCXO control signal.  This is the rate
@@ -29,7 +29,7 @@
 
 namespace android {
 
-CommonClock::CommonClock() {
+CommonClock::CommonClock() : seq_(0) {
     cur_slew_        = 0;
     cur_trans_valid_ = false;
 
@@ -38,6 +38,43 @@ CommonClock::CommonClock() {
     cur_trans_.a_to_b_numer = local_to_common_freq_numer_ = 1;
     cur_trans_.a_to_b_denom = local_to_common_freq_denom_ = 1;
     duration_trans_ = cur_trans_;
+    publish_l();
+}
+
+void CommonClock::publish_l() {
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    published_a_zero_.store(cur_trans_.a_zero, std::memory_order_relaxed);
+    published_b_zero_.store(cur_trans_.b_zero, std::memory_order_relaxed);
+    published_numer_.store(cur_trans_.a_to_b_numer, std::memory_order_relaxed);
+    published_denom_.store(cur_trans_.a_to_b_denom, std::memory_order_relaxed);
+    published_valid_.store(cur_trans_valid_, std::memory_order_relaxed);
+
+    seq_.store(seq + 2, std::memory_order_release);
+}
+
+bool CommonClock::readTransform(LinearTransform* trans) const {
+    uint32_t seq;
+    bool valid;
+
+    do {
+        seq = seq_.load(std::memory_order_acquire);
+        while (seq & 1)
+            seq = seq_.load(std::memory_order_acquire);
+
+        trans->a_zero = published_a_zero_.load(std::memory_order_relaxed);
+        trans->b_zero = published_b_zero_.load(std::memory_order_relaxed);
+        trans->a_to_b_numer = published_numer_.load(std::memory_order_relaxed);
+        trans->a_to_b_denom = published_denom_.load(std::memory_order_relaxed);
+        valid = published_valid_.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (seq_.load(std::memory_order_relaxed) != seq);
+
+    return valid;
 }
 
 bool CommonClock::init(uint64_t local_freq) {
@@ -61,29 +98,30 @@ bool CommonClock::init(uint64_t local_freq) {
     cur_trans_.a_to_b_denom = local_to_common_freq_denom_ =
         static_cast<uint32_t>(denom);
     duration_trans_ = cur_trans_;
+    publish_l();
 
     return true;
 }
 
 status_t CommonClock::localToCommon(int64_t local, int64_t *common_out) const {
-    Mutex::Autolock lock(&lock_);
+    LinearTransform trans;
 
-    if (!cur_trans_valid_)
+    if (!readTransform(&trans))
         return INVALID_OPERATION;
 
-    if (!cur_trans_.doForwardTransform(local, common_out))
+    if (!trans.doForwardTransform(local, common_out))
         return INVALID_OPERATION;
 
     return OK;
 }
 
 status_t CommonClock::commonToLocal(int64_t common, int64_t *local_out) const {
-    Mutex::Autolock lock(&lock_);
+    LinearTransform trans;
 
-    if (!cur_trans_valid_)
+    if (!readTransform(&trans))
         return INVALID_OPERATION;
 
-    if (!cur_trans_.doReverseTransform(common, local_out))
+    if (!trans.doReverseTransform(common, local_out))
         return INVALID_OPERATION;
 
     return OK;
@@ -101,6 +139,7 @@ void CommonClock::setBasis(int64_t local, int64_t common) {
     cur_trans_.a_zero = local;
     cur_trans_.b_zero = common;
     cur_trans_valid_ = true;
+    publish_l();
 }
 
 void CommonClock::resetBasis() {
@@ -109,6 +148,7 @@ void CommonClock::resetBasis() {
     cur_trans_.a_zero = 0;
     cur_trans_.b_zero = 0;
     cur_trans_valid_ = false;
+    publish_l();
 }
 
 status_t CommonClock::setSlew(int64_t change_time, int32_t ppm) {
@@ -144,6 +184,7 @@ status_t CommonClock::setSlew(int64_t change_time, int32_t ppm) {
     cur_trans_.b_zero = new_common_basis;
     cur_trans_.a_to_b_numer = n1 * n2;
     cur_trans_.a_to_b_denom = d1 * d2;
+    publish_l();
 
     return OK;
 }
@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <atomic>
+
 #include <utils/Errors.h>
 #include <utils/LinearTransform.h>
 #include <utils/threads.h>
@@ -35,12 +37,28 @@ class CommonClock {
     status_t  commonToLocal(int64_t common, int64_t *local_out) const;
     int64_t   localDurationToCommonDuration(int64_t localDur) const;
     uint64_t  getCommonFreq() const { return kCommonFreq; }
-    bool      isValid() const { return cur_trans_valid_; }
+    bool      isValid() const {
+        return published_valid_.load(std::memory_order_relaxed);
+    }
     status_t  setSlew(int64_t change_time, int32_t ppm);
     void      setBasis(int64_t local, int64_t common);
     void      resetBasis();
   private:
+    // Copies cur_trans_ to where localToCommon and commonToLocal read it.
+    void publish_l();
+    bool readTransform(LinearTransform* trans) const;
+
+    // Serializes the writers.  Readers do not take it: they read the published
+    // copy of the transform under a sequence count instead, which is odd while
+    // publish_l is writing it, and retry if it changed under them.  Media
+    // playback asks for common time far more often than it changes.
     mutable Mutex lock_;
+    std::atomic<uint32_t> seq_;
+    std::atomic<int64_t>  published_a_zero_;
+    std::atomic<int64_t>  published_b_zero_;
+    std::atomic<int32_t>  published_numer_;
+    std::atomic<uint32_t> published_denom_;
+    std::atomic<bool>     published_valid_;
 
     int32_t  cur_slew_;
     uint32_t local_to_common_freq_numer_;
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define __STDC_LIMIT_MACROS
+
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <common_time/local_clock.h>
+#include <hardware/local_time_hal.h>
+#include <utils/LinearTransform.h>
+#include <utils/threads.h>
+
+#include "clock_recovery.h"
+#include "common_clock.h"
+
+// Runs ClockRecoveryLoop against a simulated master, without a network: the
+// local time HAL is faked here, running off a clock that drifts from the
+// master's, and sync responses are made up with RTTs drawn from a base delay,
+// exponential jitter on each leg and the odd spike.  Responses go through the
+// same discard and panic handling as in CommonTimeServer::handleSyncResponse.
+// Reports how long the loop took to bring the error in, how much of the time
+// it stayed in after that and how large it got.
+//
+// Then times localToCommon() on several threads while another sets the slew
+// over and over, against the same transform behind a mutex as CommonClock had.
+//
+// The fake HAL has no set_local_slew, so the loop steers the CommonClock
+// transform as it does on devices without a VCXO.
+
+// Run it like this:
+//
+// clock_recovery_sim -d 80 -r 2000 -j 500 -p 5 -n 900 -e 1000 -t 4
+
+using namespace android;
+
+static const uint64_t kLocalFreq = 1000000;
+static const int64_t kPanicThresholdUsec = 50000;
+static const int64_t kRTTDiscardPanicThreshMultiplier = 5;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-d <ppm>] [-r <usec>] [-j <usec>] [-p <percent>] [-n <sec>]"
+            " [-e <usec>] [-t <threads>] [-q <sec>]\n", me);
+    fprintf(stderr, "       -d drift of the local clock from the master in ppm, default 80\n");
+    fprintf(stderr, "       -r base round trip time in usec, default 2000\n");
+    fprintf(stderr, "       -j mean jitter on each leg in usec, default 500\n");
+    fprintf(stderr, "       -p percentage of responses delayed by up to 40 msec, default 5\n");
+    fprintf(stderr, "       -n seconds of sync to simulate, default 900\n");
+    fprintf(stderr, "       -e error in usec to count as converged, default 1000\n");
+    fprintf(stderr, "       -t threads reading common time, default 4\n");
+    fprintf(stderr, "       -q seconds to read common time for, default 1\n");
+    exit(1);
+}
+
+// The simulated local clock, in usec at kLocalFreq.
+static std::atomic<int64_t> gLocalTime(0);
+
+static int64_t simGetLocalTime(struct local_time_hw_device*) {
+    return gLocalTime.load(std::memory_order_relaxed);
+}
+
+static uint64_t simGetLocalFreq(struct local_time_hw_device*) {
+    return kLocalFreq;
+}
+
+static int simClose(struct hw_device_t*) {
+    return 0;
+}
+
+static int simOpen(const struct hw_module_t* module, const char*, struct hw_device_t** device) {
+    static struct local_time_hw_device dev;
+    memset(&dev, 0, sizeof(dev));
+    dev.common.tag = HARDWARE_DEVICE_TAG;
+    dev.common.module = const_cast<struct hw_module_t*>(module);
+    dev.common.close = simClose;
+    dev.get_local_time = simGetLocalTime;
+    dev.get_local_freq = simGetLocalFreq;
+    *device = &dev.common;
+    return 0;
+}
+
+static struct hw_module_methods_t gSimMethods = { simOpen };
+
+// What LocalClock finds in place of libhardware.
+extern "C" int hw_get_module_by_class(const char*, const char*,
+                                      const struct hw_module_t** module) {
+    static struct hw_module_t mod;
+    mod.tag = HARDWARE_MODULE_TAG;
+    mod.id = LOCAL_TIME_HARDWARE_MODULE_ID;
+    mod.name = "clock_recovery_sim";
+    mod.methods = &gSimMethods;
+    *module = &mod;
+    return 0;
+}
+
+// The master's timeline, and a local clock running ppm fast against it.
+class SimTimeline {
+  public:
+    SimTimeline(double drift_ppm, int64_t master_offset)
+            : master_offset_(master_offset), rate_(1.0 + drift_ppm / 1e6),
+              true_time_(0), local_time_(1000000000.0) { advance(0); }
+
+    void advance(double usec) {
+        true_time_ += usec;
+        local_time_ += usec * rate_;
+        gLocalTime.store(static_cast<int64_t>(local_time_), std::memory_order_relaxed);
+    }
+
+    int64_t masterCommonTime() const {
+        return static_cast<int64_t>(true_time_) + master_offset_;
+    }
+
+    int64_t localTime() const { return static_cast<int64_t>(local_time_); }
+    double seconds() const { return true_time_ / 1e6; }
+
+  private:
+    int64_t master_offset_;
+    double rate_;
+    double true_time_;
+    double local_time_;
+};
+
+static double jitter(unsigned* seed, double mean) {
+    double u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);
+    return -mean * log(u);
+}
+
+struct SimResult {
+    double converged_sec;       // first within the error, -1 if never
+    double within_percent;      // of the seconds after that
+    double max_error_usec;      // after converging
+    double rms_error_usec;
+    int used;
+    int discarded;
+    int panics;
+};
+
+static SimResult simulate(double drift_ppm, double rtt_usec, double jitter_usec,
+        int spike_percent, int seconds, int64_t converged_usec) {
+    SimTimeline timeline(drift_ppm, 123456789);
+    LocalClock local_clock;
+    CommonClock common_clock;
+    common_clock.init(local_clock.getLocalFreq());
+    ClockRecoveryLoop loop(&local_clock, &common_clock);
+
+    SimResult result;
+    memset(&result, 0, sizeof(result));
+    result.converged_sec = -1;
+
+    unsigned seed = 1;
+    double sum_sq = 0;
+    int samples = 0;
+    int within = 0;
+    bool first_response = true;
+    for (int i = 0; i < seconds; i++) {
+        // The master answers at the midpoint of its receive and send.
+        double out_leg = rtt_usec / 2 + jitter(&seed, jitter_usec);
+        double back_leg = rtt_usec / 2 + jitter(&seed, jitter_usec);
+        if (rand_r(&seed) % 100 < spike_percent)
+            ((rand_r(&seed) & 1) ? out_leg : back_leg) += rand_r(&seed) % 40000;
+
+        int64_t client_tx_local = timeline.localTime();
+        timeline.advance(out_leg);
+        int64_t master_common = timeline.masterCommonTime();
+        timeline.advance(back_leg);
+        int64_t client_rx_local = timeline.localTime();
+
+        int64_t rtt = client_rx_local - client_tx_local;
+        int64_t avg_local = (client_tx_local + client_rx_local) >> 1;
+        int64_t rtt_common = common_clock.localDurationToCommonDuration(rtt);
+
+        if (first_response) {
+            // As the server does, on account of ARP.
+            first_response = false;
+        } else if (rtt_common > kPanicThresholdUsec * kRTTDiscardPanicThreshMultiplier) {
+            result.discarded++;
+        } else if (loop.pushDisciplineEvent(avg_local, master_common, rtt_common)) {
+            result.used++;
+        } else {
+            result.panics++;
+            loop.reset(true, true);
+            first_response = true;
+        }
+
+        timeline.advance(1000000 - out_leg - back_leg);
+
+        int64_t common;
+        if (OK != common_clock.localToCommon(timeline.localTime(), &common))
+            continue;
+        double error = fabs(static_cast<double>(common - timeline.masterCommonTime()));
+        if ((result.converged_sec < 0) && (error > converged_usec))
+            continue;
+
+        if (result.converged_sec < 0)
+            result.converged_sec = timeline.seconds();
+        sum_sq += error * error;
+        samples++;
+        if (error <= converged_usec)
+            within++;
+        if (error > result.max_error_usec)
+            result.max_error_usec = error;
+    }
+
+    if (samples > 0) {
+        result.within_percent = 100.0 * within / samples;
+        result.rms_error_usec = sqrt(sum_sq / samples);
+    }
+    return result;
+}
+
+// The transform as CommonClock kept it before, with readers behind its lock.
+class LockedClock {
+  public:
+    LockedClock() : valid_(true) {
+        trans_.a_zero = 0;
+        trans_.b_zero = 0;
+        trans_.a_to_b_numer = 1;
+        trans_.a_to_b_denom = 1;
+    }
+
+    status_t localToCommon(int64_t local, int64_t *common_out) const {
+        Mutex::Autolock lock(&lock_);
+        if (!valid_)
+            return INVALID_OPERATION;
+        if (!trans_.doForwardTransform(local, common_out))
+            return INVALID_OPERATION;
+        return OK;
+    }
+
+    status_t setSlew(int64_t change_time, int32_t ppm) {
+        Mutex::Autolock lock(&lock_);
+        int64_t common;
+        if (!trans_.doForwardTransform(change_time, &common))
+            return INVALID_OPERATION;
+        trans_.a_zero = change_time;
+        trans_.b_zero = common;
+        trans_.a_to_b_numer = 1000000 + ppm;
+        trans_.a_to_b_denom = 1000000;
+        return OK;
+    }
+
+  private:
+    mutable Mutex lock_;
+    LinearTransform trans_;
+    bool valid_;
+};
+
+// The writer flips between these slews with the basis at zero, so every read
+// of the transform must give common time for kQueryLocal at one rate or the
+// other; a read with the numerator of one and the denominator of the other
+// would be far off.
+static const int32_t kQuerySlewPpm = 40;
+static const int64_t kQueryLocal = 1000000000;
+static const int64_t kQueryCommon[2] = {
+    kQueryLocal, kQueryLocal + kQueryLocal / 1000000 * kQuerySlewPpm
+};
+
+template <typename Clock>
+struct QueryArgs {
+    Clock* clock;
+    std::atomic<bool>* stop;
+    uint64_t queries;
+    bool consistent;
+};
+
+template <typename Clock>
+static void* queryThread(void* cookie) {
+    QueryArgs<Clock>* args = static_cast<QueryArgs<Clock>*>(cookie);
+    uint64_t queries = 0;
+    while (!args->stop->load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 1024; i++) {
+            int64_t common;
+            if ((OK != args->clock->localToCommon(kQueryLocal, &common)) ||
+                ((common != kQueryCommon[0]) && (common != kQueryCommon[1])))
+                args->consistent = false;
+        }
+        queries += 1024;
+    }
+    args->queries = queries;
+    return NULL;
+}
+
+template <typename Clock>
+static double measureQueries(Clock* clock, int threads, double seconds, bool* consistent) {
+    std::atomic<bool> stop(false);
+    QueryArgs<Clock> args[threads];
+    pthread_t tids[threads];
+    for (int i = 0; i < threads; i++) {
+        args[i].clock = clock;
+        args[i].stop = &stop;
+        args[i].queries = 0;
+        args[i].consistent = true;
+        pthread_create(&tids[i], NULL, queryThread<Clock>, &args[i]);
+    }
+
+    // Slews as fast as it can, far more often than the loop ever would.
+    int64_t start = nowNs();
+    int64_t end = start + static_cast<int64_t>(seconds * 1e9);
+    for (int i = 0; nowNs() < end; i++)
+        clock->setSlew(0, (i & 1) ? kQuerySlewPpm : 0);
+    stop = true;
+
+    uint64_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        total += args[i].queries;
+        *consistent = *consistent && args[i].consistent;
+    }
+    return total / ((nowNs() - start) / 1e9);
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    double drift_ppm = 80;
+    double rtt_usec = 2000;
+    double jitter_usec = 500;
+    int spike_percent = 5;
+    int seconds = 900;
+    int64_t converged_usec = 1000;
+    int threads = 4;
+    double query_seconds = 1;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:r:j:p:n:e:t:q:")) >= 0) {
+        switch (res) {
+            case 'd': drift_ppm = atof(optarg); break;
+            case 'r': rtt_usec = atof(optarg); break;
+            case 'j': jitter_usec = atof(optarg); break;
+            case 'p': spike_percent = atoi(optarg); break;
+            case 'n': seconds = atoi(optarg); break;
+            case 'e': converged_usec = atoll(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'q': query_seconds = atof(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (seconds < 1 || converged_usec < 1 || threads < 1 || query_seconds <= 0 || rtt_usec < 0 || jitter_usec < 0)
+        usage(me);
+
+    printf("%d sec of sync, drift %.1f ppm, rtt %.0f usec + 2 x %.0f usec jitter,"
+           " %d%% spikes\n", seconds, drift_ppm, rtt_usec, jitter_usec, spike_percent);
+    int64_t start = nowNs();
+    SimResult result = simulate(drift_ppm, rtt_usec, jitter_usec, spike_percent, seconds,
+            converged_usec);
+    double sim_ms = (nowNs() - start) / 1e6;
+    if (result.converged_sec < 0) {
+        printf("  never within %" PRId64 " usec\n", converged_usec);
+    } else {
+        printf("  within %" PRId64 " usec after %.0f sec, then %.1f%% of the time,"
+               " max %.0f usec, rms %.1f usec\n", converged_usec, result.converged_sec,
+               result.within_percent, result.max_error_usec, result.rms_error_usec);
+    }
+    printf("  %d responses used, %d discarded, %d panics, simulated in %.1f ms\n",
+           result.used, result.discarded, result.panics, sim_ms);
+
+    printf("localToCommon on %d threads, slewing all the while\n", threads);
+    bool consistent = true;
+    LockedClock locked;
+    double locked_qps = measureQueries(&locked, threads, query_seconds, &consistent);
+    CommonClock common;
+    common.init(kLocalFreq);
+    common.setBasis(0, 0);
+    double seqlock_qps = measureQueries(&common, threads, query_seconds, &consistent);
+    printf("  mutex   %8.2f M/s\n", locked_qps / 1e6);
+    printf("  seqlock %8.2f M/s\n", seqlock_qps / 1e6);
+
+    printf("%s\n", consistent ? "reads consistent" : "READS INCONSISTENT");
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "BinaryCapture.h"
+#include "BinaryTrace.h"
+
+namespace android {
+
+static const char* k_tracingPath = "/sys/kernel/debug/tracing";
+
+// How long the reader sleeps once the buffers are empty.
+static const nsecs_t kReadIntervalNs = 100000000;
+
+// Pages read and not written yet, past which more are dropped rather than
+// held for a writer that can't keep up.
+static const size_t kMaxQueuedPages = 4096;
+
+// The debugfs files don't know their size, so they're read to the end.
+static bool readFile(const char* path, std::string* contents) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    contents->clear();
+    char buf[4096];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)))) > 0) {
+        contents->append(buf, n);
+    }
+    close(fd);
+    return n == 0;
+}
+
+BinaryCapture::BinaryCapture(int fd, bool compress)
+    : mFd(fd),
+      mCompress(compress),
+      mOut(NULL),
+      mPageSize(sysconf(_SC_PAGESIZE)),
+      mStarted(false),
+      mStopping(false),
+      mDone(false),
+      mFailed(false),
+      mPagesWritten(0),
+      mPagesDropped(0) {
+    memset(&mLayout, 0, sizeof(mLayout));
+}
+
+BinaryCapture::~BinaryCapture() {
+    if (mStarted) {
+        stop();
+    }
+    if (mOut != NULL) {
+        gzclose(mOut);
+    }
+    for (size_t i = 0; i < mCpuFds.size(); i++) {
+        close(mCpuFds[i]);
+    }
+    for (size_t i = 0; i < mQueue.size(); i++) {
+        free(mQueue[i].data);
+    }
+    for (size_t i = 0; i < mFree.size(); i++) {
+        free(mFree[i]);
+    }
+}
+
+bool BinaryCapture::start() {
+    char path[PATH_MAX];
+    std::string headerPage;
+    snprintf(path, sizeof(path), "%s/events/header_page", k_tracingPath);
+    if (!readFile(path, &headerPage) || !parseHeaderPage(headerPage.c_str(), &mLayout)) {
+        fprintf(stderr, "error reading %s: %s (%d)\n", path, strerror(errno), errno);
+        return false;
+    }
+
+    for (int cpu = 0; ; cpu++) {
+        snprintf(path, sizeof(path), "%s/per_cpu/cpu%d/trace_pipe_raw", k_tracingPath, cpu);
+        int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) {
+            if (errno == ENOENT && cpu > 0) {
+                break;
+            }
+            fprintf(stderr, "error opening %s: %s (%d)\n", path, strerror(errno), errno);
+            return false;
+        }
+        mCpuFds.push_back(fd);
+    }
+
+    int fd = dup(mFd);
+    mOut = fd != -1 ? gzdopen(fd, mCompress ? "wb" : "wbT") : NULL;
+    if (mOut == NULL) {
+        fprintf(stderr, "error opening binary trace output\n");
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+
+    BinaryTraceHeader header;
+    memcpy(header.magic, kBinaryTraceMagic, sizeof(kBinaryTraceMagic));
+    header.pageSize = mPageSize;
+    header.cpus = mCpuFds.size();
+    bool ok = gzwrite(mOut, &header, sizeof(header)) == sizeof(header);
+    ok = ok && writeChunk(BINARY_CHUNK_HEADER_PAGE, 0, headerPage.data(), headerPage.size());
+    ok = ok && writeEventFormats();
+    if (!ok) {
+        fprintf(stderr, "error writing binary trace header\n");
+        return false;
+    }
+
+    if (pthread_create(&mWriter, NULL, writeThread, this) != 0) {
+        fprintf(stderr, "error starting the binary trace writer\n");
+        return false;
+    }
+    if (pthread_create(&mReader, NULL, readThread, this) != 0) {
+        fprintf(stderr, "error starting the binary trace reader\n");
+        mLock.lock();
+        mDone = true;
+        mCond.broadcast();
+        mLock.unlock();
+        pthread_join(mWriter, NULL);
+        return false;
+    }
+    mStarted = true;
+    return true;
+}
+
+bool BinaryCapture::stop() {
+    if (!mStarted) {
+        return false;
+    }
+    mStarted = false;
+
+    mLock.lock();
+    mStopping = true;
+    mCond.broadcast();
+    mLock.unlock();
+    pthread_join(mReader, NULL);
+    pthread_join(mWriter, NULL);
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/saved_cmdlines", k_tracingPath);
+    writeFile(BINARY_CHUNK_CMDLINES, path);
+
+    int result = gzclose(mOut);
+    mOut = NULL;
+    if (result != Z_OK) {
+        fprintf(stderr, "error finishing binary trace: %d\n", result);
+        mFailed = true;
+    }
+    return !mFailed;
+}
+
+void* BinaryCapture::readThread(void* arg) {
+    BinaryCapture* capture = static_cast<BinaryCapture*>(arg);
+    for (;;) {
+        bool read = capture->readPages();
+        Mutex::Autolock _l(capture->mLock);
+        if (capture->mStopping) {
+            break;
+        }
+        if (!read) {
+            capture->mCond.waitRelative(capture->mLock, kReadIntervalNs);
+        }
+    }
+
+    // Tracing is off by now, so this gets the rest.
+    while (capture->readPages()) {
+    }
+
+    Mutex::Autolock _l(capture->mLock);
+    capture->mDone = true;
+    capture->mCond.broadcast();
+    return NULL;
+}
+
+void* BinaryCapture::writeThread(void* arg) {
+    BinaryCapture* capture = static_cast<BinaryCapture*>(arg);
+    Mutex::Autolock _l(capture->mLock);
+    for (;;) {
+        while (capture->mQueue.empty() && !capture->mDone) {
+            capture->mCond.wait(capture->mLock);
+        }
+        if (capture->mQueue.empty()) {
+            break;
+        }
+        Page page = capture->mQueue.front();
+        capture->mQueue.pop_front();
+
+        capture->mLock.unlock();
+        bool ok = capture->writeChunk(BINARY_CHUNK_PAGE, page.cpu, page.data, page.length);
+        capture->mLock.lock();
+
+        if (!ok && !capture->mFailed) {
+            fprintf(stderr, "error writing binary trace\n");
+            capture->mFailed = true;
+        }
+        capture->mFree.push_back(page.data);
+        capture->mPagesWritten++;
+    }
+    return NULL;
+}
+
+bool BinaryCapture::readPages() {
+    bool read = false;
+    for (size_t cpu = 0; cpu < mCpuFds.size(); cpu++) {
+        for (;;) {
+            uint8_t* data = NULL;
+            mLock.lock();
+            if (!mFree.empty()) {
+                data = mFree.back();
+                mFree.pop_back();
+            }
+            mLock.unlock();
+            if (data == NULL) {
+                data = static_cast<uint8_t*>(malloc(mPageSize));
+                if (data == NULL) {
+                    return read;
+                }
+            }
+
+            ssize_t n = TEMP_FAILURE_RETRY(::read(mCpuFds[cpu], data, mPageSize));
+            if (n < static_cast<ssize_t>(mLayout.dataOffset)) {
+                if (n < 0 && errno != EAGAIN) {
+                    fprintf(stderr, "error reading cpu%zu: %s (%d)\n", cpu, strerror(errno),
+                            errno);
+                }
+                Mutex::Autolock _l(mLock);
+                mFree.push_back(data);
+                break;
+            }
+
+            // Only the committed part of a page is worth keeping.
+            Page page;
+            page.cpu = cpu;
+            page.data = data;
+            page.length = mLayout.dataOffset + mLayout.dataLength(data);
+            if (page.length > static_cast<size_t>(n)) {
+                page.length = n;
+            }
+
+            Mutex::Autolock _l(mLock);
+            read = true;
+            if (mQueue.size() >= kMaxQueuedPages) {
+                // Still read, so that the kernel's buffers don't wrap over what's queued.
+                mFree.push_back(data);
+                mPagesDropped++;
+                continue;
+            }
+            mQueue.push_back(page);
+            mCond.broadcast();
+        }
+    }
+    return read;
+}
+
+bool BinaryCapture::writeChunk(uint32_t type, uint32_t cpu, const void* data, uint32_t length) {
+    BinaryTraceChunk chunk;
+    chunk.type = type;
+    chunk.cpu = cpu;
+    chunk.length = length;
+    if (gzwrite(mOut, &chunk, sizeof(chunk)) != sizeof(chunk)) {
+        return false;
+    }
+    return length == 0 || gzwrite(mOut, data, length) == static_cast<int>(length);
+}
+
+bool BinaryCapture::writeFile(uint32_t type, const char* path) {
+    std::string contents;
+    if (!readFile(path, &contents)) {
+        fprintf(stderr, "error reading %s: %s (%d)\n", path, strerror(errno), errno);
+        return false;
+    }
+    return writeChunk(type, 0, contents.data(), contents.size());
+}
+
+// The formats of the events that are enabled, and of the one trace_marker writes.
+bool BinaryCapture::writeEventFormats() {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/events", k_tracingPath);
+    DIR* events = opendir(path);
+    if (events == NULL) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", path, strerror(errno), errno);
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* system;
+    while (ok && (system = readdir(events)) != NULL) {
+        if (system->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/events/%s", k_tracingPath, system->d_name);
+        DIR* dir = opendir(path);
+        if (dir == NULL) {
+            continue;
+        }
+        struct dirent* event;
+        while (ok && (event = readdir(dir)) != NULL) {
+            if (event->d_name[0] == '.') {
+                continue;
+            }
+            bool wanted = !strcmp(system->d_name, "ftrace") && !strcmp(event->d_name, "print");
+            if (!wanted) {
+                std::string enable;
+                snprintf(path, sizeof(path), "%s/events/%s/%s/enable", k_tracingPath,
+                        system->d_name, event->d_name);
+                wanted = readFile(path, &enable) && !enable.empty() && enable[0] == '1';
+            }
+            if (wanted) {
+                snprintf(path, sizeof(path), "%s/events/%s/%s/format", k_tracingPath,
+                        system->d_name, event->d_name);
+                ok = writeFile(BINARY_CHUNK_EVENT_FORMAT, path);
+            }
+        }
+        closedir(dir);
+    }
+    closedir(events);
+    return ok;
+}
+
+} // namespace android
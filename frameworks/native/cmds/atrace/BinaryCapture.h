@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ATRACE_BINARY_CAPTURE_H
+#define ANDROID_ATRACE_BINARY_CAPTURE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include <deque>
+#include <vector>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+#include "BinaryTraceConverter.h"
+
+namespace android {
+
+/*
+ * Captures the kernel's ring buffers as they are, a page at a time from each
+ * CPU's trace_pipe_raw, rather than have the kernel format every event as
+ * text.  One thread reads the pages while tracing runs, which also keeps the
+ * buffers from wrapping, and another writes them out, gzipped if asked for,
+ * so that reading never waits on deflate.
+ */
+class BinaryCapture {
+public:
+    BinaryCapture(int fd, bool compress);
+    ~BinaryCapture();
+
+    // Writes the header and event formats and starts reading the buffers.
+    bool start();
+
+    // Reads what's left once tracing is stopped and finishes the file.
+    bool stop();
+
+    size_t pagesWritten() const { return mPagesWritten; }
+
+    // Pages read while the writer was too far behind, which are not in the file.
+    size_t pagesDropped() const { return mPagesDropped; }
+
+private:
+    struct Page {
+        uint32_t cpu;
+        uint32_t length;
+        uint8_t* data;
+    };
+
+    static void* readThread(void* arg);
+    static void* writeThread(void* arg);
+
+    // Reads every page there is; returns false if there were none.
+    bool readPages();
+    bool writeChunk(uint32_t type, uint32_t cpu, const void* data, uint32_t length);
+    bool writeFile(uint32_t type, const char* path);
+    bool writeEventFormats();
+
+    int mFd;
+    bool mCompress;
+    gzFile mOut;
+    uint32_t mPageSize;
+    TracePageLayout mLayout;
+    std::vector<int> mCpuFds;
+    pthread_t mReader;
+    pthread_t mWriter;
+    bool mStarted;
+
+    Mutex mLock;
+    Condition mCond;
+    std::deque<Page> mQueue;        // read, to be written, up to kMaxQueuedPages
+    std::vector<uint8_t*> mFree;    // written, to be read into again
+    bool mStopping;
+    bool mDone;
+    bool mFailed;
+    size_t mPagesWritten;
+    size_t mPagesDropped;
+};
+
+} // namespace android
+
+#endif // ANDROID_ATRACE_BINARY_CAPTURE_H
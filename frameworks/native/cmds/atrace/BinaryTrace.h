@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ATRACE_BINARY_TRACE_H
+#define ANDROID_ATRACE_BINARY_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/BinaryMarker.h>
+
+namespace android {
+
+/*
+ * A binary capture is a header followed by chunks, all little endian, and is
+ * gzipped as a whole when it was captured with -z (gzread() reads it either
+ * way).  The pages
+ * are the kernel's ring buffer pages as trace_pipe_raw gives them; the header
+ * page and event format chunks are the kernel's descriptions of them, so that
+ * they can be turned back into text off the device.
+ */
+static const char kBinaryTraceMagic[8] = { 'A', 'T', 'R', 'A', 'C', 'E', 'B', '1' };
+
+struct BinaryTraceHeader {
+    char magic[8];
+    uint32_t pageSize;
+    uint32_t cpus;
+};
+
+enum {
+    BINARY_CHUNK_HEADER_PAGE = 1,   // events/header_page
+    BINARY_CHUNK_EVENT_FORMAT = 2,  // events/<system>/<event>/format
+    BINARY_CHUNK_CMDLINES = 3,      // saved_cmdlines
+    BINARY_CHUNK_PAGE = 4,          // a page of one CPU's ring buffer
+};
+
+struct BinaryTraceChunk {
+    uint32_t type;
+    uint32_t cpu;
+    uint32_t length;    // of what follows
+};
+
+// BinaryMarker's batches, which are found in print events, are laid out in
+// <utils/BinaryMarker.h>; these read and write their varints.
+static inline size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+// Returns the bytes read, or 0 if the varint runs past end.
+static inline size_t getVarint(const uint8_t* in, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (size_t n = 0; in + n < end && n < 10; n++) {
+        result |= static_cast<uint64_t>(in[n] & 0x7f) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            *value = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+} // namespace android
+
+#endif // ANDROID_ATRACE_BINARY_TRACE_H
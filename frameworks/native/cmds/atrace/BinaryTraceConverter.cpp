@@ -0,0 +1,583 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+
+#include "BinaryTrace.h"
+#include "BinaryTraceConverter.h"
+
+namespace android {
+
+// The kernel's struct ring_buffer_event types.
+enum {
+    RINGBUF_TYPE_DATA_TYPE_LEN_MAX = 28,
+    RINGBUF_TYPE_PADDING = 29,
+    RINGBUF_TYPE_TIME_EXTEND = 30,
+    RINGBUF_TYPE_TIME_STAMP = 31,
+};
+
+// The kernel's struct trace_entry, which every event starts with.
+enum {
+    TRACE_ENTRY_FLAGS = 2,
+    TRACE_ENTRY_PREEMPT_COUNT = 3,
+    TRACE_ENTRY_PID = 4,
+    TRACE_ENTRY_SIZE = 8,
+};
+
+enum {
+    TRACE_FLAG_IRQS_OFF = 0x01,
+    TRACE_FLAG_IRQS_NOSUPPORT = 0x02,
+    TRACE_FLAG_NEED_RESCHED = 0x04,
+    TRACE_FLAG_HARDIRQ = 0x08,
+    TRACE_FLAG_SOFTIRQ = 0x10,
+};
+
+// The commit count's flags for events lost before the page.
+static const uint32_t kMissedEventsMask = (1u << 31) | (1u << 30);
+
+static const uint64_t NANOS_PER_SEC = 1000000000;
+
+template <typename T>
+static T load(const uint8_t* p) {
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static const char* skipSpace(const char* p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+// Parses a "field:<declaration>;\toffset:N;\tsize:N;\tsigned:N;" line.
+static bool parseField(const char* line, const char* lineEnd, TraceField* field) {
+    const char* decl = skipSpace(line + strlen("field:"));
+    const char* semicolon = static_cast<const char*>(memchr(decl, ';', lineEnd - decl));
+    if (semicolon == NULL) {
+        return false;
+    }
+    std::string declaration(decl, semicolon);
+
+    // The name is the last word, less any array size.
+    size_t nameEnd = declaration.size();
+    size_t bracket = declaration.rfind('[');
+    size_t space = declaration.rfind(' ');
+    if (space == std::string::npos) {
+        return false;
+    }
+    if (bracket != std::string::npos && bracket > space) {
+        nameEnd = bracket;
+    }
+    field->name = declaration.substr(space + 1, nameEnd - space - 1);
+    field->isDataLoc = declaration.compare(0, 10, "__data_loc") == 0;
+    field->isString = declaration.find("char") != std::string::npos &&
+            declaration.find('[') != std::string::npos;
+
+    std::string rest(semicolon, lineEnd);
+    const char* offset = strstr(rest.c_str(), "offset:");
+    const char* size = strstr(rest.c_str(), "size:");
+    const char* isSigned = strstr(rest.c_str(), "signed:");
+    if (offset == NULL || size == NULL) {
+        return false;
+    }
+    field->offset = strtoul(offset + strlen("offset:"), NULL, 10);
+    field->size = strtoul(size + strlen("size:"), NULL, 10);
+    field->isSigned = isSigned != NULL && atoi(isSigned + strlen("signed:")) != 0;
+    return true;
+}
+
+const TraceField* TraceEventFormat::field(const char* fieldName) const {
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (fields[i].name == fieldName) {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+bool parseEventFormat(const char* text, uint32_t* id, TraceEventFormat* format) {
+    bool haveId = false;
+    format->name.clear();
+    format->fields.clear();
+    for (const char* line = text; *line != '\0'; ) {
+        const char* lineEnd = strchr(line, '\n');
+        if (lineEnd == NULL) {
+            lineEnd = line + strlen(line);
+        }
+        const char* p = skipSpace(line);
+        if (strncmp(p, "name: ", 6) == 0) {
+            format->name.assign(p + 6, lineEnd);
+        } else if (strncmp(p, "ID: ", 4) == 0) {
+            *id = strtoul(p + 4, NULL, 10);
+            haveId = true;
+        } else if (strncmp(p, "field:", 6) == 0) {
+            TraceField field;
+            if (parseField(p, lineEnd, &field)) {
+                format->fields.push_back(field);
+            }
+        }
+        line = *lineEnd != '\0' ? lineEnd + 1 : lineEnd;
+    }
+    return haveId && !format->name.empty();
+}
+
+bool parseHeaderPage(const char* text, TracePageLayout* layout) {
+    TraceEventFormat format;
+    uint32_t id = 0;
+    parseEventFormat(text, &id, &format);
+    const TraceField* timestamp = format.field("timestamp");
+    const TraceField* commit = format.field("commit");
+    const TraceField* data = format.field("data");
+    if (timestamp == NULL || commit == NULL || data == NULL ||
+            (commit->size != 4 && commit->size != 8)) {
+        return false;
+    }
+    layout->timestampOffset = timestamp->offset;
+    layout->commitOffset = commit->offset;
+    layout->commitSize = commit->size;
+    layout->dataOffset = data->offset;
+    return true;
+}
+
+uint32_t TracePageLayout::dataLength(const uint8_t* page) const {
+    // Little endian, so the low half of a 64 bit count comes first.
+    return load<uint32_t>(page + commitOffset) & ~kMissedEventsMask;
+}
+
+BinaryTraceConverter::BinaryTraceConverter()
+    : mCpus(0),
+      mPrintType(UINT32_MAX),
+      mPrintBufOffset(0) {
+    memset(&mLayout, 0, sizeof(mLayout));
+}
+
+bool BinaryTraceConverter::read(const char* path) {
+    gzFile in = gzopen(path, "rb");
+    if (in == NULL) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", path, strerror(errno), errno);
+        return false;
+    }
+
+    BinaryTraceHeader header;
+    if (gzread(in, &header, sizeof(header)) != sizeof(header) ||
+            memcmp(header.magic, kBinaryTraceMagic, sizeof(kBinaryTraceMagic)) != 0) {
+        fprintf(stderr, "error: %s is not a binary trace\n", path);
+        gzclose(in);
+        return false;
+    }
+    mCpus = header.cpus;
+
+    struct Page {
+        uint32_t cpu;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Page> pages;
+    bool haveLayout = false;
+    BinaryTraceChunk chunk;
+    int result;
+    while ((result = gzread(in, &chunk, sizeof(chunk))) == sizeof(chunk)) {
+        std::vector<uint8_t> data(chunk.length + 1);
+        if (gzread(in, &data[0], chunk.length) != static_cast<int>(chunk.length)) {
+            result = -1;
+            break;
+        }
+        data[chunk.length] = '\0';
+        const char* text = reinterpret_cast<const char*>(&data[0]);
+
+        if (chunk.type == BINARY_CHUNK_HEADER_PAGE) {
+            haveLayout = parseHeaderPage(text, &mLayout);
+        } else if (chunk.type == BINARY_CHUNK_EVENT_FORMAT) {
+            uint32_t id;
+            TraceEventFormat format;
+            if (parseEventFormat(text, &id, &format)) {
+                const TraceField* buf = format.field("buf");
+                if (format.name == "print" && buf != NULL) {
+                    mPrintType = id;
+                    mPrintBufOffset = buf->offset;
+                }
+                mFormats[id] = format;
+            }
+        } else if (chunk.type == BINARY_CHUNK_CMDLINES) {
+            for (const char* line = text; *line != '\0'; ) {
+                int pid;
+                char comm[64];
+                if (sscanf(line, "%d %63s", &pid, comm) == 2) {
+                    mCmdlines[pid] = comm;
+                }
+                const char* lineEnd = strchr(line, '\n');
+                line = lineEnd != NULL ? lineEnd + 1 : line + strlen(line);
+            }
+        } else if (chunk.type == BINARY_CHUNK_PAGE) {
+            data.resize(chunk.length);
+            pages.push_back(Page());
+            pages.back().cpu = chunk.cpu;
+            pages.back().data.swap(data);
+        }
+    }
+    if (result != 0) {
+        fprintf(stderr, "warning: %s is truncated\n", path);
+    }
+    gzclose(in);
+
+    if (!haveLayout) {
+        fprintf(stderr, "error: %s has no page header\n", path);
+        return false;
+    }
+
+    mPages.resize(pages.size());
+    for (size_t i = 0; i < pages.size(); i++) {
+        mPages[i].swap(pages[i].data);
+        if (!mPages[i].empty()) {
+            addPage(pages[i].cpu, &mPages[i][0], mPages[i].size());
+        }
+    }
+
+    // Each CPU's events are in order already; the markers from binary batches may not be.
+    std::stable_sort(mEvents.begin(), mEvents.end(),
+            [](const Event& a, const Event& b) { return a.timestamp < b.timestamp; });
+    return true;
+}
+
+void BinaryTraceConverter::addPage(uint32_t cpu, const uint8_t* page, uint32_t length) {
+    if (length < mLayout.dataOffset) {
+        return;
+    }
+    uint64_t timestamp = load<uint64_t>(page + mLayout.timestampOffset);
+    const uint8_t* p = page + mLayout.dataOffset;
+    const uint8_t* end = p + std::min(mLayout.dataLength(page), length - mLayout.dataOffset);
+
+    while (end - p >= 4) {
+        uint32_t header = load<uint32_t>(p);
+        uint32_t typeLen = header & 0x1f;
+        uint32_t timeDelta = header >> 5;
+        size_t eventLength;
+
+        if (typeLen == RINGBUF_TYPE_PADDING) {
+            if (timeDelta == 0 || end - p < 8) {
+                // The rest of the page is padding.
+                break;
+            }
+            // A discarded event.
+            eventLength = 4 + load<uint32_t>(p + 4);
+        } else if (typeLen == RINGBUF_TYPE_TIME_EXTEND) {
+            if (end - p < 8) {
+                break;
+            }
+            timestamp += (static_cast<uint64_t>(load<uint32_t>(p + 4)) << 27) | timeDelta;
+            eventLength = 8;
+        } else if (typeLen == RINGBUF_TYPE_TIME_STAMP) {
+            eventLength = 16;
+        } else if (typeLen == 0) {
+            if (end - p < 8) {
+                break;
+            }
+            uint32_t dataLength = load<uint32_t>(p + 4);
+            if (dataLength < 4 || dataLength > static_cast<size_t>(end - p) - 4) {
+                break;
+            }
+            timestamp += timeDelta;
+            addEvent(cpu, timestamp, p + 8, dataLength - 4);
+            eventLength = 4 + dataLength;
+        } else {
+            uint32_t dataLength = typeLen * 4;
+            if (dataLength > static_cast<size_t>(end - p) - 4) {
+                break;
+            }
+            timestamp += timeDelta;
+            addEvent(cpu, timestamp, p + 4, dataLength);
+            eventLength = 4 + dataLength;
+        }
+
+        if (eventLength > static_cast<size_t>(end - p)) {
+            break;
+        }
+        p += eventLength;
+    }
+}
+
+void BinaryTraceConverter::addEvent(uint32_t cpu, uint64_t timestamp, const uint8_t* data,
+        uint32_t length) {
+    if (length < TRACE_ENTRY_SIZE) {
+        return;
+    }
+    if (load<uint16_t>(data) == mPrintType &&
+            length >= mPrintBufOffset + sizeof(BinaryMarkerBatch) &&
+            memcmp(data + mPrintBufOffset, kBinaryMarkerMagic, sizeof(kBinaryMarkerMagic)) == 0) {
+        addMarkers(cpu, timestamp, data, data + mPrintBufOffset, length - mPrintBufOffset);
+        return;
+    }
+
+    Event event;
+    memset(&event, 0, sizeof(event));
+    event.timestamp = timestamp;
+    event.data = data;
+    event.length = length;
+    event.cpu = cpu;
+    mEvents.push_back(event);
+}
+
+void BinaryTraceConverter::addMarkers(uint32_t cpu, uint64_t timestamp, const uint8_t* data,
+        const uint8_t* buf, uint32_t length) {
+    BinaryMarkerBatch batch;
+    memcpy(&batch, buf, sizeof(batch));
+    const uint8_t* p = buf + sizeof(batch);
+    const uint8_t* end = p + std::min<uint32_t>(batch.length, length - sizeof(batch));
+
+    // The kernel timestamped the write, which came flushNs - ns after each marker.
+    int64_t ns = batch.baseNs;
+    for (uint32_t i = 0; i < batch.count && p < end; i++) {
+        Event event;
+        memset(&event, 0, sizeof(event));
+        event.markerType = *p++;
+
+        uint64_t delta;
+        size_t n = getVarint(p, end, &delta);
+        if (n == 0) {
+            break;
+        }
+        p += n;
+        ns += delta;
+
+        if (event.markerType != BINARY_MARKER_END) {
+            if (p >= end || *p > end - p - 1) {
+                break;
+            }
+            event.nameLength = *p++;
+            event.name = p;
+            p += event.nameLength;
+        }
+        if (event.markerType == BINARY_MARKER_INT) {
+            uint64_t zigzag;
+            n = getVarint(p, end, &zigzag);
+            if (n == 0) {
+                break;
+            }
+            p += n;
+            event.value = static_cast<int32_t>((zigzag >> 1) ^ -(zigzag & 1));
+        }
+
+        uint64_t age = batch.flushNs > ns ? batch.flushNs - ns : 0;
+        event.timestamp = timestamp > age ? timestamp - age : 0;
+        event.data = data;
+        event.length = TRACE_ENTRY_SIZE;
+        event.cpu = cpu;
+        event.tgid = batch.tgid;
+        event.tid = batch.tid;
+        mEvents.push_back(event);
+    }
+}
+
+static std::string stringField(const TraceField& field, const uint8_t* data, uint32_t length) {
+    uint32_t offset = field.offset;
+    uint32_t size = field.size;
+    if (field.isDataLoc) {
+        if (field.offset + 4 > length) {
+            return std::string();
+        }
+        uint32_t loc = load<uint32_t>(data + field.offset);
+        offset = loc & 0xffff;
+        size = loc >> 16;
+    } else if (size == 0) {
+        // A char buf[] to the end of the event.
+        size = length > offset ? length - offset : 0;
+    }
+    if (offset >= length) {
+        return std::string();
+    }
+    size = std::min(size, length - offset);
+    const char* s = reinterpret_cast<const char*>(data + offset);
+    return std::string(s, strnlen(s, size));
+}
+
+static int64_t numberField(const TraceField& field, const uint8_t* data, uint32_t length) {
+    if (field.offset + field.size > length) {
+        return 0;
+    }
+    const uint8_t* p = data + field.offset;
+    switch (field.size) {
+        case 1: return field.isSigned ? load<int8_t>(p) : load<uint8_t>(p);
+        case 2: return field.isSigned ? load<int16_t>(p) : load<uint16_t>(p);
+        case 4: return field.isSigned ? load<int32_t>(p) : load<uint32_t>(p);
+        case 8: return load<int64_t>(p);
+        default: return 0;
+    }
+}
+
+// What the kernel prints for a sched_switch prev_state, from include/trace/events/sched.h.
+static std::string taskState(int64_t state) {
+    static const char kStates[] = "SDTtZXxKWP";
+    static const int64_t TASK_STATE_MAX = 1024;
+
+    std::string s;
+    for (int i = 0; kStates[i] != '\0'; i++) {
+        if (state & (TASK_STATE_MAX - 1) & (1 << i)) {
+            if (!s.empty()) {
+                s += '|';
+            }
+            s += kStates[i];
+        }
+    }
+    if (s.empty()) {
+        s = "R";
+    }
+    if (state & TASK_STATE_MAX) {
+        s += '+';
+    }
+    return s;
+}
+
+void BinaryTraceConverter::writeFields(FILE* out, const TraceEventFormat& format,
+        const uint8_t* data, uint32_t length) {
+    // Systrace parses the scheduler events, so they print as the kernel's formats have them.
+    if (format.name == "sched_switch" && format.field("next_prio") != NULL) {
+        fprintf(out, "prev_comm=%s prev_pid=%" PRId64 " prev_prio=%" PRId64 " prev_state=%s"
+                " ==> next_comm=%s next_pid=%" PRId64 " next_prio=%" PRId64 "\n",
+                stringField(*format.field("prev_comm"), data, length).c_str(),
+                numberField(*format.field("prev_pid"), data, length),
+                numberField(*format.field("prev_prio"), data, length),
+                taskState(numberField(*format.field("prev_state"), data, length)).c_str(),
+                stringField(*format.field("next_comm"), data, length).c_str(),
+                numberField(*format.field("next_pid"), data, length),
+                numberField(*format.field("next_prio"), data, length));
+        return;
+    }
+    if ((format.name == "sched_wakeup" || format.name == "sched_wakeup_new") &&
+            format.field("target_cpu") != NULL) {
+        fprintf(out, "comm=%s pid=%" PRId64 " prio=%" PRId64 " success=%" PRId64
+                " target_cpu=%03" PRId64 "\n",
+                stringField(*format.field("comm"), data, length).c_str(),
+                numberField(*format.field("pid"), data, length),
+                numberField(*format.field("prio"), data, length),
+                numberField(*format.field("success"), data, length),
+                numberField(*format.field("target_cpu"), data, length));
+        return;
+    }
+
+    const char* separator = "";
+    for (size_t i = 0; i < format.fields.size(); i++) {
+        const TraceField& field = format.fields[i];
+        if (field.name.compare(0, 7, "common_") == 0) {
+            continue;
+        }
+        if (field.isString) {
+            fprintf(out, "%s%s=%s", separator, field.name.c_str(),
+                    stringField(field, data, length).c_str());
+        } else if (field.isSigned) {
+            fprintf(out, "%s%s=%" PRId64, separator, field.name.c_str(),
+                    numberField(field, data, length));
+        } else {
+            fprintf(out, "%s%s=%" PRIu64, separator, field.name.c_str(),
+                    static_cast<uint64_t>(numberField(field, data, length)));
+        }
+        separator = " ";
+    }
+    fputc('\n', out);
+}
+
+void BinaryTraceConverter::writeEvent(FILE* out, const Event& event) {
+    const uint8_t* data = event.data;
+    uint8_t flags = data[TRACE_ENTRY_FLAGS];
+    uint8_t preemptCount = data[TRACE_ENTRY_PREEMPT_COUNT];
+    // A batch is often written by BinaryMarker's flush thread; its markers are the recorder's.
+    int32_t pid = event.markerType != 0 ? event.tid : load<int32_t>(data + TRACE_ENTRY_PID);
+
+    const char* comm = "<...>";
+    if (pid == 0) {
+        comm = "<idle>";
+    } else {
+        std::map<int32_t, std::string>::const_iterator it = mCmdlines.find(pid);
+        if (it != mCmdlines.end()) {
+            comm = it->second.c_str();
+        }
+    }
+
+    char tgid[16] = "-----";
+    if (event.markerType != 0) {
+        snprintf(tgid, sizeof(tgid), "%5d", event.tgid);
+    }
+
+    bool hardirq = flags & TRACE_FLAG_HARDIRQ;
+    bool softirq = flags & TRACE_FLAG_SOFTIRQ;
+    fprintf(out, "%16s-%-5d (%5s) [%03u] %c%c%c%c %5" PRIu64 ".%06" PRIu64 ": ",
+            comm, pid, tgid, event.cpu,
+            (flags & TRACE_FLAG_IRQS_OFF) ? 'd' :
+                    (flags & TRACE_FLAG_IRQS_NOSUPPORT) ? 'X' : '.',
+            (flags & TRACE_FLAG_NEED_RESCHED) ? 'N' : '.',
+            (hardirq && softirq) ? 'H' : hardirq ? 'h' : softirq ? 's' : '.',
+            preemptCount ? '0' + std::min<int>(preemptCount, 9) : '.',
+            event.timestamp / NANOS_PER_SEC, event.timestamp % NANOS_PER_SEC / 1000);
+
+    switch (event.markerType) {
+        case BINARY_MARKER_BEGIN:
+            fprintf(out, "tracing_mark_write: B|%d|%.*s\n", event.tgid, event.nameLength,
+                    event.name);
+            return;
+        case BINARY_MARKER_END:
+            fprintf(out, "tracing_mark_write: E\n");
+            return;
+        case BINARY_MARKER_INT:
+            fprintf(out, "tracing_mark_write: C|%d|%.*s|%d\n", event.tgid, event.nameLength,
+                    event.name, event.value);
+            return;
+    }
+
+    uint16_t type = load<uint16_t>(data);
+    std::map<uint32_t, TraceEventFormat>::const_iterator it = mFormats.find(type);
+    if (it == mFormats.end()) {
+        fprintf(out, "unknown event %u\n", type);
+        return;
+    }
+    if (type == mPrintType) {
+        // The marker as it was written, with the newline the kernel adds if it had none.
+        std::string buf = stringField(*it->second.field("buf"), data, event.length);
+        fputs("tracing_mark_write: ", out);
+        fputs(buf.c_str(), out);
+        if (buf.empty() || buf[buf.size() - 1] != '\n') {
+            fputc('\n', out);
+        }
+        return;
+    }
+    fprintf(out, "%s: ", it->second.name.c_str());
+    writeFields(out, it->second, data, event.length);
+}
+
+void BinaryTraceConverter::write(FILE* out) {
+    fprintf(out, "# tracer: nop\n"
+            "#\n"
+            "# entries-in-buffer/entries-written: %zu/%zu   #P:%u\n"
+            "#\n"
+            "#                                      _-----=> irqs-off\n"
+            "#                                     / _----=> need-resched\n"
+            "#                                    | / _---=> hardirq/softirq\n"
+            "#                                    || / _--=> preempt-depth\n"
+            "#                                    ||| /     delay\n"
+            "#           TASK-PID    TGID   CPU#  ||||    TIMESTAMP  FUNCTION\n"
+            "#              | |        |      |   ||||       |         |\n",
+            mEvents.size(), mEvents.size(), mCpus);
+    for (size_t i = 0; i < mEvents.size(); i++) {
+        writeEvent(out, mEvents[i]);
+    }
+}
+
+} // namespace android
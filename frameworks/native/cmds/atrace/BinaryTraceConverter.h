@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ATRACE_BINARY_TRACE_CONVERTER_H
+#define ANDROID_ATRACE_BINARY_TRACE_CONVERTER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace android {
+
+struct TraceField {
+    std::string name;
+    uint32_t offset;
+    uint32_t size;
+    bool isSigned;
+    bool isString;      // a char array, or a __data_loc char[]
+    bool isDataLoc;
+};
+
+struct TraceEventFormat {
+    std::string name;
+    std::vector<TraceField> fields;
+
+    const TraceField* field(const char* name) const;
+};
+
+// Where the timestamp, the commit count and the events are in a page.
+struct TracePageLayout {
+    uint32_t timestampOffset;
+    uint32_t commitOffset;
+    uint32_t commitSize;
+    uint32_t dataOffset;
+
+    // The length of the events in page, from the commit count.
+    uint32_t dataLength(const uint8_t* page) const;
+};
+
+// Parses the text of an events/.../format file.
+bool parseEventFormat(const char* text, uint32_t* id, TraceEventFormat* format);
+
+// Parses the text of events/header_page.
+bool parseHeaderPage(const char* text, TracePageLayout* layout);
+
+/*
+ * Turns a binary capture back into the text the kernel's trace file would
+ * have given, with the binary markers in it expanded into the lines that
+ * atrace_begin() and friends write.
+ */
+class BinaryTraceConverter {
+public:
+    BinaryTraceConverter();
+
+    // Reads the capture in path, returning false if it isn't one.
+    bool read(const char* path);
+
+    void write(FILE* out);
+
+private:
+    struct Event {
+        uint64_t timestamp;
+        const uint8_t* data;    // from common_type on
+        uint32_t length;
+        uint16_t cpu;
+        uint8_t markerType;     // set for a marker from a binary batch
+        uint8_t nameLength;
+        const uint8_t* name;
+        int32_t tgid;
+        int32_t tid;
+        int32_t value;
+    };
+
+    void addPage(uint32_t cpu, const uint8_t* page, uint32_t length);
+    void addEvent(uint32_t cpu, uint64_t timestamp, const uint8_t* data, uint32_t length);
+    void addMarkers(uint32_t cpu, uint64_t timestamp, const uint8_t* data, const uint8_t* buf,
+            uint32_t length);
+    void writeEvent(FILE* out, const Event& event);
+    void writeFields(FILE* out, const TraceEventFormat& format, const uint8_t* data,
+            uint32_t length);
+
+    uint32_t mCpus;
+    TracePageLayout mLayout;
+    std::map<uint32_t, TraceEventFormat> mFormats;
+    uint32_t mPrintType;
+    uint32_t mPrintBufOffset;
+    std::map<int32_t, std::string> mCmdlines;
+    std::vector<std::vector<uint8_t> > mPages;
+    std::vector<Event> mEvents;
+};
+
+} // namespace android
+
+#endif // ANDROID_ATRACE_BINARY_TRACE_CONVERTER_H
@@ -34,10 +34,14 @@
 
 #include <cutils/properties.h>
 
+#include <utils/BinaryMarker.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
 #include <utils/Trace.h>
 
+#include "BinaryCapture.h"
+#include "BinaryTraceConverter.h"
+
 using namespace android;
 
 #define NELEM(x) ((int) (sizeof(x) / sizeof((x)[0])))
@@ -151,6 +155,7 @@ static bool g_nohup = false;
 static int g_initialSleepSecs = 0;
 static const char* g_kernelTraceFuncs = NULL;
 static const char* g_debugAppCmdLine = "";
+static const char* g_binaryTracePath = NULL;
 
 /* Global state */
 static bool g_traceAborted = false;
@@ -486,6 +491,30 @@ static bool setAppCmdlineProperty(const char* cmdline)
     return true;
 }
 
+// Set the system property that tells BinaryMarker to batch markers for a
+// binary capture rather than write them as text.
+static bool setBinaryCaptureProperty(bool capturing)
+{
+    if (property_set(kBinaryCaptureProperty, capturing ? "1" : "0") < 0) {
+        fprintf(stderr, "error setting binary capture system property\n");
+        return false;
+    }
+    return true;
+}
+
+// Have BinaryMarker write out what it has batched while tracing is still on.
+// Processes look the property up again within one batch age, and write out
+// their batches within another, or two if one was being recorded into.
+static void drainBinaryMarkers()
+{
+    setBinaryCaptureProperty(false);
+    struct timespec timeLeft;
+    timeLeft.tv_sec = 0;
+    timeLeft.tv_nsec = 3 * kBinaryMarkerMaxBatchAgeNs;
+    while (nanosleep(&timeLeft, &timeLeft) == -1 && errno == EINTR) {
+    }
+}
+
 // Disable all /sys/ enable files.
 static bool disableKernelTraceEvents() {
     bool ok = true;
@@ -644,6 +673,9 @@ static void cleanUpTrace()
     // Reset the system properties.
     setTagsProperty(0);
     setAppCmdlineProperty("");
+    if (g_binaryTracePath != NULL) {
+        setBinaryCaptureProperty(false);
+    }
     pokeBinderServices();
 
     // Set the options back to their defaults.
@@ -831,6 +863,9 @@ static void showHelp(const char *cmd)
                     "  -s N            sleep for N seconds before tracing [default 0]\n"
                     "  -t N            trace for N seconds [defualt 5]\n"
                     "  -z              compress the trace dump\n"
+                    "  --binary file   capture the raw trace buffers into file rather\n"
+                    "                    than dump the trace as text\n"
+                    "  --convert file  print a binary trace as text\n"
                     "  --async_start   start circular trace and return immediatly\n"
                     "  --async_dump    dump the current contents of circular trace buffer\n"
                     "  --async_stop    stop tracing and dump the current contents of circular\n"
@@ -860,6 +895,8 @@ int main(int argc, char **argv)
             {"async_stop",      no_argument, 0,  0 },
             {"async_dump",      no_argument, 0,  0 },
             {"list_categories", no_argument, 0,  0 },
+            {"binary",    required_argument, 0,  0 },
+            {"convert",   required_argument, 0,  0 },
             {           0,                0, 0,  0 }
         };
 
@@ -925,6 +962,15 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
+                } else if (!strcmp(long_options[option_index].name, "binary")) {
+                    g_binaryTracePath = optarg;
+                } else if (!strcmp(long_options[option_index].name, "convert")) {
+                    BinaryTraceConverter converter;
+                    if (!converter.read(optarg)) {
+                        exit(1);
+                    }
+                    converter.write(stdout);
+                    exit(0);
                 }
             break;
 
@@ -936,12 +982,18 @@ int main(int argc, char **argv)
         }
     }
 
+    if (async && g_binaryTracePath != NULL) {
+        fprintf(stderr, "error: --binary can't be used with the async options\n");
+        exit(1);
+    }
+
     registerSigHandler();
 
     if (g_initialSleepSecs > 0) {
         sleep(g_initialSleepSecs);
     }
 
+    BinaryCapture* binaryCapture = NULL;
     bool ok = true;
     ok &= setUpTrace();
     ok &= startTrace();
@@ -957,6 +1009,19 @@ int main(int argc, char **argv)
         // another.
         ok = clearTrace();
 
+        if (ok && g_binaryTracePath != NULL) {
+            int fd = open(g_binaryTracePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd == -1) {
+                fprintf(stderr, "error opening %s: %s (%d)\n", g_binaryTracePath,
+                        strerror(errno), errno);
+                ok = false;
+            } else {
+                binaryCapture = new BinaryCapture(fd, g_compress);
+                ok = binaryCapture->start() && setBinaryCaptureProperty(true);
+                close(fd);
+            }
+        }
+
         writeClockSyncMarker();
         if (ok && !async) {
             // Sleep to allow the trace to be captured.
@@ -972,11 +1037,25 @@ int main(int argc, char **argv)
     }
 
     // Stop the trace and restore the default settings.
+    if (binaryCapture != NULL)
+        drainBinaryMarkers();
     if (traceStop)
         stopTrace();
 
     if (ok && traceDump) {
-        if (!g_traceAborted) {
+        if (binaryCapture != NULL) {
+            // The pages went out as they were read; this gets the rest.
+            if (binaryCapture->stop()) {
+                printf(" done\nwrote %zu pages to %s\n", binaryCapture->pagesWritten(),
+                        g_binaryTracePath);
+                if (binaryCapture->pagesDropped() > 0) {
+                    fprintf(stderr, "dropped %zu pages: writing the trace fell behind\n",
+                            binaryCapture->pagesDropped());
+                }
+            } else {
+                fprintf(stderr, "error writing %s\n", g_binaryTracePath);
+            }
+        } else if (!g_traceAborted) {
             printf(" done\nTRACE:\n");
             fflush(stdout);
             dumpTrace();
@@ -989,6 +1068,8 @@ int main(int argc, char **argv)
         fprintf(stderr, "unable to start tracing\n");
     }
 
+    delete binaryCapture;
+
     // Reset the trace buffer size to 1.
     if (traceStop)
         cleanUpTrace();
@@ -0,0 +1,524 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cutils/trace.h>
+
+#include <utils/BinaryMarker.h>
+
+#include "../BinaryTrace.h"
+#include "../BinaryTraceConverter.h"
+
+// Times a workload of nested sections and counters marked the way
+// atrace_begin(), atrace_end() and atrace_int() do it, a formatted write() to
+// trace_marker each, against the same markers through BinaryMarker.
+//
+// Then sizes a capture of each, recorded on several threads: both runs are
+// laid out in ring buffer pages as the kernel would have them for
+// trace_pipe_raw, written out as binary captures, plain and gzipped, and
+// converted back to text, and the text is checked to have the same markers on
+// each thread either way.  The threads wait for BinaryMarker's flush thread to
+// write their last batches before they exit.
+//
+// The marker writes go to -m, /dev/null by default; point it at trace_marker
+// to include the kernel's side of them.
+
+// Run it like this:
+//
+// binary_trace_bench -n 1000000 -d /data/local/tmp
+
+using namespace android;
+
+static const uint64_t kTag = ATRACE_TAG_ALWAYS;
+static const uint32_t kPrintType = 5;
+static const uint32_t kPageSize = 4096;
+static const uint32_t kPageDataOffset = 16;
+static const int kCaptureThreads = 4;
+
+static const char* kHeaderPage =
+        "\tfield: u64 timestamp;\toffset:0;\tsize:8;\tsigned:0;\n"
+        "\tfield: local_t commit;\toffset:8;\tsize:8;\tsigned:1;\n"
+        "\tfield: int overwrite;\toffset:8;\tsize:1;\tsigned:1;\n"
+        "\tfield: char data;\toffset:16;\tsize:4080;\tsigned:1;\n";
+
+static const char* kPrintFormat =
+        "name: print\n"
+        "ID: 5\n"
+        "format:\n"
+        "\tfield:unsigned short common_type;\toffset:0;\tsize:2;\tsigned:0;\n"
+        "\tfield:unsigned char common_flags;\toffset:2;\tsize:1;\tsigned:0;\n"
+        "\tfield:unsigned char common_preempt_count;\toffset:3;\tsize:1;\tsigned:0;\n"
+        "\tfield:int common_pid;\toffset:4;\tsize:4;\tsigned:1;\n"
+        "\n"
+        "\tfield:unsigned long ip;\toffset:8;\tsize:8;\tsigned:0;\n"
+        "\tfield:char buf[];\toffset:16;\tsize:0;\tsigned:1;\n"
+        "\n"
+        "print fmt: \"%ps: %s\", (void *)REC->ip, REC->buf\n";
+
+static const char* kNames[] = {
+    "Choreographer#doFrame", "traversal", "measure", "layout", "draw",
+    "RV OnBindView", "inflate", "obtainView",
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n <markers>] [-m <marker file>] [-d <dir>]\n", me);
+    fprintf(stderr, "       -n markers to time, default 1000000\n");
+    fprintf(stderr, "       -m file to write markers to, default /dev/null\n");
+    fprintf(stderr, "       -d directory for the captures, default /data/local/tmp\n");
+    exit(1);
+}
+
+// As atrace_begin() and friends write them.
+struct TextMarkers {
+    int fd;
+    std::vector<std::pair<int64_t, std::string> >* captured;
+
+    void write(const char* buf, size_t len) {
+        if (captured != NULL) {
+            captured->push_back(std::make_pair(nowNs(), std::string(buf, len)));
+        }
+        ::write(fd, buf, len);
+    }
+
+    void begin(const char* name) {
+        if (CC_UNLIKELY(atrace_is_tag_enabled(kTag))) {
+            char buf[1024];
+            size_t len = snprintf(buf, sizeof(buf), "B|%d|%s", getpid(), name);
+            write(buf, len);
+        }
+    }
+
+    void end() {
+        if (CC_UNLIKELY(atrace_is_tag_enabled(kTag))) {
+            write("E", 1);
+        }
+    }
+
+    void setInt(const char* name, int32_t value) {
+        if (CC_UNLIKELY(atrace_is_tag_enabled(kTag))) {
+            char buf[1024];
+            size_t len = snprintf(buf, sizeof(buf), "C|%d|%s|%" PRId32, getpid(), name, value);
+            write(buf, len);
+        }
+    }
+};
+
+struct BinaryMarkers {
+    void begin(const char* name) { BinaryMarker::begin(kTag, name); }
+    void end() { BinaryMarker::end(kTag); }
+    void setInt(const char* name, int32_t value) { BinaryMarker::setInt(kTag, name, value); }
+};
+
+// A frame's worth of sections, and a counter now and then; returns the markers made.
+template <typename Markers>
+static size_t workload(Markers& markers, size_t count) {
+    size_t made = 0;
+    for (size_t i = 0; made < count; i++) {
+        markers.begin(kNames[0]);
+        markers.begin(kNames[1]);
+        markers.begin(kNames[2 + i % 2]);
+        markers.end();
+        markers.begin(kNames[4 + i % 4]);
+        markers.end();
+        markers.end();
+        markers.end();
+        made += 8;
+        if (i % 4 == 0) {
+            markers.setInt("queued", i % 7);
+            made++;
+        }
+    }
+    return made;
+}
+
+// Lays out print events in pages as the kernel's ring buffer has them.
+class PageWriter {
+public:
+    PageWriter() : mUsed(0), mLastTs(0) {}
+
+    void add(uint64_t ts, int32_t pid, const uint8_t* buf, size_t length) {
+        // struct print_entry, with the newline trace_marker adds and the nul.
+        std::vector<uint8_t> payload(16 + length + 2, 0);
+        uint16_t type = kPrintType;
+        memcpy(&payload[0], &type, sizeof(type));
+        memcpy(&payload[4], &pid, sizeof(pid));
+        memcpy(&payload[16], buf, length);
+        size_t end = 16 + length;
+        if (length == 0 || buf[length - 1] != '\n') {
+            payload[end++] = '\n';
+        }
+        payload.resize(end + 1);
+
+        uint32_t aligned = (payload.size() + 3) & ~3;
+        uint32_t eventSize = (aligned <= 28 * 4 ? 4 : 8) + aligned;
+        if (mUsed == 0) {
+            startPage(ts);
+        }
+        uint64_t delta = ts - mLastTs;
+        bool extend = delta >= (1 << 27);
+        if (mUsed + eventSize + (extend ? 8 : 0) > kPageSize) {
+            finishPage();
+            startPage(ts);
+            delta = 0;
+            extend = false;
+        }
+
+        if (extend) {
+            put32(30 | static_cast<uint32_t>(delta & ((1 << 27) - 1)) << 5);
+            put32(delta >> 27);
+            delta = 0;
+        }
+        if (aligned <= 28 * 4) {
+            put32(aligned / 4 | static_cast<uint32_t>(delta) << 5);
+        } else {
+            put32(static_cast<uint32_t>(delta) << 5);
+            put32(aligned + 4);
+        }
+        memcpy(&mPage[mUsed], &payload[0], payload.size());
+        mUsed += aligned;
+        mLastTs = ts;
+    }
+
+    const std::vector<std::vector<uint8_t> >& finish() {
+        if (mUsed > 0) {
+            finishPage();
+        }
+        return mPages;
+    }
+
+private:
+    void put32(uint32_t value) {
+        memcpy(&mPage[mUsed], &value, sizeof(value));
+        mUsed += sizeof(value);
+    }
+
+    void startPage(uint64_t ts) {
+        mPage.assign(kPageSize, 0);
+        memcpy(&mPage[0], &ts, sizeof(ts));
+        mUsed = kPageDataOffset;
+        mLastTs = ts;
+    }
+
+    void finishPage() {
+        uint64_t commit = mUsed - kPageDataOffset;
+        memcpy(&mPage[8], &commit, sizeof(commit));
+        mPage.resize(mUsed);
+        mPages.push_back(mPage);
+        mUsed = 0;
+    }
+
+    std::vector<std::vector<uint8_t> > mPages;
+    std::vector<uint8_t> mPage;
+    size_t mUsed;
+    uint64_t mLastTs;
+};
+
+static bool writeChunk(gzFile out, uint32_t type, const void* data, uint32_t length) {
+    BinaryTraceChunk chunk = { type, 0, length };
+    return gzwrite(out, &chunk, sizeof(chunk)) == sizeof(chunk) &&
+            gzwrite(out, data, length) == static_cast<int>(length);
+}
+
+static bool writeCapture(const char* path, bool compress,
+        const std::vector<std::vector<uint8_t> >& pages, const std::string& cmdlines) {
+    gzFile out = gzopen(path, compress ? "wb" : "wbT");
+    if (out == NULL) {
+        fprintf(stderr, "error opening %s\n", path);
+        return false;
+    }
+    BinaryTraceHeader header;
+    memcpy(header.magic, kBinaryTraceMagic, sizeof(kBinaryTraceMagic));
+    header.pageSize = kPageSize;
+    header.cpus = 1;
+    bool ok = gzwrite(out, &header, sizeof(header)) == sizeof(header);
+    ok = ok && writeChunk(out, BINARY_CHUNK_HEADER_PAGE, kHeaderPage, strlen(kHeaderPage));
+    ok = ok && writeChunk(out, BINARY_CHUNK_EVENT_FORMAT, kPrintFormat, strlen(kPrintFormat));
+    for (size_t i = 0; ok && i < pages.size(); i++) {
+        ok = writeChunk(out, BINARY_CHUNK_PAGE, &pages[i][0], pages[i].size());
+    }
+    ok = ok && writeChunk(out, BINARY_CHUNK_CMDLINES, cmdlines.data(), cmdlines.size());
+    return gzclose(out) == Z_OK && ok;
+}
+
+static off_t fileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+typedef std::map<int32_t, std::vector<std::string> > ThreadMarkers;
+
+// Converts the capture, returning the size of the text and the markers in it by thread.
+static size_t convert(const char* path, ThreadMarkers* markers) {
+    BinaryTraceConverter converter;
+    if (!converter.read(path)) {
+        return 0;
+    }
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    converter.write(out);
+    fclose(out);
+
+    // "<comm>-<tid> (<tgid>) [<cpu>] ...: tracing_mark_write: <marker>"
+    const char* kMark = "tracing_mark_write: ";
+    for (char* line = strstr(text, kMark); line != NULL; line = strstr(line, kMark)) {
+        char* lineStart = line;
+        while (lineStart > text && lineStart[-1] != '\n') {
+            lineStart--;
+        }
+        char* tid = strstr(lineStart, " (");
+        while (tid > lineStart && tid[-1] != '-') {
+            tid--;
+        }
+        line += strlen(kMark);
+        char* lineEnd = strchr(line, '\n');
+        (*markers)[atoi(tid)].push_back(std::string(line, lineEnd));
+        line = lineEnd;
+    }
+    free(text);
+    return size;
+}
+
+static void reportCapture(const char* what, const char* dir,
+        const std::vector<std::vector<uint8_t> >& pages, const std::string& cmdlines,
+        ThreadMarkers* markers) {
+    std::string plain = std::string(dir) + "/binary_trace_bench." + what;
+    std::string gzipped = plain + ".gz";
+    if (!writeCapture(plain.c_str(), false, pages, cmdlines) ||
+            !writeCapture(gzipped.c_str(), true, pages, cmdlines)) {
+        exit(1);
+    }
+    size_t text = convert(gzipped.c_str(), markers);
+    printf("capture of %s markers: %zu pages, text %zu bytes, binary %lld, gzipped %lld\n",
+            what, pages.size(), text, (long long) fileSize(plain.c_str()),
+            (long long) fileSize(gzipped.c_str()));
+    unlink(plain.c_str());
+    unlink(gzipped.c_str());
+}
+
+typedef std::pair<int64_t, std::string> TimedMarker;
+
+struct CaptureThread {
+    pthread_t thread;
+    int32_t tid;
+    int fd;
+    size_t count;
+    std::vector<TimedMarker> text;
+};
+
+static pthread_mutex_t gCaptureLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gCaptureCond = PTHREAD_COND_INITIALIZER;
+static int gCaptureRecorded;
+static bool gCaptureRelease;
+
+// Records the workload as text, then through BinaryMarker, and stays alive
+// without flushing until main is done looking at what was written.
+static void* captureThread(void* arg) {
+    CaptureThread* t = static_cast<CaptureThread*>(arg);
+    t->tid = gettid();
+    TextMarkers text = { t->fd, &t->text };
+    workload(text, t->count);
+    BinaryMarkers binary;
+    workload(binary, t->count);
+
+    pthread_mutex_lock(&gCaptureLock);
+    gCaptureRecorded++;
+    pthread_cond_broadcast(&gCaptureCond);
+    while (!gCaptureRelease) {
+        pthread_cond_wait(&gCaptureCond, &gCaptureLock);
+    }
+    pthread_mutex_unlock(&gCaptureLock);
+    return NULL;
+}
+
+static bool byTime(const std::pair<int64_t, int32_t>& a, const std::pair<int64_t, int32_t>& b) {
+    return a.first < b.first;
+}
+
+int main(int argc, char** argv) {
+    const char* me = argv[0];
+    size_t count = 1000000;
+    const char* markerPath = "/dev/null";
+    const char* dir = "/data/local/tmp";
+
+    int res;
+    while ((res = getopt(argc, argv, "n:m:d:")) >= 0) {
+        switch (res) {
+            case 'n': count = atol(optarg); break;
+            case 'm': markerPath = optarg; break;
+            case 'd': dir = optarg; break;
+            default: usage(me);
+        }
+    }
+    if (count == 0) {
+        usage(me);
+    }
+
+    int fd = open(markerPath, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "error opening %s: %s\n", markerPath, strerror(errno));
+        return 1;
+    }
+
+    TextMarkers text = { fd, NULL };
+    int64_t start = nowNs();
+    size_t made = workload(text, count);
+    int64_t textNs = nowNs() - start;
+
+    BinaryMarker::setMarkerFd(fd);
+    BinaryMarkers binary;
+    start = nowNs();
+    workload(binary, count);
+    BinaryMarker::flush();
+    int64_t binaryNs = nowNs() - start;
+
+    printf("%zu markers: text %.1f ns each, binary %.1f ns each (%.1fx)\n", made,
+            (double) textNs / made, (double) binaryNs / made, (double) textNs / binaryNs);
+
+    // The captures are of a smaller run, so that the text is of a sensible size.
+    size_t captureCount = count < 100000 ? count : 100000;
+
+    std::string batchPath = std::string(dir) + "/binary_trace_bench.batches";
+    int batchFd = open(batchPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+            0600);
+    if (batchFd == -1) {
+        fprintf(stderr, "error opening %s: %s\n", batchPath.c_str(), strerror(errno));
+        return 1;
+    }
+    BinaryMarker::setMarkerFd(batchFd);
+
+    std::vector<CaptureThread> threads(kCaptureThreads);
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].fd = fd;
+        threads[i].count = captureCount / threads.size();
+        pthread_create(&threads[i].thread, NULL, captureThread, &threads[i]);
+    }
+    pthread_mutex_lock(&gCaptureLock);
+    while (gCaptureRecorded < kCaptureThreads) {
+        pthread_cond_wait(&gCaptureCond, &gCaptureLock);
+    }
+    pthread_mutex_unlock(&gCaptureLock);
+
+    // Only the flush thread writes the threads' last batches now.
+    struct timespec ts = { 0, 3 * kBinaryMarkerMaxBatchAgeNs };
+    nanosleep(&ts, NULL);
+
+    std::vector<uint8_t> batches(lseek(batchFd, 0, SEEK_END));
+    pread(batchFd, &batches[0], batches.size(), 0);
+
+    pthread_mutex_lock(&gCaptureLock);
+    gCaptureRelease = true;
+    pthread_cond_broadcast(&gCaptureCond);
+    pthread_mutex_unlock(&gCaptureLock);
+    for (size_t i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    BinaryMarker::setMarkerFd(fd);
+    close(batchFd);
+    unlink(batchPath.c_str());
+
+    // Pages hold events in time order, across the threads.
+    std::string cmdlines;
+    std::vector<std::pair<int64_t, int32_t> > order;
+    size_t written = 0;
+    for (size_t i = 0; i < threads.size(); i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "%d capture_%zu\n", threads[i].tid, i);
+        cmdlines += line;
+        for (size_t j = 0; j < threads[i].text.size(); j++) {
+            order.push_back(std::make_pair(threads[i].text[j].first, threads[i].tid));
+        }
+        written += threads[i].text.size();
+    }
+    std::vector<size_t> next(threads.size(), 0);
+    std::stable_sort(order.begin(), order.end(), byTime);
+    PageWriter textPages;
+    for (size_t i = 0; i < order.size(); i++) {
+        size_t t = 0;
+        while (threads[t].tid != order[i].second) {
+            t++;
+        }
+        const std::string& marker = threads[t].text[next[t]++].second;
+        textPages.add(order[i].first, order[i].second,
+                reinterpret_cast<const uint8_t*>(marker.data()), marker.size());
+    }
+
+    // The kernel stamps each batch with the thread that wrote it: the recording
+    // thread when its batch filled up, else the flush thread.  They are all
+    // stamped with this thread, which recorded none of them, so that markers put
+    // on the writer's thread would show up as differing.
+    std::vector<std::pair<int64_t, size_t> > batchOrder;
+    size_t writes = 0;
+    size_t batched = 0;
+    for (size_t offset = 0; offset + sizeof(BinaryMarkerBatch) <= batches.size(); writes++) {
+        BinaryMarkerBatch batch;
+        memcpy(&batch, &batches[offset], sizeof(batch));
+        batchOrder.push_back(std::make_pair(static_cast<int64_t>(batch.flushNs), offset));
+        batched += batch.count;
+        offset += sizeof(batch) + batch.length;
+    }
+    std::stable_sort(batchOrder.begin(), batchOrder.end());
+    PageWriter binaryPages;
+    for (size_t i = 0; i < batchOrder.size(); i++) {
+        BinaryMarkerBatch batch;
+        memcpy(&batch, &batches[batchOrder[i].second], sizeof(batch));
+        binaryPages.add(batch.flushNs, gettid(), &batches[batchOrder[i].second],
+                sizeof(batch) + batch.length);
+    }
+
+    printf("%zu markers for the captures on %d threads: text %zu writes, binary %zu writes\n",
+            written, kCaptureThreads, written, writes);
+    bool flushed = batched == written;
+    printf("%zu of the binary markers written before the threads exited\n", batched);
+
+    ThreadMarkers textMarkers;
+    ThreadMarkers binaryMarkers;
+    reportCapture("text", dir, textPages.finish(), cmdlines, &textMarkers);
+    reportCapture("binary", dir, binaryPages.finish(), cmdlines, &binaryMarkers);
+
+    size_t converted = 0;
+    for (ThreadMarkers::const_iterator it = textMarkers.begin(); it != textMarkers.end(); ++it) {
+        converted += it->second.size();
+    }
+    bool agree = converted == written && textMarkers.size() == threads.size() &&
+            textMarkers == binaryMarkers;
+    printf("converted markers, thread by thread, %s\n", agree ? "agree" : "DIFFER");
+
+    close(fd);
+    return agree && flushed ? 0 : 1;
+}
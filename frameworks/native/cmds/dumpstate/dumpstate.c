@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,6 +29,7 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <cutils/properties.h>
@@ -261,42 +263,7 @@ static unsigned long logcat_timeout(char *name) {
 
 /* End copy from system/core/logd/LogBuffer.cpp */
 
-/* dumps the current system state to stdout */
-static void dumpstate() {
-    unsigned long timeout;
-    time_t now = time(NULL);
-    char build[PROPERTY_VALUE_MAX], fingerprint[PROPERTY_VALUE_MAX];
-    char radio[PROPERTY_VALUE_MAX], bootloader[PROPERTY_VALUE_MAX];
-    char network[PROPERTY_VALUE_MAX], date[80];
-    char build_type[PROPERTY_VALUE_MAX];
-
-    property_get("ro.build.display.id", build, "(unknown)");
-    property_get("ro.build.fingerprint", fingerprint, "(unknown)");
-    property_get("ro.build.type", build_type, "(unknown)");
-    property_get("ro.baseband", radio, "(unknown)");
-    property_get("ro.bootloader", bootloader, "(unknown)");
-    property_get("gsm.operator.alpha", network, "(unknown)");
-    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
-
-    printf("========================================================\n");
-    printf("== dumpstate: %s\n", date);
-    printf("========================================================\n");
-
-    printf("\n");
-    printf("Build: %s\n", build);
-    printf("Build fingerprint: '%s'\n", fingerprint); /* format is important for other tools */
-    printf("Bootloader: %s\n", bootloader);
-    printf("Radio: %s\n", radio);
-    printf("Network: %s\n", network);
-
-    printf("Kernel: ");
-    dump_file(NULL, "/proc/version");
-    printf("Command line: %s\n", strtok(cmdline_buf, "\n"));
-    printf("\n");
-
-    dump_dev_files("TRUSTY VERSION", "/sys/bus/platform/drivers/trusty", "trusty_version");
-    run_command("UPTIME", 10, "uptime", NULL);
-    dump_files("UPTIME MMC PERF", mmcblk0, skip_not_stat, dump_stat_from_fd);
+static void dump_memory(void *arg __unused) {
     dump_file("MEMORY INFO", "/proc/meminfo");
     run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-t", NULL);
     run_command("PROCRANK", 20, "procrank", NULL);
@@ -307,28 +274,42 @@ static void dumpstate() {
     dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
     dump_file("BUDDYINFO", "/proc/buddyinfo");
     dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
+}
 
+static void dump_kernel(void *arg __unused) {
     dump_file("KERNEL WAKELOCKS", "/proc/wakelocks");
     dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
     dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
     dump_file("KERNEL SYNC", "/d/sync");
+}
 
+static void dump_processes(void *arg __unused) {
     run_command("PROCESSES", 10, "ps", "-P", NULL);
     run_command("PROCESSES AND THREADS", 10, "ps", "-t", "-p", "-P", NULL);
     run_command("PROCESSES (SELINUX LABELS)", 10, "ps", "-Z", NULL);
     run_command("LIBRANK", 10, "librank", NULL);
+}
 
+static void dump_kernel_log(void *arg __unused) {
     do_dmesg();
+}
 
+static void dump_process_state(void *arg __unused) {
     run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
     for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
     for_each_tid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
+}
 
+static void take_screenshot(void *arg __unused) {
     if (screenshot_path[0]) {
         ALOGI("taking screenshot\n");
         run_command(NULL, 10, "/system/bin/screencap", "-p", screenshot_path, NULL);
         ALOGI("wrote screenshot: %s\n", screenshot_path);
     }
+}
+
+static void dump_logs(void *arg __unused) {
+    unsigned long timeout;
 
     // dump_file("EVENT LOG TAGS", "/etc/event-log-tags");
     // calculate timeout
@@ -349,7 +330,9 @@ static void dumpstate() {
     run_command("RADIO LOG", timeout / 1000, "logcat", "-b", "radio", "-v", "threadtime", "-d", "*:v", NULL);
 
     run_command("LOG STATISTICS", 10, "logcat", "-b", "all", "-S", NULL);
+}
 
+static void dump_traces_and_tombstones(void *arg __unused) {
     /* show the traces we collected in main(), if that was done */
     if (dump_traces_path != NULL) {
         dump_file("VM TRACES JUST NOW", dump_traces_path);
@@ -400,13 +383,18 @@ static void dumpstate() {
     if (!dumped) {
         printf("*** NO TOMBSTONES to dump in %s\n\n", TOMBSTONE_DIR);
     }
+}
 
+static void dump_network_stats(void *arg __unused) {
     dump_file("NETWORK DEV INFO", "/proc/net/dev");
     dump_file("QTAGUID NETWORK INTERFACES INFO", "/proc/net/xt_qtaguid/iface_stat_all");
     dump_file("QTAGUID NETWORK INTERFACES INFO (xt)", "/proc/net/xt_qtaguid/iface_stat_fmt");
     dump_file("QTAGUID CTRL INFO", "/proc/net/xt_qtaguid/ctrl");
     dump_file("QTAGUID STATS INFO", "/proc/net/xt_qtaguid/stats");
+}
 
+static void dump_last_boot(void *arg __unused) {
+    struct stat st;
     if (!stat(PSTORE_LAST_KMSG, &st)) {
         /* Also TODO: Make console-ramoops CAP_SYSLOG protected. */
         dump_file("LAST KMSG", PSTORE_LAST_KMSG);
@@ -418,9 +406,10 @@ static void dumpstate() {
     /* kernels must set CONFIG_PSTORE_PMSG, slice up pstore with device tree */
     run_command("LAST LOGCAT", 10, "logcat", "-L", "-v", "threadtime",
                                              "-b", "all", "-d", "*:v", NULL);
+}
 
-    /* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
-
+/* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
+static void dump_network(void *arg __unused) {
     run_command("NETWORK INTERFACES", 10, "ip", "link", NULL);
 
     run_command("IPv4 ADDRESSES", 10, "ip", "-4", "addr", "show", NULL);
@@ -470,16 +459,22 @@ static void dumpstate() {
             SU_PATH, "root", "wlutil", "nd_status", NULL);
 #endif
     dump_file("INTERRUPTS (2)", "/proc/interrupts");
+}
 
+static void dump_properties(void *arg __unused) {
     print_properties();
+}
 
+static void dump_storage(void *arg __unused) {
     run_command("VOLD DUMP", 10, "vdc", "dump", NULL);
     run_command("SECURE CONTAINERS", 10, "vdc", "asec", "list", NULL);
 
     run_command("FILESYSTEMS & FREE SPACE", 10, "df", NULL);
 
     run_command("LAST RADIO LOG", 10, "parse_radio_log", "/proc/last_radio_log", NULL);
+}
 
+static void dump_backlights(void *arg __unused) {
     printf("------ BACKLIGHTS ------\n");
     printf("LCD brightness=");
     dump_file(NULL, "/sys/class/leds/lcd-backlight/brightness");
@@ -492,13 +487,20 @@ static void dumpstate() {
     printf("LCD driver registers:\n");
     dump_file(NULL, "/sys/class/leds/lcd-backlight/registers");
     printf("\n");
+}
 
+static void dump_binder(void *arg __unused) {
     /* Binder state is expensive to look at as it uses a lot of memory. */
     dump_file("BINDER FAILED TRANSACTION LOG", "/sys/kernel/debug/binder/failed_transaction_log");
     dump_file("BINDER TRANSACTION LOG", "/sys/kernel/debug/binder/transaction_log");
     dump_file("BINDER TRANSACTIONS", "/sys/kernel/debug/binder/transactions");
     dump_file("BINDER STATS", "/sys/kernel/debug/binder/stats");
     dump_file("BINDER STATE", "/sys/kernel/debug/binder/state");
+}
+
+static void dump_board(void *arg __unused) {
+    char build_type[PROPERTY_VALUE_MAX];
+    property_get("ro.build.type", build_type, "(unknown)");
 
     printf("========================================================\n");
     printf("== Board\n");
@@ -522,7 +524,9 @@ static void dumpstate() {
                     SU_PATH, "root", "vril-dump", NULL);
         }
     }
+}
 
+static void dump_framework(void *arg __unused) {
     printf("========================================================\n");
     printf("== Android Framework Services\n");
     printf("========================================================\n");
@@ -531,7 +535,9 @@ static void dumpstate() {
        to increase its timeout.  we really need to do the timeouts in
        dumpsys itself... */
     run_command("DUMPSYS", 60, "dumpsys", NULL);
+}
 
+static void dump_checkins(void *arg __unused) {
     printf("========================================================\n");
     printf("== Checkins\n");
     printf("========================================================\n");
@@ -542,42 +548,170 @@ static void dumpstate() {
     run_command("CHECKIN PROCSTATS", 30, "dumpsys", "procstats", "-c", NULL);
     run_command("CHECKIN USAGESTATS", 30, "dumpsys", "usagestats", "-c", NULL);
     run_command("CHECKIN PACKAGE", 30, "dumpsys", "package", "--checkin", NULL);
+}
 
+static void dump_app_activities(void *arg __unused) {
     printf("========================================================\n");
     printf("== Running Application Activities\n");
     printf("========================================================\n");
 
     run_command("APP ACTIVITIES", 30, "dumpsys", "activity", "all", NULL);
+}
 
+static void dump_app_services(void *arg __unused) {
     printf("========================================================\n");
     printf("== Running Application Services\n");
     printf("========================================================\n");
 
     run_command("APP SERVICES", 30, "dumpsys", "activity", "service", "all", NULL);
+}
 
+static void dump_app_providers(void *arg __unused) {
     printf("========================================================\n");
     printf("== Running Application Providers\n");
     printf("========================================================\n");
 
     run_command("APP SERVICES", 30, "dumpsys", "activity", "provider", "all", NULL);
+}
+
+/*
+ * The sections after the header, in the order they are printed. A timeout stops a wedged
+ * section before it holds up the rest; it is not the sum of the timeouts of the commands the
+ * section runs, which can be more. Sections whose run time grows with the number of processes
+ * or the size of the logs have no timeout but the budget, as killing one would lose all that it
+ * had yet to print. The logs and dumpsys are slowest, so they are started first.
+ */
+static section_t sections[] = {
+    { "MEMORY", dump_memory, NULL, 0, 120 },
+    { "KERNEL", dump_kernel, NULL, 0, 30 },
+    { "PROCESSES", dump_processes, NULL, 0, 60 },
+    { "DMESG", dump_kernel_log, NULL, 0, 30 },
+    { "PROCESS STATE", dump_process_state, NULL, 1, 0 },
+    { "SCREENSHOT", take_screenshot, NULL, 2, 15 },
+    { "LOGS", dump_logs, NULL, 3, 0 },
+    { "TRACES AND TOMBSTONES", dump_traces_and_tombstones, NULL, 0, 60 },
+    { "NETWORK STATS", dump_network_stats, NULL, 0, 30 },
+    { "LAST BOOT", dump_last_boot, NULL, 0, 30 },
+    { "NETWORK", dump_network, NULL, 0, 240 },
+    { "PROPERTIES", dump_properties, NULL, 0, 10 },
+    { "STORAGE", dump_storage, NULL, 0, 60 },
+    { "BACKLIGHTS", dump_backlights, NULL, 0, 10 },
+    { "BINDER", dump_binder, NULL, 0, 30 },
+    { "BOARD", dump_board, NULL, 0, 0 },
+    { "DUMPSYS", dump_framework, NULL, 3, 90 },
+    { "CHECKINS", dump_checkins, NULL, 1, 200 },
+    { "APP ACTIVITIES", dump_app_activities, NULL, 1, 40 },
+    { "APP SERVICES", dump_app_services, NULL, 1, 40 },
+    { "APP PROVIDERS", dump_app_providers, NULL, 1, 40 },
+};
+
+/* the whole report, after which whatever is left is killed or skipped */
+#define DUMPSTATE_BUDGET_SECONDS (10 * 60)
+
+/* dumps the current system state to stdout */
+static void dumpstate(int max_jobs) {
+    time_t now = time(NULL);
+    char build[PROPERTY_VALUE_MAX], fingerprint[PROPERTY_VALUE_MAX];
+    char radio[PROPERTY_VALUE_MAX], bootloader[PROPERTY_VALUE_MAX];
+    char network[PROPERTY_VALUE_MAX], date[80];
+
+    property_get("ro.build.display.id", build, "(unknown)");
+    property_get("ro.build.fingerprint", fingerprint, "(unknown)");
+    property_get("ro.baseband", radio, "(unknown)");
+    property_get("ro.bootloader", bootloader, "(unknown)");
+    property_get("gsm.operator.alpha", network, "(unknown)");
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    printf("========================================================\n");
+    printf("== dumpstate: %s\n", date);
+    printf("========================================================\n");
+
+    printf("\n");
+    printf("Build: %s\n", build);
+    printf("Build fingerprint: '%s'\n", fingerprint); /* format is important for other tools */
+    printf("Bootloader: %s\n", bootloader);
+    printf("Radio: %s\n", radio);
+    printf("Network: %s\n", network);
 
+    printf("Kernel: ");
+    dump_file(NULL, "/proc/version");
+    printf("Command line: %s\n", strtok(cmdline_buf, "\n"));
+    printf("\n");
+
+    dump_dev_files("TRUSTY VERSION", "/sys/bus/platform/drivers/trusty", "trusty_version");
+    run_command("UPTIME", 10, "uptime", NULL);
+    /* before the sections: this sets worst_write_perf, which the log timeouts use */
+    dump_files("UPTIME MMC PERF", mmcblk0, skip_not_stat, dump_stat_from_fd);
+
+    size_t count = sizeof(sections) / sizeof(sections[0]);
+    run_sections(sections, count, max_jobs, DUMPSTATE_BUDGET_SECONDS);
+
+    /* the tombstones were dumped by a child, which had copies of the fds */
+    for (size_t i = 0; i < NUM_TOMBSTONES; i++) {
+        if (tombstone_data[i].fd != -1) {
+            close(tombstone_data[i].fd);
+            tombstone_data[i].fd = -1;
+        }
+    }
 
     printf("========================================================\n");
     printf("== dumpstate: done\n");
     printf("========================================================\n");
 }
 
+static void sleep_section(void *arg) {
+    int ms = (int) (intptr_t) arg;
+    printf("------ sleeping %d ms ------\n", ms);
+    usleep(ms * 1000);
+    printf("slept %d ms\n\n", ms);
+}
+
+/* Runs made-up sections, one of which runs out of time, to see what the parallelism buys. */
+static void test_sections(int max_jobs) {
+    section_t test[] = {
+        { "FAST", sleep_section, (void *) 100, 0, 5 },
+        { "SLOW", sleep_section, (void *) 1500, 0, 5 },
+        { "WEDGED", sleep_section, (void *) 10000, 0, 2 },
+        { "LOGS", sleep_section, (void *) 1000, 3, 5 },
+        { "DUMPSYS", sleep_section, (void *) 2000, 3, 5 },
+        { "FILES", sleep_section, (void *) 300, 0, 5 },
+        { "NETWORK", sleep_section, (void *) 800, 0, 5 },
+        { "CHECKINS", sleep_section, (void *) 1200, 1, 5 },
+    };
+    size_t count = sizeof(test) / sizeof(test[0]);
+    int jobs[] = { 1, max_jobs };
+
+    for (size_t j = 0; j < sizeof(jobs) / sizeof(jobs[0]); j++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_sections(test, count, jobs[j], 30);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        fprintf(stderr, "%d job(s): %.3fs\n", jobs[j], (end.tv_sec - start.tv_sec)
+                + (end.tv_nsec - start.tv_nsec) / 1e9);
+        for (size_t i = 0; i < count; i++) {
+            fprintf(stderr, "  %-10s %.3fs%s\n", test[i].title,
+                    (float) test[i].elapsed_ns / 1e9, test[i].timed_out ? " (timed out)" : "");
+        }
+    }
+}
+
+#define DEFAULT_JOBS 4
+
 static void usage() {
-    fprintf(stderr, "usage: dumpstate [-b soundfile] [-e soundfile] [-o file [-d] [-p] [-z]] [-s] [-q]\n"
+    fprintf(stderr, "usage: dumpstate [-b soundfile] [-e soundfile] [-o file [-d] [-p] [-z]] [-s] [-q] [-j jobs] [-T]\n"
             "  -o: write to file (instead of stdout)\n"
             "  -d: append date to filename (requires -o)\n"
             "  -p: capture screenshot to filename.png (requires -o)\n"
+            "  -z: gzip the output, as filename.txt.gz (requires -o)\n"
+            "  -j: sections to run at the same time (default %d, 1 runs them in turn)\n"
+            "  -T: time made-up sections with -j 1 and -j jobs, then exit\n"
             "  -s: write output to control socket (for init)\n"
             "  -b: play sound file instead of vibrate, at beginning of job\n"
             "  -e: play sound file instead of vibrate, at end of job\n"
             "  -q: disable vibrate\n"
-            "  -B: send broadcast when finished (requires -o and -p)\n"
-                );
+            "  -B: send broadcast when finished (requires -o and -p)\n",
+            DEFAULT_JOBS);
 }
 
 static void sigpipe_handler(int n) {
@@ -598,6 +732,9 @@ int main(int argc, char *argv[]) {
     int use_socket = 0;
     int do_fb = 0;
     int do_broadcast = 0;
+    int do_compress = 0;
+    int do_test = 0;
+    int max_jobs = DEFAULT_JOBS;
 
     if (getuid() != 0) {
         // Old versions of the adb client would call the
@@ -625,7 +762,7 @@ int main(int argc, char *argv[]) {
 
     /* parse arguments */
     int c;
-    while ((c = getopt(argc, argv, "dho:svqzpB")) != -1) {
+    while ((c = getopt(argc, argv, "dho:svqzpBj:T")) != -1) {
         switch (c) {
             case 'd': do_add_date = 1;       break;
             case 'o': use_outfile = optarg;  break;
@@ -634,6 +771,9 @@ int main(int argc, char *argv[]) {
             case 'q': do_vibrate = 0;        break;
             case 'p': do_fb = 1;             break;
             case 'B': do_broadcast = 1;      break;
+            case 'z': do_compress = 1;       break;
+            case 'j': max_jobs = atoi(optarg); break;
+            case 'T': do_test = 1;           break;
             case '?': printf("\n");
             case 'h':
                 usage();
@@ -641,6 +781,16 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (max_jobs < 1) {
+        usage();
+        exit(1);
+    }
+
+    if (do_test) {
+        test_sections(max_jobs);
+        return 0;
+    }
+
     // If we are going to use a socket, do it as early as possible
     // to avoid timeouts from bugreport.
     if (use_socket) {
@@ -710,7 +860,8 @@ int main(int argc, char *argv[]) {
 
     /* redirect output if needed */
     char path[PATH_MAX], tmp_path[PATH_MAX];
-    pid_t gzip_pid = -1;
+    pthread_t gzip_thread;
+    bool gzipping = false;
 
     if (!use_socket && use_outfile) {
         strlcpy(path, use_outfile, sizeof(path));
@@ -725,12 +876,20 @@ int main(int argc, char *argv[]) {
             strlcat(screenshot_path, ".png", sizeof(screenshot_path));
         }
         strlcat(path, ".txt", sizeof(path));
+        if (do_compress) {
+            strlcat(path, ".gz", sizeof(path));
+        }
         strlcpy(tmp_path, path, sizeof(tmp_path));
         strlcat(tmp_path, ".tmp", sizeof(tmp_path));
-        redirect_to_file(stdout, tmp_path);
+        if (do_compress) {
+            gzip_thread = redirect_to_gzip_file(stdout, tmp_path);
+            gzipping = true;
+        } else {
+            redirect_to_file(stdout, tmp_path);
+        }
     }
 
-    dumpstate();
+    dumpstate(max_jobs);
 
     /* done */
     if (vibrator) {
@@ -741,10 +900,9 @@ int main(int argc, char *argv[]) {
         fclose(vibrator);
     }
 
-    /* wait for gzip to finish, otherwise it might get killed when we exit */
-    if (gzip_pid > 0) {
-        fclose(stdout);
-        waitpid(gzip_pid, NULL, 0);
+    /* wait for gzip to finish, otherwise the file would be cut short when we exit */
+    if (gzipping) {
+        finish_gzip_file(stdout, gzip_thread);
     }
 
     /* rename the (now complete) .tmp file to its final location */
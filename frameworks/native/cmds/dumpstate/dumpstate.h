@@ -19,13 +19,31 @@
 
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #define SU_PATH "/system/xbin/su"
 
 typedef void (for_each_pid_func)(int, const char *);
 typedef void (for_each_tid_func)(int, int, const char *);
+typedef void (section_func)(void *);
+
+/* a part of the report that can be run at the same time as the others */
+typedef struct {
+    const char *title;
+    section_func *func;
+    void *arg;
+    int priority;           /* higher ones are started first */
+    int timeout_seconds;    /* 0 for none but the budget */
+
+    /* filled in by run_sections() */
+    int state;
+    bool timed_out;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+} section_t;
 
 /* prints the contents of a file */
 int dump_file(const char *title, const char *path);
@@ -57,6 +75,16 @@ void redirect_to_socket(FILE *redirect, const char *service);
 /* redirect output to a file */
 void redirect_to_file(FILE *redirect, char *path);
 
+/* redirect output to a file, gzip-compressed on a thread that finish_gzip_file() waits for */
+pthread_t redirect_to_gzip_file(FILE *redirect, char *path);
+
+/* closes the redirected stream and waits for what was written to it to be compressed */
+void finish_gzip_file(FILE *redirect, pthread_t thread);
+
+/* runs the sections up to max_jobs at a time, each in a child of its own, killing whatever
+ * is left once budget_seconds have gone by; their output is printed in the order given */
+void run_sections(section_t *sections, size_t count, int max_jobs, int budget_seconds);
+
 /* dump Dalvik and native stack traces, return the trace file location (NULL if none) */
 const char *dump_traces();
 
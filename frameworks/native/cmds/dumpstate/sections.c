@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "dumpstate"
+#include <cutils/log.h>
+
+#include "dumpstate.h"
+
+/*
+ * Sections run in children of their own, so that the helpers they call can go on printing to
+ * stdout: each child's stdout is a pipe, which is read into a buffer until the section is
+ * next in order, and then copied straight through. The output is the same as if the sections
+ * had run one after the other, only sooner.
+ */
+
+static const int64_t NANOS_PER_SEC = 1000000000;
+
+enum {
+    SECTION_PENDING,
+    SECTION_RUNNING,
+    SECTION_DONE,
+};
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+} section_run_t;
+
+static uint64_t nanotime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+}
+
+static void append(section_run_t *run, const char *data, size_t len) {
+    if (run->len + len > run->cap) {
+        size_t cap = run->cap ? run->cap : 65536;
+        while (cap < run->len + len) {
+            cap *= 2;
+        }
+        char *buf = realloc(run->buf, cap);
+        if (buf == NULL) {
+            /* Better to lose part of a section than all of the report */
+            return;
+        }
+        run->buf = buf;
+        run->cap = cap;
+    }
+    memcpy(run->buf + run->len, data, len);
+    run->len += len;
+}
+
+static void appendf(section_run_t *run, const char *fmt, ...) {
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        append(run, line, (size_t) len < sizeof(line) ? (size_t) len : sizeof(line) - 1);
+    }
+}
+
+static void start_section(section_t *section, section_run_t *runs, size_t count,
+        section_run_t *run) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        appendf(run, "*** %s: pipe failed: %s\n", section->title, strerror(errno));
+        section->state = SECTION_DONE;
+        return;
+    }
+
+    fflush(stdout);
+    section->start_ns = nanotime();
+    pid_t pid = fork();
+    if (pid < 0) {
+        appendf(run, "*** %s: fork failed: %s\n", section->title, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        section->state = SECTION_DONE;
+        return;
+    }
+
+    if (pid == 0) {
+        /* A group of its own, so that what it runs can be killed with it */
+        setpgid(0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        for (size_t i = 0; i < count; i++) {
+            if (runs[i].fd >= 0) {
+                close(runs[i].fd);
+            }
+        }
+        close(fds[0]);
+        TEMP_FAILURE_RETRY(dup2(fds[1], STDOUT_FILENO));
+        close(fds[1]);
+        section->func(section->arg);
+        fflush(stdout);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    run->pid = pid;
+    run->fd = fds[0];
+    section->state = SECTION_RUNNING;
+}
+
+static void finish_section(section_t *section, section_run_t *run, bool killed) {
+    if (killed) {
+        kill(-run->pid, SIGKILL);
+        kill(run->pid, SIGKILL);
+    }
+    close(run->fd);
+    run->fd = -1;
+    TEMP_FAILURE_RETRY(waitpid(run->pid, NULL, 0));
+    section->elapsed_ns = nanotime() - section->start_ns;
+    section->state = SECTION_DONE;
+    if (killed) {
+        appendf(run, "\n*** %s: Timed out after %.3fs (killed section)\n\n", section->title,
+                (float) section->elapsed_ns / NANOS_PER_SEC);
+        section->timed_out = true;
+    }
+}
+
+/* Writes what the section at the head of the output has so far; returns true if it's done. */
+static bool emit(section_t *section, section_run_t *run) {
+    if (run->len > 0) {
+        fwrite(run->buf, run->len, 1, stdout);
+        run->len = 0;
+        fflush(stdout);
+    }
+    if (section->state != SECTION_DONE) {
+        return false;
+    }
+    free(run->buf);
+    run->buf = NULL;
+    run->cap = 0;
+    return true;
+}
+
+void run_sections(section_t *sections, size_t count, int max_jobs, int budget_seconds) {
+    if (max_jobs < 1) {
+        max_jobs = 1;
+    }
+    section_run_t *runs = calloc(count, sizeof(section_run_t));
+    size_t *order = calloc(count, sizeof(size_t));
+    struct pollfd *pfds = calloc(max_jobs, sizeof(struct pollfd));
+    size_t *polled = calloc(max_jobs, sizeof(size_t));
+    if (runs == NULL || order == NULL || pfds == NULL || polled == NULL) {
+        ALOGE("Out of memory for %zu sections, running them in turn\n", count);
+        for (size_t i = 0; i < count; i++) {
+            sections[i].func(sections[i].arg);
+        }
+        free(polled);
+        free(pfds);
+        free(order);
+        free(runs);
+        return;
+    }
+
+    /* Sections start by priority, the highest first, otherwise in order */
+    for (size_t i = 0; i < count; i++) {
+        runs[i].fd = -1;
+        sections[i].state = SECTION_PENDING;
+        sections[i].timed_out = false;
+        sections[i].elapsed_ns = 0;
+        size_t j = i;
+        while (j > 0 && sections[order[j - 1]].priority < sections[i].priority) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    uint64_t deadline = nanotime() + (uint64_t) budget_seconds * NANOS_PER_SEC;
+    size_t next_start = 0;
+    size_t next_emit = 0;
+    int running = 0;
+
+    while (next_emit < count) {
+        uint64_t now = nanotime();
+        while (running < max_jobs && next_start < count) {
+            size_t i = order[next_start++];
+            if (now >= deadline) {
+                appendf(&runs[i], "*** %s: Skipped, out of time\n\n", sections[i].title);
+                sections[i].state = SECTION_DONE;
+                sections[i].timed_out = true;
+                continue;
+            }
+            start_section(&sections[i], runs, count, &runs[i]);
+            if (sections[i].state == SECTION_RUNNING) {
+                running++;
+            }
+        }
+
+        /* Wake up for the earliest timeout, or every second */
+        int nfds = 0;
+        uint64_t wake = now + NANOS_PER_SEC;
+        for (size_t i = 0; i < count; i++) {
+            if (sections[i].state != SECTION_RUNNING) {
+                continue;
+            }
+            uint64_t end = deadline;
+            if (sections[i].timeout_seconds > 0) {
+                uint64_t own = sections[i].start_ns
+                        + (uint64_t) sections[i].timeout_seconds * NANOS_PER_SEC;
+                if (own < end) {
+                    end = own;
+                }
+            }
+            if (now >= end) {
+                finish_section(&sections[i], &runs[i], true);
+                running--;
+                continue;
+            }
+            if (end < wake) {
+                wake = end;
+            }
+            pfds[nfds].fd = runs[i].fd;
+            pfds[nfds].events = POLLIN;
+            pfds[nfds].revents = 0;
+            polled[nfds++] = i;
+        }
+
+        if (nfds > 0) {
+            int timeout_ms = (int) ((wake - now + 999999) / 1000000);
+            int ret = TEMP_FAILURE_RETRY(poll(pfds, nfds, timeout_ms));
+            if (ret < 0) {
+                ALOGE("poll failed: %s\n", strerror(errno));
+                for (int k = 0; k < nfds; k++) {
+                    finish_section(&sections[polled[k]], &runs[polled[k]], true);
+                    running--;
+                }
+            }
+            for (int k = 0; ret > 0 && k < nfds; k++) {
+                if (!pfds[k].revents) {
+                    continue;
+                }
+                size_t i = polled[k];
+                char buffer[65536];
+                ssize_t bytes_read = TEMP_FAILURE_RETRY(read(runs[i].fd, buffer, sizeof(buffer)));
+                if (bytes_read > 0) {
+                    append(&runs[i], buffer, bytes_read);
+                } else {
+                    finish_section(&sections[i], &runs[i], false);
+                    running--;
+                }
+            }
+        }
+
+        while (next_emit < count && emit(&sections[next_emit], &runs[next_emit])) {
+            next_emit++;
+        }
+    }
+
+    free(polled);
+    free(pfds);
+    free(order);
+    free(runs);
+}
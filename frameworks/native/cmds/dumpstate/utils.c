@@ -40,6 +40,8 @@
 
 #include <selinux/android.h>
 
+#include <zlib.h>
+
 #include "dumpstate.h"
 
 static const int64_t NANOS_PER_SEC = 1000000000;
@@ -600,6 +602,60 @@ void redirect_to_file(FILE *redirect, char *path) {
     close(fd);
 }
 
+typedef struct {
+    int fd;
+    gzFile out;
+} gzip_args_t;
+
+static void *gzip_thread(void *arg) {
+    gzip_args_t *args = arg;
+    char buffer[65536];
+    ssize_t bytes_read;
+    while ((bytes_read = TEMP_FAILURE_RETRY(read(args->fd, buffer, sizeof(buffer)))) > 0) {
+        if (gzwrite(args->out, buffer, bytes_read) != bytes_read) {
+            fprintf(stderr, "gzwrite failed\n");
+            break;
+        }
+    }
+    close(args->fd);
+    gzclose(args->out);
+    free(args);
+    return NULL;
+}
+
+pthread_t redirect_to_gzip_file(FILE *redirect, char *path) {
+    /* the file is opened the same way, then handed over to the thread */
+    redirect_to_file(redirect, path);
+    gzip_args_t *args = malloc(sizeof(gzip_args_t));
+    int fd = fcntl(fileno(redirect), F_DUPFD_CLOEXEC, 0);
+    int fds[2];
+    if (args == NULL || fd < 0 || pipe2(fds, O_CLOEXEC) < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    args->fd = fds[0];
+    args->out = gzdopen(fd, "wb");
+    if (args->out == NULL) {
+        fprintf(stderr, "%s: gzdopen failed\n", path);
+        exit(1);
+    }
+
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, gzip_thread, args);
+    if (err != 0) {
+        fprintf(stderr, "%s: pthread_create: %s\n", path, strerror(err));
+        exit(1);
+    }
+    TEMP_FAILURE_RETRY(dup2(fds[1], fileno(redirect)));
+    close(fds[1]);
+    return thread;
+}
+
+void finish_gzip_file(FILE *redirect, pthread_t thread) {
+    fclose(redirect);
+    pthread_join(thread, NULL);
+}
+
 static bool should_dump_native_traces(const char* path) {
     for (const char** p = native_processes_to_dump; *p; p++) {
         if (!strcmp(*p, path)) {
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "installd.h"
+
+#include <diskusage/dirsize.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+
+/*
+ * Frees cache space the way clear_cache_files() does -- oldest files first, dot files kept
+ * until their directory goes, directories removed once empty -- without an inventory of every
+ * cache file. The threads walking the cache roots share a heap of the oldest files seen, just
+ * enough of them to free what is missing, and throw away the newest whenever the rest are
+ * enough. Directories are only remembered while a kept file is in them.
+ *
+ * What is deleted is estimated from the files' blocks, so free space is checked again as the
+ * estimate runs out. Should that come up short, because files were still open or linked
+ * elsewhere, the roots are walked again.
+ */
+
+static constexpr size_t kTrimThreads = 4;
+static constexpr int kMaxTrimRounds = 4;
+static constexpr size_t kFreeCheckInterval = 64;   /* deletions between statfs calls */
+
+namespace {
+
+struct trim_dir {
+    std::shared_ptr<trim_dir> parent;   /* null for a cache root */
+    std::string path;
+    int children;       /* visible files and subdirectories still there */
+    int hidden;         /* dot files, and anything that is not a file or directory */
+};
+
+struct trim_file {
+    time_t mod_time;
+    int64_t size;
+    std::shared_ptr<trim_dir> dir;
+    std::string name;
+};
+
+static bool older(const trim_file& lhs, const trim_file& rhs) {
+    return lhs.mod_time < rhs.mod_time;
+}
+
+/*
+ * The oldest files seen, as few as add up to the target. Shared by the walking threads: once
+ * it holds enough, files newer than all of those it holds are turned away without the lock.
+ */
+class CandidateHeap {
+public:
+    explicit CandidateHeap(int64_t target) : mTarget(target), mCutoff(INT64_MAX) {}
+
+    bool wanted(time_t mod_time) {
+        mSeen++;
+        return mod_time <= mCutoff.load(std::memory_order_relaxed);
+    }
+
+    void add(trim_file&& file) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mSize += file.size;
+        mFiles.push_back(std::move(file));
+        std::push_heap(mFiles.begin(), mFiles.end(), older);
+        // The newest is on top; drop it for as long as the others are enough
+        while (mSize - mFiles.front().size >= mTarget) {
+            mSize -= mFiles.front().size;
+            std::pop_heap(mFiles.begin(), mFiles.end(), older);
+            mFiles.pop_back();
+        }
+        if (mSize >= mTarget) {
+            mCutoff.store(mFiles.front().mod_time, std::memory_order_relaxed);
+        }
+    }
+
+    /* Oldest first. Only once the walk is over. */
+    std::vector<trim_file>& sorted() {
+        std::sort_heap(mFiles.begin(), mFiles.end(), older);
+        return mFiles;
+    }
+
+    size_t seen() const { return mSeen; }
+    int64_t size() const { return mSize; }
+
+private:
+    const int64_t mTarget;
+    std::atomic<int64_t> mCutoff;       /* newest mod time that can still get in */
+    std::atomic<size_t> mSeen{0};
+    std::mutex mLock;
+    int64_t mSize = 0;
+    std::vector<trim_file> mFiles;
+};
+
+}  // namespace
+
+static bool remove_cache_dir(const trim_dir& dir)
+{
+    ALOGI("DEL DIR %s/\n", dir.path.c_str());
+    if (dir.hidden <= 0) {
+        if (rmdir(dir.path.c_str()) < 0) {
+            ALOGE("Couldn't rmdir %s: %s\n", dir.path.c_str(), strerror(errno));
+            return false;
+        }
+    } else if (delete_dir_contents(dir.path.c_str(), 1, NULL)) {
+        return false;
+    }
+    return true;
+}
+
+/* A cache root is never removed, but once it is left with only dot files they go too. */
+static void clear_cache_root(const trim_dir& root)
+{
+    if (root.hidden > 0) {
+        ALOGI("DEL CONTENTS %s/\n", root.path.c_str());
+        delete_dir_contents(root.path.c_str(), 0, NULL);
+    }
+}
+
+/* One of dir's children is gone: remove dir, and its parents, if that left them empty. */
+static void release_cache_dir(std::shared_ptr<trim_dir> dir)
+{
+    while (--dir->children <= 0) {
+        if (dir->parent == nullptr) {
+            clear_cache_root(*dir);
+            return;
+        }
+        if (!remove_cache_dir(*dir)) {
+            return;
+        }
+        dir = dir->parent;
+    }
+}
+
+static void walk_cache_dir(int fd, const std::shared_ptr<trim_dir>& dir, CandidateHeap* heap)
+{
+    DIR* d = fdopendir(fd);
+    if (d == NULL) {
+        ALOGE("Couldn't fdopendir %s: %s\n", dir->path.c_str(), strerror(errno));
+        close(fd);
+        return;
+    }
+    int dfd = dirfd(d);
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const char* name = de->d_name;
+        if (de->d_type == DT_DIR) {
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+            int subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (subfd < 0) {
+                ALOGE("Couldn't openat %s: %s\n", name, strerror(errno));
+                // Still there, so neither is this directory going anywhere
+                dir->children++;
+                continue;
+            }
+            auto subdir = std::make_shared<trim_dir>();
+            subdir->parent = dir;
+            subdir->path = dir->path + "/" + name;
+            subdir->children = 0;
+            subdir->hidden = 0;
+            walk_cache_dir(subfd, subdir, heap);
+            // Empty directories go whether or not anything else has to
+            if (subdir->children > 0 || !remove_cache_dir(*subdir)) {
+                dir->children++;
+            }
+        } else if (de->d_type == DT_REG) {
+            // Skip files that start with '.'; they will be deleted if
+            // their entire directory is deleted.
+            if (name[0] == '.') {
+                dir->hidden++;
+                continue;
+            }
+            struct stat s;
+            if (fstatat(dfd, name, &s, 0) == 0) {
+                if (heap->wanted(s.st_mtime)) {
+                    heap->add(trim_file { s.st_mtime, stat_size(&s), dir, name });
+                }
+                dir->children++;
+            } else {
+                ALOGW("Unable to stat cache file %s/%s; deleting\n", dir->path.c_str(), name);
+                if (unlinkat(dfd, name, 0) < 0) {
+                    ALOGE("Couldn't unlinkat %s: %s\n", name, strerror(errno));
+                }
+            }
+        } else {
+            dir->hidden++;
+        }
+    }
+    closedir(d);
+}
+
+static void walk_cache_roots(const std::vector<std::string>& roots, std::atomic<size_t>* next,
+        CandidateHeap* heap)
+{
+    size_t i;
+    while ((i = (*next)++) < roots.size()) {
+        int fd = open(roots[i].c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        auto root = std::make_shared<trim_dir>();
+        root->path = roots[i];
+        root->children = 0;
+        root->hidden = 0;
+        walk_cache_dir(fd, root, heap);
+        if (root->children == 0) {
+            clear_cache_root(*root);
+        }
+    }
+}
+
+void add_cache_roots(std::vector<std::string>* roots, const char *basepath, const char *cachedir)
+{
+    DIR *d;
+    struct dirent *de;
+
+    d = opendir(basepath);
+    if (d == NULL) {
+        return;
+    }
+
+    std::string base(basepath);
+    if (base.empty() || base.back() != '/') {
+        base += '/';
+    }
+    while ((de = readdir(d))) {
+        if (de->d_type == DT_DIR) {
+            const char *name = de->d_name;
+
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+
+            if (cachedir != NULL) {
+                roots->push_back(base + name + "/" + cachedir);
+            } else {
+                roots->push_back(base + name);
+            }
+        }
+    }
+
+    closedir(d);
+}
+
+void trim_cache_files(const std::string& data_path, const std::vector<std::string>& roots,
+        int64_t free_size)
+{
+    for (int round = 0; round < kMaxTrimRounds; round++) {
+        int64_t avail = data_disk_free(data_path);
+        if (avail < 0 || avail >= free_size) {
+            return;
+        }
+        int64_t needed = free_size - avail;
+        // Keep a little more than needed, the blocks of a file are not always all freed
+        int64_t target = needed + std::min(needed / 4, INT64_MAX - needed);
+
+        CandidateHeap heap(target);
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < std::min(kTrimThreads, roots.size()); t++) {
+            pool.emplace_back(walk_cache_roots, std::cref(roots), &next, &heap);
+        }
+        walk_cache_roots(roots, &next, &heap);
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        std::vector<trim_file>& files = heap.sorted();
+        ALOGI("Collected cache files: %zd seen, %zd oldest kept, %" PRId64 " bytes"
+                " for %" PRId64 " missing", heap.seen(), files.size(), heap.size(), needed);
+        if (files.empty()) {
+            return;
+        }
+
+        int64_t freed = 0;
+        size_t deleted = 0;
+        for (auto& file : files) {
+            std::string path(file.dir->path + "/" + file.name);
+            ALOGI("DEL (mod %d) %s\n", (int)file.mod_time, path.c_str());
+            if (unlink(path.c_str()) < 0) {
+                ALOGE("Couldn't unlink %s: %s\n", path.c_str(), strerror(errno));
+                continue;
+            }
+            release_cache_dir(std::move(file.dir));
+            freed += file.size;
+            deleted++;
+            if (freed >= needed || (deleted % kFreeCheckInterval) == 0) {
+                avail = data_disk_free(data_path);
+                if (avail < 0 || avail >= free_size) {
+                    return;
+                }
+                needed = free_size - avail;
+                freed = 0;
+            }
+        }
+        if (deleted == 0) {
+            return;
+        }
+    }
+}
@@ -20,7 +20,6 @@
 #include <base/logging.h>
 #include <cutils/sched_policy.h>
 #include <diskusage/dirsize.h>
-#include <logwrap/logwrap.h>
 #include <system/thread_defs.h>
 #include <selinux/android.h>
 
@@ -41,8 +40,6 @@ dir_rec_t android_media_dir;
 dir_rec_t android_mnt_expand_dir;
 dir_rec_array_t android_system_dirs;
 
-static const char* kCpPath = "/system/bin/cp";
-
 int install(const char *uuid, const char *pkgname, uid_t uid, gid_t gid, const char *seinfo)
 {
     if ((uid < AID_SYSTEM) || (gid < AID_SYSTEM)) {
@@ -177,6 +174,20 @@ int make_user_data(const char *uuid, const char *pkgname, uid_t uid, userid_t us
     return 0;
 }
 
+static void log_copy_progress(const copy_progress_t* progress, void* cookie) {
+    const std::string* to = reinterpret_cast<const std::string*>(cookie);
+    int64_t elapsed_ms = progress->elapsed_ns / 1000000;
+    uint64_t rate = elapsed_ms > 0 ? progress->bytes * 1000 / elapsed_ms : 0;
+    std::string summary(StringPrintf("%" PRIu64 " of %" PRIu64 " bytes, %" PRIu64 " files in %"
+            PRId64 " ms, %" PRIu64 " bytes/sec", progress->bytes, progress->total_bytes,
+            progress->files, elapsed_ms, rate));
+    if (progress->done) {
+        LOG(INFO) << "Copied " << *to << ": " << summary;
+    } else {
+        LOG(DEBUG) << "Copying " << *to << ": " << summary;
+    }
+}
+
 int copy_complete_app(const char *from_uuid, const char *to_uuid,
         const char *package_name, const char *data_app_name, appid_t appid,
         const char* seinfo) {
@@ -186,25 +197,10 @@ int copy_complete_app(const char *from_uuid, const char *to_uuid,
     {
         std::string from(create_data_app_package_path(from_uuid, data_app_name));
         std::string to(create_data_app_package_path(to_uuid, data_app_name));
-        std::string to_parent(create_data_app_path(to_uuid));
-
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            (char*) from.c_str(),
-            (char*) to_parent.c_str()
-        };
 
         LOG(DEBUG) << "Copying " << from << " to " << to;
-        int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-
-        if (rc != 0) {
-            LOG(ERROR) << "Failed copying " << from << " to " << to
-                    << ": status " << rc;
+        if (copy_tree(from.c_str(), to.c_str(), log_copy_progress, &to) != 0) {
+            LOG(ERROR) << "Failed copying " << from << " to " << to;
             goto fail;
         }
 
@@ -218,7 +214,6 @@ int copy_complete_app(const char *from_uuid, const char *to_uuid,
     for (auto user : users) {
         std::string from(create_data_user_package_path(from_uuid, user, package_name));
         std::string to(create_data_user_package_path(to_uuid, user, package_name));
-        std::string to_parent(create_data_user_path(to_uuid, user));
 
         // Data source may not exist for all users; that's okay
         if (access(from.c_str(), F_OK) != 0) {
@@ -238,23 +233,9 @@ int copy_complete_app(const char *from_uuid, const char *to_uuid,
             goto fail;
         }
 
-        char *argv[] = {
-            (char*) kCpPath,
-            (char*) "-F", /* delete any existing destination file first (--remove-destination) */
-            (char*) "-p", /* preserve timestamps, ownership, and permissions */
-            (char*) "-R", /* recurse into subdirectories (DEST must be a directory) */
-            (char*) "-P", /* Do not follow symlinks [default] */
-            (char*) "-d", /* don't dereference symlinks */
-            (char*) from.c_str(),
-            (char*) to_parent.c_str()
-        };
-
         LOG(DEBUG) << "Copying " << from << " to " << to;
-        int rc = android_fork_execvp(ARRAY_SIZE(argv), argv, NULL, false, true);
-
-        if (rc != 0) {
-            LOG(ERROR) << "Failed copying " << from << " to " << to
-                    << ": status " << rc;
+        if (copy_tree(from.c_str(), to.c_str(), log_copy_progress, &to) != 0) {
+            LOG(ERROR) << "Failed copying " << from << " to " << to;
             goto fail;
         }
     }
@@ -357,7 +338,7 @@ int delete_code_cache(const char *uuid, const char *pkgname, userid_t userid)
  */
 int free_cache(const char *uuid, int64_t free_size)
 {
-    cache_t* cache;
+    std::vector<std::string> roots;
     int64_t avail;
     DIR *d;
     struct dirent *de;
@@ -372,12 +353,10 @@ int free_cache(const char *uuid, int64_t free_size)
     ALOGI("free_cache(%" PRId64 ") avail %" PRId64 "\n", free_size, avail);
     if (avail >= free_size) return 0;
 
-    cache = start_cache_collection();
-
     // Special case for owner on internal storage
     if (uuid == nullptr) {
         std::string _tmpdir(create_data_user_path(nullptr, 0));
-        add_cache_files(cache, _tmpdir.c_str(), "cache");
+        add_cache_roots(&roots, _tmpdir.c_str(), "cache");
     }
 
     // Search for other users and add any cache files from them.
@@ -398,7 +377,7 @@ int free_cache(const char *uuid, int64_t free_size)
                 if ((strlen(name)+(dirpos-tmpdir)) < (sizeof(tmpdir)-1)) {
                     strcpy(dirpos, name);
                     //ALOGI("adding cache files from %s\n", tmpdir);
-                    add_cache_files(cache, tmpdir, "cache");
+                    add_cache_roots(&roots, tmpdir, "cache");
                 } else {
                     ALOGW("Path exceeds limit: %s%s", tmpdir, name);
                 }
@@ -425,7 +404,7 @@ int free_cache(const char *uuid, int64_t free_size)
                     if (lookup_media_dir(tmpdir, "Android") == 0
                             && lookup_media_dir(tmpdir, "data") == 0) {
                         //ALOGI("adding cache files from %s\n", tmpdir);
-                        add_cache_files(cache, tmpdir, "cache");
+                        add_cache_roots(&roots, tmpdir, "cache");
                     }
                 } else {
                     ALOGW("Path exceeds limit: %s%s", tmpdir, name);
@@ -435,8 +414,7 @@ int free_cache(const char *uuid, int64_t free_size)
         closedir(d);
     }
 
-    clear_cache_files(data_path, cache, free_size);
-    finish_cache_collection(cache);
+    trim_cache_files(data_path, roots, free_size);
 
     return data_disk_free(data_path) >= free_size ? 0 : -1;
 }
@@ -505,6 +483,10 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
     int64_t cachesize = 0;
     int64_t asecsize = 0;
 
+    /* directories to size, all walked together once they are known */
+    std::vector<dir_size_t> dirs;
+    std::vector<DIR*> pkgdirs;
+
     /* count the source apk as code -- but only if it's not
      * on the /system partition and its not on the sdcard. */
     if (validate_system_app_path(apkpath) &&
@@ -512,12 +494,7 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
         if (stat(apkpath, &s) == 0) {
             codesize += stat_size(&s);
             if (S_ISDIR(s.st_mode)) {
-                d = opendir(apkpath);
-                if (d != NULL) {
-                    dfd = dirfd(d);
-                    codesize += calculate_dir_size(dfd);
-                    closedir(d);
-                }
+                dirs.push_back(dir_size_t { AT_FDCWD, apkpath, false, true, &codesize });
             }
         }
     }
@@ -538,12 +515,7 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
 
     /* add in size of any libraries */
     if (libdirpath != NULL && libdirpath[0] != '!') {
-        d = opendir(libdirpath);
-        if (d != NULL) {
-            dfd = dirfd(d);
-            codesize += calculate_dir_size(dfd);
-            closedir(d);
-        }
+        dirs.push_back(dir_size_t { AT_FDCWD, libdirpath, false, true, &codesize });
     }
 
     /* compute asec size if it is given */
@@ -569,6 +541,7 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
             PLOG(WARNING) << "Failed to open " << pkgdir;
             continue;
         }
+        pkgdirs.push_back(d);
         dfd = dirfd(d);
 
         /* most stuff in the pkgdir is data, except for the "cache"
@@ -579,28 +552,18 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
             const char *name = de->d_name;
 
             if (de->d_type == DT_DIR) {
-                int subfd;
-                int64_t statsize = 0;
-                int64_t dirsize = 0;
                     /* always skip "." and ".." */
                 if (name[0] == '.') {
                     if (name[1] == 0) continue;
                     if ((name[1] == '.') && (name[2] == 0)) continue;
                 }
-                if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-                    statsize = stat_size(&s);
-                }
-                subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-                if (subfd >= 0) {
-                    dirsize = calculate_dir_size(subfd);
-                }
+                int64_t* total = &datasize;
                 if(!strcmp(name,"lib")) {
-                    codesize += dirsize + statsize;
+                    total = &codesize;
                 } else if(!strcmp(name,"cache")) {
-                    cachesize += dirsize + statsize;
-                } else {
-                    datasize += dirsize + statsize;
+                    total = &cachesize;
                 }
+                dirs.push_back(dir_size_t { dfd, name, true, false, total });
             } else if (de->d_type == DT_LNK && !strcmp(name,"lib")) {
                 // This is the symbolic link to the application's library
                 // code.  We'll count this as code instead of data, since
@@ -614,8 +577,13 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
                 }
             }
         }
-        closedir(d);
     }
+
+    calculate_dir_sizes(dirs.data(), dirs.size());
+    for (auto pkgdir : pkgdirs) {
+        closedir(pkgdir);
+    }
+
     *_codesize = codesize;
     *_datasize = datasize;
     *_cachesize = cachesize;
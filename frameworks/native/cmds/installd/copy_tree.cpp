@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "installd.h"
+
+#include <base/logging.h>
+#include <utils/FileCopy.h>
+
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * Copies a tree as "cp -F -p -R -P -d" would, without the child process. The tree is walked
+ * once: directories, links and special files are made as they are found, regular files are
+ * created empty and their contents are copied afterwards by a few threads, in chunks so that
+ * a large apk is shared between them too. Contents are reflinked when both sides are on a
+ * filesystem that can, otherwise moved in the kernel by copyFileRange(). Reflinks and
+ * copy_file_range need 4.5 kernel headers; built against older ones, it is all sendfile.
+ *
+ * Ownership, mode, timestamps and extended attributes are kept, except for the SELinux label:
+ * callers restorecon what they copied. Directories get theirs last, once nothing more is
+ * written to them.
+ */
+
+static constexpr size_t kCopyThreads = 4;
+static constexpr off64_t kChunkSize = 16 * 1024 * 1024;
+static constexpr size_t kIoSize = 1024 * 1024;            /* progress is counted in these */
+static constexpr int64_t kProgressIntervalNs = 1000000000LL;
+
+static const char* kSELinuxXattr = "security.selinux";
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+namespace {
+
+struct copy_file {
+    std::string from;
+    std::string to;
+    struct stat st;
+    std::atomic<size_t> chunks_left;
+};
+
+struct copy_chunk {
+    copy_file* file;
+    off64_t offset;
+    off64_t length;
+};
+
+struct copy_entry {
+    std::string from;
+    std::string to;
+    struct stat st;
+};
+
+class TreeCopier {
+public:
+    TreeCopier(copy_progress_cb progress, void* cookie) : mProgress(progress), mCookie(cookie) {}
+    int copy(const char* from, const char* to);
+
+private:
+    bool walk(const std::string& from, const std::string& to, const struct stat& st);
+    bool make_file(const std::string& from, const std::string& to, const struct stat& st);
+    bool make_dir(const std::string& to);
+    bool make_link(const std::string& from, const std::string& to, const struct stat& st);
+    bool make_node(const std::string& to, const struct stat& st);
+    bool remove_existing(const std::string& to);
+
+    void thread_main();
+    bool copy_chunk_contents(const copy_chunk& chunk);
+    bool finish_file(copy_file* file, int fd);
+    bool finish_path(const copy_entry& entry);
+    void report(bool done);
+
+    copy_progress_cb mProgress;
+    void* mCookie;
+    std::deque<std::unique_ptr<copy_file>> mFiles;
+    std::vector<copy_chunk> mChunks;
+    std::vector<copy_entry> mDirs;        /* parents before children */
+    bool mCanClone = true;
+    int64_t mStartNs = 0;
+    uint64_t mTotalBytes = 0;
+
+    std::atomic<size_t> mNextChunk{0};
+    std::atomic<uint64_t> mFilesDone{0};
+    std::atomic<uint64_t> mBytesDone{0};
+    std::atomic<bool> mFailed{false};
+
+    std::mutex mLock;
+    std::condition_variable mDoneCond;
+    size_t mRunning = 0;                /* threads still copying */
+};
+
+static bool copy_xattrs(const std::string& from, const std::string& to) {
+    ssize_t len = llistxattr(from.c_str(), NULL, 0);
+    if (len <= 0) {
+        return true;
+    }
+    std::unique_ptr<char[]> names(new char[len]);
+    len = llistxattr(from.c_str(), names.get(), len);
+    if (len < 0) {
+        PLOG(ERROR) << "Failed to list attributes of " << from;
+        return false;
+    }
+    std::vector<char> value;
+    for (const char* name = names.get(); name < names.get() + len; name += strlen(name) + 1) {
+        if (!strcmp(name, kSELinuxXattr)) {
+            continue;
+        }
+        ssize_t size = lgetxattr(from.c_str(), name, NULL, 0);
+        if (size < 0) {
+            PLOG(ERROR) << "Failed to read attribute " << name << " of " << from;
+            return false;
+        }
+        value.resize(size);
+        size = lgetxattr(from.c_str(), name, value.data(), value.size());
+        if (size < 0
+                || lsetxattr(to.c_str(), name, value.data(), size, 0) != 0) {
+            PLOG(ERROR) << "Failed to copy attribute " << name << " of " << from;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool set_times(const std::string& to, const struct stat& st) {
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (utimensat(AT_FDCWD, to.c_str(), times, AT_SYMLINK_NOFOLLOW) != 0) {
+        PLOG(ERROR) << "Failed to set times of " << to;
+        return false;
+    }
+    return true;
+}
+
+int TreeCopier::copy(const char* from, const char* to) {
+    struct stat st;
+    mStartNs = now_ns();
+    if (lstat(from, &st) != 0) {
+        PLOG(ERROR) << "Failed to stat " << from;
+        return -1;
+    }
+    if (!walk(from, to, st)) {
+        return -1;
+    }
+
+    size_t threads = std::min(kCopyThreads, mChunks.size());
+    std::vector<std::thread> pool;
+    mRunning = threads;
+    for (size_t i = 0; i < threads; i++) {
+        pool.emplace_back(&TreeCopier::thread_main, this);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (mRunning > 0) {
+            if (mDoneCond.wait_for(lock, std::chrono::nanoseconds(kProgressIntervalNs))
+                    == std::cv_status::timeout) {
+                lock.unlock();
+                report(false);
+                lock.lock();
+            }
+        }
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    if (mFailed) {
+        return -1;
+    }
+
+    // Children first, so that setting a directory's times is the last change made to it
+    for (auto it = mDirs.rbegin(); it != mDirs.rend(); ++it) {
+        if (!finish_path(*it)) {
+            return -1;
+        }
+    }
+    report(true);
+    return 0;
+}
+
+bool TreeCopier::walk(const std::string& from, const std::string& to, const struct stat& st) {
+    if (S_ISREG(st.st_mode)) {
+        return make_file(from, to, st);
+    } else if (S_ISLNK(st.st_mode)) {
+        return make_link(from, to, st);
+    } else if (!S_ISDIR(st.st_mode)) {
+        return make_node(to, st) && finish_path(copy_entry { from, to, st });
+    }
+
+    if (!make_dir(to)) {
+        return false;
+    }
+    mDirs.push_back(copy_entry { from, to, st });
+    mFilesDone++;
+
+    DIR* d = opendir(from.c_str());
+    if (d == NULL) {
+        PLOG(ERROR) << "Failed to open " << from;
+        return false;
+    }
+    bool ok = true;
+    struct dirent* de;
+    while (ok && (de = readdir(d))) {
+        const char* name = de->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+        std::string child_from = from + "/" + name;
+        std::string child_to = to + "/" + name;
+        struct stat child_st;
+        if (lstat(child_from.c_str(), &child_st) != 0) {
+            PLOG(ERROR) << "Failed to stat " << child_from;
+            ok = false;
+        } else {
+            ok = walk(child_from, child_to, child_st);
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+bool TreeCopier::remove_existing(const std::string& to) {
+    if (unlink(to.c_str()) != 0 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to remove " << to;
+        return false;
+    }
+    return true;
+}
+
+bool TreeCopier::make_dir(const std::string& to) {
+    // Writable by us until its own mode is set
+    if (mkdir(to.c_str(), 0700) == 0) {
+        return true;
+    }
+    struct stat st;
+    if (errno == EEXIST && lstat(to.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        return true;
+    }
+    PLOG(ERROR) << "Failed to create " << to;
+    return false;
+}
+
+bool TreeCopier::make_link(const std::string& from, const std::string& to,
+        const struct stat& st) {
+    std::vector<char> target(st.st_size + 1);
+    ssize_t len = readlink(from.c_str(), target.data(), target.size());
+    if (len < 0 || (size_t) len >= target.size()) {
+        PLOG(ERROR) << "Failed to read link " << from;
+        return false;
+    }
+    target[len] = 0;
+    if (!remove_existing(to)) {
+        return false;
+    }
+    if (symlink(target.data(), to.c_str()) != 0) {
+        PLOG(ERROR) << "Failed to create link " << to;
+        return false;
+    }
+    if (lchown(to.c_str(), st.st_uid, st.st_gid) != 0) {
+        PLOG(ERROR) << "Failed to chown " << to;
+        return false;
+    }
+    mFilesDone++;
+    return set_times(to, st);
+}
+
+bool TreeCopier::make_node(const std::string& to, const struct stat& st) {
+    if (!remove_existing(to)) {
+        return false;
+    }
+    if (mknod(to.c_str(), (st.st_mode & S_IFMT) | 0600, st.st_rdev) != 0) {
+        PLOG(ERROR) << "Failed to create " << to;
+        return false;
+    }
+    mFilesDone++;
+    return true;
+}
+
+bool TreeCopier::make_file(const std::string& from, const std::string& to,
+        const struct stat& st) {
+    if (!remove_existing(to)) {
+        return false;
+    }
+    int fd = open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to create " << to;
+        return false;
+    }
+
+    mFiles.emplace_back(new copy_file);
+    copy_file* file = mFiles.back().get();
+    file->from = from;
+    file->to = to;
+    file->st = st;
+    file->chunks_left = 0;
+    mTotalBytes += st.st_size;
+
+    // A clone is cheap enough to make here; empty files have nothing to wait for either
+    bool done = st.st_size == 0;
+#if defined(FICLONE)
+    if (!done && mCanClone) {
+        int from_fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (from_fd >= 0) {
+            if (ioctl(fd, FICLONE, from_fd) == 0) {
+                mBytesDone += st.st_size;
+                done = true;
+            } else if (errno == EOPNOTSUPP || errno == ENOTTY || errno == EXDEV
+                    || errno == EINVAL) {
+                mCanClone = false;
+            }
+            close(from_fd);
+        }
+    }
+#endif
+    if (done) {
+        bool ok = finish_file(file, fd);
+        close(fd);
+        return ok;
+    }
+    close(fd);
+
+    size_t chunks = (st.st_size + kChunkSize - 1) / kChunkSize;
+    file->chunks_left = chunks;
+    for (size_t i = 0; i < chunks; i++) {
+        off64_t offset = i * kChunkSize;
+        off64_t length = std::min<off64_t>(kChunkSize, st.st_size - offset);
+        mChunks.push_back(copy_chunk { file, offset, length });
+    }
+    return true;
+}
+
+void TreeCopier::thread_main() {
+    size_t i;
+    while (!mFailed && (i = mNextChunk++) < mChunks.size()) {
+        const copy_chunk& chunk = mChunks[i];
+        if (!copy_chunk_contents(chunk)) {
+            mFailed = true;
+            break;
+        }
+        if (--chunk.file->chunks_left == 0) {
+            int fd = open(chunk.file->to.c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0 || !finish_file(chunk.file, fd)) {
+                if (fd < 0) {
+                    PLOG(ERROR) << "Failed to open " << chunk.file->to;
+                }
+                mFailed = true;
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (--mRunning == 0) {
+        mDoneCond.notify_all();
+    }
+}
+
+bool TreeCopier::copy_chunk_contents(const copy_chunk& chunk) {
+    const copy_file* file = chunk.file;
+    int in = open(file->from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        PLOG(ERROR) << "Failed to open " << file->from;
+        return false;
+    }
+    int out = open(file->to.c_str(), O_WRONLY | O_CLOEXEC);
+    if (out < 0) {
+        PLOG(ERROR) << "Failed to open " << file->to;
+        close(in);
+        return false;
+    }
+
+    off64_t offset = chunk.offset;
+    off64_t left = chunk.length;
+    bool ok = true;
+    while (left > 0) {
+        size_t len = std::min((off64_t) kIoSize, left);
+        ssize_t n = android::copyFileRange(in, offset, out, offset, len);
+        if (n < 0) {
+            PLOG(ERROR) << "Failed to copy " << file->from << " to " << file->to;
+            ok = false;
+            break;
+        }
+        offset += n;
+        left -= n;
+        mBytesDone += n;
+        if ((size_t) n < len) {
+            // Shorter than it was when it was walked: copy what there is, as cp would
+            break;
+        }
+    }
+    close(out);
+    close(in);
+    return ok;
+}
+
+bool TreeCopier::finish_file(copy_file* file, int fd) {
+    const struct stat& st = file->st;
+    // Owner before mode, a chown clears the set-id bits
+    if (fchown(fd, st.st_uid, st.st_gid) != 0 || fchmod(fd, st.st_mode & 07777) != 0) {
+        PLOG(ERROR) << "Failed to set owner and mode of " << file->to;
+        return false;
+    }
+    if (!copy_xattrs(file->from, file->to)) {
+        return false;
+    }
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    if (futimens(fd, times) != 0) {
+        PLOG(ERROR) << "Failed to set times of " << file->to;
+        return false;
+    }
+    mFilesDone++;
+    return true;
+}
+
+/* Directories and special files, which are not opened to be written. */
+bool TreeCopier::finish_path(const copy_entry& entry) {
+    const struct stat& st = entry.st;
+    if (lchown(entry.to.c_str(), st.st_uid, st.st_gid) != 0
+            || chmod(entry.to.c_str(), st.st_mode & 07777) != 0) {
+        PLOG(ERROR) << "Failed to set owner and mode of " << entry.to;
+        return false;
+    }
+    return copy_xattrs(entry.from, entry.to) && set_times(entry.to, st);
+}
+
+void TreeCopier::report(bool done) {
+    if (mProgress == NULL) {
+        return;
+    }
+    copy_progress_t progress;
+    progress.files = mFilesDone;
+    progress.bytes = mBytesDone;
+    progress.total_bytes = mTotalBytes;
+    progress.elapsed_ns = now_ns() - mStartNs;
+    progress.done = done;
+    mProgress(&progress, mCookie);
+}
+
+}  // namespace
+
+int copy_tree(const char* from, const char* to, copy_progress_cb progress, void* cookie) {
+    TreeCopier copier(progress, cookie);
+    return copier.copy(from, to);
+}
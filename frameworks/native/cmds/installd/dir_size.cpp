@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "installd.h"
+
+#include <base/logging.h>
+#include <diskusage/dirsize.h>
+
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * Sizes directory trees the way calculate_dir_size() does -- every entry of every directory,
+ * "." and ".." included, by blocks used -- with a few threads sharing the directories of all
+ * the trees asked for at once. Directories are read with getdents64 and entries stat'ed with
+ * statx where the kernel has it.
+ *
+ * Immutable trees are the code of a package: installd and the package manager replace their
+ * files, they never write them in place, so a directory whose inode, mtime and ctime are
+ * unchanged still holds the same files. Their listings and sizes are cached, and a rewalk
+ * only stats the directories. Other trees are always walked in full: apps append to their
+ * files and databases in place, which changes no directory.
+ */
+
+static constexpr size_t kWalkerThreads = 4;
+static constexpr size_t kMaxCachedDirs = 16384;
+static constexpr size_t kDentsBufSize = 32 * 1024;
+
+namespace {
+
+struct entry_stat {
+    bool valid;
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    int64_t size;    /* as stat_size() */
+};
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+#if defined(__NR_statx) && defined(STATX_BASIC_STATS)
+static std::atomic<bool> sHaveStatx(true);
+#endif
+
+static void stat_entry(int dfd, const char* name, int flags, entry_stat* st) {
+    struct stat s;
+
+    st->valid = false;
+#if defined(__NR_statx) && defined(STATX_BASIC_STATS)
+    if (sHaveStatx) {
+        struct statx stx;
+        unsigned int mask = STATX_INO | STATX_BLOCKS | STATX_MTIME | STATX_CTIME;
+        if (syscall(__NR_statx, dfd, name, flags, mask, &stx) == 0) {
+            memset(&s, 0, sizeof(s));
+            s.st_blocks = stx.stx_blocks;
+            s.st_blksize = stx.stx_blksize;
+            st->valid = true;
+            st->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            st->ino = stx.stx_ino;
+            st->mtime_ns = stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+            st->ctime_ns = stx.stx_ctime.tv_sec * 1000000000LL + stx.stx_ctime.tv_nsec;
+            st->size = stat_size(&s);
+            return;
+        }
+        if (errno != ENOSYS) {
+            return;
+        }
+        sHaveStatx = false;
+    }
+#endif
+    if (fstatat(dfd, name, &s, flags) == 0) {
+        st->valid = true;
+        st->dev = s.st_dev;
+        st->ino = s.st_ino;
+        st->mtime_ns = s.st_mtim.tv_sec * 1000000000LL + s.st_mtim.tv_nsec;
+        st->ctime_ns = s.st_ctim.tv_sec * 1000000000LL + s.st_ctim.tv_nsec;
+        st->size = stat_size(&s);
+    }
+}
+
+struct scoped_fd {
+    explicit scoped_fd(int fd) : fd(fd) {}
+    ~scoped_fd() { if (fd >= 0) close(fd); }
+    int fd;
+};
+
+/* What an immutable directory held when it was last read. */
+struct cached_dir {
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    int64_t files_size;      /* entries other than ".", ".." and directories */
+    bool has_dot;
+    bool has_dotdot;
+    std::vector<std::string> subdirs;
+};
+
+struct walk_task {
+    std::shared_ptr<scoped_fd> parent;  /* null for a root, which is found from dir->dfd */
+    std::string name;
+    int64_t parent_size;     /* for "..", unknown for a root */
+    dir_size_t* dir;
+    bool root;
+};
+
+class DirSizeWalker {
+public:
+    void walk(dir_size_t* dirs, size_t count);
+
+private:
+    void start_threads();
+    void thread_main();
+    void run_tasks(std::unique_lock<std::mutex>& lock, char* buf);
+    void process(const walk_task& task, char* buf, std::vector<walk_task>* children);
+
+    std::mutex mWalkLock;        /* one walk at a time */
+    std::mutex mLock;            /* everything below */
+    std::condition_variable mWorkCond;
+    std::condition_variable mDoneCond;
+    std::vector<walk_task> mTasks;
+    size_t mPending = 0;         /* tasks queued or being processed */
+    bool mStarted = false;
+    std::map<std::pair<dev_t, ino_t>, cached_dir> mCache;
+};
+
+void DirSizeWalker::walk(dir_size_t* dirs, size_t count) {
+    std::lock_guard<std::mutex> walk_lock(mWalkLock);
+    std::unique_lock<std::mutex> lock(mLock);
+
+    start_threads();
+    for (size_t i = 0; i < count; i++) {
+        walk_task task;
+        task.name = dirs[i].name;
+        task.parent_size = 0;
+        task.dir = &dirs[i];
+        task.root = true;
+        mTasks.push_back(task);
+        mPending++;
+    }
+    mWorkCond.notify_all();
+
+    std::unique_ptr<char[]> buf(new char[kDentsBufSize]);
+    run_tasks(lock, buf.get());
+    mDoneCond.wait(lock, [this] { return mPending == 0; });
+}
+
+void DirSizeWalker::start_threads() {
+    if (mStarted) {
+        return;
+    }
+    mStarted = true;
+    for (size_t i = 0; i < kWalkerThreads; i++) {
+        // installd never exits cleanly, the threads live as long as it does
+        std::thread(&DirSizeWalker::thread_main, this).detach();
+    }
+}
+
+void DirSizeWalker::thread_main() {
+    std::unique_ptr<char[]> buf(new char[kDentsBufSize]);
+    std::unique_lock<std::mutex> lock(mLock);
+    for (;;) {
+        mWorkCond.wait(lock, [this] { return !mTasks.empty(); });
+        run_tasks(lock, buf.get());
+    }
+}
+
+/* Called with mLock held, processes tasks until there are none left to take. */
+void DirSizeWalker::run_tasks(std::unique_lock<std::mutex>& lock, char* buf) {
+    std::vector<walk_task> children;
+    while (!mTasks.empty()) {
+        // Depth first, so that few directories are open at once
+        walk_task task(std::move(mTasks.back()));
+        mTasks.pop_back();
+        lock.unlock();
+
+        children.clear();
+        process(task, buf, &children);
+        task.parent.reset();
+
+        lock.lock();
+        if (!children.empty()) {
+            for (auto& child : children) {
+                mTasks.push_back(std::move(child));
+            }
+            mPending += children.size();
+            mWorkCond.notify_all();
+        }
+        if (--mPending == 0) {
+            mDoneCond.notify_all();
+        }
+    }
+}
+
+void DirSizeWalker::process(const walk_task& task, char* buf, std::vector<walk_task>* children) {
+    const dir_size_t* dir = task.dir;
+    int parent_fd = task.root ? dir->dfd : task.parent->fd;
+    int64_t size = 0;
+
+    // Roots are found as stat() and opendir() find them, below them links are not followed
+    entry_stat st;
+    stat_entry(parent_fd, task.name.c_str(), task.root ? 0 : AT_SYMLINK_NOFOLLOW, &st);
+    if (st.valid && (!task.root || dir->count_self)) {
+        size += st.size;
+    }
+
+    int fd = openat(parent_fd, task.name.c_str(),
+            O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.root ? 0 : O_NOFOLLOW));
+    if (fd < 0) {
+        std::lock_guard<std::mutex> lock(mLock);
+        *dir->total += size;
+        return;
+    }
+    auto self = std::make_shared<scoped_fd>(fd);
+
+    int64_t self_size = st.valid ? st.size : 0;
+    int64_t parent_size = task.parent_size;
+    if (task.root) {
+        entry_stat parent_st;
+        stat_entry(fd, "..", AT_SYMLINK_NOFOLLOW, &parent_st);
+        parent_size = parent_st.valid ? parent_st.size : 0;
+    }
+
+    bool cacheable = dir->immutable && st.valid;
+    std::pair<dev_t, ino_t> key(st.dev, st.ino);
+    if (cacheable) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mCache.find(key);
+        if (it != mCache.end() && it->second.mtime_ns == st.mtime_ns
+                && it->second.ctime_ns == st.ctime_ns) {
+            const cached_dir& cached = it->second;
+            size += cached.files_size;
+            size += cached.has_dot ? self_size : 0;
+            size += cached.has_dotdot ? parent_size : 0;
+            for (const auto& name : cached.subdirs) {
+                children->push_back(walk_task { self, name, self_size, task.dir, false });
+            }
+            *dir->total += size;
+            return;
+        }
+    }
+
+    cached_dir listing;
+    listing.mtime_ns = st.mtime_ns;
+    listing.ctime_ns = st.ctime_ns;
+    listing.files_size = 0;
+    listing.has_dot = false;
+    listing.has_dotdot = false;
+
+    int n;
+    while ((n = syscall(__NR_getdents64, fd, buf, kDentsBufSize)) > 0) {
+        for (int pos = 0; pos < n; ) {
+            const linux_dirent64* de = (const linux_dirent64*) (buf + pos);
+            const char* name = de->d_name;
+            pos += de->d_reclen;
+
+            if (name[0] == '.' && name[1] == 0) {
+                listing.has_dot = true;
+            } else if (name[0] == '.' && name[1] == '.' && name[2] == 0) {
+                listing.has_dotdot = true;
+            } else if (de->d_type == DT_DIR) {
+                // sized, as a whole, by its own task
+                children->push_back(walk_task { self, name, self_size, task.dir, false });
+                if (cacheable) {
+                    listing.subdirs.push_back(name);
+                }
+            } else {
+                entry_stat entry;
+                stat_entry(fd, name, AT_SYMLINK_NOFOLLOW, &entry);
+                if (entry.valid) {
+                    listing.files_size += entry.size;
+                }
+            }
+        }
+    }
+    if (n < 0) {
+        PLOG(WARNING) << "Failed to read " << task.name;
+        cacheable = false;
+    }
+
+    size += listing.files_size;
+    size += listing.has_dot ? self_size : 0;
+    size += listing.has_dotdot ? parent_size : 0;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    *dir->total += size;
+    if (cacheable) {
+        if (mCache.size() >= kMaxCachedDirs) {
+            mCache.clear();
+        }
+        mCache[key] = std::move(listing);
+    }
+}
+
+}  // namespace
+
+void calculate_dir_sizes(dir_size_t* dirs, size_t count) {
+    static DirSizeWalker* walker = new DirSizeWalker();
+    if (count > 0) {
+        walker->walk(dirs, count);
+    }
+}
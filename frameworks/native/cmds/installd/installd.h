@@ -113,33 +113,6 @@ extern dir_rec_t android_media_dir;
 extern dir_rec_t android_mnt_expand_dir;
 extern dir_rec_array_t android_system_dirs;
 
-typedef struct cache_dir_struct {
-    struct cache_dir_struct* parent;
-    int32_t childCount;
-    int32_t hiddenCount;
-    int32_t deleted;
-    char name[];
-} cache_dir_t;
-
-typedef struct {
-    cache_dir_t* dir;
-    time_t modTime;
-    char name[];
-} cache_file_t;
-
-typedef struct {
-    size_t numDirs;
-    size_t availDirs;
-    cache_dir_t** dirs;
-    size_t numFiles;
-    size_t availFiles;
-    cache_file_t** files;
-    size_t numCollected;
-    void* memBlocks;
-    int8_t* curMemBlockAvail;
-    int8_t* curMemBlockEnd;
-} cache_t;
-
 /* util.c */
 
 int create_pkg_path(char path[PKG_PATH_MAX],
@@ -186,14 +159,6 @@ int lookup_media_dir(char basepath[PATH_MAX], const char *dir);
 
 int64_t data_disk_free(const std::string& data_path);
 
-cache_t* start_cache_collection();
-
-void add_cache_files(cache_t* cache, const char *basepath, const char *cachedir);
-
-void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t free_size);
-
-void finish_cache_collection(cache_t* cache);
-
 int validate_system_app_path(const char* path);
 
 int get_path_from_env(dir_rec_t* rec, const char* var);
@@ -216,6 +181,39 @@ int ensure_config_user_dirs(userid_t userid);
 int create_profile_file(const char *pkgname, gid_t gid);
 void remove_profile_file(const char *pkgname);
 
+/* dir_size.cpp */
+
+typedef struct {
+    int dfd;                /* directory holding name, or AT_FDCWD */
+    std::string name;       /* directory to size */
+    bool count_self;        /* count the directory's own entry as well as its contents */
+    bool immutable;         /* only ever replaced, never changed in place: code */
+    int64_t* total;         /* the size is added to this */
+} dir_size_t;
+
+void calculate_dir_sizes(dir_size_t* dirs, size_t count);
+
+/* copy_tree.cpp */
+
+typedef struct {
+    uint64_t files;         /* entries copied so far */
+    uint64_t bytes;         /* file contents copied so far */
+    uint64_t total_bytes;   /* file contents to copy */
+    int64_t elapsed_ns;
+    bool done;
+} copy_progress_t;
+
+typedef void (*copy_progress_cb)(const copy_progress_t* progress, void* cookie);
+
+int copy_tree(const char* from, const char* to, copy_progress_cb progress, void* cookie);
+
+/* cache_trim.cpp */
+
+void add_cache_roots(std::vector<std::string>* roots, const char *basepath, const char *cachedir);
+
+void trim_cache_files(const std::string& data_path, const std::vector<std::string>& roots,
+        int64_t free_size);
+
 /* commands.c */
 
 int install(const char *uuid, const char *pkgname, uid_t uid, gid_t gid, const char *seinfo);
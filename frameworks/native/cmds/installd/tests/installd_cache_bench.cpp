@@ -0,0 +1,715 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <diskusage/dirsize.h>
+
+#include "installd.h"
+
+// Lays out the cache dirs of many packages, with files of all ages, and frees part of them:
+// once collecting every cache file and sorting them, as free_cache() used to, and once with
+// trim_cache_files(). Each runs in a child, so that its peak memory can be told apart. Checks
+// that enough was freed, that no file was deleted while an older one was kept, and that no
+// empty directories are left behind.
+
+// Run it like this:
+//
+// installd_cache_bench -d /data/local/tmp/cache_bench -p 200 -f 2000 -r 10
+
+struct CacheFile {
+    std::string path;
+    time_t modTime;
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-p <packages>] [-f <files>] [-r <percent>]\n", me);
+    fprintf(stderr, "       -d directory to lay the cache out in, created if needed\n");
+    fprintf(stderr, "       -p packages, default 200\n");
+    fprintf(stderr, "       -f cache files per package, default 2000\n");
+    fprintf(stderr, "       -r percent of the cache to free, default 10\n");
+    exit(1);
+}
+
+static void makeDir(const std::string& path) {
+    if (mkdir(path.c_str(), 0771) != 0 && errno != EEXIST) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void writeFile(const std::string& path, size_t size, time_t modTime) {
+    static char buf[16384];
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 || write(fd, buf, size) != (ssize_t) size) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    struct timespec times[2] = { { modTime, 0 }, { modTime, 0 } };
+    utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+/* Returns the total size of the cache files, as trimming counts it. */
+static int64_t layOut(const std::string& root, int packages, int files) {
+    int64_t total = 0;
+    unsigned seed = 1;
+    time_t now = time(NULL);
+    makeDir(root);
+    for (int p = 0; p < packages; p++) {
+        std::string cache = root + "/com.example.pkg" + std::to_string(p) + "/cache";
+        makeDir(root + "/com.example.pkg" + std::to_string(p));
+        makeDir(cache);
+        makeDir(cache + "/empty");
+        makeDir(cache + "/images");
+        writeFile(cache + "/images/.nomedia", 0, now);
+        for (int f = 0; f < files; f++) {
+            std::string dir = cache;
+            if (f % 4 == 0) {
+                dir += "/images";
+            } else if (f % 16 == 1) {
+                dir += "/http/" + std::to_string(f % 7);
+                makeDir(cache + "/http");
+                makeDir(dir);
+            }
+            std::string path = dir + "/f" + std::to_string(f);
+            writeFile(path, 1 + rand_r(&seed) % 16384, now - rand_r(&seed) % (30 * 86400));
+            struct stat s;
+            if (stat(path.c_str(), &s) == 0) {
+                total += stat_size(&s);
+            }
+        }
+    }
+    return total;
+}
+
+static void removeTree(const std::string& path) {
+    delete_dir_contents(path.c_str(), 1, NULL);
+}
+
+/* Visible cache files, and whether there are empty directories below the cache roots. */
+static void inventory(const std::string& path, int depth, std::vector<CacheFile>* files,
+        bool* emptyDirs) {
+    DIR* d = opendir(path.c_str());
+    if (d == NULL) {
+        return;
+    }
+    bool empty = true;
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const char* name = de->d_name;
+        if (!strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+        std::string child = path + "/" + name;
+        if (de->d_type == DT_DIR) {
+            inventory(child, depth + 1, files, emptyDirs);
+            empty = false;
+        } else if (name[0] != '.') {
+            struct stat s;
+            if (stat(child.c_str(), &s) == 0) {
+                files->push_back(CacheFile { child, s.st_mtime });
+            }
+            empty = false;
+        }
+    }
+    closedir(d);
+    // root, package, cache root, then what may be removed
+    if (empty && depth > 2) {
+        *emptyDirs = true;
+    }
+}
+
+/*
+ * The baseline: free_cache() as it was before trim_cache_files(), which collects every cache
+ * file and directory of every package, sorts them all by age, and deletes from the oldest.
+ */
+
+#define CACHE_NOISY(x) //x
+
+typedef struct cache_dir_struct {
+    struct cache_dir_struct* parent;
+    int32_t childCount;
+    int32_t hiddenCount;
+    int32_t deleted;
+    char name[];
+} cache_dir_t;
+
+typedef struct {
+    cache_dir_t* dir;
+    time_t modTime;
+    char name[];
+} cache_file_t;
+
+typedef struct {
+    size_t numDirs;
+    size_t availDirs;
+    cache_dir_t** dirs;
+    size_t numFiles;
+    size_t availFiles;
+    cache_file_t** files;
+    size_t numCollected;
+    void* memBlocks;
+    int8_t* curMemBlockAvail;
+    int8_t* curMemBlockEnd;
+} cache_t;
+
+static cache_t* start_cache_collection()
+{
+    cache_t* cache = (cache_t*)calloc(1, sizeof(cache_t));
+    return cache;
+}
+
+#define CACHE_BLOCK_SIZE (512*1024)
+
+static void* _cache_malloc(cache_t* cache, size_t len)
+{
+    len = (len+3)&~3;
+    if (len > (CACHE_BLOCK_SIZE/2)) {
+        // It doesn't make sense to try to put this allocation into one
+        // of our blocks, because it is so big.  Instead, make a new dedicated
+        // block for it.
+        int8_t* res = (int8_t*)malloc(len+sizeof(void*));
+        if (res == NULL) {
+            return NULL;
+        }
+        CACHE_NOISY(ALOGI("Allocated large cache mem block: %p size %d", res, len));
+        // Link it into our list of blocks, not disrupting the current one.
+        if (cache->memBlocks == NULL) {
+            *(void**)res = NULL;
+            cache->memBlocks = res;
+        } else {
+            *(void**)res = *(void**)cache->memBlocks;
+            *(void**)cache->memBlocks = res;
+        }
+        return res + sizeof(void*);
+    }
+    int8_t* res = cache->curMemBlockAvail;
+    int8_t* nextPos = res + len;
+    if (cache->memBlocks == NULL || nextPos > cache->curMemBlockEnd) {
+        int8_t* newBlock = (int8_t*) malloc(CACHE_BLOCK_SIZE);
+        if (newBlock == NULL) {
+            return NULL;
+        }
+        CACHE_NOISY(ALOGI("Allocated new cache mem block: %p", newBlock));
+        *(void**)newBlock = cache->memBlocks;
+        cache->memBlocks = newBlock;
+        res = cache->curMemBlockAvail = newBlock + sizeof(void*);
+        cache->curMemBlockEnd = newBlock + CACHE_BLOCK_SIZE;
+        nextPos = res + len;
+    }
+    CACHE_NOISY(ALOGI("cache_malloc: ret %p size %d, block=%p, nextPos=%p",
+            res, len, cache->memBlocks, nextPos));
+    cache->curMemBlockAvail = nextPos;
+    return res;
+}
+
+static void* _cache_realloc(cache_t* cache, void* cur, size_t origLen, size_t len)
+{
+    // This isn't really a realloc, but it is good enough for our purposes here.
+    void* alloc = _cache_malloc(cache, len);
+    if (alloc != NULL && cur != NULL) {
+        memcpy(alloc, cur, origLen < len ? origLen : len);
+    }
+    return alloc;
+}
+
+static void _inc_num_cache_collected(cache_t* cache)
+{
+    cache->numCollected++;
+    if ((cache->numCollected%20000) == 0) {
+        ALOGI("Collected cache so far: %zd directories, %zd files",
+            cache->numDirs, cache->numFiles);
+    }
+}
+
+static cache_dir_t* _add_cache_dir_t(cache_t* cache, cache_dir_t* parent, const char *name)
+{
+    size_t nameLen = strlen(name);
+    cache_dir_t* dir = (cache_dir_t*)_cache_malloc(cache, sizeof(cache_dir_t)+nameLen+1);
+    if (dir != NULL) {
+        dir->parent = parent;
+        dir->childCount = 0;
+        dir->hiddenCount = 0;
+        dir->deleted = 0;
+        strcpy(dir->name, name);
+        if (cache->numDirs >= cache->availDirs) {
+            size_t newAvail = cache->availDirs < 1000 ? 1000 : cache->availDirs*2;
+            cache_dir_t** newDirs = (cache_dir_t**)_cache_realloc(cache, cache->dirs,
+                    cache->availDirs*sizeof(cache_dir_t*), newAvail*sizeof(cache_dir_t*));
+            if (newDirs == NULL) {
+                ALOGE("Failure growing cache dirs array for %s\n", name);
+                return NULL;
+            }
+            cache->availDirs = newAvail;
+            cache->dirs = newDirs;
+        }
+        cache->dirs[cache->numDirs] = dir;
+        cache->numDirs++;
+        if (parent != NULL) {
+            parent->childCount++;
+        }
+        _inc_num_cache_collected(cache);
+    } else {
+        ALOGE("Failure allocating cache_dir_t for %s\n", name);
+    }
+    return dir;
+}
+
+static cache_file_t* _add_cache_file_t(cache_t* cache, cache_dir_t* dir, time_t modTime,
+        const char *name)
+{
+    size_t nameLen = strlen(name);
+    cache_file_t* file = (cache_file_t*)_cache_malloc(cache, sizeof(cache_file_t)+nameLen+1);
+    if (file != NULL) {
+        file->dir = dir;
+        file->modTime = modTime;
+        strcpy(file->name, name);
+        if (cache->numFiles >= cache->availFiles) {
+            size_t newAvail = cache->availFiles < 1000 ? 1000 : cache->availFiles*2;
+            cache_file_t** newFiles = (cache_file_t**)_cache_realloc(cache, cache->files,
+                    cache->availFiles*sizeof(cache_file_t*), newAvail*sizeof(cache_file_t*));
+            if (newFiles == NULL) {
+                ALOGE("Failure growing cache file array for %s\n", name);
+                return NULL;
+            }
+            cache->availFiles = newAvail;
+            cache->files = newFiles;
+        }
+        CACHE_NOISY(ALOGI("Setting file %p at position %d in array %p", file,
+                cache->numFiles, cache->files));
+        cache->files[cache->numFiles] = file;
+        cache->numFiles++;
+        dir->childCount++;
+        _inc_num_cache_collected(cache);
+    } else {
+        ALOGE("Failure allocating cache_file_t for %s\n", name);
+    }
+    return file;
+}
+
+static int _add_cache_files(cache_t *cache, cache_dir_t *parentDir, const char *dirName,
+        DIR* dir, char *pathBase, char *pathPos, size_t pathAvailLen)
+{
+    struct dirent *de;
+    cache_dir_t* cacheDir = NULL;
+    int dfd;
+
+    CACHE_NOISY(ALOGI("_add_cache_files: parent=%p dirName=%s dir=%p pathBase=%s",
+            parentDir, dirName, dir, pathBase));
+
+    dfd = dirfd(dir);
+
+    if (dfd < 0) return 0;
+
+    // Sub-directories always get added to the data structure, so if they
+    // are empty we will know about them to delete them later.
+    cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
+
+    while ((de = readdir(dir))) {
+        const char *name = de->d_name;
+
+        if (de->d_type == DT_DIR) {
+            int subfd;
+            DIR *subdir;
+
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+
+            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
+            if (subfd < 0) {
+                ALOGE("Couldn't openat %s: %s\n", name, strerror(errno));
+                continue;
+            }
+            subdir = fdopendir(subfd);
+            if (subdir == NULL) {
+                ALOGE("Couldn't fdopendir %s: %s\n", name, strerror(errno));
+                close(subfd);
+                continue;
+            }
+            if (cacheDir == NULL) {
+                cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
+            }
+            if (cacheDir != NULL) {
+                // Update pathBase for the new path...  this may change dirName
+                // if that is also pointing to the path, but we are done with it
+                // now.
+                size_t finallen = snprintf(pathPos, pathAvailLen, "/%s", name);
+                CACHE_NOISY(ALOGI("Collecting dir %s\n", pathBase));
+                if (finallen < pathAvailLen) {
+                    _add_cache_files(cache, cacheDir, name, subdir, pathBase,
+                            pathPos+finallen, pathAvailLen-finallen);
+                } else {
+                    // Whoops, the final path is too long!  We'll just delete
+                    // this directory.
+                    ALOGW("Cache dir %s truncated in path %s; deleting dir\n",
+                            name, pathBase);
+                    delete_dir_contents_fd(dfd, name);
+                    if (unlinkat(dfd, name, AT_REMOVEDIR) < 0) {
+                        ALOGE("Couldn't unlinkat %s: %s\n", name, strerror(errno));
+                    }
+                }
+            }
+            closedir(subdir);
+        } else if (de->d_type == DT_REG) {
+            // Skip files that start with '.'; they will be deleted if
+            // their entire directory is deleted.  This allows for metadata
+            // like ".nomedia" to remain in the directory until the entire
+            // directory is deleted.
+            if (cacheDir == NULL) {
+                cacheDir = _add_cache_dir_t(cache, parentDir, dirName);
+            }
+            if (name[0] == '.') {
+                cacheDir->hiddenCount++;
+                continue;
+            }
+            if (cacheDir != NULL) {
+                // Build final full path for file...  this may change dirName
+                // if that is also pointing to the path, but we are done with it
+                // now.
+                size_t finallen = snprintf(pathPos, pathAvailLen, "/%s", name);
+                CACHE_NOISY(ALOGI("Collecting file %s\n", pathBase));
+                if (finallen < pathAvailLen) {
+                    struct stat s;
+                    if (stat(pathBase, &s) >= 0) {
+                        _add_cache_file_t(cache, cacheDir, s.st_mtime, name);
+                    } else {
+                        ALOGW("Unable to stat cache file %s; deleting\n", pathBase);
+                        if (unlink(pathBase) < 0) {
+                            ALOGE("Couldn't unlink %s: %s\n", pathBase, strerror(errno));
+                        }
+                    }
+                } else {
+                    // Whoops, the final path is too long!  We'll just delete
+                    // this file.
+                    ALOGW("Cache file %s truncated in path %s; deleting\n",
+                            name, pathBase);
+                    if (unlinkat(dfd, name, 0) < 0) {
+                        *pathPos = 0;
+                        ALOGE("Couldn't unlinkat %s in %s: %s\n", name, pathBase,
+                                strerror(errno));
+                    }
+                }
+            }
+        } else {
+            cacheDir->hiddenCount++;
+        }
+    }
+    return 0;
+}
+
+static void add_cache_files(cache_t* cache, const char *basepath, const char *cachedir)
+{
+    DIR *d;
+    struct dirent *de;
+    char dirname[PATH_MAX];
+
+    CACHE_NOISY(ALOGI("add_cache_files: base=%s cachedir=%s\n", basepath, cachedir));
+
+    d = opendir(basepath);
+    if (d == NULL) {
+        return;
+    }
+
+    while ((de = readdir(d))) {
+        if (de->d_type == DT_DIR) {
+            DIR* subdir;
+            const char *name = de->d_name;
+            char* pathpos;
+
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+
+            strcpy(dirname, basepath);
+            pathpos = dirname + strlen(dirname);
+            if ((*(pathpos-1)) != '/') {
+                *pathpos = '/';
+                pathpos++;
+                *pathpos = 0;
+            }
+            if (cachedir != NULL) {
+                snprintf(pathpos, sizeof(dirname)-(pathpos-dirname), "%s/%s", name, cachedir);
+            } else {
+                snprintf(pathpos, sizeof(dirname)-(pathpos-dirname), "%s", name);
+            }
+            CACHE_NOISY(ALOGI("Adding cache files from dir: %s\n", dirname));
+            subdir = opendir(dirname);
+            if (subdir != NULL) {
+                size_t dirnameLen = strlen(dirname);
+                _add_cache_files(cache, NULL, dirname, subdir, dirname, dirname+dirnameLen,
+                        PATH_MAX - dirnameLen);
+                closedir(subdir);
+            }
+        }
+    }
+
+    closedir(d);
+}
+
+static char *create_dir_path(char path[PATH_MAX], cache_dir_t* dir)
+{
+    char *pos = path;
+    if (dir->parent != NULL) {
+        pos = create_dir_path(path, dir->parent);
+    }
+    // Note that we don't need to worry about going beyond the buffer,
+    // since when we were constructing the cache entries our maximum
+    // buffer size for full paths was PATH_MAX.
+    strcpy(pos, dir->name);
+    pos += strlen(pos);
+    *pos = '/';
+    pos++;
+    *pos = 0;
+    return pos;
+}
+
+static void delete_cache_dir(char path[PATH_MAX], cache_dir_t* dir)
+{
+    if (dir->parent != NULL) {
+        create_dir_path(path, dir);
+        ALOGI("DEL DIR %s\n", path);
+        if (dir->hiddenCount <= 0) {
+            if (rmdir(path)) {
+                ALOGE("Couldn't rmdir %s: %s\n", path, strerror(errno));
+                return;
+            }
+        } else {
+            // The directory contains hidden files so we need to delete
+            // them along with the directory itself.
+            if (delete_dir_contents(path, 1, NULL)) {
+                return;
+            }
+        }
+        dir->parent->childCount--;
+        dir->deleted = 1;
+        if (dir->parent->childCount <= 0) {
+            delete_cache_dir(path, dir->parent);
+        }
+    } else if (dir->hiddenCount > 0) {
+        // This is a root directory, but it has hidden files.  Get rid of
+        // all of those files, but not the directory itself.
+        create_dir_path(path, dir);
+        ALOGI("DEL CONTENTS %s\n", path);
+        delete_dir_contents(path, 0, NULL);
+    }
+}
+
+static int cache_modtime_sort(const void *lhsP, const void *rhsP)
+{
+    const cache_file_t *lhs = *(const cache_file_t**)lhsP;
+    const cache_file_t *rhs = *(const cache_file_t**)rhsP;
+    return lhs->modTime < rhs->modTime ? -1 : (lhs->modTime > rhs->modTime ? 1 : 0);
+}
+
+static void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t free_size)
+{
+    size_t i;
+    int skip = 0;
+    char path[PATH_MAX];
+
+    ALOGI("Collected cache files: %zd directories, %zd files",
+        cache->numDirs, cache->numFiles);
+
+    CACHE_NOISY(ALOGI("Sorting files..."));
+    qsort(cache->files, cache->numFiles, sizeof(cache_file_t*),
+            cache_modtime_sort);
+
+    CACHE_NOISY(ALOGI("Cleaning empty directories..."));
+    for (i=cache->numDirs; i>0; i--) {
+        cache_dir_t* dir = cache->dirs[i-1];
+        if (dir->childCount <= 0 && !dir->deleted) {
+            delete_cache_dir(path, dir);
+        }
+    }
+
+    CACHE_NOISY(ALOGI("Trimming files..."));
+    for (i=0; i<cache->numFiles; i++) {
+        skip++;
+        if (skip > 10) {
+            if (data_disk_free(data_path) > free_size) {
+                return;
+            }
+            skip = 0;
+        }
+        cache_file_t* file = cache->files[i];
+        strcpy(create_dir_path(path, file->dir), file->name);
+        ALOGI("DEL (mod %d) %s\n", (int)file->modTime, path);
+        if (unlink(path) < 0) {
+            ALOGE("Couldn't unlink %s: %s\n", path, strerror(errno));
+        }
+        file->dir->childCount--;
+        if (file->dir->childCount <= 0) {
+            delete_cache_dir(path, file->dir);
+        }
+    }
+}
+
+static void finish_cache_collection(cache_t* cache)
+{
+    CACHE_NOISY(size_t i;)
+
+    CACHE_NOISY(ALOGI("clear_cache_files: %d dirs, %d files\n", cache->numDirs, cache->numFiles));
+    CACHE_NOISY(
+        for (i=0; i<cache->numDirs; i++) {
+            cache_dir_t* dir = cache->dirs[i];
+            ALOGI("dir #%d: %p %s parent=%p\n", i, dir, dir->name, dir->parent);
+        })
+    CACHE_NOISY(
+        for (i=0; i<cache->numFiles; i++) {
+            cache_file_t* file = cache->files[i];
+            ALOGI("file #%d: %p %s time=%d dir=%p\n", i, file, file->name,
+                    (int)file->modTime, file->dir);
+        })
+    void* block = cache->memBlocks;
+    while (block != NULL) {
+        void* nextBlock = *(void**)block;
+        CACHE_NOISY(ALOGI("Freeing cache mem block: %p", block));
+        free(block);
+        block = nextBlock;
+    }
+    free(cache);
+}
+
+static void trimFull(const std::string& root, int64_t freeSize) {
+    cache_t* cache = start_cache_collection();
+    add_cache_files(cache, root.c_str(), "cache");
+    clear_cache_files(root, cache, freeSize);
+    finish_cache_collection(cache);
+}
+
+static void trimStreaming(const std::string& root, int64_t freeSize) {
+    std::vector<std::string> roots;
+    add_cache_roots(&roots, root.c_str(), "cache");
+    trim_cache_files(root, roots, freeSize);
+}
+
+static bool run(const char* name, void (*trim)(const std::string&, int64_t),
+        const std::string& root, int packages, int files, int percent) {
+    removeTree(root);
+    int64_t total = layOut(root, packages, files);
+    sync();
+    std::vector<CacheFile> before;
+    bool emptyDirs = false;
+    inventory(root, 0, &before, &emptyDirs);
+
+    int64_t freeSize = data_disk_free(root) + total * percent / 100;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        struct rusage start, end;
+        getrusage(RUSAGE_SELF, &start);
+        int64_t startNs = nowNs();
+        trim(root, freeSize);
+        int64_t elapsedNs = nowNs() - startNs;
+        getrusage(RUSAGE_SELF, &end);
+        printf("  %-10s %8.1f ms, peak RSS +%ld kB\n", name, elapsedNs / 1E6,
+                end.ru_maxrss - start.ru_maxrss);
+        fflush(stdout);
+        _exit(data_disk_free(root) >= freeSize ? 0 : 1);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        fprintf(stderr, "%s: did not finish\n", name);
+        return false;
+    }
+    bool ok = true;
+    if (WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: not enough was freed\n", name);
+        ok = false;
+    }
+
+    std::vector<CacheFile> after;
+    emptyDirs = false;
+    inventory(root, 0, &after, &emptyDirs);
+    if (emptyDirs) {
+        fprintf(stderr, "%s: empty directories left\n", name);
+        ok = false;
+    }
+    time_t oldestKept = INT32_MAX;
+    for (const auto& file : after) {
+        oldestKept = std::min(oldestKept, file.modTime);
+    }
+    size_t deleted = 0;
+    time_t newestDeleted = 0;
+    for (const auto& file : before) {
+        if (access(file.path.c_str(), F_OK) != 0) {
+            deleted++;
+            newestDeleted = std::max(newestDeleted, file.modTime);
+        }
+    }
+    if (newestDeleted > oldestKept) {
+        fprintf(stderr, "%s: deleted a file newer than one it kept\n", name);
+        ok = false;
+    }
+    printf("  %-10s deleted %zu of %zu files\n", "", deleted, before.size());
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    std::string root;
+    int packages = 200;
+    int files = 2000;
+    int percent = 10;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:p:f:r:")) >= 0) {
+        switch (res) {
+            case 'd': root = optarg; break;
+            case 'p': packages = atoi(optarg); break;
+            case 'f': files = atoi(optarg); break;
+            case 'r': percent = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (root.empty() || packages < 1 || files < 1 || percent < 1 || percent > 100) {
+        usage(me);
+    }
+
+    printf("freeing %d%% of the cache of %d packages with %d files each\n", percent, packages,
+            files);
+    bool ok = run("full sort", trimFull, root, packages, files, percent);
+    ok = run("streaming", trimStreaming, root, packages, files, percent) && ok;
+    removeTree(root);
+
+    printf("%s\n", ok ? "trims agree" : "TRIMS DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "installd.h"
+
+// Lays out synthetic apps -- an app dir with a large apk, native libraries and oat files, and
+// a data dir with many small files -- and moves them to another directory, as a move to
+// adopted storage does: once by running cp, as copy_complete_app() used to, and once with
+// copy_tree(). Both copies are checked against the source.
+
+// Run it like this:
+//
+// installd_copy_bench -d /data/local/tmp/copy_bench -a 4 -m 64 -f 500
+
+static const char* kCpPath = "/system/bin/cp";
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-a <apps>] [-m <apk MB>] [-f <files>] [-c <cp>]\n", me);
+    fprintf(stderr, "       -d directory to work in, created if needed\n");
+    fprintf(stderr, "       -a apps, default 4\n");
+    fprintf(stderr, "       -m size of each apk in MB, default 64\n");
+    fprintf(stderr, "       -f data files per app, default 500\n");
+    fprintf(stderr, "       -c cp to compare with, default %s\n", kCpPath);
+    exit(1);
+}
+
+static void writeFile(const std::string& path, size_t size, unsigned seed) {
+    static char buf[65536];
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0640);
+    if (fd < 0) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    while (size > 0) {
+        size_t n = size < sizeof(buf) ? size : sizeof(buf);
+        for (size_t i = 0; i < n; i += 64) {
+            buf[i] = rand_r(&seed);
+        }
+        if (write(fd, buf, n) != (ssize_t) n) {
+            perror(path.c_str());
+            exit(EXIT_FAILURE);
+        }
+        size -= n;
+    }
+    close(fd);
+}
+
+static void makeDir(const std::string& path, mode_t mode) {
+    if (mkdir(path.c_str(), mode) != 0 && errno != EEXIST) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t layOut(const std::string& root, int apps, size_t apkSize, int files) {
+    uint64_t bytes = 0;
+    unsigned seed = 1;
+    makeDir(root, 0771);
+    for (int a = 0; a < apps; a++) {
+        std::string app = root + "/com.example.app" + std::to_string(a) + "-1";
+        makeDir(app, 0755);
+        makeDir(app + "/lib", 0755);
+        makeDir(app + "/lib/arm", 0755);
+        makeDir(app + "/oat", 0771);
+        makeDir(app + "/oat/arm", 0771);
+        writeFile(app + "/base.apk", apkSize, seed++);
+        writeFile(app + "/lib/arm/libnative.so", apkSize / 8, seed++);
+        writeFile(app + "/oat/arm/base.odex", apkSize / 2, seed++);
+        bytes += apkSize + apkSize / 8 + apkSize / 2;
+        // Not every filesystem has user attributes
+        setxattr((app + "/base.apk").c_str(), "user.bench", "apk", 3, 0);
+
+        std::string data = root + "/com.example.app" + std::to_string(a);
+        makeDir(data, 0751);
+        static const char* kSubdirs[] = { "cache", "databases", "files", "shared_prefs" };
+        for (const char* subdir : kSubdirs) {
+            makeDir(data + "/" + subdir, 0771);
+        }
+        symlink((app + "/lib/arm").c_str(), (data + "/lib").c_str());
+        mkfifo((data + "/files/pipe").c_str(), 0600);
+        for (int f = 0; f < files; f++) {
+            std::string path = data + "/" + kSubdirs[f % 4] + "/f" + std::to_string(f);
+            size_t size = rand_r(&seed) % 32768;
+            writeFile(path, size, seed++);
+            bytes += size;
+        }
+    }
+    return bytes;
+}
+
+static bool sameContents(const std::string& a, const std::string& b) {
+    static char bufA[65536], bufB[65536];
+    int fdA = open(a.c_str(), O_RDONLY);
+    int fdB = open(b.c_str(), O_RDONLY);
+    bool same = fdA >= 0 && fdB >= 0;
+    while (same) {
+        ssize_t nA = read(fdA, bufA, sizeof(bufA));
+        ssize_t nB = read(fdB, bufB, sizeof(bufB));
+        same = nA == nB && nA >= 0 && !memcmp(bufA, bufB, nA);
+        if (nA <= 0) {
+            break;
+        }
+    }
+    if (fdA >= 0) close(fdA);
+    if (fdB >= 0) close(fdB);
+    return same;
+}
+
+// cp -p leaves extended attributes behind, copy_tree() does not
+static bool sameTree(const std::string& a, const std::string& b, bool xattrs) {
+    struct stat sa, sb;
+    if (lstat(a.c_str(), &sa) != 0 || lstat(b.c_str(), &sb) != 0) {
+        fprintf(stderr, "%s: missing\n", b.c_str());
+        return false;
+    }
+    bool timesMatter = !S_ISLNK(sa.st_mode);
+    if (sa.st_mode != sb.st_mode || sa.st_uid != sb.st_uid || sa.st_gid != sb.st_gid
+            || sa.st_size != sb.st_size
+            || (timesMatter && (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec
+                    || sa.st_mtim.tv_nsec / 1000 != sb.st_mtim.tv_nsec / 1000))) {
+        fprintf(stderr, "%s: mode, owner, size or mtime differ\n", b.c_str());
+        return false;
+    }
+    if (S_ISREG(sa.st_mode)) {
+        char valueA[16], valueB[16];
+        ssize_t nA = getxattr(a.c_str(), "user.bench", valueA, sizeof(valueA));
+        ssize_t nB = getxattr(b.c_str(), "user.bench", valueB, sizeof(valueB));
+        if (xattrs && (nA != nB || (nA > 0 && memcmp(valueA, valueB, nA)))) {
+            fprintf(stderr, "%s: attributes differ\n", b.c_str());
+            return false;
+        }
+        if (!sameContents(a, b)) {
+            fprintf(stderr, "%s: contents differ\n", b.c_str());
+            return false;
+        }
+    } else if (S_ISLNK(sa.st_mode)) {
+        char targetA[PATH_MAX], targetB[PATH_MAX];
+        ssize_t nA = readlink(a.c_str(), targetA, sizeof(targetA));
+        ssize_t nB = readlink(b.c_str(), targetB, sizeof(targetB));
+        if (nA != nB || memcmp(targetA, targetB, nA)) {
+            fprintf(stderr, "%s: link target differs\n", b.c_str());
+            return false;
+        }
+    } else if (S_ISDIR(sa.st_mode)) {
+        DIR* d = opendir(a.c_str());
+        if (d == NULL) {
+            return false;
+        }
+        bool same = true;
+        struct dirent* de;
+        while (same && (de = readdir(d))) {
+            if (strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+                same = sameTree(a + "/" + de->d_name, b + "/" + de->d_name, xattrs);
+            }
+        }
+        closedir(d);
+        return same;
+    }
+    return true;
+}
+
+static void removeTree(const std::string& path) {
+    delete_dir_contents(path.c_str(), 1, NULL);
+}
+
+static bool copyWithCp(const char* cp, const std::string& from, const std::string& to) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(cp, cp, "-p", "-R", "-P", from.c_str(), to.c_str(), (char*) NULL);
+        _exit(127);
+    }
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0;
+}
+
+static void printProgress(const copy_progress_t* progress, void* cookie __unused) {
+    if (!progress->done) {
+        printf("    %" PRIu64 " of %" PRIu64 " MB\n", progress->bytes >> 20,
+                progress->total_bytes >> 20);
+    }
+}
+
+static void printRate(const char* name, uint64_t bytes, int64_t elapsedNs) {
+    printf("  %-10s %8.1f ms, %7.1f MB/s\n", name, elapsedNs / 1E6,
+            bytes / 1048576.0 / (elapsedNs / 1E9));
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    const char *cp = kCpPath;
+    std::string dir;
+    int apps = 4;
+    size_t apkSize = 64 << 20;
+    int files = 500;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:a:m:f:c:")) >= 0) {
+        switch (res) {
+            case 'd': dir = optarg; break;
+            case 'a': apps = atoi(optarg); break;
+            case 'm': apkSize = (size_t) atoi(optarg) << 20; break;
+            case 'f': files = atoi(optarg); break;
+            case 'c': cp = optarg; break;
+            default: usage(me);
+        }
+    }
+    if (dir.empty() || apps < 1 || files < 0) {
+        usage(me);
+    }
+
+    std::string from = dir + "/from";
+    std::string to = dir + "/to";
+    makeDir(dir, 0771);
+    removeTree(from);
+    removeTree(to);
+    printf("laying out %d apps with %zu MB apks and %d data files each\n", apps,
+            apkSize >> 20, files);
+    uint64_t bytes = layOut(from, apps, apkSize, files);
+    sync();
+
+    bool ok = true;
+    printf("moving %" PRIu64 " MB\n", bytes >> 20);
+    int64_t startNs = nowNs();
+    if (!copyWithCp(cp, from, to)) {
+        fprintf(stderr, "%s failed\n", cp);
+        ok = false;
+    } else {
+        printRate("cp", bytes, nowNs() - startNs);
+        ok = sameTree(from, to, false);
+    }
+    removeTree(to);
+    sync();
+
+    startNs = nowNs();
+    if (copy_tree(from.c_str(), to.c_str(), printProgress, NULL) != 0) {
+        fprintf(stderr, "copy_tree failed\n");
+        ok = false;
+    } else {
+        printRate("copy_tree", bytes, nowNs() - startNs);
+        ok = sameTree(from, to, true) && ok;
+    }
+    removeTree(to);
+    removeTree(from);
+
+    printf("%s\n", ok ? "copies match" : "COPIES DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <diskusage/dirsize.h>
+
+#include "installd.h"
+
+// Lays out a synthetic /data with many packages -- code under app/, data under user/0/ -- and
+// sizes every package the way get_size() does: serially with calculate_dir_size(), as get_size()
+// used to, then with calculate_dir_sizes(), cold and with the code trees cached. Checks that
+// all of them agree, and that changes to code and data show up in the cached walks.
+
+// Run it like this:
+//
+// installd_size_bench -d /data/local/tmp/size_bench -p 300 -f 200
+
+struct Sizes {
+    int64_t code;
+    int64_t data;
+    int64_t cache;
+
+    bool operator==(const Sizes& o) const {
+        return code == o.code && data == o.data && cache == o.cache;
+    }
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s -d <dir> [-p <packages>] [-f <files>] [-k]\n", me);
+    fprintf(stderr, "       -d directory to lay the packages out in, created if needed\n");
+    fprintf(stderr, "       -p packages, default 200\n");
+    fprintf(stderr, "       -f data files per package, default 150\n");
+    fprintf(stderr, "       -k keep the layout from an earlier run\n");
+    exit(1);
+}
+
+static void writeFile(const std::string& path, size_t size) {
+    static char buf[65536];
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+    while (size > 0) {
+        size_t n = size < sizeof(buf) ? size : sizeof(buf);
+        if (write(fd, buf, n) != (ssize_t) n) {
+            perror(path.c_str());
+            exit(EXIT_FAILURE);
+        }
+        size -= n;
+    }
+    close(fd);
+}
+
+static void makeDir(const std::string& path) {
+    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror(path.c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+static std::string codeDir(const std::string& root, int pkg) {
+    return root + "/app/com.example.pkg" + std::to_string(pkg) + "-1";
+}
+
+static std::string dataDir(const std::string& root, int pkg) {
+    return root + "/user/0/com.example.pkg" + std::to_string(pkg);
+}
+
+static void layOut(const std::string& root, int packages, int files) {
+    makeDir(root);
+    makeDir(root + "/app");
+    makeDir(root + "/user");
+    makeDir(root + "/user/0");
+    unsigned seed = 1;
+    for (int p = 0; p < packages; p++) {
+        std::string code = codeDir(root, p);
+        makeDir(code);
+        makeDir(code + "/lib");
+        makeDir(code + "/lib/arm");
+        makeDir(code + "/oat");
+        makeDir(code + "/oat/arm");
+        writeFile(code + "/base.apk", 16384 + rand_r(&seed) % 262144);
+        writeFile(code + "/lib/arm/libnative.so", 4096 + rand_r(&seed) % 65536);
+        writeFile(code + "/oat/arm/base.odex", 16384 + rand_r(&seed) % 131072);
+
+        std::string data = dataDir(root, p);
+        makeDir(data);
+        static const char* kSubdirs[] = { "cache", "code_cache", "databases", "files",
+                "shared_prefs", "no_backup" };
+        for (const char* subdir : kSubdirs) {
+            makeDir(data + "/" + subdir);
+        }
+        symlink((code + "/lib/arm").c_str(), (data + "/lib").c_str());
+        for (int f = 0; f < files; f++) {
+            // a few levels of nesting under files/ and cache/, as apps do
+            const char* top = kSubdirs[f % 6];
+            std::string dir = data + "/" + top;
+            if (f % 7 == 0) {
+                dir += "/d" + std::to_string(f % 5);
+                makeDir(dir);
+                dir += "/e" + std::to_string(f % 3);
+                makeDir(dir);
+            }
+            writeFile(dir + "/f" + std::to_string(f), rand_r(&seed) % 20000);
+        }
+    }
+}
+
+// get_size() as it was, with the serial walker.
+static Sizes serialSizes(const std::string& root, int pkg) {
+    Sizes sizes = { 0, 0, 0 };
+    struct stat s;
+
+    std::string code = codeDir(root, pkg);
+    if (stat(code.c_str(), &s) == 0) {
+        sizes.code += stat_size(&s);
+        int fd = open(code.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            sizes.code += calculate_dir_size(fd);
+        }
+    }
+
+    DIR* d = opendir(dataDir(root, pkg).c_str());
+    if (d == NULL) {
+        return sizes;
+    }
+    int dfd = dirfd(d);
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        const char* name = de->d_name;
+        int64_t size = 0;
+        if (de->d_type == DT_DIR) {
+            if (!strcmp(name, ".") || !strcmp(name, "..")) {
+                continue;
+            }
+            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                size += stat_size(&s);
+            }
+            int subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
+            if (subfd >= 0) {
+                size += calculate_dir_size(subfd);
+            }
+        } else if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+            size += stat_size(&s);
+        }
+        if (!strcmp(name, "lib")) {
+            sizes.code += size;
+        } else if (!strcmp(name, "cache")) {
+            sizes.cache += size;
+        } else {
+            sizes.data += size;
+        }
+    }
+    closedir(d);
+    return sizes;
+}
+
+// get_size() as it is now.
+static Sizes parallelSizes(const std::string& root, int pkg) {
+    Sizes sizes = { 0, 0, 0 };
+    std::vector<dir_size_t> dirs;
+    struct stat s;
+
+    std::string code = codeDir(root, pkg);
+    if (stat(code.c_str(), &s) == 0) {
+        sizes.code += stat_size(&s);
+        dirs.push_back(dir_size_t { AT_FDCWD, code, false, true, &sizes.code });
+    }
+
+    DIR* d = opendir(dataDir(root, pkg).c_str());
+    if (d != NULL) {
+        int dfd = dirfd(d);
+        struct dirent* de;
+        while ((de = readdir(d))) {
+            const char* name = de->d_name;
+            int64_t* total = !strcmp(name, "lib") ? &sizes.code
+                    : !strcmp(name, "cache") ? &sizes.cache : &sizes.data;
+            if (de->d_type == DT_DIR) {
+                if (strcmp(name, ".") && strcmp(name, "..")) {
+                    dirs.push_back(dir_size_t { dfd, name, true, false, total });
+                }
+            } else if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                *total += stat_size(&s);
+            }
+        }
+    }
+    calculate_dir_sizes(dirs.data(), dirs.size());
+    if (d != NULL) {
+        closedir(d);
+    }
+    return sizes;
+}
+
+static double pass(const char* name, const std::string& root, int packages,
+        Sizes (*sizer)(const std::string&, int), std::vector<Sizes>* out) {
+    out->resize(packages);
+    int64_t startNs = nowNs();
+    for (int p = 0; p < packages; p++) {
+        (*out)[p] = sizer(root, p);
+    }
+    double elapsedMs = (nowNs() - startNs) / 1E6;
+    printf("  %-28s %8.1f ms, %6.2f ms per package\n", name, elapsedMs, elapsedMs / packages);
+    return elapsedMs;
+}
+
+static bool same(const char* name, const std::vector<Sizes>& a, const std::vector<Sizes>& b) {
+    for (size_t p = 0; p < a.size(); p++) {
+        if (!(a[p] == b[p])) {
+            fprintf(stderr, "%s: package %zu is %lld/%lld/%lld, should be %lld/%lld/%lld\n", name,
+                    p, (long long) b[p].code, (long long) b[p].data, (long long) b[p].cache,
+                    (long long) a[p].code, (long long) a[p].data, (long long) a[p].cache);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    std::string root;
+    int packages = 200;
+    int files = 150;
+    bool keep = false;
+
+    int res;
+    while ((res = getopt(argc, argv, "d:p:f:k")) >= 0) {
+        switch (res) {
+            case 'd': root = optarg; break;
+            case 'p': packages = atoi(optarg); break;
+            case 'f': files = atoi(optarg); break;
+            case 'k': keep = true; break;
+            default: usage(me);
+        }
+    }
+    if (root.empty() || packages < 1 || files < 0) {
+        usage(me);
+    }
+
+    if (!keep) {
+        printf("laying out %d packages with %d data files each in %s\n", packages, files,
+                root.c_str());
+        layOut(root, packages, files);
+    }
+
+    std::vector<Sizes> serial, cold, warm;
+    printf("sizing %d packages\n", packages);
+    pass("serial", root, packages, serialSizes, &serial);
+    pass("parallel, code not cached", root, packages, parallelSizes, &cold);
+    pass("parallel, code cached", root, packages, parallelSizes, &warm);
+    bool ok = same("cold", serial, cold) && same("warm", serial, warm);
+
+    // Data changes in place, code is replaced: both must show up.
+    writeFile(dataDir(root, 0) + "/files/f0", 1 << 20);
+    std::string odex = codeDir(root, 0) + "/oat/arm/base.odex";
+    unlink(odex.c_str());
+    writeFile(odex, 1 << 20);
+    Sizes expected = serialSizes(root, 0);
+    Sizes changed = parallelSizes(root, 0);
+    if (!(expected == changed)) {
+        fprintf(stderr, "changes to package 0 are not seen\n");
+        ok = false;
+    }
+
+    printf("%s\n", ok ? "sizes agree" : "SIZES DIFFER");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
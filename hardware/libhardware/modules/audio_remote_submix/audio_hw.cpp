@@ -18,12 +18,15 @@
 //#define LOG_NDEBUG 0
 
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/limits.h>
+#include <time.h>
 
 #include <cutils/compiler.h>
 #include <cutils/log.h>
@@ -64,17 +67,24 @@ namespace android {
 
 // NOTE: This value will be rounded up to the nearest power of 2 by MonoPipe().
 #define DEFAULT_PIPE_SIZE_IN_FRAMES  (1024*4)
+// Pipe size used in low latency mode, where buffers (and the depth the pipe is kept at by
+// MonoPipe's write throttle) are a quarter of the default ones.
+#define LOW_LATENCY_PIPE_SIZE_IN_FRAMES 1024
 // Value used to divide the MonoPipe() buffer into segments that are written to the source and
 // read from the sink.  The maximum latency of the device is the size of the MonoPipe's buffer
 // the minimum latency is the MonoPipe buffer size divided by this value.
 #define DEFAULT_PIPE_PERIOD_COUNT    4
-// The duration of MAX_READ_ATTEMPTS * READ_ATTEMPT_SLEEP_MS must be stricly inferior to
-//   the duration of a record buffer at the current record sample rate (of the device, not of
-//   the recording itself). Here we have:
-//      3 * 5ms = 15ms < 1024 frames * 1000 / 48000 = 21.333ms
-#define MAX_READ_ATTEMPTS            3
-#define READ_ATTEMPT_SLEEP_MS        5 // 5ms between two read attempts when pipe is empty
+// When the pipe is empty, a read waits for the output stream to write to it, for at most
+// MAX_READ_WAIT_MS, and never for more than READ_WAIT_PERCENT of the duration of the buffer
+// being read, so that a stalled output still lets the input return silence in time.
+//      15ms < 1024 frames * 1000 / 48000 = 21.333ms
+#define MAX_READ_WAIT_MS             15
+#define READ_WAIT_PERCENT            70
 #define DEFAULT_SAMPLE_RATE_HZ       48000 // default sample rate
+// System property enabling the low latency mode by default.
+#define LOW_LATENCY_PROPERTY         "audio.r_submix.low_latency"
+// Device parameter switching the low latency mode for the pipes created afterwards.
+#define LOW_LATENCY_PARAMETER        "r_submix_low_latency"
 // See NBAIO_Format frameworks/av/include/media/nbaio/NBAIO.h.
 #define DEFAULT_FORMAT               AUDIO_FORMAT_PCM_16_BIT
 // A legacy user of this device does not close the input stream when it shuts down, which
@@ -139,6 +149,7 @@ struct submix_config {
     size_t buffer_size_frames; // Size of the audio pipe in frames.
     // Maximum number of frames buffered by the input and output streams.
     size_t buffer_period_size_frames;
+    bool low_latency; // Whether the pipe was created in low latency mode.
 };
 
 #define MAX_ROUTES 10
@@ -159,6 +170,10 @@ typedef struct route_config {
     // destroyed if both and input and output streams are destroyed.
     struct submix_stream_out *output;
     struct submix_stream_in *input;
+    // Broadcast, with the device lock held, after frames are written to the pipe or the pipe is
+    // shut down. An input stream waiting for data on an empty pipe blocks on it instead of
+    // polling the pipe.
+    pthread_cond_t data_available_cond;
 #if ENABLE_RESAMPLING
     // Buffer used as temporary storage for resampled data prior to returning data to the output
     // stream.
@@ -172,6 +187,8 @@ struct submix_audio_device {
     // Device lock, also used to protect access to submix_audio_device from the input and output
     // streams.
     pthread_mutex_t lock;
+    // Whether pipes are created in low latency mode.
+    bool low_latency;
 };
 
 struct submix_stream_out {
@@ -180,6 +197,14 @@ struct submix_stream_out {
     int route_handle;
     bool output_standby;
     uint64_t write_counter_frames;
+    // Statistics, reported by dump().
+    uint64_t total_written_frames;
+    // Frames discarded from the pipe to make room while no input stream was reading it.
+    uint64_t dropped_frames;
+    uint32_t write_count;
+    // Time spent in MonoPipe::write(), which throttles the writer to real time.
+    int64_t max_write_ns;
+    int64_t total_write_ns;
 #if LOG_STREAMS_TO_FILES
     int log_fd;
 #endif // LOG_STREAMS_TO_FILES
@@ -196,6 +221,17 @@ struct submix_stream_in {
     // how many frames have been requested to be read
     uint64_t read_counter_frames;
 
+    // Statistics, reported by dump().
+    uint32_t read_count;
+    // Reads the pipe could not fully serve, and the frames replaced by silence.
+    uint32_t underrun_count;
+    uint64_t underrun_frames;
+    // Times a read blocked on an empty pipe.
+    uint32_t wait_count;
+    // Frames queued in the pipe when a read starts, i.e. how old the captured audio is.
+    uint64_t total_pipe_depth_frames;
+    size_t max_pipe_depth_frames;
+
 #if ENABLE_LEGACY_INPUT_OPEN
     // Number of references to this input stream.
     volatile int32_t ref_count;
@@ -351,6 +387,60 @@ static bool audio_config_compare(const audio_config * const input_config,
     return true;
 }
 
+// Size of the pipes created by the submix audio device rsxadev.
+// Must be called with lock held on the submix_audio_device
+static size_t submix_pipe_size_in_frames_l(const struct submix_audio_device * const rsxadev)
+{
+    return rsxadev->low_latency ? LOW_LATENCY_PIPE_SIZE_IN_FRAMES : DEFAULT_PIPE_SIZE_IN_FRAMES;
+}
+
+// Add ns nanoseconds to the time t.
+static void timespec_add_ns(struct timespec * const t, const int64_t ns)
+{
+    t->tv_sec += ns / 1000000000;
+    t->tv_nsec += ns % 1000000000;
+    if (t->tv_nsec >= 1000000000) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+static int64_t timespec_diff_ns(const struct timespec * const a, const struct timespec * const b)
+{
+    return (int64_t)(a->tv_sec - b->tv_sec) * 1000000000 + (a->tv_nsec - b->tv_nsec);
+}
+
+// Wake up the input stream of the route route_idx, which may be waiting for data in the pipe.
+// Must be called with lock held on the submix_audio_device
+static void submix_audio_device_signal_data_l(struct submix_audio_device * const rsxadev,
+                                              int route_idx)
+{
+    pthread_cond_broadcast(&rsxadev->routes[route_idx].data_available_cond);
+}
+
+// Wait until the output stream of the route route_idx writes to the pipe read by source, or the
+// deadline (CLOCK_MONOTONIC) expires. Returns false if the deadline expired, or if the pipe was
+// shut down or replaced, in which case waiting longer is pointless.
+// Must be called with lock held on the submix_audio_device
+static bool submix_audio_device_wait_for_data_l(struct submix_audio_device * const rsxadev,
+                                                int route_idx,
+                                                const sp<MonoPipeReader>& source,
+                                                const struct timespec * const deadline)
+{
+    struct route_config * const route = &rsxadev->routes[route_idx];
+    while (source->availableToRead() <= 0) {
+        if (route->rsxSource != source || route->rsxSink == NULL ||
+                route->rsxSink->isShutdown()) {
+            return false;
+        }
+        if (pthread_cond_timedwait(&route->data_available_cond, &rsxadev->lock,
+                deadline) == ETIMEDOUT) {
+            return source->availableToRead() > 0;
+        }
+    }
+    return true;
+}
+
 // If one doesn't exist, create a pipe for the submix audio device rsxadev of size
 // buffer_size_frames and optionally associate "in" or "out" with the submix audio device.
 // Must be called with lock held on the submix_audio_device
@@ -440,6 +530,7 @@ static void submix_audio_device_create_pipe_l(struct submix_audio_device * const
         device_config->buffer_size_frames = sink->maxFrames();
         device_config->buffer_period_size_frames = device_config->buffer_size_frames /
                 buffer_period_count;
+        device_config->low_latency = rsxadev->low_latency;
         if (in) device_config->pipe_frame_size = audio_stream_in_frame_size(&in->stream);
         if (out) device_config->pipe_frame_size = audio_stream_out_frame_size(&out->stream);
 #if ENABLE_CHANNEL_CONVERSION
@@ -707,10 +798,25 @@ static int out_standby(struct audio_stream *stream)
     return 0;
 }
 
+// Must be called with lock held on the submix_audio_device the stream belongs to.
+static void out_dump_l(const struct submix_stream_out * const out, int fd)
+{
+    dprintf(fd, "    output: %u writes, %" PRIu64 " frames written, %" PRIu64
+            " frames dropped\n", out->write_count, out->total_written_frames, out->dropped_frames);
+    dprintf(fd, "            pipe write time avg %.2f ms, max %.2f ms\n",
+            out->write_count ? out->total_write_ns / 1E6 / out->write_count : 0.,
+            out->max_write_ns / 1E6);
+}
+
 static int out_dump(const struct audio_stream *stream, int fd)
 {
-    (void)stream;
-    (void)fd;
+    const struct submix_stream_out * const out = audio_stream_get_submix_stream_out(
+            const_cast<struct audio_stream *>(stream));
+    struct submix_audio_device * const rsxadev = out->dev;
+
+    pthread_mutex_lock(&rsxadev->lock);
+    out_dump_l(out, fd);
+    pthread_mutex_unlock(&rsxadev->lock);
     return 0;
 }
 
@@ -737,6 +843,9 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
 
             ALOGD("out_set_parameters(): shutting down MonoPipe sink");
             sink->shutdown(true);
+            // No more data is coming, don't let the input stream wait for it.
+            submix_audio_device_signal_data_l(rsxadev,
+                    audio_stream_get_submix_stream_out(stream)->route_handle);
         } // done using the sink
         pthread_mutex_unlock(&rsxadev->lock);
     }
@@ -818,6 +927,7 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
             size_t frames_to_flush_from_source = frames - availableToWrite;
             SUBMIX_ALOGV("out_write(): flushing %d frames from the pipe to avoid blocking",
                          frames_to_flush_from_source);
+            out->dropped_frames += frames_to_flush_from_source;
             while (frames_to_flush_from_source) {
                 const size_t flush_size = min(frames_to_flush_from_source, flushBufferSizeFrames);
                 frames_to_flush_from_source -= flush_size;
@@ -829,6 +939,10 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
 
     pthread_mutex_unlock(&rsxadev->lock);
 
+    // MonoPipe::write() blocks until there is room in the pipe, and throttles the output stream
+    // to real time once the pipe is filled past its setpoint: it is the clock of the device.
+    struct timespec write_start;
+    clock_gettime(CLOCK_MONOTONIC, &write_start);
     written_frames = sink->write(buffer, frames);
 
 #if LOG_STREAMS_TO_FILES
@@ -852,10 +966,21 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
         }
     }
 
+    struct timespec write_end;
+    clock_gettime(CLOCK_MONOTONIC, &write_end);
+    const int64_t write_ns = timespec_diff_ns(&write_end, &write_start);
+
     pthread_mutex_lock(&rsxadev->lock);
     sink.clear();
+    out->write_count++;
+    out->total_write_ns += write_ns;
+    if (write_ns > out->max_write_ns) {
+        out->max_write_ns = write_ns;
+    }
     if (written_frames > 0) {
         out->write_counter_frames += written_frames;
+        out->total_written_frames += written_frames;
+        submix_audio_device_signal_data_l(rsxadev, out->route_handle);
     }
     pthread_mutex_unlock(&rsxadev->lock);
 
@@ -1039,10 +1164,31 @@ static int in_standby(struct audio_stream *stream)
     return 0;
 }
 
+// Must be called with lock held on the submix_audio_device the stream belongs to.
+static void in_dump_l(const struct submix_stream_in * const in, int fd)
+{
+    const struct submix_audio_device * const rsxadev = in->dev;
+    const uint32_t sample_rate = rsxadev->routes[in->route_handle].config.common.sample_rate;
+    dprintf(fd, "    input: %u reads, %" PRIu64 " frames read since standby, %u waits for data\n",
+            in->read_count, in->read_counter_frames, in->wait_count);
+    dprintf(fd, "           %u underruns, %" PRIu64 " frames of silence inserted\n",
+            in->underrun_count, in->underrun_frames);
+    if (in->read_count && sample_rate) {
+        dprintf(fd, "           pipe latency avg %.2f ms, max %.2f ms\n",
+                (double)in->total_pipe_depth_frames * 1000 / sample_rate / in->read_count,
+                (double)in->max_pipe_depth_frames * 1000 / sample_rate);
+    }
+}
+
 static int in_dump(const struct audio_stream *stream, int fd)
 {
-    (void)stream;
-    (void)fd;
+    const struct submix_stream_in * const in = audio_stream_get_submix_stream_in(
+            const_cast<struct audio_stream *>(stream));
+    struct submix_audio_device * const rsxadev = in->dev;
+
+    pthread_mutex_lock(&rsxadev->lock);
+    in_dump_l(in, fd);
+    pthread_mutex_unlock(&rsxadev->lock);
     return 0;
 }
 
@@ -1111,8 +1257,26 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
             return bytes;
         }
 
+        // How old the data about to be read is.
+        const ssize_t pipe_depth_frames = source->availableToRead();
+        if (pipe_depth_frames > 0) {
+            in->total_pipe_depth_frames += pipe_depth_frames;
+            if ((size_t)pipe_depth_frames > in->max_pipe_depth_frames) {
+                in->max_pipe_depth_frames = pipe_depth_frames;
+            }
+        }
+        in->read_count++;
+
         pthread_mutex_unlock(&rsxadev->lock);
 
+        // If the pipe runs dry, wait for the output stream to write to it, until a deadline which
+        // leaves time to return silence before the read is late.
+        struct timespec wait_deadline;
+        clock_gettime(CLOCK_MONOTONIC, &wait_deadline);
+        timespec_add_ns(&wait_deadline, min((int64_t)MAX_READ_WAIT_MS * 1000000,
+                (int64_t)frames_to_read * 1000000000 / in_get_sample_rate(&stream->common)
+                        * READ_WAIT_PERCENT / 100));
+
         // read the data from the pipe (it's non blocking)
         int attempts = 0;
         char* buff = (char*)buffer;
@@ -1153,7 +1317,7 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
         }
 #endif // ENABLE_RESAMPLING
 
-        while ((remaining_frames > 0) && (attempts < MAX_READ_ATTEMPTS)) {
+        while (remaining_frames > 0) {
             ssize_t frames_read = -1977;
             size_t read_frames = remaining_frames;
 #if ENABLE_RESAMPLING
@@ -1243,13 +1407,24 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
                              attempts, frames_read, remaining_frames);
             } else {
                 attempts++;
-                SUBMIX_ALOGE("  in_read read returned %zd", frames_read);
-                usleep(READ_ATTEMPT_SLEEP_MS * 1000);
+                SUBMIX_ALOGV("  in_read read returned %zd, waiting for data", frames_read);
+                pthread_mutex_lock(&rsxadev->lock);
+                in->wait_count++;
+                const bool data_available = submix_audio_device_wait_for_data_l(
+                        rsxadev, in->route_handle, source, &wait_deadline);
+                pthread_mutex_unlock(&rsxadev->lock);
+                if (!data_available) {
+                    break;
+                }
             }
         }
         // done using the source
         pthread_mutex_lock(&rsxadev->lock);
         source.clear();
+        if (remaining_frames > 0) {
+            in->underrun_count++;
+            in->underrun_frames += remaining_frames;
+        }
         pthread_mutex_unlock(&rsxadev->lock);
     }
 
@@ -1259,37 +1434,18 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
         memset(((char*)buffer)+ bytes - remaining_bytes, 0, remaining_bytes);
     }
 
-    // compute how much we need to sleep after reading the data by comparing the wall clock with
-    //   the projected time at which we should return.
-    struct timespec time_after_read;// wall clock after reading from the pipe
-    struct timespec record_duration;// observed record duration
-    int rc = clock_gettime(CLOCK_MONOTONIC, &time_after_read);
+    // Return at the projected time of the end of the data read: read_counter_frames contains the
+    // number of frames that have been read since the beginning of recording (including this
+    // call), converted to time since record_start_time. Sleeping until an absolute deadline
+    // keeps the pacing from drifting with the time spent reading and waking up.
     const uint32_t sample_rate = in_get_sample_rate(&stream->common);
-    if (rc == 0) {
-        // for how long have we been recording?
-        record_duration.tv_sec  = time_after_read.tv_sec - in->record_start_time.tv_sec;
-        record_duration.tv_nsec = time_after_read.tv_nsec - in->record_start_time.tv_nsec;
-        if (record_duration.tv_nsec < 0) {
-            record_duration.tv_sec--;
-            record_duration.tv_nsec += 1000000000;
-        }
-
-        // read_counter_frames contains the number of frames that have been read since the
-        // beginning of recording (including this call): it's converted to usec and compared to
-        // how long we've been recording for, which gives us how long we must wait to sync the
-        // projected recording time, and the observed recording time.
-        long projected_vs_observed_offset_us =
-                ((int64_t)(in->read_counter_frames
-                            - (record_duration.tv_sec*sample_rate)))
-                        * 1000000 / sample_rate
-                - (record_duration.tv_nsec / 1000);
-
-        SUBMIX_ALOGV("  record duration %5lds %3ldms, will wait: %7ldus",
-                record_duration.tv_sec, record_duration.tv_nsec/1000000,
-                projected_vs_observed_offset_us);
-        if (projected_vs_observed_offset_us > 0) {
-            usleep(projected_vs_observed_offset_us);
-        }
+    struct timespec projected_time = in->record_start_time;
+    projected_time.tv_sec += in->read_counter_frames / sample_rate;
+    timespec_add_ns(&projected_time,
+            (int64_t)(in->read_counter_frames % sample_rate) * 1000000000 / sample_rate);
+    SUBMIX_ALOGV("  will wait until %lds %3ldms", projected_time.tv_sec,
+            projected_time.tv_nsec / 1000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &projected_time, NULL) == EINTR) {
     }
 
     SUBMIX_ALOGV("in_read returns %zu", bytes);
@@ -1401,7 +1557,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->dev = rsxadev;
     // Initialize the pipe.
     ALOGV("adev_open_output_stream(): about to create pipe at index %d", route_idx);
-    submix_audio_device_create_pipe_l(rsxadev, config, DEFAULT_PIPE_SIZE_IN_FRAMES,
+    submix_audio_device_create_pipe_l(rsxadev, config, submix_pipe_size_in_frames_l(rsxadev),
             DEFAULT_PIPE_PERIOD_COUNT, NULL, out, address, route_idx);
 #if LOG_STREAMS_TO_FILES
     out->log_fd = open(LOG_STREAM_OUT_FILENAME, O_CREAT | O_TRUNC | O_WRONLY,
@@ -1437,9 +1593,20 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
 
 static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
 {
-    (void)dev;
-    (void)kvpairs;
-    return -ENOSYS;
+    struct submix_audio_device * const rsxadev = audio_hw_device_get_submix_audio_device(dev);
+    AudioParameter parms = AudioParameter(String8(kvpairs));
+    int low_latency;
+    SUBMIX_ALOGV("adev_set_parameters() kvpairs='%s'", kvpairs);
+
+    if (parms.getInt(String8(LOW_LATENCY_PARAMETER), low_latency) != NO_ERROR) {
+        return -ENOSYS;
+    }
+    // Only applies to the pipes created from now on, existing routes keep their buffers.
+    pthread_mutex_lock(&rsxadev->lock);
+    rsxadev->low_latency = low_latency != 0;
+    pthread_mutex_unlock(&rsxadev->lock);
+    ALOGI("adev_set_parameters(): low latency %s", low_latency ? "enabled" : "disabled");
+    return 0;
 }
 
 static char * adev_get_parameters(const struct audio_hw_device *dev,
@@ -1637,7 +1804,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     in->read_error_count = 0;
     // Initialize the pipe.
     ALOGV("adev_open_input_stream(): about to create pipe");
-    submix_audio_device_create_pipe_l(rsxadev, config, DEFAULT_PIPE_SIZE_IN_FRAMES,
+    submix_audio_device_create_pipe_l(rsxadev, config, submix_pipe_size_in_frames_l(rsxadev),
                                     DEFAULT_PIPE_PERIOD_COUNT, in, NULL, address, route_idx);
 #if LOG_STREAMS_TO_FILES
     if (in->log_fd >= 0) close(in->log_fd);
@@ -1677,26 +1844,46 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
 
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
-    const struct submix_audio_device * rsxadev = //audio_hw_device_get_submix_audio_device(device);
-            reinterpret_cast<const struct submix_audio_device *>(
-                    reinterpret_cast<const uint8_t *>(device) -
-                            offsetof(struct submix_audio_device, device));
+    struct submix_audio_device * const rsxadev = audio_hw_device_get_submix_audio_device(
+            const_cast<struct audio_hw_device *>(device));
     char msg[100];
+    pthread_mutex_lock(&rsxadev->lock);
     int n = sprintf(msg, "\nReroute submix audio module:\n");
     write(fd, &msg, n);
+    n = sprintf(msg, " low latency %s\n", rsxadev->low_latency ? "enabled" : "disabled");
+    write(fd, &msg, n);
     for (int i=0 ; i < MAX_ROUTES ; i++) {
         n = sprintf(msg, " route[%d] rate in=%d out=%d, addr=[%s]\n", i,
                 rsxadev->routes[i].config.input_sample_rate,
                 rsxadev->routes[i].config.output_sample_rate,
                 rsxadev->routes[i].address);
         write(fd, &msg, n);
+        if (rsxadev->routes[i].rsxSink != NULL) {
+            n = sprintf(msg, "   pipe %zu frames, period %zu frames%s\n",
+                    rsxadev->routes[i].config.buffer_size_frames,
+                    rsxadev->routes[i].config.buffer_period_size_frames,
+                    rsxadev->routes[i].config.low_latency ? ", low latency" : "");
+            write(fd, &msg, n);
+        }
+        if (rsxadev->routes[i].output != NULL) {
+            out_dump_l(rsxadev->routes[i].output, fd);
+        }
+        if (rsxadev->routes[i].input != NULL) {
+            in_dump_l(rsxadev->routes[i].input, fd);
+        }
     }
+    pthread_mutex_unlock(&rsxadev->lock);
     return 0;
 }
 
 static int adev_close(hw_device_t *device)
 {
     ALOGI("adev_close()");
+    struct submix_audio_device * const rsxadev = audio_hw_device_get_submix_audio_device(
+            reinterpret_cast<struct audio_hw_device *>(device));
+    for (int i=0 ; i < MAX_ROUTES ; i++) {
+        pthread_cond_destroy(&rsxadev->routes[i].data_available_cond);
+    }
     free(device);
     return 0;
 }
@@ -1737,10 +1924,18 @@ static int adev_open(const hw_module_t* module, const char* name,
     rsxadev->device.close_input_stream = adev_close_input_stream;
     rsxadev->device.dump = adev_dump;
 
+    // Readers wait for data with absolute CLOCK_MONOTONIC deadlines.
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
     for (int i=0 ; i < MAX_ROUTES ; i++) {
             memset(&rsxadev->routes[i], 0, sizeof(route_config));
             strcpy(rsxadev->routes[i].address, "");
+            pthread_cond_init(&rsxadev->routes[i].data_available_cond, &cond_attr);
         }
+    pthread_condattr_destroy(&cond_attr);
+
+    rsxadev->low_latency = property_get_bool(LOW_LATENCY_PROPERTY, false);
 
     *device = &rsxadev->device.common;
 
@@ -21,12 +21,16 @@
 
 #include "SensorEventQueue.h"
 
-SensorEventQueue::SensorEventQueue(int capacity) {
+SensorEventQueue::SensorEventQueue(int capacity)
+    : mWritten(0),
+      mRead(0),
+      mWriterWaiting(false) {
     mCapacity = capacity;
 
     mStart = 0;
-    mSize = 0;
+    mEnd = 0;
     mData = new sensors_event_t[mCapacity];
+    pthread_mutex_init(&mSpaceAvailableMutex, NULL);
     pthread_cond_init(&mSpaceAvailableCondition, NULL);
 }
 
@@ -34,58 +38,74 @@ SensorEventQueue::~SensorEventQueue() {
     delete[] mData;
     mData = NULL;
     pthread_cond_destroy(&mSpaceAvailableCondition);
+    pthread_mutex_destroy(&mSpaceAvailableMutex);
 }
 
 int SensorEventQueue::getWritableRegion(int requestedLength, sensors_event_t** out) {
-    if (mSize == mCapacity || requestedLength <= 0) {
+    int size = getSize();
+    if (size == mCapacity || requestedLength <= 0) {
         *out = NULL;
         return 0;
     }
     // Start writing after the last readable record.
-    int firstWritable = (mStart + mSize) % mCapacity;
+    int firstWritable = mEnd;
 
-    int lastWritable = firstWritable + requestedLength - 1;
+    int length = requestedLength;
 
     // Don't go past the end of the data array.
-    if (lastWritable > mCapacity - 1) {
-        lastWritable = mCapacity - 1;
+    if (length > mCapacity - firstWritable) {
+        length = mCapacity - firstWritable;
     }
     // Don't go into the readable region.
-    if (firstWritable < mStart && lastWritable >= mStart) {
-        lastWritable = mStart - 1;
+    if (length > mCapacity - size) {
+        length = mCapacity - size;
     }
     *out = &mData[firstWritable];
-    return lastWritable - firstWritable + 1;
+    return length;
 }
 
 void SensorEventQueue::markAsWritten(int count) {
-    mSize += count;
+    if (count <= 0) return;
+    mEnd = (mEnd + count) % mCapacity;
+    // Publishes the records to the reader.
+    mWritten.fetch_add(count);
 }
 
 int SensorEventQueue::getSize() {
-    return mSize;
+    return (int)(mWritten.load() - mRead.load());
 }
 
 sensors_event_t* SensorEventQueue::peek() {
-    if (mSize == 0) return NULL;
+    if (mWritten.load() == mRead.load(std::memory_order_relaxed)) return NULL;
     return &mData[mStart];
 }
 
 void SensorEventQueue::dequeue() {
-    if (mSize == 0) return;
-    if (mSize == mCapacity) {
+    if (getSize() == 0) return;
+    mStart = (mStart + 1) % mCapacity;
+    mRead.fetch_add(1);
+    // Pairs with waitForSpace(): either the writer sees the slot freed above, or we see that
+    // it is waiting for it.
+    if (mWriterWaiting.load()) {
+        pthread_mutex_lock(&mSpaceAvailableMutex);
         pthread_cond_broadcast(&mSpaceAvailableCondition);
+        pthread_mutex_unlock(&mSpaceAvailableMutex);
     }
-    mSize--;
-    mStart = (mStart + 1) % mCapacity;
 }
 
 // returns true if it waited, or false if it was a no-op.
-bool SensorEventQueue::waitForSpace(pthread_mutex_t* mutex) {
+bool SensorEventQueue::waitForSpace() {
+    if (getSize() < mCapacity) {
+        return false;
+    }
     bool waited = false;
-    while (mSize == mCapacity) {
+    pthread_mutex_lock(&mSpaceAvailableMutex);
+    mWriterWaiting.store(true);
+    while (getSize() == mCapacity) {
         waited = true;
-        pthread_cond_wait(&mSpaceAvailableCondition, mutex);
+        pthread_cond_wait(&mSpaceAvailableCondition, &mSpaceAvailableMutex);
     }
+    mWriterWaiting.store(false);
+    pthread_mutex_unlock(&mSpaceAvailableMutex);
     return waited;
 }
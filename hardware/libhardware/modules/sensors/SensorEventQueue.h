@@ -19,6 +19,9 @@
 
 #include <hardware/sensors.h>
 #include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
 
 /*
  * Fixed-size circular queue, with an API developed around the sensor HAL poll() method.
@@ -27,16 +30,30 @@
  * write to, instead of using an intermediate buffer and a memcpy.
  *
  * Thread safety:
- * Reading can be done safely after grabbing the mutex lock, while poll() writing in a separate
- * thread without a mutex lock. But there can only be one writer at a time.
+ * Single producer, single consumer, without locks. One thread writes (getWritableRegion(),
+ * markAsWritten(), waitForSpace()) while another thread reads (peek(), dequeue()).
+ * There can only be one writer and one reader at a time. The only lock is taken when the
+ * writer has to block on a full queue.
  */
 class SensorEventQueue {
     int mCapacity;
-    int mStart; // start of readable region
-    int mSize; // number of readable items
+    int mStart; // start of readable region, only touched by the reader
+    int mEnd; // start of writable region, only touched by the writer
     sensors_event_t* mData;
+
+    // Total number of records written and read. Their difference is the number of readable
+    // records, which stays correct when the counters wrap around.
+    std::atomic<uint32_t> mWritten;
+    std::atomic<uint32_t> mRead;
+
+    // Only used while the queue is full.
+    std::atomic<bool> mWriterWaiting;
+    pthread_mutex_t mSpaceAvailableMutex;
     pthread_cond_t mSpaceAvailableCondition;
 
+    SensorEventQueue(const SensorEventQueue&);
+    SensorEventQueue& operator=(const SensorEventQueue&);
+
 public:
     SensorEventQueue(int capacity);
     ~SensorEventQueue();
@@ -45,32 +62,33 @@ public:
     // writable space, it will return a region of at least one. Because it must return
     // a pointer to a contiguous region, it may return smaller regions as we approach the end of
     // the data array.
-    // Only call while holding the lock.
+    // Only call from the writer.
     // The region is not marked internally in any way. Subsequent calls may return overlapping
     // regions. This class expects there to be exactly one writer at a time.
     int getWritableRegion(int requestedLength, sensors_event_t** out);
 
     // After writing to the region returned by getWritableRegion(), call this to indicate how
-    // many records were actually written.
+    // many records were actually written. The records become visible to the reader.
     // This increases size() by count.
-    // Only call while holding the lock.
+    // Only call from the writer.
     void markAsWritten(int count);
 
-    // Gets the number of readable records.
-    // Only call while holding the lock.
+    // Gets the number of readable records. May be called from either side; the result can
+    // only grow when called from the reader, and only shrink when called from the writer.
     int getSize();
 
     // Returns pointer to the first readable record, or NULL if size() is zero.
-    // Only call this while holding the lock.
+    // Only call from the reader.
     sensors_event_t* peek();
 
     // This will decrease the size by one, freeing up the oldest readable event's slot for writing.
-    // Only call while holding the lock.
+    // Only call from the reader.
     void dequeue();
 
     // Blocks until space is available. No-op if there is already space.
     // Returns true if it had to wait.
-    bool waitForSpace(pthread_mutex_t* mutex);
+    // Only call from the writer.
+    bool waitForSpace();
 };
 
 #endif // SENSOREVENTQUEUE_H_
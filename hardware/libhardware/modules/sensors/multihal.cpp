@@ -26,6 +26,7 @@
 #define LOG_NDEBUG 1
 #include <cutils/log.h>
 
+#include <atomic>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -43,12 +44,13 @@ static const int MAX_CONF_LINE_LENGTH = 1024;
 static pthread_mutex_t init_modules_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t init_sensors_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-// This mutex is shared by all queues
+// Each sub-HAL's queue is lock-free. This mutex is only taken to pause the multihal poll()
+// when all the queues are empty, and to wake it up.
 static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // Used to pause the multihal poll(). Broadcasted by sub-polling tasks if waiting_for_data.
 static pthread_cond_t data_available_cond = PTHREAD_COND_INITIALIZER;
-bool waiting_for_data = false;
+static std::atomic<bool> waiting_for_data(false);
 
 /*
  * Vector of sub modules, whose indexes are referred to in this file as module_index.
@@ -79,55 +81,121 @@ struct FullHandle {
     }
 };
 
-std::map<int, FullHandle> global_to_full;
-std::map<FullHandle, int> full_to_global;
+/*
+ * Handles are translated for every event, so both directions are flat arrays.
+ * Global handles are assigned densely from 1, and index global_to_full directly.
+ * Local handles index their module's entry of local_to_global, offset by the smallest local
+ * handle of that module. Modules whose local handles are spread too far apart for an array
+ * fall back to the full_to_global map.
+ */
+struct LocalHandleTable {
+    int firstLocalHandle;
+    std::vector<int> globalHandles; // -1 for unknown local handles
+};
+
+static const int MAX_LOCAL_HANDLE_SPAN = 1024;
+
+static std::vector<FullHandle> global_to_full(1); // global handle 0 is never assigned
+static std::vector<LocalHandleTable> local_to_global; // indexed by module index
+static std::map<FullHandle, int> full_to_global;
 int next_global_handle = 1;
 
+// Prepares the local to global table of a module with the sensors it reports.
+static void init_local_handle_table(int module_index, const struct sensor_t* list, int count) {
+    if ((int)local_to_global.size() <= module_index) {
+        local_to_global.resize(module_index + 1);
+    }
+    LocalHandleTable& table = local_to_global[module_index];
+    table.globalHandles.clear();
+    if (count <= 0) {
+        return;
+    }
+
+    int min_handle = list[0].handle;
+    int max_handle = list[0].handle;
+    for (int i = 1; i < count; i++) {
+        if (list[i].handle < min_handle) min_handle = list[i].handle;
+        if (list[i].handle > max_handle) max_handle = list[i].handle;
+    }
+    if ((int64_t)max_handle - min_handle >= MAX_LOCAL_HANDLE_SPAN) {
+        ALOGW("Local handles of module %d span [%d, %d], using a map",
+                module_index, min_handle, max_handle);
+        return;
+    }
+    table.firstLocalHandle = min_handle;
+    table.globalHandles.assign(max_handle - min_handle + 1, -1);
+}
+
 static int assign_global_handle(int module_index, int local_handle) {
     int global_handle = next_global_handle++;
     FullHandle full_handle;
     full_handle.moduleIndex = module_index;
     full_handle.localHandle = local_handle;
-    full_to_global[full_handle] = global_handle;
-    global_to_full[global_handle] = full_handle;
+
+    LocalHandleTable& table = local_to_global[module_index];
+    if (table.globalHandles.empty()) {
+        full_to_global[full_handle] = global_handle;
+    } else {
+        table.globalHandles[local_handle - table.firstLocalHandle] = global_handle;
+    }
+    global_to_full.push_back(full_handle);
     return global_handle;
 }
 
-// Returns the local handle, or -1 if it does not exist.
-static int get_local_handle(int global_handle) {
-    if (global_to_full.count(global_handle) == 0) {
+// Returns the FullHandle of a global handle, or NULL if it does not exist.
+static inline const FullHandle* get_full_handle(int global_handle) {
+    if (global_handle <= 0 || global_handle >= (int)global_to_full.size()) {
         ALOGW("Unknown global_handle %d", global_handle);
-        return -1;
+        return NULL;
     }
-    return global_to_full[global_handle].localHandle;
+    return &global_to_full[global_handle];
+}
+
+// Returns the local handle, or -1 if it does not exist.
+static int get_local_handle(int global_handle) {
+    const FullHandle* f = get_full_handle(global_handle);
+    return f == NULL ? -1 : f->localHandle;
 }
 
 // Returns the sub_hw_modules index of the module that contains the sensor associates with this
 // global_handle, or -1 if that global_handle does not exist.
 static int get_module_index(int global_handle) {
-    if (global_to_full.count(global_handle) == 0) {
-        ALOGW("Unknown global_handle %d", global_handle);
+    const FullHandle* f = get_full_handle(global_handle);
+    if (f == NULL) {
         return -1;
     }
-    FullHandle f = global_to_full[global_handle];
     ALOGV("FullHandle for global_handle %d: moduleIndex %d, localHandle %d",
-            global_handle, f.moduleIndex, f.localHandle);
-    return f.moduleIndex;
+            global_handle, f->moduleIndex, f->localHandle);
+    return f->moduleIndex;
 }
 
 // Returns the global handle for this full_handle, or -1 if the full_handle is unknown.
 static int get_global_handle(FullHandle* full_handle) {
     int global_handle = -1;
-    if (full_to_global.count(*full_handle)) {
-        global_handle = full_to_global[*full_handle];
-    } else {
+    if (full_handle->moduleIndex >= 0 && full_handle->moduleIndex < (int)local_to_global.size()) {
+        const LocalHandleTable& table = local_to_global[full_handle->moduleIndex];
+        if (!table.globalHandles.empty()) {
+            // unsigned, so that local handles below the first one are out of range too
+            size_t index = (size_t)((int64_t)full_handle->localHandle - table.firstLocalHandle);
+            if (index < table.globalHandles.size()) {
+                global_handle = table.globalHandles[index];
+            }
+        } else {
+            std::map<FullHandle, int>::const_iterator it = full_to_global.find(*full_handle);
+            if (it != full_to_global.end()) {
+                global_handle = it->second;
+            }
+        }
+    }
+    if (global_handle == -1) {
         ALOGW("Unknown FullHandle: moduleIndex %d, localHandle %d",
             full_handle->moduleIndex, full_handle->localHandle);
     }
     return global_handle;
 }
 
-static const int SENSOR_EVENT_QUEUE_CAPACITY = 20;
+// Large enough for a sub-HAL to hand over a whole batch of high-rate events in one poll().
+static const int SENSOR_EVENT_QUEUE_CAPACITY = 128;
 
 struct TaskContext {
   sensors_poll_device_t* device;
@@ -142,28 +210,29 @@ void *writerTask(void* ptr) {
     sensors_event_t* buffer;
     int eventsPolled;
     while (1) {
-        pthread_mutex_lock(&queue_mutex);
-        if (queue->waitForSpace(&queue_mutex)) {
+        // This task is the only writer of its queue, and poll() the only reader, so
+        // no lock is needed to fill it.
+        if (queue->waitForSpace()) {
             ALOGV("writerTask waited for space");
         }
         int bufferSize = queue->getWritableRegion(SENSOR_EVENT_QUEUE_CAPACITY, &buffer);
-        // Do blocking poll outside of lock
-        pthread_mutex_unlock(&queue_mutex);
 
         ALOGV("writerTask before poll() - bufferSize = %d", bufferSize);
         eventsPolled = device->poll(device, buffer, bufferSize);
         ALOGV("writerTask poll() got %d events.", eventsPolled);
-        if (eventsPolled == 0) {
+        if (eventsPolled <= 0) {
             continue;
         }
-        pthread_mutex_lock(&queue_mutex);
         queue->markAsWritten(eventsPolled);
         ALOGV("writerTask wrote %d events", eventsPolled);
-        if (waiting_for_data) {
+        // Pairs with poll(): either it sees the events written above before it waits, or
+        // we see that it is waiting.
+        if (waiting_for_data.load()) {
             ALOGV("writerTask - broadcast data_available_cond");
+            pthread_mutex_lock(&queue_mutex);
             pthread_cond_broadcast(&data_available_cond);
+            pthread_mutex_unlock(&queue_mutex);
         }
-        pthread_mutex_unlock(&queue_mutex);
     }
     // never actually returns
     return NULL;
@@ -205,6 +274,8 @@ struct sensors_poll_context_t {
     int get_device_version_by_handle(int global_handle);
 
     void copy_event_remap_handle(sensors_event_t* src, sensors_event_t* dest, int sub_index);
+    int next_queue_index();
+    bool has_readable_events();
 };
 
 void sensors_poll_context_t::addSubHwDevice(struct hw_device_t* sub_hw_device) {
@@ -327,43 +398,67 @@ void sensors_poll_context_t::copy_event_remap_handle(sensors_event_t* dest, sens
     }
 }
 
+// Returns the index of the queue holding the oldest event at its head, or -1 if all the queues
+// are empty. Ties go round robin, starting at nextReadIndex.
+int sensors_poll_context_t::next_queue_index() {
+    int queueCount = (int)this->queues.size();
+    int oldestIndex = -1;
+    int64_t oldestTimestamp = 0;
+    for (int i = 0; i < queueCount; i++) {
+        int index = (this->nextReadIndex + i) % queueCount;
+        sensors_event_t* event = this->queues[index]->peek();
+        if (event != NULL && (oldestIndex < 0 || event->timestamp < oldestTimestamp)) {
+            oldestIndex = index;
+            oldestTimestamp = event->timestamp;
+        }
+    }
+    return oldestIndex;
+}
+
+bool sensors_poll_context_t::has_readable_events() {
+    for (size_t i = 0; i < this->queues.size(); i++) {
+        if (this->queues[i]->peek() != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int sensors_poll_context_t::poll(sensors_event_t *data, int maxReads) {
     ALOGV("poll");
-    int empties = 0;
-    int queueCount = 0;
     int eventsRead = 0;
 
-    pthread_mutex_lock(&queue_mutex);
-    queueCount = (int)this->queues.size();
     while (eventsRead == 0) {
-        while (empties < queueCount && eventsRead < maxReads) {
-            SensorEventQueue* queue = this->queues.at(this->nextReadIndex);
-            sensors_event_t* event = queue->peek();
-            if (event == NULL) {
-                empties++;
+        // Merge the sub-HAL queues in timestamp order. Each queue is already in order.
+        while (eventsRead < maxReads) {
+            int index = this->next_queue_index();
+            if (index < 0) {
+                break;
+            }
+            SensorEventQueue* queue = this->queues[index];
+            this->copy_event_remap_handle(&data[eventsRead], queue->peek(), index);
+            if (data[eventsRead].sensor == -1) {
+                // Bad handle, do not pass corrupted event upstream !
+                ALOGW("Dropping bad local handle event packet on the floor");
             } else {
-                empties = 0;
-                this->copy_event_remap_handle(&data[eventsRead], event, nextReadIndex);
-                if (data[eventsRead].sensor == -1) {
-                    // Bad handle, do not pass corrupted event upstream !
-                    ALOGW("Dropping bad local handle event packet on the floor");
-                } else {
-                    eventsRead++;
-                }
-                queue->dequeue();
+                eventsRead++;
             }
-            this->nextReadIndex = (this->nextReadIndex + 1) % queueCount;
+            queue->dequeue();
+            this->nextReadIndex = (index + 1) % (int)this->queues.size();
         }
         if (eventsRead == 0) {
             // The queues have been scanned and none contain data, so wait.
             ALOGV("poll stopping to wait for data");
-            waiting_for_data = true;
-            pthread_cond_wait(&data_available_cond, &queue_mutex);
-            waiting_for_data = false;
-            empties = 0;
+            pthread_mutex_lock(&queue_mutex);
+            waiting_for_data.store(true);
+            // Check again now that the writers will wake us up.
+            if (!this->has_readable_events()) {
+                pthread_cond_wait(&data_available_cond, &queue_mutex);
+            }
+            waiting_for_data.store(false);
+            pthread_mutex_unlock(&queue_mutex);
         }
     }
-    pthread_mutex_unlock(&queue_mutex);
     ALOGV("poll returning %d events.", eventsRead);
 
     return eventsRead;
@@ -562,6 +657,7 @@ static void lazy_init_sensors_list() {
         struct sensors_module_t *module = (struct sensors_module_t*) hw_module;
         int module_sensor_count = module->get_sensors_list(module, &subhal_sensors_list);
         ALOGV("the module has %d sensors", module_sensor_count);
+        init_local_handle_table(module_index, subhal_sensors_list, module_sensor_count);
 
         // Copy the HAL's sensor list into global_sensors_list,
         // with the handle changed to be a global handle.
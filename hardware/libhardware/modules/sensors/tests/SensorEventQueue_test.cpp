@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <hardware/sensors.h>
 #include <pthread.h>
+#include <sched.h>
 #include <cutils/atomic.h>
 
 #include "SensorEventQueue.cpp"
@@ -110,11 +111,11 @@ void *fullQueueWriterTask(void* ptr) {
     sensors_event_t* buffer;
 
     while (totalWrites < FULL_QUEUE_EVENT_COUNT) {
-        pthread_mutex_lock(&mutex);
-        if (queue->waitForSpace(&mutex)) {
+        if (queue->waitForSpace()) {
             totalWaits++;
             printf(".");
         }
+        pthread_mutex_lock(&mutex);
         int writableSize = queue->getWritableRegion(FULL_QUEUE_CAPACITY, &buffer);
         queue->markAsWritten(writableSize);
         totalWrites += writableSize;
@@ -186,11 +187,86 @@ bool testFullQueueIo() {
     return true;
 }
 
+int LOCK_FREE_QUEUE_CAPACITY = 7;
+int LOCK_FREE_EVENT_COUNT = 100000;
+
+void *lockFreeWriterTask(void* ptr) {
+    TaskContext* ctx = (TaskContext*)ptr;
+    SensorEventQueue* queue = ctx->queue;
+    sensors_event_t* buffer;
+    int totalWrites = 0;
+
+    while (totalWrites < LOCK_FREE_EVENT_COUNT) {
+        queue->waitForSpace();
+        // Vary the batch sizes so that regions wrap at different offsets.
+        int writableSize = queue->getWritableRegion(1 + totalWrites % 5, &buffer);
+        if (writableSize > LOCK_FREE_EVENT_COUNT - totalWrites) {
+            writableSize = LOCK_FREE_EVENT_COUNT - totalWrites;
+        }
+        for (int i = 0; i < writableSize; i++) {
+            buffer[i].timestamp = totalWrites + i;
+        }
+        queue->markAsWritten(writableSize);
+        totalWrites += writableSize;
+    }
+    ctx->success = checkInt("totalWrites", LOCK_FREE_EVENT_COUNT, totalWrites);
+    return NULL;
+}
+
+void* lockFreeReaderTask(void* ptr) {
+    TaskContext* ctx = (TaskContext*)ptr;
+    SensorEventQueue* queue = ctx->queue;
+    int totalReads = 0;
+    ctx->success = true;
+    while (totalReads < LOCK_FREE_EVENT_COUNT) {
+        sensors_event_t* event = queue->peek();
+        if (event == NULL) {
+            sched_yield();
+            continue;
+        }
+        if (event->timestamp != totalReads) {
+            ctx->success = checkInt("timestamp", totalReads, (int)event->timestamp);
+            break;
+        }
+        queue->dequeue();
+        totalReads++;
+    }
+    ctx->success = ctx->success && checkInt("totalreads", LOCK_FREE_EVENT_COUNT, totalReads);
+    return NULL;
+}
+
+// Test that a writer and a reader without any lock see every event exactly once, in order.
+bool testLockFreeIo() {
+    printf("testLockFreeIo\n");
+    SensorEventQueue* queue = new SensorEventQueue(LOCK_FREE_QUEUE_CAPACITY);
+
+    TaskContext readerCtx;
+    readerCtx.success = true;
+    readerCtx.queue = queue;
+
+    TaskContext writerCtx;
+    writerCtx.success = true;
+    writerCtx.queue = queue;
+
+    pthread_t writer, reader;
+    pthread_create(&reader, NULL, lockFreeReaderTask, &readerCtx);
+    pthread_create(&writer, NULL, lockFreeWriterTask, &writerCtx);
+
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    if (!readerCtx.success || !writerCtx.success) return false;
+    if (!checkSize(queue, 0)) return false;
+    printf("passed\n");
+    return true;
+}
+
 
 int main(int argc, char **argv) {
     if (testSimpleWriteSizeCounts() &&
             testWrappingWriteSizeCounts() &&
-            testFullQueueIo()) {
+            testFullQueueIo() &&
+            testLockFreeIo()) {
         printf("ALL PASSED\n");
     } else {
         printf("SOMETHING FAILED\n");
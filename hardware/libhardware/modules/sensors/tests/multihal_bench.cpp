@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <hardware/sensors.h>
+#include <pthread.h>
+
+#include <algorithm>
+
+#include "SensorEventQueue.cpp"
+#include "multihal.cpp"
+
+// Load test for the multihal: fake sub-HAL modules produce events at a configurable rate, in
+// batches like FIFO-backed IMUs do, and the framework side of poll() is timed.
+
+// Run it like this:
+//
+// make sensorsmultihalbench -j32 && \
+// out/host/linux-x86/obj/EXECUTABLES/sensorsmultihalbench_intermediates/sensorsmultihalbench
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-m <modules>] [-s <sensors per module>] [-r <rate Hz>]"
+                    " [-b <batch>] [-d <duration s>]\n", me);
+    fprintf(stderr, "       -m number of fake sub-HALs, default 3\n");
+    fprintf(stderr, "       -s sensors per sub-HAL, default 4\n");
+    fprintf(stderr, "       -r events per second per sub-HAL, default 2000\n");
+    fprintf(stderr, "       -b events delivered per sub-HAL poll(), default 25\n");
+    fprintf(stderr, "       -d duration, default 5\n");
+    exit(1);
+}
+
+/*
+ * A fake sub-HAL module. Its local handles start at a different base per module, and overlap
+ * between modules, like independent HALs do.
+ */
+struct FakeSubHal {
+    sensors_module_t module; // must be first
+    int index;
+    int sensorCount;
+    int rateHz;
+    int batch;
+    sensor_t* sensors;
+    char (*names)[32];
+};
+
+struct FakeDevice {
+    sensors_poll_device_1_t device; // must be first
+    FakeSubHal* hal;
+    int64_t nextEventNs;
+    int nextSensor;
+};
+
+static int fake_get_sensors_list(struct sensors_module_t* module, struct sensor_t const** list) {
+    FakeSubHal* hal = (FakeSubHal*) module;
+    *list = hal->sensors;
+    return hal->sensorCount;
+}
+
+static int fake_activate(struct sensors_poll_device_t*, int, int) {
+    return 0;
+}
+
+static int fake_setDelay(struct sensors_poll_device_t*, int, int64_t) {
+    return 0;
+}
+
+static int fake_batch(struct sensors_poll_device_1*, int, int, int64_t, int64_t) {
+    return 0;
+}
+
+static int fake_flush(struct sensors_poll_device_1*, int) {
+    return 0;
+}
+
+static int fake_close(struct hw_device_t*) {
+    return 0;
+}
+
+// Blocks until a batch is due, then returns the events generated since the last call.
+static int fake_poll(struct sensors_poll_device_t* dev, sensors_event_t* data, int count) {
+    FakeDevice* fake = (FakeDevice*) dev;
+    FakeSubHal* hal = fake->hal;
+    int64_t periodNs = 1000000000LL / hal->rateHz;
+
+    int64_t batchDueNs = fake->nextEventNs + (hal->batch - 1) * periodNs;
+    int64_t now = nowNs();
+    if (now < batchDueNs) {
+        usleep((batchDueNs - now) / 1000);
+        now = nowNs();
+    }
+
+    int n = 0;
+    while (n < count && fake->nextEventNs <= now) {
+        sensors_event_t* event = &data[n++];
+        memset(event, 0, sizeof(*event));
+        event->version = sizeof(sensors_event_t);
+        event->sensor = hal->sensors[fake->nextSensor].handle;
+        event->type = hal->sensors[fake->nextSensor].type;
+        event->timestamp = fake->nextEventNs;
+        event->data[0] = hal->index;
+        fake->nextEventNs += periodNs;
+        fake->nextSensor = (fake->nextSensor + 1) % hal->sensorCount;
+    }
+    return n;
+}
+
+static int fake_open(const struct hw_module_t* module, const char*,
+        struct hw_device_t** device) {
+    FakeDevice* fake = new FakeDevice();
+    memset(&fake->device, 0, sizeof(fake->device));
+    fake->device.common.tag = HARDWARE_DEVICE_TAG;
+    fake->device.common.version = SENSORS_DEVICE_API_VERSION_1_3;
+    fake->device.common.module = const_cast<hw_module_t*>(module);
+    fake->device.common.close = fake_close;
+    fake->device.activate = fake_activate;
+    fake->device.setDelay = fake_setDelay;
+    fake->device.poll = fake_poll;
+    fake->device.batch = fake_batch;
+    fake->device.flush = fake_flush;
+    fake->hal = (FakeSubHal*) module;
+    fake->nextEventNs = nowNs();
+    fake->nextSensor = 0;
+    *device = &fake->device.common;
+    return 0;
+}
+
+static struct hw_module_methods_t fake_module_methods = {
+    open : fake_open
+};
+
+static FakeSubHal* newFakeSubHal(int index, int sensorCount, int rateHz, int batch) {
+    FakeSubHal* hal = new FakeSubHal();
+    memset(&hal->module, 0, sizeof(hal->module));
+    hal->module.common.tag = HARDWARE_MODULE_TAG;
+    hal->module.common.id = SENSORS_HARDWARE_MODULE_ID;
+    hal->module.common.name = "Fake Sensor Module";
+    hal->module.common.methods = &fake_module_methods;
+    hal->module.get_sensors_list = fake_get_sensors_list;
+    hal->index = index;
+    hal->sensorCount = sensorCount;
+    hal->rateHz = rateHz;
+    hal->batch = batch;
+    hal->sensors = new sensor_t[sensorCount];
+    hal->names = new char[sensorCount][32];
+    for (int i = 0; i < sensorCount; i++) {
+        snprintf(hal->names[i], sizeof(hal->names[i]), "fake %d.%d", index, i);
+        memset(&hal->sensors[i], 0, sizeof(sensor_t));
+        hal->sensors[i].name = hal->names[i];
+        hal->sensors[i].vendor = "AOSP";
+        hal->sensors[i].version = 1;
+        hal->sensors[i].handle = index * 3 + i; // overlaps with the next modules
+        hal->sensors[i].type = SENSOR_TYPE_ACCELEROMETER + i % 4;
+    }
+    return hal;
+}
+
+static int64_t percentile(std::vector<int64_t>& samples, int p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = samples.size() * p / 100;
+    if (index >= samples.size()) {
+        index = samples.size() - 1;
+    }
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    int moduleCount = 3;
+    int sensorCount = 4;
+    int rateHz = 2000;
+    int batch = 25;
+    int durationS = 5;
+
+    int res;
+    while ((res = getopt(argc, argv, "m:s:r:b:d:")) >= 0) {
+        switch (res) {
+            case 'm': moduleCount = atoi(optarg); break;
+            case 's': sensorCount = atoi(optarg); break;
+            case 'r': rateHz = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'd': durationS = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (moduleCount < 1 || sensorCount < 1 || rateHz < 1 || batch < 1 || durationS < 1) {
+        usage(me);
+    }
+
+    // Stand in for the modules lazy_init_modules() loads from the config file.
+    sub_hw_modules = new std::vector<hw_module_t *>();
+    for (int i = 0; i < moduleCount; i++) {
+        sub_hw_modules->push_back(&newFakeSubHal(i, sensorCount, rateHz, batch)->module.common);
+    }
+
+    struct sensor_t const* list;
+    int count = HAL_MODULE_INFO_SYM.get_sensors_list(&HAL_MODULE_INFO_SYM, &list);
+
+    // Expected sub-HAL of each global handle, from the names of the fake sensors.
+    std::vector<int> moduleOfHandle(count + 1, -1);
+    for (int i = 0; i < count; i++) {
+        int module, sensor;
+        if (list[i].handle <= 0 || list[i].handle > count
+                || sscanf(list[i].name, "fake %d.%d", &module, &sensor) != 2) {
+            printf("bad global sensor list entry %d\n", i);
+            return EXIT_FAILURE;
+        }
+        moduleOfHandle[list[i].handle] = module;
+    }
+
+    hw_device_t* hw_device;
+    HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+            SENSORS_HARDWARE_POLL, &hw_device);
+    sensors_poll_device_t* device = (sensors_poll_device_t*) hw_device;
+
+    static const int kBufferSize = 256;
+    sensors_event_t buffer[kBufferSize];
+    std::vector<int64_t> pollNs;
+    std::vector<int64_t> latencyNs;
+    std::vector<int64_t> lastTimestamp(moduleCount, 0);
+    int64_t totalEvents = 0;
+    int badHandles = 0;
+    int outOfOrder = 0;
+
+    int64_t startNs = nowNs();
+    int64_t endNs = startNs + durationS * 1000000000LL;
+    int64_t now = startNs;
+    while (now < endNs) {
+        int64_t pollStartNs = now;
+        int n = device->poll(device, buffer, kBufferSize);
+        now = nowNs();
+        pollNs.push_back(now - pollStartNs);
+
+        for (int i = 0; i < n; i++) {
+            const sensors_event_t& event = buffer[i];
+            int module = (int) event.data[0];
+            if (event.sensor <= 0 || event.sensor > count
+                    || moduleOfHandle[event.sensor] != module) {
+                badHandles++;
+                continue;
+            }
+            if (event.timestamp < lastTimestamp[module]) {
+                outOfOrder++;
+            }
+            lastTimestamp[module] = event.timestamp;
+            latencyNs.push_back(now - event.timestamp);
+        }
+        totalEvents += n;
+    }
+    double elapsedS = (now - startNs) / 1E9;
+
+    printf("%d sub-HALs x %d Hz in batches of %d, %d sensors each\n",
+            moduleCount, rateHz, batch, sensorCount);
+    printf("  %lld events in %.2f s, %.0f events/s, %.1f events per poll()\n",
+            (long long) totalEvents, elapsedS, totalEvents / elapsedS,
+            pollNs.empty() ? 0. : (double) totalEvents / pollNs.size());
+    printf("  poll() time p50 %.1f us, p99 %.1f us\n",
+            percentile(pollNs, 50) / 1E3, percentile(pollNs, 99) / 1E3);
+    printf("  event latency p50 %.1f us, p99 %.1f us\n",
+            percentile(latencyNs, 50) / 1E3, percentile(latencyNs, 99) / 1E3);
+    printf("  %d bad handles, %d out of order\n", badHandles, outOfOrder);
+
+    // The sub-HAL writer threads never return, leave the devices open.
+    return (badHandles == 0 && outOfOrder == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
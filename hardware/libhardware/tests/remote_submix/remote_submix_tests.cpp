@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+#include <system/audio.h>
+
+// Loads the remote submix HAL in process, records what is played through it and measures how long
+// the audio takes to go through the pipe.
+
+namespace tests {
+
+static const uint32_t kSampleRate = 48000;
+static const size_t kFrameSize = 2 * sizeof(int16_t); // stereo, 16 bit
+static const char kAddress[] = "0";
+static const int kWarmupBuffers = 20;
+static const int kMeasuredBuffers = 200;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+class RemoteSubmixDevice : public testing::Test {
+ public:
+    RemoteSubmixDevice() :
+        device_(NULL), out_(NULL), in_(NULL) {}
+    ~RemoteSubmixDevice() {}
+ protected:
+    virtual void SetUp() {
+        const hw_module_t *hw_module = NULL;
+        ASSERT_EQ(0, hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID,
+                AUDIO_HARDWARE_MODULE_ID_REMOTE_SUBMIX, &hw_module))
+                    << "Can't get remote submix module";
+        ASSERT_EQ(0, audio_hw_device_open(hw_module, &device_))
+                    << "Can't open remote submix device";
+    }
+
+    virtual void TearDown() {
+        if (in_ != NULL) {
+            device_->close_input_stream(device_, in_);
+        }
+        if (out_ != NULL) {
+            device_->close_output_stream(device_, out_);
+        }
+        if (device_ != NULL) {
+            audio_hw_device_close(device_);
+        }
+    }
+
+    // Opens the input first, so that the output never flushes the pipe.
+    void openStreams() {
+        struct audio_config config;
+        memset(&config, 0, sizeof(config));
+        config.sample_rate = kSampleRate;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        config.channel_mask = AUDIO_CHANNEL_IN_STEREO;
+        ASSERT_EQ(0, device_->open_input_stream(device_, 1, AUDIO_DEVICE_IN_REMOTE_SUBMIX,
+                &config, &in_, AUDIO_INPUT_FLAG_NONE, kAddress, AUDIO_SOURCE_REMOTE_SUBMIX));
+
+        config.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+        ASSERT_EQ(0, device_->open_output_stream(device_, 2, AUDIO_DEVICE_OUT_REMOTE_SUBMIX,
+                AUDIO_OUTPUT_FLAG_NONE, &config, &out_, kAddress));
+    }
+
+    struct Writer {
+        audio_stream_out *out;
+        size_t frames;
+        int buffers;
+        std::vector<int64_t> write_ns; // when each buffer was handed to the HAL
+    };
+
+    // Plays buffers whose samples all hold the buffer's sequence number, starting at 1.
+    static void *writerLoop(void *arg) {
+        Writer *writer = static_cast<Writer *>(arg);
+        std::vector<int16_t> buffer(writer->frames * 2);
+        for (int i = 1; i <= writer->buffers; i++) {
+            std::fill(buffer.begin(), buffer.end(), (int16_t)i);
+            writer->write_ns[i] = nowNs();
+            writer->out->write(writer->out, &buffer[0], buffer.size() * sizeof(int16_t));
+        }
+        return NULL;
+    }
+
+    // Records what is played and returns the time between each buffer being written and the
+    // read returning its first frame, in ns, sorted.
+    void measureLatency(std::vector<int64_t> *latencies_ns) {
+        Writer writer;
+        writer.out = out_;
+        writer.frames = out_->common.get_buffer_size(&out_->common) / kFrameSize;
+        writer.buffers = kWarmupBuffers + kMeasuredBuffers;
+        writer.write_ns.resize(writer.buffers + 1);
+
+        const size_t in_frames = in_->common.get_buffer_size(&in_->common) / kFrameSize;
+        std::vector<int16_t> buffer(in_frames * 2);
+
+        pthread_t thread;
+        ASSERT_EQ(0, pthread_create(&thread, NULL, writerLoop, &writer));
+        int last_seen = 0;
+        while (last_seen < writer.buffers) {
+            in_->read(in_, &buffer[0], buffer.size() * sizeof(int16_t));
+            const int64_t read_ns = nowNs();
+            for (size_t i = 0; i < buffer.size(); i += 2) {
+                const int seq = buffer[i];
+                if (seq > last_seen) {
+                    ASSERT_LE(seq, writer.buffers);
+                    if (seq > kWarmupBuffers) {
+                        latencies_ns->push_back(read_ns - writer.write_ns[seq]);
+                    }
+                    last_seen = seq;
+                }
+            }
+        }
+        pthread_join(thread, NULL);
+        std::sort(latencies_ns->begin(), latencies_ns->end());
+        ASSERT_FALSE(latencies_ns->empty());
+    }
+
+    static double percentileMs(const std::vector<int64_t> &sorted_ns, int p) {
+        return sorted_ns[std::min(sorted_ns.size() - 1, sorted_ns.size() * p / 100)] / 1E6;
+    }
+
+    audio_hw_device_t *device_;
+    audio_stream_out_t *out_;
+    audio_stream_in_t *in_;
+};
+
+TEST_F(RemoteSubmixDevice, DefaultLatency) {
+    openStreams();
+    ASSERT_FALSE(HasFatalFailure());
+
+    std::vector<int64_t> latencies_ns;
+    measureLatency(&latencies_ns);
+    ASSERT_FALSE(HasFatalFailure());
+    const double p50 = percentileMs(latencies_ns, 50);
+    const double p99 = percentileMs(latencies_ns, 99);
+    printf("default: latency p50 %.2f ms, p99 %.2f ms\n", p50, p99);
+
+    // Bounded by the pipe, plus a read period to reach the reader.
+    EXPECT_LT(p99, out_->get_latency(out_) * 1.5);
+}
+
+TEST_F(RemoteSubmixDevice, LowLatency) {
+    ASSERT_EQ(0, device_->set_parameters(device_, "r_submix_low_latency=1"));
+    openStreams();
+    ASSERT_FALSE(HasFatalFailure());
+    EXPECT_LT(out_->get_latency(out_), 25u);
+
+    std::vector<int64_t> latencies_ns;
+    measureLatency(&latencies_ns);
+    ASSERT_FALSE(HasFatalFailure());
+    const double p50 = percentileMs(latencies_ns, 50);
+    const double p99 = percentileMs(latencies_ns, 99);
+    printf("low latency: latency p50 %.2f ms, p99 %.2f ms\n", p50, p99);
+
+    EXPECT_LT(p99, 40.);
+}
+
+TEST_F(RemoteSubmixDevice, ReadWithoutDataIsPaced) {
+    openStreams();
+    ASSERT_FALSE(HasFatalFailure());
+
+    // Nothing is played: reads return silence, at the rate of the input stream.
+    const size_t in_bytes = in_->common.get_buffer_size(&in_->common);
+    const size_t in_frames = in_bytes / kFrameSize;
+    std::vector<int16_t> buffer(in_frames * 2, 1);
+    const int reads = 10;
+    const int64_t start_ns = nowNs();
+    for (int i = 0; i < reads; i++) {
+        ASSERT_EQ((ssize_t)in_bytes, in_->read(in_, &buffer[0], in_bytes));
+    }
+    const double elapsed_ms = (nowNs() - start_ns) / 1E6;
+    const double expected_ms = reads * in_frames * 1000. / kSampleRate;
+    EXPECT_EQ(0, buffer[0]);
+    EXPECT_GT(elapsed_ms, expected_ms * 0.9);
+    EXPECT_LT(elapsed_ms, expected_ms * 1.1 + 5);
+}
+
+}  // namespace tests
@@ -39,6 +39,7 @@
 #include "OMX_Component.h"
 #include "QOMX_JpegExtensions.h"
 #include "mm_jpeg_ionbuf.h"
+#include "mm_jpeg_sw_encoder.h"
 
 #define MM_JPEG_MAX_THREADS 30
 #define MM_JPEG_CIRQ_SIZE 30
@@ -338,6 +339,9 @@ typedef struct mm_jpeg_job_session {
 
   int thumb_from_main;
   uint32_t job_index;
+
+  /* job of the SW encoder, when it is used instead of OMX */
+  mm_jpeg_sw_job_t sw_job;
 } mm_jpeg_job_session_t;
 
 typedef struct {
@@ -398,6 +402,10 @@ typedef struct mm_jpeg_obj_t {
   uint32_t num_sessions;
   uint32_t reuse_reproc_buffer;
 
+  /* encode with the SW encoder instead of OMX */
+  uint32_t sw_encode;
+  mm_jpeg_sw_encoder_t sw_encoder;
+
   /*OTP Data - remains the same per camera session*/
   cam_related_system_calibration_data_t *calibration_data;
 
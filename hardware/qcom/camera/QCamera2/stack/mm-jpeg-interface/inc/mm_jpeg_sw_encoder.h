@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MM_JPEG_SW_ENCODER_H_
+#define MM_JPEG_SW_ENCODER_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "QOMX_JpegExtensions.h"
+
+#define MM_JPEG_SW_MAX_THREADS 8
+#define MM_JPEG_SW_MAX_STRIPES 64
+
+/* MCU rows per stripe. Restart markers count modulo 8, so a multiple of 8
+ * lets the stripes be joined without renumbering their markers */
+#define MM_JPEG_SW_STRIPE_MCU_ROWS 8
+
+/* number of jobs mm_jpeg keeps in flight with the SW encoder */
+#define MM_JPEG_SW_PIPELINE_DEPTH 3
+
+/** mm_jpeg_sw_image_t:
+ *  @y: first luma sample to encode
+ *  @cbcr: first chroma pair to encode
+ *  @width: width to encode
+ *  @height: height to encode
+ *  @y_stride: bytes from one luma row to the next
+ *  @cbcr_stride: bytes from one chroma row to the next
+ *  @crcb: chroma pairs are in Cr, Cb order, as in NV21
+ *
+ *  A semi planar 4:2:0 image, or a crop of one
+ **/
+typedef struct {
+  uint8_t *y;
+  uint8_t *cbcr;
+  uint32_t width;
+  uint32_t height;
+  uint32_t y_stride;
+  uint32_t cbcr_stride;
+  uint8_t crcb;
+} mm_jpeg_sw_image_t;
+
+struct mm_jpeg_sw_job;
+
+/** mm_jpeg_sw_get_output_t:
+ *
+ *  Returns a buffer of at least @size bytes for the encoded
+ *  image, or NULL to fail the job
+ **/
+typedef uint8_t *(*mm_jpeg_sw_get_output_t)(struct mm_jpeg_sw_job *p_job,
+  size_t size);
+
+/** mm_jpeg_sw_done_t:
+ *
+ *  Called from an encoder thread when the job is complete,
+ *  status is 0 on success. Not called for aborted jobs.
+ **/
+typedef void (*mm_jpeg_sw_done_t)(struct mm_jpeg_sw_job *p_job,
+  int32_t status);
+
+/** mm_jpeg_sw_job_t:
+ *  @main: main image
+ *  @quality: main image quality, 1~100
+ *  @rotation: rotation for the orientation tag, 0, 90, 180 or 270
+ *  @thumb: thumbnail source, width 0 for no thumbnail
+ *  @thumb_width: thumbnail width after scaling
+ *  @thumb_height: thumbnail height after scaling
+ *  @thumb_quality: thumbnail quality, 1~100
+ *  @exif_data: exif tags, tags from more than one table are merged
+ *  @exif_count: number of exif tags in each table
+ *  @get_output: provides the output buffer
+ *  @done: completion callback
+ *  @userdata: owned by the caller
+ *  @out_buf: encoded image, set before done is called
+ *  @out_filled: encoded image length, set before done is called
+ *
+ *  The rest is private to the encoder. The job must stay valid until
+ *  done returns or mm_jpeg_sw_encoder_abort returns, and may be
+ *  started again from done.
+ **/
+typedef struct mm_jpeg_sw_job {
+  mm_jpeg_sw_image_t main;
+  uint32_t quality;
+  uint32_t rotation;
+  mm_jpeg_sw_image_t thumb;
+  uint32_t thumb_width;
+  uint32_t thumb_height;
+  uint32_t thumb_quality;
+  QEXIF_INFO_DATA *exif_data[2];
+  uint32_t exif_count[2];
+  mm_jpeg_sw_get_output_t get_output;
+  mm_jpeg_sw_done_t done;
+  void *userdata;
+
+  uint8_t *out_buf;
+  size_t out_filled;
+
+  /* private */
+  struct mm_jpeg_sw_job *next;
+  uint32_t stripe_rows;
+  uint32_t num_stripes;
+  uint32_t num_tasks;
+  uint32_t next_task;
+  uint32_t pending;
+  int32_t status;
+  uint8_t abort;
+  uint8_t *stripe_buf[MM_JPEG_SW_MAX_STRIPES];
+  size_t stripe_len[MM_JPEG_SW_MAX_STRIPES];
+  uint8_t *thumb_buf;
+  size_t thumb_len;
+} mm_jpeg_sw_job_t;
+
+struct mm_jpeg_sw_encoder;
+
+/** mm_jpeg_sw_worker_t:
+ *  @pid: thread id
+ *  @p_encoder: encoder the thread works for
+ *  @scratch: rows deinterleaved for libjpeg
+ *  @scratch_size: size of the scratch buffer
+ *  @p_finishing: job being assembled and called back
+ **/
+typedef struct {
+  pthread_t pid;
+  struct mm_jpeg_sw_encoder *p_encoder;
+  uint8_t *scratch;
+  size_t scratch_size;
+  mm_jpeg_sw_job_t *p_finishing;
+} mm_jpeg_sw_worker_t;
+
+/** mm_jpeg_sw_encoder_t:
+ *
+ *  Pool of threads encoding the stripes and the thumbnails of
+ *  the queued jobs. A job's thumbnail is encoded alongside its
+ *  stripes, and the threads go on to the next job as soon as the
+ *  tasks of the current one are all taken, so that a burst of
+ *  jobs overlaps.
+ **/
+typedef struct mm_jpeg_sw_encoder {
+  mm_jpeg_sw_worker_t workers[MM_JPEG_SW_MAX_THREADS];
+  uint32_t num_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t task_cond;  /* a task was queued */
+  pthread_cond_t done_cond;  /* a job went idle */
+  mm_jpeg_sw_job_t *head;    /* jobs with tasks not yet taken */
+  mm_jpeg_sw_job_t *tail;
+  uint8_t running;
+} mm_jpeg_sw_encoder_t;
+
+extern int32_t mm_jpeg_sw_encoder_init(mm_jpeg_sw_encoder_t *p_encoder,
+  uint32_t num_threads);
+extern void mm_jpeg_sw_encoder_deinit(mm_jpeg_sw_encoder_t *p_encoder);
+extern int32_t mm_jpeg_sw_encoder_start(mm_jpeg_sw_encoder_t *p_encoder,
+  mm_jpeg_sw_job_t *p_job);
+extern void mm_jpeg_sw_encoder_abort(mm_jpeg_sw_encoder_t *p_encoder,
+  mm_jpeg_sw_job_t *p_job);
+
+#endif /* MM_JPEG_SW_ENCODER_H_ */
@@ -308,6 +308,14 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   omx_lib = "OMX.qcom.image.jpeg.encoder_pipeline";
 #endif
 
+  if (my_obj->sw_encode) {
+    /* nothing to configure, the job carries all of it */
+    p_session->omx_handle = NULL;
+    p_session->config = OMX_TRUE;
+    my_obj->num_sessions++;
+    return rc;
+  }
+
   rc = OMX_GetHandle(&p_session->omx_handle,
       omx_lib,
       (void *)p_session,
@@ -343,36 +351,38 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
   mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
 
   CDBG("%s:%d] E", __func__, __LINE__);
-  if (NULL == p_session->omx_handle) {
+  if ((NULL == p_session->omx_handle) && !my_obj->sw_encode) {
     CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
     return;
   }
 
-  rc = OMX_GetState(p_session->omx_handle, &state);
+  if (NULL != p_session->omx_handle) {
+    rc = OMX_GetState(p_session->omx_handle, &state);
 
-  //Check state before state transition
-  if ((state == OMX_StateExecuting) || (state == OMX_StatePause)) {
-    rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    //Check state before state transition
+    if ((state == OMX_StateExecuting) || (state == OMX_StatePause)) {
+      rc = mm_jpeg_session_change_state(p_session, OMX_StateIdle, NULL);
+      if (rc) {
+        CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+      }
     }
-  }
 
-  rc = OMX_GetState(p_session->omx_handle, &state);
+    rc = OMX_GetState(p_session->omx_handle, &state);
 
-  if (state == OMX_StateIdle) {
-    rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
-      mm_jpeg_session_free_buffers);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    if (state == OMX_StateIdle) {
+      rc = mm_jpeg_session_change_state(p_session, OMX_StateLoaded,
+        mm_jpeg_session_free_buffers);
+      if (rc) {
+        CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+      }
     }
-  }
 
-  rc = OMX_FreeHandle(p_session->omx_handle);
-  if (0 != rc) {
-    CDBG_ERROR("%s:%d] OMX_FreeHandle failed (%d)", __func__, __LINE__, rc);
+    rc = OMX_FreeHandle(p_session->omx_handle);
+    if (0 != rc) {
+      CDBG_ERROR("%s:%d] OMX_FreeHandle failed (%d)", __func__, __LINE__, rc);
+    }
+    p_session->omx_handle = NULL;
   }
-  p_session->omx_handle = NULL;
 
   pthread_mutex_destroy(&p_session->lock);
   pthread_cond_destroy(&p_session->cond);
@@ -1395,6 +1405,7 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
 OMX_BOOL mm_jpeg_session_abort(mm_jpeg_job_session_t *p_session)
 {
   OMX_ERRORTYPE ret = OMX_ErrorNone;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *)p_session->jpeg_obj;
   int rc = 0;
 
   CDBG("%s:%d] E", __func__, __LINE__);
@@ -1405,7 +1416,20 @@ OMX_BOOL mm_jpeg_session_abort(mm_jpeg_job_session_t *p_session)
     return 0;
   }
   p_session->abort_state = MM_JPEG_ABORT_INIT;
-  if (OMX_TRUE == p_session->encoding) {
+  if ((OMX_TRUE == p_session->encoding) && my_obj->sw_encode) {
+    CDBG_HIGH("%s:%d] **** ABORTING", __func__, __LINE__);
+    pthread_mutex_unlock(&p_session->lock);
+
+    /* the done callback takes the session lock, so not held here */
+    mm_jpeg_sw_encoder_abort(&my_obj->sw_encoder, &p_session->sw_job);
+    rc = mm_jpegenc_destroy_job(p_session);
+    if (rc != 0) {
+      CDBG_ERROR("%s:%d] Destroy job returned error %d",
+        __func__, __LINE__, rc);
+    }
+
+    pthread_mutex_lock(&p_session->lock);
+  } else if (OMX_TRUE == p_session->encoding) {
     p_session->state_change_pending = OMX_TRUE;
 
     CDBG_HIGH("%s:%d] **** ABORTING", __func__, __LINE__);
@@ -1754,6 +1778,265 @@ error:
   return ret;
 }
 
+/** mm_jpeg_sw_set_image:
+ *
+ *  Arguments:
+ *    @p_img: SW encoder image
+ *    @color_format: color format of the buffer
+ *    @p_buf: source buffer
+ *    @p_dim: source dimension and crop
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Points the SW encoder image at the crop of the buffer
+ *
+ **/
+static int32_t mm_jpeg_sw_set_image(mm_jpeg_sw_image_t *p_img,
+  mm_jpeg_color_format color_format, mm_jpeg_buf_t *p_buf,
+  mm_jpeg_dim_t *p_dim)
+{
+  cam_rect_t crop = p_dim->crop;
+  cam_mp_len_offset_t *p_y = &p_buf->offset.mp[0];
+  cam_mp_len_offset_t *p_cbcr = &p_buf->offset.mp[1];
+
+  if ((MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 != color_format) &&
+    (MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V2 != color_format)) {
+    CDBG_ERROR("%s:%d] color format %d not supported", __func__, __LINE__,
+      color_format);
+    return -1;
+  }
+
+  if ((crop.width == 0) || (crop.height == 0)) {
+    crop.left = 0;
+    crop.top = 0;
+    crop.width = p_dim->src_dim.width;
+    crop.height = p_dim->src_dim.height;
+  }
+  if ((crop.width <= 0) || (crop.height <= 0) ||
+    (crop.left < 0) || (crop.top < 0) ||
+    (crop.width + crop.left > p_dim->src_dim.width) ||
+    (crop.height + crop.top > p_dim->src_dim.height)) {
+    CDBG_ERROR("%s:%d] invalid crop (%d, %d) offset (%d, %d) out of (%d, %d)",
+      __func__, __LINE__, crop.width, crop.height, crop.left, crop.top,
+      p_dim->src_dim.width, p_dim->src_dim.height);
+    return -1;
+  }
+
+  /* chroma is subsampled, so the crop starts on an even pixel */
+  crop.left &= ~1;
+  crop.top &= ~1;
+
+  p_img->y = p_buf->buf_vaddr + p_y->offset +
+    (size_t)crop.top * (size_t)p_y->stride + (size_t)crop.left;
+  /* the chroma plane follows the luma plane */
+  p_img->cbcr = p_buf->buf_vaddr + p_y->len + p_cbcr->offset +
+    (size_t)(crop.top / 2) * (size_t)p_cbcr->stride + (size_t)crop.left;
+  p_img->width = (uint32_t)crop.width;
+  p_img->height = (uint32_t)crop.height;
+  p_img->y_stride = (uint32_t)p_y->stride;
+  p_img->cbcr_stride = (uint32_t)p_cbcr->stride;
+  p_img->crcb = (MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2 == color_format);
+  return 0;
+}
+
+/** mm_jpeg_sw_get_output:
+ *
+ *  Arguments:
+ *    @p_job: SW encoder job
+ *    @size: size of the encoded image
+ *
+ *  Return:
+ *       output buffer, NULL if none is big enough
+ *
+ *  Description:
+ *       Called by the SW encoder once the size of the image is
+ *       known. With get_memory the buffer is allocated then, as
+ *       the OMX component does through the mem ops.
+ *
+ **/
+static uint8_t *mm_jpeg_sw_get_output(mm_jpeg_sw_job_t *p_job, size_t size)
+{
+  mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *)p_job->userdata;
+  mm_jpeg_buf_t *p_dest =
+    &p_session->params.dest_buf[p_session->encode_job.dst_index];
+  omx_jpeg_ouput_buf_t *p_out_buf;
+  uint8_t *buf = NULL;
+
+  pthread_mutex_lock(&p_session->lock);
+  if (p_session->params.get_memory) {
+    /* the destination holds the descriptor given to get_memory */
+    p_out_buf = (omx_jpeg_ouput_buf_t *)p_dest->buf_vaddr;
+    p_out_buf->size = size;
+    p_out_buf->fd = -1;
+    if (0 == mm_jpeg_get_mem(p_out_buf, p_session)) {
+      buf = (uint8_t *)p_out_buf->vaddr;
+    }
+  } else if (size <= p_dest->buf_size) {
+    buf = p_dest->buf_vaddr;
+  } else {
+    CDBG_ERROR("%s:%d] output buffer of %zu bytes too small for %zu",
+      __func__, __LINE__, p_dest->buf_size, size);
+  }
+  pthread_mutex_unlock(&p_session->lock);
+
+  return buf;
+}
+
+/** mm_jpeg_sw_done:
+ *
+ *  Arguments:
+ *    @p_job: SW encoder job
+ *    @status: 0 if the image was encoded
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Called by the SW encoder when the job is complete, does
+ *       what mm_jpeg_fbd does for OMX
+ *
+ **/
+static void mm_jpeg_sw_done(mm_jpeg_sw_job_t *p_job, int32_t status)
+{
+  mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *)p_job->userdata;
+  mm_jpeg_output_t output_buf;
+
+  CDBG_HIGH("[KPI Perf] : PROFILE_JPEG_FBD");
+
+  pthread_mutex_lock(&p_session->lock);
+  KPI_ATRACE_INT("Camera:JPEG",
+      (int32_t)((uint32_t)GET_SESSION_IDX(
+        p_session->sessionId)<<16 | --p_session->job_index));
+  if (MM_JPEG_ABORT_NONE != p_session->abort_state) {
+    pthread_mutex_unlock(&p_session->lock);
+    return;
+  }
+
+  p_session->fbd_count++;
+  if (NULL != p_session->params.jpeg_cb) {
+
+    p_session->job_status = status ?
+      JPEG_JOB_STATUS_ERROR : JPEG_JOB_STATUS_DONE;
+    output_buf.buf_filled_len = p_job->out_filled;
+    output_buf.buf_vaddr = p_session->params.get_memory ?
+      p_session->params.dest_buf[p_session->encode_job.dst_index].buf_vaddr :
+      p_job->out_buf;
+    output_buf.fd = -1;
+    CDBG_HIGH("%s:%d] send jpeg callback %d buf 0x%p len %zu JobID %u",
+      __func__, __LINE__,
+      p_session->job_status, p_job->out_buf,
+      p_job->out_filled, p_session->jobId);
+    p_session->params.jpeg_cb(p_session->job_status,
+      p_session->client_hdl,
+      p_session->jobId,
+      status ? NULL : &output_buf,
+      p_session->params.userdata);
+
+    mm_jpegenc_job_done(p_session);
+
+    mm_jpeg_put_mem((void *)p_session);
+  }
+  pthread_mutex_unlock(&p_session->lock);
+}
+
+/** mm_jpeg_session_sw_encode:
+ *
+ *  Arguments:
+ *    @p_session: encode session
+ *
+ *  Return:
+ *       OMX_ERRORTYPE
+ *
+ *  Description:
+ *       Start the encoding with the SW encoder. The image is
+ *       encoded as stripes on all cores, the thumbnail along with
+ *       them, and the next job may start before this one is done.
+ *
+ **/
+static OMX_ERRORTYPE mm_jpeg_session_sw_encode(mm_jpeg_job_session_t *p_session)
+{
+  OMX_ERRORTYPE ret = OMX_ErrorNone;
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *)p_session->jpeg_obj;
+  mm_jpeg_encode_params_t *p_params = &p_session->params;
+  mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
+  mm_jpeg_sw_job_t *p_job = &p_session->sw_job;
+  QOMX_EXIF_INFO exif_info;
+
+  pthread_mutex_lock(&p_session->lock);
+  p_session->abort_state = MM_JPEG_ABORT_NONE;
+  p_session->encoding = OMX_FALSE;
+  pthread_mutex_unlock(&p_session->lock);
+
+  if ((0 > p_jobparams->src_index) || (0 > p_jobparams->dst_index)) {
+    CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    ret = OMX_ErrorUnsupportedIndex;
+    goto error;
+  }
+
+  if (p_session->thumb_from_main) {
+    p_jobparams->thumb_index = (uint32_t)p_jobparams->src_index;
+    p_jobparams->thumb_dim.crop = p_jobparams->main_dim.crop;
+  }
+
+  memset(p_job, 0, sizeof(*p_job));
+  if (mm_jpeg_sw_set_image(&p_job->main, p_params->color_format,
+    &p_params->src_main_buf[p_jobparams->src_index],
+    &p_jobparams->main_dim)) {
+    ret = OMX_ErrorBadParameter;
+    goto error;
+  }
+  p_job->quality = p_params->quality;
+  p_job->rotation = p_jobparams->rotation;
+
+  if (p_params->encode_thumbnail) {
+    if (mm_jpeg_sw_set_image(&p_job->thumb, p_params->thumb_color_format,
+      &p_params->src_thumb_buf[p_jobparams->thumb_index],
+      &p_jobparams->thumb_dim)) {
+      ret = OMX_ErrorBadParameter;
+      goto error;
+    }
+    p_job->thumb_width = (uint32_t)p_jobparams->thumb_dim.dst_dim.width;
+    p_job->thumb_height = (uint32_t)p_jobparams->thumb_dim.dst_dim.height;
+    p_job->thumb_quality = p_params->thumb_quality;
+  }
+
+  /* exif tags from the HAL, then the ones parsed from the metadata */
+  memset(&p_session->exif_info_local[0], 0, sizeof(p_session->exif_info_local));
+  exif_info.numOfEntries = 0;
+  exif_info.exif_data = &p_session->exif_info_local[0];
+  process_meta_data(p_jobparams->p_metadata, &exif_info,
+    &p_jobparams->cam_exif_params, p_jobparams->hal_version);
+  p_session->exif_count_local = (int)exif_info.numOfEntries;
+
+  p_job->exif_data[0] = p_jobparams->exif_info.exif_data;
+  p_job->exif_count[0] = p_jobparams->exif_info.numOfEntries;
+  p_job->exif_data[1] = &p_session->exif_info_local[0];
+  p_job->exif_count[1] = exif_info.numOfEntries;
+
+  p_job->get_output = mm_jpeg_sw_get_output;
+  p_job->done = mm_jpeg_sw_done;
+  p_job->userdata = p_session;
+
+  pthread_mutex_lock(&p_session->lock);
+  p_session->encoding = OMX_TRUE;
+  pthread_mutex_unlock(&p_session->lock);
+
+  MM_JPEG_CHK_ABORT(p_session, ret, error);
+
+  if (mm_jpeg_sw_encoder_start(&my_obj->sw_encoder, p_job)) {
+    CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
+    ret = OMX_ErrorUndefined;
+    goto error;
+  }
+
+error:
+
+  CDBG("%s:%d] X ", __func__, __LINE__);
+  return ret;
+}
+
 /** mm_jpeg_process_encoding_job:
  *
  *  Arguments:
@@ -1832,7 +2115,11 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
 
   p_session->encode_job = job_node->enc_info.encode_job;
   p_session->jobId = job_node->enc_info.job_id;
-  ret = mm_jpeg_session_encode(p_session);
+  if (my_obj->sw_encode) {
+    ret = mm_jpeg_session_sw_encode(p_session);
+  } else {
+    ret = mm_jpeg_session_encode(p_session);
+  }
   if (ret) {
     CDBG_ERROR("%s:%d] encode session failed", __func__, __LINE__);
     goto error;
@@ -1882,6 +2169,7 @@ static void *mm_jpeg_jobmgr_thread(void *data)
   int rc = 0;
   int running = 1;
   uint32_t num_ongoing_jobs = 0;
+  uint32_t max_ongoing_jobs;
   mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
   mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
   mm_jpeg_job_q_node_t* node = NULL;
@@ -1900,9 +2188,11 @@ static void *mm_jpeg_jobmgr_thread(void *data)
     /* check ongoing q size */
     num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
 
+    max_ongoing_jobs = my_obj->sw_encode ?
+      MM_JPEG_SW_PIPELINE_DEPTH : MM_JPEG_CONCURRENT_SESSIONS_COUNT;
     CDBG("%s:%d] ongoing job  %d %d", __func__,
-      __LINE__, num_ongoing_jobs, MM_JPEG_CONCURRENT_SESSIONS_COUNT);
-    if (num_ongoing_jobs >= MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
+      __LINE__, num_ongoing_jobs, max_ongoing_jobs);
+    if (num_ongoing_jobs >= max_ongoing_jobs) {
       CDBG_ERROR("%s:%d] ongoing job already reach max %d", __func__,
         __LINE__, num_ongoing_jobs);
       continue;
@@ -2123,8 +2413,9 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
     return -1;
   }
 
-  /* allocate work buffer if reproc source buffer is not supposed to be used */
-  if (!my_obj->reuse_reproc_buffer) {
+  /* allocate work buffer if reproc source buffer is not supposed to be used,
+   * the SW encoder does without */
+  if (!my_obj->reuse_reproc_buffer && !my_obj->sw_encode) {
     work_buf_size = CEILING64((uint32_t)my_obj->max_pic_w) *
      CEILING64((uint32_t)my_obj->max_pic_h) * 3U / 2U;
     rc = mm_jpeg_alloc_workbuffer(my_obj, initial_workbufs_cnt, work_buf_size);
@@ -2134,6 +2425,18 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
     }
   }
 
+  if (my_obj->sw_encode) {
+    /* one thread per core */
+    rc = mm_jpeg_sw_encoder_init(&my_obj->sw_encoder, 0);
+    if (0 != rc) {
+      CDBG_ERROR("%s:%d] SW encoder init failed (%d)", __func__, __LINE__, rc);
+      mm_jpeg_jobmgr_thread_release(my_obj);
+      mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+      pthread_mutex_destroy(&my_obj->job_lock);
+    }
+    return rc;
+  }
+
   /* load OMX */
   if (OMX_ErrorNone != OMX_Init()) {
     /* roll back in error case */
@@ -2181,8 +2484,12 @@ int32_t mm_jpeg_deinit(mm_jpeg_obj *my_obj)
     CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
   }
 
-  /* unload OMX engine */
-  OMX_Deinit();
+  if (my_obj->sw_encode) {
+    mm_jpeg_sw_encoder_deinit(&my_obj->sw_encoder);
+  } else {
+    /* unload OMX engine */
+    OMX_Deinit();
+  }
 
   /* deinit ongoing job and cb queue */
   rc = mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
@@ -2307,7 +2614,7 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
 
   p_session = &my_obj->clnt_mgr[client_idx].session[session_idx];
 
-  if (my_obj->reuse_reproc_buffer) {
+  if (my_obj->reuse_reproc_buffer && !my_obj->sw_encode) {
     p_session->work_buffer.addr           = p_jobparams->work_buf.buf_vaddr;
     p_session->work_buffer.size           = p_jobparams->work_buf.buf_size;
     p_session->work_buffer.ion_info_fd.fd = p_jobparams->work_buf.fd;
@@ -2530,10 +2837,11 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   }
 
   if (p_params->burst_mode) {
-    num_omx_sessions = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
+    num_omx_sessions = my_obj->sw_encode ?
+      MM_JPEG_SW_PIPELINE_DEPTH : MM_JPEG_CONCURRENT_SESSIONS_COUNT;
   }
 
-  if (!my_obj->reuse_reproc_buffer) {
+  if (!my_obj->reuse_reproc_buffer && !my_obj->sw_encode) {
     work_bufs_need = num_omx_sessions;
     if (work_bufs_need > MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
       work_bufs_need = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
@@ -2598,7 +2906,12 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     p_prev_session = p_session;
 
     buf_idx = i;
-    if (buf_idx < MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
+    if (my_obj->sw_encode) {
+      /* the SW encoder has its own scratch buffers */
+      p_session->work_buffer.addr = NULL;
+      p_session->work_buffer.ion_fd = -1;
+      p_session->work_buffer.p_pmem_fd = -1;
+    } else if (buf_idx < MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
       p_session->work_buffer = my_obj->ionBuffer[buf_idx];
     } else {
       CDBG_ERROR("%s %d: Invalid Index, Setting buffer add to null", __func__, __LINE__);
@@ -379,6 +379,12 @@ uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_jpeg_mpo_ops_t *mpo_ops,
     CDBG_HIGH("%s, %d] reuse_reproc_buffer %d ", __func__, __LINE__,
       jpeg_obj->reuse_reproc_buffer);
 
+    /* encode on the CPU cores instead of the OMX component */
+    property_get("persist.camera.jpeg.swenc", prop, "0");
+    jpeg_obj->sw_encode = (uint32_t)atoi(prop);
+    CDBG_HIGH("%s, %d] sw_encode %d ", __func__, __LINE__,
+      jpeg_obj->sw_encode);
+
     /* used for work buf calculation */
     jpeg_obj->max_pic_w = picture_size.w;
     jpeg_obj->max_pic_h = picture_size.h;
@@ -0,0 +1,1168 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "jpeglib.h"
+#include "jerror.h"
+
+#include "mm_jpeg_dbg.h"
+#include "mm_jpeg_sw_encoder.h"
+
+/* The main image is encoded as stripes of MCU rows, each one a JPEG of its
+ * own with a restart marker after every MCU row. All stripes use the same
+ * tables, and a restart marker resets the DC predictors just as the start
+ * of a scan does, so the entropy coded data of the stripes joined with a
+ * restart marker in between is the scan of the whole image. The header is
+ * taken from the first stripe with the image height patched in. */
+
+#define M_SOF0  0xc0
+#define M_RST0  0xd0
+#define M_SOI   0xd8
+#define M_EOI   0xd9
+#define M_SOS   0xda
+#define M_APP1  0xe1
+
+#define MM_JPEG_SW_MCU_SIZE 16
+#define MM_JPEG_SW_CEILING16(x) (((x) + 15U) & ~15U)
+
+/* the APP1 segment length field covers at most 64K */
+#define MM_JPEG_SW_MAX_APP1_LEN 0xffff
+#define MM_JPEG_SW_MAX_IFD_ENTRIES 64
+
+/** mm_jpeg_sw_dest_t:
+ *  @pub: libjpeg destination manager
+ *  @pp_buf: output buffer, grown as needed
+ *  @size: size of the output buffer
+ *
+ *  libjpeg destination writing into a malloc'd buffer
+ **/
+typedef struct {
+  struct jpeg_destination_mgr pub;
+  uint8_t **pp_buf;
+  size_t size;
+} mm_jpeg_sw_dest_t;
+
+/** mm_jpeg_sw_error_t:
+ *  @pub: libjpeg error manager
+ *  @env: where to go on error
+ **/
+typedef struct {
+  struct jpeg_error_mgr pub;
+  jmp_buf env;
+} mm_jpeg_sw_error_t;
+
+/** mm_jpeg_sw_ifd_entry_t:
+ *  @tag: tag id within the IFD
+ *  @type: exif_tag_type_t
+ *  @count: number of values
+ *  @data: the values, if not in @value
+ *  @value: the values if they fit
+ **/
+typedef struct {
+  uint16_t tag;
+  uint16_t type;
+  uint32_t count;
+  const uint8_t *data;
+  uint8_t value[8];
+} mm_jpeg_sw_ifd_entry_t;
+
+typedef struct {
+  mm_jpeg_sw_ifd_entry_t entries[MM_JPEG_SW_MAX_IFD_ENTRIES];
+  uint32_t count;
+} mm_jpeg_sw_ifd_t;
+
+static void mm_jpeg_sw_init_destination(j_compress_ptr cinfo)
+{
+  mm_jpeg_sw_dest_t *p_dest = (mm_jpeg_sw_dest_t *)cinfo->dest;
+
+  p_dest->pub.next_output_byte = *p_dest->pp_buf;
+  p_dest->pub.free_in_buffer = p_dest->size;
+}
+
+static boolean mm_jpeg_sw_empty_output_buffer(j_compress_ptr cinfo)
+{
+  mm_jpeg_sw_dest_t *p_dest = (mm_jpeg_sw_dest_t *)cinfo->dest;
+  size_t size = p_dest->size * 2;
+  uint8_t *buf = (uint8_t *)realloc(*p_dest->pp_buf, size);
+
+  if (NULL == buf) {
+    ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+  }
+  /* the whole buffer was filled */
+  p_dest->pub.next_output_byte = buf + p_dest->size;
+  p_dest->pub.free_in_buffer = size - p_dest->size;
+  *p_dest->pp_buf = buf;
+  p_dest->size = size;
+  return TRUE;
+}
+
+static void mm_jpeg_sw_term_destination(j_compress_ptr cinfo)
+{
+  (void)cinfo;
+}
+
+static void mm_jpeg_sw_error_exit(j_common_ptr cinfo)
+{
+  mm_jpeg_sw_error_t *p_err = (mm_jpeg_sw_error_t *)cinfo->err;
+  char msg[JMSG_LENGTH_MAX];
+
+  (*cinfo->err->format_message)(cinfo, msg);
+  CDBG_ERROR("%s:%d] %s", __func__, __LINE__, msg);
+  longjmp(p_err->env, 1);
+}
+
+/** mm_jpeg_sw_compress:
+ *
+ *  Arguments:
+ *    @p_worker: worker thread
+ *    @p_img: image
+ *    @first_row: first row to encode, a multiple of 16
+ *    @num_rows: number of rows to encode
+ *    @quality: quality
+ *    @restart: put a restart marker after each MCU row
+ *    @pp_buf: output buffer, allocated here
+ *    @p_len: output length
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Encodes rows of the image as a JPEG of their own, with
+ *       the chroma passed to libjpeg as it is
+ *
+ **/
+static int32_t mm_jpeg_sw_compress(mm_jpeg_sw_worker_t *p_worker,
+  mm_jpeg_sw_image_t *p_img, uint32_t first_row, uint32_t num_rows,
+  uint32_t quality, int restart, uint8_t **pp_buf, size_t *p_len)
+{
+  struct jpeg_compress_struct cinfo;
+  mm_jpeg_sw_error_t jerr;
+  mm_jpeg_sw_dest_t dest;
+  JSAMPROW y_rows[MM_JPEG_SW_MCU_SIZE];
+  JSAMPROW cb_rows[MM_JPEG_SW_MCU_SIZE / 2];
+  JSAMPROW cr_rows[MM_JPEG_SW_MCU_SIZE / 2];
+  JSAMPARRAY planes[3] = { y_rows, cb_rows, cr_rows };
+  uint32_t width = p_img->width;
+  uint32_t padded_width = MM_JPEG_SW_CEILING16(width);
+  uint32_t chroma_width = (width + 1) / 2;
+  uint32_t last_row = first_row + num_rows - 1;
+  int pad_luma = (width != padded_width);
+  size_t scratch_size = (size_t)padded_width * 24;
+  uint8_t *luma_scratch, *cb_scratch, *cr_scratch;
+  uint32_t row, i, x;
+
+  if (p_worker->scratch_size < scratch_size) {
+    uint8_t *scratch = (uint8_t *)realloc(p_worker->scratch, scratch_size);
+    if (NULL == scratch) {
+      CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+      return -1;
+    }
+    p_worker->scratch = scratch;
+    p_worker->scratch_size = scratch_size;
+  }
+  luma_scratch = p_worker->scratch;
+  cb_scratch = luma_scratch + padded_width * 16;
+  cr_scratch = cb_scratch + padded_width / 2 * 8;
+
+  /* most of the time a fourth of the raw size is plenty */
+  dest.size = (size_t)width * num_rows / 4 + 4096;
+  dest.pp_buf = pp_buf;
+  *pp_buf = (uint8_t *)malloc(dest.size);
+  if (NULL == *pp_buf) {
+    CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+    return -1;
+  }
+  dest.pub.init_destination = mm_jpeg_sw_init_destination;
+  dest.pub.empty_output_buffer = mm_jpeg_sw_empty_output_buffer;
+  dest.pub.term_destination = mm_jpeg_sw_term_destination;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = mm_jpeg_sw_error_exit;
+  if (setjmp(jerr.env)) {
+    jpeg_destroy_compress(&cinfo);
+    free(*pp_buf);
+    *pp_buf = NULL;
+    return -1;
+  }
+
+  jpeg_create_compress(&cinfo);
+  cinfo.dest = &dest.pub;
+  cinfo.image_width = width;
+  cinfo.image_height = num_rows;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, (int)quality, TRUE);
+  cinfo.raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+  cinfo.do_fancy_downsampling = FALSE;
+#endif
+  /* exif goes in front, written by the caller */
+  cinfo.write_JFIF_header = FALSE;
+  cinfo.comp_info[0].h_samp_factor = 2;
+  cinfo.comp_info[0].v_samp_factor = 2;
+  cinfo.comp_info[1].h_samp_factor = 1;
+  cinfo.comp_info[1].v_samp_factor = 1;
+  cinfo.comp_info[2].h_samp_factor = 1;
+  cinfo.comp_info[2].v_samp_factor = 1;
+  if (restart) {
+    cinfo.restart_in_rows = 1;
+  }
+  jpeg_start_compress(&cinfo, TRUE);
+
+  for (row = 0; row < num_rows; row += MM_JPEG_SW_MCU_SIZE) {
+    /* rows past the end repeat the last one */
+    for (i = 0; i < MM_JPEG_SW_MCU_SIZE; i++) {
+      uint32_t r = first_row + row + i;
+      uint8_t *src;
+      if (r > last_row) {
+        r = last_row;
+      }
+      src = p_img->y + (size_t)r * p_img->y_stride;
+      if (pad_luma) {
+        uint8_t *dst = luma_scratch + i * padded_width;
+        memcpy(dst, src, width);
+        memset(dst + width, src[width - 1], padded_width - width);
+        src = dst;
+      }
+      y_rows[i] = src;
+    }
+    for (i = 0; i < MM_JPEG_SW_MCU_SIZE / 2; i++) {
+      uint32_t r = (first_row + row) / 2 + i;
+      const uint8_t *src;
+      uint8_t *cb = cb_scratch + i * padded_width / 2;
+      uint8_t *cr = cr_scratch + i * padded_width / 2;
+      const uint8_t *cb_src, *cr_src;
+      if (r > last_row / 2) {
+        r = last_row / 2;
+      }
+      src = p_img->cbcr + (size_t)r * p_img->cbcr_stride;
+      cb_src = src + (p_img->crcb ? 1 : 0);
+      cr_src = src + (p_img->crcb ? 0 : 1);
+      for (x = 0; x < chroma_width; x++) {
+        cb[x] = cb_src[2 * x];
+        cr[x] = cr_src[2 * x];
+      }
+      for (; x < padded_width / 2; x++) {
+        cb[x] = cb[chroma_width - 1];
+        cr[x] = cr[chroma_width - 1];
+      }
+      cb_rows[i] = cb;
+      cr_rows[i] = cr;
+    }
+    jpeg_write_raw_data(&cinfo, planes, MM_JPEG_SW_MCU_SIZE);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  *p_len = dest.size - dest.pub.free_in_buffer;
+  jpeg_destroy_compress(&cinfo);
+  return 0;
+}
+
+/** mm_jpeg_sw_scale_plane:
+ *
+ *  Arguments:
+ *    @src: first source sample
+ *    @src_w: source width
+ *    @src_h: source height
+ *    @src_stride: source stride in bytes
+ *    @dst: first destination sample
+ *    @dst_w: destination width
+ *    @dst_h: destination height
+ *    @dst_stride: destination stride in bytes
+ *    @step: bytes from one sample to the next
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Scales a plane, each destination sample being the
+ *       average of the source samples it covers
+ *
+ **/
+static void mm_jpeg_sw_scale_plane(const uint8_t *src, uint32_t src_w,
+  uint32_t src_h, uint32_t src_stride, uint8_t *dst, uint32_t dst_w,
+  uint32_t dst_h, uint32_t dst_stride, uint32_t step)
+{
+  uint32_t x, y, sx, sy;
+
+  for (y = 0; y < dst_h; y++) {
+    uint32_t y0 = (uint32_t)((uint64_t)y * src_h / dst_h);
+    uint32_t y1 = (uint32_t)((uint64_t)(y + 1) * src_h / dst_h);
+    if (y1 <= y0) {
+      y1 = y0 + 1;
+    }
+    for (x = 0; x < dst_w; x++) {
+      uint32_t x0 = (uint32_t)((uint64_t)x * src_w / dst_w);
+      uint32_t x1 = (uint32_t)((uint64_t)(x + 1) * src_w / dst_w);
+      uint32_t sum = 0, n;
+      if (x1 <= x0) {
+        x1 = x0 + 1;
+      }
+      n = (x1 - x0) * (y1 - y0);
+      for (sy = y0; sy < y1; sy++) {
+        const uint8_t *p = src + (size_t)sy * src_stride + x0 * step;
+        for (sx = x0; sx < x1; sx++, p += step) {
+          sum += *p;
+        }
+      }
+      dst[(size_t)y * dst_stride + x * step] = (uint8_t)((sum + n / 2) / n);
+    }
+  }
+}
+
+/** mm_jpeg_sw_encode_thumbnail:
+ *
+ *  Arguments:
+ *    @p_worker: worker thread
+ *    @p_job: job
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Scales and encodes the thumbnail
+ *
+ **/
+static int32_t mm_jpeg_sw_encode_thumbnail(mm_jpeg_sw_worker_t *p_worker,
+  mm_jpeg_sw_job_t *p_job)
+{
+  mm_jpeg_sw_image_t *p_src = &p_job->thumb;
+  mm_jpeg_sw_image_t scaled;
+  uint32_t w = p_job->thumb_width, h = p_job->thumb_height;
+  uint8_t *buf;
+  int32_t rc;
+
+  buf = (uint8_t *)malloc((size_t)w * h + (size_t)(w + 1) / 2 * 2 * ((h + 1) / 2));
+  if (NULL == buf) {
+    CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+    return -1;
+  }
+  scaled.y = buf;
+  scaled.cbcr = buf + (size_t)w * h;
+  scaled.width = w;
+  scaled.height = h;
+  scaled.y_stride = w;
+  scaled.cbcr_stride = (w + 1) / 2 * 2;
+  scaled.crcb = p_src->crcb;
+
+  mm_jpeg_sw_scale_plane(p_src->y, p_src->width, p_src->height,
+    p_src->y_stride, scaled.y, w, h, scaled.y_stride, 1);
+  mm_jpeg_sw_scale_plane(p_src->cbcr, (p_src->width + 1) / 2,
+    (p_src->height + 1) / 2, p_src->cbcr_stride, scaled.cbcr,
+    (w + 1) / 2, (h + 1) / 2, scaled.cbcr_stride, 2);
+  mm_jpeg_sw_scale_plane(p_src->cbcr + 1, (p_src->width + 1) / 2,
+    (p_src->height + 1) / 2, p_src->cbcr_stride, scaled.cbcr + 1,
+    (w + 1) / 2, (h + 1) / 2, scaled.cbcr_stride, 2);
+
+  rc = mm_jpeg_sw_compress(p_worker, &scaled, 0, h, p_job->thumb_quality, 0,
+    &p_job->thumb_buf, &p_job->thumb_len);
+  free(buf);
+  return rc;
+}
+
+/** mm_jpeg_sw_has_thumbnail:
+ *
+ *  Arguments:
+ *    @p_job: job
+ *
+ *  Return:
+ *       non zero if the job has a thumbnail to encode
+ *
+ **/
+static int mm_jpeg_sw_has_thumbnail(mm_jpeg_sw_job_t *p_job)
+{
+  return p_job->thumb.width && p_job->thumb.height &&
+    p_job->thumb_width && p_job->thumb_height;
+}
+
+/** mm_jpeg_sw_run_task:
+ *
+ *  Arguments:
+ *    @p_worker: worker thread
+ *    @p_job: job
+ *    @task: task index, the thumbnail comes first
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ **/
+static int32_t mm_jpeg_sw_run_task(mm_jpeg_sw_worker_t *p_worker,
+  mm_jpeg_sw_job_t *p_job, uint32_t task)
+{
+  uint32_t stripe, first_row, num_rows;
+
+  if (mm_jpeg_sw_has_thumbnail(p_job)) {
+    if (0 == task) {
+      return mm_jpeg_sw_encode_thumbnail(p_worker, p_job);
+    }
+    task--;
+  }
+
+  stripe = task;
+  first_row = stripe * p_job->stripe_rows;
+  num_rows = p_job->main.height - first_row;
+  if (num_rows > p_job->stripe_rows) {
+    num_rows = p_job->stripe_rows;
+  }
+  return mm_jpeg_sw_compress(p_worker, &p_job->main, first_row, num_rows,
+    p_job->quality, 1, &p_job->stripe_buf[stripe], &p_job->stripe_len[stripe]);
+}
+
+/** mm_jpeg_sw_find_scan:
+ *
+ *  Arguments:
+ *    @buf: JPEG written by libjpeg
+ *    @len: length of the JPEG
+ *    @p_sof: offset of the SOF0 marker
+ *    @p_scan: offset of the entropy coded data
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ **/
+static int32_t mm_jpeg_sw_find_scan(const uint8_t *buf, size_t len,
+  size_t *p_sof, size_t *p_scan)
+{
+  size_t pos = 2;
+
+  if (len < 4 || buf[0] != 0xff || buf[1] != M_SOI ||
+    buf[len - 2] != 0xff || buf[len - 1] != M_EOI) {
+    return -1;
+  }
+  *p_sof = 0;
+  while (pos + 4 <= len) {
+    uint8_t marker = buf[pos + 1];
+    if (buf[pos] != 0xff) {
+      return -1;
+    }
+    if (M_SOF0 == marker) {
+      *p_sof = pos;
+    }
+    pos += 2 + (size_t)(buf[pos + 2] << 8 | buf[pos + 3]);
+    if (M_SOS == marker) {
+      *p_scan = pos;
+      return (*p_sof && pos <= len - 2) ? 0 : -1;
+    }
+  }
+  return -1;
+}
+
+static size_t mm_jpeg_sw_exif_type_size(uint16_t type)
+{
+  switch (type) {
+  case EXIF_SHORT:
+    return 2;
+  case EXIF_LONG:
+  case EXIF_SLONG:
+    return 4;
+  case EXIF_RATIONAL:
+  case EXIF_SRATIONAL:
+    return 8;
+  default:
+    return 1;
+  }
+}
+
+static mm_jpeg_sw_ifd_entry_t *mm_jpeg_sw_ifd_get(mm_jpeg_sw_ifd_t *p_ifd,
+  uint16_t tag)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_ifd->count; i++) {
+    if (p_ifd->entries[i].tag == tag) {
+      return &p_ifd->entries[i];
+    }
+  }
+  if (p_ifd->count == MM_JPEG_SW_MAX_IFD_ENTRIES) {
+    CDBG_ERROR("%s:%d] too many exif tags, 0x%x dropped", __func__, __LINE__,
+      tag);
+    return NULL;
+  }
+  return &p_ifd->entries[p_ifd->count++];
+}
+
+static void mm_jpeg_sw_ifd_add(mm_jpeg_sw_ifd_t *p_ifd, uint16_t tag,
+  exif_tag_entry_t *p_entry)
+{
+  mm_jpeg_sw_ifd_entry_t *p = mm_jpeg_sw_ifd_get(p_ifd, tag);
+  size_t size = mm_jpeg_sw_exif_type_size((uint16_t)p_entry->type);
+
+  if (NULL == p) {
+    return;
+  }
+  p->tag = tag;
+  p->type = (uint16_t)p_entry->type;
+  p->count = p_entry->count;
+  p->data = NULL;
+  if (EXIF_ASCII == p_entry->type || EXIF_UNDEFINED == p_entry->type ||
+    p_entry->count > 1) {
+    p->data = p_entry->data._bytes;
+  } else {
+    /* single values are in the union, in the byte order of the tiff */
+    memcpy(p->value, &p_entry->data, size);
+  }
+}
+
+static void mm_jpeg_sw_ifd_add_long(mm_jpeg_sw_ifd_t *p_ifd, uint16_t tag,
+  uint16_t type, uint32_t value)
+{
+  exif_tag_entry_t entry;
+
+  memset(&entry, 0, sizeof(entry));
+  entry.type = (exif_tag_type_t)type;
+  entry.count = 1;
+  if (EXIF_SHORT == type) {
+    entry.data._short = (uint16_t)value;
+  } else {
+    entry.data._long = value;
+  }
+  mm_jpeg_sw_ifd_add(p_ifd, tag, &entry);
+}
+
+static size_t mm_jpeg_sw_ifd_data_size(mm_jpeg_sw_ifd_entry_t *p)
+{
+  return mm_jpeg_sw_exif_type_size(p->type) * p->count;
+}
+
+static size_t mm_jpeg_sw_ifd_size(mm_jpeg_sw_ifd_t *p_ifd)
+{
+  size_t size = 2 + 12 * p_ifd->count + 4;
+  uint32_t i;
+
+  for (i = 0; i < p_ifd->count; i++) {
+    size_t data_size = mm_jpeg_sw_ifd_data_size(&p_ifd->entries[i]);
+    if (data_size > 4) {
+      size += (data_size + 1) & ~1U;
+    }
+  }
+  return size;
+}
+
+static void mm_jpeg_sw_put16(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void mm_jpeg_sw_put32(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/** mm_jpeg_sw_ifd_write:
+ *
+ *  Arguments:
+ *    @p_ifd: IFD
+ *    @tiff: start of the tiff header
+ *    @offset: offset of the IFD from the tiff header
+ *    @next: offset of the next IFD, 0 for none
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Writes the IFD and the values that don't fit in its
+ *       entries, sorted by tag as tiff wants
+ *
+ **/
+static void mm_jpeg_sw_ifd_write(mm_jpeg_sw_ifd_t *p_ifd, uint8_t *tiff,
+  size_t offset, size_t next)
+{
+  uint8_t *p = tiff + offset;
+  size_t data_offset = offset + 2 + 12 * p_ifd->count + 4;
+  uint32_t i, j;
+
+  for (i = 1; i < p_ifd->count; i++) {
+    mm_jpeg_sw_ifd_entry_t entry = p_ifd->entries[i];
+    for (j = i; j > 0 && p_ifd->entries[j - 1].tag > entry.tag; j--) {
+      p_ifd->entries[j] = p_ifd->entries[j - 1];
+    }
+    p_ifd->entries[j] = entry;
+  }
+
+  mm_jpeg_sw_put16(p, p_ifd->count);
+  p += 2;
+  for (i = 0; i < p_ifd->count; i++, p += 12) {
+    mm_jpeg_sw_ifd_entry_t *e = &p_ifd->entries[i];
+    size_t data_size = mm_jpeg_sw_ifd_data_size(e);
+    const uint8_t *data = e->data ? e->data : e->value;
+    mm_jpeg_sw_put16(p, e->tag);
+    mm_jpeg_sw_put16(p + 2, e->type);
+    mm_jpeg_sw_put32(p + 4, e->count);
+    memset(p + 8, 0, 4);
+    if (data_size <= 4) {
+      memcpy(p + 8, data, data_size);
+    } else {
+      mm_jpeg_sw_put32(p + 8, (uint32_t)data_offset);
+      memcpy(tiff + data_offset, data, data_size);
+      data_offset += (data_size + 1) & ~1U;
+    }
+  }
+  mm_jpeg_sw_put32(p, (uint32_t)next);
+}
+
+/** mm_jpeg_sw_write_exif:
+ *
+ *  Arguments:
+ *    @p_job: job
+ *    @buf: output
+ *    @with_thumbnail: embed the thumbnail
+ *
+ *  Return:
+ *       length of the APP1 segment, 0 if it does not fit
+ *
+ *  Description:
+ *       Writes the exif APP1 segment from the tags of the job.
+ *       The IFD pointers, the image dimensions and the thumbnail
+ *       tags are filled in here.
+ *
+ **/
+static size_t mm_jpeg_sw_write_exif(mm_jpeg_sw_job_t *p_job, uint8_t *buf,
+  int with_thumbnail)
+{
+  static const uint8_t exif_header[] = { 'E', 'x', 'i', 'f', 0, 0 };
+  static const uint8_t tiff_header[] = { 'I', 'I', 0x2a, 0, 8, 0, 0, 0 };
+  mm_jpeg_sw_ifd_t *p_ifds;
+  mm_jpeg_sw_ifd_t *p_ifd0, *p_exif_ifd, *p_gps_ifd, *p_ifd1;
+  size_t ifd0_offset = sizeof(tiff_header), exif_offset, gps_offset = 0;
+  size_t ifd1_offset = 0, thumb_offset = 0, tiff_len, len = 0;
+  uint8_t *tiff = buf + 4 + sizeof(exif_header);
+  uint32_t i, t;
+
+  /* too big for the stack of a worker */
+  p_ifds = (mm_jpeg_sw_ifd_t *)calloc(4, sizeof(mm_jpeg_sw_ifd_t));
+  if (NULL == p_ifds) {
+    CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+    return 0;
+  }
+  p_ifd0 = &p_ifds[0];
+  p_exif_ifd = &p_ifds[1];
+  p_gps_ifd = &p_ifds[2];
+  p_ifd1 = &p_ifds[3];
+
+  for (t = 0; t < 2; t++) {
+    for (i = 0; i < p_job->exif_count[t]; i++) {
+      QEXIF_INFO_DATA *p_tag = &p_job->exif_data[t][i];
+      uint32_t offset = p_tag->tag_id >> 16;
+      uint16_t tag = (uint16_t)p_tag->tag_id;
+      if (offset < NEW_SUBFILE_TYPE) {
+        mm_jpeg_sw_ifd_add(p_gps_ifd, tag, &p_tag->tag_entry);
+      } else if (offset < TN_IMAGE_WIDTH) {
+        if (offset != EXIF_IFD && offset != GPS_IFD) {
+          mm_jpeg_sw_ifd_add(p_ifd0, tag, &p_tag->tag_entry);
+        }
+      } else if (offset < EXPOSURE_TIME) {
+        if (offset != TN_JPEGINTERCHANGE_FORMAT &&
+          offset != TN_JPEGINTERCHANGE_FORMAT_L) {
+          mm_jpeg_sw_ifd_add(p_ifd1, tag, &p_tag->tag_entry);
+        }
+      } else if (offset != INTEROP) {
+        mm_jpeg_sw_ifd_add(p_exif_ifd, tag, &p_tag->tag_entry);
+      }
+    }
+  }
+
+  /* no pixels are rotated, the orientation tells the viewer */
+  if (p_job->rotation) {
+    uint32_t orientation = 1;
+    switch (p_job->rotation) {
+    case 90:
+      orientation = 6;
+      break;
+    case 180:
+      orientation = 3;
+      break;
+    case 270:
+      orientation = 8;
+      break;
+    }
+    mm_jpeg_sw_ifd_add_long(p_ifd0, 0x0112, EXIF_SHORT, orientation);
+  }
+  mm_jpeg_sw_ifd_add_long(p_exif_ifd, 0xa002, EXIF_LONG, p_job->main.width);
+  mm_jpeg_sw_ifd_add_long(p_exif_ifd, 0xa003, EXIF_LONG, p_job->main.height);
+
+  /* the pointers go in first, so that the sizes are right */
+  mm_jpeg_sw_ifd_add_long(p_ifd0, 0x8769, EXIF_LONG, 0);
+  if (p_gps_ifd->count) {
+    mm_jpeg_sw_ifd_add_long(p_ifd0, 0x8825, EXIF_LONG, 0);
+  }
+  if (with_thumbnail) {
+    mm_jpeg_sw_ifd_add_long(p_ifd1, 0x0103, EXIF_SHORT, 6);
+    mm_jpeg_sw_ifd_add_long(p_ifd1, 0x0201, EXIF_LONG, 0);
+    mm_jpeg_sw_ifd_add_long(p_ifd1, 0x0202, EXIF_LONG,
+      (uint32_t)p_job->thumb_len);
+  }
+
+  exif_offset = ifd0_offset + mm_jpeg_sw_ifd_size(p_ifd0);
+  tiff_len = exif_offset + mm_jpeg_sw_ifd_size(p_exif_ifd);
+  if (p_gps_ifd->count) {
+    gps_offset = tiff_len;
+    tiff_len += mm_jpeg_sw_ifd_size(p_gps_ifd);
+  }
+  if (with_thumbnail) {
+    ifd1_offset = tiff_len;
+    thumb_offset = ifd1_offset + mm_jpeg_sw_ifd_size(p_ifd1);
+    tiff_len = thumb_offset + p_job->thumb_len;
+  }
+  if (2 + sizeof(exif_header) + tiff_len > MM_JPEG_SW_MAX_APP1_LEN) {
+    goto done;
+  }
+
+  mm_jpeg_sw_ifd_add_long(p_ifd0, 0x8769, EXIF_LONG, (uint32_t)exif_offset);
+  if (p_gps_ifd->count) {
+    mm_jpeg_sw_ifd_add_long(p_ifd0, 0x8825, EXIF_LONG, (uint32_t)gps_offset);
+  }
+  if (with_thumbnail) {
+    mm_jpeg_sw_ifd_add_long(p_ifd1, 0x0201, EXIF_LONG, (uint32_t)thumb_offset);
+  }
+
+  buf[0] = 0xff;
+  buf[1] = M_APP1;
+  len = 2 + sizeof(exif_header) + tiff_len;
+  buf[2] = (uint8_t)(len >> 8);
+  buf[3] = (uint8_t)len;
+  memcpy(buf + 4, exif_header, sizeof(exif_header));
+  memcpy(tiff, tiff_header, sizeof(tiff_header));
+  mm_jpeg_sw_ifd_write(p_ifd0, tiff, ifd0_offset, ifd1_offset);
+  mm_jpeg_sw_ifd_write(p_exif_ifd, tiff, exif_offset, 0);
+  if (p_gps_ifd->count) {
+    mm_jpeg_sw_ifd_write(p_gps_ifd, tiff, gps_offset, 0);
+  }
+  if (with_thumbnail) {
+    mm_jpeg_sw_ifd_write(p_ifd1, tiff, ifd1_offset, 0);
+    memcpy(tiff + thumb_offset, p_job->thumb_buf, p_job->thumb_len);
+  }
+  /* plus the marker */
+  len += 2;
+
+done:
+  free(p_ifds);
+  return len;
+}
+
+/** mm_jpeg_sw_assemble:
+ *
+ *  Arguments:
+ *    @p_job: job with all stripes encoded
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Joins the exif and the stripes into the output buffer
+ *
+ **/
+static int32_t mm_jpeg_sw_assemble(mm_jpeg_sw_job_t *p_job)
+{
+  size_t sof[MM_JPEG_SW_MAX_STRIPES], scan[MM_JPEG_SW_MAX_STRIPES];
+  size_t app1_len, total, hdr_len;
+  uint32_t stripe_mcu_rows = p_job->stripe_rows / MM_JPEG_SW_MCU_SIZE;
+  uint8_t *app1, *out, *p;
+  uint32_t i;
+
+  for (i = 0; i < p_job->num_stripes; i++) {
+    if (mm_jpeg_sw_find_scan(p_job->stripe_buf[i], p_job->stripe_len[i],
+      &sof[i], &scan[i])) {
+      CDBG_ERROR("%s:%d] bad stripe %u", __func__, __LINE__, i);
+      return -1;
+    }
+  }
+
+  app1 = (uint8_t *)malloc(MM_JPEG_SW_MAX_APP1_LEN + 2);
+  if (NULL == app1) {
+    CDBG_ERROR("%s:%d] no mem", __func__, __LINE__);
+    return -1;
+  }
+  app1_len = 0;
+  if (p_job->thumb_buf) {
+    app1_len = mm_jpeg_sw_write_exif(p_job, app1, 1);
+    if (!app1_len) {
+      CDBG_ERROR("%s:%d] thumbnail of %zu bytes dropped", __func__, __LINE__,
+        p_job->thumb_len);
+    }
+  }
+  if (!app1_len) {
+    app1_len = mm_jpeg_sw_write_exif(p_job, app1, 0);
+  }
+
+  /* SOI, APP1, tables and frame header, scans, restart markers, EOI */
+  hdr_len = scan[0] - 2;
+  total = 2 + app1_len + hdr_len + 2;
+  for (i = 0; i < p_job->num_stripes; i++) {
+    total += p_job->stripe_len[i] - scan[i] - 2;
+  }
+  total += 2 * (p_job->num_stripes - 1);
+
+  out = p_job->get_output(p_job, total);
+  if (NULL == out) {
+    CDBG_ERROR("%s:%d] no output buffer for %zu bytes", __func__, __LINE__,
+      total);
+    free(app1);
+    return -1;
+  }
+
+  p = out;
+  *p++ = 0xff;
+  *p++ = M_SOI;
+  memcpy(p, app1, app1_len);
+  p += app1_len;
+  free(app1);
+
+  memcpy(p, p_job->stripe_buf[0] + 2, hdr_len);
+  /* the height in the frame header is the first stripe's */
+  p[sof[0] - 2 + 5] = (uint8_t)(p_job->main.height >> 8);
+  p[sof[0] - 2 + 6] = (uint8_t)p_job->main.height;
+  p += hdr_len;
+
+  for (i = 0; i < p_job->num_stripes; i++) {
+    size_t len = p_job->stripe_len[i] - scan[i] - 2;
+    if (i > 0) {
+      *p++ = 0xff;
+      *p++ = (uint8_t)(M_RST0 + (i * stripe_mcu_rows - 1) % 8);
+    }
+    memcpy(p, p_job->stripe_buf[i] + scan[i], len);
+    p += len;
+  }
+  *p++ = 0xff;
+  *p++ = M_EOI;
+
+  p_job->out_buf = out;
+  p_job->out_filled = (size_t)(p - out);
+  return 0;
+}
+
+static void mm_jpeg_sw_free_job_bufs(mm_jpeg_sw_job_t *p_job)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_job->num_stripes; i++) {
+    free(p_job->stripe_buf[i]);
+    p_job->stripe_buf[i] = NULL;
+  }
+  free(p_job->thumb_buf);
+  p_job->thumb_buf = NULL;
+}
+
+/** mm_jpeg_sw_worker_thread:
+ *
+ *  Arguments:
+ *    @data: worker
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Takes the tasks of the queued jobs in order. Whoever
+ *       finishes the last task of a job assembles it and calls
+ *       its done callback.
+ *
+ **/
+static void *mm_jpeg_sw_worker_thread(void *data)
+{
+  mm_jpeg_sw_worker_t *p_worker = (mm_jpeg_sw_worker_t *)data;
+  mm_jpeg_sw_encoder_t *p_encoder = p_worker->p_encoder;
+  mm_jpeg_sw_job_t *p_job;
+  uint32_t task;
+  int skip;
+  int32_t rc;
+
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_sw", 0, 0, 0);
+
+  pthread_mutex_lock(&p_encoder->lock);
+  for (;;) {
+    while (p_encoder->running && NULL == p_encoder->head) {
+      pthread_cond_wait(&p_encoder->task_cond, &p_encoder->lock);
+    }
+    if (!p_encoder->running) {
+      break;
+    }
+
+    p_job = p_encoder->head;
+    task = p_job->next_task++;
+    if (p_job->next_task == p_job->num_tasks) {
+      p_encoder->head = p_job->next;
+      if (NULL == p_encoder->head) {
+        p_encoder->tail = NULL;
+      }
+    }
+    /* no use going on with a job that failed */
+    skip = p_job->status || p_job->abort;
+    pthread_mutex_unlock(&p_encoder->lock);
+
+    rc = 0;
+    if (!skip) {
+      rc = mm_jpeg_sw_run_task(p_worker, p_job, task);
+    }
+
+    pthread_mutex_lock(&p_encoder->lock);
+    if (rc) {
+      p_job->status = rc;
+    }
+    if (p_job->pending > 1) {
+      p_job->pending--;
+      continue;
+    }
+
+    /* the job may be started again from its done callback, so it is
+     * no longer pending here. abort waits on p_finishing instead */
+    p_job->pending = 0;
+    if (!p_job->abort) {
+      p_worker->p_finishing = p_job;
+      pthread_mutex_unlock(&p_encoder->lock);
+      rc = p_job->status;
+      if (!rc) {
+        rc = mm_jpeg_sw_assemble(p_job);
+      }
+      mm_jpeg_sw_free_job_bufs(p_job);
+      p_job->done(p_job, rc);
+      pthread_mutex_lock(&p_encoder->lock);
+      p_worker->p_finishing = NULL;
+    } else {
+      mm_jpeg_sw_free_job_bufs(p_job);
+    }
+    pthread_cond_broadcast(&p_encoder->done_cond);
+  }
+  pthread_mutex_unlock(&p_encoder->lock);
+
+  return NULL;
+}
+
+/** mm_jpeg_sw_encoder_init:
+ *
+ *  Arguments:
+ *    @p_encoder: encoder
+ *    @num_threads: number of threads, 0 for one per cpu
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Starts the encoder threads
+ *
+ **/
+int32_t mm_jpeg_sw_encoder_init(mm_jpeg_sw_encoder_t *p_encoder,
+  uint32_t num_threads)
+{
+  uint32_t i;
+
+  if (0 == num_threads) {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    num_threads = cpus > 0 ? (uint32_t)cpus : 1;
+  }
+  if (num_threads > MM_JPEG_SW_MAX_THREADS) {
+    num_threads = MM_JPEG_SW_MAX_THREADS;
+  }
+
+  memset(p_encoder, 0, sizeof(*p_encoder));
+  pthread_mutex_init(&p_encoder->lock, NULL);
+  pthread_cond_init(&p_encoder->task_cond, NULL);
+  pthread_cond_init(&p_encoder->done_cond, NULL);
+  p_encoder->running = 1;
+
+  for (i = 0; i < num_threads; i++) {
+    mm_jpeg_sw_worker_t *p_worker = &p_encoder->workers[i];
+    p_worker->p_encoder = p_encoder;
+    if (pthread_create(&p_worker->pid, NULL, mm_jpeg_sw_worker_thread,
+      p_worker)) {
+      CDBG_ERROR("%s:%d] cannot start thread %u", __func__, __LINE__, i);
+      break;
+    }
+  }
+  p_encoder->num_threads = i;
+
+  if (0 == p_encoder->num_threads) {
+    mm_jpeg_sw_encoder_deinit(p_encoder);
+    return -1;
+  }
+  CDBG_HIGH("%s:%d] %u threads", __func__, __LINE__, p_encoder->num_threads);
+  return 0;
+}
+
+/** mm_jpeg_sw_encoder_deinit:
+ *
+ *  Arguments:
+ *    @p_encoder: encoder
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Stops the encoder threads. Jobs still queued are
+ *       dropped without their done callback.
+ *
+ **/
+void mm_jpeg_sw_encoder_deinit(mm_jpeg_sw_encoder_t *p_encoder)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&p_encoder->lock);
+  p_encoder->running = 0;
+  pthread_cond_broadcast(&p_encoder->task_cond);
+  pthread_mutex_unlock(&p_encoder->lock);
+
+  for (i = 0; i < p_encoder->num_threads; i++) {
+    pthread_join(p_encoder->workers[i].pid, NULL);
+    free(p_encoder->workers[i].scratch);
+    p_encoder->workers[i].scratch = NULL;
+    p_encoder->workers[i].scratch_size = 0;
+  }
+  p_encoder->num_threads = 0;
+
+  pthread_cond_destroy(&p_encoder->done_cond);
+  pthread_cond_destroy(&p_encoder->task_cond);
+  pthread_mutex_destroy(&p_encoder->lock);
+}
+
+/** mm_jpeg_sw_encoder_start:
+ *
+ *  Arguments:
+ *    @p_encoder: encoder
+ *    @p_job: job
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Queues the stripes and the thumbnail of the job
+ *
+ **/
+int32_t mm_jpeg_sw_encoder_start(mm_jpeg_sw_encoder_t *p_encoder,
+  mm_jpeg_sw_job_t *p_job)
+{
+  uint32_t mcu_rows, stripe_mcu_rows;
+
+  if (!p_job->main.width || !p_job->main.height ||
+    p_job->main.width > 65535 || p_job->main.height > 65535 ||
+    !p_job->get_output || !p_job->done) {
+    CDBG_ERROR("%s:%d] invalid job %ux%u", __func__, __LINE__,
+      p_job->main.width, p_job->main.height);
+    return -1;
+  }
+
+  mcu_rows = (p_job->main.height + MM_JPEG_SW_MCU_SIZE - 1) /
+    MM_JPEG_SW_MCU_SIZE;
+  stripe_mcu_rows = MM_JPEG_SW_STRIPE_MCU_ROWS;
+  while ((mcu_rows + stripe_mcu_rows - 1) / stripe_mcu_rows >
+    MM_JPEG_SW_MAX_STRIPES) {
+    stripe_mcu_rows += MM_JPEG_SW_STRIPE_MCU_ROWS;
+  }
+
+  p_job->stripe_rows = stripe_mcu_rows * MM_JPEG_SW_MCU_SIZE;
+  p_job->num_stripes = (mcu_rows + stripe_mcu_rows - 1) / stripe_mcu_rows;
+  p_job->num_tasks = p_job->num_stripes +
+    (mm_jpeg_sw_has_thumbnail(p_job) ? 1 : 0);
+  p_job->next_task = 0;
+  p_job->pending = p_job->num_tasks;
+  p_job->status = 0;
+  p_job->abort = 0;
+  p_job->next = NULL;
+  p_job->out_buf = NULL;
+  p_job->out_filled = 0;
+  memset(p_job->stripe_buf, 0, sizeof(p_job->stripe_buf));
+  p_job->thumb_buf = NULL;
+  p_job->thumb_len = 0;
+
+  pthread_mutex_lock(&p_encoder->lock);
+  if (!p_encoder->running) {
+    pthread_mutex_unlock(&p_encoder->lock);
+    return -1;
+  }
+  if (p_encoder->tail) {
+    p_encoder->tail->next = p_job;
+  } else {
+    p_encoder->head = p_job;
+  }
+  p_encoder->tail = p_job;
+  pthread_cond_broadcast(&p_encoder->task_cond);
+  pthread_mutex_unlock(&p_encoder->lock);
+
+  return 0;
+}
+
+static int mm_jpeg_sw_is_finishing(mm_jpeg_sw_encoder_t *p_encoder,
+  mm_jpeg_sw_job_t *p_job)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_encoder->num_threads; i++) {
+    if (p_encoder->workers[i].p_finishing == p_job) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** mm_jpeg_sw_encoder_abort:
+ *
+ *  Arguments:
+ *    @p_encoder: encoder
+ *    @p_job: job
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Drops the tasks of the job not yet taken and waits for
+ *       the ones running. The done callback is not called unless
+ *       it already was being called, in which case this waits for
+ *       it to return.
+ *
+ **/
+void mm_jpeg_sw_encoder_abort(mm_jpeg_sw_encoder_t *p_encoder,
+  mm_jpeg_sw_job_t *p_job)
+{
+  mm_jpeg_sw_job_t *p_prev = NULL, *p_cur;
+
+  pthread_mutex_lock(&p_encoder->lock);
+  p_job->abort = 1;
+
+  for (p_cur = p_encoder->head; p_cur; p_prev = p_cur, p_cur = p_cur->next) {
+    if (p_cur != p_job) {
+      continue;
+    }
+    if (p_prev) {
+      p_prev->next = p_job->next;
+    } else {
+      p_encoder->head = p_job->next;
+    }
+    if (p_encoder->tail == p_job) {
+      p_encoder->tail = p_prev;
+    }
+    p_job->pending -= p_job->num_tasks - p_job->next_task;
+    p_job->next_task = p_job->num_tasks;
+    if (0 == p_job->pending) {
+      mm_jpeg_sw_free_job_bufs(p_job);
+    }
+    break;
+  }
+
+  while (p_job->pending > 0 || mm_jpeg_sw_is_finishing(p_encoder, p_job)) {
+    pthread_cond_wait(&p_encoder->done_cond, &p_encoder->lock);
+  }
+  pthread_mutex_unlock(&p_encoder->lock);
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm_jpeg_sw_encoder.h"
+
+/* Encodes NV21 frames read from files with the SW encoder of mm-jpeg-interface,
+ * keeping a number of jobs in flight as mm_jpeg does for a burst, and reports
+ * the images/sec. -j 1 -d 1 gives the single threaded, one job at a time
+ * baseline.
+ *
+ * Run it like this:
+ *
+ * mm-jpeg-sw-bench -W 4160 -H 3120 -I frame0.yuv -I frame1.yuv -n 50 -O out.jpg
+ */
+
+#define MAX_FILES 16
+#define MAX_DEPTH 8
+
+typedef struct {
+  mm_jpeg_sw_job_t job;
+  uint8_t *out;
+  size_t out_size;
+  int64_t start_ns;
+  int busy;
+} bench_job_t;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t g_done, g_failed;
+static int64_t g_latency_ns;
+static size_t g_bytes;
+static bench_job_t *g_last;
+
+static int64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me)
+{
+  fprintf(stderr, "usage: %s -W <width> -H <height> -I <nv21 file> [-I <file>...]"
+    " [options]\n", me);
+  fprintf(stderr, "       -n images to encode, default 20\n");
+  fprintf(stderr, "       -j encoder threads, 0 for one per cpu, default 0\n");
+  fprintf(stderr, "       -d jobs in flight, default %d\n", MM_JPEG_SW_PIPELINE_DEPTH);
+  fprintf(stderr, "       -q quality, default 95\n");
+  fprintf(stderr, "       -t thumbnail width x height, 0x0 for none, default 320x240\n");
+  fprintf(stderr, "       -O write the last image to this file\n");
+  exit(1);
+}
+
+static uint8_t *get_output(mm_jpeg_sw_job_t *p_job, size_t size)
+{
+  bench_job_t *p_bench = (bench_job_t *)p_job->userdata;
+  return size <= p_bench->out_size ? p_bench->out : NULL;
+}
+
+static void done(mm_jpeg_sw_job_t *p_job, int32_t status)
+{
+  bench_job_t *p_bench = (bench_job_t *)p_job->userdata;
+
+  pthread_mutex_lock(&g_lock);
+  if (status) {
+    g_failed++;
+  } else {
+    g_bytes += p_job->out_filled;
+    g_last = p_bench;
+  }
+  g_latency_ns += now_ns() - p_bench->start_ns;
+  g_done++;
+  p_bench->busy = 0;
+  pthread_cond_signal(&g_cond);
+  pthread_mutex_unlock(&g_lock);
+}
+
+static uint8_t *read_frame(const char *path, size_t size)
+{
+  FILE *fp = fopen(path, "rb");
+  uint8_t *buf;
+
+  if (NULL == fp) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  buf = (uint8_t *)malloc(size);
+  if (NULL == buf || fread(buf, 1, size, fp) != size) {
+    fprintf(stderr, "%s is shorter than a frame of %zu bytes\n", path, size);
+    exit(EXIT_FAILURE);
+  }
+  fclose(fp);
+  return buf;
+}
+
+int main(int argc, char **argv)
+{
+  const char *me = argv[0];
+  const char *files[MAX_FILES];
+  const char *out_path = NULL;
+  uint8_t *frames[MAX_FILES];
+  bench_job_t jobs[MAX_DEPTH];
+  mm_jpeg_sw_encoder_t encoder;
+  char make[] = "QCOM-AA";
+  char model[] = "QCAM-AA";
+  QEXIF_INFO_DATA exif[2];
+  uint32_t num_files = 0, width = 0, height = 0, count = 20, threads = 0;
+  uint32_t depth = MM_JPEG_SW_PIPELINE_DEPTH, quality = 95;
+  uint32_t thumb_width = 320, thumb_height = 240;
+  uint32_t i, submitted = 0, num_threads;
+  int64_t start_ns;
+  double elapsed_s;
+  int c;
+
+  while ((c = getopt(argc, argv, "W:H:I:n:j:d:q:t:O:")) != -1) {
+    switch (c) {
+    case 'W': width = (uint32_t)atoi(optarg); break;
+    case 'H': height = (uint32_t)atoi(optarg); break;
+    case 'I':
+      if (num_files == MAX_FILES) {
+        usage(me);
+      }
+      files[num_files++] = optarg;
+      break;
+    case 'n': count = (uint32_t)atoi(optarg); break;
+    case 'j': threads = (uint32_t)atoi(optarg); break;
+    case 'd': depth = (uint32_t)atoi(optarg); break;
+    case 'q': quality = (uint32_t)atoi(optarg); break;
+    case 't':
+      if (sscanf(optarg, "%ux%u", &thumb_width, &thumb_height) != 2) {
+        usage(me);
+      }
+      break;
+    case 'O': out_path = optarg; break;
+    default: usage(me);
+    }
+  }
+  if (!width || !height || !num_files || !count || !depth || depth > MAX_DEPTH) {
+    usage(me);
+  }
+
+  for (i = 0; i < num_files; i++) {
+    frames[i] = read_frame(files[i], (size_t)width * height * 3 / 2);
+  }
+
+  memset(exif, 0, sizeof(exif));
+  exif[0].tag_id = EXIFTAGID_MAKE;
+  exif[0].tag_entry.type = EXIF_ASCII;
+  exif[0].tag_entry.count = sizeof(make);
+  exif[0].tag_entry.data._ascii = make;
+  exif[1].tag_id = EXIFTAGID_MODEL;
+  exif[1].tag_entry.type = EXIF_ASCII;
+  exif[1].tag_entry.count = sizeof(model);
+  exif[1].tag_entry.data._ascii = model;
+
+  memset(jobs, 0, sizeof(jobs));
+  for (i = 0; i < depth; i++) {
+    jobs[i].out_size = (size_t)width * height * 3 / 2 + 65536;
+    jobs[i].out = (uint8_t *)malloc(jobs[i].out_size);
+    if (NULL == jobs[i].out) {
+      fprintf(stderr, "no mem\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (mm_jpeg_sw_encoder_init(&encoder, threads)) {
+    fprintf(stderr, "cannot start the encoder\n");
+    return EXIT_FAILURE;
+  }
+
+  start_ns = now_ns();
+  pthread_mutex_lock(&g_lock);
+  while (g_done < count) {
+    bench_job_t *p_bench = NULL;
+    for (i = 0; submitted < count && i < depth; i++) {
+      if (!jobs[i].busy) {
+        p_bench = &jobs[i];
+        break;
+      }
+    }
+    if (NULL == p_bench) {
+      pthread_cond_wait(&g_cond, &g_lock);
+      continue;
+    }
+
+    uint8_t *frame = frames[submitted % num_files];
+    mm_jpeg_sw_job_t *p_job = &p_bench->job;
+    memset(p_job, 0, sizeof(*p_job));
+    p_job->main.y = frame;
+    p_job->main.cbcr = frame + (size_t)width * height;
+    p_job->main.width = width;
+    p_job->main.height = height;
+    p_job->main.y_stride = width;
+    p_job->main.cbcr_stride = width;
+    p_job->main.crcb = 1;
+    p_job->quality = quality;
+    if (thumb_width && thumb_height) {
+      p_job->thumb = p_job->main;
+      p_job->thumb_width = thumb_width;
+      p_job->thumb_height = thumb_height;
+      p_job->thumb_quality = 75;
+    }
+    p_job->exif_data[0] = exif;
+    p_job->exif_count[0] = 2;
+    p_job->get_output = get_output;
+    p_job->done = done;
+    p_job->userdata = p_bench;
+    p_bench->busy = 1;
+    p_bench->start_ns = now_ns();
+    submitted++;
+
+    pthread_mutex_unlock(&g_lock);
+    if (mm_jpeg_sw_encoder_start(&encoder, p_job)) {
+      fprintf(stderr, "cannot start job %u\n", submitted);
+      return EXIT_FAILURE;
+    }
+    pthread_mutex_lock(&g_lock);
+  }
+  pthread_mutex_unlock(&g_lock);
+  elapsed_s = (now_ns() - start_ns) / 1E9;
+
+  num_threads = encoder.num_threads;
+  mm_jpeg_sw_encoder_deinit(&encoder);
+
+  if (out_path && g_last) {
+    FILE *fp = fopen(out_path, "wb");
+    if (NULL == fp || fwrite(g_last->out, 1, g_last->job.out_filled, fp) !=
+      g_last->job.out_filled) {
+      fprintf(stderr, "cannot write %s\n", out_path);
+      return EXIT_FAILURE;
+    }
+    fclose(fp);
+  }
+
+  printf("%ux%u, %u images, %u threads, %u in flight\n", width, height, count,
+    num_threads, depth);
+  printf("  %.2f s, %.2f images/s, %.1f ms per image, %zu bytes per image\n",
+    elapsed_s, count / elapsed_s, g_latency_ns / 1E6 / count,
+    g_bytes / (count - g_failed ? count - g_failed : 1));
+  if (g_failed) {
+    printf("  %u failed\n", g_failed);
+  }
+
+  for (i = 0; i < depth; i++) {
+    free(jobs[i].out);
+  }
+  for (i = 0; i < num_files; i++) {
+    free(frames[i]);
+  }
+  return g_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -45,12 +45,16 @@ namespace qcamera {
  *
  * RETURN     : None
  *==========================================================================*/
-QCameraCmdThread::QCameraCmdThread() :
-    cmd_queue()
+QCameraCmdThread::QCameraCmdThread()
 {
     cmd_pid = 0;
+    m_cmds = NULL;
+    m_cmdCapacity = 0;
+    m_cmdFront = 0;
+    m_cmdCount = 0;
     cam_sem_init(&sync_sem, 0);
     cam_sem_init(&cmd_sem, 0);
+    reserveCmd();
 }
 
 /*===========================================================================
@@ -66,6 +70,7 @@ QCameraCmdThread::~QCameraCmdThread()
 {
     cam_sem_destroy(&sync_sem);
     cam_sem_destroy(&cmd_sem);
+    free(m_cmds);
 }
 
 /*===========================================================================
@@ -111,6 +116,40 @@ int32_t QCameraCmdThread::setName(const char* name)
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : reserveCmd
+ *
+ * DESCRIPTION: make room for one more pending cmd, doubling the ring if it
+ *              is full. Called with the mutex of cmd_sem held, except from
+ *              the constructor.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- success; false -- no memory
+ *==========================================================================*/
+bool QCameraCmdThread::reserveCmd()
+{
+    if (m_cmdCount < m_cmdCapacity) {
+        return true;
+    }
+
+    int capacity = (m_cmdCapacity > 0) ? m_cmdCapacity * 2 : INITIAL_CMD_CAPACITY;
+    camera_cmd_type_t *cmds =
+        (camera_cmd_type_t *)malloc(sizeof(camera_cmd_type_t) * capacity);
+    if (NULL == cmds) {
+        return false;
+    }
+
+    for (int i = 0; i < m_cmdCount; i++) {
+        cmds[i] = m_cmds[(m_cmdFront + i) & (m_cmdCapacity - 1)];
+    }
+    free(m_cmds);
+    m_cmds = cmds;
+    m_cmdCapacity = capacity;
+    m_cmdFront = 0;
+    return true;
+}
+
 /*===========================================================================
  * FUNCTION   : sendCmd
  *
@@ -129,26 +168,25 @@ int32_t QCameraCmdThread::setName(const char* name)
  *==========================================================================*/
 int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority)
 {
-    camera_cmd_t *node = (camera_cmd_t *)malloc(sizeof(camera_cmd_t));
-    if (NULL == node) {
+    /* queue the cmd and post cmd_sem in one go, as cam_sem_post would */
+    pthread_mutex_lock(&cmd_sem.mutex);
+    if (!reserveCmd()) {
+        pthread_mutex_unlock(&cmd_sem.mutex);
         ALOGE("%s: No memory for camera_cmd_t", __func__);
         return NO_MEMORY;
     }
-    memset(node, 0, sizeof(camera_cmd_t));
-    node->cmd = cmd;
 
     if (priority) {
-        if (!cmd_queue.enqueueWithPriority((void *)node)) {
-            free(node);
-            node = NULL;
-        }
+        m_cmdFront = (m_cmdFront - 1) & (m_cmdCapacity - 1);
+        m_cmds[m_cmdFront] = cmd;
     } else {
-        if (!cmd_queue.enqueue((void *)node)) {
-            free(node);
-            node = NULL;
-        }
+        m_cmds[(m_cmdFront + m_cmdCount) & (m_cmdCapacity - 1)] = cmd;
     }
-    cam_sem_post(&cmd_sem);
+    m_cmdCount++;
+
+    cmd_sem.val++;
+    pthread_cond_signal(&cmd_sem.cond);
+    pthread_mutex_unlock(&cmd_sem.mutex);
 
     /* if is a sync call, need to wait until it returns */
     if (sync_cmd) {
@@ -169,13 +207,17 @@ int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8
 camera_cmd_type_t QCameraCmdThread::getCmd()
 {
     camera_cmd_type_t cmd = CAMERA_CMD_TYPE_NONE;
-    camera_cmd_t *node = (camera_cmd_t *)cmd_queue.dequeue();
-    if (NULL == node) {
+
+    pthread_mutex_lock(&cmd_sem.mutex);
+    if (m_cmdCount > 0) {
+        cmd = m_cmds[m_cmdFront];
+        m_cmdFront = (m_cmdFront + 1) & (m_cmdCapacity - 1);
+        m_cmdCount--;
+    }
+    pthread_mutex_unlock(&cmd_sem.mutex);
+
+    if (CAMERA_CMD_TYPE_NONE == cmd) {
         ALOGD("%s: No notify avail", __func__);
-        return CAMERA_CMD_TYPE_NONE;
-    } else {
-        cmd = node->cmd;
-        free(node);
     }
     return cmd;
 }
@@ -63,10 +63,21 @@ public:
     int32_t sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority);
     camera_cmd_type_t getCmd();
 
-    QCameraQueue cmd_queue;      /* cmd queue */
     pthread_t cmd_pid;           /* cmd thread ID */
     cam_semaphore_t cmd_sem;               /* semaphore for cmd thread */
     cam_semaphore_t sync_sem;              /* semaphore for synchronized call signal */
+
+private:
+    static const int INITIAL_CMD_CAPACITY = 16;
+
+    bool reserveCmd();
+
+    /* ring of pending cmds, guarded by the mutex of cmd_sem so that a cmd is
+     * queued and signaled under a single lock, without allocating */
+    camera_cmd_type_t *m_cmds;
+    int m_cmdCapacity;           /* a power of 2 */
+    int m_cmdFront;
+    int m_cmdCount;
 };
 
 }; // namespace qcamera
@@ -45,11 +45,14 @@ namespace qcamera {
 QCameraQueue::QCameraQueue()
 {
     pthread_mutex_init(&m_lock, NULL);
-    cam_list_init(&m_head.list);
+    m_nodes = NULL;
+    m_capacity = 0;
+    m_front = 0;
     m_size = 0;
     m_dataFn = NULL;
     m_userData = NULL;
     m_active = true;
+    reserve();
 }
 
 /*===========================================================================
@@ -66,11 +69,14 @@ QCameraQueue::QCameraQueue()
 QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 {
     pthread_mutex_init(&m_lock, NULL);
-    cam_list_init(&m_head.list);
+    m_nodes = NULL;
+    m_capacity = 0;
+    m_front = 0;
     m_size = 0;
     m_dataFn = data_rel_fn;
     m_userData = user_data;
     m_active = true;
+    reserve();
 }
 
 /*===========================================================================
@@ -85,6 +91,7 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 QCameraQueue::~QCameraQueue()
 {
     flush();
+    free(m_nodes);
     pthread_mutex_destroy(&m_lock);
 }
 
@@ -124,6 +131,88 @@ bool QCameraQueue::isEmpty()
     return flag;
 }
 
+/*===========================================================================
+ * FUNCTION   : reserve
+ *
+ * DESCRIPTION: make room for one more node, doubling the ring if it is full.
+ *              Called with m_lock held, except from the constructors.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true -- success; false -- no memory
+ *==========================================================================*/
+bool QCameraQueue::reserve()
+{
+    if (m_size < m_capacity) {
+        return true;
+    }
+
+    int capacity = (m_capacity > 0) ? m_capacity * 2 : INITIAL_CAPACITY;
+    void **nodes = (void **)malloc(sizeof(void *) * capacity);
+    if (NULL == nodes) {
+        ALOGE("%s: No memory for %d queue nodes", __func__, capacity);
+        return false;
+    }
+
+    for (int i = 0; i < m_size; i++) {
+        nodes[i] = nodeAt(i);
+    }
+    free(m_nodes);
+    m_nodes = nodes;
+    m_capacity = capacity;
+    m_front = 0;
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : removeAt
+ *
+ * DESCRIPTION: remove a node from the ring, moving the nodes on its shorter
+ *              side to close the gap. Called with m_lock held.
+ *
+ * PARAMETERS :
+ *   @index   : position of the node from the head
+ *
+ * RETURN     : data ptr of the removed node
+ *==========================================================================*/
+void* QCameraQueue::removeAt(int index)
+{
+    void *data = nodeAt(index);
+
+    if (index < m_size / 2) {
+        for (int i = index; i > 0; i--) {
+            nodeAt(i) = nodeAt(i - 1);
+        }
+        m_front = (m_front + 1) & (m_capacity - 1);
+    } else {
+        for (int i = index; i < m_size - 1; i++) {
+            nodeAt(i) = nodeAt(i + 1);
+        }
+    }
+    m_size--;
+    return data;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseData
+ *
+ * DESCRIPTION: release the internal resource of flushed data, then the data
+ *
+ * PARAMETERS :
+ *   @data    : data ptr
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::releaseData(void *data)
+{
+    if (NULL != data) {
+        if (m_dataFn) {
+            m_dataFn(data, m_userData);
+        }
+        free(data);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : enqueue
  *
@@ -136,25 +225,13 @@ bool QCameraQueue::isEmpty()
  *==========================================================================*/
 bool QCameraQueue::enqueue(void *data)
 {
-    bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
+    bool rc = false;
 
     pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        cam_list_add_tail_node(&node->list, &m_head.list);
+    if (m_active && reserve()) {
         m_size++;
+        nodeAt(m_size - 1) = data;
         rc = true;
-    } else {
-        free(node);
-        rc = false;
     }
     pthread_mutex_unlock(&m_lock);
     return rc;
@@ -173,31 +250,14 @@ bool QCameraQueue::enqueue(void *data)
  *==========================================================================*/
 bool QCameraQueue::enqueueWithPriority(void *data)
 {
-    bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
+    bool rc = false;
 
     pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        struct cam_list *p_next = m_head.list.next;
-
-        m_head.list.next = &node->list;
-        p_next->prev = &node->list;
-        node->list.next = p_next;
-        node->list.prev = &m_head.list;
-
+    if (m_active && reserve()) {
+        m_front = (m_front - 1) & (m_capacity - 1);
         m_size++;
+        nodeAt(0) = data;
         rc = true;
-    } else {
-        free(node);
-        rc = false;
     }
     pthread_mutex_unlock(&m_lock);
     return rc;
@@ -214,25 +274,14 @@ bool QCameraQueue::enqueueWithPriority(void *data)
  *==========================================================================*/
 void* QCameraQueue::peek()
 {
-    camera_q_node* node = NULL;
     void* data = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
 
     pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-        if (pos != head) {
-            node = member_of(pos, camera_q_node, list);
-        }
+    if (m_active && m_size > 0) {
+        data = nodeAt(0);
     }
     pthread_mutex_unlock(&m_lock);
 
-    if (NULL != node) {
-        data = node->data;
-    }
-
     return data;
 }
 
@@ -249,32 +298,20 @@ void* QCameraQueue::peek()
  *==========================================================================*/
 void* QCameraQueue::dequeue(bool bFromHead)
 {
-    camera_q_node* node = NULL;
     void* data = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
 
     pthread_mutex_lock(&m_lock);
-    if (m_active) {
-        head = &m_head.list;
+    if (m_active && m_size > 0) {
         if (bFromHead) {
-            pos = head->next;
+            data = nodeAt(0);
+            m_front = (m_front + 1) & (m_capacity - 1);
         } else {
-            pos = head->prev;
-        }
-        if (pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            cam_list_del_node(&node->list);
-            m_size--;
+            data = nodeAt(m_size - 1);
         }
+        m_size--;
     }
     pthread_mutex_unlock(&m_lock);
 
-    if (NULL != node) {
-        data = node->data;
-        free(node);
-    }
-
     return data;
 }
 
@@ -290,9 +327,6 @@ void* QCameraQueue::dequeue(bool bFromHead)
  * RETURN     : data ptr. NULL if not any data in the queue.
  *==========================================================================*/
 void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
     void* data = NULL;
 
     if ( NULL == match || NULL == match_data ) {
@@ -301,26 +335,15 @@ void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            if (NULL != node) {
-                if ( match(node->data, m_userData, match_data) ) {
-                    cam_list_del_node(&node->list);
-                    m_size--;
-                    data = node->data;
-                    free(node);
-                    pthread_mutex_unlock(&m_lock);
-                    return data;
-                }
+        for (int i = 0; i < m_size; i++) {
+            if ( match(nodeAt(i), m_userData, match_data) ) {
+                data = removeAt(i);
+                break;
             }
         }
     }
     pthread_mutex_unlock(&m_lock);
-    return NULL;
+    return data;
 }
 
 /*===========================================================================
@@ -334,30 +357,12 @@ void* QCameraQueue::dequeue(match_fn_data match, void *match_data){
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flush(){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
     pthread_mutex_lock(&m_lock);
     if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            cam_list_del_node(&node->list);
-            m_size--;
-
-            if (NULL != node->data) {
-                if (m_dataFn) {
-                    m_dataFn(node->data, m_userData);
-                }
-                free(node->data);
-            }
-            free(node);
-
+        for (int i = 0; i < m_size; i++) {
+            releaseData(nodeAt(i));
         }
+        m_front = 0;
         m_size = 0;
         m_active = false;
     }
@@ -376,35 +381,23 @@ void QCameraQueue::flush(){
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flushNodes(match_fn match){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
     if ( NULL == match ) {
         return;
     }
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            if ( match(node->data, m_userData) ) {
-                cam_list_del_node(&node->list);
-                m_size--;
-
-                if (NULL != node->data) {
-                    if (m_dataFn) {
-                        m_dataFn(node->data, m_userData);
-                    }
-                    free(node->data);
-                }
-                free(node);
+        /* keep the nodes that do not match, in order, in one pass */
+        int kept = 0;
+        for (int i = 0; i < m_size; i++) {
+            void *data = nodeAt(i);
+            if ( match(data, m_userData) ) {
+                releaseData(data);
+            } else {
+                nodeAt(kept++) = data;
             }
         }
+        m_size = kept;
     }
     pthread_mutex_unlock(&m_lock);
 }
@@ -421,35 +414,23 @@ void QCameraQueue::flushNodes(match_fn match){
  * RETURN     : None
  *==========================================================================*/
 void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
-    camera_q_node* node = NULL;
-    struct cam_list *head = NULL;
-    struct cam_list *pos = NULL;
-
     if ( NULL == match ) {
         return;
     }
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
-        head = &m_head.list;
-        pos = head->next;
-
-        while(pos != head) {
-            node = member_of(pos, camera_q_node, list);
-            pos = pos->next;
-            if ( match(node->data, m_userData, match_data) ) {
-                cam_list_del_node(&node->list);
-                m_size--;
-
-                if (NULL != node->data) {
-                    if (m_dataFn) {
-                        m_dataFn(node->data, m_userData);
-                    }
-                    free(node->data);
-                }
-                free(node);
+        /* keep the nodes that do not match, in order, in one pass */
+        int kept = 0;
+        for (int i = 0; i < m_size; i++) {
+            void *data = nodeAt(i);
+            if ( match(data, m_userData, match_data) ) {
+                releaseData(data);
+            } else {
+                nodeAt(kept++) = data;
             }
         }
+        m_size = kept;
     }
     pthread_mutex_unlock(&m_lock);
 }
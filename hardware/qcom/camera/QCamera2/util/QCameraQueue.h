@@ -58,12 +58,18 @@ public:
     bool isEmpty();
     int getCurrentSize() {return m_size;}
 private:
-    typedef struct {
-        struct cam_list list;
-        void* data;
-    } camera_q_node;
+    /* slots allocated up front, enough for the deepest queues in
+     * steady state so that enqueue does not allocate */
+    static const int INITIAL_CAPACITY = 32;
 
-    camera_q_node m_head; // dummy head
+    bool reserve();
+    void* &nodeAt(int index) {return m_nodes[(m_front + index) & (m_capacity - 1)];}
+    void* removeAt(int index);
+    void releaseData(void *data);
+
+    void **m_nodes;   // ring of m_capacity slots, a power of 2
+    int m_capacity;
+    int m_front;      // slot of the head
     int m_size;
     bool m_active;
     pthread_mutex_t m_lock;
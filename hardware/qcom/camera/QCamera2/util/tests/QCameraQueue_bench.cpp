@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "QCameraCmdThread.h"
+#include "QCameraQueue.h"
+
+// Replays the queue traffic of a capture through the HAL: stream callbacks hand frames to
+// their stream's data proc thread, which passes them to the postprocessor's data proc thread,
+// which keeps them on an ongoing queue until a JPEG callback thread takes them off by job id.
+// Every hop is a QCameraQueue plus a QCameraCmdThread command, as in QCameraStream and
+// QCameraPostProcessor. Reports the frames/sec and the latency of a frame through all of it.
+
+// Run it like this:
+//
+// make qcamera_queue_bench -j32 && \
+// out/host/linux-x86/obj/EXECUTABLES/qcamera_queue_bench_intermediates/qcamera_queue_bench
+
+using namespace qcamera;
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-s <streams>] [-n <frames>] [-r <fps>]\n", me);
+    fprintf(stderr, "       -s streams producing frames, each from its own thread, default 3\n");
+    fprintf(stderr, "       -n frames per stream, default 100000\n");
+    fprintf(stderr, "       -r frames per second per stream, 0 for as fast as possible,"
+                    " default 0\n");
+    exit(1);
+}
+
+struct Frame {
+    uint32_t jobId;
+    int64_t startNs;
+};
+
+struct Stage {
+    QCameraQueue queue;
+    QCameraCmdThread thread;
+};
+
+static Stage *s_streams;
+static Stage s_postProc;
+static QCameraQueue s_ongoingJpegQ;
+static Stage s_jpegCallback;
+static std::vector<int64_t> s_latencyNs;
+static volatile int s_framesLeft;
+
+static bool matchJobId(void *data, void *, void *match_data) {
+    return ((Frame *)data)->jobId == *(uint32_t *)match_data;
+}
+
+// The stage's thread, forwarding what it dequeues to the next stage.
+static void *stageRoutine(void *data, Stage *next, bool ongoing) {
+    Stage *stage = (Stage *)data;
+
+    for (;;) {
+        cam_sem_wait(&stage->thread.cmd_sem);
+        camera_cmd_type_t cmd = stage->thread.getCmd();
+        if (CAMERA_CMD_TYPE_EXIT == cmd) {
+            return NULL;
+        }
+        if (CAMERA_CMD_TYPE_DO_NEXT_JOB != cmd) {
+            continue;
+        }
+
+        Frame *frame = (Frame *)stage->queue.dequeue();
+        if (NULL == frame) {
+            continue;
+        }
+        if (ongoing) {
+            // Kept until the encoder is done, as m_ongoingJpegQ does.
+            s_ongoingJpegQ.enqueue(frame);
+            uint32_t *jobId = (uint32_t *)malloc(sizeof(uint32_t));
+            *jobId = frame->jobId;
+            frame = (Frame *)jobId;
+        }
+        next->queue.enqueue(frame);
+        next->thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, 0, 0);
+    }
+}
+
+static void *streamProcRoutine(void *data) {
+    return stageRoutine(data, &s_postProc, false);
+}
+
+static void *postProcRoutine(void *data) {
+    return stageRoutine(data, &s_jpegCallback, true);
+}
+
+static void *jpegCallbackRoutine(void *) {
+    Stage *stage = &s_jpegCallback;
+
+    for (;;) {
+        cam_sem_wait(&stage->thread.cmd_sem);
+        camera_cmd_type_t cmd = stage->thread.getCmd();
+        if (CAMERA_CMD_TYPE_EXIT == cmd) {
+            return NULL;
+        }
+
+        uint32_t *jobId = (uint32_t *)stage->queue.dequeue();
+        if (NULL == jobId) {
+            continue;
+        }
+        Frame *frame = (Frame *)s_ongoingJpegQ.dequeue(matchJobId, jobId);
+        if (NULL == frame) {
+            fprintf(stderr, "job %u not found on the ongoing queue\n", *jobId);
+            exit(EXIT_FAILURE);
+        }
+        free(jobId);
+        s_latencyNs.push_back(nowNs() - frame->startNs);
+        free(frame);
+        __sync_fetch_and_sub(&s_framesLeft, 1);
+    }
+}
+
+struct Producer {
+    int index;
+    int frames;
+    int64_t periodNs;
+};
+
+static void *producerRoutine(void *data) {
+    Producer *producer = (Producer *)data;
+    Stage *stream = &s_streams[producer->index];
+    int64_t nextNs = nowNs();
+
+    for (int i = 0; i < producer->frames; i++) {
+        if (producer->periodNs > 0) {
+            int64_t waitNs = nextNs - nowNs();
+            if (waitNs > 0) {
+                struct timespec ts = { (time_t)(waitNs / 1000000000LL),
+                        (long)(waitNs % 1000000000LL) };
+                nanosleep(&ts, NULL);
+            }
+            nextNs += producer->periodNs;
+        }
+
+        // Malloc'd by the callback, as mm-camera-interface super buffers are.
+        Frame *frame = (Frame *)malloc(sizeof(Frame));
+        frame->jobId = (uint32_t)(producer->index << 24 | i);
+        frame->startNs = nowNs();
+        stream->queue.enqueue(frame);
+        stream->thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, 0, 0);
+    }
+    return NULL;
+}
+
+static int64_t percentile(std::vector<int64_t> &samples, int p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, samples.size() * p / 100);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    int streams = 3;
+    int frames = 100000;
+    int fps = 0;
+
+    int res;
+    while ((res = getopt(argc, argv, "s:n:r:")) >= 0) {
+        switch (res) {
+            case 's': streams = atoi(optarg); break;
+            case 'n': frames = atoi(optarg); break;
+            case 'r': fps = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (streams < 1 || streams > 255 || frames < 1 || fps < 0) {
+        usage(me);
+    }
+
+    s_streams = new Stage[streams];
+    s_framesLeft = streams * frames;
+    s_latencyNs.reserve(s_framesLeft);
+
+    for (int i = 0; i < streams; i++) {
+        s_streams[i].thread.launch(streamProcRoutine, &s_streams[i]);
+    }
+    s_postProc.thread.launch(postProcRoutine, &s_postProc);
+    s_jpegCallback.thread.launch(jpegCallbackRoutine, NULL);
+
+    std::vector<Producer> producers(streams);
+    std::vector<pthread_t> tids(streams);
+    int64_t startNs = nowNs();
+    for (int i = 0; i < streams; i++) {
+        producers[i].index = i;
+        producers[i].frames = frames;
+        producers[i].periodNs = fps > 0 ? 1000000000LL / fps : 0;
+        pthread_create(&tids[i], NULL, producerRoutine, &producers[i]);
+    }
+    for (int i = 0; i < streams; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    while (s_framesLeft > 0) {
+        usleep(1000);
+    }
+    double elapsedS = (nowNs() - startNs) / 1E9;
+
+    for (int i = 0; i < streams; i++) {
+        s_streams[i].thread.exit();
+    }
+    s_postProc.thread.exit();
+    s_jpegCallback.thread.exit();
+
+    printf("%d streams, %d frames each, %s\n", streams, frames,
+            fps > 0 ? "paced" : "as fast as possible");
+    printf("  %.2f s, %.0f frames/s\n", elapsedS, streams * frames / elapsedS);
+    printf("  latency through the pipeline: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+            percentile(s_latencyNs, 50) / 1E3, percentile(s_latencyNs, 99) / 1E3,
+            percentile(s_latencyNs, 100) / 1E3);
+
+    delete[] s_streams;
+    return EXIT_SUCCESS;
+}
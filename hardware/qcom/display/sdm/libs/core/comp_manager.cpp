@@ -22,6 +22,7 @@
 * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <string.h>
 #include <utils/constants.h>
 #include <utils/debug.h>
 #include <core/buffer_allocator.h>
@@ -33,6 +34,27 @@
 
 namespace sdm {
 
+// The part of a layer's signature that does not depend on its regions takes less than this.
+static const uint32_t kMaxLayerWords = 32;
+
+static uint32_t AppendRect(const LayerRect &rect, uint32_t *words, uint32_t count) {
+  memcpy(&words[count], &rect.left, sizeof(float));
+  memcpy(&words[count + 1], &rect.top, sizeof(float));
+  memcpy(&words[count + 2], &rect.right, sizeof(float));
+  memcpy(&words[count + 3], &rect.bottom, sizeof(float));
+
+  return count + 4;
+}
+
+static uint32_t AppendRects(const LayerRectArray &rects, uint32_t *words, uint32_t count) {
+  words[count++] = rects.count;
+  for (uint32_t i = 0; i < rects.count; i++) {
+    count = AppendRect(rects.rect[i], words, count);
+  }
+
+  return count;
+}
+
 DisplayError CompManager::Init(const HWResourceInfo &hw_res_info,
                                ExtensionInterface *extension_intf,
                                BufferSyncHandler *buffer_sync_handler) {
@@ -157,6 +179,7 @@ DisplayError CompManager::ReconfigureDisplay(Handle comp_handle,
 
   resource_intf_->ReconfigureDisplay(display_comp_ctx->display_resource_ctx, attributes,
                                      hw_panel_info);
+  ClearStrategyCache(display_comp_ctx);
 
   DisplayError error = kErrorNone;
   if (display_comp_ctx->strategy) {
@@ -215,13 +238,245 @@ void CompManager::PrepareStrategyConstraints(Handle comp_handle, HWLayers *hw_la
   }
 }
 
+void CompManager::StartStrategy(DisplayCompositionContext *display_comp_ctx,
+                                HWLayers *hw_layers) {
+  display_comp_ctx->strategy->Start(&hw_layers->info, &display_comp_ctx->max_strategies,
+                                    display_comp_ctx->partial_update_enable);
+  display_comp_ctx->remaining_strategies = display_comp_ctx->max_strategies;
+  display_comp_ctx->strategy_started = true;
+}
+
+void CompManager::GenerateSignature(DisplayCompositionContext *display_comp_ctx,
+                                    HWLayers *hw_layers) {
+  StackSignature &signature = display_comp_ctx->prepared.signature;
+  const StrategyConstraints &constraints = display_comp_ctx->constraints;
+  LayerStack *layer_stack = hw_layers->info.stack;
+  uint32_t *words = signature.words;
+  uint32_t count = 0;
+
+  signature.count = 0;
+  if (layer_stack->layer_count > kMaxCachedLayers) {
+    return;
+  }
+
+  // Both are set by the client whenever it likes, the layers themselves tell what changed.
+  LayerStackFlags stack_flags = layer_stack->flags;
+  stack_flags.geometry_changed = 0;
+  stack_flags.attributes_changed = 0;
+
+  // Dirty regions only matter when the ROI is generated from them.
+  bool dirty_regions = display_comp_ctx->partial_update_enable &&
+                       display_comp_ctx->strategy->IsPartialUpdateSupported();
+
+  words[count++] = layer_stack->layer_count;
+  words[count++] = stack_flags.flags;
+  words[count++] = constraints.safe_mode;
+  words[count++] = constraints.use_cursor;
+  words[count++] = constraints.max_layers;
+  words[count++] = dirty_regions;
+
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    Layer &layer = layer_stack->layers[i];
+    LayerBuffer *input_buffer = layer.input_buffer;
+    uint32_t rect_count = layer.visible_regions.count;
+    if (dirty_regions) {
+      rect_count += layer.dirty_regions.count;
+    }
+
+    if (count + kMaxLayerWords + (rect_count * 4) > kMaxSignatureWords) {
+      return;
+    }
+
+    // Only the targets are an input, the client hands back whatever was chosen for the others.
+    LayerComposition composition = layer.composition;
+    if (composition != kCompositionGPUTarget && composition != kCompositionBlitTarget) {
+      composition = kCompositionGPU;
+    }
+
+    display_comp_ctx->input_composition[i] = layer.composition;
+    words[count++] = composition;
+    words[count++] = input_buffer ? input_buffer->format : kFormatInvalid;
+    words[count++] = input_buffer ? input_buffer->width : 0;
+    words[count++] = input_buffer ? input_buffer->height : 0;
+    words[count++] = input_buffer ? input_buffer->flags.flags : 0;
+    count = AppendRect(layer.src_rect, words, count);
+    count = AppendRect(layer.dst_rect, words, count);
+    words[count++] = layer.blending;
+    memcpy(&words[count++], &layer.transform.rotation, sizeof(float));
+    words[count++] = (UINT32(layer.transform.flip_horizontal) << 1) |
+                     UINT32(layer.transform.flip_vertical);
+    words[count++] = layer.plane_alpha;
+    words[count++] = layer.csc;
+    words[count++] = layer.igc;
+    words[count++] = layer.flags.flags;
+    count = AppendRects(layer.visible_regions, words, count);
+    if (dirty_regions) {
+      count = AppendRects(layer.dirty_regions, words, count);
+    }
+  }
+
+  // FNV-1a, to tell most signatures apart without comparing them.
+  uint32_t hash = 2166136261U;
+  for (uint32_t i = 0; i < count; i++) {
+    hash = (hash ^ words[i]) * 16777619U;
+  }
+
+  signature.hash = hash;
+  signature.count = count;
+}
+
+CompManager::CachedStrategy *CompManager::FindCachedStrategy(
+                             DisplayCompositionContext *display_comp_ctx) {
+  const StackSignature &signature = display_comp_ctx->prepared.signature;
+
+  for (uint32_t i = 0; i < kMaxCachedStrategies; i++) {
+    CachedStrategy *cached = &display_comp_ctx->cache[i];
+    const StackSignature &cached_signature = cached->signature;
+    if (cached->valid && cached_signature.hash == signature.hash &&
+        cached_signature.count == signature.count &&
+        !memcmp(cached_signature.words, signature.words, signature.count * sizeof(uint32_t))) {
+      return cached;
+    }
+  }
+
+  return NULL;
+}
+
+DisplayError CompManager::ReplayStrategy(Handle display_ctx, CachedStrategy *cached,
+                                         HWLayers *hw_layers) {
+  DisplayCompositionContext *display_comp_ctx =
+                             reinterpret_cast<DisplayCompositionContext *>(display_ctx);
+  Handle &display_resource_ctx = display_comp_ctx->display_resource_ctx;
+  LayerStack *layer_stack = hw_layers->info.stack;
+
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    layer_stack->layers[i].composition = cached->composition[i];
+  }
+
+  // Only what the strategy decided on is replayed, the rest of the info belongs to this frame.
+  HWLayersInfo &info = hw_layers->info;
+  info.count = cached->count;
+  for (uint32_t i = 0; i < cached->count; i++) {
+    info.index[i] = cached->index[i];
+  }
+  info.left_partial_update = cached->left_partial_update;
+  info.right_partial_update = cached->right_partial_update;
+
+  // The resource manager resets its pipe state on every Acquire, so go through it as usual.
+  resource_intf_->Start(display_resource_ctx);
+  DisplayError error = resource_intf_->Acquire(display_resource_ctx, hw_layers);
+  resource_intf_->Stop(display_resource_ctx);
+
+  return error;
+}
+
+void CompManager::SaveStrategy(DisplayCompositionContext *display_comp_ctx,
+                               HWLayers *hw_layers) {
+  CachedStrategy &prepared = display_comp_ctx->prepared;
+  LayerStack *layer_stack = hw_layers->info.stack;
+
+  prepared.valid = false;
+  if (!prepared.signature.count) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+    LayerComposition composition = layer_stack->layers[i].composition;
+    // Blit composition updates the layer regions as well, which are not saved.
+    if (composition == kCompositionHybrid || composition == kCompositionBlit) {
+      return;
+    }
+    prepared.composition[i] = composition;
+  }
+
+  const HWLayersInfo &info = hw_layers->info;
+  prepared.count = info.count;
+  for (uint32_t i = 0; i < info.count; i++) {
+    prepared.index[i] = info.index[i];
+  }
+  prepared.left_partial_update = info.left_partial_update;
+  prepared.right_partial_update = info.right_partial_update;
+  prepared.valid = true;
+}
+
+void CompManager::CacheStrategy(DisplayCompositionContext *display_comp_ctx,
+                                HWLayers *hw_layers) {
+  CachedStrategy *cached = display_comp_ctx->replayed_strategy;
+  CachedStrategy &prepared = display_comp_ctx->prepared;
+
+  display_comp_ctx->replayed_strategy = NULL;
+
+  // Resources were acquired again by ReConfigure() for what was committed.
+  if (hw_layers->info.stack->flags.attributes_changed) {
+    prepared.valid = false;
+    return;
+  }
+
+  if (!cached && prepared.valid) {
+    // Take a free entry, else the least recently used one.
+    cached = &display_comp_ctx->cache[0];
+    for (uint32_t i = 0; i < kMaxCachedStrategies; i++) {
+      CachedStrategy *entry = &display_comp_ctx->cache[i];
+      if (!entry->valid) {
+        cached = entry;
+        break;
+      }
+
+      if (entry->last_used < cached->last_used) {
+        cached = entry;
+      }
+    }
+
+    *cached = prepared;
+    prepared.valid = false;
+  }
+
+  if (cached) {
+    cached->last_used = ++display_comp_ctx->use_count;
+  }
+}
+
+void CompManager::DropCachedStrategy(CachedStrategy *cached) {
+  cached->valid = false;
+
+  strategy_cache_drops_++;
+}
+
+void CompManager::ClearStrategyCache(DisplayCompositionContext *display_comp_ctx) {
+  for (uint32_t i = 0; i < kMaxCachedStrategies; i++) {
+    display_comp_ctx->cache[i].valid = false;
+  }
+
+  display_comp_ctx->prepared.valid = false;
+  display_comp_ctx->cached_strategy = NULL;
+  display_comp_ctx->replayed_strategy = NULL;
+}
+
 void CompManager::PrePrepare(Handle display_ctx, HWLayers *hw_layers) {
   SCOPE_LOCK(locker_);
   DisplayCompositionContext *display_comp_ctx =
                              reinterpret_cast<DisplayCompositionContext *>(display_ctx);
-  display_comp_ctx->strategy->Start(&hw_layers->info, &display_comp_ctx->max_strategies,
-                                    display_comp_ctx->partial_update_enable);
+
+  display_comp_ctx->cached_strategy = NULL;
+  display_comp_ctx->replayed_strategy = NULL;
+  display_comp_ctx->prepared.valid = false;
+
+  // A frame that only differs from one committed before in its buffers gets the same composition,
+  // so skip the strategies and let Prepare() replay it.
   display_comp_ctx->remaining_strategies = display_comp_ctx->max_strategies;
+  PrepareStrategyConstraints(display_ctx, hw_layers);
+  GenerateSignature(display_comp_ctx, hw_layers);
+  if (display_comp_ctx->prepared.signature.count) {
+    display_comp_ctx->cached_strategy = FindCachedStrategy(display_comp_ctx);
+    if (display_comp_ctx->cached_strategy) {
+      strategy_cache_hits_++;
+      return;
+    }
+
+    strategy_cache_misses_++;
+  }
+
+  StartStrategy(display_comp_ctx, hw_layers);
 }
 
 DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
@@ -233,6 +488,31 @@ DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
 
   DisplayError error = kErrorUndefined;
 
+  CachedStrategy *&replayed_strategy = display_comp_ctx->replayed_strategy;
+  if (display_comp_ctx->cached_strategy) {
+    replayed_strategy = display_comp_ctx->cached_strategy;
+    display_comp_ctx->cached_strategy = NULL;
+    if (ReplayStrategy(display_ctx, replayed_strategy, hw_layers) == kErrorNone) {
+      return kErrorNone;
+    }
+  }
+
+  if (replayed_strategy) {
+    // Either the resources or the display did not take the cached strategy any more, so go
+    // through the strategies for this frame after all.
+    DropCachedStrategy(replayed_strategy);
+    replayed_strategy = NULL;
+
+    LayerStack *layer_stack = hw_layers->info.stack;
+    for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+      layer_stack->layers[i].composition = display_comp_ctx->input_composition[i];
+    }
+    hw_layers->info = HWLayersInfo();
+    hw_layers->info.stack = layer_stack;
+
+    StartStrategy(display_comp_ctx, hw_layers);
+  }
+
   PrepareStrategyConstraints(display_ctx, hw_layers);
 
   // Select a composition strategy, and try to allocate resources for it.
@@ -257,6 +537,8 @@ DisplayError CompManager::Prepare(Handle display_ctx, HWLayers *hw_layers) {
 
   if (error != kErrorNone) {
     DLOGE("Composition strategies exhausted for display = %d", display_comp_ctx->display_type);
+  } else {
+    SaveStrategy(display_comp_ctx, hw_layers);
   }
 
   resource_intf_->Stop(display_resource_ctx);
@@ -276,7 +558,10 @@ DisplayError CompManager::PostPrepare(Handle display_ctx, HWLayers *hw_layers) {
     return error;
   }
 
-  display_comp_ctx->strategy->Stop();
+  if (display_comp_ctx->strategy_started) {
+    display_comp_ctx->strategy->Stop();
+    display_comp_ctx->strategy_started = false;
+  }
 
   return kErrorNone;
 }
@@ -321,6 +606,7 @@ DisplayError CompManager::PostCommit(Handle display_ctx, HWLayers *hw_layers) {
   }
 
   display_comp_ctx->idle_fallback = false;
+  CacheStrategy(display_comp_ctx, hw_layers);
 
   DLOGV_IF(kTagCompManager, "registered display bit mask 0x%x, configured display bit mask 0x%x, " \
            "display type %d", registered_displays_, configured_displays_,
@@ -374,6 +660,7 @@ DisplayError CompManager::SetMaxMixerStages(Handle display_ctx, uint32_t max_mix
   if (display_comp_ctx) {
     error = resource_intf_->SetMaxMixerStages(display_comp_ctx->display_resource_ctx,
                                               max_mixer_stages);
+    ClearStrategyCache(display_comp_ctx);
   }
 
   return error;
@@ -389,6 +676,13 @@ void CompManager::ControlPartialUpdate(Handle display_ctx, bool enable) {
 
 void CompManager::AppendDump(char *buffer, uint32_t length) {
   SCOPE_LOCK(locker_);
+
+  uint32_t lookups = strategy_cache_hits_ + strategy_cache_misses_;
+  DumpImpl::AppendString(buffer, length, "\n-----------------------");
+  DumpImpl::AppendString(buffer, length, "\nstrategy cache hits: %u, misses: %u, hit rate: %u%%",
+                         strategy_cache_hits_, strategy_cache_misses_,
+                         lookups ? UINT32(UINT64(strategy_cache_hits_) * 100 / lookups) : 0);
+  DumpImpl::AppendString(buffer, length, "\nstrategy cache drops: %u", strategy_cache_drops_);
 }
 
 DisplayError CompManager::ValidateScaling(const LayerRect &crop, const LayerRect &dst,
@@ -66,8 +66,30 @@ class CompManager : public DumpImpl {
 
  private:
   static const int kMaxThermalLevel = 3;
+  static const uint32_t kMaxCachedStrategies = 4;
+  static const uint32_t kMaxCachedLayers = 32;
+  static const uint32_t kMaxSignatureWords = 1024;
 
-  void PrepareStrategyConstraints(Handle display_ctx, HWLayers *hw_layers);
+  // Everything in a layer stack that the strategy and the resource manager decide on, that is all
+  // but the buffer handles and fences, flattened so that two frames compare with a memcmp.
+  struct StackSignature {
+    uint32_t hash = 0;
+    uint32_t count = 0;  // Words used, 0 if the layer stack can not be cached.
+    uint32_t words[kMaxSignatureWords];
+  };
+
+  // Composition chosen by the strategy for a layer stack, replayed on the frames that match it.
+  // Resources are acquired again for every frame, as for one that goes through the strategies.
+  struct CachedStrategy {
+    StackSignature signature;
+    LayerComposition composition[kMaxCachedLayers];
+    uint32_t index[kMaxSDELayers];
+    uint32_t count = 0;
+    LayerRect left_partial_update;
+    LayerRect right_partial_update;
+    uint32_t last_used = 0;
+    bool valid = false;
+  };
 
   struct DisplayCompositionContext {
     Strategy *strategy = NULL;
@@ -79,8 +101,25 @@ class CompManager : public DumpImpl {
     bool idle_fallback = false;
     bool fallback_ = false;
     uint32_t partial_update_enable = true;
+    bool strategy_started = false;
+    LayerComposition input_composition[kMaxCachedLayers];
+    CachedStrategy prepared;                           // Current frame, cached on commit.
+    CachedStrategy cache[kMaxCachedStrategies];
+    CachedStrategy *cached_strategy = NULL;            // Match found for the current frame.
+    CachedStrategy *replayed_strategy = NULL;          // Match handed out for the current frame.
+    uint32_t use_count = 0;
   };
 
+  void PrepareStrategyConstraints(Handle display_ctx, HWLayers *hw_layers);
+  void StartStrategy(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  void GenerateSignature(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  CachedStrategy *FindCachedStrategy(DisplayCompositionContext *display_comp_ctx);
+  DisplayError ReplayStrategy(Handle display_ctx, CachedStrategy *cached, HWLayers *hw_layers);
+  void SaveStrategy(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  void CacheStrategy(DisplayCompositionContext *display_comp_ctx, HWLayers *hw_layers);
+  void DropCachedStrategy(CachedStrategy *cached);
+  void ClearStrategyCache(DisplayCompositionContext *display_comp_ctx);
+
   Locker locker_;
   ResourceInterface *resource_intf_ = NULL;
   ResourceDefault resource_default_;
@@ -91,6 +130,9 @@ class CompManager : public DumpImpl {
                                         // that uses optimal number of pipes for each display
   HWResourceInfo hw_res_info_;
   ExtensionInterface *extension_intf_ = NULL;
+  uint32_t strategy_cache_hits_ = 0;     // Frames composed with a cached strategy
+  uint32_t strategy_cache_misses_ = 0;   // Frames that could be cached but were not
+  uint32_t strategy_cache_drops_ = 0;    // Cached strategies that failed when replayed
 };
 
 }  // namespace sdm
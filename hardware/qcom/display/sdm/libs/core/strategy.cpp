@@ -114,6 +114,10 @@ DisplayError Strategy::Stop() {
   return kErrorNone;
 }
 
+bool Strategy::IsPartialUpdateSupported() {
+  return (partial_update_intf_ != NULL);
+}
+
 DisplayError Strategy::GetNextStrategy(StrategyConstraints *constraints) {
   DisplayError error = kErrorNone;
 
@@ -42,6 +42,7 @@ class Strategy {
                      bool partial_update_enable);
   DisplayError GetNextStrategy(StrategyConstraints *constraints);
   DisplayError Stop();
+  bool IsPartialUpdateSupported();
 
  private:
   void GenerateROI();
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "comp_manager.h"
+
+// Drives CompManager the way DisplayBase does, with a strategy and a resource manager that count
+// what is asked of them, through recorded layer stacks where only the buffers change between
+// frames.
+
+namespace sdm {
+
+static const int kNumAppLayers = 3;
+
+class StubStrategy : public StrategyInterface {
+ public:
+  virtual DisplayError Start(HWLayersInfo *hw_layers_info, uint32_t *max_attempts) {
+    hw_layers_info_ = hw_layers_info;
+    attempt_ = 0;
+    *max_attempts = 2;
+    starts++;
+    return kErrorNone;
+  }
+
+  // Everything on SDE first, then everything on GPU.
+  virtual DisplayError GetNextStrategy(StrategyConstraints *constraints) {
+    LayerStack *layer_stack = hw_layers_info_->stack;
+    uint32_t &count = hw_layers_info_->count;
+    bool sde = (attempt_++ == 0) && !constraints->safe_mode;
+
+    count = 0;
+    for (uint32_t i = 0; i < layer_stack->layer_count; i++) {
+      LayerComposition &composition = layer_stack->layers[i].composition;
+      if (composition == kCompositionGPUTarget) {
+        if (!sde) {
+          hw_layers_info_->index[count++] = i;
+        }
+      } else {
+        composition = sde ? kCompositionSDE : kCompositionGPU;
+        if (sde) {
+          hw_layers_info_->index[count++] = i;
+        }
+      }
+    }
+    attempts++;
+
+    return (attempt_ <= 2) ? kErrorNone : kErrorUndefined;
+  }
+
+  virtual DisplayError Stop() {
+    stops++;
+    return kErrorNone;
+  }
+
+  uint32_t starts = 0;
+  uint32_t attempts = 0;
+  uint32_t stops = 0;
+
+ private:
+  HWLayersInfo *hw_layers_info_ = NULL;
+  uint32_t attempt_ = 0;
+};
+
+class StubResource : public ResourceInterface {
+ public:
+  virtual DisplayError RegisterDisplay(DisplayType type, const HWDisplayAttributes &attributes,
+                                       const HWPanelInfo &hw_panel_info, Handle *display_ctx) {
+    *display_ctx = this;
+    return kErrorNone;
+  }
+  virtual DisplayError UnregisterDisplay(Handle display_ctx) { return kErrorNone; }
+  virtual void ReconfigureDisplay(Handle display_ctx, const HWDisplayAttributes &attributes,
+                                  const HWPanelInfo &hw_panel_info) { }
+  virtual DisplayError Start(Handle display_ctx) { return kErrorNone; }
+  virtual DisplayError Stop(Handle display_ctx) { return kErrorNone; }
+
+  // A new pipe for each layer, every time, so that stale pipes show.
+  virtual DisplayError Acquire(Handle display_ctx, HWLayers *hw_layers) {
+    acquires++;
+    if (hw_layers->info.count > max_layers) {
+      return kErrorResources;
+    }
+
+    for (uint32_t i = 0; i < hw_layers->info.count; i++) {
+      HWPipeInfo &left_pipe = hw_layers->config[i].left_pipe;
+      left_pipe.Reset();
+      left_pipe.pipe_id = next_pipe_id++;
+      left_pipe.dst_roi = hw_layers->info.stack->layers[hw_layers->info.index[i]].dst_rect;
+      left_pipe.valid = true;
+    }
+    hw_layers->bandwidth = hw_layers->info.count;
+
+    return kErrorNone;
+  }
+
+  virtual DisplayError PostPrepare(Handle display_ctx, HWLayers *hw_layers) { return kErrorNone; }
+  virtual DisplayError PostCommit(Handle display_ctx, HWLayers *hw_layers) { return kErrorNone; }
+  virtual void Purge(Handle display_ctx) { }
+  virtual DisplayError SetMaxMixerStages(Handle display_ctx, uint32_t max_mixer_stages) {
+    return kErrorNone;
+  }
+  virtual DisplayError ValidateScaling(const LayerRect &crop, const LayerRect &dst,
+                                       bool rotate90, bool ubwc_tiled,
+                                       bool use_rotator_downscale) {
+    return kErrorNone;
+  }
+  virtual DisplayError ValidateCursorConfig(Handle display_ctx, const Layer &layer,
+                                            bool is_top) {
+    return kErrorNotSupported;
+  }
+  virtual DisplayError ValidateCursorPosition(Handle display_ctx, HWLayers *hw_layers,
+                                              int x, int y) {
+    return kErrorNotSupported;
+  }
+
+  uint32_t acquires = 0;
+  uint32_t max_layers = kMaxSDELayers;
+  uint32_t next_pipe_id = 1;
+};
+
+class StubExtension : public ExtensionInterface {
+ public:
+  virtual DisplayError CreatePartialUpdate(DisplayType type, const HWResourceInfo &hw_resource_info,
+                                           const HWPanelInfo &hw_panel_info,
+                                           PartialUpdateInterface **interface) {
+    return kErrorNotSupported;
+  }
+  virtual DisplayError DestroyPartialUpdate(PartialUpdateInterface *interface) {
+    return kErrorNone;
+  }
+  virtual DisplayError CreateStrategyExtn(DisplayType type, HWDisplayMode mode,
+                                          StrategyInterface **interface) {
+    *interface = &strategy;
+    return kErrorNone;
+  }
+  virtual DisplayError DestroyStrategyExtn(StrategyInterface *interface) { return kErrorNone; }
+  virtual DisplayError CreateResourceExtn(const HWResourceInfo &hw_resource_info,
+                                          ResourceInterface **interface,
+                                          BufferSyncHandler *buffer_sync_handler) {
+    *interface = &resource;
+    return kErrorNone;
+  }
+  virtual DisplayError DestroyResourceExtn(ResourceInterface *interface) { return kErrorNone; }
+  virtual DisplayError CreateRotator(BufferAllocator *buffer_allocator,
+                                     BufferSyncHandler *buffer_sync_handler,
+                                     RotatorInterface **intf) {
+    return kErrorNotSupported;
+  }
+  virtual DisplayError DestroyRotator(RotatorInterface *intf) { return kErrorNone; }
+
+  StubStrategy strategy;
+  StubResource resource;
+};
+
+// A recorded frame: app layers over a full screen GPU target.
+struct Frame {
+  Frame(float offset) {
+    for (int i = 0; i <= kNumAppLayers; i++) {
+      Layer &layer = layers[i];
+      buffers[i].width = 1080;
+      buffers[i].height = 1920;
+      layer.input_buffer = &buffers[i];
+      layer.src_rect = LayerRect(0.0f, 0.0f, 1080.0f, 1920.0f);
+      layer.dst_rect = (i == kNumAppLayers) ? layer.src_rect :
+                       LayerRect(offset, 100.0f * i, offset + 500.0f, 100.0f * i + 400.0f);
+      layer.composition = (i == kNumAppLayers) ? kCompositionGPUTarget : kCompositionGPU;
+      layer.plane_alpha = 0xff;
+    }
+    layer_stack.layers = layers;
+    layer_stack.layer_count = kNumAppLayers + 1;
+  }
+
+  // New buffers and sync handle, as every frame brings.
+  void NextBuffers(int frame) {
+    for (int i = 0; i <= kNumAppLayers; i++) {
+      buffers[i].planes[0].fd = frame * 10 + i;
+    }
+    sync_handle = frame;
+  }
+
+  int sync_handle = -1;
+  LayerBuffer buffers[kNumAppLayers + 1];
+  Layer layers[kNumAppLayers + 1];
+  LayerStack layer_stack;
+};
+
+class CompManagerTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    HWResourceInfo hw_res_info;
+    HWDisplayAttributes attributes;
+    HWPanelInfo panel_info;
+
+    ASSERT_EQ(kErrorNone, comp_manager_.Init(hw_res_info, &extension_, NULL));
+    ASSERT_EQ(kErrorNone, comp_manager_.RegisterDisplay(kPrimary, attributes, panel_info,
+                                                        &display_ctx_));
+  }
+
+  virtual void TearDown() {
+    comp_manager_.UnregisterDisplay(display_ctx_);
+    comp_manager_.Deinit();
+  }
+
+  // Same calls as DisplayBase::Prepare() and DisplayBase::Commit(), where validate stands in for
+  // HWInterface::Validate().
+  DisplayError Compose(Frame *frame, DisplayError validate = kErrorNone) {
+    DisplayError error = kErrorNone;
+
+    hw_layers_.info = HWLayersInfo();
+    hw_layers_.info.stack = &frame->layer_stack;
+    hw_layers_.info.sync_handle = frame->sync_handle;
+    hw_layers_.output_compression = 1.0f;
+
+    comp_manager_.PrePrepare(display_ctx_, &hw_layers_);
+    while (true) {
+      error = comp_manager_.Prepare(display_ctx_, &hw_layers_);
+      if (error != kErrorNone) {
+        break;
+      }
+
+      error = validate;
+      validate = kErrorNone;
+      if (error == kErrorNone) {
+        break;
+      }
+    }
+    comp_manager_.PostPrepare(display_ctx_, &hw_layers_);
+    if (error != kErrorNone) {
+      return error;
+    }
+
+    return comp_manager_.PostCommit(display_ctx_, &hw_layers_);
+  }
+
+  std::vector<uint32_t> PipeIds() {
+    std::vector<uint32_t> pipe_ids;
+    for (uint32_t i = 0; i < hw_layers_.info.count; i++) {
+      pipe_ids.push_back(hw_layers_.config[i].left_pipe.pipe_id);
+    }
+    return pipe_ids;
+  }
+
+  void ExpectComposition(Frame *frame, LayerComposition app_composition) {
+    for (int i = 0; i < kNumAppLayers; i++) {
+      EXPECT_EQ(app_composition, frame->layers[i].composition);
+    }
+    EXPECT_EQ(kCompositionGPUTarget, frame->layers[kNumAppLayers].composition);
+  }
+
+  void ExpectDump(const char *text) {
+    char buffer[1024] = { 0 };
+    comp_manager_.AppendDump(buffer, sizeof(buffer));
+    EXPECT_TRUE(strstr(buffer, text) != NULL) << buffer;
+  }
+
+  StubExtension extension_;
+  CompManager comp_manager_;
+  Handle display_ctx_ = NULL;
+  HWLayers hw_layers_;
+};
+
+TEST_F(CompManagerTest, UnchangedFramesSkipStrategy) {
+  Frame frame(0.0f);
+
+  frame.NextBuffers(0);
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  EXPECT_EQ(UINT32(kNumAppLayers), PipeIds().size());
+
+  for (int i = 1; i < 10; i++) {
+    // The client hands back the compositions of the last frame.
+    frame.NextBuffers(i);
+    ASSERT_EQ(kErrorNone, Compose(&frame));
+    ExpectComposition(&frame, kCompositionSDE);
+    EXPECT_EQ(UINT32(kNumAppLayers), PipeIds().size());
+    EXPECT_EQ(UINT32(kNumAppLayers), hw_layers_.bandwidth);
+    EXPECT_EQ(i, hw_layers_.info.sync_handle);
+  }
+
+  // The strategy is skipped, but not the resource manager.
+  EXPECT_EQ(1U, extension_.strategy.starts);
+  EXPECT_EQ(1U, extension_.strategy.stops);
+  EXPECT_EQ(10U, extension_.resource.acquires);
+  ExpectDump("strategy cache hits: 9, misses: 1, hit rate: 90%");
+}
+
+TEST_F(CompManagerTest, ChangedGeometryRunsStrategy) {
+  Frame frame(0.0f);
+  Frame moved(8.0f);
+
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  ASSERT_EQ(kErrorNone, Compose(&moved));
+  ExpectComposition(&moved, kCompositionSDE);
+  EXPECT_EQ(8.0f, hw_layers_.config[0].left_pipe.dst_roi.left);
+
+  EXPECT_EQ(2U, extension_.strategy.starts);
+  EXPECT_EQ(2U, extension_.resource.acquires);
+}
+
+TEST_F(CompManagerTest, AlternatingStacksReacquireOnly) {
+  Frame frames[2] = { Frame(0.0f), Frame(8.0f) };
+
+  // Stacks that come back are replayed, on pipes that are acquired again.
+  for (int i = 0; i < 10; i++) {
+    Frame &frame = frames[i % 2];
+    frame.NextBuffers(i);
+    ASSERT_EQ(kErrorNone, Compose(&frame));
+    ExpectComposition(&frame, kCompositionSDE);
+    EXPECT_EQ(frame.layers[0].dst_rect.left, hw_layers_.config[0].left_pipe.dst_roi.left);
+  }
+
+  EXPECT_EQ(2U, extension_.strategy.starts);
+  EXPECT_EQ(10U, extension_.resource.acquires);
+  ExpectDump("strategy cache hits: 8, misses: 2, hit rate: 80%");
+}
+
+TEST_F(CompManagerTest, RejectedReplayRunsStrategy) {
+  Frame frame(0.0f);
+
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  ASSERT_EQ(kErrorNone, Compose(&frame, kErrorResources));
+  EXPECT_EQ(2U, extension_.strategy.starts);
+  EXPECT_EQ(2U, extension_.strategy.stops);
+  ExpectDump("strategy cache drops: 1");
+
+  // What the strategy chose instead is cached now.
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  EXPECT_EQ(2U, extension_.strategy.starts);
+}
+
+TEST_F(CompManagerTest, FailedReacquireRunsStrategy) {
+  Frame frame(0.0f);
+
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  comp_manager_.Purge(display_ctx_);
+
+  // The pipes are gone with the purge, and now there are not enough for SDE composition.
+  extension_.resource.max_layers = 1;
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  ExpectComposition(&frame, kCompositionGPU);
+  EXPECT_EQ(2U, extension_.strategy.starts);
+  ExpectDump("strategy cache drops: 1");
+}
+
+TEST_F(CompManagerTest, FallbackChangesSignature) {
+  Frame frame(0.0f);
+
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  ExpectComposition(&frame, kCompositionSDE);
+
+  comp_manager_.ProcessThermalEvent(display_ctx_, 3);
+  ASSERT_EQ(kErrorNone, Compose(&frame));
+  ExpectComposition(&frame, kCompositionGPU);
+  EXPECT_EQ(2U, extension_.strategy.starts);
+}
+
+}  // namespace sdm
@@ -28,6 +28,7 @@
  */
 
 #include <C2DColorConverter.h>
+#include <SWColorConverter.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <linux/msm_kgsl.h>
@@ -57,6 +58,7 @@ public:
     C2DColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags,size_t srcStride);
     int32_t getBuffReq(int32_t port, C2DBuffReq *req);
     int32_t dumpOutput(char * filename, char mode);
+    bool isInitialized() { return mError == 0; }
 protected:
     virtual ~C2DColorConverter();
     virtual int convertC2D(int srcFd, void *srcBase, void * srcData, int dstFd, void *dstBase, void * dstData);
@@ -115,6 +117,8 @@ private:
 C2DColorConverter::C2DColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags, size_t srcStride)
 {
      mError = 0;
+     mC2DLibHandle = NULL;
+     mAdrenoUtilsHandle = NULL;
      if (NV12_UBWC == dstFormat) {
          ALOGE("%s: FATAL ERROR: could not support UBWC output formats ", __FUNCTION__);
          mError = -1;
@@ -192,6 +196,9 @@ C2DColorConverter::C2DColorConverter(size_t srcWidth, size_t srcHeight, size_t d
 C2DColorConverter::~C2DColorConverter()
 {
     if (mError) {
+        if (mAdrenoUtilsHandle) {
+            dlclose(mAdrenoUtilsHandle);
+        }
         if (mC2DLibHandle) {
             dlclose(mC2DLibHandle);
         }
@@ -286,6 +293,7 @@ bool C2DColorConverter::isYUVSurface(ColorConvertFormat format)
     switch (format) {
         case YCbCr420Tile:
         case YCbCr420SP:
+        case YCrCb420SP:
         case YCbCr420P:
         case YCrCb420P:
         case NV12_2K:
@@ -408,6 +416,8 @@ uint32_t C2DColorConverter::getC2DFormat(ColorConvertFormat format)
         case NV12_2K:
         case NV12_128m:
             return C2D_COLOR_FORMAT_420_NV12;
+        case YCrCb420SP:
+            return C2D_COLOR_FORMAT_420_NV21;
         case YCbCr420P:
             return C2D_COLOR_FORMAT_420_I420;
         case YCrCb420P:
@@ -433,6 +443,7 @@ size_t C2DColorConverter::calcStride(ColorConvertFormat format, size_t width)
         case YCbCr420Tile:
             return ALIGN(width, ALIGN128);
         case YCbCr420SP:
+        case YCrCb420SP:
             return ALIGN(width, ALIGN16);
         case NV12_2K:
             return ALIGN(width, ALIGN16);
@@ -453,6 +464,7 @@ size_t C2DColorConverter::calcYSize(ColorConvertFormat format, size_t width, siz
 {
     switch (format) {
         case YCbCr420SP:
+        case YCrCb420SP:
             return (ALIGN(width, ALIGN16) * height);
         case YCbCr420P:
             return ALIGN(width, ALIGN16) * height;
@@ -506,6 +518,7 @@ size_t C2DColorConverter::calcSize(ColorConvertFormat format, size_t width, size
             size = ALIGN(size, ALIGN4K);
             break;
         case YCbCr420SP:
+        case YCrCb420SP:
             alignedw = ALIGN(width, ALIGN16);
             size = ALIGN((alignedw * height) + (ALIGN(width/2, ALIGN32) * (height/2) * 2), ALIGN4K);
             break;
@@ -625,6 +638,7 @@ size_t C2DColorConverter::calcSizeAlign(ColorConvertFormat format) {
 
     switch (format) {
         case YCbCr420SP: //OR NV12
+        case YCrCb420SP:
         case YCbCr420P:
         case NV12_2K:
         case NV12_128m:
@@ -649,6 +663,7 @@ C2DBytesPerPixel C2DColorConverter::calcBytesPerPixel(ColorConvertFormat format)
             bpp.numerator = 4;
             break;
         case YCbCr420SP:
+        case YCrCb420SP:
         case YCbCr420P:
         case YCrCb420P:
         case YCbCr420Tile:
@@ -762,7 +777,15 @@ int32_t C2DColorConverter::dumpOutput(char * filename, char mode) {
 
 extern "C" C2DColorConverterBase* createC2DColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags, size_t srcStride)
 {
-    return new C2DColorConverter(srcWidth, srcHeight, dstWidth, dstHeight, srcFormat, dstFormat, flags, srcStride);
+    C2DColorConverter *converter = new C2DColorConverter(srcWidth, srcHeight, dstWidth, dstHeight, srcFormat, dstFormat, flags, srcStride);
+    if (converter->isInitialized() || !SWColorConverter::isSupported(srcFormat, dstFormat)) {
+        return converter;
+    }
+
+    // No C2D on this device, convert on the CPU instead
+    ALOGW("%s: C2D not available, using the SW converter", __FUNCTION__);
+    delete static_cast<C2DColorConverterBase *>(converter);
+    return new SWColorConverter(srcWidth, srcHeight, dstWidth, dstHeight, srcFormat, dstFormat, flags, srcStride);
 }
 
 extern "C" void destroyC2DColorConverter(C2DColorConverterBase* C2DCC)
@@ -81,6 +81,7 @@ enum ColorConvertFormat {
     NV12_2K,
     NV12_128m,
     NV12_UBWC,
+    YCrCb420SP,
 };
 
 typedef struct {
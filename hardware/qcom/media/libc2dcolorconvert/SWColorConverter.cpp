@@ -0,0 +1,1031 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <SWColorConverter.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SW_CC_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SW_CC_SSE2
+#endif
+
+#undef LOG_TAG
+#define LOG_TAG "C2DColorConvert"
+#define ALIGN( num, to ) (((num) + (to-1)) & (~(to-1)))
+#define ALIGN4K 4096
+#define ALIGN2K 2048
+#define ALIGN128 128
+#define ALIGN64 64
+#define ALIGN32 32
+#define ALIGN16 16
+
+//-----------------------------------------------------
+namespace android {
+
+struct SWColorConverter::Kernels {
+    // width is in pixels and even; u and v hold width / 2 samples
+    void (*yuvToRGBA)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width);
+    void (*yuvToRGB565)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width);
+    void (*rgbaToY)(const uint8_t *src, uint8_t *y, size_t width);
+    void (*rgbaToUV)(const uint8_t *src, uint8_t *u, uint8_t *v, size_t width);
+    // count is in chroma pairs
+    void (*splitUV)(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count);
+    void (*mergeUV)(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count);
+};
+
+/*
+ * Reference kernels. YUV to RGB is ColorConverter::convertYUV420Planar:
+ *   R = (298 * (Y - 16) + 409 * (V - 128)) >> 8
+ *   G = (298 * (Y - 16) - 100 * (U - 128) - 208 * (V - 128)) >> 8
+ *   B = (298 * (Y - 16) + 517 * (U - 128)) >> 8
+ * clipped to 0..255. RGB to YUV is ConvertRGB32ToPlanar:
+ *   Y = ((66 * R + 129 * G + 25 * B) >> 8) + 16
+ *   U = ((-38 * R - 74 * G + 112 * B) >> 8) + 128
+ *   V = ((112 * R - 94 * G - 18 * B) >> 8) + 128
+ * with U and V taken from the top-left pixel of each 2x2 block. The SIMD
+ * kernels below must give the same bytes.
+ */
+static inline uint8_t clip(int32_t x)
+{
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+static inline void yuvToRGB(uint8_t y, uint8_t u, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    int32_t y1 = ((int32_t)y - 16) * 298;
+    int32_t u1 = (int32_t)u - 128;
+    int32_t v1 = (int32_t)v - 128;
+
+    *r = clip((y1 + v1 * 409) >> 8);
+    *g = clip((y1 - u1 * 100 - v1 * 208) >> 8);
+    *b = clip((y1 + u1 * 517) >> 8);
+}
+
+static void yuvToRGBARowC(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        yuvToRGB(y[x], u[x / 2], v[x / 2], &dst[0], &dst[1], &dst[2]);
+        dst[3] = 0xff;
+        dst += 4;
+    }
+}
+
+static void yuvToRGB565RowC(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    uint16_t *dst16 = (uint16_t *)dst;
+    for (size_t x = 0; x < width; x++) {
+        uint8_t r, g, b;
+        yuvToRGB(y[x], u[x / 2], v[x / 2], &r, &g, &b);
+        dst16[x] = ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | (b >> 3);
+    }
+}
+
+static void rgbaToYRowC(const uint8_t *src, uint8_t *y, size_t width)
+{
+    for (size_t x = 0; x < width; x++) {
+        y[x] = ((66 * src[0] + 129 * src[1] + 25 * src[2]) >> 8) + 16;
+        src += 4;
+    }
+}
+
+static void rgbaToUVRowC(const uint8_t *src, uint8_t *u, uint8_t *v, size_t width)
+{
+    for (size_t x = 0; x < width / 2; x++) {
+        int32_t r = src[0], g = src[1], b = src[2];
+        u[x] = ((-38 * r - 74 * g + 112 * b) >> 8) + 128;
+        v[x] = ((112 * r - 94 * g - 18 * b) >> 8) + 128;
+        src += 8;
+    }
+}
+
+static void splitUVRowC(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count)
+{
+    for (size_t x = 0; x < count; x++) {
+        u[x] = uv[0];
+        v[x] = uv[1];
+        uv += 2;
+    }
+}
+
+static void mergeUVRowC(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count)
+{
+    for (size_t x = 0; x < count; x++) {
+        uv[0] = u[x];
+        uv[1] = v[x];
+        uv += 2;
+    }
+}
+
+// Only ever done in C, RGB565 sources are rare.
+static void rgb565ToRGBARow(const uint8_t *src, uint8_t *dst, size_t width)
+{
+    const uint16_t *src16 = (const uint16_t *)src;
+    for (size_t x = 0; x < width; x++) {
+        uint16_t p = src16[x];
+        uint8_t r = p >> 11, g = (p >> 5) & 0x3f, b = p & 0x1f;
+        dst[0] = (r << 3) | (r >> 2);
+        dst[1] = (g << 2) | (g >> 4);
+        dst[2] = (b << 3) | (b >> 2);
+        dst[3] = 0xff;
+        dst += 4;
+    }
+}
+
+static const SWColorConverter::Kernels sKernelsC = {
+    yuvToRGBARowC,
+    yuvToRGB565RowC,
+    rgbaToYRowC,
+    rgbaToUVRowC,
+    splitUVRowC,
+    mergeUVRowC,
+};
+
+#if defined(SW_CC_NEON)
+
+// 8 pixels from 8 luma and 4 chroma samples, each chroma sample already
+// repeated for the two pixels it covers.
+static inline void yuvToRGB8NEON(int16x8_t y, int16x8_t u, int16x8_t v, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+    int32x4_t yl = vmull_n_s16(vget_low_s16(y), 298);
+    int32x4_t yh = vmull_n_s16(vget_high_s16(y), 298);
+
+    *r = vqmovun_s16(vcombine_s16(
+            vshrn_n_s32(vmlal_n_s16(yl, vget_low_s16(v), 409), 8),
+            vshrn_n_s32(vmlal_n_s16(yh, vget_high_s16(v), 409), 8)));
+    *g = vqmovun_s16(vcombine_s16(
+            vshrn_n_s32(vmlal_n_s16(vmlal_n_s16(yl, vget_low_s16(u), -100), vget_low_s16(v), -208), 8),
+            vshrn_n_s32(vmlal_n_s16(vmlal_n_s16(yh, vget_high_s16(u), -100), vget_high_s16(v), -208), 8)));
+    *b = vqmovun_s16(vcombine_s16(
+            vshrn_n_s32(vmlal_n_s16(yl, vget_low_s16(u), 517), 8),
+            vshrn_n_s32(vmlal_n_s16(yh, vget_high_s16(u), 517), 8)));
+}
+
+// 16 pixels from 16 luma and 8 chroma samples, in two halves of 8.
+static inline void yuvToRGB16NEON(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8x8_t r[2], uint8x8_t g[2], uint8x8_t b[2])
+{
+    uint8x16_t y8 = vld1q_u8(y);
+    int16x8_t u16 = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u), vdup_n_u8(128)));
+    int16x8_t v16 = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v), vdup_n_u8(128)));
+    int16x8x2_t uu = vzipq_s16(u16, u16);
+    int16x8x2_t vv = vzipq_s16(v16, v16);
+
+    yuvToRGB8NEON(vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(y8), vdup_n_u8(16))),
+            uu.val[0], vv.val[0], &r[0], &g[0], &b[0]);
+    yuvToRGB8NEON(vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(y8), vdup_n_u8(16))),
+            uu.val[1], vv.val[1], &r[1], &g[1], &b[1]);
+}
+
+static void yuvToRGBARowNEON(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t r[2], g[2], b[2];
+        yuvToRGB16NEON(y + x, u + x / 2, v + x / 2, r, g, b);
+        for (int half = 0; half < 2; half++) {
+            uint8x8x4_t px;
+            px.val[0] = r[half];
+            px.val[1] = g[half];
+            px.val[2] = b[half];
+            px.val[3] = vdup_n_u8(0xff);
+            vst4_u8(dst + (x + half * 8) * 4, px);
+        }
+    }
+    yuvToRGBARowC(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x);
+}
+
+static void yuvToRGB565RowNEON(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t r[2], g[2], b[2];
+        yuvToRGB16NEON(y + x, u + x / 2, v + x / 2, r, g, b);
+        for (int half = 0; half < 2; half++) {
+            uint16x8_t px = vshll_n_u8(r[half], 8);
+            px = vsriq_n_u16(px, vshll_n_u8(g[half], 8), 5);
+            px = vsriq_n_u16(px, vshll_n_u8(b[half], 8), 11);
+            vst1q_u16((uint16_t *)dst + x + half * 8, px);
+        }
+    }
+    yuvToRGB565RowC(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+static void rgbaToYRowNEON(const uint8_t *src, uint8_t *y, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t px = vld4q_u8(src + x * 4);
+        // at most 255 * (66 + 129 + 25), no need to widen further
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), vdup_n_u8(66));
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), vdup_n_u8(66));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), vdup_n_u8(129));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), vdup_n_u8(129));
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), vdup_n_u8(25));
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), vdup_n_u8(25));
+        vst1q_u8(y + x, vaddq_u8(vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)), vdupq_n_u8(16)));
+    }
+    rgbaToYRowC(src + x * 4, y + x, width - x);
+}
+
+static void rgbaToUVRowNEON(const uint8_t *src, uint8_t *u, uint8_t *v, size_t width)
+{
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t px = vld4q_u8(src + x * 4);
+        // the low byte of each pair is the even pixel
+        uint8x8_t r = vmovn_u16(vreinterpretq_u16_u8(px.val[0]));
+        uint8x8_t g = vmovn_u16(vreinterpretq_u16_u8(px.val[1]));
+        uint8x8_t b = vmovn_u16(vreinterpretq_u16_u8(px.val[2]));
+        // the sums are within +-255 * 112, so wrapping unsigned arithmetic
+        // read back as signed gives the right result
+        uint16x8_t u16 = vmull_u8(b, vdup_n_u8(112));
+        u16 = vmlsl_u8(u16, r, vdup_n_u8(38));
+        u16 = vmlsl_u8(u16, g, vdup_n_u8(74));
+        uint16x8_t v16 = vmull_u8(r, vdup_n_u8(112));
+        v16 = vmlsl_u8(v16, g, vdup_n_u8(94));
+        v16 = vmlsl_u8(v16, b, vdup_n_u8(18));
+        vst1_u8(u + x / 2, vadd_u8(vreinterpret_u8_s8(vshrn_n_s16(vreinterpretq_s16_u16(u16), 8)), vdup_n_u8(128)));
+        vst1_u8(v + x / 2, vadd_u8(vreinterpret_u8_s8(vshrn_n_s16(vreinterpretq_s16_u16(v16), 8)), vdup_n_u8(128)));
+    }
+    rgbaToUVRowC(src + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+static void splitUVRowNEON(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        uint8x16x2_t px = vld2q_u8(uv + x * 2);
+        vst1q_u8(u + x, px.val[0]);
+        vst1q_u8(v + x, px.val[1]);
+    }
+    splitUVRowC(uv + x * 2, u + x, v + x, count - x);
+}
+
+static void mergeUVRowNEON(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        uint8x16x2_t px;
+        px.val[0] = vld1q_u8(u + x);
+        px.val[1] = vld1q_u8(v + x);
+        vst2q_u8(uv + x * 2, px);
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, count - x);
+}
+
+static const SWColorConverter::Kernels sKernelsSIMD = {
+    yuvToRGBARowNEON,
+    yuvToRGB565RowNEON,
+    rgbaToYRowNEON,
+    rgbaToUVRowNEON,
+    splitUVRowNEON,
+    mergeUVRowNEON,
+};
+
+#elif defined(SW_CC_SSE2)
+
+// 8 pixels from 8 luma and 4 chroma samples, with the channels in the low
+// 8 bytes of r, g and b. The products need 32 bits, pmaddwd gives them as
+// the sum of a luma and a chroma term.
+static inline void yuvToRGB8SSE2(const uint8_t *y, const uint8_t *u, const uint8_t *v, __m128i *r, __m128i *g, __m128i *b)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t u4, v4;
+    memcpy(&u4, u, sizeof(u4));
+    memcpy(&v4, v, sizeof(v4));
+
+    __m128i y16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)y), zero), _mm_set1_epi16(16));
+    __m128i u16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(u4), zero), _mm_set1_epi16(128));
+    __m128i v16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v4), zero), _mm_set1_epi16(128));
+    u16 = _mm_unpacklo_epi16(u16, u16);
+    v16 = _mm_unpacklo_epi16(v16, v16);
+
+    __m128i yuLo = _mm_unpacklo_epi16(y16, u16);
+    __m128i yuHi = _mm_unpackhi_epi16(y16, u16);
+    __m128i yvLo = _mm_unpacklo_epi16(y16, v16);
+    __m128i yvHi = _mm_unpackhi_epi16(y16, v16);
+
+    const __m128i kR = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+    const __m128i kGU = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+    const __m128i kGV = _mm_setr_epi16(0, -208, 0, -208, 0, -208, 0, -208);
+    const __m128i kB = _mm_setr_epi16(298, 517, 298, 517, 298, 517, 298, 517);
+
+    __m128i lo, hi;
+    lo = _mm_srai_epi32(_mm_madd_epi16(yvLo, kR), 8);
+    hi = _mm_srai_epi32(_mm_madd_epi16(yvHi, kR), 8);
+    *r = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+    lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuLo, kGU), _mm_madd_epi16(yvLo, kGV)), 8);
+    hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuHi, kGU), _mm_madd_epi16(yvHi, kGV)), 8);
+    *g = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+    lo = _mm_srai_epi32(_mm_madd_epi16(yuLo, kB), 8);
+    hi = _mm_srai_epi32(_mm_madd_epi16(yuHi, kB), 8);
+    *b = _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero);
+}
+
+static void yuvToRGBARowSSE2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i r, g, b;
+        yuvToRGB8SSE2(y + x, u + x / 2, v + x / 2, &r, &g, &b);
+        __m128i rg = _mm_unpacklo_epi8(r, g);
+        __m128i ba = _mm_unpacklo_epi8(b, _mm_set1_epi8((char)0xff));
+        _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    yuvToRGBARowC(y + x, u + x / 2, v + x / 2, dst + x * 4, width - x);
+}
+
+static void yuvToRGB565RowSSE2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, size_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i r, g, b;
+        yuvToRGB8SSE2(y + x, u + x / 2, v + x / 2, &r, &g, &b);
+        r = _mm_slli_epi16(_mm_and_si128(_mm_unpacklo_epi8(r, zero), _mm_set1_epi16(0xf8)), 8);
+        g = _mm_slli_epi16(_mm_and_si128(_mm_unpacklo_epi8(g, zero), _mm_set1_epi16(0xfc)), 3);
+        b = _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3);
+        _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_or_si128(_mm_or_si128(r, g), b));
+    }
+    yuvToRGB565RowC(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+// Adds the neighbouring 32 bit lanes of a and b: a0 + a1, a2 + a3, b0 + b1, b2 + b3.
+static inline __m128i addPairsSSE2(__m128i a, __m128i b)
+{
+    __m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+    return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+            _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// Dot products of the 4 RGBA pixels in px with k, as 32 bit lanes.
+static inline __m128i dot4SSE2(__m128i px, __m128i k)
+{
+    const __m128i zero = _mm_setzero_si128();
+    return addPairsSSE2(_mm_madd_epi16(_mm_unpacklo_epi8(px, zero), k),
+            _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), k));
+}
+
+static void rgbaToYRowSSE2(const uint8_t *src, uint8_t *y, size_t width)
+{
+    const __m128i kY = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    const __m128i k16 = _mm_set1_epi32(16);
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + x * 4 + 16));
+        lo = _mm_add_epi32(_mm_srli_epi32(dot4SSE2(lo, kY), 8), k16);
+        hi = _mm_add_epi32(_mm_srli_epi32(dot4SSE2(hi, kY), 8), k16);
+        __m128i y16 = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i *)(y + x), _mm_packus_epi16(y16, y16));
+    }
+    rgbaToYRowC(src + x * 4, y + x, width - x);
+}
+
+static void rgbaToUVRowSSE2(const uint8_t *src, uint8_t *u, uint8_t *v, size_t width)
+{
+    const __m128i kU = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    const __m128i kV = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    const __m128i k128 = _mm_set1_epi32(128);
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + x * 4));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + x * 4 + 16));
+        // pixels 0, 2, 4 and 6
+        __m128i even = _mm_unpacklo_epi64(_mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0)),
+                _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i u32 = _mm_add_epi32(_mm_srai_epi32(dot4SSE2(even, kU), 8), k128);
+        __m128i v32 = _mm_add_epi32(_mm_srai_epi32(dot4SSE2(even, kV), 8), k128);
+        __m128i uv16 = _mm_packs_epi32(u32, v32);
+        __m128i uv8 = _mm_packus_epi16(uv16, uv16);
+        uint32_t u4 = _mm_cvtsi128_si32(uv8);
+        uint32_t v4 = _mm_cvtsi128_si32(_mm_srli_si128(uv8, 4));
+        memcpy(u + x / 2, &u4, sizeof(u4));
+        memcpy(v + x / 2, &v4, sizeof(v4));
+    }
+    rgbaToUVRowC(src + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+static void splitUVRowSSE2(const uint8_t *uv, uint8_t *u, uint8_t *v, size_t count)
+{
+    const __m128i mask = _mm_set1_epi16(0xff);
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(uv + x * 2));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(uv + x * 2 + 16));
+        _mm_storeu_si128((__m128i *)(u + x),
+                _mm_packus_epi16(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask)));
+        _mm_storeu_si128((__m128i *)(v + x),
+                _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    splitUVRowC(uv + x * 2, u + x, v + x, count - x);
+}
+
+static void mergeUVRowSSE2(const uint8_t *u, const uint8_t *v, uint8_t *uv, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i u16 = _mm_loadu_si128((const __m128i *)(u + x));
+        __m128i v16 = _mm_loadu_si128((const __m128i *)(v + x));
+        _mm_storeu_si128((__m128i *)(uv + x * 2), _mm_unpacklo_epi8(u16, v16));
+        _mm_storeu_si128((__m128i *)(uv + x * 2 + 16), _mm_unpackhi_epi8(u16, v16));
+    }
+    mergeUVRowC(u + x, v + x, uv + x * 2, count - x);
+}
+
+static const SWColorConverter::Kernels sKernelsSIMD = {
+    yuvToRGBARowSSE2,
+    yuvToRGB565RowSSE2,
+    rgbaToYRowSSE2,
+    rgbaToUVRowSSE2,
+    splitUVRowSSE2,
+    mergeUVRowSSE2,
+};
+
+#else
+
+static const SWColorConverter::Kernels &sKernelsSIMD = sKernelsC;
+
+#endif
+
+SWColorConverter::SWColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags, size_t srcStride)
+{
+    mError = 0;
+    mSrcStride = srcStride;
+    mFlags = flags;
+    mKernels = &sKernelsSIMD;
+    mScratch = NULL;
+    mScratchSize = 0;
+    mNumThreads = 0;
+    mNumBands = 0;
+    mNextBand = 0;
+    mBandsLeft = 0;
+    mGeneration = 0;
+    mExit = false;
+    memset(&mSrc, 0, sizeof(mSrc));
+    memset(&mDst, 0, sizeof(mDst));
+    memset(&mSrcPlanes, 0, sizeof(mSrcPlanes));
+    memset(&mDstPlanes, 0, sizeof(mDstPlanes));
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+
+    if (!isSupported(srcFormat, dstFormat)) {
+        ALOGE("%s: conversion from %d to %d not supported", __FUNCTION__, srcFormat, dstFormat);
+        mError = -1;
+        return;
+    }
+    if (srcWidth != dstWidth || srcHeight != dstHeight) {
+        ALOGE("%s: scaling not supported, %zux%zu to %zux%zu", __FUNCTION__,
+                srcWidth, srcHeight, dstWidth, dstHeight);
+        mError = -1;
+        return;
+    }
+    if (!srcWidth || !srcHeight || (srcWidth & 1) || (srcHeight & 1)) {
+        ALOGE("%s: invalid size %zux%zu", __FUNCTION__, srcWidth, srcHeight);
+        mError = -1;
+        return;
+    }
+
+    initLayout(&mSrc, srcFormat, srcWidth, srcHeight);
+    initLayout(&mDst, dstFormat, dstWidth, dstHeight);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!startThreads(cpus > 0 ? cpus : 1)) {
+        mError = -1;
+    }
+}
+
+SWColorConverter::~SWColorConverter()
+{
+    stopThreads();
+    free(mScratch);
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+bool SWColorConverter::isSupported(ColorConvertFormat srcFormat, ColorConvertFormat dstFormat)
+{
+    ColorConvertFormat formats[] = { srcFormat, dstFormat };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        switch (formats[i]) {
+            case RGB565:
+            case RGBA8888:
+            case YCbCr420SP:
+            case YCrCb420SP:
+            case YCbCr420P:
+            case YCrCb420P:
+            case NV12_2K:
+            case NV12_128m:
+                break;
+            case YCbCr420Tile:
+            case NV12_UBWC:
+            default:
+                return false;
+        }
+    }
+    return isYUVSurface(srcFormat) != isYUVSurface(dstFormat);
+}
+
+void SWColorConverter::setUseSIMD(bool useSIMD)
+{
+    mKernels = useSIMD ? &sKernelsSIMD : &sKernelsC;
+}
+
+void SWColorConverter::setNumThreads(size_t numThreads)
+{
+    if (mError) {
+        return;
+    }
+    stopThreads();
+    if (!startThreads(numThreads)) {
+        mError = -1;
+    }
+}
+
+bool SWColorConverter::startThreads(size_t numThreads)
+{
+    numThreads = numThreads < 1 ? 1 : (numThreads > kMaxThreads ? (size_t)kMaxThreads : numThreads);
+
+    // bands are whole chroma rows
+    mNumBands = numThreads < mSrc.height / 2 ? numThreads : mSrc.height / 2;
+    mScratchSize = ALIGN(mSrc.width, ALIGN64) + ALIGN(mSrc.width * 4, ALIGN64);
+    free(mScratch);
+    mScratch = (uint8_t *)malloc(mScratchSize * mNumBands);
+    if (!mScratch) {
+        ALOGE("%s: no memory for %zu bands", __FUNCTION__, mNumBands);
+        return false;
+    }
+
+    // the caller of convertC2D converts bands as well
+    mNumThreads = 1;
+    while (mNumThreads < numThreads) {
+        if (pthread_create(&mThreads[mNumThreads - 1], NULL, threadMain, this)) {
+            ALOGW("%s: running with %zu threads", __FUNCTION__, mNumThreads);
+            break;
+        }
+        mNumThreads++;
+    }
+    return true;
+}
+
+void SWColorConverter::stopThreads()
+{
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    for (size_t i = 0; i + 1 < mNumThreads; i++) {
+        pthread_join(mThreads[i], NULL);
+    }
+    mNumThreads = 0;
+    mExit = false;
+}
+
+void *SWColorConverter::threadMain(void *arg)
+{
+    SWColorConverter *me = (SWColorConverter *)arg;
+
+    pthread_mutex_lock(&me->mLock);
+    uint32_t generation = me->mGeneration;
+    for (;;) {
+        while (!me->mExit && generation == me->mGeneration) {
+            pthread_cond_wait(&me->mWorkCond, &me->mLock);
+        }
+        if (me->mExit) {
+            break;
+        }
+        generation = me->mGeneration;
+        me->convertBands();
+    }
+    pthread_mutex_unlock(&me->mLock);
+    return NULL;
+}
+
+// Called with mLock held, converts bands until none are left to take.
+void SWColorConverter::convertBands()
+{
+    while (mNextBand < mNumBands) {
+        size_t band = mNextBand++;
+        pthread_mutex_unlock(&mLock);
+        convertBand(band);
+        pthread_mutex_lock(&mLock);
+        if (--mBandsLeft == 0) {
+            pthread_cond_signal(&mDoneCond);
+        }
+    }
+}
+
+void SWColorConverter::convertBand(size_t band)
+{
+    size_t chromaRows = mSrc.height / 2;
+    size_t first = chromaRows * band / mNumBands * 2;
+    size_t last = chromaRows * (band + 1) / mNumBands * 2;
+    uint8_t *scratch = mScratch + band * mScratchSize;
+
+    if (isYUVSurface(mSrc.format)) {
+        convertYUVToRGB(first, last, scratch);
+    } else {
+        convertRGBToYUV(first, last, scratch);
+    }
+}
+
+void SWColorConverter::convertYUVToRGB(size_t first, size_t last, uint8_t *scratch)
+{
+    size_t width = mSrc.width;
+    uint8_t *u = scratch;
+    uint8_t *v = scratch + width / 2;
+    const uint8_t *uRow = NULL, *vRow = NULL;
+
+    for (size_t y = first; y < last; y++) {
+        if (!(y & 1)) {
+            size_t row = y / 2;
+            if (mSrcPlanes.uv) {
+                const uint8_t *uv = mSrcPlanes.uv + row * mSrc.chromaStride;
+                if (mSrc.format == YCrCb420SP) {
+                    mKernels->splitUV(uv, v, u, width / 2);
+                } else {
+                    mKernels->splitUV(uv, u, v, width / 2);
+                }
+                uRow = u;
+                vRow = v;
+            } else {
+                uRow = mSrcPlanes.u + row * mSrc.chromaStride;
+                vRow = mSrcPlanes.v + row * mSrc.chromaStride;
+            }
+        }
+
+        const uint8_t *yRow = mSrcPlanes.y + y * mSrc.stride;
+        uint8_t *dst = mDstPlanes.y + y * mDst.stride;
+        if (mDst.format == RGBA8888) {
+            mKernels->yuvToRGBA(yRow, uRow, vRow, dst, width);
+        } else {
+            mKernels->yuvToRGB565(yRow, uRow, vRow, dst, width);
+        }
+    }
+}
+
+void SWColorConverter::convertRGBToYUV(size_t first, size_t last, uint8_t *scratch)
+{
+    size_t width = mSrc.width;
+    uint8_t *u = scratch;
+    uint8_t *v = scratch + width / 2;
+    uint8_t *rgba = scratch + ALIGN(width, ALIGN64);
+
+    for (size_t y = first; y < last; y++) {
+        const uint8_t *src = mSrcPlanes.y + y * mSrc.stride;
+        if (mSrc.format == RGB565) {
+            rgb565ToRGBARow(src, rgba, width);
+            src = rgba;
+        }
+        mKernels->rgbaToY(src, mDstPlanes.y + y * mDst.stride, width);
+
+        if (y & 1) {
+            continue;
+        }
+        size_t row = y / 2;
+        if (mDstPlanes.uv) {
+            uint8_t *uv = mDstPlanes.uv + row * mDst.chromaStride;
+            mKernels->rgbaToUV(src, u, v, width);
+            if (mDst.format == YCrCb420SP) {
+                mKernels->mergeUV(v, u, uv, width / 2);
+            } else {
+                mKernels->mergeUV(u, v, uv, width / 2);
+            }
+        } else {
+            mKernels->rgbaToUV(src, mDstPlanes.u + row * mDst.chromaStride,
+                    mDstPlanes.v + row * mDst.chromaStride, width);
+        }
+    }
+}
+
+int SWColorConverter::convertC2D(int srcFd, void *srcBase, void * srcData, int dstFd, void *dstBase, void * dstData)
+{
+    (void)srcFd;
+    (void)srcBase;
+    (void)dstFd;
+    (void)dstBase;
+
+    if (mError) {
+        ALOGE("SW color converter initialization failed\n");
+        return mError;
+    }
+
+    if ((srcData == NULL) || (dstData == NULL)) {
+        ALOGE("Incorrect input parameters\n");
+        return -1;
+    }
+
+    setPlanes(&mSrcPlanes, mSrc, srcData);
+    setPlanes(&mDstPlanes, mDst, dstData);
+
+    pthread_mutex_lock(&mLock);
+    mNextBand = 0;
+    mBandsLeft = mNumBands;
+    mGeneration++;
+    if (mNumThreads > 1) {
+        pthread_cond_broadcast(&mWorkCond);
+    }
+    convertBands();
+    while (mBandsLeft) {
+        pthread_cond_wait(&mDoneCond, &mLock);
+    }
+    pthread_mutex_unlock(&mLock);
+    return 0;
+}
+
+bool SWColorConverter::isYUVSurface(ColorConvertFormat format)
+{
+    switch (format) {
+        case YCbCr420Tile:
+        case YCbCr420SP:
+        case YCrCb420SP:
+        case YCbCr420P:
+        case YCrCb420P:
+        case NV12_2K:
+        case NV12_128m:
+        case NV12_UBWC:
+            return true;
+        case RGB565:
+        case RGBA8888:
+        default:
+            return false;
+    }
+}
+
+bool SWColorConverter::isSemiPlanar(ColorConvertFormat format)
+{
+    return isYUVSurface(format) && format != YCbCr420P && format != YCrCb420P;
+}
+
+void SWColorConverter::initLayout(Layout *layout, ColorConvertFormat format, size_t width, size_t height)
+{
+    layout->format = format;
+    layout->width = width;
+    layout->height = height;
+    layout->stride = calcStride(format, width);
+    layout->chromaStride = isSemiPlanar(format) ? layout->stride : layout->stride / 2;
+    layout->ySize = calcYSize(format, width, height);
+    layout->size = calcSize(format, width, height);
+}
+
+void SWColorConverter::setPlanes(Planes *planes, const Layout &layout, void *data)
+{
+    memset(planes, 0, sizeof(*planes));
+    planes->y = (uint8_t *)data;
+    if (!isYUVSurface(layout.format)) {
+        return;
+    }
+
+    uint8_t *plane1 = (uint8_t *)data + layout.ySize;
+    if (isSemiPlanar(layout.format)) {
+        planes->uv = plane1;
+        return;
+    }
+    // same placement as C2DColorConverter::updateYUVSurfaceDef
+    uint8_t *plane2 = plane1 + layout.ySize / 4;
+    if (layout.format == YCbCr420P) {
+        planes->u = plane1;
+        planes->v = plane2;
+    } else {
+        planes->v = plane1;
+        planes->u = plane2;
+    }
+}
+
+size_t SWColorConverter::calcStride(ColorConvertFormat format, size_t width)
+{
+    switch (format) {
+        case RGB565:
+            return ALIGN(width, ALIGN32) * 2; // RGB565 has width as twice
+        case RGBA8888:
+            if (mSrcStride)
+                return mSrcStride * 4;
+            else
+                return ALIGN(width, ALIGN32) * 4;
+        case YCbCr420SP:
+        case YCrCb420SP:
+            return ALIGN(width, ALIGN16);
+        case NV12_2K:
+            return ALIGN(width, ALIGN16);
+        case NV12_128m:
+            return ALIGN(width, ALIGN128);
+        case YCbCr420P:
+            return ALIGN(width, ALIGN16);
+        case YCrCb420P:
+            return ALIGN(width, ALIGN16);
+        default:
+            return 0;
+    }
+}
+
+size_t SWColorConverter::calcYSize(ColorConvertFormat format, size_t width, size_t height)
+{
+    switch (format) {
+        case YCbCr420SP:
+        case YCrCb420SP:
+            return (ALIGN(width, ALIGN16) * height);
+        case YCbCr420P:
+            return ALIGN(width, ALIGN16) * height;
+        case YCrCb420P:
+            return ALIGN(width, ALIGN16) * height;
+        case NV12_2K: {
+            size_t alignedw = ALIGN(width, ALIGN16);
+            size_t lumaSize = ALIGN(alignedw * height, ALIGN2K);
+            return lumaSize;
+        }
+        case NV12_128m:
+            return ALIGN(width, ALIGN128) * ALIGN(height, ALIGN32);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * As C2DColorConverter::calcSize, except that RGB buffers are not padded for
+ * the GPU: rows of calcStride bytes, rounded up to 4K.
+ */
+size_t SWColorConverter::calcSize(ColorConvertFormat format, size_t width, size_t height)
+{
+    size_t alignedw = 0;
+    size_t alignedh = 0;
+    size_t size = 0;
+
+    switch (format) {
+        case RGB565:
+        case RGBA8888:
+            size = ALIGN(calcStride(format, width) * height, ALIGN4K);
+            break;
+        case YCbCr420SP:
+        case YCrCb420SP:
+            alignedw = ALIGN(width, ALIGN16);
+            size = ALIGN((alignedw * height) + (ALIGN(width/2, ALIGN32) * (height/2) * 2), ALIGN4K);
+            break;
+        case YCbCr420P:
+        case YCrCb420P:
+            alignedw = ALIGN(width, ALIGN16);
+            size = ALIGN((alignedw * height) + (ALIGN(width/2, ALIGN16) * (height/2) * 2), ALIGN4K);
+            break;
+        case NV12_2K: {
+            alignedw = ALIGN(width, ALIGN16);
+            size_t lumaSize = ALIGN(alignedw * height, ALIGN2K);
+            size_t chromaSize = ALIGN((alignedw * height)/2, ALIGN2K);
+            size = ALIGN(lumaSize + chromaSize, ALIGN4K);
+            }
+            break;
+        case NV12_128m:
+            alignedw = ALIGN(width, ALIGN128);
+            alignedh = ALIGN(height, ALIGN32);
+            size = ALIGN(alignedw * alignedh + (alignedw * ALIGN(height/2, ALIGN16)), ALIGN4K);
+            break;
+        default:
+            break;
+    }
+    return size;
+}
+
+int32_t SWColorConverter::getBuffReq(int32_t port, C2DBuffReq *req) {
+    if (!req) return -1;
+
+    if (port != C2D_INPUT && port != C2D_OUTPUT) return -1;
+
+    const Layout &layout = port == C2D_INPUT ? mSrc : mDst;
+    memset(req, 0, sizeof(C2DBuffReq));
+    req->width = layout.width;
+    req->height = layout.height;
+    req->stride = layout.stride;
+    req->sliceHeight = layout.height;
+    req->lumaAlign = calcLumaAlign(layout.format);
+    req->sizeAlign = calcSizeAlign(layout.format);
+    req->size = layout.size;
+    req->bpp = calcBytesPerPixel(layout.format);
+    ALOGV("%s req->size = %d\n", port == C2D_INPUT ? "input" : "output", req->size);
+    return 0;
+}
+
+size_t SWColorConverter::calcLumaAlign(ColorConvertFormat format) {
+    switch (format) {
+        case NV12_2K:
+          return ALIGN2K;
+        default:
+          return 1;
+    }
+}
+
+size_t SWColorConverter::calcSizeAlign(ColorConvertFormat format) {
+    switch (format) {
+        case YCbCr420SP: //OR NV12
+        case YCrCb420SP:
+        case YCbCr420P:
+        case NV12_2K:
+        case NV12_128m:
+          return ALIGN4K;
+        default:
+          return 1;
+    }
+}
+
+C2DBytesPerPixel SWColorConverter::calcBytesPerPixel(ColorConvertFormat format) {
+    C2DBytesPerPixel bpp;
+    bpp.numerator = 0;
+    bpp.denominator = 1;
+
+    switch (format) {
+        case RGB565:
+            bpp.numerator = 2;
+            break;
+        case RGBA8888:
+            bpp.numerator = 4;
+            break;
+        case YCbCr420SP:
+        case YCrCb420SP:
+        case YCbCr420P:
+        case YCrCb420P:
+        case NV12_2K:
+        case NV12_128m:
+            bpp.numerator = 3;
+            bpp.denominator = 2;
+            break;
+        default:
+            break;
+    }
+    return bpp;
+}
+
+// Writes the last output without its padding, as C2DColorConverter does.
+int32_t SWColorConverter::dumpOutput(char * filename, char mode) {
+    int fd;
+    if (!filename || !mDstPlanes.y) return -1;
+
+    int flags = O_RDWR | O_CREAT;
+    if (mode == 'a') {
+      flags |= O_APPEND;
+    }
+
+    if ((fd = open(filename, flags, 0644)) < 0) {
+        ALOGE("open dump file failed w/ errno %s", strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    size_t rowBytes = mDst.width;
+    if (!isYUVSurface(mDst.format)) {
+        rowBytes *= calcBytesPerPixel(mDst.format).numerator;
+    }
+    for (size_t i = 0; i < mDst.height && ret >= 0; i++) {
+        ret = write(fd, mDstPlanes.y + i * mDst.stride, rowBytes);
+    }
+    if (mDstPlanes.uv) {
+        for (size_t i = 0; i < mDst.height / 2 && ret >= 0; i++) {
+            ret = write(fd, mDstPlanes.uv + i * mDst.chromaStride, mDst.width);
+        }
+    } else if (mDstPlanes.u) {
+        // in memory order, Cb first for I420 and Cr first for YV12
+        uint8_t *planes[2] = { mDstPlanes.u, mDstPlanes.v };
+        if (mDst.format == YCrCb420P) {
+            planes[0] = mDstPlanes.v;
+            planes[1] = mDstPlanes.u;
+        }
+        for (size_t p = 0; p < 2; p++) {
+            for (size_t i = 0; i < mDst.height / 2 && ret >= 0; i++) {
+                ret = write(fd, planes[p] + i * mDst.chromaStride, mDst.width / 2);
+            }
+        }
+    }
+
+    if (ret < 0) {
+      ALOGE("file write failed w/ errno %s", strerror(errno));
+    }
+    close(fd);
+    return ret < 0 ? ret : 0;
+}
+
+extern "C" C2DColorConverterBase* createSWColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags, size_t srcStride)
+{
+    return new SWColorConverter(srcWidth, srcHeight, dstWidth, dstHeight, srcFormat, dstFormat, flags, srcStride);
+}
+
+}
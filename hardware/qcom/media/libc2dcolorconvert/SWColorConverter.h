@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SW_ColorConverter_H_
+#define SW_ColorConverter_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <C2DColorConverter.h>
+
+namespace android {
+
+/*
+ * Converts on the CPU between the linear 4:2:0 YUV layouts (NV12, NV21, I420,
+ * YV12 and the NV12 variants with padded planes) and RGBA8888 / RGB565, for
+ * when the C2D blitter is not available. Buffers are laid out exactly as
+ * C2DColorConverter lays them out, so a client does not need to know which of
+ * the two it got. Tiled and UBWC layouts, and scaling, are not supported.
+ *
+ * The arithmetic matches libstagefright's software converters bit for bit:
+ * YUV to RGB as in ColorConverter (BT.601, video range), RGB to YUV as in
+ * SoftVideoEncoderOMXComponent::ConvertRGB32ToPlanar, which takes the chroma
+ * of each 2x2 block from its top-left pixel. Rows are converted in bands, one
+ * band per thread, with NEON or SSE2 kernels where the build has them.
+ */
+class SWColorConverter : public C2DColorConverterBase {
+
+public:
+    SWColorConverter(size_t srcWidth, size_t srcHeight, size_t dstWidth, size_t dstHeight, ColorConvertFormat srcFormat, ColorConvertFormat dstFormat, int32_t flags, size_t srcStride);
+    virtual ~SWColorConverter();
+    virtual int convertC2D(int srcFd, void *srcBase, void * srcData, int dstFd, void *dstBase, void * dstData);
+    virtual int32_t getBuffReq(int32_t port, C2DBuffReq *req);
+    virtual int32_t dumpOutput(char * filename, char mode);
+
+    static bool isSupported(ColorConvertFormat srcFormat, ColorConvertFormat dstFormat);
+
+    // For benchmarking: plain C kernels instead of the SIMD ones, and the
+    // number of threads (including the caller's) sharing a conversion.
+    void setUseSIMD(bool useSIMD);
+    void setNumThreads(size_t numThreads);
+
+    enum {
+        kMaxThreads = 8,
+    };
+
+    struct Kernels; // row conversion functions, see SWColorConverter.cpp
+
+private:
+    struct Layout {
+        ColorConvertFormat format;
+        size_t width;
+        size_t height;
+        size_t stride;       // bytes between rows of plane 0
+        size_t chromaStride; // bytes between rows of the chroma planes
+        size_t ySize;        // offset of the first chroma plane
+        size_t size;
+    };
+
+    struct Planes {
+        uint8_t *y;  // luma, or the RGB pixels
+        uint8_t *uv; // interleaved chroma of the semi planar formats
+        uint8_t *u;  // chroma planes of the planar formats
+        uint8_t *v;
+    };
+
+    static bool isYUVSurface(ColorConvertFormat format);
+    static bool isSemiPlanar(ColorConvertFormat format);
+    size_t calcStride(ColorConvertFormat format, size_t width);
+    size_t calcYSize(ColorConvertFormat format, size_t width, size_t height);
+    size_t calcSize(ColorConvertFormat format, size_t width, size_t height);
+    size_t calcLumaAlign(ColorConvertFormat format);
+    size_t calcSizeAlign(ColorConvertFormat format);
+    C2DBytesPerPixel calcBytesPerPixel(ColorConvertFormat format);
+    void initLayout(Layout *layout, ColorConvertFormat format, size_t width, size_t height);
+    void setPlanes(Planes *planes, const Layout &layout, void *data);
+
+    bool startThreads(size_t numThreads);
+    void stopThreads();
+    static void *threadMain(void *arg);
+    void convertBands();
+    void convertBand(size_t band);
+    void convertYUVToRGB(size_t first, size_t last, uint8_t *scratch);
+    void convertRGBToYUV(size_t first, size_t last, uint8_t *scratch);
+
+    Layout mSrc;
+    Layout mDst;
+    Planes mSrcPlanes;
+    Planes mDstPlanes;
+    size_t mSrcStride;
+    int32_t mFlags;
+    const Kernels *mKernels;
+
+    // Scratch rows for each band: the deinterleaved chroma, and the
+    // RGBA8888 expansion of an RGB565 row.
+    uint8_t *mScratch;
+    size_t mScratchSize;
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond; // a conversion was started
+    pthread_cond_t mDoneCond; // the last band of a conversion is done
+    pthread_t mThreads[kMaxThreads];
+    size_t mNumThreads;       // including the caller of convertC2D
+    size_t mNumBands;
+    size_t mNextBand;
+    size_t mBandsLeft;
+    uint32_t mGeneration;
+    bool mExit;
+
+    int mError;
+};
+
+}
+
+#endif  // SW_ColorConverter_H_
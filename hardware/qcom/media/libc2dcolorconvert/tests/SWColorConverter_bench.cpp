@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <SWColorConverter.h>
+
+// Times the SW color converter at 1080p and 4K for each conversion it does: plain C on one
+// thread, SIMD on one thread, and SIMD on all the threads. Also checks that the three give
+// the same bytes, and spot checks NV12 <-> RGBA against the formulas.
+
+// Run it like this:
+//
+// sw_color_converter_bench -n 30 -j 4
+
+using namespace android;
+
+struct Size {
+    const char *name;
+    size_t width;
+    size_t height;
+};
+
+struct Conversion {
+    const char *name;
+    ColorConvertFormat src;
+    ColorConvertFormat dst;
+};
+
+static const Size kSizes[] = {
+    { "1080p", 1920, 1080 },
+    { "4K", 3840, 2160 },
+};
+
+static const Conversion kConversions[] = {
+    { "NV12 -> RGBA8888", YCbCr420SP, RGBA8888 },
+    { "NV21 -> RGBA8888", YCrCb420SP, RGBA8888 },
+    { "YV12 -> RGBA8888", YCrCb420P, RGBA8888 },
+    { "NV12_128m -> RGBA8888", NV12_128m, RGBA8888 },
+    { "NV12 -> RGB565", YCbCr420SP, RGB565 },
+    { "RGBA8888 -> NV12", RGBA8888, YCbCr420SP },
+    { "RGBA8888 -> NV21", RGBA8888, YCrCb420SP },
+    { "RGBA8888 -> I420", RGBA8888, YCbCr420P },
+    { "RGB565 -> NV12", RGB565, YCbCr420SP },
+};
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-n <frames>] [-j <threads>]\n", me);
+    fprintf(stderr, "       -n frames converted for each measurement, default 30\n");
+    fprintf(stderr, "       -j threads, default one per cpu\n");
+    exit(1);
+}
+
+static uint8_t *allocBuffer(SWColorConverter *converter, int32_t port, C2DBuffReq *req) {
+    if (converter->getBuffReq(port, req)) {
+        return NULL;
+    }
+    uint8_t *buf = (uint8_t *)malloc(req->size);
+    if (buf) {
+        memset(buf, 0x5a, req->size);
+    }
+    return buf;
+}
+
+static double timeConversion(SWColorConverter *converter, uint8_t *src, uint8_t *dst, int frames) {
+    int64_t startNs = nowNs();
+    for (int i = 0; i < frames; i++) {
+        if (converter->convertC2D(-1, src, src, -1, dst, dst)) {
+            fprintf(stderr, "conversion failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return (nowNs() - startNs) / 1E6 / frames;
+}
+
+static uint8_t clip(int32_t x) {
+    return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+// Checks every 97th pixel of an NV12 -> RGBA8888 or RGBA8888 -> NV12 conversion.
+static bool spotCheck(const Conversion &c, size_t width, size_t height, const C2DBuffReq &srcReq,
+        const uint8_t *src, const C2DBuffReq &dstReq, const uint8_t *dst) {
+    for (size_t i = 0; i < width * height; i += 97) {
+        size_t x = i % width, y = i / width;
+        if (c.src == YCbCr420SP && c.dst == RGBA8888) {
+            const uint8_t *uv = src + srcReq.stride * height + srcReq.stride * (y / 2) + x / 2 * 2;
+            int32_t y1 = 298 * (src[srcReq.stride * y + x] - 16);
+            int32_t u = uv[0] - 128, v = uv[1] - 128;
+            const uint8_t *px = dst + dstReq.stride * y + x * 4;
+            if (px[0] != clip((y1 + 409 * v) / 256) ||
+                    px[1] != clip((y1 - 100 * u - 208 * v) / 256) ||
+                    px[2] != clip((y1 + 517 * u) / 256) || px[3] != 0xff) {
+                fprintf(stderr, "  pixel %zu,%zu is wrong\n", x, y);
+                return false;
+            }
+        } else if (c.src == RGBA8888 && c.dst == YCbCr420SP) {
+            const uint8_t *px = src + srcReq.stride * y + x * 4;
+            unsigned r = px[0], g = px[1], b = px[2];
+            if (dst[dstReq.stride * y + x] != ((r * 66 + g * 129 + b * 25) >> 8) + 16) {
+                fprintf(stderr, "  luma %zu,%zu is wrong\n", x, y);
+                return false;
+            }
+            if (!(x & 1) && !(y & 1)) {
+                const uint8_t *uv = dst + dstReq.stride * height + dstReq.stride * (y / 2) + x;
+                if (uv[0] != (uint8_t)(((-r * 38 - g * 74 + b * 112) >> 8) + 128) ||
+                        uv[1] != (uint8_t)(((r * 112 - g * 94 - b * 18) >> 8) + 128)) {
+                    fprintf(stderr, "  chroma %zu,%zu is wrong\n", x, y);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    int frames = 30;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int res;
+    while ((res = getopt(argc, argv, "n:j:")) >= 0) {
+        switch (res) {
+            case 'n': frames = atoi(optarg); break;
+            case 'j': threads = atol(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (frames < 1 || threads < 1) {
+        usage(me);
+    }
+
+    bool ok = true;
+    for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); s++) {
+        const Size &size = kSizes[s];
+        printf("%s, %zux%zu, ms per frame: C / SIMD / SIMD on %ld threads\n", size.name,
+                size.width, size.height, threads);
+
+        for (size_t i = 0; i < sizeof(kConversions) / sizeof(kConversions[0]); i++) {
+            const Conversion &c = kConversions[i];
+            SWColorConverter converter(size.width, size.height, size.width, size.height,
+                    c.src, c.dst, 0, 0);
+            C2DBuffReq srcReq, dstReq;
+            uint8_t *src = allocBuffer(&converter, C2D_INPUT, &srcReq);
+            uint8_t *dst = allocBuffer(&converter, C2D_OUTPUT, &dstReq);
+            uint8_t *ref = allocBuffer(&converter, C2D_OUTPUT, &dstReq);
+            if (!src || !dst || !ref) {
+                fprintf(stderr, "no memory\n");
+                return EXIT_FAILURE;
+            }
+            uint32_t seed = 1;
+            for (int32_t j = 0; j < srcReq.size; j++) {
+                seed = seed * 1103515245 + 12345;
+                src[j] = seed >> 24;
+            }
+
+            converter.setUseSIMD(false);
+            converter.setNumThreads(1);
+            double cMs = timeConversion(&converter, src, ref, frames);
+            converter.setUseSIMD(true);
+            double simdMs = timeConversion(&converter, src, dst, frames);
+            bool same = !memcmp(ref, dst, dstReq.size);
+            memset(dst, 0x5a, dstReq.size);
+            converter.setNumThreads(threads);
+            double threadsMs = timeConversion(&converter, src, dst, frames);
+            same = same && !memcmp(ref, dst, dstReq.size);
+
+            printf("  %-22s %7.2f / %6.2f / %6.2f  %s\n", c.name, cMs, simdMs, threadsMs,
+                    same ? "" : "MISMATCH");
+            ok = ok && same && spotCheck(c, size.width, size.height, srcReq, src, dstReq, dst);
+
+            free(ref);
+            free(dst);
+            free(src);
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
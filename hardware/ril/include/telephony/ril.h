@@ -5291,6 +5291,20 @@ struct RIL_Env {
 };
 
 
+/**
+ * RIL implementations may export
+ *
+ *     const int RIL_DispatchPerSocket = 1;
+ *
+ * to have requests of each SIM's command socket passed to RIL_RequestFunc by
+ * a thread of their own, so that a request blocking for one SIM does not
+ * hold up the others. Requests of one socket are still passed one at a time,
+ * in order, but RIL_RequestFunc is then called from several threads, at the
+ * same time for different sockets, and RIL_requestTimedCallback callbacks
+ * run on none of them. Without it, RIL_RequestFunc and the callbacks are all
+ * called from the same thread.
+ */
+
 /**
  *  RIL implementations must defined RIL_Init
  *  argc and argv will be command line arguments intended for the RIL implementation
@@ -5312,6 +5326,14 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
  */
 void RIL_register (const RIL_RadioFunctions *callbacks);
 
+/**
+ * Call this before RIL_register to have requests of each command socket
+ * dispatched by a thread of their own, see RIL_DispatchPerSocket
+ *
+ * @param enable non-zero to dispatch per socket
+ */
+void RIL_setDispatchPerSocket (int enable);
+
 
 /**
  *
@@ -143,8 +143,50 @@ typedef struct RequestInfo {
     char cancelled;
     char local;         // responses to local commands do not go back to command process
     RIL_SOCKET_ID socket_id;
+    int64_t receivedNs; // elapsedRealtimeNano() when the command was read from the socket
 } RequestInfo;
 
+/* A command read from a command socket, waiting for its socket's dispatch thread */
+typedef struct CommandRecord {
+    struct CommandRecord *p_next;
+    size_t buflen;
+    uint32_t generation;
+    int64_t receivedNs;
+    uint8_t buffer[];
+} CommandRecord;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t unsolicited;
+    size_t maxQueueDepth;
+    int64_t totalQueueNs;   // from reading the command to calling onRequest
+    int64_t maxQueueNs;
+    int64_t totalLatencyNs; // from reading the command to RIL_onRequestComplete
+    int64_t maxLatencyNs;
+} DispatchStats;
+
+/*
+ * Commands are dispatched to the vendor RIL from the event loop thread, as RIL_RequestFunc
+ * and RIL_requestTimedCallback are documented to run on the same thread. A vendor RIL that
+ * exports RIL_DispatchPerSocket instead has them dispatched by one thread per command
+ * socket, so that a request blocking in onRequest for one SIM neither holds up the other
+ * SIMs nor the event loop. Requests of a given socket are still dispatched one at a time,
+ * in order. The queue is only used in that mode; the stats are kept in both.
+ */
+typedef struct {
+    RIL_SOCKET_ID socket_id;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    CommandRecord *head;
+    CommandRecord *tail;
+    size_t depth;
+    /* Incremented when the command socket closes, with the pending requests mutex of the
+     * socket held: commands read from a previous connection are cancelled. */
+    uint32_t generation;
+    DispatchStats stats;
+} DispatchQueue;
+
 typedef struct UserCallbackInfo {
     RIL_TimedCallback p_callback;
     void *userParam;
@@ -224,11 +266,8 @@ static const struct timeval TIMEVAL_WAKE_TIMEOUT = {ANDROID_WAKE_LOCK_SECS,ANDRO
 static pthread_mutex_t s_startupMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t s_startupCond = PTHREAD_COND_INITIALIZER;
 
-static pthread_mutex_t s_dispatchMutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t s_dispatchCond = PTHREAD_COND_INITIALIZER;
-
-static RequestInfo *s_toDispatchHead = NULL;
-static RequestInfo *s_toDispatchTail = NULL;
+static DispatchQueue s_dispatchQueues[SIM_COUNT];
+static int s_dispatchPerSocket = 0;
 
 static UserCallbackInfo *s_last_wake_timeout_info = NULL;
 
@@ -452,6 +491,7 @@ issueLocalRequest(int request, void *data, int len, RIL_SOCKET_ID socket_id) {
     pRI->token = 0xffffffff;        // token is not used in this context
     pRI->pCI = &(s_commands[request]);
     pRI->socket_id = socket_id;
+    pRI->receivedNs = elapsedRealtimeNano();
 
     ret = pthread_mutex_lock(pendingRequestsMutexHook);
     assert (ret == 0);
@@ -470,7 +510,8 @@ issueLocalRequest(int request, void *data, int len, RIL_SOCKET_ID socket_id) {
 
 
 static int
-processCommandBuffer(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
+processCommandBuffer(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id,
+        uint32_t generation, int64_t receivedNs) {
     Parcel p;
     status_t status;
     int32_t request;
@@ -531,10 +572,16 @@ processCommandBuffer(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
     pRI->token = token;
     pRI->pCI = &(s_commands[request]);
     pRI->socket_id = socket_id;
+    pRI->receivedNs = receivedNs;
 
     ret = pthread_mutex_lock(pendingRequestsMutexHook);
     assert (ret == 0);
 
+    /* the socket this came from was closed while the command was queued */
+    if (generation != s_dispatchQueues[socket_id].generation) {
+        pRI->cancelled = 1;
+    }
+
     pRI->p_next = *pendingRequestsHook;
     *pendingRequestsHook = pRI;
 
@@ -548,6 +595,139 @@ processCommandBuffer(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
     return 0;
 }
 
+static void *
+dispatchLoop(void *param) {
+    DispatchQueue *q = (DispatchQueue *)param;
+
+    for (;;) {
+        pthread_mutex_lock(&q->mutex);
+        while (q->head == NULL) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        }
+        CommandRecord *p_record = q->head;
+        q->head = p_record->p_next;
+        if (q->head == NULL) {
+            q->tail = NULL;
+        }
+        q->depth--;
+
+        int64_t queuedNs = elapsedRealtimeNano() - p_record->receivedNs;
+        q->stats.requests++;
+        q->stats.totalQueueNs += queuedNs;
+        if (queuedNs > q->stats.maxQueueNs) {
+            q->stats.maxQueueNs = queuedNs;
+        }
+        pthread_mutex_unlock(&q->mutex);
+
+        processCommandBuffer(p_record->buffer, p_record->buflen, q->socket_id,
+                p_record->generation, p_record->receivedNs);
+        free(p_record);
+    }
+    return NULL;
+}
+
+/**
+ * To be called from the event loop thread
+ * Dispatch a command read from a command socket right away, on this thread
+ */
+static void
+dispatchCommand(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
+    DispatchQueue *q = &s_dispatchQueues[socket_id];
+
+    pthread_mutex_lock(&q->mutex);
+    q->stats.requests++;
+    pthread_mutex_unlock(&q->mutex);
+
+    /* the generation only changes on this thread, see onCommandsSocketClosed() */
+    processCommandBuffer(buffer, buflen, socket_id, q->generation, elapsedRealtimeNano());
+}
+
+/**
+ * To be called from the event loop thread
+ * Copy a command read from a command socket to the dispatch queue of the socket,
+ * when commands are dispatched per socket
+ */
+static void
+enqueueCommand(void *buffer, size_t buflen, RIL_SOCKET_ID socket_id) {
+    DispatchQueue *q = &s_dispatchQueues[socket_id];
+    CommandRecord *p_record = (CommandRecord *)malloc(sizeof(CommandRecord) + buflen);
+
+    if (p_record == NULL) {
+        RLOGE("out of memory queueing command for %s", rilSocketIdToString(socket_id));
+        return;
+    }
+    p_record->p_next = NULL;
+    p_record->buflen = buflen;
+    p_record->receivedNs = elapsedRealtimeNano();
+    memcpy(p_record->buffer, buffer, buflen);
+
+    pthread_mutex_lock(&q->mutex);
+    /* only changed on this thread, see onCommandsSocketClosed() */
+    p_record->generation = q->generation;
+    if (q->tail == NULL) {
+        q->head = p_record;
+    } else {
+        q->tail->p_next = p_record;
+    }
+    q->tail = p_record;
+    q->depth++;
+    if (q->depth > q->stats.maxQueueDepth) {
+        q->stats.maxQueueDepth = q->depth;
+    }
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static void
+startDispatchQueues() {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (int i = 0; i < SIM_COUNT; i++) {
+        DispatchQueue *q = &s_dispatchQueues[i];
+        pthread_t tid;
+
+        q->socket_id = (RIL_SOCKET_ID)i;
+        pthread_mutex_init(&q->mutex, NULL);
+        pthread_cond_init(&q->cond, NULL);
+
+        if (!s_dispatchPerSocket) {
+            continue;
+        }
+
+        int result = pthread_create(&tid, &attr, dispatchLoop, q);
+        if (result != 0) {
+            RLOGE("Failed to create dispatch thread for %s: %s",
+                    rilSocketIdToString(q->socket_id), strerror(result));
+            exit(-1);
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static void
+dumpDispatchStats() {
+    for (int i = 0; i < SIM_COUNT; i++) {
+        DispatchQueue *q = &s_dispatchQueues[i];
+        DispatchStats stats;
+
+        pthread_mutex_lock(&q->mutex);
+        stats = q->stats;
+        pthread_mutex_unlock(&q->mutex);
+
+        RLOGI("%s: %u requests, %u responses, %u unsolicited, max queue depth %zu",
+                rilSocketIdToString(q->socket_id), stats.requests, stats.responses,
+                stats.unsolicited, stats.maxQueueDepth);
+        RLOGI("%s: queued avg %lld us max %lld us, latency avg %lld us max %lld us",
+                rilSocketIdToString(q->socket_id),
+                stats.requests ? (long long)(stats.totalQueueNs / stats.requests / 1000) : 0,
+                (long long)(stats.maxQueueNs / 1000),
+                stats.responses ? (long long)(stats.totalLatencyNs / stats.responses / 1000) : 0,
+                (long long)(stats.maxLatencyNs / 1000));
+    }
+}
+
 static void
 invalidCommandBlock (RequestInfo *pRI) {
     RLOGE("invalid command block for token %d request %s",
@@ -3770,10 +3950,25 @@ static void onCommandsSocketClosed(RIL_SOCKET_ID socket_id) {
     }
 #endif
 #endif
+    /* drop the commands not dispatched yet, they came from the closed connection */
+    DispatchQueue *q = &s_dispatchQueues[socket_id];
+    pthread_mutex_lock(&q->mutex);
+    while (q->head != NULL) {
+        CommandRecord *p_record = q->head;
+        q->head = p_record->p_next;
+        free(p_record);
+    }
+    q->tail = NULL;
+    q->depth = 0;
+    pthread_mutex_unlock(&q->mutex);
+
     /* mark pending requests as "cancelled" so we dont report responses */
     ret = pthread_mutex_lock(pendingRequestsMutexHook);
     assert (ret == 0);
 
+    /* and the command being dispatched, if any */
+    q->generation++;
+
     p_cur = *pendingRequestsHook;
 
     for (p_cur = *pendingRequestsHook
@@ -3808,7 +4003,11 @@ static void processCommandsCallback(int fd, short flags, void *param) {
         } else if (ret < 0) {
             break;
         } else if (ret == 0) { /* && p_record != NULL */
-            processCommandBuffer(p_record, recordlen, p_info->socket_id);
+            if (s_dispatchPerSocket) {
+                enqueueCommand(p_record, recordlen, p_info->socket_id);
+            } else {
+                dispatchCommand(p_record, recordlen, p_info->socket_id);
+            }
         }
     }
 
@@ -4160,6 +4359,10 @@ static void debugCallback (int fd, short flags, void *param) {
             issueLocalRequest(RIL_REQUEST_HANGUP, &hangupData,
                               sizeof(hangupData), socket_id);
             break;
+        case 11:
+            RLOGI("Debug port: Dispatch statistics");
+            dumpDispatchStats();
+            break;
         default:
             RLOGE ("Invalid request");
             break;
@@ -4250,6 +4453,11 @@ done:
     pthread_mutex_unlock(&s_startupMutex);
 }
 
+extern "C" void
+RIL_setDispatchPerSocket(int enable) {
+    s_dispatchPerSocket = enable;
+}
+
 // Used for testing purpose only.
 extern "C" void RIL_setcallbacks (const RIL_RadioFunctions *callbacks) {
     memcpy(&s_callbacks, callbacks, sizeof (RIL_RadioFunctions));
@@ -4414,6 +4622,8 @@ RIL_register (const RIL_RadioFunctions *callbacks) {
         RIL_startEventLoop();
     }
 
+    startDispatchQueues();
+
     // start listen socket1
     startListen(RIL_SOCKET_1, &s_ril_param_socket);
 
@@ -4589,6 +4799,19 @@ RIL_onRequestComplete(RIL_Token t, RIL_Errno e, void *response, size_t responsel
         goto done;
     }
 
+    {
+        DispatchQueue *q = &s_dispatchQueues[socket_id];
+        int64_t latencyNs = elapsedRealtimeNano() - pRI->receivedNs;
+
+        pthread_mutex_lock(&q->mutex);
+        q->stats.responses++;
+        q->stats.totalLatencyNs += latencyNs;
+        if (latencyNs > q->stats.maxLatencyNs) {
+            q->stats.maxLatencyNs = latencyNs;
+        }
+        pthread_mutex_unlock(&q->mutex);
+    }
+
     appendPrintBuf("[%04d]< %s",
         pRI->token, requestToString(pRI->pCI->requestNumber));
 
@@ -4803,6 +5026,12 @@ void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
         return;
     }
 
+    if (soc_id < SIM_COUNT) {
+        pthread_mutex_lock(&s_dispatchQueues[soc_id].mutex);
+        s_dispatchQueues[soc_id].stats.unsolicited++;
+        pthread_mutex_unlock(&s_dispatchQueues[soc_id].mutex);
+    }
+
     // Grab a wake lock if needed for this reponse,
     // as we exit we'll either release it immediately
     // or set a timer to release it later.
@@ -21,9 +21,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <utils/Log.h>
 #include <ril_event.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -65,11 +67,17 @@ static pthread_mutex_t listMutex;
     } while(0);
 #endif
 
-static fd_set readFds;
-static int nfds = 0;
+static int epollFd = -1;
+
+// Watched events, indexed by fd.  Grown as needed.
+static struct ril_event ** watch_table = NULL;
+static int watch_table_size = 0;
+
+// Timers, as a binary min-heap on timeout: the next timer to fire is timer_heap[0].
+static struct ril_event ** timer_heap = NULL;
+static int timer_count = 0;
+static int timer_heap_size = 0;
 
-static struct ril_event * watch_table[MAX_FD_EVENTS];
-static struct ril_event timer_list;
 static struct ril_event pending_list;
 
 #define DEBUG 0
@@ -130,6 +138,27 @@ static void removeFromList(struct ril_event * ev)
     dlog("~~~~ -removeFromList ~~~~");
 }
 
+// Grow an array of event pointers to hold at least minSize entries, zeroing the new ones.
+static bool growTable(struct ril_event *** table, int * size, int minSize)
+{
+    if (minSize <= *size) {
+        return true;
+    }
+    int newSize = *size > 0 ? *size * 2 : 8;
+    while (newSize < minSize) {
+        newSize *= 2;
+    }
+    struct ril_event ** newTable =
+            (struct ril_event **)realloc(*table, newSize * sizeof(struct ril_event *));
+    if (newTable == NULL) {
+        RLOGE("ril_event: out of memory growing table to %d", newSize);
+        return false;
+    }
+    memset(newTable + *size, 0, (newSize - *size) * sizeof(struct ril_event *));
+    *table = newTable;
+    *size = newSize;
+    return true;
+}
 
 static void removeWatch(struct ril_event * ev, int index)
 {
@@ -137,22 +166,65 @@ static void removeWatch(struct ril_event * ev, int index)
     watch_table[index] = NULL;
     ev->index = -1;
 
-    FD_CLR(ev->fd, &readFds);
+    // The fd may already be closed, in which case epoll dropped it by itself.
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, ev->fd, NULL);
+    dlog("~~~~ -removeWatch ~~~~");
+}
 
-    if (ev->fd+1 == nfds) {
-        int n = 0;
+static void heapSet(int i, struct ril_event * ev)
+{
+    timer_heap[i] = ev;
+    ev->index = i;
+}
 
-        for (int i = 0; i < MAX_FD_EVENTS; i++) {
-            struct ril_event * rev = watch_table[i];
+static void heapSiftUp(int i)
+{
+    struct ril_event * ev = timer_heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timercmp(&ev->timeout, &timer_heap[parent]->timeout, <)) {
+            break;
+        }
+        heapSet(i, timer_heap[parent]);
+        i = parent;
+    }
+    heapSet(i, ev);
+}
 
-            if ((rev != NULL) && (rev->fd > n)) {
-                n = rev->fd;
-            }
+static void heapSiftDown(int i)
+{
+    struct ril_event * ev = timer_heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= timer_count) {
+            break;
         }
-        nfds = n + 1;
-        dlog("~~~~ nfds = %d ~~~~", nfds);
+        if (child + 1 < timer_count
+                && timercmp(&timer_heap[child + 1]->timeout, &timer_heap[child]->timeout, <)) {
+            child++;
+        }
+        if (!timercmp(&timer_heap[child]->timeout, &ev->timeout, <)) {
+            break;
+        }
+        heapSet(i, timer_heap[child]);
+        i = child;
     }
-    dlog("~~~~ -removeWatch ~~~~");
+    heapSet(i, ev);
+}
+
+static void heapRemove(int i)
+{
+    struct ril_event * ev = timer_heap[i];
+    ev->index = -1;
+    timer_count--;
+    if (i < timer_count) {
+        // Move the last timer into the hole, then restore the heap order around it.
+        struct ril_event * last = timer_heap[timer_count];
+        heapSet(i, last);
+        heapSiftUp(i);
+        heapSiftDown(last->index);
+    }
+    timer_heap[timer_count] = NULL;
 }
 
 static void processTimeouts()
@@ -160,38 +232,37 @@ static void processTimeouts()
     dlog("~~~~ +processTimeouts ~~~~");
     MUTEX_ACQUIRE();
     struct timeval now;
-    struct ril_event * tev = timer_list.next;
-    struct ril_event * next;
 
     getNow(&now);
-    // walk list, see if now >= ev->timeout for any events
+    // pop timers while now >= ev->timeout
 
     dlog("~~~~ Looking for timers <= %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
-    while ((tev != &timer_list) && (timercmp(&now, &tev->timeout, >))) {
+    while ((timer_count > 0) && !timercmp(&now, &timer_heap[0]->timeout, <)) {
         // Timer expired
         dlog("~~~~ firing timer ~~~~");
-        next = tev->next;
-        removeFromList(tev);
+        struct ril_event * tev = timer_heap[0];
+        heapRemove(0);
         addToList(tev, &pending_list);
-        tev = next;
     }
     MUTEX_RELEASE();
     dlog("~~~~ -processTimeouts ~~~~");
 }
 
-static void processReadReadies(fd_set * rfds, int n)
+static void processReadReadies(struct epoll_event * events, int n)
 {
     dlog("~~~~ +processReadReadies (%d) ~~~~", n);
     MUTEX_ACQUIRE();
 
-    for (int i = 0; (i < MAX_FD_EVENTS) && (n > 0); i++) {
-        struct ril_event * rev = watch_table[i];
-        if (rev != NULL && FD_ISSET(rev->fd, rfds)) {
+    for (int i = 0; i < n; i++) {
+        // Look the event up by fd rather than keeping a pointer in the epoll data, so that an
+        // event removed since epoll_wait() returned is not fired.
+        int fd = events[i].data.fd;
+        struct ril_event * rev = (fd < watch_table_size) ? watch_table[fd] : NULL;
+        if (rev != NULL) {
             addToList(rev, &pending_list);
             if (rev->persist == false) {
-                removeWatch(rev, i);
+                removeWatch(rev, fd);
             }
-            n--;
         }
     }
 
@@ -212,29 +283,37 @@ static void firePending()
     dlog("~~~~ -firePending ~~~~");
 }
 
-static int calcNextTimeout(struct timeval * tv)
+// Returns the epoll_wait() timeout until the next timer fires, in ms, or -1 if there is none.
+static int calcNextTimeout()
 {
-    struct ril_event * tev = timer_list.next;
     struct timeval now;
+    struct timeval tv;
 
-    getNow(&now);
-
-    // Sorted list, so calc based on first node
-    if (tev == &timer_list) {
+    MUTEX_ACQUIRE();
+    if (timer_count == 0) {
         // no pending timers
+        MUTEX_RELEASE();
         return -1;
     }
 
+    getNow(&now);
+    struct ril_event * tev = timer_heap[0];
     dlog("~~~~ now = %ds + %dus ~~~~", (int)now.tv_sec, (int)now.tv_usec);
     dlog("~~~~ next = %ds + %dus ~~~~",
             (int)tev->timeout.tv_sec, (int)tev->timeout.tv_usec);
     if (timercmp(&tev->timeout, &now, >)) {
-        timersub(&tev->timeout, &now, tv);
+        timersub(&tev->timeout, &now, &tv);
     } else {
         // timer already expired.
-        tv->tv_sec = tv->tv_usec = 0;
+        tv.tv_sec = tv.tv_usec = 0;
+    }
+    MUTEX_RELEASE();
+
+    // Round up, so that the timer has expired when epoll_wait() returns.
+    if (tv.tv_sec >= INT_MAX / 1000 - 1) {
+        return INT_MAX;
     }
-    return 0;
+    return tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000;
 }
 
 // Initialize internal data structs
@@ -242,10 +321,18 @@ void ril_event_init()
 {
     MUTEX_INIT();
 
-    FD_ZERO(&readFds);
-    init_list(&timer_list);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        RLOGE("ril_event: epoll_create1 error (%d)", errno);
+    }
     init_list(&pending_list);
-    memset(watch_table, 0, sizeof(watch_table));
+    free(watch_table);
+    watch_table = NULL;
+    watch_table_size = 0;
+    free(timer_heap);
+    timer_heap = NULL;
+    timer_count = 0;
+    timer_heap_size = 0;
 }
 
 // Initialize an event
@@ -266,17 +353,28 @@ void ril_event_add(struct ril_event * ev)
 {
     dlog("~~~~ +ril_event_add ~~~~");
     MUTEX_ACQUIRE();
-    for (int i = 0; i < MAX_FD_EVENTS; i++) {
-        if (watch_table[i] == NULL) {
-            watch_table[i] = ev;
-            ev->index = i;
-            dlog("~~~~ added at %d ~~~~", i);
-            dump_event(ev);
-            FD_SET(ev->fd, &readFds);
-            if (ev->fd >= nfds) nfds = ev->fd+1;
-            dlog("~~~~ nfds = %d ~~~~", nfds);
-            break;
-        }
+    if (ev->fd < 0 || !growTable(&watch_table, &watch_table_size, ev->fd + 1)) {
+        MUTEX_RELEASE();
+        return;
+    }
+    if (watch_table[ev->fd] != NULL) {
+        RLOGE("ril_event: fd %d is already watched", ev->fd);
+        MUTEX_RELEASE();
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = ev->fd;
+    // Takes effect immediately, even while the loop is blocked in epoll_wait().
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, ev->fd, &event) < 0) {
+        RLOGE("ril_event: epoll_ctl error (%d) adding fd %d", errno, ev->fd);
+    } else {
+        watch_table[ev->fd] = ev;
+        ev->index = ev->fd;
+        dlog("~~~~ added fd %d ~~~~", ev->fd);
+        dump_event(ev);
     }
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_add ~~~~");
@@ -288,88 +386,64 @@ void ril_timer_add(struct ril_event * ev, struct timeval * tv)
     dlog("~~~~ +ril_timer_add ~~~~");
     MUTEX_ACQUIRE();
 
-    struct ril_event * list;
-    if (tv != NULL) {
-        // add to timer list
-        list = timer_list.next;
+    if (tv != NULL && growTable(&timer_heap, &timer_heap_size, timer_count + 1)) {
+        // add to timer heap
         ev->fd = -1; // make sure fd is invalid
 
         struct timeval now;
         getNow(&now);
         timeradd(&now, tv, &ev->timeout);
 
-        // keep list sorted
-        while (timercmp(&list->timeout, &ev->timeout, < )
-                && (list != &timer_list)) {
-            list = list->next;
-        }
-        // list now points to the first event older than ev
-        addToList(ev, list);
+        heapSet(timer_count, ev);
+        timer_count++;
+        heapSiftUp(timer_count - 1);
+        dump_event(ev);
     }
 
     MUTEX_RELEASE();
     dlog("~~~~ -ril_timer_add ~~~~");
 }
 
-// Remove event from watch or timer list
+// Remove event from watch list or timer heap
 void ril_event_del(struct ril_event * ev)
 {
     dlog("~~~~ +ril_event_del ~~~~");
     MUTEX_ACQUIRE();
 
-    if (ev->index < 0 || ev->index >= MAX_FD_EVENTS) {
-        MUTEX_RELEASE();
-        return;
+    if (ev->fd < 0) {
+        if (ev->index >= 0 && ev->index < timer_count && timer_heap[ev->index] == ev) {
+            heapRemove(ev->index);
+        }
+    } else if (ev->index >= 0 && ev->index < watch_table_size
+            && watch_table[ev->index] == ev) {
+        removeWatch(ev, ev->index);
     }
 
-    removeWatch(ev, ev->index);
-
     MUTEX_RELEASE();
     dlog("~~~~ -ril_event_del ~~~~");
 }
 
-#if DEBUG
-static void printReadies(fd_set * rfds)
-{
-    for (int i = 0; (i < MAX_FD_EVENTS); i++) {
-        struct ril_event * rev = watch_table[i];
-        if (rev != NULL && FD_ISSET(rev->fd, rfds)) {
-          dlog("DON: fd=%d is ready", rev->fd);
-        }
-    }
-}
-#else
-#define printReadies(rfds) do {} while(0)
-#endif
-
 void ril_event_loop()
 {
     int n;
-    fd_set rfds;
-    struct timeval tv;
-    struct timeval * ptv;
-
+    int timeout;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
 
     for (;;) {
 
-        // make local copy of read fd_set
-        memcpy(&rfds, &readFds, sizeof(fd_set));
-        if (-1 == calcNextTimeout(&tv)) {
+        timeout = calcNextTimeout();
+        if (timeout < 0) {
             // no pending timers; block indefinitely
             dlog("~~~~ no timers; blocking indefinitely ~~~~");
-            ptv = NULL;
         } else {
-            dlog("~~~~ blocking for %ds + %dus ~~~~", (int)tv.tv_sec, (int)tv.tv_usec);
-            ptv = &tv;
+            dlog("~~~~ blocking for %dms ~~~~", timeout);
         }
-        printReadies(&rfds);
-        n = select(nfds, &rfds, NULL, NULL, ptv);
-        printReadies(&rfds);
+        n = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeout);
         dlog("~~~~ %d events fired ~~~~", n);
         if (n < 0) {
             if (errno == EINTR) continue;
 
-            RLOGE("ril_event: select error (%d)", errno);
+            RLOGE("ril_event: epoll_wait error (%d)", errno);
             // bail?
             return;
         }
@@ -377,7 +451,7 @@ void ril_event_loop()
         // Check for timeouts
         processTimeouts();
         // Check for read-ready
-        processReadReadies(&rfds, n);
+        processReadReadies(events, n);
         // Fire away
         firePending();
     }
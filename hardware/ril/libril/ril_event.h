@@ -15,8 +15,9 @@
 ** limitations under the License.
 */
 
-// Max number of fd's we watch at any one time.  Increase if necessary.
-#define MAX_FD_EVENTS 8
+// Max number of ready fd's handled per wakeup of the event loop.  Fd's left over
+// are reported again on the next wakeup.
+#define MAX_EPOLL_EVENTS 16
 
 typedef void (*ril_event_cb)(int fd, short events, void *userdata);
 
@@ -25,7 +26,7 @@ struct ril_event {
     struct ril_event *prev;
 
     int fd;
-    int index;
+    int index;      // position in the watch table (fd events) or timer heap (timers), or -1
     bool persist;
     struct timeval timeout;
     ril_event_cb func;
@@ -44,7 +45,7 @@ void ril_event_add(struct ril_event * ev);
 // Add timer event
 void ril_timer_add(struct ril_event * ev, struct timeval * tv);
 
-// Remove event from watch list
+// Remove event from watch list, or cancel a timer that hasn't fired yet
 void ril_event_del(struct ril_event * ev);
 
 // Event loop
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <ril_event.h>
+
+// ril_event keeps its state in globals and its loop never returns: each test runs the loop in a
+// forked child, and the child's exit status is the result.
+
+namespace tests {
+
+static const int kTimerCount = 1000;
+static const int kFdCount = 64;
+
+static struct ril_event s_timers[kTimerCount];
+static std::vector<int> s_fired;
+static struct ril_event s_fdEvents[kFdCount];
+static int s_pipes[kFdCount][2];
+static int s_reads;
+
+static void timerCallback(int, short, void *param) {
+    s_fired.push_back((int)(long)param);
+}
+
+static void readCallback(int fd, short, void *) {
+    char buf[16];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+        s_reads++;
+    }
+}
+
+static void checkTimersCallback(int, short, void *) {
+    // Timers fire in timeout order, whatever the order they were added in.
+    for (size_t i = 1; i < s_fired.size(); i++) {
+        if (timercmp(&s_timers[s_fired[i]].timeout, &s_timers[s_fired[i - 1]].timeout, <)) {
+            exit(1);
+        }
+    }
+    // All but the cancelled one.
+    exit(s_fired.size() == kTimerCount - 1
+            && std::find(s_fired.begin(), s_fired.end(), kTimerCount / 2) == s_fired.end()
+            ? 0 : 2);
+}
+
+static void checkReadsCallback(int, short, void *) {
+    exit(s_reads == kFdCount ? 0 : 1);
+}
+
+static int runInChild(void (*setup)()) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        ril_event_init();
+        setup();
+        ril_event_loop();
+        exit(3);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void setupTimers() {
+    std::vector<int> order;
+    for (int i = 0; i < kTimerCount; i++) {
+        order.push_back(i);
+    }
+    srand(1);
+    std::random_shuffle(order.begin(), order.end());
+
+    for (int i : order) {
+        struct timeval tv = {0, (i % 97) * 1000};
+        ril_event_set(&s_timers[i], -1, false, timerCallback, (void *)(long)i);
+        ril_timer_add(&s_timers[i], &tv);
+    }
+    ril_event_del(&s_timers[kTimerCount / 2]);
+
+    static struct ril_event check;
+    struct timeval tv = {0, 200000};
+    ril_event_set(&check, -1, false, checkTimersCallback, NULL);
+    ril_timer_add(&check, &tv);
+}
+
+static void setupFds() {
+    for (int i = 0; i < kFdCount; i++) {
+        ASSERT_EQ(0, pipe(s_pipes[i]));
+        ril_event_set(&s_fdEvents[i], s_pipes[i][0], true, readCallback, NULL);
+        ril_event_add(&s_fdEvents[i]);
+        ASSERT_EQ(1, write(s_pipes[i][1], "x", 1));
+    }
+
+    static struct ril_event check;
+    struct timeval tv = {0, 100000};
+    ril_event_set(&check, -1, false, checkReadsCallback, NULL);
+    ril_timer_add(&check, &tv);
+}
+
+TEST(RilEventTest, TimersFireInOrder) {
+    EXPECT_EQ(0, runInChild(setupTimers));
+}
+
+TEST(RilEventTest, WatchesManyFds) {
+    EXPECT_EQ(0, runInChild(setupFds));
+}
+
+}  // namespace tests
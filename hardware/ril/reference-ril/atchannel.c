@@ -46,14 +46,30 @@
 #define HANDSHAKE_RETRY_COUNT 8
 #define HANDSHAKE_TIMEOUT_MSEC 250
 
+/* most lines fit in the nodes they are kept in, longer ones are malloc()ed */
+#define INLINE_LINE_SIZE 112
+#define INLINE_FINAL_RESPONSE_SIZE 48
+#define MAX_FREE_LINES 32
+#define MAX_FREE_RESPONSES 8
+
 static pthread_t s_tid_reader;
 static int s_fd = -1;    /* fd of the AT channel */
 static ATUnsolHandler s_unsolHandler;
 
-/* for input buffering */
+/*
+ * for input buffering
+ *
+ * Lines are handed out in place, with a \0 over their \r. The data not yet
+ * returned is between s_ATBufferCur and s_ATBufferEnd, and it is only moved
+ * back to the start of the buffer when a partial line reaches the end.
+ * The search for the end of a partial line resumes at s_ATBufferScan, so
+ * every byte is looked at once however many reads the line takes.
+ */
 
 static char s_ATBuffer[MAX_AT_RESPONSE+1];
 static char *s_ATBufferCur = s_ATBuffer;
+static char *s_ATBufferEnd = s_ATBuffer;
+static char *s_ATBufferScan = s_ATBuffer;
 
 #if AT_DEBUG
 void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
@@ -64,18 +80,56 @@ void  AT_DUMP(const char*  prefix, const char*  buff, int  len)
 }
 #endif
 
+/* an ATLine and room for its text */
+typedef struct ATLineNode {
+    ATLine line;               /* must be first */
+    char storage[INLINE_LINE_SIZE];
+} ATLineNode;
+
+/* an ATResponse and room for its final response */
+typedef struct ATResponseNode {
+    ATResponse response;       /* must be first */
+    ATLine *p_lastIntermediate;
+    struct ATResponseNode *p_nextFree;
+    char finalStorage[INLINE_FINAL_RESPONSE_SIZE];
+} ATResponseNode;
+
 /*
- * for current pending command
+ * freed nodes, reused by the next commands
+ * these are protected by s_poolmutex, as responses are freed by the
+ * command issuers
+ */
+
+static pthread_mutex_t s_poolmutex = PTHREAD_MUTEX_INITIALIZER;
+static ATLine *sp_freeLines = NULL;
+static int s_freeLineCount;
+static ATResponseNode *sp_freeResponses = NULL;
+static int s_freeResponseCount;
+
+/** a command that was sent, waiting for its final response */
+typedef struct ATCommand {
+    struct ATCommand *p_next;
+    ATCommandType type;
+    const char *responsePrefix;
+    const char *smsPDU;
+    ATResponse *p_response;
+} ATCommand;
+
+/*
+ * for pending commands, in the order they were sent
  * these are protected by s_commandmutex
  */
 
 static pthread_mutex_t s_commandmutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t s_commandcond = PTHREAD_COND_INITIALIZER;
 
-static ATCommandType s_type;
-static const char *s_responsePrefix = NULL;
-static const char *s_smsPDU = NULL;
-static ATResponse *sp_response = NULL;
+static ATCommand *sp_pendingHead = NULL;
+static ATCommand *sp_pendingTail = NULL;
+static int s_pendingCount;
+static int s_pipelineDepth = 1;
+static int s_smsPending;        /* nothing else is sent until it completes */
+static int s_channelReserved;   /* by at_handshake() on s_tid_reserved */
+static pthread_t s_tid_reserved;
 
 static void (*s_onTimeout)(void) = NULL;
 static void (*s_onReaderClosed)(void) = NULL;
@@ -97,6 +151,13 @@ static void setTimespecRelative(struct timespec *p_ts, long long msec)
        a relative time again */
     p_ts->tv_sec = tv.tv_sec + (msec / 1000);
     p_ts->tv_nsec = (tv.tv_usec + (msec % 1000) * 1000L ) * 1000L;
+
+    /* pthread_cond_timedwait fails with EINVAL on an unnormalized time,
+       without waiting */
+    if (p_ts->tv_nsec >= 1000000000L) {
+        p_ts->tv_sec++;
+        p_ts->tv_nsec -= 1000000000L;
+    }
 }
 #endif /*USE_NP*/
 
@@ -114,21 +175,85 @@ static void sleepMsec(long long msec)
 }
 
 
+/** returns "line" in "storage" if it fits, or else in a malloc()ed copy */
+static char *copyLine(char *storage, size_t storageSize, const char *line)
+{
+    size_t len = strlen(line);
+    char *ret;
+
+    ret = len < storageSize ? storage : (char *) malloc(len + 1);
+    memcpy(ret, line, len + 1);
+
+    return ret;
+}
 
-/** add an intermediate response to sp_response*/
-static void addIntermediate(const char *line)
+static ATLine *newLine(const char *line)
 {
-    ATLine *p_new;
+    ATLineNode *p_node;
+
+    pthread_mutex_lock(&s_poolmutex);
+
+    p_node = (ATLineNode *) sp_freeLines;
+    if (p_node != NULL) {
+        sp_freeLines = p_node->line.p_next;
+        s_freeLineCount--;
+    }
+
+    pthread_mutex_unlock(&s_poolmutex);
 
-    p_new = (ATLine  *) malloc(sizeof(ATLine));
+    if (p_node == NULL) {
+        p_node = (ATLineNode *) malloc(sizeof(ATLineNode));
+    }
 
-    p_new->line = strdup(line);
+    p_node->line.p_next = NULL;
+    p_node->line.line = copyLine(p_node->storage, sizeof(p_node->storage), line);
 
-    /* note: this adds to the head of the list, so the list
-       will be in reverse order of lines received. the order is flipped
-       again before passing on to the command issuer */
-    p_new->p_next = sp_response->p_intermediates;
-    sp_response->p_intermediates = p_new;
+    return &p_node->line;
+}
+
+/** frees a list of lines */
+static void freeLines(ATLine *p_line)
+{
+    ATLine *p_toFree;
+
+    pthread_mutex_lock(&s_poolmutex);
+
+    while (p_line != NULL) {
+        ATLineNode *p_node = (ATLineNode *) p_line;
+
+        p_toFree = p_line;
+        p_line = p_line->p_next;
+
+        if (p_toFree->line != p_node->storage) {
+            free(p_toFree->line);
+        }
+
+        if (s_freeLineCount < MAX_FREE_LINES) {
+            p_toFree->p_next = sp_freeLines;
+            sp_freeLines = p_toFree;
+            s_freeLineCount++;
+        } else {
+            free(p_toFree);
+        }
+    }
+
+    pthread_mutex_unlock(&s_poolmutex);
+}
+
+/** add an intermediate response to the command's response */
+static void addIntermediate(ATResponse *p_response, const char *line)
+{
+    ATResponseNode *p_node = (ATResponseNode *) p_response;
+    ATLine *p_new;
+
+    p_new = newLine(line);
+
+    if (p_node->p_lastIntermediate == NULL) {
+        p_response->p_intermediates = p_new;
+    } else {
+        p_node->p_lastIntermediate->p_next = p_new;
+    }
+    p_node->p_lastIntermediate = p_new;
 }
 
 
@@ -214,12 +339,54 @@ static int isSMSUnsolicited(const char *line)
 }
 
 
+/** assumes s_commandmutex is held */
+static void appendPendingCommand(ATCommand *p_cmd)
+{
+    p_cmd->p_next = NULL;
+
+    if (sp_pendingTail == NULL) {
+        sp_pendingHead = p_cmd;
+    } else {
+        sp_pendingTail->p_next = p_cmd;
+    }
+    sp_pendingTail = p_cmd;
+    s_pendingCount++;
+}
+
+/** assumes s_commandmutex is held. Does nothing if p_cmd isn't pending */
+static void removePendingCommand(ATCommand *p_cmd)
+{
+    ATCommand **pp_cur;
+    ATCommand *p_prev = NULL;
+
+    for (pp_cur = &sp_pendingHead; *pp_cur != NULL; pp_cur = &(*pp_cur)->p_next) {
+        if (*pp_cur == p_cmd) {
+            *pp_cur = p_cmd->p_next;
+            if (sp_pendingTail == p_cmd) {
+                sp_pendingTail = p_prev;
+            }
+            s_pendingCount--;
+            p_cmd->p_next = NULL;
+            return;
+        }
+        p_prev = *pp_cur;
+    }
+}
+
 /** assumes s_commandmutex is held */
 static void handleFinalResponse(const char *line)
 {
-    sp_response->finalResponse = strdup(line);
+    ATCommand *p_cmd = sp_pendingHead;
+    ATResponseNode *p_node = (ATResponseNode *) p_cmd->p_response;
+
+    p_node->response.finalResponse = copyLine(p_node->finalStorage,
+                    sizeof(p_node->finalStorage), line);
+
+    /* the lines that follow are for the next command */
+    removePendingCommand(p_cmd);
+    s_smsPending = 0;
 
-    pthread_cond_signal(&s_commandcond);
+    pthread_cond_broadcast(&s_commandcond);
 }
 
 static void handleUnsolicited(const char *line)
@@ -231,31 +398,36 @@ static void handleUnsolicited(const char *line)
 
 static void processLine(const char *line)
 {
+    ATCommand *p_cmd;
+
     pthread_mutex_lock(&s_commandmutex);
 
-    if (sp_response == NULL) {
+    /* responses come back in the order the commands were sent */
+    p_cmd = sp_pendingHead;
+
+    if (p_cmd == NULL) {
         /* no command pending */
         handleUnsolicited(line);
     } else if (isFinalResponseSuccess(line)) {
-        sp_response->success = 1;
+        p_cmd->p_response->success = 1;
         handleFinalResponse(line);
     } else if (isFinalResponseError(line)) {
-        sp_response->success = 0;
+        p_cmd->p_response->success = 0;
         handleFinalResponse(line);
-    } else if (s_smsPDU != NULL && 0 == strcmp(line, "> ")) {
+    } else if (p_cmd->smsPDU != NULL && 0 == strcmp(line, "> ")) {
         // See eg. TS 27.005 4.3
         // Commands like AT+CMGS have a "> " prompt
-        writeCtrlZ(s_smsPDU);
-        s_smsPDU = NULL;
-    } else switch (s_type) {
+        writeCtrlZ(p_cmd->smsPDU);
+        p_cmd->smsPDU = NULL;
+    } else switch (p_cmd->type) {
         case NO_RESULT:
             handleUnsolicited(line);
             break;
         case NUMERIC:
-            if (sp_response->p_intermediates == NULL
+            if (p_cmd->p_response->p_intermediates == NULL
                 && isdigit(line[0])
             ) {
-                addIntermediate(line);
+                addIntermediate(p_cmd->p_response, line);
             } else {
                 /* either we already have an intermediate response or
                    the line doesn't begin with a digit */
@@ -263,25 +435,25 @@ static void processLine(const char *line)
             }
             break;
         case SINGLELINE:
-            if (sp_response->p_intermediates == NULL
-                && strStartsWith (line, s_responsePrefix)
+            if (p_cmd->p_response->p_intermediates == NULL
+                && strStartsWith (line, p_cmd->responsePrefix)
             ) {
-                addIntermediate(line);
+                addIntermediate(p_cmd->p_response, line);
             } else {
                 /* we already have an intermediate response */
                 handleUnsolicited(line);
             }
             break;
         case MULTILINE:
-            if (strStartsWith (line, s_responsePrefix)) {
-                addIntermediate(line);
+            if (strStartsWith (line, p_cmd->responsePrefix)) {
+                addIntermediate(p_cmd->p_response, line);
             } else {
                 handleUnsolicited(line);
             }
         break;
 
         default: /* this should never be reached */
-            RLOGE("Unsupported AT command type %d\n", s_type);
+            RLOGE("Unsupported AT command type %d\n", p_cmd->type);
             handleUnsolicited(line);
         break;
     }
@@ -291,22 +463,22 @@ static void processLine(const char *line)
 
 
 /**
- * Returns a pointer to the end of the next line
- * special-cases the "> " SMS prompt
+ * Returns a pointer to the end of the line starting at cur, looking from
+ * scan onwards. special-cases the "> " SMS prompt
  *
- * returns NULL if there is no complete line
+ * returns NULL if there is no complete line before end
  */
-static char * findNextEOL(char *cur)
+static char * findNextEOL(char *cur, char *scan, char *end)
 {
-    if (cur[0] == '>' && cur[1] == ' ' && cur[2] == '\0') {
+    if (cur[0] == '>' && cur[1] == ' ' && cur + 2 == end) {
         /* SMS prompt character...not \r terminated */
         return cur+2;
     }
 
     // Find next newline
-    while (*cur != '\0' && *cur != '\r' && *cur != '\n') cur++;
+    while (scan < end && *scan != '\r' && *scan != '\n') scan++;
 
-    return *cur == '\0' ? NULL : cur;
+    return scan == end ? NULL : scan;
 }
 
 
@@ -314,78 +486,64 @@ static char * findNextEOL(char *cur)
  * Reads a line from the AT channel, returns NULL on timeout.
  * Assumes it has exclusive read access to the FD
  *
- * This line is valid only until the next call to readline
+ * The line is returned in place, and is valid only until the next call
+ * to readline
  *
  * This function exists because as of writing, android libc does not
  * have buffered stdio.
  */
 
-static const char *readline()
+static char *readline()
 {
     ssize_t count;
 
-    char *p_read = NULL;
-    char *p_eol = NULL;
+    char *p_eol;
     char *ret;
 
-    /* this is a little odd. I use *s_ATBufferCur == 0 to
-     * mean "buffer consumed completely". If it points to a character, than
-     * the buffer continues until a \0
-     */
-    if (*s_ATBufferCur == '\0') {
-        /* empty buffer */
-        s_ATBufferCur = s_ATBuffer;
-        *s_ATBufferCur = '\0';
-        p_read = s_ATBuffer;
-    } else {   /* *s_ATBufferCur != '\0' */
-        /* there's data in the buffer from the last read */
-
+    for (;;) {
         // skip over leading newlines
-        while (*s_ATBufferCur == '\r' || *s_ATBufferCur == '\n')
+        while (s_ATBufferCur < s_ATBufferEnd
+                && (*s_ATBufferCur == '\r' || *s_ATBufferCur == '\n'))
             s_ATBufferCur++;
 
-        p_eol = findNextEOL(s_ATBufferCur);
-
-        if (p_eol == NULL) {
-            /* a partial line. move it up and prepare to read more */
-            size_t len;
+        if (s_ATBufferScan < s_ATBufferCur) {
+            s_ATBufferScan = s_ATBufferCur;
+        }
 
-            len = strlen(s_ATBufferCur);
+        p_eol = findNextEOL(s_ATBufferCur, s_ATBufferScan, s_ATBufferEnd);
 
-            memmove(s_ATBuffer, s_ATBufferCur, len + 1);
-            p_read = s_ATBuffer + len;
-            s_ATBufferCur = s_ATBuffer;
+        if (p_eol != NULL) {
+            break;
         }
-        /* Otherwise, (p_eol !- NULL) there is a complete line  */
-        /* that will be returned the while () loop below        */
-    }
 
-    while (p_eol == NULL) {
-        if (0 == MAX_AT_RESPONSE - (p_read - s_ATBuffer)) {
-            RLOGE("ERROR: Input line exceeded buffer\n");
-            /* ditch buffer and start over again */
+        /* no complete line, read more */
+        s_ATBufferScan = s_ATBufferEnd;
+
+        if (s_ATBufferCur == s_ATBufferEnd) {
+            /* buffer consumed completely, start over at the beginning */
+            s_ATBufferCur = s_ATBufferEnd = s_ATBufferScan = s_ATBuffer;
+        } else if (s_ATBufferEnd == s_ATBuffer + MAX_AT_RESPONSE) {
+            size_t len = s_ATBufferEnd - s_ATBufferCur;
+
+            if (s_ATBufferCur == s_ATBuffer) {
+                RLOGE("ERROR: Input line exceeded buffer\n");
+                /* ditch buffer and start over again */
+                len = 0;
+            } else {
+                /* a partial line at the end. move it up */
+                memmove(s_ATBuffer, s_ATBufferCur, len);
+            }
+
             s_ATBufferCur = s_ATBuffer;
-            *s_ATBufferCur = '\0';
-            p_read = s_ATBuffer;
+            s_ATBufferEnd = s_ATBufferScan = s_ATBuffer + len;
         }
 
         do {
-            count = read(s_fd, p_read,
-                            MAX_AT_RESPONSE - (p_read - s_ATBuffer));
+            count = read(s_fd, s_ATBufferEnd,
+                            MAX_AT_RESPONSE - (s_ATBufferEnd - s_ATBuffer));
         } while (count < 0 && errno == EINTR);
 
-        if (count > 0) {
-            AT_DUMP( "<< ", p_read, count );
-
-            p_read[count] = '\0';
-
-            // skip over leading newlines
-            while (*s_ATBufferCur == '\r' || *s_ATBufferCur == '\n')
-                s_ATBufferCur++;
-
-            p_eol = findNextEOL(s_ATBufferCur);
-            p_read += count;
-        } else if (count <= 0) {
+        if (count <= 0) {
             /* read error encountered or EOF reached */
             if(count == 0) {
                 RLOGD("atchannel: EOF reached");
@@ -394,14 +552,21 @@ static const char *readline()
             }
             return NULL;
         }
+
+        AT_DUMP( "<< ", s_ATBufferEnd, count );
+
+        s_ATBufferEnd += count;
+        *s_ATBufferEnd = '\0';
     }
 
     /* a full line in the buffer. Place a \0 over the \r and return */
 
     ret = s_ATBufferCur;
-    *p_eol = '\0';
-    s_ATBufferCur = p_eol + 1; /* this will always be <= p_read,    */
-                              /* and there will be a \0 at *p_read */
+    if (p_eol < s_ATBufferEnd) {
+        *p_eol = '\0';
+        p_eol++;
+    } /* else the "> " prompt, which already ends with the \0 at *s_ATBufferEnd */
+    s_ATBufferCur = s_ATBufferScan = p_eol;
 
     RLOGD("AT< %s\n", ret);
     return ret;
@@ -416,7 +581,7 @@ static void onReaderClosed()
 
         s_readerClosed = 1;
 
-        pthread_cond_signal(&s_commandcond);
+        pthread_cond_broadcast(&s_commandcond);
 
         pthread_mutex_unlock(&s_commandmutex);
 
@@ -550,18 +715,6 @@ static int writeCtrlZ (const char *s)
     return 0;
 }
 
-static void clearPendingCommand()
-{
-    if (sp_response != NULL) {
-        at_response_free(sp_response);
-    }
-
-    sp_response = NULL;
-    s_responsePrefix = NULL;
-    s_smsPDU = NULL;
-}
-
-
 /**
  * Starts AT handler on stream "fd'
  * returns 0 on success, -1 on error
@@ -576,9 +729,12 @@ int at_open(int fd, ATUnsolHandler h)
     s_unsolHandler = h;
     s_readerClosed = 0;
 
-    s_responsePrefix = NULL;
-    s_smsPDU = NULL;
-    sp_response = NULL;
+    sp_pendingHead = NULL;
+    sp_pendingTail = NULL;
+    s_pendingCount = 0;
+    s_smsPending = 0;
+
+    s_ATBufferCur = s_ATBufferEnd = s_ATBufferScan = s_ATBuffer;
 
     pthread_attr_init (&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
@@ -606,7 +762,7 @@ void at_close()
 
     s_readerClosed = 1;
 
-    pthread_cond_signal(&s_commandcond);
+    pthread_cond_broadcast(&s_commandcond);
 
     pthread_mutex_unlock(&s_commandmutex);
 
@@ -615,54 +771,104 @@ void at_close()
 
 static ATResponse * at_response_new()
 {
-    return (ATResponse *) calloc(1, sizeof(ATResponse));
+    ATResponseNode *p_node;
+
+    pthread_mutex_lock(&s_poolmutex);
+
+    p_node = sp_freeResponses;
+    if (p_node != NULL) {
+        sp_freeResponses = p_node->p_nextFree;
+        s_freeResponseCount--;
+    }
+
+    pthread_mutex_unlock(&s_poolmutex);
+
+    if (p_node == NULL) {
+        p_node = (ATResponseNode *) malloc(sizeof(ATResponseNode));
+    }
+
+    memset(&p_node->response, 0, sizeof(p_node->response));
+    p_node->p_lastIntermediate = NULL;
+    p_node->p_nextFree = NULL;
+
+    return &p_node->response;
 }
 
 void at_response_free(ATResponse *p_response)
 {
-    ATLine *p_line;
+    ATResponseNode *p_node = (ATResponseNode *) p_response;
 
     if (p_response == NULL) return;
 
-    p_line = p_response->p_intermediates;
+    freeLines(p_response->p_intermediates);
 
-    while (p_line != NULL) {
-        ATLine *p_toFree;
+    if (p_response->finalResponse != p_node->finalStorage) {
+        free (p_response->finalResponse);
+    }
 
-        p_toFree = p_line;
-        p_line = p_line->p_next;
+    pthread_mutex_lock(&s_poolmutex);
 
-        free(p_toFree->line);
-        free(p_toFree);
+    if (s_freeResponseCount < MAX_FREE_RESPONSES) {
+        p_node->p_nextFree = sp_freeResponses;
+        sp_freeResponses = p_node;
+        s_freeResponseCount++;
+        p_node = NULL;
     }
 
-    free (p_response->finalResponse);
-    free (p_response);
+    pthread_mutex_unlock(&s_poolmutex);
+
+    free (p_node);
 }
 
 /**
- * The line reader places the intermediate responses in reverse order
- * here we flip them back
+ * returns 1 if a command can't be sent yet
+ * assumes s_commandmutex is held
  */
-static void reverseIntermediates(ATResponse *p_response)
+static int isChannelBusy(const char *smspdu)
 {
-    ATLine *pcur,*pnext;
+    if (s_channelReserved
+            && 0 == pthread_equal(s_tid_reserved, pthread_self())) {
+        return 1;
+    }
+
+    if (s_smsPending) {
+        return 1;
+    }
+
+    /* the "> " prompt is only looked for as the response to the oldest
+       pending command */
+    if (smspdu != NULL && s_pendingCount > 0) {
+        return 1;
+    }
 
-    pcur = p_response->p_intermediates;
-    p_response->p_intermediates = NULL;
+    return s_pendingCount >= s_pipelineDepth;
+}
 
-    while (pcur != NULL) {
-        pnext = pcur->p_next;
-        pcur->p_next = p_response->p_intermediates;
-        p_response->p_intermediates = pcur;
-        pcur = pnext;
+/**
+ * Waits for s_commandcond, assumes s_commandmutex is held
+ *
+ * timeoutMsec == 0 means infinite timeout
+ */
+static int waitForCommandCond(long long timeoutMsec, const struct timespec *p_ts)
+{
+    if (timeoutMsec == 0) {
+        return pthread_cond_wait(&s_commandcond, &s_commandmutex);
     }
+
+#ifdef USE_NP
+    (void) p_ts;
+    return pthread_cond_timeout_np(&s_commandcond, &s_commandmutex, timeoutMsec);
+#else
+    return pthread_cond_timedwait(&s_commandcond, &s_commandmutex, p_ts);
+#endif /*USE_NP*/
 }
 
 /**
  * Internal send_command implementation
  * Doesn't lock or call the timeout callback
  *
+ * Waits for a free slot if s_pipelineDepth commands are already pending.
+ *
  * timeoutMsec == 0 means infinite timeout
  */
 
@@ -671,42 +877,45 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
                     long long timeoutMsec, ATResponse **pp_outResponse)
 {
     int err = 0;
-#ifndef USE_NP
+    ATCommand cmd;
     struct timespec ts;
+
+    memset(&ts, 0, sizeof(ts));
+
+#ifndef USE_NP
+    if (timeoutMsec != 0) {
+        setTimespecRelative(&ts, timeoutMsec);
+    }
 #endif /*USE_NP*/
 
-    if(sp_response != NULL) {
-        err = AT_ERROR_COMMAND_PENDING;
-        goto error;
+    while (s_readerClosed == 0 && isChannelBusy(smspdu)) {
+        err = waitForCommandCond(timeoutMsec, &ts);
+
+        if (err == ETIMEDOUT) {
+            /* nothing was written, so the modem isn't out of sync */
+            return AT_ERROR_CHANNEL_BUSY;
+        }
     }
 
     err = writeline (command);
 
     if (err < 0) {
-        goto error;
+        return err;
     }
 
-    s_type = type;
-    s_responsePrefix = responsePrefix;
-    s_smsPDU = smspdu;
-    sp_response = at_response_new();
+    cmd.type = type;
+    cmd.responsePrefix = responsePrefix;
+    cmd.smsPDU = smspdu;
+    cmd.p_response = at_response_new();
 
-#ifndef USE_NP
-    if (timeoutMsec != 0) {
-        setTimespecRelative(&ts, timeoutMsec);
+    appendPendingCommand(&cmd);
+
+    if (smspdu != NULL) {
+        s_smsPending = 1;
     }
-#endif /*USE_NP*/
 
-    while (sp_response->finalResponse == NULL && s_readerClosed == 0) {
-        if (timeoutMsec != 0) {
-#ifdef USE_NP
-            err = pthread_cond_timeout_np(&s_commandcond, &s_commandmutex, timeoutMsec);
-#else
-            err = pthread_cond_timedwait(&s_commandcond, &s_commandmutex, &ts);
-#endif /*USE_NP*/
-        } else {
-            err = pthread_cond_wait(&s_commandcond, &s_commandmutex);
-        }
+    while (cmd.p_response->finalResponse == NULL && s_readerClosed == 0) {
+        err = waitForCommandCond(timeoutMsec, &ts);
 
         if (err == ETIMEDOUT) {
             err = AT_ERROR_TIMEOUT;
@@ -714,24 +923,31 @@ static int at_send_command_full_nolock (const char *command, ATCommandType type,
         }
     }
 
+    if(s_readerClosed > 0) {
+        err = AT_ERROR_CHANNEL_CLOSED;
+        goto error;
+    }
+
     if (pp_outResponse == NULL) {
-        at_response_free(sp_response);
+        at_response_free(cmd.p_response);
     } else {
-        /* line reader stores intermediate responses in reverse order */
-        reverseIntermediates(sp_response);
-        *pp_outResponse = sp_response;
+        *pp_outResponse = cmd.p_response;
     }
 
-    sp_response = NULL;
+    return 0;
 
-    if(s_readerClosed > 0) {
-        err = AT_ERROR_CHANNEL_CLOSED;
-        goto error;
+error:
+    /* still pending unless the reader closed after it completed. A late
+       response will be taken as the next command's, as it always was */
+    removePendingCommand(&cmd);
+
+    if (smspdu != NULL) {
+        s_smsPending = 0;
     }
 
-    err = 0;
-error:
-    clearPendingCommand();
+    at_response_free(cmd.p_response);
+
+    pthread_cond_broadcast(&s_commandcond);
 
     return err;
 }
@@ -888,6 +1104,17 @@ void at_set_on_reader_closed(void (*onClose)(void))
     s_onReaderClosed = onClose;
 }
 
+void at_set_pipeline_depth(int depth)
+{
+    pthread_mutex_lock(&s_commandmutex);
+
+    s_pipelineDepth = depth < 1 ? 1 : depth;
+
+    pthread_cond_broadcast(&s_commandcond);
+
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
 
 /**
  * Periodically issue an AT command and wait for a response.
@@ -906,6 +1133,15 @@ int at_handshake()
 
     pthread_mutex_lock(&s_commandmutex);
 
+    /* take the channel once the pending commands complete, so that nothing
+       else is sent while the modem syncs up */
+    while (s_readerClosed == 0 && (s_channelReserved || s_pendingCount > 0)) {
+        pthread_cond_wait(&s_commandcond, &s_commandmutex);
+    }
+
+    s_channelReserved = 1;
+    s_tid_reserved = pthread_self();
+
     for (i = 0 ; i < HANDSHAKE_RETRY_COUNT ; i++) {
         /* some stacks start with verbose off */
         err = at_send_command_full_nolock ("ATE0Q0V1", NO_RESULT,
@@ -923,6 +1159,10 @@ int at_handshake()
         sleepMsec(HANDSHAKE_TIMEOUT_MSEC);
     }
 
+    s_channelReserved = 0;
+
+    pthread_cond_broadcast(&s_commandcond);
+
     pthread_mutex_unlock(&s_commandmutex);
 
     return err;
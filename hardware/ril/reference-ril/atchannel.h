@@ -41,6 +41,8 @@ extern void  AT_DUMP(const char* prefix, const char*  buff, int  len);
 #define AT_ERROR_INVALID_RESPONSE -6 /* eg an at_send_command_singleline that
                                         did not get back an intermediate
                                         response */
+#define AT_ERROR_CHANNEL_BUSY -7 /* no pipeline slot came free before the
+                                    timeout, so the command was never sent */
 
 
 typedef enum {
@@ -87,6 +89,13 @@ void at_set_on_timeout(void (*onTimeout)(void));
    channel is already closed */
 void at_set_on_reader_closed(void (*onClose)(void));
 
+/* Allows up to "depth" commands to be outstanding at once, for modems
+   that accept pipelined AT commands. Responses are matched to commands
+   in the order the commands were sent. The default of 1 waits for each
+   final response before the next command is sent. SMS commands and
+   at_handshake() always have the channel to themselves */
+void at_set_pipeline_depth(int depth);
+
 int at_send_command_singleline (const char *command,
                                 const char *responsePrefix,
                                  ATResponse **pp_outResponse);
@@ -3278,7 +3278,8 @@ static void usage(char *s)
 #ifdef RIL_SHLIB
     fprintf(stderr, "reference-ril requires: -p <tcp port> or -d /dev/tty_device\n");
 #else
-    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device]\n", s);
+    fprintf(stderr, "usage: %s [-p <tcp port>] [-d /dev/tty_device]"
+                    " [-P <pipelined AT commands>]\n", s);
     exit(-1);
 #endif
 }
@@ -3377,7 +3378,7 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
 
     s_rilenv = env;
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:"))) {
+    while ( -1 != (opt = getopt(argc, argv, "p:d:s:c:P:"))) {
         switch (opt) {
             case 'p':
                 s_port = atoi(optarg);
@@ -3403,6 +3404,11 @@ const RIL_RadioFunctions *RIL_Init(const struct RIL_Env *env, int argc, char **a
                 RLOGI("Client id received %s\n", optarg);
             break;
 
+            case 'P':
+                at_set_pipeline_depth(atoi(optarg));
+                RLOGI("Pipelining up to %d AT commands\n", atoi(optarg));
+            break;
+
             default:
                 usage(argv[0]);
                 return NULL;
@@ -3432,7 +3438,7 @@ int main (int argc, char **argv)
     int fd = -1;
     int opt;
 
-    while ( -1 != (opt = getopt(argc, argv, "p:d:"))) {
+    while ( -1 != (opt = getopt(argc, argv, "p:d:P:"))) {
         switch (opt) {
             case 'p':
                 s_port = atoi(optarg);
@@ -3453,6 +3459,11 @@ int main (int argc, char **argv)
                 RLOGI("Opening socket %s\n", s_device_path);
             break;
 
+            case 'P':
+                at_set_pipeline_depth(atoi(optarg));
+                RLOGI("Pipelining up to %d AT commands\n", atoi(optarg));
+            break;
+
             default:
                 usage(argv[0]);
         }
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "atchannel.h"
+
+// Drives atchannel against a simulated modem on a pty, from several threads like the RIL
+// does, and reports the commands/sec with and without pipelining.
+
+// Run it like this:
+//
+// make atchannelbench -j32 && \
+// out/host/linux-x86/obj/EXECUTABLES/atchannelbench_intermediates/atchannelbench
+
+static int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *me) {
+    fprintf(stderr, "usage: %s [-t <threads>] [-P <pipeline depth>] [-l <latency us>]"
+                    " [-u <unsolicited Hz>] [-d <duration s>]\n", me);
+    fprintf(stderr, "       -t command threads, default 4\n");
+    fprintf(stderr, "       -P pipeline depth compared to 1, default the number of threads\n");
+    fprintf(stderr, "       -l modem response latency, default 2000\n");
+    fprintf(stderr, "       -u unsolicited responses per second, default 100\n");
+    fprintf(stderr, "       -d duration of each run, default 3\n");
+    exit(1);
+}
+
+/*
+ * A modem that answers each command a fixed latency after it was received, whether or not
+ * the previous ones were answered yet, like one at the end of a link with some latency.
+ * "AT+XSEQ=<n>" gets "+XSEQ: <n>" then OK, anything else gets OK. Unsolicited "+CREG:"
+ * lines are sent in between.
+ */
+struct Modem {
+    int fd;
+    int64_t latencyNs;
+    int unsolicitedHz;
+    int64_t unsolicitedSent;
+};
+
+struct PendingResponse {
+    int64_t dueNs;
+    std::string text;
+};
+
+static void writeAll(int fd, const std::string &s) {
+    size_t cur = 0;
+    while (cur < s.size()) {
+        ssize_t written = write(fd, s.data() + cur, s.size() - cur);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        cur += written;
+    }
+}
+
+static void *modemLoop(void *arg) {
+    Modem *modem = (Modem *) arg;
+    std::deque<PendingResponse> pending;
+    std::string command;
+    int64_t unsolicitedPeriodNs = modem->unsolicitedHz > 0
+            ? 1000000000LL / modem->unsolicitedHz : 0;
+    int64_t nextUnsolicitedNs = nowNs() + unsolicitedPeriodNs;
+    char buf[1024];
+
+    for (;;) {
+        int64_t now = nowNs();
+        int64_t nextNs = pending.empty() ? now + 100000000LL : pending.front().dueNs;
+        if (unsolicitedPeriodNs > 0) {
+            nextNs = std::min(nextNs, nextUnsolicitedNs);
+        }
+        int timeoutMs = nextNs > now ? (int) ((nextNs - now + 999999) / 1000000) : 0;
+
+        struct pollfd pfd = { modem->fd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, timeoutMs);
+        if (ret < 0 && errno != EINTR) {
+            return NULL;
+        }
+
+        now = nowNs();
+        if (ret > 0 && (pfd.revents & POLLIN)) {
+            ssize_t count = read(modem->fd, buf, sizeof(buf));
+            if (count <= 0) {
+                return NULL;
+            }
+            for (ssize_t i = 0; i < count; i++) {
+                if (buf[i] != '\r') {
+                    command += buf[i];
+                    continue;
+                }
+                PendingResponse response;
+                response.dueNs = now + modem->latencyNs;
+                if (command.compare(0, 8, "AT+XSEQ=") == 0) {
+                    response.text = "\r\n+XSEQ: " + command.substr(8) + "\r\n\r\nOK\r\n";
+                } else {
+                    response.text = "\r\nOK\r\n";
+                }
+                pending.push_back(response);
+                command.clear();
+            }
+        }
+
+        std::string out;
+        while (!pending.empty() && pending.front().dueNs <= now) {
+            out += pending.front().text;
+            pending.pop_front();
+        }
+        if (unsolicitedPeriodNs > 0 && nextUnsolicitedNs <= now) {
+            out += "\r\n+CREG: 1\r\n";
+            modem->unsolicitedSent++;
+            nextUnsolicitedNs += unsolicitedPeriodNs;
+        }
+        if (!out.empty()) {
+            writeAll(modem->fd, out);
+        }
+    }
+}
+
+static volatile int64_t s_unsolicitedReceived;
+
+static void onUnsolicited(const char *s, const char *) {
+    if (strncmp(s, "+CREG:", 6) == 0) {
+        __sync_fetch_and_add(&s_unsolicitedReceived, 1);
+    }
+}
+
+struct Client {
+    int index;
+    int64_t endNs;
+    int64_t commands;
+    int64_t errors;
+    int64_t mismatches;
+    std::vector<int64_t> latencyNs;
+};
+
+static void *clientLoop(void *arg) {
+    Client *client = (Client *) arg;
+    char command[32];
+    char expected[32];
+
+    for (int64_t i = 0; nowNs() < client->endNs; i++) {
+        int seq = client->index * 100000000 + (int) (i % 100000000);
+        snprintf(command, sizeof(command), "AT+XSEQ=%d", seq);
+        snprintf(expected, sizeof(expected), "+XSEQ: %d", seq);
+
+        ATResponse *p_response = NULL;
+        int64_t startNs = nowNs();
+        int err = at_send_command_singleline(command, "+XSEQ:", &p_response);
+        client->latencyNs.push_back(nowNs() - startNs);
+
+        if (err < 0 || p_response->success == 0) {
+            client->errors++;
+        } else if (strcmp(p_response->p_intermediates->line, expected) != 0) {
+            client->mismatches++;
+        }
+        client->commands++;
+        at_response_free(p_response);
+    }
+    return NULL;
+}
+
+static int64_t percentile(std::vector<int64_t> &samples, int p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, samples.size() * p / 100);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Returns false if any response went to the wrong command.
+static bool run(int threads, int depth, int durationS) {
+    at_set_pipeline_depth(depth);
+
+    std::vector<Client> clients(threads);
+    std::vector<pthread_t> tids(threads);
+    int64_t startNs = nowNs();
+    for (int i = 0; i < threads; i++) {
+        clients[i].index = i;
+        clients[i].endNs = startNs + durationS * 1000000000LL;
+        clients[i].commands = clients[i].errors = clients[i].mismatches = 0;
+        pthread_create(&tids[i], NULL, clientLoop, &clients[i]);
+    }
+
+    int64_t commands = 0, errors = 0, mismatches = 0;
+    std::vector<int64_t> latencyNs;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+        commands += clients[i].commands;
+        errors += clients[i].errors;
+        mismatches += clients[i].mismatches;
+        latencyNs.insert(latencyNs.end(), clients[i].latencyNs.begin(),
+                clients[i].latencyNs.end());
+    }
+    double elapsedS = (nowNs() - startNs) / 1E9;
+
+    printf("pipeline depth %d, %d threads:\n", depth, threads);
+    printf("  %lld commands in %.2f s, %.0f commands/s\n",
+            (long long) commands, elapsedS, commands / elapsedS);
+    printf("  command latency p50 %.2f ms, p99 %.2f ms\n",
+            percentile(latencyNs, 50) / 1E6, percentile(latencyNs, 99) / 1E6);
+    printf("  %lld errors, %lld mismatched responses\n",
+            (long long) errors, (long long) mismatches);
+    return errors == 0 && mismatches == 0;
+}
+
+int main(int argc, char **argv) {
+    const char *me = argv[0];
+    int threads = 4;
+    int depth = -1;
+    int latencyUs = 2000;
+    int unsolicitedHz = 100;
+    int durationS = 3;
+
+    int res;
+    while ((res = getopt(argc, argv, "t:P:l:u:d:")) >= 0) {
+        switch (res) {
+            case 't': threads = atoi(optarg); break;
+            case 'P': depth = atoi(optarg); break;
+            case 'l': latencyUs = atoi(optarg); break;
+            case 'u': unsolicitedHz = atoi(optarg); break;
+            case 'd': durationS = atoi(optarg); break;
+            default: usage(me);
+        }
+    }
+    if (depth < 0) {
+        depth = threads;
+    }
+    if (threads < 1 || depth < 1 || latencyUs < 0 || unsolicitedHz < 0 || durationS < 1) {
+        usage(me);
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        return EXIT_FAILURE;
+    }
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        perror("open pty");
+        return EXIT_FAILURE;
+    }
+
+    // No echo, no \r to \n translation, as on a modem's serial port.
+    struct termios ios;
+    tcgetattr(slave, &ios);
+    cfmakeraw(&ios);
+    tcsetattr(slave, TCSANOW, &ios);
+
+    Modem modem = { master, latencyUs * 1000LL, unsolicitedHz, 0 };
+    pthread_t modemTid;
+    pthread_create(&modemTid, NULL, modemLoop, &modem);
+
+    if (at_open(slave, onUnsolicited) < 0) {
+        fprintf(stderr, "at_open failed\n");
+        return EXIT_FAILURE;
+    }
+    if (at_handshake() < 0) {
+        fprintf(stderr, "handshake with the simulated modem failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("modem latency %d us, %d unsolicited/s\n", latencyUs, unsolicitedHz);
+    bool ok = run(threads, 1, durationS);
+    ok = run(threads, depth, durationS) && ok;
+    printf("%lld/%lld unsolicited responses received\n",
+            (long long) s_unsolicitedReceived, (long long) modem.unsolicitedSent);
+
+    // The reader and modem threads never return, leave the channel open.
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
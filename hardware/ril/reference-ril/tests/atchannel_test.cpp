@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// The timed sends are internal to atchannel, only the handshake uses them.
+extern "C" {
+#include "atchannel.c"
+}
+
+// Drives atchannel against a modem on a pty that answers every command with OK, in order,
+// except that it holds back the answer to "AT+HOLD", and to everything after it, until the
+// test releases them.
+
+namespace {
+
+struct Modem {
+    int fd;
+    pthread_mutex_t lock;
+    std::vector<std::string> received;
+    int held;       // answers held back
+};
+
+Modem s_modem;
+int s_timeouts;
+
+void writeAll(int fd, const char *s) {
+    size_t length = strlen(s);
+    while (length > 0) {
+        ssize_t written = write(fd, s, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return;
+        }
+        s += written;
+        length -= written;
+    }
+}
+
+void *modemLoop(void *) {
+    std::string command;
+    char buf[256];
+    for (;;) {
+        ssize_t count = read(s_modem.fd, buf, sizeof(buf));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return NULL;
+        }
+        for (ssize_t i = 0; i < count; i++) {
+            if (buf[i] != '\r') {
+                command += buf[i];
+                continue;
+            }
+            pthread_mutex_lock(&s_modem.lock);
+            s_modem.received.push_back(command);
+            if (command == "AT+HOLD" || s_modem.held > 0) {
+                s_modem.held++;
+            } else {
+                writeAll(s_modem.fd, "\r\nOK\r\n");
+            }
+            pthread_mutex_unlock(&s_modem.lock);
+            command.clear();
+        }
+    }
+}
+
+void releaseHeld() {
+    pthread_mutex_lock(&s_modem.lock);
+    for (; s_modem.held > 0; s_modem.held--) {
+        writeAll(s_modem.fd, "\r\nOK\r\n");
+    }
+    pthread_mutex_unlock(&s_modem.lock);
+}
+
+std::vector<std::string> received() {
+    pthread_mutex_lock(&s_modem.lock);
+    std::vector<std::string> commands = s_modem.received;
+    s_modem.received.clear();
+    pthread_mutex_unlock(&s_modem.lock);
+    return commands;
+}
+
+void onUnsolicited(const char *, const char *) {
+}
+
+void onTimeout() {
+    s_timeouts++;
+}
+
+void *sendHold(void *arg) {
+    *(int *) arg = at_send_command("AT+HOLD", NULL);
+    return NULL;
+}
+
+void *sendAt(void *arg) {
+    *(int *) arg = at_send_command("AT", NULL);
+    return NULL;
+}
+
+// Waits for the reader to have count commands outstanding.
+void waitForPending(int count) {
+    pthread_mutex_lock(&s_commandmutex);
+    while (s_pendingCount < count) {
+        pthread_mutex_unlock(&s_commandmutex);
+        usleep(1000);
+        pthread_mutex_lock(&s_commandmutex);
+    }
+    pthread_mutex_unlock(&s_commandmutex);
+}
+
+class AtChannelTest : public ::testing::Test {
+ protected:
+    static void SetUpTestCase() {
+        int master = posix_openpt(O_RDWR | O_NOCTTY);
+        ASSERT_GE(master, 0);
+        ASSERT_EQ(0, grantpt(master));
+        ASSERT_EQ(0, unlockpt(master));
+        int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+        ASSERT_GE(slave, 0);
+
+        // No echo, no \r to \n translation, as on a modem's serial port.
+        struct termios ios;
+        tcgetattr(slave, &ios);
+        cfmakeraw(&ios);
+        tcsetattr(slave, TCSANOW, &ios);
+
+        s_modem.fd = master;
+        pthread_mutex_init(&s_modem.lock, NULL);
+        s_modem.held = 0;
+        pthread_t tid;
+        pthread_create(&tid, NULL, modemLoop, NULL);
+
+        ASSERT_EQ(0, at_open(slave, onUnsolicited));
+        at_set_on_timeout(::onTimeout);
+        ASSERT_EQ(0, at_handshake());
+    }
+
+    virtual void SetUp() {
+        at_set_pipeline_depth(1);
+        received();
+        s_timeouts = 0;
+    }
+};
+
+TEST_F(AtChannelTest, SendsAndCompletes) {
+    ATResponse *p_response = NULL;
+    ASSERT_EQ(0, at_send_command("AT+CFUN=1", &p_response));
+    EXPECT_EQ(1, p_response->success);
+    EXPECT_STREQ("OK", p_response->finalResponse);
+    at_response_free(p_response);
+
+    std::vector<std::string> commands = received();
+    ASSERT_EQ(1u, commands.size());
+    EXPECT_EQ("AT+CFUN=1", commands[0]);
+}
+
+// A command that times out waiting for a pipeline slot was never written, so it mustn't be
+// taken for a modem that stopped answering.
+TEST_F(AtChannelTest, SlotWaitTimeoutIsNotATimeout) {
+    int holdErr = -1;
+    pthread_t tid;
+    pthread_create(&tid, NULL, sendHold, &holdErr);
+    waitForPending(1);
+
+    EXPECT_EQ(AT_ERROR_CHANNEL_BUSY,
+            at_send_command_full("AT", NO_RESULT, NULL, NULL, 50, NULL));
+    EXPECT_EQ(0, s_timeouts);
+
+    releaseHeld();
+    pthread_join(tid, NULL);
+    EXPECT_EQ(0, holdErr);
+
+    std::vector<std::string> commands = received();
+    ASSERT_EQ(1u, commands.size());
+    EXPECT_EQ("AT+HOLD", commands[0]);
+}
+
+// With more slots than pending commands, a command is written without waiting for the ones
+// before it.
+TEST_F(AtChannelTest, PipelinedCommandIsNotHeldBack) {
+    at_set_pipeline_depth(2);
+
+    int holdErr = -1, atErr = -1;
+    pthread_t holdTid, atTid;
+    pthread_create(&holdTid, NULL, sendHold, &holdErr);
+    waitForPending(1);
+    pthread_create(&atTid, NULL, sendAt, &atErr);
+    waitForPending(2);
+
+    releaseHeld();
+    pthread_join(holdTid, NULL);
+    pthread_join(atTid, NULL);
+    EXPECT_EQ(0, holdErr);
+    EXPECT_EQ(0, atErr);
+    EXPECT_EQ(0, s_timeouts);
+
+    std::vector<std::string> commands = received();
+    ASSERT_EQ(2u, commands.size());
+    EXPECT_EQ("AT+HOLD", commands[0]);
+    EXPECT_EQ("AT", commands[1]);
+}
+
+// Last: the late OK that a timed out command leaves behind is taken as an unsolicited line.
+TEST_F(AtChannelTest, ResponseTimeoutCallsOnTimeout) {
+    EXPECT_EQ(AT_ERROR_TIMEOUT,
+            at_send_command_full("AT+HOLD", NO_RESULT, NULL, NULL, 50, NULL));
+    EXPECT_EQ(1, s_timeouts);
+
+    std::vector<std::string> commands = received();
+    ASSERT_EQ(1u, commands.size());
+    EXPECT_EQ("AT+HOLD", commands[0]);
+}
+
+}  // namespace
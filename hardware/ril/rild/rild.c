@@ -60,6 +60,8 @@ extern void RIL_onRequestComplete(RIL_Token t, RIL_Errno e,
 
 extern void RIL_setRilSocketName(char *);
 
+extern void RIL_setDispatchPerSocket(int enable);
+
 #if defined(ANDROID_MULTI_SIM)
 extern void RIL_onUnsolicitedResponse(int unsolResponse, const void *data,
         size_t datalen, RIL_SOCKET_ID socket_id);
@@ -142,6 +144,7 @@ int main(int argc, char **argv) {
     void *dlHandle;
     const RIL_RadioFunctions *(*rilInit)(const struct RIL_Env *, int, char **);
     const RIL_RadioFunctions *(*rilUimInit)(const struct RIL_Env *, int, char **);
+    const int *dispatchPerSocket;
     char *err_str = NULL;
 
     const RIL_RadioFunctions *funcs;
@@ -349,6 +352,12 @@ OpenLib:
     funcs = rilInit(&s_rilEnv, argc, rilArgv);
     RLOGD("RIL_Init rilInit completed");
 
+    dispatchPerSocket = (const int *) dlsym(dlHandle, "RIL_DispatchPerSocket");
+    if (dispatchPerSocket != NULL && *dispatchPerSocket) {
+        RLOGD("RIL_Init dispatching requests per socket");
+        RIL_setDispatchPerSocket(1);
+    }
+
     RIL_register(funcs);
 
     RLOGD("RIL_Init RIL_register completed");
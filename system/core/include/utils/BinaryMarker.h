@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BINARY_MARKER_H
+#define ANDROID_BINARY_MARKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// See <utils/Trace.h> for the markers this stands in for.
+
+// ATRACE_BINARY_NAME is an ATRACE_NAME that goes through BinaryMarker.
+#define ATRACE_BINARY_NAME(name) android::ScopedBinaryTrace ___binary_tracer(ATRACE_TAG, name)
+
+namespace android {
+
+/*
+ * A variant of atrace_begin(), atrace_end() and atrace_int() for code that
+ * marks a great many sections.  Rather than formatting each marker and
+ * writing it to trace_marker, the markers are kept as binary records in a
+ * buffer for each thread, and written out a batch at a time: when the buffer
+ * is full, when the thread exits, when flush() is called, and otherwise no
+ * later than about 100 ms after the batch was started.  Converting a binary
+ * capture (atrace --binary) turns them back into the same lines atrace_begin()
+ * and friends would have written.
+ *
+ * A text trace would show the batches as unreadable tracing_mark_write lines,
+ * so markers are only batched while atrace --binary has
+ * kBinaryCaptureProperty set, and otherwise written as atrace_begin() and
+ * friends write them.  atrace clears the property and waits for the batches
+ * to be written before it stops tracing.
+ *
+ * Markers are only recorded while the tag is enabled, as with atrace_begin().
+ */
+class BinaryMarker {
+public:
+    static void begin(uint64_t tag, const char* name);
+    static void end(uint64_t tag);
+    static void setInt(uint64_t tag, const char* name, int32_t value);
+
+    // Writes out what the calling thread has buffered.
+    static void flush();
+
+    // Writes to fd rather than trace_marker, batching whether or not a binary
+    // capture is running, for testing; -1 goes back to trace_marker.
+    static void setMarkerFd(int fd);
+};
+
+class ScopedBinaryTrace {
+public:
+    inline ScopedBinaryTrace(uint64_t tag, const char* name) : mTag(tag) {
+        BinaryMarker::begin(mTag, name);
+    }
+
+    inline ~ScopedBinaryTrace() {
+        BinaryMarker::end(mTag);
+    }
+
+private:
+    uint64_t mTag;
+};
+
+// "1" while atrace is capturing the trace buffers in binary.
+static const char* const kBinaryCaptureProperty = "debug.atrace.binary";
+
+// The longest a batch is held before it is written.
+static const int64_t kBinaryMarkerMaxBatchAgeNs = 100000000;
+
+/*
+ * The batches go to trace_marker, one write() for many markers, each batch
+ * this header and then the records.  A record is its type, then the
+ * nanoseconds since the record before it (or since baseNs) as a varint, then
+ * for BEGIN and INT the name as a length byte and that many bytes, then for
+ * INT the value as a zigzag varint.
+ *
+ * flushNs is when the batch was written, so that the converter can place the
+ * records against the time the kernel gave the write.  The write may come from
+ * another thread than the one that recorded the markers, so tid is given too.
+ */
+static const char kBinaryMarkerMagic[4] = { '\x01', 'A', 'T', 'B' };
+
+struct BinaryMarkerBatch {
+    char magic[4];
+    int32_t tgid;
+    int32_t tid;        // that recorded the markers
+    uint16_t length;    // of the records
+    uint16_t count;
+    int64_t baseNs;     // CLOCK_MONOTONIC
+    int64_t flushNs;
+} __attribute__((packed));
+
+enum {
+    BINARY_MARKER_BEGIN = 'B',
+    BINARY_MARKER_END = 'E',
+    BINARY_MARKER_INT = 'C',
+};
+
+// The kernel truncates trace_marker writes to a little more than this.
+static const size_t kBinaryMarkerMaxBatch = 1000;
+
+}; // namespace android
+
+#endif // ANDROID_BINARY_MARKER_H
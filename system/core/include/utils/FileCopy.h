@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_FILECOPY_H
+#define ANDROID_UTILS_FILECOPY_H
+
+#include <sys/types.h>
+
+#include <utils/Compat.h>
+
+namespace android {
+
+/*
+ * Copies length bytes at inOff in the file in to outOff in the file out without bringing
+ * them into user space: with copy_file_range() where the kernel has it and both files are
+ * on one filesystem, with sendfile() otherwise.  The file offset of in is left alone; that
+ * of out may be moved, so threads copying at once each need their own fd for out.
+ *
+ * Returns the bytes copied, fewer than length only if in ends first, or -1 with errno set.
+ */
+ssize_t copyFileRange(int in, off64_t inOff, int out, off64_t outOff, size_t length);
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_FILECOPY_H
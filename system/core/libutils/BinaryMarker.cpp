@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include <cutils/properties.h>
+#include <cutils/trace.h>
+
+#include <utils/BinaryMarker.h>
+
+namespace android {
+
+struct PackedBatch {
+    BinaryMarkerBatch header;
+    uint8_t records[kBinaryMarkerMaxBatch - sizeof(BinaryMarkerBatch)];
+} __attribute__((packed));
+
+struct MarkerBuffer {
+    PackedBatch batch;
+    int64_t lastNs;
+    // Held by the thread while it records, and by the flush thread while it
+    // writes the batch out from under it.
+    pthread_mutex_t lock;
+    MarkerBuffer* prev;
+    MarkerBuffer* next;
+};
+
+static pthread_once_t gInitOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gBufferKey;
+static int gTraceMarkerFd = -1;
+static volatile int gMarkerFd = -1;
+
+// Every thread's buffer, for the flush thread.
+static pthread_mutex_t gListLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gListCond = PTHREAD_COND_INITIALIZER;
+static MarkerBuffer* gBuffers = NULL;
+static bool gFlushThreadStarted = false;
+static std::atomic<bool> gFlushPending(false);
+
+// Whether a binary capture is running, looked up again once it's this old.
+static std::atomic<int64_t> gCaptureCheckNs(0);
+static std::atomic<bool> gCapturing(false);
+
+static int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static size_t putVarint(uint8_t* out, uint64_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+// Must be called with buffer->lock held.
+static void flushBuffer(MarkerBuffer* buffer) {
+    BinaryMarkerBatch* header = &buffer->batch.header;
+    if (header->count == 0) {
+        return;
+    }
+    int fd = gMarkerFd >= 0 ? gMarkerFd : gTraceMarkerFd;
+    header->flushNs = monotonicNs();
+    // A batch that can't be written is dropped, as a marker would be.
+    if (fd >= 0) {
+        TEMP_FAILURE_RETRY(write(fd, header, sizeof(*header) + header->length));
+    }
+    header->length = 0;
+    header->count = 0;
+}
+
+// Writes out every batch once kBinaryMarkerMaxBatchAgeNs has passed, and
+// sleeps for as long as nothing is buffered.
+static void* flushThread(void*) {
+    pthread_mutex_lock(&gListLock);
+    for (;;) {
+        while (!gFlushPending) {
+            pthread_cond_wait(&gListCond, &gListLock);
+        }
+        pthread_mutex_unlock(&gListLock);
+
+        struct timespec ts = { 0, kBinaryMarkerMaxBatchAgeNs };
+        while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        }
+
+        pthread_mutex_lock(&gListLock);
+        gFlushPending = false;
+        for (MarkerBuffer* buffer = gBuffers; buffer != NULL; buffer = buffer->next) {
+            if (pthread_mutex_trylock(&buffer->lock) == 0) {
+                flushBuffer(buffer);
+                pthread_mutex_unlock(&buffer->lock);
+            } else {
+                // Being recorded into, so there'll be more to write.
+                gFlushPending = true;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Has the flush thread look at the buffers, starting it if need be.
+static void scheduleFlush() {
+    pthread_mutex_lock(&gListLock);
+    if (!gFlushThreadStarted) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        gFlushThreadStarted = pthread_create(&thread, &attr, flushThread, NULL) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    gFlushPending = true;
+    pthread_cond_signal(&gListCond);
+    pthread_mutex_unlock(&gListLock);
+}
+
+static void destroyBuffer(void* arg) {
+    MarkerBuffer* buffer = static_cast<MarkerBuffer*>(arg);
+
+    pthread_mutex_lock(&gListLock);
+    if (buffer->prev != NULL) {
+        buffer->prev->next = buffer->next;
+    } else {
+        gBuffers = buffer->next;
+    }
+    if (buffer->next != NULL) {
+        buffer->next->prev = buffer->prev;
+    }
+    pthread_mutex_unlock(&gListLock);
+
+    pthread_mutex_lock(&buffer->lock);
+    flushBuffer(buffer);
+    pthread_mutex_unlock(&buffer->lock);
+    pthread_mutex_destroy(&buffer->lock);
+    free(buffer);
+}
+
+static void lockListForFork() {
+    pthread_mutex_lock(&gListLock);
+}
+
+static void unlockListForFork() {
+    pthread_mutex_unlock(&gListLock);
+}
+
+// The child has only the forking thread, and no flush thread: what the parent
+// had buffered isn't the child's to write.
+static void resetListInChild() {
+    MarkerBuffer* buffer = static_cast<MarkerBuffer*>(pthread_getspecific(gBufferKey));
+    gBuffers = buffer;
+    if (buffer != NULL) {
+        buffer->prev = NULL;
+        buffer->next = NULL;
+        buffer->batch.header.tgid = getpid();
+        buffer->batch.header.tid = gettid();
+        buffer->batch.header.length = 0;
+        buffer->batch.header.count = 0;
+    }
+    gFlushThreadStarted = false;
+    gFlushPending = false;
+    pthread_mutex_unlock(&gListLock);
+}
+
+static void init() {
+    pthread_key_create(&gBufferKey, destroyBuffer);
+    pthread_atfork(lockListForFork, unlockListForFork, resetListInChild);
+    gTraceMarkerFd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+}
+
+static MarkerBuffer* getBuffer() {
+    pthread_once(&gInitOnce, init);
+    MarkerBuffer* buffer = static_cast<MarkerBuffer*>(pthread_getspecific(gBufferKey));
+    if (buffer == NULL) {
+        buffer = static_cast<MarkerBuffer*>(calloc(1, sizeof(MarkerBuffer)));
+        if (buffer == NULL) {
+            return NULL;
+        }
+        memcpy(buffer->batch.header.magic, kBinaryMarkerMagic, sizeof(kBinaryMarkerMagic));
+        buffer->batch.header.tgid = getpid();
+        buffer->batch.header.tid = gettid();
+        pthread_mutex_init(&buffer->lock, NULL);
+        pthread_setspecific(gBufferKey, buffer);
+
+        pthread_mutex_lock(&gListLock);
+        buffer->next = gBuffers;
+        if (gBuffers != NULL) {
+            gBuffers->prev = buffer;
+        }
+        gBuffers = buffer;
+        pthread_mutex_unlock(&gListLock);
+    }
+    return buffer;
+}
+
+static bool isCapturing(int64_t now) {
+    if (gMarkerFd >= 0) {
+        return true;
+    }
+    if (now - gCaptureCheckNs > kBinaryMarkerMaxBatchAgeNs) {
+        char value[PROPERTY_VALUE_MAX];
+        property_get(kBinaryCaptureProperty, value, "0");
+        gCapturing = strcmp(value, "1") == 0;
+        gCaptureCheckNs = now;
+    }
+    return gCapturing;
+}
+
+// Returns false if the marker has to be written as text instead.
+static bool record(uint8_t type, const char* name, int32_t value) {
+    int64_t now = monotonicNs();
+    if (!isCapturing(now)) {
+        return false;
+    }
+    MarkerBuffer* buffer = getBuffer();
+    if (buffer == NULL) {
+        return false;
+    }
+
+    // At most the type, the delta, the name and the value.
+    size_t length = type != BINARY_MARKER_END ? strnlen(name, 255) : 0;
+    size_t maxRecord = 1 + 10 + 1 + length + 10;
+
+    pthread_mutex_lock(&buffer->lock);
+    BinaryMarkerBatch* header = &buffer->batch.header;
+    if (header->count > 0 &&
+            (header->length + maxRecord > sizeof(buffer->batch.records) ||
+             now - header->baseNs > kBinaryMarkerMaxBatchAgeNs)) {
+        flushBuffer(buffer);
+    }
+    if (header->count == 0) {
+        header->baseNs = now;
+        buffer->lastNs = now;
+        if (!gFlushPending) {
+            scheduleFlush();
+        }
+    }
+
+    uint8_t* p = buffer->batch.records + header->length;
+    *p++ = type;
+    p += putVarint(p, now - buffer->lastNs);
+    if (type != BINARY_MARKER_END) {
+        *p++ = length;
+        memcpy(p, name, length);
+        p += length;
+    }
+    if (type == BINARY_MARKER_INT) {
+        p += putVarint(p, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+    }
+    buffer->lastNs = now;
+    header->length = p - buffer->batch.records;
+    header->count++;
+    pthread_mutex_unlock(&buffer->lock);
+    return true;
+}
+
+void BinaryMarker::begin(uint64_t tag, const char* name) {
+    if (CC_UNLIKELY(atrace_is_tag_enabled(tag))) {
+        if (!record(BINARY_MARKER_BEGIN, name, 0)) {
+            atrace_begin(tag, name);
+        }
+    }
+}
+
+void BinaryMarker::end(uint64_t tag) {
+    if (CC_UNLIKELY(atrace_is_tag_enabled(tag))) {
+        if (!record(BINARY_MARKER_END, NULL, 0)) {
+            atrace_end(tag);
+        }
+    }
+}
+
+void BinaryMarker::setInt(uint64_t tag, const char* name, int32_t value) {
+    if (CC_UNLIKELY(atrace_is_tag_enabled(tag))) {
+        if (!record(BINARY_MARKER_INT, name, value)) {
+            atrace_int(tag, name, value);
+        }
+    }
+}
+
+void BinaryMarker::flush() {
+    pthread_once(&gInitOnce, init);
+    MarkerBuffer* buffer = static_cast<MarkerBuffer*>(pthread_getspecific(gBufferKey));
+    if (buffer != NULL) {
+        pthread_mutex_lock(&buffer->lock);
+        flushBuffer(buffer);
+        pthread_mutex_unlock(&buffer->lock);
+    }
+}
+
+void BinaryMarker::setMarkerFd(int fd) {
+    gMarkerFd = fd;
+}
+
+}; // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/FileCopy.h>
+
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace android {
+
+// A sendfile() of more than this is cut short by the kernel anyway.
+static const size_t kMaxCopySize = 1024 * 1024 * 1024;
+
+// Kernel headers older than 4.5 don't have copy_file_range, and then it's all sendfile().
+#if defined(__NR_copy_file_range)
+static std::atomic<bool> sHaveCopyFileRange(true);
+#endif
+
+ssize_t copyFileRange(int in, off64_t inOff, int out, off64_t outOff, size_t length) {
+    size_t left = length;
+    while (left > 0) {
+        size_t len = std::min(kMaxCopySize, left);
+        ssize_t n = -1;
+        bool fallback = true;
+#if defined(__NR_copy_file_range)
+        if (sHaveCopyFileRange) {
+            n = syscall(__NR_copy_file_range, in, &inOff, out, &outOff, len, 0);
+            if (n < 0 && errno == ENOSYS) {
+                sHaveCopyFileRange = false;
+            }
+            // Older kernels only copy_file_range within a filesystem, if at all
+            fallback = n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL
+                    || errno == EOPNOTSUPP);
+        }
+#endif
+        if (fallback) {
+            if (lseek64(out, outOff, SEEK_SET) != outOff) {
+                return -1;
+            }
+            n = sendfile64(out, in, &inOff, len);
+            if (n > 0) {
+                outOff += n;
+            }
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        left -= n;
+    }
+    return length - left;
+}
+
+}; // namespace android